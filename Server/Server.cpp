@@ -8,8 +8,22 @@
 #include <csignal>
 #include <windows.h>
 #include "window_manager.h"
+#include "asset_cache.h"
+#include "asset_store.h"
 #include "renderer.h"
+#include "render_context_cache.h"
+#include "frame_pipeline.h"
+#include "image_scaler.h"
+#include "media_library.h"
 #include "network_server.h"
+#include "pixel_convert.h"
+#include "request_pool.h"
+#include "stream_acknowledger.h"
+#include "transport_compression.h"
+#include "video_decoder_cache.h"
+#include "video_player.h"
+#include "video_source.h"
+#include "work_stealing_pool.h"
 #include "google/protobuf/message.h"
 #include "windowcaster.pb.h"
 
@@ -19,57 +33,201 @@ void signalHandler(int signal) {
 	gSignalStatus = signal;
 }
 
-class WindowCasterServer {
+class WindowCasterServer : public FramePresenter {
 public:
-	WindowCasterServer(uint16_t port)
-		: windowManager(std::make_unique<WindowManager>())
-		, renderer(std::make_unique<Renderer>())
-		, server(std::make_unique<NetworkServer>(port)) {
-		server->SetMessageHandler([this](const std::string& message) {
-			HandleMessage(message);
+	// Uploaded media files are kept in memory up to this total
+	static constexpr uint64_t kMediaUploadBytes = uint64_t(1024) * 1024 * 1024;
+
+	WindowCasterServer(uint16_t port, size_t maxSessions, size_t assetCacheBytes, std::unique_ptr<AssetStore> assetStore,
+		std::string mediaDirectory, const ScaleOptions& scaleOptions, const WorkStealingPool::Options& poolOptions,
+		const FrameBufferPool::Options& bufferOptions)
+		: workers(std::make_unique<WorkStealingPool>(poolOptions))
+		, windowManager(std::make_unique<WindowManager>())
+		, renderContexts(std::make_unique<RenderContextCache>([scaleOptions, this] {
+			return std::make_unique<Renderer>(scaleOptions, workers.get());
+			}))
+		, videoDecoders(std::make_unique<VideoDecoderCache>(CreateSoftwareVideoDecoder))
+		, assets(std::make_unique<AssetCache>(assetCacheBytes, std::move(assetStore)))
+		, media(std::make_unique<MediaLibrary>(kMediaUploadBytes, std::move(mediaDirectory)))
+		, requests(std::make_unique<RequestPool>(RequestPool::kRequestsPerParseThread * FramePipeline::DefaultParseThreads()))
+		, pipeline(std::make_unique<FramePipeline>(*this))
+		, players(std::make_unique<PlaybackController>([this](uint64_t targetWindow, DecodedFrame frame) {
+			return PostPlaybackFrame(targetWindow, std::move(frame));
+			}))
+		, server(std::make_unique<NetworkServer>(port, maxSessions, 0, bufferOptions)) {
+		// Network stage only frames messages, parsing and presenting run on their own threads
+		server->SetMessageHandler([this](const std::shared_ptr<ClientSession>& session, std::shared_ptr<FrameBuffer> message) {
+			pipeline->SubmitMessage(session, std::move(message));
+			});
+		server->SetRawFrameHandler([this](const std::shared_ptr<ClientSession>& session, std::unique_ptr<RawFrame> frame) {
+			pipeline->SubmitRawFrame(session, std::move(frame));
+			});
+		server->SetSessionClosedHandler([this](const std::shared_ptr<ClientSession>& session) {
+			pipeline->CloseSource(session.get());
 			});
+		pipeline->SetMessageHandler([this](const std::shared_ptr<ReplyChannel>& reply, const FrameBuffer& message) {
+			HandleMessage(reply, message);
+			});
+		pipeline->SetRawFrameHandler([this](const std::shared_ptr<ReplyChannel>& reply, std::unique_ptr<RawFrame> frame) {
+			HandleRawFrame(*reply, std::move(frame));
+			});
+	}
+
+	// Threads that work on one frame at once: the pool's workers and the window's present thread
+	size_t FrameThreads() const {
+		return workers->Concurrency();
+	}
+
+	// Whether received messages and raw frames land in huge pages
+	bool BufferHugePages() const {
+		return server->BufferHugePages();
 	}
 
 	bool Start() {
+		pipeline->Start();
 		return server->Start();
 	}
 
 	void Stop() {
 		server->Stop();
+		// Players feed the pipeline on their own threads
+		players->StopAll();
+		pipeline->Stop();
+
+		AssetCache::Stats assetStats = assets->GetStats();
+		std::cout << "Asset cache: " << assetStats.hits << " hits, " << assetStats.misses << " misses, "
+			<< assetStats.insertions << " insertions, " << assetStats.evictions << " evictions, "
+			<< assetStats.idMismatches << " id mismatches, "
+			<< assetStats.assets << " assets (" << assetStats.bytes / (1024 * 1024) << " of "
+			<< assetStats.budgetBytes / (1024 * 1024) << " MB)" << std::endl;
+		if (AssetStore* store = assets->Store()) {
+			store->Flush();
+			AssetStore::Stats storeStats = store->GetStats();
+			std::cout << "Asset store: " << assetStats.storeHits << " hits, " << storeStats.appended << " appended, "
+				<< storeStats.checksumFailures << " checksum failures, " << storeStats.assets << " assets ("
+				<< storeStats.dataBytes / (1024 * 1024) << " MB)" << std::endl;
+		}
+		MediaLibrary::Stats mediaStats = media->GetStats();
+		std::cout << "Media uploads: " << mediaStats.uploads << " files (" << mediaStats.bytes / (1024 * 1024) << " of "
+			<< mediaStats.budgetBytes / (1024 * 1024) << " MB), " << mediaStats.evictions << " evictions, "
+			<< mediaStats.idMismatches << " id mismatches" << std::endl;
+		RequestPool::Stats requestStats = requests->GetStats();
+		std::cout << "Request pool: " << requestStats.reused << " reused (" << requestStats.kept << " with their buffers), "
+			<< requestStats.created << " created, " << requestStats.oversized << " too large to pool, " << requestStats.requests
+			<< " pooled" << std::endl;
+		WorkStealingPool::Stats poolStats = workers->GetStats();
+		std::cout << "Worker pool: " << poolStats.jobs << " parallel jobs, " << poolStats.inlineJobs << " inline, "
+			<< poolStats.tasks << " strips, " << poolStats.stolen << " stolen" << std::endl;
+		FrameBufferPool::Stats bufferStats = server->GetBufferPoolStats();
+		std::cout << "Buffer pool: " << static_cast<int>(bufferStats.HitRate() * 100) << "% hit rate ("
+			<< bufferStats.hits << " hits, " << bufferStats.misses << " misses), " << bufferStats.evictions << " evictions, "
+			<< bufferStats.residentBytes / (1024 * 1024) << " MB resident (peak "
+			<< bufferStats.peakResidentBytes / (1024 * 1024) << " MB, " << bufferStats.hugePageBytes / (1024 * 1024)
+			<< " MB in huge pages)" << std::endl;
+	}
+
+	// Runs on the target window's present thread
+	bool Present(const FrameItem& frame) override {
+		std::shared_ptr<RenderTarget> renderer = renderContexts->Acquire(frame.targetWindow);
+		if (!renderer) {
+			std::cerr << "Renderer initialization failed" << std::endl;
+			return false;
+		}
+
+		if (frame.IsPartial()) {
+			return renderer->RenderDirtyRects(frame.image.width, frame.image.height, frame.dirtyRects);
+		}
+		if (frame.isVideo) {
+			return renderer->RenderVideoFrame(frame.image);
+		}
+		return renderer->RenderImageFrame(frame.image);
+	}
+
+	// Runs on the target window's present thread
+	void Execute(const ControlItem& control) override {
+		switch (control.type) {
+		case ControlItem::Type::StopRender: {
+			std::shared_ptr<RenderTarget> renderer = renderContexts->Acquire(control.targetWindow);
+			if (renderer) {
+				renderer->Clear();
+			}
+			// Release the window's DC and bitmap; the next frame starts a fresh context
+			renderContexts->Invalidate(control.targetWindow);
+			break;
+		}
+		}
+	}
+
+	// Polled for idle present stages; IsWindowValid would also fetch the title, which can block on a hung window
+	bool IsTargetAlive(uint64_t targetWindow) override {
+		return IsWindow(reinterpret_cast<HWND>(targetWindow)) != FALSE;
 	}
 
 private:
-	bool ValidateAndInitialize(HWND hwnd, windowcaster::Status* status) {
+	bool ValidateWindow(HWND hwnd, windowcaster::Status* status) {
 		if (!windowManager->IsWindowValid(hwnd)) {
 			status->set_success(false);
 			status->set_message("Invalid window handle");
 			return false;
 		}
-		if (!renderer->Initialize(hwnd)) {
-			status->set_success(false);
-			status->set_message("Renderer initialization failed");
-			return false;
-		}
 		return true;
 	}
 
-	void HandleMessage(const std::string& message) {
-		windowcaster::ClientRequest request;
-		if (!request.ParseFromString(message)) {
+	void HandleMessage(const std::shared_ptr<ReplyChannel>& channel, const FrameBuffer& message) {
+		ReplyChannel& reply = *channel;
+		// Shared so that queued frames can keep their pixel data alive without copying it; the pool
+		// hands the request out again once they are done with it, pixel buffer and all
+		std::shared_ptr<windowcaster::ClientRequest> request = requests->Parse(message.Data(), message.Size());
+		if (!request) {
 			std::cerr << "Failed to parse message" << std::endl;
 			return;
 		}
 
-		windowcaster::ServerResponse response;
-		switch (request.request_case()) {
+		// One response per parse thread; Clear keeps its status and strings for the next message
+		thread_local windowcaster::ServerResponse response;
+		response.Clear();
+		switch (request->request_case()) {
 		case windowcaster::ClientRequest::kGetWindowList:
 			HandleGetWindowList(response);
 			break;
-		case windowcaster::ClientRequest::kRenderCommand:
-			HandleRenderCommand(request.render_command(), response);
+		case windowcaster::ClientRequest::kRenderCommand: {
+			const auto& command = request->render_command();
+			auto* status = response.mutable_status();
+			bool keyframeNeeded = false;
+			std::unique_ptr<FrameItem> frame;
+			if (command.has_encoded_video()) {
+				frame = DecodeFrame(command, status, keyframeNeeded);
+			}
+			else if (command.has_region_update()) {
+				frame = BuildRegionUpdate(request, status);
+			}
+			else if (command.has_cached_image()) {
+				frame = BuildCachedImage(command, status);
+			}
+			else {
+				frame = BuildFrame(request, status);
+			}
+			QueueFrame(reply, std::move(frame), command.target_window(),
+				command.sequence(), message.Size(), status);
+			if (keyframeNeeded) {
+				RequestKeyframe(reply, command.target_window(), command.sequence(), response);
+			}
+			if (!FoldIntoStreamAck(reply, command.sequence(), response)) {
+				return;
+			}
 			break;
+		}
 		case windowcaster::ClientRequest::kStopRender:
-			HandleStopRender(request.stop_render(), response);
+			HandleStopRender(request->stop_render(), response);
+			break;
+		case windowcaster::ClientRequest::kStreamConfig:
+			HandleStreamConfig(channel, request->stream_config(), response);
+			break;
+		case windowcaster::ClientRequest::kMediaUpload:
+			HandleMediaUpload(request->media_upload(), response);
+			break;
+		case windowcaster::ClientRequest::kPlayback:
+			HandlePlayback(request->playback(), response);
 			break;
 		default:
 			response.mutable_status()->set_success(false);
@@ -77,12 +235,61 @@ private:
 			break;
 		}
 
-		std::string responseStr;
+		SendResponse(reply, response);
+	}
+
+	// Frames from the raw channel: pixels already sit in a pooled buffer, no protobuf involved
+	void HandleRawFrame(ReplyChannel& reply, std::unique_ptr<RawFrame> raw) {
+		thread_local windowcaster::ServerResponse response;
+		response.Clear();
+		auto* status = response.mutable_status();
+		uint64_t targetWindow = raw->header.targetWindow;
+		uint64_t sequence = raw->header.sequence;
+		size_t messageSize = raw->messageSize;
+
+		QueueFrame(reply, BuildRawFrame(std::move(raw), status), targetWindow, sequence, messageSize, status);
+		if (FoldIntoStreamAck(reply, sequence, response)) {
+			SendResponse(reply, response);
+		}
+	}
+
+	// Most replies are a bare success, which is serialized once; the rest reuse one buffer per thread
+	static void SendResponse(ReplyChannel& reply, const windowcaster::ServerResponse& response) {
+		static const std::string successReply = [] {
+			windowcaster::ServerResponse success;
+			success.mutable_status()->set_success(true);
+			return success.SerializeAsString();
+		}();
+		// Success without a message is the whole of the bare reply; anything else adds bytes
+		if (response.status().success() && response.status().message().empty()
+			&& response.ByteSizeLong() == successReply.size()) {
+			reply.SendMessage(successReply);
+			return;
+		}
+
+		thread_local std::string responseStr;
 		if (response.SerializeToString(&responseStr)) {
-			server->SendMessage(responseStr);
+			reply.SendMessage(responseStr);
 		}
 	}
 
+	// Streaming: fold a frame's result into the cumulative ack instead of replying per frame.
+	// Returns false when no reply is due yet.
+	bool FoldIntoStreamAck(ReplyChannel& reply, uint64_t sequence, windowcaster::ServerResponse& response) {
+		const auto& stream = reply.Stream();
+		if (!stream) {
+			return true;
+		}
+
+		const auto& status = response.status();
+		if (!stream->RecordFrame(sequence, status.success(), status.message())) {
+			return false;
+		}
+		response.Clear();
+		FillStreamAck(*stream, response);
+		return true;
+	}
+
 	void HandleGetWindowList(windowcaster::ServerResponse& response) {
 		auto windows = windowManager->EnumerateWindows();
 		auto* windowList = response.mutable_window_list();
@@ -103,45 +310,309 @@ private:
 		}
 	}
 
-	void HandleRenderCommand(const windowcaster::RenderCommand& command,
-		windowcaster::ServerResponse& response) {
+	// Queues a validated frame for the window's present stage; null if validation failed or an
+	// encoded frame produced no picture yet.
+	// The reply acknowledges acceptance; a newer frame may replace it before it is presented.
+	void QueueFrame(ReplyChannel& reply, std::unique_ptr<FrameItem> frame, uint64_t targetWindow,
+		uint64_t sequence, size_t messageSize, windowcaster::Status* status) {
+		if (const auto& stream = reply.Stream()) {
+			// Every streamed frame holds credit until it leaves the pipeline, rejected ones included
+			CreditWindow& credits = stream->Credits();
+			if (!credits.Acquire(targetWindow, messageSize) && frame) {
+				status->set_success(false);
+				status->set_message("Credit exceeded");
+				frame.reset();
+			}
+			if (!frame) {
+				credits.Release(targetWindow, messageSize);
+				return;
+			}
+			frame->clientSequence = sequence;
+			frame->messageSize = messageSize;
+			frame->observer = stream;
+		}
+
+		if (frame) {
+			pipeline->PostFrame(std::move(frame));
+			status->set_success(true);
+		}
+	}
+
+	std::unique_ptr<FrameItem> BuildFrame(const std::shared_ptr<windowcaster::ClientRequest>& request,
+		windowcaster::Status* status) {
+		const auto& command = request->render_command();
 		HWND hwnd = reinterpret_cast<HWND>(command.target_window());
-		auto* status = response.mutable_status();
 
-		if (!ValidateAndInitialize(hwnd, status)) {
-			return;
+		if (!ValidateWindow(hwnd, status)) {
+			return nullptr;
 		}
 
-		bool success = false;
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = command.target_window();
+		frame->receivedAt = std::chrono::steady_clock::now();
+		frame->owner = request;
+
+		FrameView& view = frame->image;
+		const std::string* pixels = nullptr;
+		uint32_t pixelFormat = 0;
 		switch (command.content_case()) {
 		case windowcaster::RenderCommand::kImage: {
 			const auto& image = command.image();
-			success = renderer->RenderImageFrame(
-				image.data().data(),
-				image.width(),
-				image.height()
-			);
+			pixels = &image.data();
+			view.width = image.width();
+			view.height = image.height();
+			pixelFormat = image.pixel_format();
+			if (!ReadPlanes(image.planes(), view, status)) {
+				return nullptr;
+			}
 			break;
 		}
 		case windowcaster::RenderCommand::kVideo: {
 			const auto& video = command.video();
-			success = renderer->RenderVideoFrame(
-				video.frame_data().data(),
-				video.width(),
-				video.height()
-			);
+			pixels = &video.frame_data();
+			view.width = video.width();
+			view.height = video.height();
+			pixelFormat = video.pixel_format();
+			view.colorSpace.matrix = video.color_matrix() == windowcaster::COLOR_MATRIX_BT709
+				? YuvMatrix::Bt709 : YuvMatrix::Bt601;
+			view.colorSpace.fullRange = video.full_range();
+			if (!ReadPlanes(video.planes(), view, status)) {
+				return nullptr;
+			}
+			frame->isVideo = true;
 			break;
 		}
 		default:
 			status->set_success(false);
 			status->set_message("Unknown render content type");
-			return;
+			return nullptr;
+		}
+
+		view.data = reinterpret_cast<const uint8_t*>(pixels->data());
+		if (!ValidatePixels(pixelFormat, pixels->size(), view, status)) {
+			return nullptr;
+		}
+		if (command.has_image() && !command.image().asset_id().empty()) {
+			return CacheImage(std::move(frame), command.image().asset_id(), status);
+		}
+		return frame;
+	}
+
+	// Images uploaded with an asset id are converted here rather than at present time and kept,
+	// so that showing them again with CachedImage costs only the present
+	std::unique_ptr<FrameItem> CacheImage(std::unique_ptr<FrameItem> frame, const std::string& assetId,
+		windowcaster::Status* status) {
+		AssetId id;
+		if (!ParseAssetId(assetId.data(), assetId.size(), id)) {
+			status->set_success(false);
+			status->set_message("Invalid asset id");
+			return nullptr;
+		}
+		std::string error;
+		std::shared_ptr<const CachedAsset> asset = assets->Insert(id, frame->image, error);
+		if (!asset) {
+			status->set_success(false);
+			status->set_message(error);
+			return nullptr;
+		}
+		// The frame now holds the converted pixels instead of the request
+		frame->image = asset->image;
+		frame->owner = std::move(asset);
+		return frame;
+	}
+
+	// A miss answers "Asset not cached", upon which the client uploads the image
+	std::unique_ptr<FrameItem> BuildCachedImage(const windowcaster::RenderCommand& command,
+		windowcaster::Status* status) {
+		if (!ValidateWindow(reinterpret_cast<HWND>(command.target_window()), status)) {
+			return nullptr;
+		}
+
+		const std::string& assetId = command.cached_image().asset_id();
+		AssetId id;
+		if (!ParseAssetId(assetId.data(), assetId.size(), id)) {
+			status->set_success(false);
+			status->set_message("Invalid asset id");
+			return nullptr;
+		}
+		std::shared_ptr<const CachedAsset> asset = assets->Find(id);
+		if (!asset) {
+			status->set_success(false);
+			status->set_message("Asset not cached");
+			return nullptr;
+		}
+
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = command.target_window();
+		frame->receivedAt = std::chrono::steady_clock::now();
+		frame->image = asset->image;
+		frame->owner = std::move(asset);
+		return frame;
+	}
+
+	std::unique_ptr<FrameItem> BuildRawFrame(std::unique_ptr<RawFrame> raw, windowcaster::Status* status) {
+		const RawFrameHeader& header = raw->header;
+		if (!ValidateWindow(reinterpret_cast<HWND>(header.targetWindow), status)) {
+			return nullptr;
+		}
+
+		auto frame = std::make_unique<FrameItem>();
+		FrameView& view = frame->image;
+		view.data = reinterpret_cast<const uint8_t*>(raw->pixels->Data());
+		view.width = header.width;
+		view.height = header.height;
+		view.colorSpace = header.colorSpace;
+		for (size_t plane = 0; plane < kMaxPlanes; ++plane) {
+			view.planeOffsets[plane] = header.planeOffsets[plane];
+			view.strides[plane] = header.strides[plane];
+		}
+		if (!ValidatePixels(header.pixelFormat, raw->pixels->Size(), view, status)) {
+			return nullptr;
+		}
+
+		frame->targetWindow = header.targetWindow;
+		frame->isVideo = header.isVideo;
+		frame->receivedAt = std::chrono::steady_clock::now();
+		// The header has been copied out; the pooled buffer is all the frame needs to keep
+		frame->owner = std::move(raw->pixels);
+		return frame;
+	}
+
+	// Each rect is validated like a frame of its own; the rects are converted straight into the
+	// window's current picture at present time. An update without rects changes nothing.
+	std::unique_ptr<FrameItem> BuildRegionUpdate(const std::shared_ptr<windowcaster::ClientRequest>& request,
+		windowcaster::Status* status) {
+		const auto& command = request->render_command();
+		if (!ValidateWindow(reinterpret_cast<HWND>(command.target_window()), status)) {
+			return nullptr;
+		}
+
+		const auto& update = command.region_update();
+		status->set_success(true);
+		if (update.rects().empty()) {
+			return nullptr;
+		}
+
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = command.target_window();
+		frame->receivedAt = std::chrono::steady_clock::now();
+		frame->owner = request;
+		frame->image.width = update.width();
+		frame->image.height = update.height();
+		frame->dirtyRects.resize(update.rects_size());
+
+		for (int i = 0; i < update.rects_size(); ++i) {
+			const auto& source = update.rects(i);
+			DirtyRect& rect = frame->dirtyRects[i];
+			// 64-bit sums, so huge coordinates cannot wrap around the frame
+			if (source.width() == 0 || source.height() == 0
+				|| uint64_t(source.x()) + source.width() > update.width()
+				|| uint64_t(source.y()) + source.height() > update.height()) {
+				status->set_success(false);
+				status->set_message("Region outside the frame");
+				return nullptr;
+			}
+			rect.x = source.x();
+			rect.y = source.y();
+			rect.image.data = reinterpret_cast<const uint8_t*>(source.data().data());
+			rect.image.width = source.width();
+			rect.image.height = source.height();
+			rect.image.colorSpace.matrix = update.color_matrix() == windowcaster::COLOR_MATRIX_BT709
+				? YuvMatrix::Bt709 : YuvMatrix::Bt601;
+			rect.image.colorSpace.fullRange = update.full_range();
+			if (!ReadPlanes(source.planes(), rect.image, status)
+				|| !ValidatePixels(source.pixel_format(), source.data().size(), rect.image, status)) {
+				return nullptr;
+			}
 		}
+		return frame;
+	}
+
+	// Encoded video is decoded here, on the session's parse stage in message order, because every
+	// packet is needed as a reference; only decoded pictures go through the latest-wins mailbox.
+	// A null frame with a successful status means the decoder has not output a picture yet.
+	std::unique_ptr<FrameItem> DecodeFrame(const windowcaster::RenderCommand& command, windowcaster::Status* status,
+		bool& keyframeNeeded) {
+		if (!ValidateWindow(reinterpret_cast<HWND>(command.target_window()), status)) {
+			videoDecoders->Invalidate(command.target_window());
+			return nullptr;
+		}
+
+		const auto& video = command.encoded_video();
+		if (!IsKnownVideoCodec(video.codec())) {
+			status->set_success(false);
+			status->set_message("Unsupported video codec");
+			return nullptr;
+		}
+
+		VideoDecoderCache::Result result = videoDecoders->Decode(command.target_window(),
+			static_cast<VideoCodec>(video.codec()), command.sequence(),
+			reinterpret_cast<const uint8_t*>(video.data().data()), video.data().size());
+		keyframeNeeded = result.requestKeyframe;
+		status->set_success(result.success);
+		if (!result.success) {
+			status->set_message(result.error);
+			return nullptr;
+		}
+		if (!result.frame.owner) {
+			return nullptr;
+		}
+
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = command.target_window();
+		frame->isVideo = true;
+		frame->receivedAt = std::chrono::steady_clock::now();
+		frame->image = result.frame.image;
+		frame->owner = std::move(result.frame.owner);
+		return frame;
+	}
+
+	// Per-frame replies carry the request; streaming acks are cumulative and may not be due yet,
+	// so there it goes out on its own right away
+	void RequestKeyframe(ReplyChannel& reply, uint64_t targetWindow, uint64_t sequence,
+		windowcaster::ServerResponse& response) {
+		windowcaster::ServerResponse keyframeResponse;
+		windowcaster::ServerResponse& target = reply.Stream() ? keyframeResponse : response;
+		auto* keyframeRequest = target.add_keyframe_requests();
+		keyframeRequest->set_target_window(targetWindow);
+		keyframeRequest->set_sequence(sequence);
+		if (reply.Stream()) {
+			SendResponse(reply, keyframeResponse);
+		}
+	}
 
-		status->set_success(success);
-		if (!success) {
-			status->set_message("Render failed");
+	// Optional plane layout of a frame; absent planes are tightly packed
+	bool ReadPlanes(const google::protobuf::RepeatedPtrField<windowcaster::PlaneLayout>& planes, FrameView& view,
+		windowcaster::Status* status) {
+		if (planes.size() > static_cast<int>(kMaxPlanes)) {
+			status->set_success(false);
+			status->set_message("Too many planes");
+			return false;
+		}
+		for (int plane = 0; plane < planes.size(); ++plane) {
+			view.planeOffsets[plane] = planes[plane].offset();
+			view.strides[plane] = planes[plane].stride();
 		}
+		return true;
+	}
+
+	// Sets the format and completes the plane layout; rejects unknown formats and layouts that
+	// reach past the payload instead of letting the renderer read past them
+	bool ValidatePixels(uint32_t pixelFormat, size_t payloadSize, FrameView& view, windowcaster::Status* status) {
+		if (!IsKnownPixelFormat(pixelFormat)) {
+			status->set_success(false);
+			status->set_message("Unsupported pixel format");
+			return false;
+		}
+
+		// Compressed images take their size from the file header
+		view.format = static_cast<PixelFormat>(pixelFormat);
+		if (!ResolvePlaneLayout(view, payloadSize)) {
+			status->set_success(false);
+			status->set_message("Invalid frame size");
+			return false;
+		}
+		return true;
 	}
 
 	void HandleStopRender(const windowcaster::StopRender& command,
@@ -149,17 +620,188 @@ private:
 		HWND hwnd = reinterpret_cast<HWND>(command.target_window());
 		auto* status = response.mutable_status();
 
-		if (!ValidateAndInitialize(hwnd, status)) {
+		if (!ValidateWindow(hwnd, status)) {
 			return;
 		}
 
-		renderer->Clear();
-		status->set_success(true);
+		// The next encoded frame for the window starts a fresh decoder at a keyframe
+		videoDecoders->Invalidate(command.target_window());
+		// Joined before the clear is queued, so no played frame can land after it
+		players->Stop(command.target_window());
+
+		ControlItem control;
+		control.targetWindow = command.target_window();
+		control.type = ControlItem::Type::StopRender;
+		status->set_success(pipeline->PostControl(control));
+	}
+
+	void HandleMediaUpload(const windowcaster::MediaUpload& upload, windowcaster::ServerResponse& response) {
+		auto* status = response.mutable_status();
+		std::string error;
+		status->set_success(media->Upload(upload.media_id(), upload.total_size(), upload.offset(),
+			upload.data().data(), upload.data().size(), error));
+		if (!status->success()) {
+			status->set_message(error);
+		}
+	}
+
+	// The server reads, decodes and paces the video itself; nothing crosses the network per frame
+	void HandlePlayback(const windowcaster::Playback& command, windowcaster::ServerResponse& response) {
+		auto* status = response.mutable_status();
+		if (!ValidateWindow(reinterpret_cast<HWND>(command.target_window()), status)) {
+			return;
+		}
+
+		uint64_t targetWindow = command.target_window();
+		// Clamped so that the conversion to microseconds cannot overflow
+		constexpr uint64_t kMaxPositionMs = uint64_t(1) << 40;
+		uint64_t positionMs = command.position_ms() < kMaxPositionMs ? command.position_ms() : kMaxPositionMs;
+		int64_t positionUs = static_cast<int64_t>(positionMs) * 1000;
+		bool found = true;
+		switch (command.action()) {
+		case windowcaster::PLAYBACK_PLAY: {
+			std::string error;
+			std::shared_ptr<MediaInput> input = command.path().empty()
+				? media->OpenUpload(command.media_id(), error) : media->OpenFile(command.path(), error);
+			std::unique_ptr<VideoSource> source = input ? OpenVideoSource(std::move(input), error) : nullptr;
+			if (!source) {
+				status->set_success(false);
+				status->set_message(error);
+				return;
+			}
+			VideoPlayer::Options options;
+			options.startUs = positionUs;
+			options.loop = command.loop();
+			// Played frames replace whatever the client was streaming to the window
+			videoDecoders->Invalidate(targetWindow);
+			players->Play(targetWindow, std::move(source), options);
+			break;
+		}
+		case windowcaster::PLAYBACK_PAUSE:
+			found = players->Pause(targetWindow);
+			break;
+		case windowcaster::PLAYBACK_RESUME:
+			found = players->Resume(targetWindow);
+			break;
+		case windowcaster::PLAYBACK_SEEK:
+			found = players->Seek(targetWindow, positionUs);
+			break;
+		case windowcaster::PLAYBACK_STOP:
+			found = players->Stop(targetWindow);
+			break;
+		case windowcaster::PLAYBACK_STATUS:
+			break;
+		default:
+			status->set_success(false);
+			status->set_message("Unknown playback action");
+			return;
+		}
+
+		VideoPlayer::State state;
+		if (command.action() != windowcaster::PLAYBACK_STOP && !players->GetState(targetWindow, state)) {
+			found = false;
+		}
+		status->set_success(found);
+		if (!found) {
+			status->set_message("No playback on window");
+			return;
+		}
+		if (command.action() != windowcaster::PLAYBACK_STOP) {
+			auto* playbackState = response.mutable_playback_state();
+			playbackState->set_position_ms(static_cast<uint64_t>(state.positionUs / 1000));
+			playbackState->set_duration_ms(static_cast<uint64_t>(state.durationUs / 1000));
+			playbackState->set_paused(state.paused);
+			playbackState->set_finished(state.finished);
+			playbackState->set_frames_presented(state.framesPresented);
+			playbackState->set_frames_late(state.framesLate);
+			playbackState->set_error(state.error);
+		}
+	}
+
+	// Runs on the window's player thread; played frames take the same path as streamed ones
+	bool PostPlaybackFrame(uint64_t targetWindow, DecodedFrame decoded) {
+		if (!windowManager->IsWindowValid(reinterpret_cast<HWND>(targetWindow))) {
+			return false;
+		}
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = targetWindow;
+		frame->isVideo = true;
+		frame->receivedAt = std::chrono::steady_clock::now();
+		frame->image = decoded.image;
+		frame->owner = std::move(decoded.owner);
+		pipeline->PostFrame(std::move(frame));
+		return true;
+	}
+
+	// Enabling switches render commands to cumulative acks and credit-based flow
+	// control; disabling flushes a final ack
+	void HandleStreamConfig(const std::shared_ptr<ReplyChannel>& channel, const windowcaster::StreamConfig& config,
+		windowcaster::ServerResponse& response) {
+		if (channel->Stream()) {
+			FillStreamAck(*channel->Stream(), response);
+		}
+		response.mutable_status()->set_success(true);
+
+		if (!config.enabled()) {
+			channel->SetStream(nullptr);
+			return;
+		}
+
+		auto stream = std::make_shared<StreamAcknowledger>(config.ack_every_frames(), config.ack_interval_ms());
+		// Weak so that the session is not kept alive by frames still in the pipeline
+		std::weak_ptr<ReplyChannel> weakChannel = channel;
+		stream->Credits().SetGrantHandler([weakChannel](uint64_t targetWindow, uint64_t frames, uint64_t bytes) {
+			std::shared_ptr<ReplyChannel> target = weakChannel.lock();
+			if (!target) {
+				return;
+			}
+			// Grants may be sent from inside HandleMessage, so they keep a response of their own
+			thread_local windowcaster::ServerResponse grantResponse;
+			grantResponse.Clear();
+			auto* grant = grantResponse.add_credits();
+			grant->set_target_window(targetWindow);
+			grant->set_frames(frames);
+			grant->set_bytes(bytes);
+			SendResponse(*target, grantResponse);
+			});
+
+		response.set_raw_frame_version(kRawFrameVersion);
+		// Compression is per message from here on; the session inflates whatever it can decode
+		for (int compression : config.compression()) {
+			if (compression != windowcaster::COMPRESSION_NONE
+				&& IsCompressionSupported(static_cast<TransportCompression>(compression))) {
+				response.add_compression(static_cast<windowcaster::Compression>(compression));
+			}
+		}
+		auto* creditWindow = response.mutable_credit_window();
+		creditWindow->set_frames(stream->Credits().Frames());
+		creditWindow->set_bytes(stream->Credits().Bytes());
+		channel->SetStream(std::move(stream));
+	}
+
+	void FillStreamAck(StreamAcknowledger& stream, windowcaster::ServerResponse& response) {
+		StreamAcknowledger::Ack ack = stream.TakeAck();
+		auto* streamAck = response.mutable_stream_ack();
+		streamAck->set_sequence(ack.sequence);
+		streamAck->set_presented_sequence(ack.presentedSequence);
+		streamAck->set_frames(ack.frames);
+		streamAck->set_failed_frames(ack.failedFrames);
+		streamAck->set_error_sequence(ack.errorSequence);
+		streamAck->set_error(ack.error);
 	}
 
 private:
+	// First in, last out: every window's renderer splits its frames across these threads
+	std::unique_ptr<WorkStealingPool> workers;
 	std::unique_ptr<WindowManager> windowManager;
-	std::unique_ptr<Renderer> renderer;
+	std::unique_ptr<RenderContextCache> renderContexts;
+	std::unique_ptr<VideoDecoderCache> videoDecoders;
+	std::unique_ptr<AssetCache> assets;
+	std::unique_ptr<MediaLibrary> media;
+	std::unique_ptr<RequestPool> requests;
+	std::unique_ptr<FramePipeline> pipeline;
+	// After the pipeline: players post into it until they are destroyed
+	std::unique_ptr<PlaybackController> players;
 	std::unique_ptr<NetworkServer> server;
 };
 
@@ -175,13 +817,84 @@ int main(int argc, char* argv[]) {
 			port = static_cast<uint16_t>(std::stoi(argv[1]));
 		}
 
-		WindowCasterServer server(port);
+		size_t maxSessions = 16;  // Default concurrent client limit
+		if (argc > 2) {
+			maxSessions = static_cast<size_t>(std::stoul(argv[2]));
+		}
+
+		size_t assetCacheMb = 256;  // Default memory budget of the image cache
+		if (argc > 3) {
+			assetCacheMb = static_cast<size_t>(std::stoul(argv[3]));
+		}
+
+		// Converted images persist across restarts when a store directory is given
+		std::unique_ptr<AssetStore> assetStore;
+		if (argc > 4) {
+			assetStore = std::make_unique<AssetStore>();
+			auto openStart = std::chrono::steady_clock::now();
+			std::string error;
+			if (!assetStore->Open(argv[4], error)) {
+				std::cerr << "Asset store unavailable: " << error << std::endl;
+				assetStore.reset();
+			}
+			else {
+				AssetStore::Stats storeStats = assetStore->GetStats();
+				auto openMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now() - openStart).count();
+				std::cout << "Asset store " << argv[4] << ": " << storeStats.assets << " assets ("
+					<< storeStats.dataBytes / (1024 * 1024) << " MB) opened in " << openMs << " ms";
+				if (storeStats.recoveredEntries) {
+					std::cout << ", dropped " << storeStats.recoveredEntries << " damaged entries at the end";
+				}
+				std::cout << std::endl;
+			}
+		}
+
+		// Clients may play files from this directory by relative path
+		std::string mediaDirectory;
+		if (argc > 5) {
+			mediaDirectory = argv[5];
+		}
+
+		// Frames are scaled to the window's client area by the server, e.g. "lanczos3,letterbox"
+		ScaleOptions scaleOptions;
+		if (argc > 6 && !ParseScaleOptions(argv[6], scaleOptions)) {
+			std::cerr << "Unknown scaling option: " << argv[6] << std::endl;
+			return 1;
+		}
+
+		// Threads that share the per-frame work of all windows, e.g. "8" or "8,pin"
+		WorkStealingPool::Options poolOptions;
+		if (argc > 7 && !ParsePoolOptions(argv[7], poolOptions)) {
+			std::cerr << "Unknown worker thread option: " << argv[7] << std::endl;
+			return 1;
+		}
+
+		// Idle message and raw frame buffers kept for reuse, e.g. "512" or "512,huge"
+		FrameBufferPool::Options bufferOptions;
+		if (argc > 8 && !ParseBufferPoolOptions(argv[8], bufferOptions)) {
+			std::cerr << "Unknown buffer pool option: " << argv[8] << std::endl;
+			return 1;
+		}
+
+		WindowCasterServer server(port, maxSessions, assetCacheMb * 1024 * 1024, std::move(assetStore),
+			std::move(mediaDirectory), scaleOptions, poolOptions, bufferOptions);
 		if (!server.Start()) {
 			std::cerr << "Server failed to start" << std::endl;
 			return 1;
 		}
 
-		std::cout << "WindowCaster server started on port " << port << "..." << std::endl;
+		std::cout << "WindowCaster server started on port " << port
+			<< " (max " << maxSessions << " sessions, " << assetCacheMb << " MB image cache)..." << std::endl;
+		std::cout << "Pixel conversion: " << SimdLevelName(DetectSimdLevel()) << std::endl;
+		std::cout << "Scaling: " << ScaleFilterName(scaleOptions.filter) << ", " << ScaleFitName(scaleOptions.fit) << std::endl;
+		std::cout << "Frame worker threads: " << server.FrameThreads()
+			<< (poolOptions.pinWorkers ? " (pinned)" : "") << std::endl;
+		std::cout << "Buffer pool: " << bufferOptions.maxFreeBytes / (1024 * 1024) << " MB idle budget";
+		if (bufferOptions.hugePages) {
+			std::cout << (server.BufferHugePages() ? ", huge pages" : ", huge pages unavailable");
+		}
+		std::cout << std::endl;
 		std::cout << "Press Ctrl+C to exit" << std::endl;
 
 		// Loop until Ctrl+C is pressed
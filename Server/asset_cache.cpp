@@ -0,0 +1,138 @@
+#include "asset_cache.h"
+#include "asset_store.h"
+#include "content_hash.h"
+#include "pixel_convert.h"
+#include <cstring>
+#include <iterator>
+#include <new>
+
+namespace {
+	// Like the asset store, assumes a little-endian host
+	uint64_t ReadLittleEndian64(const uint8_t* data) {
+		uint64_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+}
+
+AssetId ComputeAssetId(const void* data, size_t size) {
+	Digest128 digest = ComputeXxh128(data, size);
+	return { digest.low, digest.high };
+}
+
+bool ParseAssetId(const void* data, size_t size, AssetId& id) {
+	if (size != kAssetIdSize) {
+		return false;
+	}
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	id.low = ReadLittleEndian64(bytes);
+	id.high = ReadLittleEndian64(bytes + 8);
+	return true;
+}
+
+AssetCache::AssetCache(size_t budgetBytes, std::unique_ptr<AssetStore> store)
+	: budgetBytes(budgetBytes)
+	, store(std::move(store)) {
+}
+
+AssetCache::~AssetCache() = default;
+
+std::shared_ptr<const CachedAsset> AssetCache::Find(const AssetId& id) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(id);
+		if (it != index.end()) {
+			stats.hits++;
+			lru.splice(lru.begin(), lru, it->second);
+			return it->second->asset;
+		}
+	}
+
+	// Stored images stay in the file mapping instead of taking a share of the memory budget
+	std::shared_ptr<const CachedAsset> asset = store ? store->Find(id) : nullptr;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (asset) {
+		stats.storeHits++;
+	}
+	else {
+		stats.misses++;
+	}
+	return asset;
+}
+
+std::shared_ptr<const CachedAsset> AssetCache::Insert(const AssetId& id, const FrameView& image, std::string& error) {
+	// Hashed and converted outside the lock: decoding a large JPEG must not stall lookups from other sessions.
+	// Every session is shown what is stored under an id, so the id has to be the digest of the upload.
+	// Raw pixels carry their size and layout outside the data, which the digest would not cover
+	if (!IsCompressedFormat(image.format)) {
+		error = "Asset must be an image file or screen-encoded";
+		return nullptr;
+	}
+	if (!(ComputeAssetId(image.data, image.dataSize) == id)) {
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.idMismatches++;
+		error = "Asset id does not match the image";
+		return nullptr;
+	}
+	auto asset = std::make_shared<CachedAsset>();
+	size_t stride = image.width * 4;
+	size_t size = stride * image.height;
+	std::shared_ptr<uint8_t[]> pixels(new (std::nothrow) uint8_t[size]);
+	if (!pixels || !ConvertFrameToBgra(image, pixels.get(), stride)) {
+		error = "Invalid image data";
+		return nullptr;
+	}
+	FrameView& view = asset->image;
+	view.data = pixels.get();
+	view.width = image.width;
+	view.height = image.height;
+	view.format = PixelFormat::Bgra32;
+	view.strides[0] = stride;
+	view.dataSize = size;
+	asset->storage = std::move(pixels);
+
+	if (store) {
+		store->Append(id, asset->image);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = index.find(id);
+	if (it != index.end()) {
+		EraseLocked(it->second);
+	}
+	if (size > budgetBytes) {
+		stats.oversized++;
+		return asset;
+	}
+	while (bytes + size > budgetBytes && !lru.empty()) {
+		stats.evictions++;
+		EraseLocked(std::prev(lru.end()));
+	}
+	lru.push_front(Entry{ id, asset });
+	index[id] = lru.begin();
+	bytes += size;
+	stats.insertions++;
+	return asset;
+}
+
+void AssetCache::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	lru.clear();
+	index.clear();
+	bytes = 0;
+}
+
+AssetCache::Stats AssetCache::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats result = stats;
+	result.assets = lru.size();
+	result.bytes = bytes;
+	result.budgetBytes = budgetBytes;
+	return result;
+}
+
+void AssetCache::EraseLocked(std::list<Entry>::iterator it) {
+	bytes -= it->asset->Bytes();
+	index.erase(it->id);
+	lru.erase(it);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// ͼƬԴ idϴͼƬ (Image.data ȫֽ)  XXH3-128 ժҪ (16 ֽڣС)
+// лỰòɳ־ûһ id µͼƬʾ֮ͬһ id κοͻˣ
+// Բʱ¼ժҪ id ϴܾͻ޷ѱݷŵͼƬ id 
+struct AssetId {
+	uint64_t low = 0;
+	uint64_t high = 0;
+
+	bool operator==(const AssetId& other) const { return low == other.low && high == other.high; }
+};
+
+struct AssetIdHash {
+	size_t operator()(const AssetId& id) const { return static_cast<size_t>(id.low ^ id.high); }
+};
+
+constexpr size_t kAssetIdSize = 16;
+
+// Ϣеֽڶ idȲ kAssetIdSize ʱ false
+bool ParseAssetId(const void* data, size_t size, AssetId& id);
+
+// ݵ XXH3-128 ժҪ (ĬԿ 0)ͻ xxhash-rust  xxh3_128 һ
+AssetId ComputeAssetId(const void* data, size_t size);
+
+class AssetStore;
+
+// еһͼƬתΪʹõ 32 λ BGRAٴʾʱֻ踴Ƶλͼ
+struct CachedAsset {
+	std::shared_ptr<const void> storage;   // أϵĻ壬־û洢ļӳ
+	FrameView image;                       // ص Bgra32 ͼм
+
+	size_t Bytes() const { return image.dataSize; }
+};
+
+// ժҪתͼƬֽԤʱ̭δʹõͼƬ
+// ѡĳ־û洢 ( asset_store.h) ΪڶͼƬͬʱд洢ڴδʱٲ洢
+// 洢еͼƬļӳУռڴԤ
+// ̰߳ȫ̭Ա֡õͼƬһͷʱŻ
+class AssetCache {
+public:
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t storeHits = 0;   // ڴδжɳ־û洢ṩ
+		uint64_t misses = 0;
+		uint64_t insertions = 0;
+		uint64_t evictions = 0;
+		uint64_t oversized = 0;   // žͳԤδͼƬ
+		uint64_t idMismatches = 0;   // ժҪ id ܾϴ
+		size_t assets = 0;
+		size_t bytes = 0;
+		size_t budgetBytes = 0;
+	};
+
+	explicit AssetCache(size_t budgetBytes, std::unique_ptr<AssetStore> store = nullptr);
+	~AssetCache();
+
+	// ͼƬʱΪʹ
+	std::shared_ptr<const CachedAsset> Find(const AssetId& id);
+
+	//  ResolvePlaneLayout ȫͼƬתΪ BGRA  id 棬ͬһ id ľͼƬ滻
+	// image Ϊĸʽ (JPEGPNGQOI Ļ) (dataSize ֽ) ժҪ id
+	// ԭʼصĳߴ벼ֲУժҪ޷ǣ˲
+	// ųԤʱ棬Էתγ֣ʽժҪʱ nullptrerror Ϊԭ
+	// ó־û洢ʱͼƬͬʱ׷ӵ洢 (ڴԤ)
+	// Уתڶ߳ͬʱ
+	std::shared_ptr<const CachedAsset> Insert(const AssetId& id, const FrameView& image, std::string& error);
+
+	// ڴеͼƬ־û洢Ӱ
+	void Clear();
+
+	Stats GetStats() const;
+
+	// ־û洢δʱΪ
+	AssetStore* Store() const { return store.get(); }
+
+private:
+	struct Entry {
+		AssetId id;
+		std::shared_ptr<const CachedAsset> asset;
+	};
+
+	size_t budgetBytes;
+	std::unique_ptr<AssetStore> store;
+	mutable std::mutex mutex;
+	// ʹõǰ
+	std::list<Entry> lru;
+	std::unordered_map<AssetId, std::list<Entry>::iterator, AssetIdHash> index;
+	size_t bytes = 0;
+	Stats stats;
+
+	void EraseLocked(std::list<Entry>::iterator it);
+};
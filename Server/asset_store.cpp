@@ -0,0 +1,478 @@
+#include "asset_store.h"
+#include "content_hash.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr uint32_t kDataMagic = 0x44414357u;    // 'WCAD'
+	constexpr uint32_t kIndexMagic = 0x58414357u;   // 'WCAX'
+	constexpr uint32_t kEntryMagic = 0x45414357u;   // 'WCAE'
+	constexpr uint32_t kStoreVersion = 2;
+	constexpr size_t kHeaderSize = 64;
+	constexpr size_t kEntrySize = 64;
+	constexpr size_t kEntryChecksumOffset = 56;
+	constexpr uint64_t kRecordAlignment = 64;
+	const char* const kDataFileName = "assets.dat";
+	const char* const kIndexFileName = "assets.idx";
+
+	uint32_t Read32(const uint8_t* p) {
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	uint64_t Read64(const uint8_t* p) {
+		uint64_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	void Write32(uint8_t* p, uint32_t value) {
+		std::memcpy(p, &value, sizeof(value));
+	}
+
+	void Write64(uint8_t* p, uint64_t value) {
+		std::memcpy(p, &value, sizeof(value));
+	}
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void FillHeader(uint8_t* header, uint32_t magic) {
+		std::memset(header, 0, kHeaderSize);
+		Write32(header, magic);
+		Write32(header + 4, kStoreVersion);
+	}
+
+	bool IsHeader(const uint8_t* header, uint32_t magic) {
+		return Read32(header) == magic && Read32(header + 4) == kStoreVersion;
+	}
+}
+
+// Pixels of stored images, mapped read-only; released with the last asset that points into it
+struct AssetStore::Mapping {
+	void* view = nullptr;
+	size_t length = 0;
+	const uint8_t* data = nullptr;   // the requested offset within the view
+
+	~Mapping() {
+#ifdef _WIN32
+		UnmapViewOfFile(view);
+#else
+		munmap(view, length);
+#endif
+	}
+};
+
+// Positional reads and writes, so that appends never move a shared file pointer
+class AssetStore::File {
+public:
+	~File() {
+#ifdef _WIN32
+		if (handle != INVALID_HANDLE_VALUE) {
+			CloseHandle(handle);
+		}
+#else
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+
+	bool Open(const std::filesystem::path& path) {
+#ifdef _WIN32
+		handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		return handle != INVALID_HANDLE_VALUE;
+#else
+		fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		return fd >= 0;
+#endif
+	}
+
+	uint64_t Size() const {
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		return GetFileSizeEx(handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+		struct stat info;
+		return fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+#endif
+	}
+
+	bool Read(uint64_t offset, void* dst, size_t size) const {
+		auto* out = static_cast<uint8_t*>(dst);
+		while (size > 0) {
+#ifdef _WIN32
+			OVERLAPPED position = {};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+			DWORD done = 0;
+			if (!ReadFile(handle, out, chunk, &done, &position) || done == 0) {
+				return false;
+			}
+#else
+			ssize_t done = pread(fd, out, size, static_cast<off_t>(offset));
+			if (done <= 0) {
+				if (done < 0 && errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+#endif
+			out += done;
+			offset += done;
+			size -= done;
+		}
+		return true;
+	}
+
+	bool Write(uint64_t offset, const void* src, size_t size) {
+		const auto* in = static_cast<const uint8_t*>(src);
+		while (size > 0) {
+#ifdef _WIN32
+			OVERLAPPED position = {};
+			position.Offset = static_cast<DWORD>(offset);
+			position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD chunk = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+			DWORD done = 0;
+			if (!WriteFile(handle, in, chunk, &done, &position) || done == 0) {
+				return false;
+			}
+#else
+			ssize_t done = pwrite(fd, in, size, static_cast<off_t>(offset));
+			if (done <= 0) {
+				if (done < 0 && errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+#endif
+			in += done;
+			offset += done;
+			size -= done;
+		}
+		return true;
+	}
+
+	bool Truncate(uint64_t size) {
+#ifdef _WIN32
+		FILE_END_OF_FILE_INFO end = {};
+		end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+		return SetFileInformationByHandle(handle, FileEndOfFileInfo, &end, sizeof(end)) != FALSE;
+#else
+		return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+	}
+
+	bool Sync() {
+#ifdef _WIN32
+		return FlushFileBuffers(handle) != FALSE;
+#else
+		return fsync(fd) == 0;
+#endif
+	}
+
+	// Maps [offset, offset + size); the view starts at the granularity boundary below offset
+	std::shared_ptr<Mapping> Map(uint64_t offset, uint64_t size) const {
+#ifdef _WIN32
+		SYSTEM_INFO system;
+		GetSystemInfo(&system);
+		uint64_t start = offset / system.dwAllocationGranularity * system.dwAllocationGranularity;
+		HANDLE section = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!section) {
+			return nullptr;
+		}
+		size_t length = static_cast<size_t>(offset - start + size);
+		void* view = MapViewOfFile(section, FILE_MAP_READ, static_cast<DWORD>(start >> 32),
+			static_cast<DWORD>(start), length);
+		// The view keeps the section alive
+		CloseHandle(section);
+		if (!view) {
+			return nullptr;
+		}
+#else
+		uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+		uint64_t start = offset / page * page;
+		size_t length = static_cast<size_t>(offset - start + size);
+		void* view = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+		if (view == MAP_FAILED) {
+			return nullptr;
+		}
+#endif
+		auto mapping = std::make_shared<Mapping>();
+		mapping->view = view;
+		mapping->length = length;
+		mapping->data = static_cast<const uint8_t*>(view) + (offset - start);
+		return mapping;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+};
+
+AssetStore::AssetStore(uint64_t maxBytes)
+	: maxBytes(maxBytes) {
+}
+
+AssetStore::~AssetStore() {
+	Flush();
+}
+
+bool AssetStore::Open(const std::string& directory, std::string& error) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::filesystem::path root = std::filesystem::u8path(directory);
+	std::error_code ec;
+	std::filesystem::create_directories(root, ec);
+	if (ec) {
+		error = "Cannot create " + directory + ": " + ec.message();
+		return false;
+	}
+
+	data = std::make_unique<File>();
+	index = std::make_unique<File>();
+	if (!data->Open(root / kDataFileName) || !index->Open(root / kIndexFileName)) {
+		error = "Cannot open the asset store in " + directory;
+		return false;
+	}
+	return Recover(error);
+}
+
+bool AssetStore::Reset(std::string& error) {
+	uint8_t header[kHeaderSize];
+	FillHeader(header, kDataMagic);
+	bool written = data->Truncate(0) && data->Write(0, header, kHeaderSize);
+	FillHeader(header, kIndexMagic);
+	written = written && index->Truncate(0) && index->Write(0, header, kHeaderSize);
+	if (!written) {
+		error = "Cannot initialize the asset store files";
+		return false;
+	}
+	dataEnd = kHeaderSize;
+	indexEnd = kHeaderSize;
+	writable = true;
+	return true;
+}
+
+// Reads the index and drops everything from the first entry that does not check out: a crash
+// while appending leaves at most a torn entry or pixels without an entry at the end
+bool AssetStore::Recover(std::string& error) {
+	entries.clear();
+	mapping.reset();
+
+	uint64_t dataSize = data->Size();
+	uint64_t indexSize = index->Size();
+	uint8_t header[kHeaderSize];
+	if (dataSize < kHeaderSize || indexSize < kHeaderSize
+		|| !data->Read(0, header, kHeaderSize) || !IsHeader(header, kDataMagic)
+		|| !index->Read(0, header, kHeaderSize) || !IsHeader(header, kIndexMagic)) {
+		return Reset(error);
+	}
+
+	size_t count = static_cast<size_t>((indexSize - kHeaderSize) / kEntrySize);
+	std::vector<uint8_t> table(count * kEntrySize);
+	if (!table.empty() && !index->Read(kHeaderSize, table.data(), table.size())) {
+		error = "Cannot read the asset store index";
+		return false;
+	}
+
+	dataEnd = kHeaderSize;
+	size_t valid = 0;
+	for (; valid < count; ++valid) {
+		const uint8_t* record = table.data() + valid * kEntrySize;
+		Entry entry;
+		entry.width = Read32(record + 4);
+		entry.height = Read32(record + 8);
+		entry.offset = Read64(record + 32);
+		entry.size = Read64(record + 40);
+		entry.checksum = Read64(record + 48);
+		if (Read32(record) != kEntryMagic
+			|| Read64(record + kEntryChecksumOffset) != ComputeXxh64(record, kEntryChecksumOffset)
+			|| entry.size != uint64_t(entry.width) * entry.height * 4 || entry.size == 0
+			|| entry.offset < kHeaderSize || entry.offset % kRecordAlignment != 0
+			|| entry.offset > dataSize || entry.size > dataSize - entry.offset) {
+			break;
+		}
+		AssetId id;
+		id.low = Read64(record + 16);
+		id.high = Read64(record + 24);
+		entries[id] = entry;
+		if (entry.offset + entry.size > dataEnd) {
+			dataEnd = entry.offset + entry.size;
+		}
+	}
+
+	stats.recoveredEntries = count - valid;
+	indexEnd = kHeaderSize + valid * kEntrySize;
+	if ((indexSize != indexEnd && !index->Truncate(indexEnd)) || (dataSize != dataEnd && !data->Truncate(dataEnd))) {
+		error = "Cannot truncate the damaged tail of the asset store";
+		return false;
+	}
+	writable = true;
+
+	// One mapping for everything stored so far; failing that, each image is mapped on first use
+	if (dataEnd > kHeaderSize) {
+		mapping = data->Map(0, dataEnd);
+	}
+	return true;
+}
+
+std::shared_ptr<const CachedAsset> AssetStore::Find(const AssetId& id) {
+	Entry entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(id);
+		if (it == entries.end() || it->second.corrupt || it->second.pending) {
+			return nullptr;
+		}
+		if (it->second.asset) {
+			stats.hits++;
+			return it->second.asset;
+		}
+		entry = it->second;
+	}
+
+	// Mapping and checking happen outside the lock; two threads racing here do the same work twice
+	std::shared_ptr<const void> storage;
+	const uint8_t* pixels = nullptr;
+	if (mapping && entry.offset + entry.size <= mapping->length) {
+		storage = mapping;
+		pixels = mapping->data + entry.offset;
+	}
+	else if (auto own = data->Map(entry.offset, entry.size)) {
+		pixels = own->data;
+		storage = std::move(own);
+	}
+	else {
+		return nullptr;
+	}
+	bool intact = entry.verified || ComputeXxh64(pixels, static_cast<size_t>(entry.size)) == entry.checksum;
+
+	auto asset = std::make_shared<CachedAsset>();
+	asset->storage = std::move(storage);
+	FrameView& view = asset->image;
+	view.data = pixels;
+	view.width = entry.width;
+	view.height = entry.height;
+	view.format = PixelFormat::Bgra32;
+	view.strides[0] = size_t(entry.width) * 4;
+	view.dataSize = static_cast<size_t>(entry.size);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(id);
+	// A corrupt entry may have been replaced by a new append meanwhile
+	if (it == entries.end() || it->second.pending || it->second.offset != entry.offset) {
+		return nullptr;
+	}
+	if (!intact) {
+		it->second.corrupt = true;
+		stats.checksumFailures++;
+		return nullptr;
+	}
+	it->second.verified = true;
+	if (!it->second.asset) {
+		it->second.asset = std::move(asset);
+	}
+	stats.hits++;
+	return it->second.asset;
+}
+
+void AssetStore::Append(const AssetId& id, const FrameView& image) {
+	size_t size = image.width * image.height * 4;
+	uint64_t checksum = ComputeXxh64(image.data, size);
+
+	// Space in both files is reserved under the lock and written outside it, so that one large
+	// image going to disk holds up neither lookups nor appends of other images
+	uint64_t offset;
+	uint64_t slot;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto existing = entries.find(id);
+		if (!writable || (existing != entries.end() && !existing->second.corrupt)) {
+			return;
+		}
+		offset = AlignUp(dataEnd, kRecordAlignment);
+		if (offset + size > maxBytes) {
+			stats.rejected++;
+			return;
+		}
+		dataEnd = offset + size;
+		slot = indexEnd;
+		indexEnd += kEntrySize;
+
+		// Holds the id until the write is done: Find skips it and a second Append of the same image returns
+		Entry entry;
+		entry.offset = offset;
+		entry.size = size;
+		entry.width = static_cast<uint32_t>(image.width);
+		entry.height = static_cast<uint32_t>(image.height);
+		entry.checksum = checksum;
+		entry.verified = true;
+		entry.pending = true;
+		entries[id] = std::move(entry);
+	}
+
+	uint8_t record[kEntrySize] = {};
+	Write32(record, kEntryMagic);
+	Write32(record + 4, static_cast<uint32_t>(image.width));
+	Write32(record + 8, static_cast<uint32_t>(image.height));
+	Write64(record + 16, id.low);
+	Write64(record + 24, id.high);
+	Write64(record + 32, offset);
+	Write64(record + 40, size);
+	Write64(record + 48, checksum);
+	Write64(record + kEntryChecksumOffset, ComputeXxh64(record, kEntryChecksumOffset));
+
+	// Pixels before the entry that points at them. Concurrent appends may fill index slots out of
+	// order; recovery stops at the first slot that does not check out, so an append that never
+	// finished also drops the later ones
+	bool written = data->Write(offset, image.data, size) && index->Write(slot, record, kEntrySize);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(id);
+	if (!written) {
+		// Whatever was half written is cut off again when the store is next opened
+		writable = false;
+		stats.rejected++;
+		if (it != entries.end() && it->second.pending) {
+			entries.erase(it);
+		}
+		return;
+	}
+	it->second.pending = false;
+	stats.appended++;
+}
+
+void AssetStore::Flush() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (writable) {
+		data->Sync();
+		index->Sync();
+	}
+}
+
+AssetStore::Stats AssetStore::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats result = stats;
+	result.assets = entries.size();
+	result.dataBytes = dataEnd;
+	return result;
+}
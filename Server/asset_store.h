@@ -0,0 +1,96 @@
+#pragma once
+
+#include "asset_cache.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// ͼƬĴ̳־ûתͼƬ׷дļһļ
+// ʱֻӳļеͼƬֱӴӳ֣ϴ
+//
+// ļ assets.dat64 ֽļͷǸͼƬ BGRA  (м)ÿŴ 64 ֽڶ봦ʼ
+// ļ assets.idx64 ֽļͷǶ 64 ֽڵĿ (С)
+//   0  uint32 magic      'WCAE'
+//   4  uint32 width
+//   8  uint32 height
+//  12  uint32 reserved
+//  16  uint64 idLow
+//  24  uint64 idHigh
+//  32  uint64 offset     ļеƫ
+//  40  uint64 size       width * height * 4
+//  48  uint64 checksum   ص XXH64
+//  56  uint64 entryChecksum  ǰ 56 ֽڵ XXH64
+// ддĿд벻̣ʱӵһ𻵻ԽļĩβĿض
+// ļ (ʱдһβ)УÿͼƬһαʹʱ飬һµͼƬΪ
+class AssetStore {
+public:
+	struct Stats {
+		size_t assets = 0;
+		uint64_t dataBytes = 0;          // ļС
+		uint64_t hits = 0;
+		uint64_t appended = 0;
+		uint64_t recoveredEntries = 0;   // ʱβĿ
+		uint64_t checksumFailures = 0;
+		uint64_t rejected = 0;           // С޻дʧܶδͼƬ
+	};
+
+	static constexpr uint64_t kDefaultMaxBytes = uint64_t(16) << 30;
+
+	explicit AssetStore(uint64_t maxBytes = kDefaultMaxBytes);
+	~AssetStore();
+
+	AssetStore(const AssetStore&) = delete;
+	AssetStore& operator=(const AssetStore&) = delete;
+
+	// Ŀ¼еĴ洢ʱļͷ (Ǳʽ汾ͬ) ʱؽ
+	bool Open(const std::string& directory, std::string& error);
+
+	// ͼƬֱļӳ䣻һʹʱУ
+	std::shared_ptr<const CachedAsset> Find(const AssetId& id);
+
+	// ׷һŽе Bgra32 ͼƬѱд id д
+	// ֻԤļеλãдУͼƬдʱͼƬ׷ӣ
+	// дǰҲͼƬ׷ӿдĿӵһδдĿض
+	// дʧܺ׷ӣѱͼƬԿɶȡ
+	void Append(const AssetId& id, const FrameView& image);
+
+	// ׷ӵд
+	void Flush();
+
+	Stats GetStats() const;
+
+private:
+	class File;
+	struct Mapping;
+
+	struct Entry {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint64_t checksum = 0;
+		bool verified = false;
+		bool corrupt = false;
+		bool pending = false;   // Ԥռ䣬д
+		std::shared_ptr<const CachedAsset> asset;   // һʹú󴴽
+	};
+
+	uint64_t maxBytes;
+	std::unique_ptr<File> data;
+	std::unique_ptr<File> index;
+	// ʱļӳ䣬֮׷ӵͼƬ԰ӳ
+	std::shared_ptr<Mapping> mapping;
+
+	mutable std::mutex mutex;
+	std::unordered_map<AssetId, Entry, AssetIdHash> entries;
+	uint64_t dataEnd = 0;
+	uint64_t indexEnd = 0;
+	bool writable = false;
+	Stats stats;
+
+	bool Reset(std::string& error);
+	bool Recover(std::string& error);
+};
@@ -0,0 +1,50 @@
+#include "block_free_list.h"
+#include <algorithm>
+#include <new>
+
+BlockFreeList::BlockFreeList(size_t blockSize, size_t maxBlocks)
+	: blockSize(std::max(blockSize, sizeof(Node)))
+	, maxBlocks(maxBlocks)
+	, head(nullptr)
+	, count(0) {
+}
+
+BlockFreeList::~BlockFreeList() {
+	while (head) {
+		Node* next = head->next;
+		::operator delete(head);
+		head = next;
+	}
+}
+
+void* BlockFreeList::Allocate() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (Node* node = head) {
+			head = node->next;
+			count--;
+			return node;
+		}
+	}
+	return ::operator new(blockSize);
+}
+
+void BlockFreeList::Deallocate(void* block) {
+	if (!block) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (count < maxBlocks) {
+			head = new (block) Node{ head };
+			count++;
+			return;
+		}
+	}
+	::operator delete(block);
+}
+
+size_t BlockFreeList::FreeBlocks() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return count;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+// ڴĿ黹Ŀ´ȡã֡ͷŵС˲ÿ
+// пౣ maxBlocks ʱֱͷţָڿпУȡ黹ڴ
+// 鰴 operator new Ĭ϶뷽ʽ룻߳ȡ黹
+class BlockFreeList {
+public:
+	BlockFreeList(size_t blockSize, size_t maxBlocks);
+	~BlockFreeList();
+
+	BlockFreeList(const BlockFreeList&) = delete;
+	BlockFreeList& operator=(const BlockFreeList&) = delete;
+
+	void* Allocate();
+	void Deallocate(void* block);
+
+	size_t BlockSize() const { return blockSize; }
+	size_t FreeBlocks() const;
+
+private:
+	struct Node {
+		Node* next;
+	};
+
+	size_t blockSize;
+	size_t maxBlocks;
+	mutable std::mutex mutex;
+	Node* head;
+	size_t count;
+};
@@ -0,0 +1,247 @@
+#include "client_session.h"
+#include <cstring>
+#include <iostream>
+
+ClientSession::ClientSession(uint64_t id, Reactor& reactor, std::string peerAddress, FrameBufferPool& bufferPool,
+	MessageHandler messageHandler, RawFrameHandler rawFrameHandler, ClosedHandler closedHandler)
+	: id(id)
+	, reactor(reactor)
+	, peerAddress(std::move(peerAddress))
+	, bufferPool(bufferPool)
+	, messageHandler(std::move(messageHandler))
+	, rawFrameHandler(std::move(rawFrameHandler))
+	, closedHandler(std::move(closedHandler))
+	, rawReceived(0)
+	, bodyReceived(0)
+	, connectedAt(std::chrono::steady_clock::now())
+	, bytesReceived(0)
+	, messagesReceived(0)
+	, bytesSent(0)
+	, messagesSent(0)
+	, compressedMessages(0)
+	, bytesDecompressed(0)
+	, bytesCopied(0) {
+}
+
+void ClientSession::Close() {
+	reactor.Close(id);
+}
+
+char* ClientSession::PrepareReceive(size_t& writable) {
+	if (rawFrame) {
+		writable = rawPayload->Size() - rawReceived;
+		return rawPayload->Data() + rawReceived;
+	}
+	if (messageBody) {
+		writable = messageBody->Size() - bodyReceived;
+		return messageBody->Data() + bodyReceived;
+	}
+
+	char* buffer = assembler.PrepareWrite(writable);
+	if (!buffer) {
+		std::cerr << "Session " << id << ": invalid message length, dropping client" << std::endl;
+	}
+	return buffer;
+}
+
+bool ClientSession::OnReceived(size_t bytes) {
+	bytesReceived += bytes;
+	if (rawFrame) {
+		rawReceived += bytes;
+		if (rawReceived < rawPayload->Size()) {
+			return true;
+		}
+		return DeliverRawFrame() && DrainAssembler();
+	}
+	if (messageBody) {
+		bodyReceived += bytes;
+		if (bodyReceived < messageBody->Size()) {
+			return true;
+		}
+		DeliverMessageBody();
+		return DrainAssembler();
+	}
+
+	assembler.CommitWrite(bytes);
+	return DrainAssembler();
+}
+
+bool ClientSession::DrainAssembler() {
+	// Every message moves out of the assembler into a pooled buffer the handler can keep
+	std::shared_ptr<ClientSession> self = shared_from_this();
+	while (true) {
+		size_t bodySize = 0;
+		if (assembler.NextMessageBody(bodySize)) {
+			// As with raw frames, only what the last recv read past the prefix is copied
+			messageBody = bufferPool.Acquire(bodySize);
+			bodyReceived = assembler.TakeBuffered(messageBody->Data(), bodySize);
+			if (bodyReceived < bodySize) {
+				break;
+			}
+			DeliverMessageBody();
+			continue;
+		}
+
+		std::string_view message;
+		bool compressed = false;
+		if (assembler.NextMessage(message, compressed)) {
+			// Only compressed messages are left here; they are inflated straight into a pooled buffer
+			messagesReceived++;
+			std::shared_ptr<FrameBuffer> buffer = Inflate(message);
+			if (!buffer) {
+				std::cerr << "Session " << id << ": invalid compressed message, dropping client" << std::endl;
+				return false;
+			}
+			if (messageHandler) {
+				messageHandler(self, std::move(buffer));
+			}
+			continue;
+		}
+
+		std::string_view header;
+		size_t payloadSize = 0;
+		if (!assembler.NextRawFrame(header, payloadSize)) {
+			break;
+		}
+
+		auto frame = std::make_unique<RawFrame>();
+		if (!ParseRawFrameHeader(header, frame->header)) {
+			std::cerr << "Session " << id << ": invalid raw frame header, dropping client" << std::endl;
+			return false;
+		}
+		if (frame->header.compression == TransportCompression::None) {
+			frame->pixels = bufferPool.Acquire(payloadSize);
+			rawPayload = frame->pixels;
+		}
+		else {
+			if (!IsCompressionSupported(frame->header.compression)
+				|| frame->header.rawPayloadSize > assembler.MaxMessageSize()) {
+				std::cerr << "Session " << id << ": unsupported raw frame compression, dropping client" << std::endl;
+				return false;
+			}
+			frame->pixels = bufferPool.Acquire(frame->header.rawPayloadSize);
+			rawPayload = bufferPool.Acquire(payloadSize);
+		}
+		frame->messageSize = header.size() + frame->pixels->Size();
+
+		// Only what the last recv read past the header is copied; the rest lands in place
+		rawReceived = assembler.TakeBuffered(rawPayload->Data(), payloadSize);
+		rawFrame = std::move(frame);
+		if (rawReceived < payloadSize) {
+			break;
+		}
+		if (!DeliverRawFrame()) {
+			return false;
+		}
+	}
+	bytesCopied = assembler.GetStats().bytesCopied;
+	return !assembler.IsCorrupted();
+}
+
+bool ClientSession::DeliverRawFrame() {
+	messagesReceived++;
+	std::unique_ptr<RawFrame> frame = std::move(rawFrame);
+	std::shared_ptr<FrameBuffer> payload = std::move(rawPayload);
+	rawReceived = 0;
+
+	// Compressed payloads are inflated straight into the frame's pooled buffer
+	if (payload != frame->pixels) {
+		if (!decompressor.Decompress(frame->header.compression, payload->Data(), payload->Size(),
+			frame->pixels->Data(), frame->pixels->Size())) {
+			std::cerr << "Session " << id << ": corrupt compressed raw frame, dropping client" << std::endl;
+			return false;
+		}
+		compressedMessages++;
+		bytesDecompressed += frame->pixels->Size();
+	}
+
+	if (rawFrameHandler) {
+		rawFrameHandler(shared_from_this(), std::move(frame));
+	}
+	return true;
+}
+
+void ClientSession::DeliverMessageBody() {
+	messagesReceived++;
+	std::shared_ptr<FrameBuffer> body = std::move(messageBody);
+	bodyReceived = 0;
+	if (messageHandler) {
+		messageHandler(shared_from_this(), std::move(body));
+	}
+}
+
+std::shared_ptr<FrameBuffer> ClientSession::Inflate(std::string_view message) {
+	if (message.size() < kCompressedMessageHeaderSize) {
+		return nullptr;
+	}
+
+	const auto* p = reinterpret_cast<const unsigned char*>(message.data());
+	auto compression = static_cast<TransportCompression>(p[0]);
+	size_t rawSize = static_cast<size_t>(p[1])
+		| (static_cast<size_t>(p[2]) << 8)
+		| (static_cast<size_t>(p[3]) << 16)
+		| (static_cast<size_t>(p[4]) << 24);
+	if (compression == TransportCompression::None || !IsCompressionSupported(compression)
+		|| rawSize > assembler.MaxMessageSize()) {
+		return nullptr;
+	}
+
+	std::shared_ptr<FrameBuffer> inflated = bufferPool.Acquire(rawSize);
+	if (!decompressor.Decompress(compression, message.data() + kCompressedMessageHeaderSize,
+		message.size() - kCompressedMessageHeaderSize, inflated->Data(), rawSize)) {
+		return nullptr;
+	}
+	compressedMessages++;
+	bytesDecompressed += rawSize;
+	return inflated;
+}
+
+void ClientSession::OnClosed() {
+	if (closedHandler) {
+		closedHandler(shared_from_this());
+	}
+}
+
+bool ClientSession::SendMessage(const std::string& message) {
+	// Prefix and payload go out in one buffer so concurrent replies never interleave; acks and
+	// statuses fit on the stack, only large replies such as window lists take a heap buffer
+	constexpr size_t kStackFrameSize = 256;
+	uint32_t len = static_cast<uint32_t>(message.size());
+	size_t frameSize = 4 + message.size();
+	char stackFrame[kStackFrameSize];
+	std::unique_ptr<char[]> heapFrame;
+	char* frame = stackFrame;
+	if (frameSize > kStackFrameSize) {
+		heapFrame.reset(new char[frameSize]);
+		frame = heapFrame.get();
+	}
+	frame[0] = static_cast<char>(len & 0xFF);
+	frame[1] = static_cast<char>((len >> 8) & 0xFF);
+	frame[2] = static_cast<char>((len >> 16) & 0xFF);
+	frame[3] = static_cast<char>((len >> 24) & 0xFF);
+	std::memcpy(frame + 4, message.data(), message.size());
+
+	if (!reactor.Send(id, frame, frameSize)) {
+		return false;
+	}
+
+	bytesSent += frameSize;
+	messagesSent++;
+	return true;
+}
+
+ClientSession::Stats ClientSession::GetStats() const {
+	Stats stats;
+	stats.id = id;
+	stats.peerAddress = peerAddress;
+	stats.bytesReceived = bytesReceived.load();
+	stats.messagesReceived = messagesReceived.load();
+	stats.bytesSent = bytesSent.load();
+	stats.messagesSent = messagesSent.load();
+	stats.compressedMessages = compressedMessages.load();
+	stats.bytesDecompressed = bytesDecompressed.load();
+	stats.bytesCopied = bytesCopied.load();
+	stats.connectedSeconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - connectedAt).count();
+	return stats;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "frame_assembler.h"
+#include "frame_buffer_pool.h"
+#include "raw_frame.h"
+#include "reactor.h"
+#include "reply_channel.h"
+#include "transport_compression.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// һͻӣƴ֡״̬ظͨ
+// ջص Reactor ߳ռö߳
+class ClientSession : public ReplyChannel, public ConnectionHandler,
+	public std::enable_shared_from_this<ClientSession> {
+public:
+	// ϢڳػУһֱ踴
+	using MessageHandler = std::function<void(const std::shared_ptr<ClientSession>&, std::shared_ptr<FrameBuffer>)>;
+	using RawFrameHandler = std::function<void(const std::shared_ptr<ClientSession>&, std::unique_ptr<RawFrame>)>;
+	using ClosedHandler = std::function<void(const std::shared_ptr<ClientSession>&)>;
+
+	struct Stats {
+		uint64_t id = 0;
+		std::string peerAddress;
+		uint64_t bytesReceived = 0;
+		uint64_t messagesReceived = 0;
+		uint64_t bytesSent = 0;
+		uint64_t messagesSent = 0;
+		uint64_t compressedMessages = 0;  // ѹϢ
+		uint64_t bytesDecompressed = 0;   // ЩϢѹֽ
+		uint64_t bytesCopied = 0;         // ƴ֡ƽѻʱƵֱֽֽ recv λ
+		double connectedSeconds = 0;
+	};
+
+	ClientSession(uint64_t id, Reactor& reactor, std::string peerAddress, FrameBufferPool& bufferPool,
+		MessageHandler messageHandler, RawFrameHandler rawFrameHandler, ClosedHandler closedHandler);
+
+	// Ͽ
+	void Close();
+
+	// Ϣÿͻ
+	bool SendMessage(const std::string& message) override;
+
+	char* PrepareReceive(size_t& writable) override;
+	bool OnReceived(size_t bytes) override;
+	void OnClosed() override;
+
+	uint64_t Id() const { return id; }
+	const std::string& PeerAddress() const { return peerAddress; }
+	Stats GetStats() const;
+
+private:
+	uint64_t id;
+	Reactor& reactor;
+	std::string peerAddress;
+	FrameBufferPool& bufferPool;
+	MessageHandler messageHandler;
+	RawFrameHandler rawFrameHandler;
+	ClosedHandler closedHandler;
+	FrameAssembler assembler;
+	// ڽոصԭʼֱ֡ recv ֡
+	std::unique_ptr<RawFrame> rawFrame;
+	// ϵֽ䵽δѹʱ֡壬ѹʱȡĳػ壬ѹ֡
+	std::shared_ptr<FrameBuffer> rawPayload;
+	size_t rawReceived;
+	// ڽյδѹϢ壬ǰ׺һʹӳȡϢֱ recv 
+	std::shared_ptr<FrameBuffer> messageBody;
+	size_t bodyReceived;
+	Decompressor decompressor;
+	std::chrono::steady_clock::time_point connectedAt;
+	std::atomic<uint64_t> bytesReceived;
+	std::atomic<uint64_t> messagesReceived;
+	std::atomic<uint64_t> bytesSent;
+	std::atomic<uint64_t> messagesSent;
+	std::atomic<uint64_t> compressedMessages;
+	std::atomic<uint64_t> bytesDecompressed;
+	std::atomic<uint64_t> bytesCopied;
+
+	// ƴ֡Ϣԭʼ֡δϢʱתֱӽ
+	bool DrainAssembler();
+	// ԭʼ֡ؽѹʧʱ false
+	bool DeliverRawFrame();
+	// Ϣ彻
+	void DeliverMessageBody();
+
+	// ѹϢѹػУϢ𻵻㷨֧ʱؿ
+	std::shared_ptr<FrameBuffer> Inflate(std::string_view message);
+};
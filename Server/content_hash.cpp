@@ -0,0 +1,423 @@
+#include "content_hash.h"
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__SIZEOF_INT128__)
+#include <intrin.h>
+#endif
+
+const uint8_t kXxh3Secret[kXxh3SecretSize] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+namespace {
+	// Assumes a little-endian host, as the asset store's file format does
+	uint64_t ReadLittleEndian64(const uint8_t* data) {
+		uint64_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint32_t ReadLittleEndian32(const uint8_t* data) {
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint64_t RotateLeft64(uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	// XXH64 with seed 0
+	uint64_t Xxh64Round(uint64_t accumulator, uint64_t input) {
+		return RotateLeft64(accumulator + input * kXxhPrime64_2, 31) * kXxhPrime64_1;
+	}
+
+	uint64_t Xxh64MergeRound(uint64_t hash, uint64_t accumulator) {
+		return (hash ^ Xxh64Round(0, accumulator)) * kXxhPrime64_1 + kXxhPrime64_4;
+	}
+
+	// XXH3 with the default secret and seed 0, scalar, following the reference implementation's
+	// structure by input length
+	constexpr uint32_t kPrime32_1 = 0x9E3779B1u;
+	constexpr uint32_t kPrime32_2 = 0x85EBCA77u;
+	constexpr uint32_t kPrime32_3 = 0xC2B2AE3Du;
+
+	constexpr size_t kStripeLength = 64;
+	constexpr size_t kSecretConsumeRate = 8;
+	constexpr size_t kAccumulators = 8;
+	constexpr size_t kSecretMergeStart = 11;
+	constexpr size_t kSecretLastStripeStart = 7;
+	constexpr size_t kMidSizeMax = 240;
+	constexpr size_t kSecretSizeMin = 136;
+
+	uint32_t RotateLeft32(uint32_t value, int bits) {
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	uint32_t SwapBytes32(uint32_t value) {
+		return ((value & 0xFFu) << 24) | ((value & 0xFF00u) << 8) | ((value >> 8) & 0xFF00u) | (value >> 24);
+	}
+
+	uint64_t SwapBytes64(uint64_t value) {
+		return (uint64_t(SwapBytes32(static_cast<uint32_t>(value))) << 32) | SwapBytes32(static_cast<uint32_t>(value >> 32));
+	}
+
+	// Full 128-bit product of two 64-bit values
+	void Multiply64To128(uint64_t left, uint64_t right, uint64_t& low, uint64_t& high) {
+#if defined(__SIZEOF_INT128__)
+		unsigned __int128 product = static_cast<unsigned __int128>(left) * right;
+		low = static_cast<uint64_t>(product);
+		high = static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		low = _umul128(left, right, &high);
+#else
+		uint64_t lowLow = (left & 0xFFFFFFFFu) * (right & 0xFFFFFFFFu);
+		uint64_t highLow = (left >> 32) * (right & 0xFFFFFFFFu);
+		uint64_t lowHigh = (left & 0xFFFFFFFFu) * (right >> 32);
+		uint64_t highHigh = (left >> 32) * (right >> 32);
+		uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFFu) + lowHigh;
+		high = (highLow >> 32) + (cross >> 32) + highHigh;
+		low = (cross << 32) | (lowLow & 0xFFFFFFFFu);
+#endif
+	}
+
+	uint64_t MultiplyFold64(uint64_t left, uint64_t right) {
+		uint64_t low, high;
+		Multiply64To128(left, right, low, high);
+		return low ^ high;
+	}
+
+	uint64_t XorShift64(uint64_t value, int shift) {
+		return value ^ (value >> shift);
+	}
+
+	uint64_t Avalanche(uint64_t value) {
+		value = XorShift64(value, 37);
+		value *= 0x165667919E3779F9ull;
+		return XorShift64(value, 32);
+	}
+
+	uint64_t Mix16(const uint8_t* input, const uint8_t* secret) {
+		return MultiplyFold64(ReadLittleEndian64(input) ^ ReadLittleEndian64(secret),
+			ReadLittleEndian64(input + 8) ^ ReadLittleEndian64(secret + 8));
+	}
+
+	void Mix32(uint64_t& low, uint64_t& high, const uint8_t* first, const uint8_t* second, const uint8_t* secret) {
+		low += Mix16(first, secret);
+		low ^= ReadLittleEndian64(second) + ReadLittleEndian64(second + 8);
+		high += Mix16(second, secret + 16);
+		high ^= ReadLittleEndian64(first) + ReadLittleEndian64(first + 8);
+	}
+
+	Digest128 Digest1To3(const uint8_t* input, size_t size) {
+		uint32_t combinedLow = (uint32_t(input[0]) << 16) | (uint32_t(input[size >> 1]) << 24)
+			| uint32_t(input[size - 1]) | (static_cast<uint32_t>(size) << 8);
+		uint32_t combinedHigh = RotateLeft32(SwapBytes32(combinedLow), 13);
+		uint64_t flipLow = uint64_t(ReadLittleEndian32(kXxh3Secret) ^ ReadLittleEndian32(kXxh3Secret + 4));
+		uint64_t flipHigh = uint64_t(ReadLittleEndian32(kXxh3Secret + 8) ^ ReadLittleEndian32(kXxh3Secret + 12));
+		return { Xxh64Avalanche(combinedLow ^ flipLow), Xxh64Avalanche(combinedHigh ^ flipHigh) };
+	}
+
+	Digest128 Digest4To8(const uint8_t* input, size_t size) {
+		uint64_t combined = uint64_t(ReadLittleEndian32(input)) + (uint64_t(ReadLittleEndian32(input + size - 4)) << 32);
+		uint64_t flip = ReadLittleEndian64(kXxh3Secret + 16) ^ ReadLittleEndian64(kXxh3Secret + 24);
+		uint64_t low, high;
+		Multiply64To128(combined ^ flip, kXxhPrime64_1 + (uint64_t(size) << 2), low, high);
+		high += low << 1;
+		low ^= high >> 3;
+		low = XorShift64(low, 35) * 0x9FB21C651E98DF25ull;
+		low = XorShift64(low, 28);
+		return { low, Avalanche(high) };
+	}
+
+	Digest128 Digest9To16(const uint8_t* input, size_t size) {
+		uint64_t flipLow = ReadLittleEndian64(kXxh3Secret + 32) ^ ReadLittleEndian64(kXxh3Secret + 40);
+		uint64_t flipHigh = ReadLittleEndian64(kXxh3Secret + 48) ^ ReadLittleEndian64(kXxh3Secret + 56);
+		uint64_t inputLow = ReadLittleEndian64(input);
+		uint64_t inputHigh = ReadLittleEndian64(input + size - 8);
+		uint64_t mulLow, mulHigh;
+		Multiply64To128(inputLow ^ inputHigh ^ flipLow, kXxhPrime64_1, mulLow, mulHigh);
+		mulLow += uint64_t(size - 1) << 54;
+		inputHigh ^= flipHigh;
+		mulHigh += inputHigh + uint64_t(static_cast<uint32_t>(inputHigh)) * (kPrime32_2 - 1);
+		mulLow ^= SwapBytes64(mulHigh);
+		uint64_t low, high;
+		Multiply64To128(mulLow, kXxhPrime64_2, low, high);
+		high += mulHigh * kXxhPrime64_2;
+		return { Avalanche(low), Avalanche(high) };
+	}
+
+	Digest128 Digest0To16(const uint8_t* input, size_t size) {
+		if (size > 8) {
+			return Digest9To16(input, size);
+		}
+		if (size >= 4) {
+			return Digest4To8(input, size);
+		}
+		if (size > 0) {
+			return Digest1To3(input, size);
+		}
+		return { Xxh64Avalanche(ReadLittleEndian64(kXxh3Secret + 64) ^ ReadLittleEndian64(kXxh3Secret + 72)),
+			Xxh64Avalanche(ReadLittleEndian64(kXxh3Secret + 80) ^ ReadLittleEndian64(kXxh3Secret + 88)) };
+	}
+
+	Digest128 FinishMidSize(uint64_t low, uint64_t high, size_t size) {
+		return { Avalanche(low + high),
+			0 - Avalanche(low * kXxhPrime64_1 + high * kXxhPrime64_4 + uint64_t(size) * kXxhPrime64_2) };
+	}
+
+	Digest128 Digest17To128(const uint8_t* input, size_t size) {
+		uint64_t low = uint64_t(size) * kXxhPrime64_1;
+		uint64_t high = 0;
+		if (size > 32) {
+			if (size > 64) {
+				if (size > 96) {
+					Mix32(low, high, input + 48, input + size - 64, kXxh3Secret + 96);
+				}
+				Mix32(low, high, input + 32, input + size - 48, kXxh3Secret + 64);
+			}
+			Mix32(low, high, input + 16, input + size - 32, kXxh3Secret + 32);
+		}
+		Mix32(low, high, input, input + size - 16, kXxh3Secret);
+		return FinishMidSize(low, high, size);
+	}
+
+	Digest128 Digest129To240(const uint8_t* input, size_t size) {
+		constexpr size_t kStartOffset = 3;
+		constexpr size_t kLastOffset = 17;
+		size_t rounds = size / 32;
+		uint64_t low = uint64_t(size) * kXxhPrime64_1;
+		uint64_t high = 0;
+		for (size_t i = 0; i < 4; ++i) {
+			Mix32(low, high, input + 32 * i, input + 32 * i + 16, kXxh3Secret + 32 * i);
+		}
+		low = Avalanche(low);
+		high = Avalanche(high);
+		for (size_t i = 4; i < rounds; ++i) {
+			Mix32(low, high, input + 32 * i, input + 32 * i + 16, kXxh3Secret + kStartOffset + 32 * (i - 4));
+		}
+		Mix32(low, high, input + size - 16, input + size - 32, kXxh3Secret + kSecretSizeMin - kLastOffset - 16);
+		return FinishMidSize(low, high, size);
+	}
+
+	void Accumulate512(uint64_t* acc, const uint8_t* input, const uint8_t* secret) {
+		for (size_t i = 0; i < kAccumulators; ++i) {
+			uint64_t value = ReadLittleEndian64(input + 8 * i);
+			uint64_t keyed = value ^ ReadLittleEndian64(secret + 8 * i);
+			acc[i ^ 1] += value;
+			acc[i] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+		}
+	}
+
+	void ScrambleAccumulators(uint64_t* acc, const uint8_t* secret) {
+		for (size_t i = 0; i < kAccumulators; ++i) {
+			acc[i] = (XorShift64(acc[i], 47) ^ ReadLittleEndian64(secret + 8 * i)) * kPrime32_1;
+		}
+	}
+
+	uint64_t MergeAccumulators(const uint64_t* acc, const uint8_t* secret, uint64_t start) {
+		uint64_t result = start;
+		for (size_t i = 0; i < 4; ++i) {
+			result += MultiplyFold64(acc[2 * i] ^ ReadLittleEndian64(secret + 16 * i),
+				acc[2 * i + 1] ^ ReadLittleEndian64(secret + 16 * i + 8));
+		}
+		return Avalanche(result);
+	}
+
+	// The stripes of inputs over 240 bytes; both widths merge the same accumulators
+	void AccumulateLong(uint64_t* acc, const uint8_t* input, size_t size) {
+		const uint64_t initial[kAccumulators] = {
+			kPrime32_3, kXxhPrime64_1, kXxhPrime64_2, kXxhPrime64_3, kXxhPrime64_4, kPrime32_2, kXxhPrime64_5, kPrime32_1 };
+		std::memcpy(acc, initial, sizeof(initial));
+		constexpr size_t kStripesPerBlock = (kXxh3SecretSize - kStripeLength) / kSecretConsumeRate;
+		constexpr size_t kBlockLength = kStripeLength * kStripesPerBlock;
+		size_t blocks = (size - 1) / kBlockLength;
+		for (size_t block = 0; block < blocks; ++block) {
+			for (size_t stripe = 0; stripe < kStripesPerBlock; ++stripe) {
+				Accumulate512(acc, input + block * kBlockLength + stripe * kStripeLength, kXxh3Secret + stripe * kSecretConsumeRate);
+			}
+			ScrambleAccumulators(acc, kXxh3Secret + kXxh3SecretSize - kStripeLength);
+		}
+
+		size_t stripes = ((size - 1) - kBlockLength * blocks) / kStripeLength;
+		for (size_t stripe = 0; stripe < stripes; ++stripe) {
+			Accumulate512(acc, input + blocks * kBlockLength + stripe * kStripeLength, kXxh3Secret + stripe * kSecretConsumeRate);
+		}
+		Accumulate512(acc, input + size - kStripeLength, kXxh3Secret + kXxh3SecretSize - kStripeLength - kSecretLastStripeStart);
+	}
+
+	Digest128 DigestLong(const uint8_t* input, size_t size) {
+		uint64_t acc[kAccumulators];
+		AccumulateLong(acc, input, size);
+		return { MergeAccumulators(acc, kXxh3Secret + kSecretMergeStart, uint64_t(size) * kXxhPrime64_1),
+			MergeAccumulators(acc, kXxh3Secret + kXxh3SecretSize - sizeof(acc) - kSecretMergeStart, ~(uint64_t(size) * kXxhPrime64_2)) };
+	}
+
+	// XXH3-64 by input length
+	uint64_t Hash1To3(const uint8_t* input, size_t size) {
+		uint32_t combined = (uint32_t(input[0]) << 16) | (uint32_t(input[size >> 1]) << 24)
+			| uint32_t(input[size - 1]) | (static_cast<uint32_t>(size) << 8);
+		uint64_t flip = uint64_t(ReadLittleEndian32(kXxh3Secret) ^ ReadLittleEndian32(kXxh3Secret + 4));
+		return Xxh64Avalanche(combined ^ flip);
+	}
+
+	uint64_t Hash4To8(const uint8_t* input, size_t size) {
+		uint64_t combined = uint64_t(ReadLittleEndian32(input + size - 4)) + (uint64_t(ReadLittleEndian32(input)) << 32);
+		uint64_t value = combined ^ (ReadLittleEndian64(kXxh3Secret + 8) ^ ReadLittleEndian64(kXxh3Secret + 16));
+		value ^= RotateLeft64(value, 49) ^ RotateLeft64(value, 24);
+		value *= 0x9FB21C651E98DF25ull;
+		value ^= (value >> 35) + size;
+		value *= 0x9FB21C651E98DF25ull;
+		return XorShift64(value, 28);
+	}
+
+	uint64_t Hash9To16(const uint8_t* input, size_t size) {
+		uint64_t inputLow = ReadLittleEndian64(input) ^ ReadLittleEndian64(kXxh3Secret + 24) ^ ReadLittleEndian64(kXxh3Secret + 32);
+		uint64_t inputHigh = ReadLittleEndian64(input + size - 8) ^ ReadLittleEndian64(kXxh3Secret + 40)
+			^ ReadLittleEndian64(kXxh3Secret + 48);
+		return Avalanche(size + SwapBytes64(inputLow) + inputHigh + MultiplyFold64(inputLow, inputHigh));
+	}
+
+	uint64_t Hash0To16(const uint8_t* input, size_t size) {
+		if (size > 8) {
+			return Hash9To16(input, size);
+		}
+		if (size >= 4) {
+			return Hash4To8(input, size);
+		}
+		if (size > 0) {
+			return Hash1To3(input, size);
+		}
+		return Xxh64Avalanche(ReadLittleEndian64(kXxh3Secret + 56) ^ ReadLittleEndian64(kXxh3Secret + 64));
+	}
+
+	uint64_t Hash17To128(const uint8_t* input, size_t size) {
+		uint64_t acc = uint64_t(size) * kXxhPrime64_1;
+		if (size > 32) {
+			if (size > 64) {
+				if (size > 96) {
+					acc += Mix16(input + 48, kXxh3Secret + 96);
+					acc += Mix16(input + size - 64, kXxh3Secret + 112);
+				}
+				acc += Mix16(input + 32, kXxh3Secret + 64);
+				acc += Mix16(input + size - 48, kXxh3Secret + 80);
+			}
+			acc += Mix16(input + 16, kXxh3Secret + 32);
+			acc += Mix16(input + size - 32, kXxh3Secret + 48);
+		}
+		acc += Mix16(input, kXxh3Secret);
+		acc += Mix16(input + size - 16, kXxh3Secret + 16);
+		return Avalanche(acc);
+	}
+
+	uint64_t Hash129To240(const uint8_t* input, size_t size) {
+		constexpr size_t kStartOffset = 3;
+		constexpr size_t kLastOffset = 17;
+		size_t rounds = size / 16;
+		uint64_t acc = uint64_t(size) * kXxhPrime64_1;
+		for (size_t i = 0; i < 8; ++i) {
+			acc += Mix16(input + 16 * i, kXxh3Secret + 16 * i);
+		}
+		acc = Avalanche(acc);
+		for (size_t i = 8; i < rounds; ++i) {
+			acc += Mix16(input + 16 * i, kXxh3Secret + 16 * (i - 8) + kStartOffset);
+		}
+		acc += Mix16(input + size - 16, kXxh3Secret + kSecretSizeMin - kLastOffset);
+		return Avalanche(acc);
+	}
+
+	uint64_t HashLong(const uint8_t* input, size_t size) {
+		uint64_t acc[kAccumulators];
+		AccumulateLong(acc, input, size);
+		return MergeAccumulators(acc, kXxh3Secret + kSecretMergeStart, uint64_t(size) * kXxhPrime64_1);
+	}
+}
+
+uint64_t Xxh64Avalanche(uint64_t value) {
+	value ^= value >> 33;
+	value *= kXxhPrime64_2;
+	value ^= value >> 29;
+	value *= kXxhPrime64_3;
+	value ^= value >> 32;
+	return value;
+}
+
+uint64_t ComputeXxh64(const void* data, size_t size) {
+	const auto* p = static_cast<const uint8_t*>(data);
+	const uint8_t* const end = p + size;
+	uint64_t hash;
+	if (size >= 32) {
+		uint64_t v1 = kXxhPrime64_1 + kXxhPrime64_2;
+		uint64_t v2 = kXxhPrime64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - kXxhPrime64_1;
+		const uint8_t* const limit = end - 32;
+		do {
+			v1 = Xxh64Round(v1, ReadLittleEndian64(p));
+			v2 = Xxh64Round(v2, ReadLittleEndian64(p + 8));
+			v3 = Xxh64Round(v3, ReadLittleEndian64(p + 16));
+			v4 = Xxh64Round(v4, ReadLittleEndian64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		hash = RotateLeft64(v1, 1) + RotateLeft64(v2, 7) + RotateLeft64(v3, 12) + RotateLeft64(v4, 18);
+		hash = Xxh64MergeRound(hash, v1);
+		hash = Xxh64MergeRound(hash, v2);
+		hash = Xxh64MergeRound(hash, v3);
+		hash = Xxh64MergeRound(hash, v4);
+	}
+	else {
+		hash = kXxhPrime64_5;
+	}
+	hash += size;
+
+	for (; p + 8 <= end; p += 8) {
+		hash = RotateLeft64(hash ^ Xxh64Round(0, ReadLittleEndian64(p)), 27) * kXxhPrime64_1 + kXxhPrime64_4;
+	}
+	if (p + 4 <= end) {
+		hash = RotateLeft64(hash ^ (uint64_t(ReadLittleEndian32(p)) * kXxhPrime64_1), 23) * kXxhPrime64_2 + kXxhPrime64_3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		hash = RotateLeft64(hash ^ (*p * kXxhPrime64_5), 11) * kXxhPrime64_1;
+	}
+	return Xxh64Avalanche(hash);
+}
+
+Digest128 ComputeXxh128(const void* data, size_t size) {
+	const auto* input = static_cast<const uint8_t*>(data);
+	if (size <= 16) {
+		return Digest0To16(input, size);
+	}
+	if (size <= 128) {
+		return Digest17To128(input, size);
+	}
+	if (size <= kMidSizeMax) {
+		return Digest129To240(input, size);
+	}
+	return DigestLong(input, size);
+}
+
+uint64_t ComputeXxh3(const void* data, size_t size) {
+	const auto* input = static_cast<const uint8_t*>(data);
+	if (size <= 16) {
+		return Hash0To16(input, size);
+	}
+	if (size <= 128) {
+		return Hash17To128(input, size);
+	}
+	if (size <= kMidSizeMax) {
+		return Hash129To240(input, size);
+	}
+	return HashLong(input, size);
+}
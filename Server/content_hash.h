@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// õļݹϣ xxHash οʵ (0.8) Ľλһ£
+//   XXH3-128  ͼƬ idͻ xxhash-rust  xxh3_128 ͬժҪ
+//   XXH3-64   ϴýļ idͻ xxhash-rust  xxh3_64 
+//   XXH64     ͼƬ洢ļĿУ
+// 밴С˶ȡ洢ļʽһٶΪС
+
+struct Digest128 {
+	uint64_t low = 0;
+	uint64_t high = 0;
+};
+
+// XXH64  XXH3 ĬԿͼϣԴ SIMD ۼӵĹϣҲȡ
+constexpr uint64_t kXxhPrime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kXxhPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kXxhPrime64_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kXxhPrime64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kXxhPrime64_5 = 0x27D4EB2F165667C5ull;
+
+constexpr size_t kXxh3SecretSize = 192;
+extern const uint8_t kXxh3Secret[kXxh3SecretSize];
+
+// XXH64 ջϣʹ 64 λֵÿһλӰÿһλ
+uint64_t Xxh64Avalanche(uint64_t value);
+
+// XXH64 0
+uint64_t ComputeXxh64(const void* data, size_t size);
+
+// XXH3-64ĬԿ 0
+uint64_t ComputeXxh3(const void* data, size_t size);
+
+// XXH3-128 (XXH128)ĬԿ 0
+Digest128 ComputeXxh128(const void* data, size_t size);
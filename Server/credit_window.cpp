@@ -0,0 +1,43 @@
+#include "credit_window.h"
+
+CreditWindow::CreditWindow(uint32_t frames, uint64_t bytes)
+	: frames(frames)
+	, bytes(bytes) {
+}
+
+void CreditWindow::SetGrantHandler(GrantHandler handler) {
+	grantHandler = std::move(handler);
+}
+
+bool CreditWindow::Acquire(uint64_t targetWindow, uint64_t messageSize) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = windows[targetWindow];
+	// A single frame larger than the byte window is allowed when nothing else is in flight
+	bool withinCredit = entry.framesInFlight < frames
+		&& (entry.bytesInFlight == 0 || entry.bytesInFlight + messageSize <= bytes);
+	entry.framesInFlight++;
+	entry.bytesInFlight += messageSize;
+	return withinCredit;
+}
+
+void CreditWindow::Release(uint64_t targetWindow, uint64_t messageSize) {
+	uint64_t framesReleased = 0;
+	uint64_t bytesReleased = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = windows.find(targetWindow);
+		if (it == windows.end() || it->second.framesInFlight == 0) {
+			return;
+		}
+		Entry& entry = it->second;
+		entry.framesInFlight--;
+		entry.bytesInFlight -= messageSize;
+		framesReleased = ++entry.framesReleased;
+		bytesReleased = entry.bytesReleased += messageSize;
+	}
+
+	// Totals are cumulative, so grants sent from different threads may arrive in any order
+	if (grantHandler) {
+		grantHandler(targetWindow, framesReleased, bytesReleased);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+// һʽỰԸĿ괰ڵö
+// ÿյ֡ (ܾ֡) ռöȣֱ֡滻ȡܾ黹
+// 滻֡ˮ滻ֺ֡ű棬ʹͻ˵ķٶȸٶ
+// 黹Ķۼֵ֪ͨͻˣͻ˾ݴ;ֽ֡
+class CreditWindow {
+public:
+	using GrantHandler = std::function<void(uint64_t targetWindow, uint64_t framesReleased, uint64_t bytesReleased)>;
+
+	CreditWindow(uint32_t frames, uint64_t bytes);
+
+	// öȹ黹صڽ̻߳߳ϵ
+	void SetGrantHandler(GrantHandler handler);
+
+	uint32_t Frames() const { return frames; }
+	uint64_t Bytes() const { return bytes; }
+
+	// һ֡ false ʾͻ˳˶
+	// ۽Σ֡Ҫڴ Release
+	bool Acquire(uint64_t targetWindow, uint64_t messageSize);
+
+	// 黹һ֡ռõĶ
+	void Release(uint64_t targetWindow, uint64_t messageSize);
+
+private:
+	struct Entry {
+		uint64_t framesInFlight = 0;
+		uint64_t bytesInFlight = 0;
+		uint64_t framesReleased = 0;
+		uint64_t bytesReleased = 0;
+	};
+
+	uint32_t frames;
+	uint64_t bytes;
+	GrantHandler grantHandler;
+	std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> windows;
+};
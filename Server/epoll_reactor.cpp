@@ -0,0 +1,408 @@
+#include "epoll_reactor.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace {
+	constexpr int kMaxEvents = 64;
+	// Bound the work done for one connection per wakeup so busy clients cannot starve others
+	constexpr int kMaxReadsPerEvent = 16;
+	constexpr uint32_t kReadEvents = EPOLLIN | EPOLLRDHUP;
+}
+
+std::unique_ptr<Reactor> CreateReactor(size_t ioThreads) {
+	return std::make_unique<EpollReactor>(ioThreads);
+}
+
+EpollReactor::EpollReactor(size_t ioThreads)
+	: ioThreadCount(std::max<size_t>(1, ioThreads))
+	, running(false)
+	, listenSocket(kInvalidSocket)
+	, nextLoop(0)
+	, nextConnectionId(1) {
+}
+
+EpollReactor::~EpollReactor() {
+	Stop();
+}
+
+bool EpollReactor::Start(uint16_t port, AcceptHandler handler) {
+	if (running) {
+		return true;
+	}
+
+	listenSocket = socket_compat::Listen(port);
+	if (listenSocket == kInvalidSocket || !socket_compat::SetNonBlocking(listenSocket)) {
+		socket_compat::Close(listenSocket);
+		listenSocket = kInvalidSocket;
+		return false;
+	}
+	acceptHandler = std::move(handler);
+
+	for (size_t i = 0; i < ioThreadCount; ++i) {
+		auto loop = std::make_unique<Loop>();
+		loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+		loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		// The wake descriptor is tagged with a null pointer, the listener with this reactor
+		epoll_event wakeEvent = {};
+		wakeEvent.events = EPOLLIN;
+		wakeEvent.data.ptr = nullptr;
+		bool ok = loop->epollFd >= 0 && loop->wakeFd >= 0
+			&& epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &wakeEvent) == 0;
+
+		if (ok && i == 0) {
+			epoll_event listenEvent = {};
+			listenEvent.events = EPOLLIN;
+			listenEvent.data.ptr = this;
+			ok = epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, listenSocket, &listenEvent) == 0;
+		}
+
+		loops.push_back(std::move(loop));
+		if (!ok) {
+			std::cerr << "Failed to create epoll instance" << std::endl;
+			running = true;
+			Stop();
+			return false;
+		}
+	}
+
+	running = true;
+	for (size_t i = 0; i < loops.size(); ++i) {
+		loops[i]->thread = std::thread(&EpollReactor::LoopThread, this, std::ref(*loops[i]), i == 0);
+	}
+	return true;
+}
+
+void EpollReactor::Stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+
+	for (auto& loop : loops) {
+		uint64_t one = 1;
+		if (loop->wakeFd >= 0) {
+			ssize_t ignored = write(loop->wakeFd, &one, sizeof(one));
+			(void)ignored;
+		}
+	}
+	for (auto& loop : loops) {
+		if (loop->thread.joinable()) {
+			loop->thread.join();
+		}
+	}
+
+	socket_compat::Close(listenSocket);
+	listenSocket = kInvalidSocket;
+
+	std::unordered_map<uint64_t, std::shared_ptr<Connection>> closing;
+	{
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		closing.swap(connections);
+	}
+	for (auto& entry : closing) {
+		Connection& connection = *entry.second;
+		{
+			std::lock_guard<std::mutex> lock(connection.sendMutex);
+			connection.closed = true;
+			socket_compat::Close(connection.socket);
+			connection.socket = kInvalidSocket;
+		}
+		connection.handler->OnClosed();
+	}
+
+	for (auto& loop : loops) {
+		if (loop->epollFd >= 0) {
+			close(loop->epollFd);
+		}
+		if (loop->wakeFd >= 0) {
+			close(loop->wakeFd);
+		}
+	}
+	loops.clear();
+}
+
+void EpollReactor::LoopThread(Loop& loop, bool acceptsConnections) {
+	epoll_event events[kMaxEvents];
+
+	while (running) {
+		int count = epoll_wait(loop.epollFd, events, kMaxEvents, -1);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cerr << "epoll_wait failed: " << errno << std::endl;
+			break;
+		}
+
+		for (int i = 0; i < count; ++i) {
+			void* tag = events[i].data.ptr;
+			if (!tag) {
+				uint64_t value = 0;
+				ssize_t ignored = read(loop.wakeFd, &value, sizeof(value));
+				(void)ignored;
+				continue;
+			}
+			if (tag == this) {
+				if (acceptsConnections) {
+					AcceptPending();
+				}
+				continue;
+			}
+
+			// A connection is only ever removed by its own loop, so the pointer is valid here
+			Connection& connection = *static_cast<Connection*>(tag);
+			bool keep = true;
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				keep = HandleReadable(connection);
+			}
+			if (keep && (events[i].events & EPOLLOUT)) {
+				keep = HandleWritable(connection);
+			}
+			if (!keep) {
+				CloseConnection(connection);
+			}
+		}
+	}
+}
+
+void EpollReactor::AcceptPending() {
+	while (running) {
+		sockaddr_in clientAddr = {};
+		socklen_t clientAddrLen = sizeof(clientAddr);
+		int socket = accept4(listenSocket, reinterpret_cast<sockaddr*>(&clientAddr), &clientAddrLen,
+			SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (socket < 0) {
+			int error = errno;
+			if (error == EINTR) {
+				continue;
+			}
+			if (!socket_compat::IsWouldBlock(error)) {
+				std::cerr << "Failed to accept connection: " << error << std::endl;
+			}
+			return;
+		}
+
+		socket_compat::SetNoDelay(socket);
+		uint64_t id = nextConnectionId++;
+		std::shared_ptr<ConnectionHandler> handler = acceptHandler
+			? acceptHandler(id, socket_compat::FormatAddress(clientAddr))
+			: nullptr;
+		if (!handler) {
+			socket_compat::Close(socket);
+			continue;
+		}
+
+		auto connection = std::make_shared<Connection>();
+		connection->id = id;
+		connection->socket = socket;
+		connection->handler = handler;
+		connection->loopIndex = nextLoop++ % loops.size();
+		{
+			std::lock_guard<std::mutex> lock(connectionsMutex);
+			connections[id] = connection;
+		}
+
+		epoll_event event = {};
+		event.events = kReadEvents;
+		event.data.ptr = connection.get();
+		if (epoll_ctl(loops[connection->loopIndex]->epollFd, EPOLL_CTL_ADD, socket, &event) != 0) {
+			std::cerr << "Failed to register connection " << id << std::endl;
+			{
+				std::lock_guard<std::mutex> lock(connectionsMutex);
+				connections.erase(id);
+			}
+			socket_compat::Close(socket);
+			handler->OnClosed();
+		}
+	}
+}
+
+bool EpollReactor::HandleReadable(Connection& connection) {
+	for (int i = 0; i < kMaxReadsPerEvent; ++i) {
+		size_t writable = 0;
+		char* buffer = connection.handler->PrepareReceive(writable);
+		if (!buffer || writable == 0) {
+			return false;
+		}
+
+		ssize_t received = recv(connection.socket, buffer, writable, 0);
+		if (received > 0) {
+			if (!connection.handler->OnReceived(static_cast<size_t>(received))) {
+				return false;
+			}
+			if (static_cast<size_t>(received) < writable) {
+				// Socket buffer drained; level triggering brings us back for more
+				return true;
+			}
+			continue;
+		}
+		if (received == 0) {
+			return false;
+		}
+
+		int error = errno;
+		if (error == EINTR) {
+			continue;
+		}
+		return socket_compat::IsWouldBlock(error);
+	}
+	return true;
+}
+
+bool EpollReactor::HandleWritable(Connection& connection) {
+	std::lock_guard<std::mutex> lock(connection.sendMutex);
+	if (connection.closed) {
+		return false;
+	}
+	return FlushLocked(connection);
+}
+
+bool EpollReactor::FlushLocked(Connection& connection) {
+	while (connection.outboundOffset < connection.outbound.size()) {
+		ssize_t sent = send(connection.socket,
+			connection.outbound.data() + connection.outboundOffset,
+			connection.outbound.size() - connection.outboundOffset, MSG_NOSIGNAL);
+		if (sent > 0) {
+			connection.outboundOffset += static_cast<size_t>(sent);
+			continue;
+		}
+
+		int error = errno;
+		if (error == EINTR) {
+			continue;
+		}
+		if (socket_compat::IsWouldBlock(error)) {
+			ArmWriteLocked(connection, true);
+			return true;
+		}
+		return false;
+	}
+
+	connection.outbound.clear();
+	connection.outboundOffset = 0;
+	ArmWriteLocked(connection, false);
+	return true;
+}
+
+void EpollReactor::ArmWriteLocked(Connection& connection, bool armed) {
+	if (connection.writeArmed == armed) {
+		return;
+	}
+
+	epoll_event event = {};
+	event.events = armed ? (kReadEvents | EPOLLOUT) : kReadEvents;
+	event.data.ptr = &connection;
+	epoll_ctl(loops[connection.loopIndex]->epollFd, EPOLL_CTL_MOD, connection.socket, &event);
+	connection.writeArmed = armed;
+}
+
+bool EpollReactor::Send(uint64_t connectionId, const char* data, size_t size) {
+	std::shared_ptr<Connection> connection = FindConnection(connectionId);
+	if (!connection) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(connection->sendMutex);
+	if (connection->closed) {
+		return false;
+	}
+
+	// A peer that stops reading would otherwise grow the queue without bound
+	size_t queued = connection->outbound.size() - connection->outboundOffset;
+	if (queued + size > kMaxQueuedSendBytes) {
+		std::cerr << "Connection " << connectionId << ": peer is not reading (" << queued
+			<< " bytes queued), closing" << std::endl;
+		// Nothing queued will go out any more; later sends fail on the shut down socket
+		std::string().swap(connection->outbound);
+		connection->outboundOffset = 0;
+		ArmWriteLocked(*connection, false);
+		shutdown(connection->socket, SHUT_RDWR);
+		return false;
+	}
+
+	// Keep ordering: once something is queued, new data goes behind it
+	if (!connection->outbound.empty()) {
+		// Drop what was already sent once it is the larger part, so a queue that never fully drains stays bounded
+		if (connection->outboundOffset >= connection->outbound.size() / 2) {
+			connection->outbound.erase(0, connection->outboundOffset);
+			connection->outboundOffset = 0;
+		}
+		connection->outbound.append(data, size);
+		return true;
+	}
+
+	size_t sentTotal = 0;
+	while (sentTotal < size) {
+		ssize_t sent = send(connection->socket, data + sentTotal, size - sentTotal, MSG_NOSIGNAL);
+		if (sent > 0) {
+			sentTotal += static_cast<size_t>(sent);
+			continue;
+		}
+
+		int error = errno;
+		if (error == EINTR) {
+			continue;
+		}
+		if (socket_compat::IsWouldBlock(error)) {
+			break;
+		}
+		// Let the owning loop notice the broken connection and close it
+		shutdown(connection->socket, SHUT_RDWR);
+		return false;
+	}
+
+	if (sentTotal < size) {
+		connection->outbound.assign(data + sentTotal, size - sentTotal);
+		connection->outboundOffset = 0;
+		ArmWriteLocked(*connection, true);
+	}
+	return true;
+}
+
+void EpollReactor::Close(uint64_t connectionId) {
+	std::shared_ptr<Connection> connection = FindConnection(connectionId);
+	if (!connection) {
+		return;
+	}
+
+	// The owning loop sees the hang-up and performs the actual close
+	std::lock_guard<std::mutex> lock(connection->sendMutex);
+	if (!connection->closed) {
+		shutdown(connection->socket, SHUT_RDWR);
+	}
+}
+
+void EpollReactor::CloseConnection(Connection& connection) {
+	std::shared_ptr<Connection> keepAlive;
+	{
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		auto it = connections.find(connection.id);
+		if (it == connections.end()) {
+			return;
+		}
+		keepAlive = std::move(it->second);
+		connections.erase(it);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(connection.sendMutex);
+		connection.closed = true;
+		epoll_ctl(loops[connection.loopIndex]->epollFd, EPOLL_CTL_DEL, connection.socket, nullptr);
+		socket_compat::Close(connection.socket);
+		connection.socket = kInvalidSocket;
+	}
+	connection.handler->OnClosed();
+}
+
+std::shared_ptr<EpollReactor::Connection> EpollReactor::FindConnection(uint64_t connectionId) {
+	std::lock_guard<std::mutex> lock(connectionsMutex);
+	auto it = connections.find(connectionId);
+	return it != connections.end() ? it->second : nullptr;
+}
+
+#endif
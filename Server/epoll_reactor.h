@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "reactor.h"
+#include "socket_compat.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//  epoll  Reactorÿ߳һ epoll ʵӰѯ䵽߳
+// ˮƽ socket
+class EpollReactor : public Reactor {
+public:
+	explicit EpollReactor(size_t ioThreads);
+	~EpollReactor() override;
+
+	bool Start(uint16_t port, AcceptHandler acceptHandler) override;
+	void Stop() override;
+	bool Send(uint64_t connectionId, const char* data, size_t size) override;
+	void Close(uint64_t connectionId) override;
+
+private:
+	struct Connection {
+		uint64_t id = 0;
+		SocketHandle socket = kInvalidSocket;
+		size_t loopIndex = 0;
+		std::shared_ptr<ConnectionHandler> handler;
+		std::mutex sendMutex;
+		std::string outbound;      // δ
+		size_t outboundOffset = 0;
+		bool writeArmed = false;   // Ƿѹע EPOLLOUT
+		bool closed = false;
+	};
+
+	struct Loop {
+		int epollFd = -1;
+		int wakeFd = -1;
+		std::thread thread;
+	};
+
+	size_t ioThreadCount;
+	std::atomic<bool> running;
+	SocketHandle listenSocket;
+	AcceptHandler acceptHandler;
+	std::vector<std::unique_ptr<Loop>> loops;
+	std::atomic<size_t> nextLoop;
+	std::atomic<uint64_t> nextConnectionId;
+	std::mutex connectionsMutex;
+	std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections;
+
+	// ̺߳
+	void LoopThread(Loop& loop, bool acceptsConnections);
+
+	// й
+	void AcceptPending();
+
+	// ɶ¼ false ʾҪر
+	bool HandleReadable(Connection& connection);
+
+	// д¼ false ʾҪر
+	bool HandleWritable(Connection& connection);
+
+	// Ŷӵݣ÷ sendMutex
+	bool FlushLocked(Connection& connection);
+
+	//  EPOLLOUT ע״̬÷ sendMutex
+	void ArmWriteLocked(Connection& connection, bool armed);
+
+	// ߳Ϲر
+	void CloseConnection(Connection& connection);
+
+	std::shared_ptr<Connection> FindConnection(uint64_t connectionId);
+};
+
+#endif
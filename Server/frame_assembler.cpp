@@ -0,0 +1,240 @@
+#include "frame_assembler.h"
+#include "raw_frame.h"
+#include "transport_compression.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// Smallest free tail we hand to recv when the next message length is still unknown
+	constexpr size_t kMinReadSize = 4096;
+	// Messages whose missing part is at least this big are read exactly up to their end,
+	// so the following message starts on an empty buffer and never has to be moved
+	constexpr size_t kDirectReadThreshold = 64 * 1024;
+}
+
+FrameAssembler::FrameAssembler(size_t initialCapacity, size_t maxMessageSize)
+	: storage(new char[std::max(initialCapacity, kMinReadSize)])
+	, capacity(std::max(initialCapacity, kMinReadSize))
+	, readPos(0)
+	, writePos(0)
+	, initialCapacity(std::max(initialCapacity, kMinReadSize))
+	, maxMessageSize(maxMessageSize)
+	, corrupted(false) {
+}
+
+bool FrameAssembler::PeekMessageLength(uint32_t& length) const {
+	if (writePos - readPos < kHeaderSize) {
+		return false;
+	}
+
+	// Length prefix is little endian regardless of host byte order
+	const auto* p = reinterpret_cast<const unsigned char*>(storage.get() + readPos);
+	length = static_cast<uint32_t>(p[0])
+		| (static_cast<uint32_t>(p[1]) << 8)
+		| (static_cast<uint32_t>(p[2]) << 16)
+		| (static_cast<uint32_t>(p[3]) << 24);
+	return true;
+}
+
+size_t FrameAssembler::RawHeaderSize() const {
+	if (writePos - readPos < kHeaderSize + kRawFramePrefixSize) {
+		return kRawFramePrefixSize;
+	}
+
+	size_t size = PeekRawFrameHeaderSize(storage.get() + readPos + kHeaderSize);
+	return size >= kRawFrameHeaderSizeV1 && size <= kRawFrameHeaderSize ? size : 0;
+}
+
+void FrameAssembler::EnsureContiguous(size_t required) {
+	if (capacity - readPos >= required) {
+		return;
+	}
+
+	size_t buffered = writePos - readPos;
+	if (capacity >= required) {
+		// Enough room overall, move the partial message to the front
+		std::memmove(storage.get(), storage.get() + readPos, buffered);
+		stats.compactions++;
+	}
+	else {
+		// Grow and move the partial message in the same pass
+		size_t newCapacity = std::max(required, capacity * 2);
+		std::unique_ptr<char[]> newStorage(new char[newCapacity]);
+		std::memcpy(newStorage.get(), storage.get() + readPos, buffered);
+		storage = std::move(newStorage);
+		capacity = newCapacity;
+		stats.growths++;
+	}
+
+	stats.bytesCopied += buffered;
+	readPos = 0;
+	writePos = buffered;
+}
+
+char* FrameAssembler::PrepareWrite(size_t& writable) {
+	writable = 0;
+	if (corrupted) {
+		return nullptr;
+	}
+
+	// Everything delivered: rewind for free instead of moving anything
+	if (readPos == writePos) {
+		readPos = 0;
+		writePos = 0;
+	}
+
+	uint32_t length = 0;
+	if (PeekMessageLength(length)) {
+		// Raw frames carry their compression in the frame header, never in the prefix
+		if ((length & ~(kRawFrameFlag | kCompressedMessageFlag)) > maxMessageSize
+			|| ((length & kRawFrameFlag) && (length & kCompressedMessageFlag))) {
+			corrupted = true;
+			return nullptr;
+		}
+
+		if (length & kRawFrameFlag) {
+			// Stop at the end of the raw frame header; the payload goes to the caller's buffer
+			size_t headerSize = RawHeaderSize();
+			if (headerSize == 0) {
+				corrupted = true;
+				return nullptr;
+			}
+			size_t total = kHeaderSize + headerSize;
+			EnsureContiguous(total);
+			if (writePos - readPos < total) {
+				writable = total - (writePos - readPos);
+				return storage.get() + writePos;
+			}
+		}
+		else {
+			// Length is known: reserve room for the whole message so it is received in place
+			size_t total = kHeaderSize + (length & ~kCompressedMessageFlag);
+			EnsureContiguous(total);
+
+			// Also when the message ends too close to the end of the buffer for another read: reading
+			// past it would compact or grow the buffer and move the whole message for a few bytes
+			size_t end = readPos + total;
+			if (end > writePos && (end - writePos >= kDirectReadThreshold || capacity - end < kMinReadSize)) {
+				writable = end - writePos;
+				return storage.get() + writePos;
+			}
+		}
+	}
+
+	if (capacity - writePos < kMinReadSize) {
+		EnsureContiguous(writePos - readPos + kMinReadSize);
+	}
+
+	writable = capacity - writePos;
+	return storage.get() + writePos;
+}
+
+void FrameAssembler::CommitWrite(size_t bytes) {
+	writePos = std::min(writePos + bytes, capacity);
+}
+
+bool FrameAssembler::NextMessage(std::string_view& message, bool& compressed) {
+	if (corrupted) {
+		return false;
+	}
+
+	uint32_t length = 0;
+	if (!PeekMessageLength(length)) {
+		return false;
+	}
+
+	if (length & kRawFrameFlag) {
+		return false;
+	}
+
+	compressed = (length & kCompressedMessageFlag) != 0;
+	length &= ~kCompressedMessageFlag;
+	if (length > maxMessageSize) {
+		corrupted = true;
+		return false;
+	}
+
+	if (writePos - readPos < kHeaderSize + length) {
+		// Not enough data for a complete message, wait for more data
+		return false;
+	}
+
+	message = std::string_view(storage.get() + readPos + kHeaderSize, length);
+	readPos += kHeaderSize + length;
+
+	stats.messages++;
+	stats.bytesDelivered += length;
+	return true;
+}
+
+bool FrameAssembler::NextRawFrame(std::string_view& header, size_t& payloadSize) {
+	uint32_t length = 0;
+	if (corrupted || !PeekMessageLength(length) || !(length & kRawFrameFlag)) {
+		return false;
+	}
+
+	if (length & kCompressedMessageFlag) {
+		corrupted = true;
+		return false;
+	}
+
+	length &= ~kRawFrameFlag;
+	size_t headerSize = RawHeaderSize();
+	if (headerSize == 0 || length < headerSize || length > maxMessageSize) {
+		corrupted = true;
+		return false;
+	}
+
+	// Until the fixed prefix is in, headerSize is only the prefix size
+	if (writePos - readPos < kHeaderSize + kRawFramePrefixSize
+		|| writePos - readPos < kHeaderSize + headerSize) {
+		return false;
+	}
+
+	header = std::string_view(storage.get() + readPos + kHeaderSize, headerSize);
+	payloadSize = length - headerSize;
+	readPos += kHeaderSize + headerSize;
+
+	stats.messages++;
+	stats.bytesDelivered += payloadSize;
+	return true;
+}
+
+bool FrameAssembler::NextMessageBody(size_t& size) {
+	uint32_t length = 0;
+	if (corrupted || !PeekMessageLength(length) || (length & (kRawFrameFlag | kCompressedMessageFlag))) {
+		return false;
+	}
+
+	if (length > maxMessageSize) {
+		corrupted = true;
+		return false;
+	}
+
+	size = length;
+	readPos += kHeaderSize;
+
+	stats.messages++;
+	stats.bytesDelivered += length;
+	return true;
+}
+
+size_t FrameAssembler::TakeBuffered(char* destination, size_t maxBytes) {
+	size_t bytes = std::min(maxBytes, writePos - readPos);
+	std::memcpy(destination, storage.get() + readPos, bytes);
+	readPos += bytes;
+	stats.bytesCopied += bytes;
+	return bytes;
+}
+
+void FrameAssembler::Reset() {
+	readPos = 0;
+	writePos = 0;
+	corrupted = false;
+
+	// Do not keep a multi-megabyte buffer alive for an idle connection
+	if (capacity > initialCapacity) {
+		storage.reset(new char[initialCapacity]);
+		capacity = initialCapacity;
+	}
+}
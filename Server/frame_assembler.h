@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// ǰ׺ (4 ֽС) Ϣƴ֡
+// recv ֱдڲϢԷӵͼʽ÷
+// ԭʼ֡ (ǰ׺λ 1) ֻ嵽֡ͷΪֹɵ÷յԼĻ
+// ѹϢ (ǰ׺θλ 1) ԭɵ÷ѹ
+class FrameAssembler {
+public:
+	static constexpr size_t kHeaderSize = 4;
+
+	struct Stats {
+		uint64_t messages = 0;       // ѽϢ
+		uint64_t bytesDelivered = 0; // ѽϢֽ
+		uint64_t bytesCopied = 0;    // /ݶƵֽ
+		uint64_t compactions = 0;    // 
+		uint64_t growths = 0;        // ݴ
+	};
+
+	explicit FrameAssembler(size_t initialCapacity = 64 * 1024,
+		size_t maxMessageSize = 256 * 1024 * 1024);
+
+	// Ԥдռ䣬ؿֱ recv ĵַwritable Ϊдֽ
+	// ú֮ǰصϢͼȫʧЧ
+	char* PrepareWrite(size_t& writable);
+
+	// ύ recv ʵдֽ
+	void CommitWrite(size_t bytes);
+
+	// ȡһϢͼһ PrepareWrite/Reset ֮ǰЧ
+	// compressed ʾϢѹ֡ͷ + ѹ ( transport_compression.h)
+	// һԭʼ֡ʱ falseӦ NextRawFrame
+	bool NextMessage(std::string_view& message, bool& compressed);
+
+	// ȡһԭʼ֡֡ͷpayloadSize Ϊ֡ͷ֮ĸֽ
+	// ѻĲ TakeBuffered ȡߣɵ÷ֱ recv
+	bool NextRawFrame(std::string_view& header, size_t& payloadSize);
+
+	// ȡһδѹϢĳǰ׺size ΪϢֽ
+	// ԭʼ֡һϢѻĲ TakeBuffered ȡߣɵ÷ֱ recv
+	// һԭʼ֡ѹϢʱ false
+	bool NextMessageBody(size_t& size);
+
+	// ѻ ( maxBytes ֽ) ƽ÷ʵֽ
+	size_t TakeBuffered(char* destination, size_t maxBytes);
+
+	// ǰ׺ޣѲ
+	bool IsCorrupted() const { return corrupted; }
+
+	//  (ʱ)
+	void Reset();
+
+	size_t BufferedSize() const { return writePos - readPos; }
+	size_t Capacity() const { return capacity; }
+	size_t MaxMessageSize() const { return maxMessageSize; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	std::unique_ptr<char[]> storage;
+	size_t capacity;
+	size_t readPos;
+	size_t writePos;
+	size_t initialCapacity;
+	size_t maxMessageSize;
+	bool corrupted;
+	Stats stats;
+
+	// ȡǰϢĳǰ׺ 4 ֽʱ false
+	bool PeekMessageLength(uint32_t& length) const;
+
+	// ǰԭʼ֡Ҫ֡ͷȣ̶ǰ׺δʱΪǰ׺ȣ֮Ϊ֡ͷĳ
+	// ĳȲϷʱ 0
+	size_t RawHeaderSize() const;
+
+	// ֤ readPos  required ֽڵռ
+	void EnsureContiguous(size_t required);
+};
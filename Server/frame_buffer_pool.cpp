@@ -0,0 +1,382 @@
+#include "frame_buffer_pool.h"
+#include "block_free_list.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr size_t kMinClassShift = 8;   // The smallest class holds 256 bytes
+	constexpr size_t kStepsPerDoubling = 4;
+
+	size_t FloorLog2(size_t value) {
+		size_t shift = 0;
+		while (value >>= 1) {
+			++shift;
+		}
+		return shift;
+	}
+
+	size_t RoundUp(size_t value, size_t multiple) {
+		return (value + multiple - 1) / multiple * multiple;
+	}
+
+	// Freed control blocks kept for reuse; more than there are buffers in flight at once
+	constexpr size_t kMaxFreeControlBlocks = 1024;
+
+	// Allocates the shared_ptr control blocks of handed-out buffers from a free list, so that taking
+	// a pooled buffer does not touch the heap at all. The control block is the only thing allocated.
+	template <typename T>
+	class ControlBlockAllocator {
+	public:
+		using value_type = T;
+
+		ControlBlockAllocator() = default;
+		template <typename U>
+		ControlBlockAllocator(const ControlBlockAllocator<U>&) {}
+
+		T* allocate(size_t count) {
+			if (count != 1) {
+				return static_cast<T*>(::operator new(count * sizeof(T)));
+			}
+			return static_cast<T*>(FreeList().Allocate());
+		}
+
+		void deallocate(T* block, size_t count) {
+			if (count != 1) {
+				::operator delete(block);
+				return;
+			}
+			FreeList().Deallocate(block);
+		}
+
+		template <typename U>
+		bool operator==(const ControlBlockAllocator<U>&) const { return true; }
+		template <typename U>
+		bool operator!=(const ControlBlockAllocator<U>&) const { return false; }
+
+	private:
+		static BlockFreeList& FreeList() {
+			// Never destroyed, as buffers may outlive the pool and static destruction
+			static BlockFreeList* freeList = new BlockFreeList(sizeof(T), kMaxFreeControlBlocks);
+			return *freeList;
+		}
+	};
+
+#ifdef _WIN32
+	size_t PageSize() {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+	}
+
+	size_t HugePageSize() {
+		size_t size = GetLargePageMinimum();
+		return size > 0 ? size : FrameBufferPool::kHugePageBytes;
+	}
+
+	// Large pages need SeLockMemoryPrivilege granted to the account and enabled in the token
+	bool EnableHugePages() {
+		if (GetLargePageMinimum() == 0) {
+			return false;
+		}
+		HANDLE token = nullptr;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+			return false;
+		}
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		// AdjustTokenPrivileges succeeds with ERROR_NOT_ALL_ASSIGNED when the account lacks the right
+		bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+			&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+			&& GetLastError() == ERROR_SUCCESS;
+		CloseHandle(token);
+		return enabled;
+	}
+
+	char* MapPages(size_t bytes, bool hugePages) {
+		DWORD type = MEM_RESERVE | MEM_COMMIT | (hugePages ? MEM_LARGE_PAGES : 0);
+		return static_cast<char*>(VirtualAlloc(nullptr, bytes, type, PAGE_READWRITE));
+	}
+
+	void UnmapPages(char* data, size_t) {
+		VirtualFree(data, 0, MEM_RELEASE);
+	}
+#else
+	size_t PageSize() {
+		long size = sysconf(_SC_PAGESIZE);
+		return size > 0 ? static_cast<size_t>(size) : 4096;
+	}
+
+	size_t HugePageSize() {
+		return FrameBufferPool::kHugePageBytes;
+	}
+
+	// Transparent huge pages need no privilege; whether the kernel backs a region is up to it
+	bool EnableHugePages() {
+#ifdef MADV_HUGEPAGE
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	char* MapPages(size_t bytes, bool hugePages) {
+		if (!hugePages) {
+			void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			return data == MAP_FAILED ? nullptr : static_cast<char*>(data);
+		}
+#ifdef MADV_HUGEPAGE
+		// Over-map so the buffer can start on a huge page boundary, then give the slack back
+		size_t span = bytes + FrameBufferPool::kHugePageBytes;
+		void* mapped = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED) {
+			return nullptr;
+		}
+		uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+		uintptr_t aligned = RoundUp(start, FrameBufferPool::kHugePageBytes);
+		if (aligned > start) {
+			munmap(mapped, aligned - start);
+		}
+		size_t tail = start + span - (aligned + bytes);
+		if (tail > 0) {
+			munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+		}
+		char* data = reinterpret_cast<char*>(aligned);
+		if (madvise(data, bytes, MADV_HUGEPAGE) != 0) {
+			munmap(data, bytes);
+			return nullptr;
+		}
+		return data;
+#else
+		return nullptr;
+#endif
+	}
+
+	void UnmapPages(char* data, size_t bytes) {
+		munmap(data, bytes);
+	}
+#endif
+}
+
+FrameBuffer::~FrameBuffer() {
+	if (backing == Backing::Heap) {
+		::operator delete(data, std::align_val_t(FrameBufferPool::kCacheLineSize));
+	}
+	else {
+		UnmapPages(data, reserved);
+	}
+}
+
+FrameBufferPool::FrameBufferPool()
+	: FrameBufferPool(Options()) {
+}
+
+FrameBufferPool::FrameBufferPool(const Options& options)
+	: state(std::make_shared<State>()) {
+	state->options = options;
+	if (options.hugePages) {
+		static const bool available = EnableHugePages();
+		state->hugePages = available;
+	}
+	state->classes.resize(SizeClassOf(SIZE_MAX) + 1);
+	state->stats.budgetBytes = options.maxFreeBytes;
+}
+
+size_t FrameBufferPool::SizeClassOf(size_t size) {
+	if (size <= (static_cast<size_t>(1) << kMinClassShift)) {
+		return 0;
+	}
+	// base < size <= 2 * base, split into kStepsPerDoubling equal steps
+	size_t shift = FloorLog2(size - 1);
+	size_t base = static_cast<size_t>(1) << shift;
+	size_t step = base / kStepsPerDoubling;
+	size_t steps = (size - base + step - 1) / step;
+	return (shift - kMinClassShift) * kStepsPerDoubling + steps;
+}
+
+size_t FrameBufferPool::SizeClassCapacity(size_t sizeClass) {
+	if (sizeClass == 0) {
+		return static_cast<size_t>(1) << kMinClassShift;
+	}
+	size_t base = static_cast<size_t>(1) << (kMinClassShift + (sizeClass - 1) / kStepsPerDoubling);
+	size_t steps = (sizeClass - 1) % kStepsPerDoubling + 1;
+	size_t step = base / kStepsPerDoubling;
+	// The last class takes every size past the one before it and cannot be allocated
+	if (base > SIZE_MAX - steps * step) {
+		return SIZE_MAX;
+	}
+	return base + steps * step;
+}
+
+std::unique_ptr<FrameBuffer> FrameBufferPool::Allocate(size_t sizeClass, bool hugePages) {
+	size_t capacity = SizeClassCapacity(sizeClass);
+	if (capacity < kPageBackedBytes) {
+		char* data = static_cast<char*>(::operator new(capacity, std::align_val_t(kCacheLineSize)));
+		return std::unique_ptr<FrameBuffer>(new FrameBuffer(data, capacity, capacity, FrameBuffer::Backing::Heap, sizeClass));
+	}
+
+	if (capacity > SIZE_MAX - HugePageSize()) {
+		throw std::bad_alloc();
+	}
+
+	if (hugePages && capacity >= kHugePageBytes) {
+		// Falls back to ordinary pages when no contiguous huge pages are left
+		size_t reserved = RoundUp(capacity, HugePageSize());
+		if (char* data = MapPages(reserved, true)) {
+			return std::unique_ptr<FrameBuffer>(new FrameBuffer(data, capacity, reserved, FrameBuffer::Backing::HugePages, sizeClass));
+		}
+	}
+
+	size_t reserved = RoundUp(capacity, PageSize());
+	char* data = MapPages(reserved, false);
+	if (!data) {
+		throw std::bad_alloc();
+	}
+	return std::unique_ptr<FrameBuffer>(new FrameBuffer(data, capacity, reserved, FrameBuffer::Backing::Pages, sizeClass));
+}
+
+std::shared_ptr<FrameBuffer> FrameBufferPool::Acquire(size_t size) {
+	size_t sizeClass = SizeClassOf(size);
+	std::unique_ptr<FrameBuffer> buffer;
+	bool hugePages = false;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		SizeClass& slot = state->classes[sizeClass];
+		slot.lastUsed = ++state->clock;
+		Stats& stats = state->stats;
+		if (!slot.freeBuffers.empty()) {
+			// The most recently returned buffer is the one most likely still in cache
+			buffer = std::move(slot.freeBuffers.back());
+			slot.freeBuffers.pop_back();
+			stats.hits++;
+			stats.freeBuffers--;
+			stats.freeBytes -= buffer->reserved;
+			stats.outstandingBuffers++;
+			stats.outstandingBytes += buffer->reserved;
+		}
+		else {
+			stats.misses++;
+		}
+		hugePages = state->hugePages;
+	}
+
+	if (!buffer) {
+		buffer = Allocate(sizeClass, hugePages);
+		std::lock_guard<std::mutex> lock(state->mutex);
+		Stats& stats = state->stats;
+		stats.outstandingBuffers++;
+		stats.outstandingBytes += buffer->reserved;
+		stats.residentBytes += buffer->reserved;
+		stats.peakResidentBytes = std::max(stats.peakResidentBytes, stats.residentBytes);
+		if (buffer->HugePages()) {
+			stats.hugePageBytes += buffer->reserved;
+		}
+	}
+	buffer->size = size;
+
+	std::weak_ptr<State> weakState = state;
+	return std::shared_ptr<FrameBuffer>(buffer.release(), [weakState](FrameBuffer* released) {
+		Recycle(weakState, released);
+		}, ControlBlockAllocator<FrameBuffer>());
+}
+
+void FrameBufferPool::Recycle(const std::weak_ptr<State>& weakState, FrameBuffer* buffer) {
+	std::unique_ptr<FrameBuffer> owned(buffer);
+	std::shared_ptr<State> pool = weakState.lock();
+	if (!pool) {
+		return;
+	}
+
+	// Freed after the lock is released; unmapping large buffers is not free
+	std::vector<std::unique_ptr<FrameBuffer>> released;
+	std::lock_guard<std::mutex> lock(pool->mutex);
+	Stats& stats = pool->stats;
+	stats.outstandingBuffers--;
+	stats.outstandingBytes -= owned->reserved;
+
+	// Make room by dropping idle buffers of the classes that have gone longest without being asked for,
+	// but never for a class that is itself the stalest
+	size_t budget = pool->options.maxFreeBytes;
+	uint64_t ownLastUsed = pool->classes[owned->sizeClass].lastUsed;
+	while (stats.freeBytes + owned->reserved > budget) {
+		SizeClass* victim = nullptr;
+		for (size_t i = 0; i < pool->classes.size(); ++i) {
+			SizeClass& slot = pool->classes[i];
+			if (i != owned->sizeClass && !slot.freeBuffers.empty()
+				&& (!victim || slot.lastUsed < victim->lastUsed)) {
+				victim = &slot;
+			}
+		}
+		if (!victim || victim->lastUsed > ownLastUsed) {
+			break;
+		}
+		stats.freeBuffers--;
+		stats.freeBytes -= victim->freeBuffers.back()->reserved;
+		released.push_back(std::move(victim->freeBuffers.back()));
+		victim->freeBuffers.pop_back();
+	}
+
+	if (stats.freeBytes + owned->reserved <= budget) {
+		stats.freeBuffers++;
+		stats.freeBytes += owned->reserved;
+		pool->classes[owned->sizeClass].freeBuffers.push_back(std::move(owned));
+	}
+	else {
+		released.push_back(std::move(owned));
+	}
+
+	for (const auto& dropped : released) {
+		stats.evictions++;
+		stats.residentBytes -= dropped->reserved;
+		if (dropped->HugePages()) {
+			stats.hugePageBytes -= dropped->reserved;
+		}
+	}
+}
+
+FrameBufferPool::Stats FrameBufferPool::GetStats() const {
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->stats;
+}
+
+bool FrameBufferPool::HugePagesEnabled() const {
+	return state->hugePages;
+}
+
+bool ParseBufferPoolOptions(const std::string& text, FrameBufferPool::Options& options) {
+	FrameBufferPool::Options parsed = options;
+	size_t begin = 0;
+	while (begin <= text.size()) {
+		size_t end = text.find(',', begin);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string word = text.substr(begin, end - begin);
+		std::transform(word.begin(), word.end(), word.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		if (word == "huge") {
+			parsed.hugePages = true;
+		}
+		else if (!word.empty() && word.size() <= 6
+			&& std::all_of(word.begin(), word.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+			parsed.maxFreeBytes = static_cast<size_t>(std::stoul(word)) * 1024 * 1024;
+		}
+		else {
+			return false;
+		}
+		begin = end + 1;
+	}
+	options = parsed;
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// һ֡壬һͷʱ黹Ļ
+// ʼַٰж룻ϴĻֱϵͳҳ룬ôҳʱԴҳ֧
+//  (shared_ptr) ˮ߸׶֮䴫ݣҲɱ֡ͬʱж踴
+// ĿƿͬȡԿӳȡû岻ڴ
+class FrameBuffer {
+public:
+	~FrameBuffer();
+
+	FrameBuffer(const FrameBuffer&) = delete;
+	FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+	char* Data() { return data; }
+	const char* Data() const { return data; }
+	size_t Size() const { return size; }
+	size_t Capacity() const { return capacity; }
+	// ռõڴ棬ҳʱȡҳĲ
+	size_t Reserved() const { return reserved; }
+	bool HugePages() const { return backing == Backing::HugePages; }
+
+private:
+	friend class FrameBufferPool;
+
+	enum class Backing {
+		Heap,        // ж operator new
+		Pages,       // VirtualAlloc / mmap
+		HugePages,   // Դҳ (Windows  MEM_LARGE_PAGESƽ̨Ϊ͸ҳ)
+	};
+
+	FrameBuffer(char* data, size_t capacity, size_t reserved, Backing backing, size_t sizeClass)
+		: data(data), capacity(capacity), reserved(reserved), size(0), backing(backing), sizeClass(sizeClass) {}
+
+	char* data;
+	size_t capacity;
+	size_t reserved;
+	size_t size;
+	Backing backing;
+	size_t sizeClass;
+};
+
+// ֡أּù黹Ļÿ֡ڴ沢´ȱҳ
+//  256 ֽÿ 2 ٵȷΪ 4 ˷Ѳ 25%ͬһĻ廥ิ
+// лֽԤ㣬ʱͷδȡõĹеĿл
+// ߳ȡ黹ԱȻػø
+class FrameBufferPool {
+public:
+	// дСлʼַ
+	static constexpr size_t kCacheLineSize = 64;
+	// Сڴ˴СĻ尴ҳ
+	static constexpr size_t kPageBackedBytes = 64 * 1024;
+	// ôҳʱСڴ˴СĻԴҳ
+	static constexpr size_t kHugePageBytes = 2 * 1024 * 1024;
+
+	struct Options {
+		size_t maxFreeBytes = 256u * 1024 * 1024;   // лֽ
+		bool hugePages = false;                     // Windows Ҫ"ڴҳ"Ȩޣȡʱ˻ͨҳ
+	};
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;          // 򳬳ԤͷŵĻ
+		size_t freeBuffers = 0;
+		size_t freeBytes = 0;
+		size_t outstandingBuffers = 0;   // ȡδ黹
+		size_t outstandingBytes = 0;
+		size_t residentBytes = 0;        // ȡĻ干ռõڴ
+		size_t peakResidentBytes = 0;
+		size_t hugePageBytes = 0;        // ԴҳĲ
+		size_t budgetBytes = 0;
+
+		double HitRate() const {
+			uint64_t total = hits + misses;
+			return total > 0 ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+		}
+	};
+
+	FrameBufferPool();
+	explicit FrameBufferPool(const Options& options);
+
+	// ȡÿ size ֽڵĻSize() Ϊ sizeCapacity() Ϊڹ
+	std::shared_ptr<FrameBuffer> Acquire(size_t size);
+
+	Stats GetStats() const;
+
+	// Ƿʵ˴ҳ (˴ҳϵͳ)
+	bool HugePagesEnabled() const;
+
+	// size ڹһݳΪ SIZE_MAXȡʱ׳ std::bad_alloc
+	static size_t SizeClassOf(size_t size);
+	static size_t SizeClassCapacity(size_t sizeClass);
+
+private:
+	struct SizeClass {
+		std::vector<std::unique_ptr<FrameBuffer>> freeBuffers;
+		uint64_t lastUsed = 0;
+	};
+
+	struct State {
+		Options options;
+		bool hugePages = false;
+		mutable std::mutex mutex;
+		std::vector<SizeClass> classes;
+		uint64_t clock = 0;
+		Stats stats;
+	};
+
+	std::shared_ptr<State> state;
+
+	static std::unique_ptr<FrameBuffer> Allocate(size_t sizeClass, bool hugePages);
+	static void Recycle(const std::weak_ptr<State>& weakState, FrameBuffer* buffer);
+};
+
+//  "512"  "512,huge" Ļ (лԤ MB "huge" ʾôҳ)
+bool ParseBufferPoolOptions(const std::string& text, FrameBufferPool::Options& options);
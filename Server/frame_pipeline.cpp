@@ -0,0 +1,622 @@
+#include "frame_pipeline.h"
+#include "block_free_list.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+	// Back-off while a never-drop queue is full
+	constexpr auto kFullQueueBackoff = std::chrono::milliseconds(1);
+	// Longest wait between two checks for idle present stages
+	constexpr auto kRetireCheckInterval = std::chrono::milliseconds(1000);
+	// Freed frames kept for reuse; more than every window has pending or in flight at once
+	constexpr size_t kMaxFreeFrameItems = 256;
+
+	BlockFreeList& FrameItemFreeList() {
+		// Never destroyed, as frames may still be freed during static destruction
+		static BlockFreeList* freeList = new BlockFreeList(sizeof(FrameItem), kMaxFreeFrameItems);
+		return *freeList;
+	}
+
+	size_t ChainLength(const FrameItem& frame) {
+		size_t length = 1;
+		for (const FrameItem* item = frame.previous.get(); item; item = item->previous.get()) {
+			++length;
+		}
+		return length;
+	}
+
+	void UpdateMax(std::atomic<uint64_t>& target, uint64_t value) {
+		uint64_t current = target.load(std::memory_order_relaxed);
+		while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+		}
+	}
+}
+
+void* FrameItem::operator new(size_t size) {
+	if (size != sizeof(FrameItem)) {
+		return ::operator new(size);
+	}
+	return FrameItemFreeList().Allocate();
+}
+
+void FrameItem::operator delete(void* item, size_t size) {
+	if (size != sizeof(FrameItem)) {
+		::operator delete(item);
+		return;
+	}
+	FrameItemFreeList().Deallocate(item);
+}
+
+PresentStage::PresentStage(uint64_t targetWindow, FramePresenter& presenter, size_t controlCapacity)
+	: targetWindow(targetWindow)
+	, presenter(presenter)
+	, controls(controlCapacity)
+	, nextSequence(1)
+	, running(true)
+	, retired(false)
+	, busy(false)
+	, lastActivity(std::chrono::steady_clock::now().time_since_epoch().count())
+	, lastFrameSequence(0)
+	, stoppedSequence(0)
+	, wakePending(false) {
+	thread = std::thread(&PresentStage::Run, this);
+}
+
+PresentStage::~PresentStage() {
+	Stop();
+}
+
+void PresentStage::Wake() {
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakePending = true;
+	}
+	wakeCondition.notify_one();
+}
+
+void PresentStage::Touch() {
+	lastActivity = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+bool PresentStage::PostFrame(std::unique_ptr<FrameItem>& frame) {
+	// Producers take the pending frame out before posting, so a partial update can chain it
+	// without the present thread taking the update first
+	std::unique_lock<std::mutex> lock(frameProducerMutex);
+	if (retired) {
+		return false;
+	}
+	counters.framesPosted++;
+	Touch();
+	std::unique_ptr<FrameItem> stale = mailbox.Take();
+	if (frame->IsPartial()) {
+		// Nothing in a chain may be dropped; wait for the present thread when it gets long
+		while (stale && ChainLength(*stale) >= kMaxChainedFrames && running) {
+			mailbox.Post(std::move(stale));
+			Wake();
+			lock.unlock();
+			std::this_thread::sleep_for(kFullQueueBackoff);
+			lock.lock();
+			stale = mailbox.Take();
+		}
+		frame->previous = std::move(stale);
+	}
+	else if (stale) {
+		// The window has not presented the previous frame yet; it is stale now
+		Supersede(std::move(stale), *frame);
+	}
+	frame->sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+	lastFrameSequence = frame->sequence;
+	mailbox.Post(std::move(frame));
+	lock.unlock();
+	Wake();
+	return true;
+}
+
+void PresentStage::Supersede(std::unique_ptr<FrameItem> stale, FrameItem& replacement) {
+	// The stale frames are reported once the replacement is done, whichever source it came from;
+	// reporting them now would let a client refill the mailbox as fast as it parses
+	std::unique_ptr<FrameItem>* tail = &replacement.superseded;
+	while (*tail) {
+		tail = &(*tail)->superseded;
+	}
+	while (stale) {
+		counters.framesDropped++;
+		std::unique_ptr<FrameItem> next = std::move(stale->previous);
+		// The frames it replaced in turn come first
+		*tail = std::move(stale->superseded);
+		while (*tail) {
+			tail = &(*tail)->superseded;
+		}
+		if (stale->observer) {
+			// Only what the observer looks at is kept; the pixels go back now
+			stale->owner.reset();
+			stale->image = FrameView();
+			stale->dirtyRects.clear();
+			*tail = std::move(stale);
+			tail = &(*tail)->superseded;
+		}
+		stale = std::move(next);
+	}
+}
+
+void PresentStage::NotifySuperseded(FrameItem& frame) {
+	std::unique_ptr<FrameItem> stale = std::move(frame.superseded);
+	while (stale) {
+		stale->observer->OnFrameDropped(*stale, PresentObserver::DropReason::Superseded);
+		stale = std::move(stale->superseded);
+	}
+}
+
+void PresentStage::DropFrame(std::unique_ptr<FrameItem> frame, PresentObserver::DropReason reason) {
+	// Frames chained behind a partial update go with it
+	while (frame) {
+		counters.framesDropped++;
+		NotifySuperseded(*frame);
+		frame->owner.reset();
+		if (frame->observer) {
+			frame->observer->OnFrameDropped(*frame, reason);
+		}
+		frame = std::move(frame->previous);
+	}
+}
+
+void PresentStage::DropOlderThan(std::unique_ptr<FrameItem>& frame, uint64_t sequence) {
+	// A chain runs from the newest frame to the oldest, so everything past the first older one goes
+	std::unique_ptr<FrameItem>* link = &frame;
+	while (*link && (*link)->sequence >= sequence) {
+		link = &(*link)->previous;
+	}
+	if (*link) {
+		DropFrame(std::move(*link), PresentObserver::DropReason::Cancelled);
+	}
+}
+
+bool PresentStage::PostControl(ControlItem control) {
+	// Several sessions may drive the same window; serialize producers of the SPSC queue
+	std::lock_guard<std::mutex> lock(controlProducerMutex);
+	if (retired) {
+		return false;
+	}
+	Touch();
+	control.sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+	while (!controls.TryPush(std::move(control))) {
+		if (!running) {
+			return false;
+		}
+		std::this_thread::sleep_for(kFullQueueBackoff);
+	}
+	Wake();
+	return true;
+}
+
+bool PresentStage::TryRetire(std::chrono::steady_clock::duration idleTimeout) {
+	// A producer in the middle of posting keeps the stage; with both locks held nothing new arrives
+	std::unique_lock<std::mutex> frameLock(frameProducerMutex, std::try_to_lock);
+	if (!frameLock.owns_lock()) {
+		return false;
+	}
+	std::unique_lock<std::mutex> controlLock(controlProducerMutex, std::try_to_lock);
+	if (!controlLock.owns_lock()) {
+		return false;
+	}
+	// The present thread marks itself busy before it takes anything out
+	if (busy || mailbox.HasItem() || controls.Size() > 0) {
+		return false;
+	}
+
+	auto idleFor = std::chrono::steady_clock::now().time_since_epoch()
+		- std::chrono::steady_clock::duration(lastActivity.load());
+	bool stopped = stoppedSequence > lastFrameSequence;
+	if (idleFor < idleTimeout && !stopped && presenter.IsTargetAlive(targetWindow)) {
+		return false;
+	}
+	retired = true;
+	return true;
+}
+
+void PresentStage::Stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	Wake();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void PresentStage::RecordLatency(const FrameItem& frame) {
+	auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - frame.receivedAt).count();
+	UpdateMax(counters.maxLatencyUs, static_cast<uint64_t>(std::max<int64_t>(latency, 0)));
+}
+
+void PresentStage::Run() {
+	std::unique_ptr<FrameItem> held;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wakeCondition.wait(lock, [this] { return wakePending || !running; });
+			wakePending = false;
+		}
+		if (!running) {
+			break;
+		}
+
+		busy = true;
+		std::unique_ptr<FrameItem> frame = mailbox.Take();
+		if (frame) {
+			held = std::move(frame);
+		}
+
+		// Controls are applied in posting order relative to frames: a frame posted
+		// before a control is superseded by it and is not presented afterwards
+		ControlItem control;
+		while (controls.TryPop(control)) {
+			DropOlderThan(held, control.sequence);
+			presenter.Execute(control);
+			counters.controlsExecuted++;
+			if (control.type == ControlItem::Type::StopRender) {
+				stoppedSequence = control.sequence;
+			}
+		}
+
+		if (held) {
+			PresentFrame(std::move(held));
+		}
+		Touch();
+		busy = false;
+	}
+}
+
+void PresentStage::PresentFrame(std::unique_ptr<FrameItem> frame) {
+	// The frames a partial update builds on are presented first, oldest first
+	if (frame->previous) {
+		PresentFrame(std::move(frame->previous));
+	}
+
+	bool presented = presenter.Present(*frame);
+	if (presented) {
+		counters.framesPresented++;
+	}
+	else {
+		counters.presentFailures++;
+	}
+	NotifySuperseded(*frame);
+	// The pixels go back before the credit does, so a client sending its next frame finds them free
+	frame->owner.reset();
+	if (frame->observer) {
+		frame->observer->OnFramePresented(*frame, presented);
+	}
+	RecordLatency(*frame);
+}
+
+ParseStage::ParseStage(std::shared_ptr<ReplyChannel> source, size_t capacity)
+	: source(std::move(source))
+	, messages(capacity)
+	, scheduled(false)
+	, submitted(0)
+	, queueMaxDepth(0) {
+}
+
+bool ParseStage::TryPush(InboundMessage& message) {
+	if (!messages.TryPush(std::move(message))) {
+		return false;
+	}
+	submitted++;
+	UpdateMax(queueMaxDepth, messages.Size());
+	return true;
+}
+
+void ParseStage::Drain(const MessageHandler& messageHandler, const RawFrameHandler& rawFrameHandler, size_t limit) {
+	for (size_t i = 0; i < limit; ++i) {
+		// Scoped to the turn, so the message's buffer goes back to its pool as soon as it is handled
+		InboundMessage item;
+		if (!messages.TryPop(item)) {
+			break;
+		}
+		if (item.rawFrame) {
+			if (rawFrameHandler) {
+				rawFrameHandler(source, std::move(item.rawFrame));
+			}
+		}
+		else if (messageHandler) {
+			messageHandler(source, *item.message);
+		}
+	}
+}
+
+bool ParseStage::TrySchedule() {
+	return !scheduled.exchange(true);
+}
+
+bool ParseStage::FinishRun() {
+	scheduled.store(false);
+	// Pairs with the fence in Submit: either we see the new message or the producer sees us idle
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return messages.Size() > 0 && TrySchedule();
+}
+
+FramePipeline::FramePipeline(FramePresenter& presenter, size_t parseThreads,
+	size_t messageCapacity, size_t controlCapacity, std::chrono::milliseconds idleTimeout)
+	: presenter(presenter)
+	, parseThreadCount(parseThreads ? parseThreads : DefaultParseThreads())
+	, messageCapacity(messageCapacity)
+	, controlCapacity(controlCapacity)
+	, idleTimeout(idleTimeout)
+	, running(false)
+	, closedSubmitted(0)
+	, closedQueueMaxDepth(0)
+	, readyHead(0)
+	, readyCount(0)
+	, stagesRetired(0)
+	, nextRetireCheck(0) {
+}
+
+FramePipeline::~FramePipeline() {
+	Stop();
+}
+
+size_t FramePipeline::DefaultParseThreads() {
+	return std::max(1u, std::thread::hardware_concurrency() / 2);
+}
+
+void FramePipeline::SetMessageHandler(ParseStage::MessageHandler handler) {
+	messageHandler = std::move(handler);
+}
+
+void FramePipeline::SetRawFrameHandler(ParseStage::RawFrameHandler handler) {
+	rawFrameHandler = std::move(handler);
+}
+
+void FramePipeline::Start() {
+	if (running.exchange(true)) {
+		return;
+	}
+	for (size_t i = 0; i < parseThreadCount; ++i) {
+		parseWorkers.emplace_back(&FramePipeline::ParseWorker, this);
+	}
+}
+
+void FramePipeline::Stop() {
+	running = false;
+	readyCondition.notify_all();
+	for (auto& worker : parseWorkers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+	parseWorkers.clear();
+	readyStages.clear();
+	readyHead = 0;
+	readyCount = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(parseStagesMutex);
+		parseStages.clear();
+	}
+
+	// Present threads are joined outside the lock
+	std::unordered_map<uint64_t, std::shared_ptr<PresentStage>> stopping;
+	{
+		std::lock_guard<std::mutex> lock(stagesMutex);
+		stopping.swap(stages);
+	}
+	for (auto& entry : stopping) {
+		entry.second->Stop();
+	}
+}
+
+void FramePipeline::ParseWorker() {
+	// Bound one turn so a busy session cannot monopolize a parse thread
+	constexpr size_t kMessagesPerTurn = 16;
+	auto retireInterval = std::min<std::chrono::milliseconds>(idleTimeout, kRetireCheckInterval);
+
+	while (true) {
+		// Parse threads double as the reaper of idle present stages
+		RetireIdleStagesIfDue();
+
+		std::shared_ptr<ParseStage> stage;
+		{
+			std::unique_lock<std::mutex> lock(readyMutex);
+			readyCondition.wait_for(lock, retireInterval, [this] { return readyCount > 0 || !running; });
+			if (readyCount == 0) {
+				if (!running) {
+					break;
+				}
+				continue;
+			}
+			stage = std::move(readyStages[readyHead]);
+			readyHead = (readyHead + 1) % readyStages.size();
+			readyCount--;
+		}
+
+		stage->Drain(messageHandler, rawFrameHandler, kMessagesPerTurn);
+		if (stage->FinishRun()) {
+			Schedule(std::move(stage));
+		}
+	}
+}
+
+void FramePipeline::Schedule(std::shared_ptr<ParseStage> stage) {
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+		if (readyCount == readyStages.size()) {
+			// Full: unwrap into a ring twice the size
+			std::vector<std::shared_ptr<ParseStage>> grown(std::max<size_t>(16, readyStages.size() * 2));
+			for (size_t i = 0; i < readyCount; ++i) {
+				grown[i] = std::move(readyStages[(readyHead + i) % readyStages.size()]);
+			}
+			readyStages.swap(grown);
+			readyHead = 0;
+		}
+		readyStages[(readyHead + readyCount) % readyStages.size()] = std::move(stage);
+		readyCount++;
+	}
+	readyCondition.notify_one();
+}
+
+std::shared_ptr<ParseStage> FramePipeline::ParseStageFor(const std::shared_ptr<ReplyChannel>& source) {
+	std::lock_guard<std::mutex> lock(parseStagesMutex);
+	if (!running) {
+		return nullptr;
+	}
+	auto& stage = parseStages[source.get()];
+	if (!stage) {
+		stage = std::make_shared<ParseStage>(source, messageCapacity);
+	}
+	return stage;
+}
+
+bool FramePipeline::SubmitMessage(const std::shared_ptr<ReplyChannel>& source, std::shared_ptr<FrameBuffer> message) {
+	InboundMessage item;
+	item.message = std::move(message);
+	return Submit(source, std::move(item));
+}
+
+bool FramePipeline::SubmitRawFrame(const std::shared_ptr<ReplyChannel>& source, std::unique_ptr<RawFrame> frame) {
+	InboundMessage item;
+	item.rawFrame = std::move(frame);
+	return Submit(source, std::move(item));
+}
+
+bool FramePipeline::Submit(const std::shared_ptr<ReplyChannel>& source, InboundMessage item) {
+	std::shared_ptr<ParseStage> stage = ParseStageFor(source);
+	if (!stage) {
+		return false;
+	}
+
+	while (!stage->TryPush(item)) {
+		if (!running) {
+			return false;
+		}
+		std::this_thread::sleep_for(kFullQueueBackoff);
+	}
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (stage->TrySchedule()) {
+		Schedule(std::move(stage));
+	}
+	return true;
+}
+
+void FramePipeline::CloseSource(const ReplyChannel* source) {
+	std::shared_ptr<ParseStage> stage;
+	{
+		std::lock_guard<std::mutex> lock(parseStagesMutex);
+		auto it = parseStages.find(source);
+		if (it == parseStages.end()) {
+			return;
+		}
+		stage = std::move(it->second);
+		parseStages.erase(it);
+	}
+
+	// Messages still queued are answered; the stage goes away with its last scheduled run
+	closedSubmitted += stage->Submitted();
+	UpdateMax(closedQueueMaxDepth, stage->QueueMaxDepth());
+}
+
+std::shared_ptr<PresentStage> FramePipeline::StageFor(uint64_t targetWindow) {
+	std::lock_guard<std::mutex> lock(stagesMutex);
+	auto& stage = stages[targetWindow];
+	if (!stage) {
+		stage = std::make_shared<PresentStage>(targetWindow, presenter, controlCapacity);
+	}
+	return stage;
+}
+
+void FramePipeline::PostFrame(std::unique_ptr<FrameItem> frame) {
+	// A stage retired after the lookup is out of the map already; the retry gets a fresh one
+	while (!StageFor(frame->targetWindow)->PostFrame(frame)) {
+	}
+}
+
+bool FramePipeline::PostControl(ControlItem control) {
+	while (true) {
+		std::shared_ptr<PresentStage> stage = StageFor(control.targetWindow);
+		if (stage->PostControl(control)) {
+			return true;
+		}
+		if (!stage->Retired()) {
+			return false;
+		}
+	}
+}
+
+void FramePipeline::RetireIdleStagesIfDue() {
+	auto now = std::chrono::steady_clock::now();
+	auto interval = std::min<std::chrono::steady_clock::duration>(idleTimeout, kRetireCheckInterval);
+	auto due = nextRetireCheck.load();
+	if (now.time_since_epoch().count() < due
+		|| !nextRetireCheck.compare_exchange_strong(due, (now + interval).time_since_epoch().count())) {
+		return;
+	}
+	RetireIdleStages();
+}
+
+void FramePipeline::RetireIdleStages() {
+	std::vector<std::shared_ptr<PresentStage>> retiring;
+	{
+		std::lock_guard<std::mutex> lock(stagesMutex);
+		for (auto it = stages.begin(); it != stages.end();) {
+			if (it->second->TryRetire(idleTimeout)) {
+				retiring.push_back(std::move(it->second));
+				it = stages.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	// Joining a present thread may wait for it to wake up; that happens outside the lock
+	for (auto& stage : retiring) {
+		stage->Stop();
+		const auto& counters = stage->GetCounters();
+		retiredCounters.framesPosted += counters.framesPosted.load();
+		retiredCounters.framesPresented += counters.framesPresented.load();
+		retiredCounters.framesDropped += counters.framesDropped.load();
+		retiredCounters.presentFailures += counters.presentFailures.load();
+		retiredCounters.controlsExecuted += counters.controlsExecuted.load();
+		UpdateMax(retiredCounters.maxLatencyUs, counters.maxLatencyUs.load());
+		stagesRetired++;
+	}
+}
+
+FramePipeline::Stats FramePipeline::GetStats() const {
+	Stats stats;
+	stats.messagesSubmitted = closedSubmitted.load();
+	stats.messageQueueMaxDepth = closedQueueMaxDepth.load();
+	{
+		std::lock_guard<std::mutex> lock(parseStagesMutex);
+		stats.parseStages = parseStages.size();
+		stats.parseThreads = parseThreadCount;
+		for (const auto& entry : parseStages) {
+			stats.messagesSubmitted += entry.second->Submitted();
+			stats.messageQueueDepth += entry.second->QueueDepth();
+			stats.messageQueueMaxDepth = std::max(stats.messageQueueMaxDepth, entry.second->QueueMaxDepth());
+		}
+	}
+
+	stats.framesPosted = retiredCounters.framesPosted.load();
+	stats.framesPresented = retiredCounters.framesPresented.load();
+	stats.framesDropped = retiredCounters.framesDropped.load();
+	stats.presentFailures = retiredCounters.presentFailures.load();
+	stats.controlsExecuted = retiredCounters.controlsExecuted.load();
+	stats.maxLatencyUs = retiredCounters.maxLatencyUs.load();
+	stats.presentStagesRetired = stagesRetired.load();
+
+	std::lock_guard<std::mutex> lock(stagesMutex);
+	stats.presentStages = stages.size();
+	for (const auto& entry : stages) {
+		const auto& counters = entry.second->GetCounters();
+		stats.framesPosted += counters.framesPosted.load();
+		stats.framesPresented += counters.framesPresented.load();
+		stats.framesDropped += counters.framesDropped.load();
+		stats.presentFailures += counters.presentFailures.load();
+		stats.controlsExecuted += counters.controlsExecuted.load();
+		stats.maxLatencyUs = std::max(stats.maxLatencyUs, counters.maxLatencyUs.load());
+	}
+	return stats;
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "latest_mailbox.h"
+#include "pixel_format.h"
+#include "raw_frame.h"
+#include "render_target.h"
+#include "reply_channel.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct FrameItem;
+
+// ֡뿪ˮʱ֪ͨ (ʽỰۼȷö)
+class PresentObserver {
+public:
+	virtual ~PresentObserver() = default;
+
+	// ֡ѽڳ֣ڳ߳ϵ
+	virtual void OnFramePresented(const FrameItem& frame, bool success) = 0;
+
+	enum class DropReason {
+		Superseded,   // ͬһڸµ֡滻滻ֻ֡ʱŵã˸ٶ
+		Cancelled,    // ֮Ŀȡ
+	};
+
+	// ֡δ־뿪ˮߣڳ߳ϵ
+	virtual void OnFrameDropped(const FrameItem& frame, DropReason reason) = 0;
+};
+
+// ֵһ֡
+struct FrameItem {
+	uint64_t targetWindow = 0;
+	bool isVideo = false;
+	//  owner 
+	FrameView image;
+	// ǿձʾֲ£ֻдڵǰеЩimage ֻп (֡ߴ) Ч
+	std::vector<DirtyRect> dirtyRects;
+	// ݵĶ ()
+	std::shared_ptr<const void> owner;
+	std::chrono::steady_clock::time_point receivedAt;
+	uint64_t sequence = 0;
+	// ͻ֡šظ֡С뿪ˮʱĽշշΪ
+	uint64_t clientSequence = 0;
+	size_t messageSize = 0;
+	std::shared_ptr<PresentObserver> observer;
+	// ֲ֮ǰĻ棬ܱ滻δֵľ֡ʱڱ֡
+	std::unique_ptr<FrameItem> previous;
+	// ֡滻֡ (ͷ)֡뿪ˮʱ֪ͨǵĽշĸỰ
+	// ֡ superseded 滻ʱڴ
+	std::unique_ptr<FrameItem> superseded;
+
+	bool IsPartial() const { return !dirtyRects.empty(); }
+
+	// ÿ֡һͷźڿйһ֡ʹ ( block_free_list.h)
+	static void* operator new(size_t size);
+	static void operator delete(void* item, size_t size);
+};
+
+// 
+struct ControlItem {
+	enum class Type {
+		StopRender,
+	};
+
+	uint64_t targetWindow = 0;
+	Type type = Type::StopRender;
+	uint64_t sequence = 0;
+};
+
+// ֻصĿ괰ڸԵĳ߳ϵ
+class FramePresenter {
+public:
+	virtual ~FramePresenter() = default;
+
+	// һ֡
+	virtual bool Present(const FrameItem& frame) = 0;
+
+	// ִп
+	virtual void Execute(const ControlItem& control) = 0;
+
+	// Ŀ괰ǷȻڣֽ׶οʱݴ˾Ƿգ߳ϵ
+	virtual bool IsTargetAlive(uint64_t /*targetWindow*/) { return true; }
+};
+
+// Ŀ괰ڵĳֽ׶ΣƵ֡ latest-wins 䣬н
+// ֲ²滻еľ֮֡ӣ֡ʱ滻
+// еĽ׶οɱˮ߻գպٽͶݣͶݷͶ½Ľ׶
+class PresentStage {
+public:
+	// ӵľֲ´ﵽʱͶݷȴ߳ȡ
+	static constexpr size_t kMaxChainedFrames = 64;
+
+	struct Counters {
+		std::atomic<uint64_t> framesPosted{ 0 };
+		std::atomic<uint64_t> framesPresented{ 0 };
+		std::atomic<uint64_t> framesDropped{ 0 };
+		std::atomic<uint64_t> presentFailures{ 0 };
+		std::atomic<uint64_t> controlsExecuted{ 0 };
+		std::atomic<uint64_t> maxLatencyUs{ 0 };
+	};
+
+	PresentStage(uint64_t targetWindow, FramePresenter& presenter, size_t controlCapacity);
+	~PresentStage();
+
+	// Ͷһ֡δֵľ֡滻붪ֲ֡֡ӣʱȴ
+	// ׶ѻʱ false  frame ֲ
+	bool PostFrame(std::unique_ptr<FrameItem>& frame);
+
+	// Ͷݿʱȴֹͣѻպ󷵻 false
+	// ɱỰĽ߳ͬʱ
+	bool PostControl(ControlItem control);
+
+	// ûд֡ѿ idleTimeoutһΪ StopRender 򴰿ѲʱգǷ
+	// պ߳Уٵ Stop
+	bool TryRetire(std::chrono::steady_clock::duration idleTimeout);
+
+	// ֹͣ߳
+	void Stop();
+
+	bool Retired() const { return retired.load(); }
+	uint64_t TargetWindow() const { return targetWindow; }
+	size_t ControlDepth() const { return controls.Size(); }
+	const Counters& GetCounters() const { return counters; }
+
+private:
+	uint64_t targetWindow;
+	FramePresenter& presenter;
+	LatestMailbox<FrameItem> mailbox;
+	std::mutex frameProducerMutex;
+	SpscQueue<ControlItem> controls;
+	std::mutex controlProducerMutex;
+	std::atomic<uint64_t> nextSequence;
+	std::atomic<bool> running;
+	// Ͷλ
+	std::atomic<bool> retired;
+	// ߳ڴһ֡
+	std::atomic<bool> busy;
+	std::atomic<std::chrono::steady_clock::rep> lastActivity;
+	// һִ֡е StopRender 
+	uint64_t lastFrameSequence;
+	std::atomic<uint64_t> stoppedSequence;
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	bool wakePending;
+	Counters counters;
+	std::thread thread;
+
+	void Wake();
+	void Touch();
+	void Run();
+	void RecordLatency(const FrameItem& frame);
+	void Supersede(std::unique_ptr<FrameItem> stale, FrameItem& replacement);
+	void NotifySuperseded(FrameItem& frame);
+	void DropFrame(std::unique_ptr<FrameItem> frame, PresentObserver::DropReason reason);
+	void DropOlderThan(std::unique_ptr<FrameItem>& frame, uint64_t sequence);
+	void PresentFrame(std::unique_ptr<FrameItem> frame);
+};
+
+// ׶εһ룺protobuf Ϣԭʼ֡ͨյһ֡ (ȡһ)
+struct InboundMessage {
+	std::shared_ptr<FrameBuffer> message;
+	std::unique_ptr<RawFrame> rawFrame;
+};
+
+// ͻ˻ỰĽ׶ΣϢ˳
+// ռ̣߳ϢʱΪȵ߳ϣͬһʱһ߳ڴ
+class ParseStage {
+public:
+	using MessageHandler = std::function<void(const std::shared_ptr<ReplyChannel>&, const FrameBuffer&)>;
+	using RawFrameHandler = std::function<void(const std::shared_ptr<ReplyChannel>&, std::unique_ptr<RawFrame>)>;
+
+	ParseStage(std::shared_ptr<ReplyChannel> source, size_t capacity);
+
+	// ߣһϢʱ false  message ֲ
+	bool TryPush(InboundMessage& message);
+
+	// ߣ˳ limit Ϣ
+	void Drain(const MessageHandler& messageHandler, const RawFrameHandler& rawFrameHandler, size_t limit);
+
+	// Ϊѵȣ true ʾ÷Ҫ
+	bool TrySchedule();
+
+	// һִ true ʾϢҵ÷Ҫٴε
+	bool FinishRun();
+
+	size_t QueueDepth() const { return messages.Size(); }
+	uint64_t QueueMaxDepth() const { return queueMaxDepth.load(); }
+	uint64_t Submitted() const { return submitted.load(); }
+
+private:
+	std::shared_ptr<ReplyChannel> source;
+	SpscQueue<InboundMessage> messages;
+	std::atomic<bool> scheduled;
+	std::atomic<uint64_t> submitted;
+	std::atomic<uint64_t> queueMaxDepth;
+};
+
+//  /  /  ʽˮ
+// ֻ߳ƴ֡ύϢỰĽ׶ɹ̶Ľִ߳УÿĿ괰ڸһ߳
+class FramePipeline {
+public:
+	struct Stats {
+		uint64_t messagesSubmitted = 0;
+		uint64_t messageQueueDepth = 0;
+		uint64_t messageQueueMaxDepth = 0;
+		size_t parseStages = 0;
+		size_t parseThreads = 0;
+		uint64_t framesPosted = 0;
+		uint64_t framesPresented = 0;
+		uint64_t framesDropped = 0;
+		uint64_t presentFailures = 0;
+		uint64_t controlsExecuted = 0;
+		uint64_t maxLatencyUs = 0;
+		size_t presentStages = 0;
+		uint64_t presentStagesRetired = 0;
+	};
+
+	// ֽ׶οиʱ߳
+	static constexpr std::chrono::milliseconds kDefaultIdleTimeout{ 10000 };
+
+	// parseThreads Ϊ 0 ʱʹ DefaultParseThreads
+	FramePipeline(FramePresenter& presenter, size_t parseThreads = 0,
+		size_t messageCapacity = 64, size_t controlCapacity = 64,
+		std::chrono::milliseconds idleTimeout = kDefaultIdleTimeout);
+	~FramePipeline();
+
+	// ĬϵĽ߳CPU һ룬һ
+	static size_t DefaultParseThreads();
+
+	// ý׶εϢص Start ֮ǰ
+	void SetMessageHandler(ParseStage::MessageHandler handler);
+	void SetRawFrameHandler(ParseStage::RawFrameHandler handler);
+
+	// ߳
+	void Start();
+
+	// ֹͣн׶Σֹ֮ͣ
+	void Stop();
+
+	// ׶ΣύĳỰһϢ״ύʱΪûỰ׶
+	// Ϣڵĳػֱӣٸ
+	bool SubmitMessage(const std::shared_ptr<ReplyChannel>& source, std::shared_ptr<FrameBuffer> message);
+
+	// ׶Σύһԭʼ֡ͬһỰϢֵ˳
+	bool SubmitRawFrame(const std::shared_ptr<ReplyChannel>& source, std::unique_ptr<RawFrame> frame);
+
+	// ỰرգʣϢ׶֮ͷ
+	void CloseSource(const ReplyChannel* source);
+
+	// ׶ΣͶݴֵ֡
+	void PostFrame(std::unique_ptr<FrameItem> frame);
+
+	// ׶ΣͶݿ
+	bool PostControl(ControlItem control);
+
+	// տеĳֽ׶Σ̻߳ᶨڵ
+	void RetireIdleStages();
+
+	Stats GetStats() const;
+
+private:
+	FramePresenter& presenter;
+	size_t parseThreadCount;
+	size_t messageCapacity;
+	size_t controlCapacity;
+	std::chrono::milliseconds idleTimeout;
+	ParseStage::MessageHandler messageHandler;
+	ParseStage::RawFrameHandler rawFrameHandler;
+	std::atomic<bool> running;
+	// Totals of parse stages that were already closed
+	std::atomic<uint64_t> closedSubmitted;
+	std::atomic<uint64_t> closedQueueMaxDepth;
+
+	mutable std::mutex parseStagesMutex;
+	std::unordered_map<const ReplyChannel*, std::shared_ptr<ParseStage>> parseStages;
+
+	std::mutex readyMutex;
+	std::condition_variable readyCondition;
+	// ȴ̵߳Ľ׶Σֻʱڴ
+	std::vector<std::shared_ptr<ParseStage>> readyStages;
+	size_t readyHead;
+	size_t readyCount;
+	std::vector<std::thread> parseWorkers;
+
+	mutable std::mutex stagesMutex;
+	std::unordered_map<uint64_t, std::shared_ptr<PresentStage>> stages;
+	// Totals of present stages that were already retired
+	PresentStage::Counters retiredCounters;
+	std::atomic<uint64_t> stagesRetired;
+	std::atomic<std::chrono::steady_clock::rep> nextRetireCheck;
+
+	void ParseWorker();
+	void RetireIdleStagesIfDue();
+	void Schedule(std::shared_ptr<ParseStage> stage);
+	bool Submit(const std::shared_ptr<ReplyChannel>& source, InboundMessage message);
+	std::shared_ptr<ParseStage> ParseStageFor(const std::shared_ptr<ReplyChannel>& source);
+	std::shared_ptr<PresentStage> StageFor(uint64_t targetWindow);
+};
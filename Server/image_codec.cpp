@@ -0,0 +1,282 @@
+#include "image_codec.h"
+#include "screen_codec.h"
+#include <climits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <wincodec.h>
+#include <wrl/client.h>
+#pragma comment(lib, "windowscodecs.lib")
+#endif
+
+namespace {
+	uint32_t ReadBigEndian16(const uint8_t* data) {
+		return (uint32_t(data[0]) << 8) | data[1];
+	}
+
+	uint32_t ReadBigEndian32(const uint8_t* data) {
+		return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+	}
+
+	bool AcceptSize(size_t width, size_t height, size_t& outWidth, size_t& outHeight) {
+		if (width == 0 || height == 0 || width > kMaxImageDimension || height > kMaxImageDimension
+			|| width * height > kMaxImagePixels) {
+			return false;
+		}
+		outWidth = width;
+		outHeight = height;
+		return true;
+	}
+
+	// Walks the marker segments up to the first start-of-frame
+	bool ReadJpegSize(const uint8_t* data, size_t size, size_t& width, size_t& height) {
+		if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+			return false;
+		}
+		size_t pos = 2;
+		while (pos + 2 <= size) {
+			if (data[pos] != 0xFF) {
+				return false;
+			}
+			// Any number of 0xFF fill bytes may precede a marker
+			while (pos + 1 < size && data[pos + 1] == 0xFF) {
+				++pos;
+			}
+			if (pos + 1 >= size) {
+				return false;
+			}
+			uint8_t marker = data[pos + 1];
+			pos += 2;
+			// Standalone markers carry no length
+			if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+				continue;
+			}
+			// Scan data or the end of the image before any frame header
+			if (marker == 0xDA || marker == 0xD9 || pos + 2 > size) {
+				return false;
+			}
+			size_t length = ReadBigEndian16(data + pos);
+			if (length < 2) {
+				return false;
+			}
+			// SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+			if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+				if (length < 7 || pos + 7 > size) {
+					return false;
+				}
+				return AcceptSize(ReadBigEndian16(data + pos + 5), ReadBigEndian16(data + pos + 3), width, height);
+			}
+			pos += length;
+		}
+		return false;
+	}
+
+	bool ReadPngSize(const uint8_t* data, size_t size, size_t& width, size_t& height) {
+		static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		// The IHDR chunk comes first: length, type, then width and height
+		if (size < 24) {
+			return false;
+		}
+		for (size_t i = 0; i < sizeof(kSignature); ++i) {
+			if (data[i] != kSignature[i]) {
+				return false;
+			}
+		}
+		if (data[12] != 'I' || data[13] != 'H' || data[14] != 'D' || data[15] != 'R') {
+			return false;
+		}
+		return AcceptSize(ReadBigEndian32(data + 16), ReadBigEndian32(data + 20), width, height);
+	}
+
+	// QOI: "qoif", width, height, channels, colorspace; the chunks end with 7 zero bytes and a one
+	constexpr size_t kQoiHeaderSize = 14;
+	constexpr size_t kQoiPaddingSize = 8;
+
+	bool ReadQoiSize(const uint8_t* data, size_t size, size_t& width, size_t& height) {
+		if (size < kQoiHeaderSize + kQoiPaddingSize
+			|| data[0] != 'q' || data[1] != 'o' || data[2] != 'i' || data[3] != 'f'
+			|| (data[12] != 3 && data[12] != 4) || data[13] > 1) {
+			return false;
+		}
+		return AcceptSize(ReadBigEndian32(data + 4), ReadBigEndian32(data + 8), width, height);
+	}
+
+	struct QoiPixel {
+		uint8_t r, g, b, a;
+	};
+
+	bool DecodeQoi(const FrameView& image, uint8_t* dst, size_t dstStride) {
+		static const uint8_t kEndMarker[kQoiPaddingSize] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		const uint8_t* data = image.data;
+		if (image.dataSize < kQoiHeaderSize + kQoiPaddingSize) {
+			return false;
+		}
+		// The padding guarantees that an op never reads past the end; a stream cut short lacks it
+		size_t chunksEnd = image.dataSize - kQoiPaddingSize;
+		for (size_t i = 0; i < kQoiPaddingSize; ++i) {
+			if (data[chunksEnd + i] != kEndMarker[i]) {
+				return false;
+			}
+		}
+		size_t pos = kQoiHeaderSize;
+		QoiPixel index[64] = {};
+		QoiPixel pixel = { 0, 0, 0, 255 };
+		uint32_t run = 0;
+
+		for (size_t y = 0; y < image.height; ++y) {
+			uint8_t* row = dst + y * dstStride;
+			for (size_t x = 0; x < image.width; ++x) {
+				if (run > 0) {
+					--run;
+				}
+				else {
+					if (pos >= chunksEnd) {
+						return false;
+					}
+					uint8_t op = data[pos++];
+					if (op == 0xFE) {
+						pixel.r = data[pos];
+						pixel.g = data[pos + 1];
+						pixel.b = data[pos + 2];
+						pos += 3;
+					}
+					else if (op == 0xFF) {
+						pixel.r = data[pos];
+						pixel.g = data[pos + 1];
+						pixel.b = data[pos + 2];
+						pixel.a = data[pos + 3];
+						pos += 4;
+					}
+					else {
+						switch (op >> 6) {
+						case 0: // QOI_OP_INDEX
+							pixel = index[op];
+							break;
+						case 1: // QOI_OP_DIFF
+							pixel.r = static_cast<uint8_t>(pixel.r + ((op >> 4) & 3) - 2);
+							pixel.g = static_cast<uint8_t>(pixel.g + ((op >> 2) & 3) - 2);
+							pixel.b = static_cast<uint8_t>(pixel.b + (op & 3) - 2);
+							break;
+						case 2: { // QOI_OP_LUMA
+							uint8_t next = data[pos++];
+							int greenDiff = (op & 0x3F) - 32;
+							pixel.r = static_cast<uint8_t>(pixel.r + greenDiff - 8 + ((next >> 4) & 0x0F));
+							pixel.g = static_cast<uint8_t>(pixel.g + greenDiff);
+							pixel.b = static_cast<uint8_t>(pixel.b + greenDiff - 8 + (next & 0x0F));
+							break;
+						}
+						default: // QOI_OP_RUN, the current pixel counts as the first of the run
+							run = op & 0x3F;
+							break;
+						}
+					}
+					// An op whose operands run into the end marker was cut short
+					if (pos > chunksEnd) {
+						return false;
+					}
+					index[(pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64] = pixel;
+				}
+				row[x * 4] = pixel.b;
+				row[x * 4 + 1] = pixel.g;
+				row[x * 4 + 2] = pixel.r;
+				row[x * 4 + 3] = pixel.a;
+			}
+		}
+		// A run past the last pixel or chunks left over mean the stream does not describe this image
+		return run == 0 && pos == chunksEnd;
+	}
+
+#ifdef _WIN32
+	using Microsoft::WRL::ComPtr;
+
+	// COM and the WIC factory are set up once per thread; images are decoded on the present threads,
+	// and on the parse threads when they are uploaded into the asset cache
+	class WicContext {
+	public:
+		WicContext() {
+			// S_FALSE (already initialized) needs a matching CoUninitialize too; RPC_E_CHANGED_MODE does not
+			comInitialized = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+			CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+		}
+
+		~WicContext() {
+			factory.Reset();
+			if (comInitialized) {
+				CoUninitialize();
+			}
+		}
+
+		IWICImagingFactory* Factory() const { return factory.Get(); }
+
+	private:
+		bool comInitialized = false;
+		ComPtr<IWICImagingFactory> factory;
+	};
+
+	// The system codecs are SIMD-optimized and convert straight into the caller's buffer
+	bool DecodeWithWic(const FrameView& image, uint8_t* dst, size_t dstStride) {
+		thread_local WicContext context;
+		IWICImagingFactory* factory = context.Factory();
+		if (!factory || image.dataSize > MAXDWORD || dstStride * image.height > UINT_MAX) {
+			return false;
+		}
+
+		ComPtr<IWICStream> stream;
+		ComPtr<IWICBitmapDecoder> decoder;
+		ComPtr<IWICBitmapFrameDecode> frame;
+		ComPtr<IWICFormatConverter> converter;
+		UINT width = 0;
+		UINT height = 0;
+		if (FAILED(factory->CreateStream(&stream))
+			|| FAILED(stream->InitializeFromMemory(const_cast<BYTE*>(image.data), static_cast<DWORD>(image.dataSize)))
+			|| FAILED(factory->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, &decoder))
+			|| FAILED(decoder->GetFrame(0, &frame))
+			|| FAILED(frame->GetSize(&width, &height))
+			|| width != image.width || height != image.height
+			|| FAILED(factory->CreateFormatConverter(&converter))
+			|| FAILED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppBGRA,
+				WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom))) {
+			return false;
+		}
+		return SUCCEEDED(converter->CopyPixels(nullptr, static_cast<UINT>(dstStride),
+			static_cast<UINT>(dstStride * image.height), dst));
+	}
+#endif
+}
+
+bool ReadImageSize(PixelFormat format, const uint8_t* data, size_t size, size_t& width, size_t& height) {
+	switch (format) {
+	case PixelFormat::Jpeg:
+		return ReadJpegSize(data, size, width, height);
+	case PixelFormat::Png:
+		return ReadPngSize(data, size, width, height);
+	case PixelFormat::Qoi:
+		return ReadQoiSize(data, size, width, height);
+	case PixelFormat::Screen: {
+		size_t screenWidth, screenHeight;
+		return ReadScreenImageSize(data, size, screenWidth, screenHeight)
+			&& AcceptSize(screenWidth, screenHeight, width, height);
+	}
+	default:
+		return false;
+	}
+}
+
+bool DecodeImageToBgra(const FrameView& image, uint8_t* dst, size_t dstStride) {
+	switch (image.format) {
+	case PixelFormat::Qoi:
+		return DecodeQoi(image, dst, dstStride);
+	case PixelFormat::Screen:
+		return DecodeScreenImage(image, dst, dstStride);
+	case PixelFormat::Jpeg:
+	case PixelFormat::Png:
+#ifdef _WIN32
+		return DecodeWithWic(image, dst, dstStride);
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
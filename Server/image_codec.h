@@ -0,0 +1,17 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+
+// ѹͼƬ (JPEG/PNG/QOI Ļݱ) Ľ
+// һֵ kMaxImagePixels ͼƬܾⰴļͷλͼ
+constexpr size_t kMaxImageDimension = 16384;
+constexpr size_t kMaxImagePixels = size_t(1) << 26;
+
+// ļͷȡߣݲǸøʽߴ糬ʱ false
+bool ReadImageSize(PixelFormat format, const uint8_t* data, size_t size, size_t& width, size_t& height);
+
+// ѹͼƬֱӽ뵽 32 λ BGRA Ŀ껺壬image Ŀ ResolvePlaneLayout 
+// JPEG/PNG ʹϵͳ WIC  ( Windows)QOI ĻݱΪʵ֣ʱ false
+bool DecodeImageToBgra(const FrameView& image, uint8_t* dst, size_t dstStride);
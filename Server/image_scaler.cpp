@@ -0,0 +1,665 @@
+#include "image_scaler.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_SCALER_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC accepts any intrinsic without /arch; GCC and Clang need the target enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PIXEL_TARGET(isa)
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+	// Q14 coefficients: 1.0 is 16384, and the largest Lanczos weights stay well inside int16.
+	// Sums are exact in 32 bits, so every implementation rounds and clamps the same values.
+	constexpr int kPrecision = 14;
+	constexpr int32_t kOne = 1 << kPrecision;
+	constexpr int32_t kRounding = 1 << (kPrecision - 1);
+	constexpr double kPi = 3.14159265358979323846;
+
+	struct Kernel {
+		double support;
+		double (*weight)(double x);
+	};
+
+	double BoxWeight(double x) {
+		return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+	}
+
+	double TriangleWeight(double x) {
+		x = std::fabs(x);
+		return x < 1.0 ? 1.0 - x : 0.0;
+	}
+
+	double Sinc(double x) {
+		if (x == 0.0) {
+			return 1.0;
+		}
+		x *= kPi;
+		return std::sin(x) / x;
+	}
+
+	double Lanczos3Weight(double x) {
+		return x > -3.0 && x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+	}
+
+	Kernel KernelOf(ScaleFilter filter) {
+		switch (filter) {
+		case ScaleFilter::Box:
+			return { 0.5, BoxWeight };
+		case ScaleFilter::Lanczos3:
+			return { 3.0, Lanczos3Weight };
+		default:
+			return { 1.0, TriangleWeight };
+		}
+	}
+
+	ScaleFilter ResolveFilter(ScaleFilter filter, size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight) {
+		if (filter != ScaleFilter::Auto) {
+			return filter;
+		}
+		bool wholeFactors = srcWidth % dstWidth == 0 && srcHeight % dstHeight == 0;
+		bool shrinking = srcWidth > dstWidth || srcHeight > dstHeight;
+		return wholeFactors && shrinking ? ScaleFilter::Box : ScaleFilter::Bilinear;
+	}
+
+	inline uint8_t ClampToByte(int32_t value) {
+		return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+
+	// Two neighbouring coefficients as one 32-bit value, the way pmaddwd pairs them with 16-bit pixels
+	inline int32_t LoadPair(const int16_t* coefficients) {
+		int32_t pair;
+		std::memcpy(&pair, coefficients, sizeof(pair));
+		return pair;
+	}
+
+	// Horizontal pass: writes target columns [first, last) of one row
+	using HorizontalPass = void (*)(const uint8_t* src, uint8_t* dst, const int32_t* starts, const int32_t* counts,
+		const int16_t* coefficients, size_t taps, size_t first, size_t last);
+
+	// Vertical pass: weighs count rows into dst, bytes [from, bytes)
+	using VerticalPass = void (*)(const uint8_t* const* rows, const int16_t* coefficients, size_t count,
+		uint8_t* dst, size_t from, size_t bytes);
+
+	void HorizontalNearest(const uint8_t* src, uint8_t* dst, const int32_t* starts, const int32_t*,
+		const int16_t*, size_t, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i, dst += 4) {
+			std::memcpy(dst, src + static_cast<size_t>(starts[i]) * 4, 4);
+		}
+	}
+
+	void HorizontalScalar(const uint8_t* src, uint8_t* dst, const int32_t* starts, const int32_t* counts,
+		const int16_t* coefficients, size_t taps, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i, dst += 4) {
+			const uint8_t* pixel = src + static_cast<size_t>(starts[i]) * 4;
+			const int16_t* k = coefficients + i * taps;
+			int32_t b = kRounding, g = kRounding, r = kRounding, a = kRounding;
+			for (int32_t j = 0; j < counts[i]; ++j, pixel += 4) {
+				b += pixel[0] * k[j];
+				g += pixel[1] * k[j];
+				r += pixel[2] * k[j];
+				a += pixel[3] * k[j];
+			}
+			dst[0] = ClampToByte(b >> kPrecision);
+			dst[1] = ClampToByte(g >> kPrecision);
+			dst[2] = ClampToByte(r >> kPrecision);
+			dst[3] = ClampToByte(a >> kPrecision);
+		}
+	}
+
+	void VerticalScalar(const uint8_t* const* rows, const int16_t* coefficients, size_t count,
+		uint8_t* dst, size_t from, size_t bytes) {
+		for (size_t x = from; x < bytes; ++x) {
+			int32_t sum = kRounding;
+			for (size_t j = 0; j < count; ++j) {
+				sum += rows[j][x] * coefficients[j];
+			}
+			dst[x] = ClampToByte(sum >> kPrecision);
+		}
+	}
+
+#ifdef IMAGE_SCALER_X86
+	// Two neighbouring pixels become the channel pairs (b0 b1, g0 g1, r0 r1, a0 a1), so one
+	// pmaddwd applies two taps to all four channels; the sums are 32-bit b, g, r, a
+	PIXEL_TARGET("ssse3")
+	inline __m128i WeighPixelsSsse3(const uint8_t* pixel, const int16_t* k, int32_t count) {
+		const __m128i lowPairs = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+		const __m128i highPairs = _mm_setr_epi8(8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1, 11, -1, 15, -1);
+		__m128i acc = _mm_set1_epi32(kRounding);
+		int32_t j = 0;
+		for (; j + 4 <= count; j += 4) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixel + j * 4));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(pixels, lowPairs), _mm_set1_epi32(LoadPair(k + j))));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(pixels, highPairs), _mm_set1_epi32(LoadPair(k + j + 2))));
+		}
+		if (j + 2 <= count) {
+			__m128i pixels = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixel + j * 4));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(pixels, lowPairs), _mm_set1_epi32(LoadPair(k + j))));
+			j += 2;
+		}
+		if (j < count) {
+			// The coefficient after the last one is zero padding
+			int32_t value;
+			std::memcpy(&value, pixel + j * 4, 4);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_shuffle_epi8(_mm_cvtsi32_si128(value), lowPairs),
+				_mm_set1_epi32(LoadPair(k + j))));
+		}
+		return _mm_srai_epi32(acc, kPrecision);
+	}
+
+	PIXEL_TARGET("ssse3")
+	void HorizontalSsse3(const uint8_t* src, uint8_t* dst, const int32_t* starts, const int32_t* counts,
+		const int16_t* coefficients, size_t taps, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i, dst += 4) {
+			__m128i sums = WeighPixelsSsse3(src + static_cast<size_t>(starts[i]) * 4, coefficients + i * taps, counts[i]);
+			int32_t result = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sums, sums), sums));
+			std::memcpy(dst, &result, 4);
+		}
+	}
+
+	// Bytes of two rows are interleaved and widened to 16 bits, then pmaddwd weighs both rows at once.
+	// Only SSE2 is used; the level is the one the rest of the scaler needs.
+	PIXEL_TARGET("ssse3")
+	void VerticalSse2(const uint8_t* const* rows, const int16_t* coefficients, size_t count,
+		uint8_t* dst, size_t from, size_t bytes) {
+		const __m128i zero = _mm_setzero_si128();
+		size_t x = from;
+		for (; x + 16 <= bytes; x += 16) {
+			__m128i acc0 = _mm_set1_epi32(kRounding);
+			__m128i acc1 = acc0;
+			__m128i acc2 = acc0;
+			__m128i acc3 = acc0;
+			for (size_t j = 0; j < count; j += 2) {
+				bool pair = j + 1 < count;
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + x));
+				__m128i b = pair ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j + 1] + x)) : zero;
+				__m128i k = _mm_set1_epi32(LoadPair(coefficients + j));
+				__m128i low = _mm_unpacklo_epi8(a, b);
+				__m128i high = _mm_unpackhi_epi8(a, b);
+				acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), k));
+				acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), k));
+				acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), k));
+				acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), k));
+			}
+			__m128i low = _mm_packs_epi32(_mm_srai_epi32(acc0, kPrecision), _mm_srai_epi32(acc1, kPrecision));
+			__m128i high = _mm_packs_epi32(_mm_srai_epi32(acc2, kPrecision), _mm_srai_epi32(acc3, kPrecision));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(low, high));
+		}
+		VerticalScalar(rows, coefficients, count, dst, x, bytes);
+	}
+
+	// Unpacking and packing both work within 128-bit lanes, so the bytes come out in order
+	PIXEL_TARGET("avx2")
+	void VerticalAvx2(const uint8_t* const* rows, const int16_t* coefficients, size_t count,
+		uint8_t* dst, size_t from, size_t bytes) {
+		const __m256i zero = _mm256_setzero_si256();
+		size_t x = from;
+		for (; x + 32 <= bytes; x += 32) {
+			__m256i acc0 = _mm256_set1_epi32(kRounding);
+			__m256i acc1 = acc0;
+			__m256i acc2 = acc0;
+			__m256i acc3 = acc0;
+			for (size_t j = 0; j < count; j += 2) {
+				bool pair = j + 1 < count;
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[j] + x));
+				__m256i b = pair ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[j + 1] + x)) : zero;
+				__m256i k = _mm256_set1_epi32(LoadPair(coefficients + j));
+				__m256i low = _mm256_unpacklo_epi8(a, b);
+				__m256i high = _mm256_unpackhi_epi8(a, b);
+				acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), k));
+				acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), k));
+				acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), k));
+				acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), k));
+			}
+			__m256i low = _mm256_packs_epi32(_mm256_srai_epi32(acc0, kPrecision), _mm256_srai_epi32(acc1, kPrecision));
+			__m256i high = _mm256_packs_epi32(_mm256_srai_epi32(acc2, kPrecision), _mm256_srai_epi32(acc3, kPrecision));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_packus_epi16(low, high));
+		}
+		// The compiler leaves the upper halves dirty across the tail call, which slows down all
+		// later SSE code (the filter tables' libm calls took ten times as long)
+		_mm256_zeroupper();
+		VerticalSse2(rows, coefficients, count, dst, x, bytes);
+	}
+#endif
+
+	HorizontalPass SelectHorizontalPass(SimdLevel level, ScaleFilter filter) {
+		if (filter == ScaleFilter::Nearest) {
+			return HorizontalNearest;
+		}
+#ifdef IMAGE_SCALER_X86
+		if (level >= SimdLevel::Ssse3) return HorizontalSsse3;
+#else
+		(void)level;
+#endif
+		return HorizontalScalar;
+	}
+
+	VerticalPass SelectVerticalPass(SimdLevel level) {
+#ifdef IMAGE_SCALER_X86
+		if (level == SimdLevel::Avx2) return VerticalAvx2;
+		if (level == SimdLevel::Ssse3) return VerticalSse2;
+#else
+		(void)level;
+#endif
+		return VerticalScalar;
+	}
+
+	// First index in [0, size) for which reached() holds; reached() must be monotonic
+	template <typename Predicate>
+	size_t FirstIndex(size_t size, Predicate reached) {
+		size_t low = 0;
+		size_t high = size;
+		while (low < high) {
+			size_t middle = low + (high - low) / 2;
+			if (reached(middle)) {
+				high = middle;
+			}
+			else {
+				low = middle + 1;
+			}
+		}
+		return low;
+	}
+
+	void FillBlack(uint8_t* dst, size_t dstStride, size_t x, size_t y, size_t width, size_t height) {
+		static const uint8_t kBlack[4] = { 0, 0, 0, 0xFF };
+		for (size_t row = y; row < y + height; ++row) {
+			uint8_t* pixel = dst + row * dstStride + x * 4;
+			for (size_t column = 0; column < width; ++column, pixel += 4) {
+				std::memcpy(pixel, kBlack, 4);
+			}
+		}
+	}
+}
+
+bool ParseScaleOptions(const std::string& text, ScaleOptions& options) {
+	ScaleOptions parsed = options;
+	size_t begin = 0;
+	while (begin <= text.size()) {
+		size_t end = text.find(',', begin);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string word = text.substr(begin, end - begin);
+		std::transform(word.begin(), word.end(), word.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		if (word == "nearest") parsed.filter = ScaleFilter::Nearest;
+		else if (word == "bilinear") parsed.filter = ScaleFilter::Bilinear;
+		else if (word == "box") parsed.filter = ScaleFilter::Box;
+		else if (word == "lanczos3" || word == "lanczos") parsed.filter = ScaleFilter::Lanczos3;
+		else if (word == "auto") parsed.filter = ScaleFilter::Auto;
+		else if (word == "stretch") parsed.fit = ScaleFit::Stretch;
+		else if (word == "letterbox") parsed.fit = ScaleFit::Letterbox;
+		else return false;
+		begin = end + 1;
+	}
+	options = parsed;
+	return true;
+}
+
+const char* ScaleFilterName(ScaleFilter filter) {
+	switch (filter) {
+	case ScaleFilter::Nearest:
+		return "nearest";
+	case ScaleFilter::Bilinear:
+		return "bilinear";
+	case ScaleFilter::Box:
+		return "box";
+	case ScaleFilter::Lanczos3:
+		return "lanczos3";
+	case ScaleFilter::Auto:
+		return "auto";
+	}
+	return "unknown";
+}
+
+const char* ScaleFitName(ScaleFit fit) {
+	return fit == ScaleFit::Letterbox ? "letterbox" : "stretch";
+}
+
+ImageScaler::ImageScaler(const ScaleOptions& options, SimdLevel level, WorkStealingPool* pool)
+	: options(options)
+	, level(std::min(level, DetectSimdLevel()))
+	, pool(pool) {
+}
+
+ImageScaler::Rect ImageScaler::Placement(ScaleFit fit, size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight) {
+	Rect rect;
+	rect.width = dstWidth;
+	rect.height = dstHeight;
+	if (fit != ScaleFit::Letterbox || srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0) {
+		return rect;
+	}
+
+	// The side that hits the target first fills it; the other is rounded and centred
+	if (srcWidth * dstHeight >= srcHeight * dstWidth) {
+		rect.height = std::max<size_t>((srcHeight * dstWidth + srcWidth / 2) / srcWidth, 1);
+	}
+	else {
+		rect.width = std::max<size_t>((srcWidth * dstHeight + srcHeight / 2) / srcHeight, 1);
+	}
+	rect.x = (dstWidth - rect.width) / 2;
+	rect.y = (dstHeight - rect.height) / 2;
+	return rect;
+}
+
+void ImageScaler::Scale(const uint8_t* src, size_t srcStride, size_t srcWidth, size_t srcHeight,
+	uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight) {
+	if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0) {
+		return;
+	}
+
+	Rect place = FillOutside(srcWidth, srcHeight, dst, dstStride, dstWidth, dstHeight);
+	const Plan& plan = GetPlan(srcWidth, srcHeight, place.width, place.height);
+	uint8_t* origin = dst + place.y * dstStride + place.x * 4;
+	ForStrips(place.height, [&](Scratch& scratch, size_t y0, size_t y1) {
+		ScaleArea(plan, scratch, src, srcStride, origin, dstStride, 0, place.width, y0, y1);
+		});
+}
+
+bool ImageScaler::ScaleFrame(const FrameView& frame, uint8_t* retained, size_t retainedStride,
+	uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight) {
+	if (IsCompressedFormat(frame.format)) {
+		return false;
+	}
+	if (frame.width == 0 || frame.height == 0 || dstWidth == 0 || dstHeight == 0) {
+		return true;
+	}
+
+	Rect place = FillOutside(frame.width, frame.height, dst, dstStride, dstWidth, dstHeight);
+	const Plan& plan = GetPlan(frame.width, frame.height, place.width, place.height);
+	uint8_t* origin = dst + place.y * dstStride + place.x * 4;
+	std::atomic<bool> converted(true);
+	ForStrips(place.height, [&](Scratch& scratch, size_t y0, size_t y1) {
+		if (!ScaleFrameRows(plan, scratch, frame, retained, retainedStride, origin, dstStride, y0, y1)) {
+			converted = false;
+		}
+		});
+	return converted;
+}
+
+bool ImageScaler::ScaleFrameRows(const Plan& plan, Scratch& scratch, const FrameView& frame,
+	uint8_t* retained, size_t retainedStride, uint8_t* origin, size_t dstStride, size_t y0, size_t y1) {
+	const FilterTable& horizontal = plan.horizontal;
+	const FilterTable& vertical = plan.vertical;
+	bool weighed = !vertical.identity && plan.filter != ScaleFilter::Nearest;
+	size_t rowBytes = plan.dstWidth * 4;
+	HorizontalPass scaleRow = SelectHorizontalPass(level, plan.filter);
+	VerticalPass weighRows = SelectVerticalPass(level);
+	auto firstSource = [&](size_t y) { return vertical.identity ? y : static_cast<size_t>(vertical.starts[y]); };
+
+	// Target rows draw on windows of source rows that only move forward, so horizontally scaled
+	// rows are kept for as long as the widest window needs them and no longer
+	size_t ringSize = weighed ? vertical.taps : 1;
+	scratch.intermediate.resize(ringSize * rowBytes);
+	scratch.ring.assign(ringSize, nullptr);
+	scratch.sourceRow.resize(frame.width * 4);
+
+	// Neighbouring strips share the source rows at their border; each writes to the retained frame
+	// only the rows from its own first window up to the next strip's, the outer strips up to the edges
+	size_t ownedFirst = y0 == 0 ? 0 : firstSource(y0);
+	size_t ownedLast = y1 == plan.dstHeight ? frame.height : firstSource(y1);
+
+	// Converts source row r (into the retained frame when it is kept) and, when a target row needs
+	// it, scales it into its ring slot. A source row of the target's width needs no horizontal pass.
+	auto produce = [&](size_t r, bool keep, bool needed) {
+		uint8_t* slot = scratch.intermediate.data() + (r % ringSize) * rowBytes;
+		uint8_t* converted = keep ? retained + r * retainedStride : (horizontal.identity ? slot : scratch.sourceRow.data());
+		if (!ConvertFrameRowsToBgra(level, frame, r, 1, converted, frame.width * 4)) {
+			return false;
+		}
+		if (!needed) {
+			return true;
+		}
+		if (!horizontal.identity) {
+			scaleRow(converted, slot, horizontal.starts.data(), horizontal.counts.data(), horizontal.coefficients.data(),
+				horizontal.taps, 0, plan.dstWidth);
+			converted = slot;
+		}
+		scratch.ring[r % ringSize] = converted;
+		return true;
+	};
+
+	size_t next = retained ? ownedFirst : firstSource(y0);
+	for (size_t y = y0; y < y1; ++y) {
+		size_t first = firstSource(y);
+		size_t count = weighed ? static_cast<size_t>(vertical.counts[y]) : 1;
+		// Rows no target row reaches (nearest neighbour shrinking) are only converted for the retained frame
+		for (; next < first + count; ++next) {
+			bool keep = retained && next >= ownedFirst && next < ownedLast;
+			bool needed = next >= first;
+			if ((keep || needed) && !produce(next, keep, needed)) {
+				return false;
+			}
+		}
+
+		uint8_t* target = origin + y * dstStride;
+		if (!weighed) {
+			std::memcpy(target, scratch.ring[first % ringSize], rowBytes);
+			continue;
+		}
+		scratch.rows.resize(count);
+		for (size_t j = 0; j < count; ++j) {
+			scratch.rows[j] = scratch.ring[(first + j) % ringSize];
+		}
+		weighRows(scratch.rows.data(), vertical.coefficients.data() + y * vertical.taps, count, target, 0, rowBytes);
+	}
+	for (; retained && next < ownedLast; ++next) {
+		if (next >= ownedFirst && !produce(next, true, false)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ImageScaler::Rect ImageScaler::ScaleRegion(const uint8_t* src, size_t srcStride, size_t srcWidth, size_t srcHeight,
+	uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight, const Rect& region) {
+	if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0
+		|| region.x >= srcWidth || region.y >= srcHeight || region.width == 0 || region.height == 0) {
+		return Rect();
+	}
+
+	Rect place = Placement(options.fit, srcWidth, srcHeight, dstWidth, dstHeight);
+	const Plan& plan = GetPlan(srcWidth, srcHeight, place.width, place.height);
+
+	// Target pixels whose taps reach into the region; everything else keeps its value
+	auto affected = [](const FilterTable& table, size_t size, size_t begin, size_t end, size_t& first, size_t& last) {
+		if (table.identity) {
+			first = begin;
+			last = end;
+			return;
+		}
+		first = FirstIndex(size, [&](size_t i) {
+			return static_cast<size_t>(table.starts[i]) + static_cast<size_t>(table.counts[i]) > begin;
+			});
+		last = FirstIndex(size, [&](size_t i) { return static_cast<size_t>(table.starts[i]) >= end; });
+	};
+	size_t x0, x1, y0, y1;
+	affected(plan.horizontal, place.width, region.x, std::min(region.x + region.width, srcWidth), x0, x1);
+	affected(plan.vertical, place.height, region.y, std::min(region.y + region.height, srcHeight), y0, y1);
+	if (x0 >= x1 || y0 >= y1) {
+		return Rect();
+	}
+
+	uint8_t* origin = dst + place.y * dstStride + place.x * 4;
+	ForStrips(y1 - y0, [&](Scratch& scratch, size_t begin, size_t end) {
+		ScaleArea(plan, scratch, src, srcStride, origin, dstStride, x0, x1, y0 + begin, y0 + end);
+		});
+	Rect updated;
+	updated.x = place.x + x0;
+	updated.y = place.y + y0;
+	updated.width = x1 - x0;
+	updated.height = y1 - y0;
+	return updated;
+}
+
+ImageScaler::Rect ImageScaler::FillOutside(size_t srcWidth, size_t srcHeight,
+	uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight) const {
+	Rect place = Placement(options.fit, srcWidth, srcHeight, dstWidth, dstHeight);
+	FillBlack(dst, dstStride, 0, 0, dstWidth, place.y);
+	FillBlack(dst, dstStride, 0, place.y + place.height, dstWidth, dstHeight - place.y - place.height);
+	FillBlack(dst, dstStride, 0, place.y, place.x, place.height);
+	FillBlack(dst, dstStride, place.x + place.width, place.y, dstWidth - place.x - place.width, place.height);
+	return place;
+}
+
+const ImageScaler::Plan& ImageScaler::GetPlan(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight) {
+	for (auto it = plans.begin(); it != plans.end(); ++it) {
+		if (it->srcWidth == srcWidth && it->srcHeight == srcHeight && it->dstWidth == dstWidth && it->dstHeight == dstHeight) {
+			plans.splice(plans.begin(), plans, it);
+			return plans.front();
+		}
+	}
+
+	Plan plan;
+	plan.srcWidth = srcWidth;
+	plan.srcHeight = srcHeight;
+	plan.dstWidth = dstWidth;
+	plan.dstHeight = dstHeight;
+	plan.filter = ResolveFilter(options.filter, srcWidth, srcHeight, dstWidth, dstHeight);
+
+	auto build = [filter = plan.filter](size_t in, size_t out, FilterTable& table) {
+		table.starts.assign(out, 0);
+		table.counts.assign(out, 1);
+		if (in == out) {
+			table.identity = true;
+			return;
+		}
+		if (filter == ScaleFilter::Nearest) {
+			// The source pixel under the centre of each target pixel
+			table.taps = 2;
+			table.coefficients.assign(out * 2, 0);
+			for (size_t i = 0; i < out; ++i) {
+				table.starts[i] = static_cast<int32_t>(std::min((2 * i + 1) * in / (2 * out), in - 1));
+				table.coefficients[i * 2] = static_cast<int16_t>(kOne);
+			}
+			return;
+		}
+
+		// Shrinking widens the kernel by the scale factor, so every source pixel contributes
+		Kernel kernel = KernelOf(filter);
+		double scale = static_cast<double>(in) / static_cast<double>(out);
+		double filterScale = std::max(scale, 1.0);
+		double support = kernel.support * filterScale;
+		// Rounded up to even: the SIMD passes read coefficients in pairs, past an odd count into the zero padding
+		table.taps = static_cast<size_t>(std::ceil(support)) * 2 + 2;
+		table.coefficients.assign(out * table.taps, 0);
+
+		std::vector<double> weights(table.taps);
+		for (size_t i = 0; i < out; ++i) {
+			double center = (static_cast<double>(i) + 0.5) * scale;
+			ptrdiff_t first = std::max<ptrdiff_t>(static_cast<ptrdiff_t>(center - support + 0.5), 0);
+			ptrdiff_t last = std::min<ptrdiff_t>(static_cast<ptrdiff_t>(center + support + 0.5), static_cast<ptrdiff_t>(in));
+			size_t count = std::min(static_cast<size_t>(std::max<ptrdiff_t>(last - first, 1)), table.taps);
+			first = std::min<ptrdiff_t>(first, static_cast<ptrdiff_t>(in - count));
+
+			double total = 0.0;
+			for (size_t j = 0; j < count; ++j) {
+				weights[j] = kernel.weight((static_cast<double>(first + j) - center + 0.5) / filterScale);
+				total += weights[j];
+			}
+
+			// Quantized weights must still add up to exactly 1.0, or flat areas would shift in
+			// brightness; the rounding error goes to the largest weight
+			int16_t* k = table.coefficients.data() + i * table.taps;
+			int32_t sum = 0;
+			size_t largest = 0;
+			for (size_t j = 0; j < count; ++j) {
+				double weight = total != 0.0 ? weights[j] / total : (j == 0 ? 1.0 : 0.0);
+				k[j] = static_cast<int16_t>(std::lround(weight * kOne));
+				sum += k[j];
+				if (k[j] > k[largest]) {
+					largest = j;
+				}
+			}
+			k[largest] = static_cast<int16_t>(k[largest] + kOne - sum);
+			table.starts[i] = static_cast<int32_t>(first);
+			table.counts[i] = static_cast<int32_t>(count);
+		}
+	};
+	build(srcWidth, dstWidth, plan.horizontal);
+	build(srcHeight, dstHeight, plan.vertical);
+
+	plans.push_front(std::move(plan));
+	if (plans.size() > kMaxCachedPlans) {
+		plans.pop_back();
+	}
+	return plans.front();
+}
+
+void ImageScaler::ForStrips(size_t rows, const StripTask& body) {
+	if (!pool) {
+		scratch.resize(1);
+		body(scratch[0], 0, rows);
+		return;
+	}
+	// Strips run at once, each with buffers of its own; the horizontal pass repeats for the few
+	// source rows that neighbouring strips share
+	scratch.resize(std::max<size_t>(pool->TaskCount(rows, kMinStripRows), 1));
+	pool->ParallelFor(rows, kMinStripRows, [&](size_t task, size_t begin, size_t end) {
+		body(scratch[task], begin, end);
+		});
+}
+
+void ImageScaler::ScaleArea(const Plan& plan, Scratch& scratch, const uint8_t* src, size_t srcStride,
+	uint8_t* dst, size_t dstStride, size_t x0, size_t x1, size_t y0, size_t y1) {
+	const FilterTable& horizontal = plan.horizontal;
+	const FilterTable& vertical = plan.vertical;
+	size_t rowBytes = (x1 - x0) * 4;
+	HorizontalPass scaleRow = SelectHorizontalPass(level, plan.filter);
+
+	// Only the width changes: rows go straight to the target
+	if (vertical.identity && !horizontal.identity) {
+		for (size_t y = y0; y < y1; ++y) {
+			scaleRow(src + y * srcStride, dst + y * dstStride + x0 * 4, horizontal.starts.data(), horizontal.counts.data(),
+				horizontal.coefficients.data(), horizontal.taps, x0, x1);
+		}
+		return;
+	}
+
+	// Source rows the target rows draw on, scaled horizontally first
+	size_t srcY0 = vertical.identity ? y0 : static_cast<size_t>(vertical.starts[y0]);
+	size_t srcY1 = vertical.identity ? y1 : static_cast<size_t>(vertical.starts[y1 - 1] + vertical.counts[y1 - 1]);
+	const uint8_t* source = src + srcY0 * srcStride + x0 * 4;
+	size_t sourceStride = srcStride;
+	if (!horizontal.identity) {
+		scratch.intermediate.resize((srcY1 - srcY0) * rowBytes);
+		for (size_t y = srcY0; y < srcY1; ++y) {
+			scaleRow(src + y * srcStride, scratch.intermediate.data() + (y - srcY0) * rowBytes, horizontal.starts.data(),
+				horizontal.counts.data(), horizontal.coefficients.data(), horizontal.taps, x0, x1);
+		}
+		source = scratch.intermediate.data();
+		sourceStride = rowBytes;
+	}
+
+	if (vertical.identity || plan.filter == ScaleFilter::Nearest) {
+		for (size_t y = y0; y < y1; ++y) {
+			size_t from = vertical.identity ? y : static_cast<size_t>(vertical.starts[y]);
+			std::memcpy(dst + y * dstStride + x0 * 4, source + (from - srcY0) * sourceStride, rowBytes);
+		}
+		return;
+	}
+
+	VerticalPass weighRows = SelectVerticalPass(level);
+	scratch.rows.resize(vertical.taps);
+	for (size_t y = y0; y < y1; ++y) {
+		size_t first = static_cast<size_t>(vertical.starts[y]);
+		size_t count = static_cast<size_t>(vertical.counts[y]);
+		for (size_t j = 0; j < count; ++j) {
+			scratch.rows[j] = source + (first + j - srcY0) * sourceStride;
+		}
+		weighRows(scratch.rows.data(), vertical.coefficients.data() + y * vertical.taps, count,
+			dst + y * dstStride + x0 * 4, 0, rowBytes);
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "pixel_convert.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+// ʹõ˲
+enum class ScaleFilter {
+	Nearest,
+	Bilinear,   // Сʱӿ൱˲ᶪԴ
+	Box,        // ƽСʱÿĿǶӦһԴصƽֵ
+	Lanczos3,   // 
+	Auto,       // С Box Bilinear
+};
+
+// Դͼڿͻеİڷŷʽ
+enum class ScaleFit {
+	Stretch,     // ͻֿ߱
+	Letterbox,   // ֿ߱ȾУಿɫ
+};
+
+struct ScaleOptions {
+	ScaleFilter filter = ScaleFilter::Auto;
+	ScaleFit fit = ScaleFit::Stretch;
+};
+
+// ŷָ˲ڷŷʽ "lanczos3,letterbox"δĬ
+bool ParseScaleOptions(const std::string& text, ScaleOptions& options);
+
+const char* ScaleFilterName(ScaleFilter filter);
+const char* ScaleFitName(ScaleFit fit);
+
+class WorkStealingPool;
+
+//  32 λ BGRA ͼΪǿͻߴ BGRA ͼ񣬳ʱֻ 1:1 
+// ˮƽֱ˿ɷ˲14 λϵָʵֵĽֽһ
+// ÿ (Դߴ, Ŀߴ) ˲ϵʵУߴ粻֡¼
+// ̳߳ʱĿвţ뵥ֽ߳һ
+// ͬһʵͬһʱֻһ߳ʹ (ύ̳߳ص)
+class ImageScaler {
+public:
+	struct Rect {
+		size_t x = 0;
+		size_t y = 0;
+		size_t width = 0;
+		size_t height = 0;
+	};
+
+	// ϵʱ̭δõ
+	static constexpr size_t kMaxCachedPlans = 4;
+	// ʱÿٰĿԽСظˮƽռԽ
+	static constexpr size_t kMinStripRows = 32;
+
+	explicit ImageScaler(const ScaleOptions& options = ScaleOptions(), SimdLevel level = DetectSimdLevel(),
+		WorkStealingPool* pool = nullptr);
+
+	// Դͼ dstWidth x dstHeight ĿռݵľΣStretch ʱΪĿ
+	static Rect Placement(ScaleFit fit, size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight);
+
+	// ͼLetterbox ʱĿԴͼĲɫ
+	void Scale(const uint8_t* src, size_t srcStride, size_t srcWidth, size_t srcHeight,
+		uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight);
+
+	// Դͼ region ڵر仯ֻ¼ӰĿ (˲ǵıԵ)
+	// Ŀಿ֮ǰͬߴŵĽĿбдľ
+	Rect ScaleRegion(const uint8_t* src, size_t srcStride, size_t srcWidth, size_t srcHeight,
+		uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight, const Rect& region);
+
+	// ֱӴδѹʽ֡ţתˮƽţֻдֱ˲Ļλ壬֡ BGRA
+	// retained Ϊʱ˳ת֡д (лڻʱд)֮ľֲʹ
+	//  ConvertFrameToBgra  Scale ֽһ£ѹʽ false
+	bool ScaleFrame(const FrameView& frame, uint8_t* retained, size_t retainedStride,
+		uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight);
+
+	const ScaleOptions& GetOptions() const { return options; }
+
+private:
+	// ÿĿɴ starts[i] ʼ counts[i] ԴؼȨõȨΪ coefficients[i * taps ...]
+	// starts  starts + counts  i 
+	struct FilterTable {
+		bool identity = false;   // ԴĿߴͬһֱӸ
+		size_t taps = 0;
+		std::vector<int32_t> starts;
+		std::vector<int32_t> counts;
+		std::vector<int16_t> coefficients;
+	};
+
+	struct Plan {
+		size_t srcWidth = 0;
+		size_t srcHeight = 0;
+		size_t dstWidth = 0;
+		size_t dstHeight = 0;
+		ScaleFilter filter = ScaleFilter::Nearest;
+		FilterTable horizontal;
+		FilterTable vertical;
+	};
+
+	// ÿԵʱ
+	struct Scratch {
+		std::vector<uint8_t> intermediate;
+		std::vector<const uint8_t*> rows;
+		std::vector<uint8_t> sourceRow;     // ScaleFrame תһ
+		std::vector<const uint8_t*> ring;   // ScaleFrame иԴˮƽźڵλãкŶԻδСȡģ
+	};
+
+	using StripTask = std::function<void(Scratch& scratch, size_t y0, size_t y1)>;
+
+	ScaleOptions options;
+	SimdLevel level;
+	WorkStealingPool* pool;
+	std::list<Plan> plans;   // ʹõǰ
+	std::vector<Scratch> scratch;
+
+	// Scale  ScaleFrame ãĿԴͼĲɫԴͼռݵľ
+	Rect FillOutside(size_t srcWidth, size_t srcHeight, uint8_t* dst, size_t dstStride, size_t dstWidth, size_t dstHeight) const;
+
+	const Plan& GetPlan(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight);
+
+	//  rows Ŀв bodyû̳߳ʱΪһ
+	void ForStrips(size_t rows, const StripTask& body);
+
+	//  Placement ֮ţֻĿ [x0, x1) [y0, y1)
+	void ScaleArea(const Plan& plan, Scratch& scratch, const uint8_t* src, size_t srcStride,
+		uint8_t* dst, size_t dstStride, size_t x0, size_t x1, size_t y0, size_t y1);
+
+	// ScaleFrame еһĿ [y0, y1)origin Ϊ Placement Ͻ
+	bool ScaleFrameRows(const Plan& plan, Scratch& scratch, const FrameView& frame, uint8_t* retained,
+		size_t retainedStride, uint8_t* origin, size_t dstStride, size_t y0, size_t y1);
+};
@@ -0,0 +1,365 @@
+#include "iocp_reactor.h"
+
+#ifdef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <iostream>
+
+namespace {
+	// How long Stop waits for cancelled I/O of open connections to complete
+	constexpr auto kCloseDrainTimeout = std::chrono::seconds(2);
+}
+
+std::unique_ptr<Reactor> CreateReactor(size_t ioThreads) {
+	return std::make_unique<IocpReactor>(ioThreads);
+}
+
+IocpReactor::IocpReactor(size_t ioThreads)
+	: ioThreadCount(std::max<size_t>(1, ioThreads))
+	, running(false)
+	, completionPort(nullptr)
+	, listenSocket(INVALID_SOCKET)
+	, nextConnectionId(1) {
+}
+
+IocpReactor::~IocpReactor() {
+	Stop();
+}
+
+bool IocpReactor::Start(uint16_t port, AcceptHandler handler) {
+	if (running) {
+		return true;
+	}
+
+	if (!socket_compat::Startup()) {
+		return false;
+	}
+
+	listenSocket = socket_compat::Listen(port);
+	if (listenSocket == INVALID_SOCKET) {
+		socket_compat::Cleanup();
+		return false;
+	}
+
+	completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, static_cast<DWORD>(ioThreadCount));
+	if (!completionPort) {
+		std::cerr << "Failed to create completion port" << std::endl;
+		socket_compat::Close(listenSocket);
+		listenSocket = INVALID_SOCKET;
+		socket_compat::Cleanup();
+		return false;
+	}
+
+	acceptHandler = std::move(handler);
+	running = true;
+	for (size_t i = 0; i < ioThreadCount; ++i) {
+		workers.emplace_back(&IocpReactor::WorkerThread, this);
+	}
+	acceptThread = std::thread(&IocpReactor::AcceptThread, this);
+	return true;
+}
+
+void IocpReactor::Stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+
+	// Closing the listener unblocks accept
+	socket_compat::Close(listenSocket);
+	listenSocket = INVALID_SOCKET;
+	if (acceptThread.joinable()) {
+		acceptThread.join();
+	}
+
+	// Close every connection; their cancelled I/O completes on the workers, which release them
+	std::vector<std::shared_ptr<Connection>> open;
+	{
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		for (auto& entry : connections) {
+			open.push_back(entry.second);
+		}
+	}
+	for (auto& connection : open) {
+		std::lock_guard<std::mutex> lock(connection->sendMutex);
+		BeginCloseLocked(*connection);
+	}
+	open.clear();
+
+	auto deadline = std::chrono::steady_clock::now() + kCloseDrainTimeout;
+	while (std::chrono::steady_clock::now() < deadline) {
+		{
+			std::lock_guard<std::mutex> lock(connectionsMutex);
+			if (connections.empty()) {
+				break;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// A completion without an OVERLAPPED tells a worker to exit
+	for (size_t i = 0; i < workers.size(); ++i) {
+		PostQueuedCompletionStatus(completionPort, 0, 0, nullptr);
+	}
+	for (auto& worker : workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+	workers.clear();
+
+	CloseHandle(completionPort);
+	completionPort = nullptr;
+	socket_compat::Cleanup();
+}
+
+void IocpReactor::AcceptThread() {
+	while (running) {
+		sockaddr_in clientAddr = {};
+		int clientAddrLen = sizeof(clientAddr);
+
+		SOCKET socket = accept(listenSocket, reinterpret_cast<sockaddr*>(&clientAddr), &clientAddrLen);
+		if (socket == INVALID_SOCKET) {
+			if (running) {
+				std::cerr << "Failed to accept connection" << std::endl;
+			}
+			continue;
+		}
+
+		socket_compat::SetNoDelay(socket);
+		uint64_t id = nextConnectionId++;
+		std::shared_ptr<ConnectionHandler> handler = acceptHandler
+			? acceptHandler(id, socket_compat::FormatAddress(clientAddr))
+			: nullptr;
+		if (!handler) {
+			socket_compat::Close(socket);
+			continue;
+		}
+
+		auto connection = std::make_shared<Connection>();
+		connection->id = id;
+		connection->socket = socket;
+		connection->handler = handler;
+		connection->receiveContext.operation = Operation::Receive;
+		connection->sendContext.operation = Operation::Send;
+
+		if (!CreateIoCompletionPort(reinterpret_cast<HANDLE>(socket), completionPort,
+			reinterpret_cast<ULONG_PTR>(connection.get()), 0)) {
+			std::cerr << "Failed to associate connection " << id << " with completion port" << std::endl;
+			socket_compat::Close(socket);
+			handler->OnClosed();
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(connectionsMutex);
+			connections[id] = connection;
+		}
+
+		// The pending receive keeps the connection alive; when it fails the connection is released
+		connection->outstanding++;
+		bool posted = false;
+		{
+			std::lock_guard<std::mutex> lock(connection->sendMutex);
+			posted = PostReceive(*connection);
+			if (!posted) {
+				BeginCloseLocked(*connection);
+			}
+		}
+		if (!posted) {
+			ReleaseOperation(*connection);
+		}
+	}
+}
+
+void IocpReactor::WorkerThread() {
+	while (true) {
+		DWORD bytes = 0;
+		ULONG_PTR key = 0;
+		OVERLAPPED* overlapped = nullptr;
+		BOOL ok = GetQueuedCompletionStatus(completionPort, &bytes, &key, &overlapped, INFINITE);
+		if (!overlapped) {
+			// Stop signal, or the port itself was closed
+			break;
+		}
+
+		auto* connection = reinterpret_cast<Connection*>(key);
+		auto* context = CONTAINING_RECORD(overlapped, IoContext, overlapped);
+		OnCompletion(*connection, *context, ok != FALSE, bytes);
+	}
+}
+
+bool IocpReactor::PostReceive(Connection& connection) {
+	if (connection.closing) {
+		return false;
+	}
+
+	size_t writable = 0;
+	char* buffer = connection.handler->PrepareReceive(writable);
+	if (!buffer || writable == 0) {
+		return false;
+	}
+
+	WSABUF wsaBuffer;
+	wsaBuffer.buf = buffer;
+	wsaBuffer.len = static_cast<ULONG>(std::min<size_t>(writable, INT_MAX));
+	DWORD flags = 0;
+	ZeroMemory(&connection.receiveContext.overlapped, sizeof(OVERLAPPED));
+
+	if (WSARecv(connection.socket, &wsaBuffer, 1, nullptr, &flags,
+		&connection.receiveContext.overlapped, nullptr) == SOCKET_ERROR
+		&& WSAGetLastError() != WSA_IO_PENDING) {
+		return false;
+	}
+	return true;
+}
+
+bool IocpReactor::PostSendLocked(Connection& connection) {
+	WSABUF wsaBuffer;
+	wsaBuffer.buf = &connection.sending[connection.sendingOffset];
+	wsaBuffer.len = static_cast<ULONG>(std::min<size_t>(connection.sending.size() - connection.sendingOffset, INT_MAX));
+	ZeroMemory(&connection.sendContext.overlapped, sizeof(OVERLAPPED));
+
+	connection.outstanding++;
+	if (WSASend(connection.socket, &wsaBuffer, 1, nullptr, 0,
+		&connection.sendContext.overlapped, nullptr) == SOCKET_ERROR
+		&& WSAGetLastError() != WSA_IO_PENDING) {
+		connection.outstanding--;
+		connection.sendInFlight = false;
+		return false;
+	}
+	connection.sendInFlight = true;
+	return true;
+}
+
+void IocpReactor::OnCompletion(Connection& connection, IoContext& context, bool success, DWORD bytes) {
+	if (context.operation == Operation::Receive) {
+		bool keep = success && bytes > 0 && connection.handler->OnReceived(bytes);
+		std::lock_guard<std::mutex> lock(connection.sendMutex);
+		if (keep) {
+			// Re-arm before releasing this operation so the count never drops to zero in between
+			connection.outstanding++;
+			if (!PostReceive(connection)) {
+				connection.outstanding--;
+				BeginCloseLocked(connection);
+			}
+		}
+		else {
+			BeginCloseLocked(connection);
+		}
+	}
+	else {
+		std::lock_guard<std::mutex> lock(connection.sendMutex);
+		if (!success) {
+			connection.sendInFlight = false;
+			BeginCloseLocked(connection);
+		}
+		else {
+			connection.sendingOffset += bytes;
+			bool posted = true;
+			if (connection.sendingOffset < connection.sending.size()) {
+				posted = PostSendLocked(connection);
+			}
+			else if (!connection.pending.empty() && !connection.closing) {
+				connection.sending.swap(connection.pending);
+				connection.pending.clear();
+				connection.sendingOffset = 0;
+				posted = PostSendLocked(connection);
+			}
+			else {
+				connection.sending.clear();
+				connection.sendingOffset = 0;
+				connection.sendInFlight = false;
+			}
+			if (!posted) {
+				BeginCloseLocked(connection);
+			}
+		}
+	}
+
+	// May release the connection; it must not be touched afterwards
+	ReleaseOperation(connection);
+}
+
+void IocpReactor::BeginCloseLocked(Connection& connection) {
+	if (connection.closing) {
+		return;
+	}
+	// Closing the socket cancels the outstanding requests, which then complete with an error
+	connection.closing = true;
+	socket_compat::Close(connection.socket);
+	connection.socket = INVALID_SOCKET;
+}
+
+void IocpReactor::ReleaseOperation(Connection& connection) {
+	if (--connection.outstanding > 0) {
+		return;
+	}
+
+	std::shared_ptr<Connection> keepAlive;
+	{
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		auto it = connections.find(connection.id);
+		if (it != connections.end()) {
+			keepAlive = std::move(it->second);
+			connections.erase(it);
+		}
+	}
+	if (keepAlive) {
+		keepAlive->handler->OnClosed();
+	}
+}
+
+bool IocpReactor::Send(uint64_t connectionId, const char* data, size_t size) {
+	std::shared_ptr<Connection> connection = FindConnection(connectionId);
+	if (!connection) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(connection->sendMutex);
+	if (connection->closing) {
+		return false;
+	}
+
+	// A peer that stops reading would otherwise grow the queue without bound
+	size_t queued = connection->sending.size() - connection->sendingOffset + connection->pending.size();
+	if (queued + size > kMaxQueuedSendBytes) {
+		std::cerr << "Connection " << connectionId << ": peer is not reading (" << queued
+			<< " bytes queued), closing" << std::endl;
+		BeginCloseLocked(*connection);
+		return false;
+	}
+
+	// Only one send request is in flight per connection; later data waits behind it
+	if (connection->sendInFlight) {
+		connection->pending.append(data, size);
+		return true;
+	}
+
+	connection->sending.assign(data, size);
+	connection->sendingOffset = 0;
+	if (!PostSendLocked(*connection)) {
+		BeginCloseLocked(*connection);
+		return false;
+	}
+	return true;
+}
+
+void IocpReactor::Close(uint64_t connectionId) {
+	std::shared_ptr<Connection> connection = FindConnection(connectionId);
+	if (!connection) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(connection->sendMutex);
+	BeginCloseLocked(*connection);
+}
+
+std::shared_ptr<IocpReactor::Connection> IocpReactor::FindConnection(uint64_t connectionId) {
+	std::lock_guard<std::mutex> lock(connectionsMutex);
+	auto it = connections.find(connectionId);
+	return it != connections.end() ? it->second : nullptr;
+}
+
+#endif
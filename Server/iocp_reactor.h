@@ -0,0 +1,87 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "reactor.h"
+#include "socket_compat.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// ɶ˿ (IOCP)  Reactorһ̼߳ӹ̶߳
+// ÿͬʱһһ;
+class IocpReactor : public Reactor {
+public:
+	explicit IocpReactor(size_t ioThreads);
+	~IocpReactor() override;
+
+	bool Start(uint16_t port, AcceptHandler acceptHandler) override;
+	void Stop() override;
+	bool Send(uint64_t connectionId, const char* data, size_t size) override;
+	void Close(uint64_t connectionId) override;
+
+private:
+	enum class Operation {
+		Receive,
+		Send,
+	};
+
+	struct IoContext {
+		OVERLAPPED overlapped;
+		Operation operation;
+	};
+
+	struct Connection {
+		uint64_t id = 0;
+		SOCKET socket = INVALID_SOCKET;
+		std::shared_ptr<ConnectionHandler> handler;
+		IoContext receiveContext;
+		IoContext sendContext;
+		std::mutex sendMutex;
+		std::string sending;        // ;
+		size_t sendingOffset = 0;
+		std::string pending;        // ȴ;ɺٷ͵
+		bool sendInFlight = false;
+		bool closing = false;
+		std::atomic<int> outstanding{ 0 };  // ; I/O 
+	};
+
+	size_t ioThreadCount;
+	std::atomic<bool> running;
+	HANDLE completionPort;
+	SOCKET listenSocket;
+	AcceptHandler acceptHandler;
+	std::thread acceptThread;
+	std::vector<std::thread> workers;
+	std::atomic<uint64_t> nextConnectionId;
+	std::mutex connectionsMutex;
+	std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections;
+
+	// ̺߳
+	void AcceptThread();
+
+	// ̺߳
+	void WorkerThread();
+
+	// Ͷݽ
+	bool PostReceive(Connection& connection);
+
+	// Ͷݷ󣬵÷ sendMutex
+	bool PostSendLocked(Connection& connection);
+
+	// һ֪ͨ
+	void OnCompletion(Connection& connection, IoContext& context, bool success, DWORD bytes);
+
+	// ʼرӣ÷ sendMutex
+	void BeginCloseLocked(Connection& connection);
+
+	// һ;һʱͷ
+	void ReleaseOperation(Connection& connection);
+
+	std::shared_ptr<Connection> FindConnection(uint64_t connectionId);
+};
+
+#endif
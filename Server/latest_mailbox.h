@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// ֻһ (latest wins)
+// Ͷʱ滻δȡߵľֻῴµ
+template <typename T>
+class LatestMailbox {
+public:
+	LatestMailbox() : slot(nullptr) {}
+
+	~LatestMailbox() {
+		delete slot.exchange(nullptr, std::memory_order_acq_rel);
+	}
+
+	LatestMailbox(const LatestMailbox&) = delete;
+	LatestMailbox& operator=(const LatestMailbox&) = delete;
+
+	// Ͷһر滻ľ (ûΪ)
+	std::unique_ptr<T> Post(std::unique_ptr<T> item) {
+		return std::unique_ptr<T>(slot.exchange(item.release(), std::memory_order_acq_rel));
+	}
+
+	// ȡߵǰûΪ
+	std::unique_ptr<T> Take() {
+		return std::unique_ptr<T>(slot.exchange(nullptr, std::memory_order_acq_rel));
+	}
+
+	bool HasItem() const {
+		return slot.load(std::memory_order_acquire) != nullptr;
+	}
+
+private:
+	std::atomic<T*> slot;
+};
@@ -0,0 +1,139 @@
+#include "media_library.h"
+#include "content_hash.h"
+#include <filesystem>
+#include <iterator>
+
+MediaLibrary::MediaLibrary(uint64_t budgetBytes, std::string directory)
+	: budgetBytes(budgetBytes)
+	, directory(std::move(directory)) {
+}
+
+bool MediaLibrary::Upload(uint64_t mediaId, uint64_t totalSize, uint64_t offset, const void* data, size_t size,
+	std::string& error) {
+	std::shared_ptr<const std::vector<uint8_t>> complete;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(mediaId);
+		if (it != index.end() && it->second->verified) {
+			// The id is the digest of the stored file, so uploading it again has nothing to add;
+			// a file of another size cannot have the same content
+			if (totalSize != it->second->totalSize) {
+				idMismatches++;
+				error = "Media id does not match the file";
+				return false;
+			}
+			lru.splice(lru.begin(), lru, it->second);
+			return true;
+		}
+		if (offset == 0) {
+			if (it != index.end()) {
+				EraseLocked(it->second);
+			}
+			if (totalSize == 0 || totalSize > budgetBytes) {
+				error = "Media too large";
+				return false;
+			}
+			// The whole file is accounted for up front, so parallel uploads cannot overrun the budget
+			while (bytes + totalSize > budgetBytes && !lru.empty()) {
+				evictions++;
+				EraseLocked(std::prev(lru.end()));
+			}
+			Entry entry;
+			entry.mediaId = mediaId;
+			entry.totalSize = totalSize;
+			entry.data = std::make_shared<std::vector<uint8_t>>();
+			entry.data->reserve(static_cast<size_t>(totalSize));
+			lru.push_front(std::move(entry));
+			it = index.emplace(mediaId, lru.begin()).first;
+			bytes += totalSize;
+		}
+		else if (it == index.end()) {
+			error = "Media not uploaded";
+			return false;
+		}
+
+		Entry& entry = *it->second;
+		std::vector<uint8_t>& file = *entry.data;
+		if (totalSize != entry.totalSize || offset != file.size() || size > entry.totalSize - file.size()) {
+			// A lost or repeated chunk would corrupt the file; the client starts over
+			EraseLocked(it->second);
+			error = "Media upload out of order";
+			return false;
+		}
+		const auto* bytesIn = static_cast<const uint8_t*>(data);
+		file.insert(file.end(), bytesIn, bytesIn + size);
+		lru.splice(lru.begin(), lru, it->second);
+		if (file.size() < entry.totalSize) {
+			return true;
+		}
+		complete = entry.data;
+	}
+
+	// Hashed outside the lock, which a large file would hold for tens of milliseconds. Every session
+	// plays what is stored under an id, so the id has to be the digest of the file
+	bool matches = ComputeXxh3(complete->data(), complete->size()) == mediaId;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = index.find(mediaId);
+	// A new upload under the same id may have replaced this one meanwhile
+	bool current = it != index.end() && it->second->data == complete;
+	if (!matches) {
+		idMismatches++;
+		if (current) {
+			EraseLocked(it->second);
+		}
+		error = "Media id does not match the file";
+		return false;
+	}
+	if (current) {
+		it->second->verified = true;
+	}
+	return true;
+}
+
+std::shared_ptr<MediaInput> MediaLibrary::OpenUpload(uint64_t mediaId, std::string& error) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = index.find(mediaId);
+	if (it == index.end()) {
+		error = "Media not uploaded";
+		return nullptr;
+	}
+	const Entry& entry = *it->second;
+	if (!entry.verified) {
+		error = "Media upload incomplete";
+		return nullptr;
+	}
+	lru.splice(lru.begin(), lru, it->second);
+	// Complete files are never written again: a new upload under the same id gets its own buffer
+	return CreateMemoryInput(entry.data);
+}
+
+std::shared_ptr<MediaInput> MediaLibrary::OpenFile(const std::string& path, std::string& error) {
+	if (directory.empty()) {
+		error = "No media directory on the server";
+		return nullptr;
+	}
+	// Lexical check only: links inside the directory are trusted like the files themselves
+	std::filesystem::path relative = std::filesystem::u8path(path).lexically_normal();
+	if (relative.empty() || relative.has_root_path() || *relative.begin() == "..") {
+		error = "Invalid media path";
+		return nullptr;
+	}
+	return OpenFileInput((std::filesystem::u8path(directory) / relative).u8string(), error);
+}
+
+MediaLibrary::Stats MediaLibrary::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats stats;
+	stats.uploads = lru.size();
+	stats.bytes = bytes;
+	stats.budgetBytes = budgetBytes;
+	stats.evictions = evictions;
+	stats.idMismatches = idMismatches;
+	return stats;
+}
+
+void MediaLibrary::EraseLocked(std::list<Entry>::iterator it) {
+	bytes -= it->totalSize;
+	index.erase(it->mediaId);
+	lru.erase(it);
+}
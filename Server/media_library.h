@@ -0,0 +1,63 @@
+#pragma once
+
+#include "video_source.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ɹ˲ŵýļͻ˷ֶϴڴеļԼýĿ¼еļ
+// ϴļԤʱδʹõļڲŵļɲųУŽͷ
+// ̰߳ȫ
+class MediaLibrary {
+public:
+	struct Stats {
+		size_t uploads = 0;
+		uint64_t bytes = 0;          // ϴļ (δɵ) ռõֽ
+		uint64_t budgetBytes = 0;
+		uint64_t evictions = 0;
+		uint64_t idMismatches = 0;   // ժҪ id ϴ
+	};
+
+	// directory Ϊʱܰ·
+	MediaLibrary(uint64_t budgetBytes, std::string directory);
+
+	// ׷һϴoffset Ϊ 0 ʱʼµϴ滻ͬһ id δɵϴ
+	// mediaId Ϊļݵ XXH3-64 ժҪյһʱУ飬ļ false
+	// ͬһ id УļʱٽݣСͬĸֱӷ true
+	// β totalSize ļԤʱ false ԭ
+	bool Upload(uint64_t mediaId, uint64_t totalSize, uint64_t offset, const void* data, size_t size,
+		std::string& error);
+
+	// ϴͨУļΪʹ
+	std::shared_ptr<MediaInput> OpenUpload(uint64_t mediaId, std::string& error);
+
+	// ýĿ¼еļpath Ϊ UTF-8 ·뿪Ŀ¼
+	std::shared_ptr<MediaInput> OpenFile(const std::string& path, std::string& error);
+
+	Stats GetStats() const;
+
+private:
+	struct Entry {
+		uint64_t mediaId = 0;
+		uint64_t totalSize = 0;
+		std::shared_ptr<std::vector<uint8_t>> data;   // ϴǰֻڴ˴
+		bool verified = false;   // ϴ id 
+	};
+
+	uint64_t budgetBytes;
+	std::string directory;
+	mutable std::mutex mutex;
+	// ʹõǰ
+	std::list<Entry> lru;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+	uint64_t bytes = 0;
+	uint64_t evictions = 0;
+	uint64_t idMismatches = 0;
+
+	void EraseLocked(std::list<Entry>::iterator it);
+};
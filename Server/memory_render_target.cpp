@@ -0,0 +1,171 @@
+#include "memory_render_target.h"
+#include "pixel_convert.h"
+#include <algorithm>
+
+MemoryRenderTarget::MemoryRenderTarget(int clientWidth, int clientHeight, const ScaleOptions& scaleOptions,
+	WorkStealingPool* pool)
+	: targetWindow(0)
+	, clientWidth(clientWidth)
+	, clientHeight(clientHeight)
+	, alive(true)
+	, frameWidth(0)
+	, frameHeight(0)
+	, tiles(DetectSimdLevel(), pool)
+	, scaler(scaleOptions, DetectSimdLevel(), pool)
+	, pool(pool)
+	, clientFrameWidth(0)
+	, clientFrameHeight(0) {
+}
+
+bool MemoryRenderTarget::Initialize(uint64_t targetWindow) {
+	if (!alive || targetWindow == 0) {
+		return false;
+	}
+
+	this->targetWindow = targetWindow;
+	counters.initializations++;
+	return true;
+}
+
+bool MemoryRenderTarget::IsAlive() const {
+	return alive;
+}
+
+bool MemoryRenderTarget::GetClientSize(int& width, int& height) const {
+	if (!alive) {
+		return false;
+	}
+	width = clientWidth;
+	height = clientHeight;
+	return true;
+}
+
+bool MemoryRenderTarget::RenderImageFrame(const FrameView& image) {
+	if (!alive || !image.data || image.width == 0 || image.height == 0) {
+		return false;
+	}
+
+	// Keep the last frame as BGRA, tightly packed, like the window backend presents it
+	frame.resize(image.width * image.height * 4);
+	if (!ConvertFrameToBgra(pool, image, frame.data(), image.width * 4)) {
+		return false;
+	}
+	frameWidth = image.width;
+	frameHeight = image.height;
+	counters.frames++;
+	counters.pixelsWritten += image.width * image.height;
+
+	presentedRegions.clear();
+	size_t changedTiles = tiles.Compare(frame.data(), image.width * 4, image.width, image.height, presentedRegions);
+	if (changedTiles * 2 >= tiles.TileCount()) {
+		PresentFrame();
+	}
+	else {
+		for (const TileTracker::Region& region : presentedRegions) {
+			PresentRegion(region.x, region.y, region.width, region.height);
+		}
+	}
+	return true;
+}
+
+bool MemoryRenderTarget::RenderDirtyRects(size_t frameWidth, size_t frameHeight, const std::vector<DirtyRect>& rects) {
+	// Regions patch the last frame, so it has to be there and have the same size
+	if (!alive || frame.empty() || frameWidth != this->frameWidth || frameHeight != this->frameHeight) {
+		return false;
+	}
+
+	size_t stride = frameWidth * 4;
+	presentedRegions.clear();
+	for (const DirtyRect& rect : rects) {
+		if (!ConvertFrameToBgra(rect.image, frame.data() + rect.y * stride + rect.x * 4, stride)) {
+			return false;
+		}
+		counters.pixelsWritten += rect.image.width * rect.image.height;
+		tiles.Invalidate(rect.x, rect.y, rect.image.width, rect.image.height);
+		presentedRegions.push_back({ rect.x, rect.y, rect.image.width, rect.image.height });
+	}
+	for (const TileTracker::Region& region : presentedRegions) {
+		PresentRegion(region.x, region.y, region.width, region.height);
+	}
+	counters.regionUpdates++;
+	return true;
+}
+
+bool MemoryRenderTarget::RenderVideoFrame(const FrameView& video) {
+	if (IsCompressedFormat(video.format)
+		|| (video.width == static_cast<size_t>(clientWidth) && video.height == static_cast<size_t>(clientHeight))) {
+		return RenderImageFrame(video);
+	}
+	if (!alive || !video.data || video.width == 0 || video.height == 0) {
+		return false;
+	}
+
+	// Converted and scaled in one pass like the window backend; the frame is kept for inspection
+	frame.resize(video.width * video.height * 4);
+	clientFrameWidth = static_cast<size_t>(clientWidth > 0 ? clientWidth : 0);
+	clientFrameHeight = static_cast<size_t>(clientHeight > 0 ? clientHeight : 0);
+	client.resize(clientFrameWidth * clientFrameHeight * 4);
+	if (!scaler.ScaleFrame(video, frame.data(), video.width * 4,
+		client.data(), clientFrameWidth * 4, clientFrameWidth, clientFrameHeight)) {
+		frameWidth = 0;
+		frameHeight = 0;
+		return false;
+	}
+	frameWidth = video.width;
+	frameHeight = video.height;
+	counters.frames++;
+	counters.pixelsWritten += video.width * video.height;
+	counters.pixelsScaled += clientFrameWidth * clientFrameHeight;
+
+	// Presented whole without comparing tiles
+	tiles.Reset();
+	presentedRegions.clear();
+	presentedRegions.push_back({ 0, 0, video.width, video.height });
+	return true;
+}
+
+void MemoryRenderTarget::Clear() {
+	std::fill(frame.begin(), frame.end(), static_cast<uint8_t>(0));
+	std::fill(client.begin(), client.end(), static_cast<uint8_t>(0));
+	counters.clears++;
+	tiles.Reset();
+}
+
+PresentCounters MemoryRenderTarget::GetPresentCounters() const {
+	const TileTracker::Counters& tileCounters = tiles.GetCounters();
+	PresentCounters result;
+	result.framesSkipped = tileCounters.framesSkipped.load();
+	result.tilesPresented = tileCounters.tilesChanged.load();
+	result.tilesSkipped = tileCounters.tilesSkipped.load();
+	return result;
+}
+
+void MemoryRenderTarget::SetClientSize(int width, int height) {
+	clientWidth = width;
+	clientHeight = height;
+}
+
+void MemoryRenderTarget::PresentFrame() {
+	clientFrameWidth = static_cast<size_t>(clientWidth > 0 ? clientWidth : 0);
+	clientFrameHeight = static_cast<size_t>(clientHeight > 0 ? clientHeight : 0);
+	client.resize(clientFrameWidth * clientFrameHeight * 4);
+	scaler.Scale(frame.data(), frameWidth * 4, frameWidth, frameHeight,
+		client.data(), clientFrameWidth * 4, clientFrameWidth, clientFrameHeight);
+	counters.pixelsScaled += clientFrameWidth * clientFrameHeight;
+}
+
+void MemoryRenderTarget::PresentRegion(size_t x, size_t y, size_t width, size_t height) {
+	// Like a window that was resized, a client area of another size needs the whole frame again
+	if (clientFrameWidth != static_cast<size_t>(clientWidth) || clientFrameHeight != static_cast<size_t>(clientHeight)) {
+		PresentFrame();
+		return;
+	}
+	ImageScaler::Rect region;
+	region.x = x;
+	region.y = y;
+	region.width = width;
+	region.height = height;
+	ImageScaler::Rect updated = scaler.ScaleRegion(frame.data(), frameWidth * 4, frameWidth, frameHeight,
+		client.data(), clientFrameWidth * 4, clientFrameWidth, clientFrameHeight, region);
+	counters.pixelsScaled += updated.width * updated.height;
+}
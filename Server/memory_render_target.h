@@ -0,0 +1,73 @@
+#pragma once
+
+#include "image_scaler.h"
+#include "render_target.h"
+#include "tile_tracker.h"
+#include <cstdint>
+#include <vector>
+
+// ڴȾĿ꣬ϵͳ֡ݱڴ
+// ûĻ֤Ⱦ·һ֡ BGRA 
+// 봰ںһͼȽ֡¼Ӧֵ򣬲ѱ仯ĲŵͻߴĻ
+class MemoryRenderTarget : public RenderTarget {
+public:
+	struct Counters {
+		uint64_t initializations = 0;
+		uint64_t frames = 0;
+		uint64_t regionUpdates = 0;
+		uint64_t clears = 0;
+		uint64_t pixelsWritten = 0;   // ֲ֡дֵĿ
+		uint64_t pixelsScaled = 0;    // ¼Ŀͻ
+	};
+
+	MemoryRenderTarget(int clientWidth = 1920, int clientHeight = 1080, const ScaleOptions& scaleOptions = ScaleOptions(),
+		WorkStealingPool* pool = nullptr);
+
+	bool Initialize(uint64_t targetWindow) override;
+	bool IsAlive() const override;
+	bool GetClientSize(int& width, int& height) const override;
+	bool RenderImageFrame(const FrameView& image) override;
+	// 봰ںһҪŵδѹ֡תһɣֲ֡Ƚͼ
+	bool RenderVideoFrame(const FrameView& video) override;
+	bool RenderDirtyRects(size_t frameWidth, size_t frameHeight, const std::vector<DirtyRect>& rects) override;
+	void Clear() override;
+	PresentCounters GetPresentCounters() const override;
+
+	// ģⴰڳߴ仯
+	void SetClientSize(int width, int height);
+
+	// ģⴰڱ
+	void Destroy() { alive = false; }
+
+	uint64_t TargetWindow() const { return targetWindow; }
+	const std::vector<uint8_t>& FrameData() const { return frame; }
+	size_t FrameWidth() const { return frameWidth; }
+	size_t FrameHeight() const { return frameHeight; }
+	// ӦʾĻ棬ͻߴ BGRA
+	const std::vector<uint8_t>& ClientData() const { return client; }
+	size_t ClientWidth() const { return clientFrameWidth; }
+	size_t ClientHeight() const { return clientFrameHeight; }
+	const Counters& GetCounters() const { return counters; }
+	// һ֡б仯Ҫֵ
+	const std::vector<TileTracker::Region>& PresentedRegions() const { return presentedRegions; }
+
+private:
+	uint64_t targetWindow;
+	int clientWidth;
+	int clientHeight;
+	bool alive;
+	std::vector<uint8_t> frame;
+	size_t frameWidth;
+	size_t frameHeight;
+	Counters counters;
+	TileTracker tiles;
+	std::vector<TileTracker::Region> presentedRegions;
+	ImageScaler scaler;
+	WorkStealingPool* pool;
+	std::vector<uint8_t> client;
+	size_t clientFrameWidth;
+	size_t clientFrameHeight;
+
+	void PresentFrame();
+	void PresentRegion(size_t x, size_t y, size_t width, size_t height);
+};
@@ -1,18 +1,22 @@
 #pragma once
-#define WIN32_LEAN_AND_MEAN
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
 
+#include "client_session.h"
+#include "reactor.h"
 #include <string>
+#include <string_view>
 #include <thread>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 
 class NetworkServer {
 public:
-	NetworkServer(uint16_t port = 12345);
+	// ioThreads Ϊ 0 ʱʹ CPU bufferOptions ΪյϢԭʼ֡õĻ
+	NetworkServer(uint16_t port = 12345, size_t maxSessions = 16, size_t ioThreads = 0,
+		const FrameBufferPool::Options& bufferOptions = FrameBufferPool::Options());
 	~NetworkServer();
 
 	// 
@@ -21,26 +25,43 @@ public:
 	// ֹͣ
 	void Stop();
 
-	// Ϣص
-	void SetMessageHandler(std::function<void(const std::string&)> handler);
+	// Ϣص (߳ϵ)
+	void SetMessageHandler(ClientSession::MessageHandler handler);
 
-	// Ϣͻ
-	bool SendMessage(const std::string& message);
+	// ԭʼ֡ص (߳ϵ)
+	void SetRawFrameHandler(ClientSession::RawFrameHandler handler);
+
+	// ûỰرջص
+	void SetSessionClosedHandler(ClientSession::ClosedHandler handler);
+
+	// ǰỰ
+	size_t SessionCount() const;
+
+	// ȡлỰͳϢ
+	std::vector<ClientSession::Stats> GetSessionStats() const;
+
+	// Ϣԭʼ֡صͳϢ
+	FrameBufferPool::Stats GetBufferPoolStats() const { return bufferPool.GetStats(); }
+
+	// Ƿʵʹ˴ҳ
+	bool BufferHugePages() const { return bufferPool.HugePagesEnabled(); }
 
 private:
 	uint16_t port;
+	size_t maxSessions;
+	size_t ioThreads;
 	bool running;
-	SOCKET serverSocket;
-	SOCKET clientSocket;
-	std::thread listenThread;
-	std::function<void(const std::string&)> messageHandler;
-
-	// ̺߳
-	void ListenThread();
+	std::unique_ptr<Reactor> reactor;
+	FrameBufferPool bufferPool;
+	ClientSession::MessageHandler messageHandler;
+	ClientSession::RawFrameHandler rawFrameHandler;
+	ClientSession::ClosedHandler closedHandler;
+	mutable std::mutex sessionsMutex;
+	std::unordered_map<uint64_t, std::shared_ptr<ClientSession>> sessions;
 
-	// ʼ WSA
-	bool InitializeWSA();
+	// ӵ
+	std::shared_ptr<ConnectionHandler> AcceptSession(uint64_t id, const std::string& peerAddress);
 
-	// Դ
-	void Cleanup();
+	// Ựر
+	void OnSessionClosed(const std::shared_ptr<ClientSession>& session);
 };
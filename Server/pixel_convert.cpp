@@ -0,0 +1,520 @@
+#include "pixel_convert.h"
+#include "image_codec.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic without /arch; GCC and Clang need the target enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PIXEL_TARGET(isa)
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+	using RowConverter = void (*)(const uint8_t* src, uint8_t* dst, size_t width);
+
+	// Q6 fixed-point YUV coefficients. Every intermediate fits in 16 bits except the
+	// B and R sums of very bright pixels, which the SIMD kernels saturate; both end
+	// up clamped to 255, so all implementations produce identical output
+	struct YuvCoefficients {
+		int16_t yOffset;
+		int16_t yScale;
+		int16_t blueU;
+		int16_t greenU;
+		int16_t greenV;
+		int16_t redV;
+	};
+
+	// For NV12 the u pointer addresses the interleaved UV plane and v is unused
+	using YuvRowConverter = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+		uint8_t* dst, size_t width, const YuvCoefficients& k);
+
+	YuvCoefficients MakeYuvCoefficients(const YuvColorSpace& colorSpace) {
+		// Kr and Kb of the matrix; the other coefficients follow from them
+		double kr = colorSpace.matrix == YuvMatrix::Bt709 ? 0.2126 : 0.299;
+		double kb = colorSpace.matrix == YuvMatrix::Bt709 ? 0.0722 : 0.114;
+		double kg = 1.0 - kr - kb;
+		double yScale = colorSpace.fullRange ? 1.0 : 255.0 / 219.0;
+		double chromaScale = colorSpace.fullRange ? 1.0 : 255.0 / 224.0;
+
+		auto fixed = [](double value) { return static_cast<int16_t>(value * 64.0 + 0.5); };
+		YuvCoefficients k;
+		k.yOffset = colorSpace.fullRange ? 0 : 16;
+		k.yScale = fixed(yScale);
+		k.blueU = fixed(2.0 * (1.0 - kb) * chromaScale);
+		k.greenU = fixed(2.0 * (1.0 - kb) * kb / kg * chromaScale);
+		k.greenV = fixed(2.0 * (1.0 - kr) * kr / kg * chromaScale);
+		k.redV = fixed(2.0 * (1.0 - kr) * chromaScale);
+		return k;
+	}
+
+	// Scalar reference implementations
+
+	inline uint8_t ClampToByte(int value) {
+		return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+
+	template <bool Interleaved>
+	void YuvToBgraScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+		uint8_t* dst, size_t width, const YuvCoefficients& k) {
+		for (size_t x = 0; x < width; ++x, dst += 4) {
+			size_t c = x / 2;
+			int cu = (Interleaved ? u[2 * c] : u[c]) - 128;
+			int cv = (Interleaved ? u[2 * c + 1] : v[c]) - 128;
+			int luma = (y[x] - k.yOffset) * k.yScale;
+			dst[0] = ClampToByte((luma + k.blueU * cu + 32) >> 6);
+			dst[1] = ClampToByte((luma - (k.greenU * cu + k.greenV * cv) + 32) >> 6);
+			dst[2] = ClampToByte((luma + k.redV * cv + 32) >> 6);
+			dst[3] = 0xFF;
+		}
+	}
+
+	void RgbToBgraScalar(const uint8_t* src, uint8_t* dst, size_t width) {
+		for (size_t x = 0; x < width; ++x, src += 3, dst += 4) {
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			dst[3] = 0xFF;
+		}
+	}
+
+	void BgrToBgraScalar(const uint8_t* src, uint8_t* dst, size_t width) {
+		for (size_t x = 0; x < width; ++x, src += 3, dst += 4) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = 0xFF;
+		}
+	}
+
+	void RgbaToBgraScalar(const uint8_t* src, uint8_t* dst, size_t width) {
+		for (size_t x = 0; x < width; ++x, src += 4, dst += 4) {
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			dst[3] = src[3];
+		}
+	}
+
+	void CopyBgra(const uint8_t* src, uint8_t* dst, size_t width) {
+		std::memcpy(dst, src, width * 4);
+	}
+
+#ifdef PIXEL_CONVERT_X86
+	// Shuffle masks: four 3-byte pixels at the bottom of a register to four 4-byte pixels,
+	// the alpha slot (0x80) zeroed and then filled in by OR-ing 0xFF
+	#define PIXEL_RGB_TO_BGRA_MASK 2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128
+	#define PIXEL_BGR_TO_BGRA_MASK 0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128
+	#define PIXEL_RGBA_TO_BGRA_MASK 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+
+	// Every 16-byte load of 24-bit pixels uses only 12 bytes, so the loops stop early
+	// enough that the last load stays inside the row
+	template <bool SwapRedBlue>
+	PIXEL_TARGET("ssse3")
+	void Rgb24ToBgraSsse3(const uint8_t* src, uint8_t* dst, size_t width) {
+		const __m128i mask = SwapRedBlue
+			? _mm_setr_epi8(PIXEL_RGB_TO_BGRA_MASK)
+			: _mm_setr_epi8(PIXEL_BGR_TO_BGRA_MASK);
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+		size_t x = 0;
+		for (; x + 18 <= width; x += 16, src += 48, dst += 64) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 36));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_shuffle_epi8(b, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_shuffle_epi8(c, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_or_si128(_mm_shuffle_epi8(d, mask), alpha));
+		}
+		for (; x + 6 <= width; x += 4, src += 12, dst += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+		}
+
+		if (SwapRedBlue) {
+			RgbToBgraScalar(src, dst, width - x);
+		}
+		else {
+			BgrToBgraScalar(src, dst, width - x);
+		}
+	}
+
+	PIXEL_TARGET("ssse3")
+	void RgbaToBgraSsse3(const uint8_t* src, uint8_t* dst, size_t width) {
+		const __m128i mask = _mm_setr_epi8(PIXEL_RGBA_TO_BGRA_MASK);
+
+		size_t x = 0;
+		for (; x + 4 <= width; x += 4, src += 16, dst += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(a, mask));
+		}
+		RgbaToBgraScalar(src, dst, width - x);
+	}
+
+	// AVX2 shuffles within 128-bit lanes, so each lane gets its own four 24-bit pixels
+	template <bool SwapRedBlue>
+	PIXEL_TARGET("avx2")
+	void Rgb24ToBgraAvx2(const uint8_t* src, uint8_t* dst, size_t width) {
+		const __m256i mask = SwapRedBlue
+			? _mm256_setr_epi8(PIXEL_RGB_TO_BGRA_MASK, PIXEL_RGB_TO_BGRA_MASK)
+			: _mm256_setr_epi8(PIXEL_BGR_TO_BGRA_MASK, PIXEL_BGR_TO_BGRA_MASK);
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+
+		size_t x = 0;
+		for (; x + 18 <= width; x += 16, src += 48, dst += 64) {
+			__m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12)), 1);
+			__m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 36)), 1);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_or_si256(_mm256_shuffle_epi8(a, mask), alpha));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_or_si256(_mm256_shuffle_epi8(b, mask), alpha));
+		}
+		Rgb24ToBgraSsse3<SwapRedBlue>(src, dst, width - x);
+	}
+
+	PIXEL_TARGET("avx2")
+	void RgbaToBgraAvx2(const uint8_t* src, uint8_t* dst, size_t width) {
+		const __m256i mask = _mm256_setr_epi8(PIXEL_RGBA_TO_BGRA_MASK, PIXEL_RGBA_TO_BGRA_MASK);
+
+		size_t x = 0;
+		for (; x + 16 <= width; x += 16, src += 64, dst += 64) {
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_shuffle_epi8(a, mask));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_shuffle_epi8(b, mask));
+		}
+		RgbaToBgraSsse3(src, dst, width - x);
+	}
+
+	// Eight pixels of 16-bit luma and (already duplicated) chroma to BGR, in Q6 rounded down to 8 bits
+	PIXEL_TARGET("sse2")
+	inline void YuvToBgr16Sse2(__m128i luma, __m128i cu, __m128i cv, const YuvCoefficients& k,
+		__m128i& b, __m128i& g, __m128i& r) {
+		const __m128i rounding = _mm_set1_epi16(32);
+		luma = _mm_mullo_epi16(_mm_sub_epi16(luma, _mm_set1_epi16(k.yOffset)), _mm_set1_epi16(k.yScale));
+		__m128i green = _mm_add_epi16(_mm_mullo_epi16(cu, _mm_set1_epi16(k.greenU)),
+			_mm_mullo_epi16(cv, _mm_set1_epi16(k.greenV)));
+		b = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cu, _mm_set1_epi16(k.blueU))), rounding), 6);
+		g = _mm_srai_epi16(_mm_adds_epi16(_mm_subs_epi16(luma, green), rounding), 6);
+		r = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(cv, _mm_set1_epi16(k.redV))), rounding), 6);
+	}
+
+	// 16 pixels per iteration; only SSE2 is needed, but it runs at the SSSE3 level
+	template <bool Interleaved>
+	PIXEL_TARGET("sse2")
+	void YuvToBgraSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+		uint8_t* dst, size_t width, const YuvCoefficients& k) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i bias = _mm_set1_epi16(128);
+		const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+		size_t x = 0;
+		for (; x + 16 <= width; x += 16, dst += 64) {
+			__m128i cu;
+			__m128i cv;
+			if (Interleaved) {
+				__m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x));
+				cu = _mm_and_si128(uv, _mm_set1_epi16(0xFF));
+				cv = _mm_srli_epi16(uv, 8);
+			}
+			else {
+				cu = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)), zero);
+				cv = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), zero);
+			}
+			cu = _mm_sub_epi16(cu, bias);
+			cv = _mm_sub_epi16(cv, bias);
+
+			__m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+			__m128i b0, g0, r0, b1, g1, r1;
+			YuvToBgr16Sse2(_mm_unpacklo_epi8(luma, zero), _mm_unpacklo_epi16(cu, cu), _mm_unpacklo_epi16(cv, cv), k, b0, g0, r0);
+			YuvToBgr16Sse2(_mm_unpackhi_epi8(luma, zero), _mm_unpackhi_epi16(cu, cu), _mm_unpackhi_epi16(cv, cv), k, b1, g1, r1);
+
+			__m128i blue = _mm_packus_epi16(b0, b1);
+			__m128i green = _mm_packus_epi16(g0, g1);
+			__m128i red = _mm_packus_epi16(r0, r1);
+			__m128i bgLow = _mm_unpacklo_epi8(blue, green);
+			__m128i bgHigh = _mm_unpackhi_epi8(blue, green);
+			__m128i raLow = _mm_unpacklo_epi8(red, alpha);
+			__m128i raHigh = _mm_unpackhi_epi8(red, alpha);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(bgLow, raLow));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(bgLow, raLow));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi16(bgHigh, raHigh));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi16(bgHigh, raHigh));
+		}
+
+		// x is even here, so the tail starts on a chroma sample boundary
+		YuvToBgraScalar<Interleaved>(y + x, Interleaved ? u + x : u + x / 2, Interleaved ? v : v + x / 2, dst, width - x, k);
+	}
+
+	PIXEL_TARGET("avx2")
+	inline void YuvToBgr16Avx2(__m256i luma, __m256i cu, __m256i cv, const YuvCoefficients& k,
+		__m256i& b, __m256i& g, __m256i& r) {
+		const __m256i rounding = _mm256_set1_epi16(32);
+		luma = _mm256_mullo_epi16(_mm256_sub_epi16(luma, _mm256_set1_epi16(k.yOffset)), _mm256_set1_epi16(k.yScale));
+		__m256i green = _mm256_add_epi16(_mm256_mullo_epi16(cu, _mm256_set1_epi16(k.greenU)),
+			_mm256_mullo_epi16(cv, _mm256_set1_epi16(k.greenV)));
+		b = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cu, _mm256_set1_epi16(k.blueU))), rounding), 6);
+		g = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_subs_epi16(luma, green), rounding), 6);
+		r = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(cv, _mm256_set1_epi16(k.redV))), rounding), 6);
+	}
+
+	// 32 pixels per iteration. Unpacks work within 128-bit lanes, so the low half holds
+	// pixels 0-7 and 16-23 and the high half 8-15 and 24-31; the final permutes restore the order
+	template <bool Interleaved>
+	PIXEL_TARGET("avx2")
+	void YuvToBgraAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+		uint8_t* dst, size_t width, const YuvCoefficients& k) {
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i bias = _mm256_set1_epi16(128);
+		const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+
+		size_t x = 0;
+		for (; x + 32 <= width; x += 32, dst += 128) {
+			__m256i cu;
+			__m256i cv;
+			if (Interleaved) {
+				__m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + x));
+				cu = _mm256_and_si256(uv, _mm256_set1_epi16(0xFF));
+				cv = _mm256_srli_epi16(uv, 8);
+			}
+			else {
+				cu = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x / 2)));
+				cv = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x / 2)));
+			}
+			cu = _mm256_sub_epi16(cu, bias);
+			cv = _mm256_sub_epi16(cv, bias);
+
+			__m256i luma = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + x));
+			__m256i b0, g0, r0, b1, g1, r1;
+			YuvToBgr16Avx2(_mm256_unpacklo_epi8(luma, zero), _mm256_unpacklo_epi16(cu, cu), _mm256_unpacklo_epi16(cv, cv), k, b0, g0, r0);
+			YuvToBgr16Avx2(_mm256_unpackhi_epi8(luma, zero), _mm256_unpackhi_epi16(cu, cu), _mm256_unpackhi_epi16(cv, cv), k, b1, g1, r1);
+
+			__m256i blue = _mm256_packus_epi16(b0, b1);
+			__m256i green = _mm256_packus_epi16(g0, g1);
+			__m256i red = _mm256_packus_epi16(r0, r1);
+			__m256i bgLow = _mm256_unpacklo_epi8(blue, green);
+			__m256i bgHigh = _mm256_unpackhi_epi8(blue, green);
+			__m256i raLow = _mm256_unpacklo_epi8(red, alpha);
+			__m256i raHigh = _mm256_unpackhi_epi8(red, alpha);
+			__m256i p0 = _mm256_unpacklo_epi16(bgLow, raLow);    // 0-3, 16-19
+			__m256i p1 = _mm256_unpackhi_epi16(bgLow, raLow);    // 4-7, 20-23
+			__m256i p2 = _mm256_unpacklo_epi16(bgHigh, raHigh);  // 8-11, 24-27
+			__m256i p3 = _mm256_unpackhi_epi16(bgHigh, raHigh);  // 12-15, 28-31
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(p0, p1, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 64), _mm256_permute2x128_si256(p0, p1, 0x31));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+		}
+
+		YuvToBgraSse2<Interleaved>(y + x, Interleaved ? u + x : u + x / 2, Interleaved ? v : v + x / 2, dst, width - x, k);
+	}
+
+	void Cpuid(int leaf, int subleaf, unsigned int registers[4]) {
+#ifdef _MSC_VER
+		int values[4];
+		__cpuidex(values, leaf, subleaf);
+		for (int i = 0; i < 4; ++i) {
+			registers[i] = static_cast<unsigned int>(values[i]);
+		}
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	// Whether the OS saves the YMM registers on context switches
+	PIXEL_TARGET("xsave")
+	bool OsSupportsAvx() {
+#ifdef _MSC_VER
+		return (_xgetbv(0) & 0x6) == 0x6;
+#else
+		unsigned int eax = 0;
+		unsigned int edx = 0;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (eax & 0x6) == 0x6;
+#endif
+	}
+
+	SimdLevel QuerySimdLevel() {
+		unsigned int registers[4] = {};
+		Cpuid(0, 0, registers);
+		unsigned int maxLeaf = registers[0];
+		if (maxLeaf < 1) {
+			return SimdLevel::Scalar;
+		}
+
+		Cpuid(1, 0, registers);
+		bool ssse3 = (registers[2] & (1u << 9)) != 0;
+		bool osxsave = (registers[2] & (1u << 27)) != 0;
+		bool avx = (registers[2] & (1u << 28)) != 0;
+		if (!ssse3) {
+			return SimdLevel::Scalar;
+		}
+
+		if (maxLeaf >= 7 && osxsave && avx && OsSupportsAvx()) {
+			Cpuid(7, 0, registers);
+			if (registers[1] & (1u << 5)) {
+				return SimdLevel::Avx2;
+			}
+		}
+		return SimdLevel::Ssse3;
+	}
+#else
+	SimdLevel QuerySimdLevel() {
+		return SimdLevel::Scalar;
+	}
+#endif
+
+	RowConverter SelectRowConverter(SimdLevel level, PixelFormat format) {
+		switch (format) {
+		case PixelFormat::Rgb24:
+#ifdef PIXEL_CONVERT_X86
+			if (level == SimdLevel::Avx2) return Rgb24ToBgraAvx2<true>;
+			if (level == SimdLevel::Ssse3) return Rgb24ToBgraSsse3<true>;
+#endif
+			return RgbToBgraScalar;
+		case PixelFormat::Bgr24:
+#ifdef PIXEL_CONVERT_X86
+			if (level == SimdLevel::Avx2) return Rgb24ToBgraAvx2<false>;
+			if (level == SimdLevel::Ssse3) return Rgb24ToBgraSsse3<false>;
+#endif
+			return BgrToBgraScalar;
+		case PixelFormat::Rgba32:
+#ifdef PIXEL_CONVERT_X86
+			if (level == SimdLevel::Avx2) return RgbaToBgraAvx2;
+			if (level == SimdLevel::Ssse3) return RgbaToBgraSsse3;
+#endif
+			return RgbaToBgraScalar;
+		case PixelFormat::Bgra32:
+			return CopyBgra;
+		default:
+			return nullptr;
+		}
+	}
+
+	YuvRowConverter SelectYuvRowConverter(SimdLevel level, PixelFormat format) {
+		bool interleaved = format == PixelFormat::Nv12;
+#ifdef PIXEL_CONVERT_X86
+		if (level == SimdLevel::Avx2) {
+			return interleaved ? YuvToBgraAvx2<true> : YuvToBgraAvx2<false>;
+		}
+		if (level == SimdLevel::Ssse3) {
+			return interleaved ? YuvToBgraSse2<true> : YuvToBgraSse2<false>;
+		}
+#else
+		(void)level;
+#endif
+		return interleaved ? YuvToBgraScalar<true> : YuvToBgraScalar<false>;
+	}
+
+	void ConvertYuvToBgra(SimdLevel level, const FrameView& frame, size_t firstRow, size_t rows,
+		uint8_t* dst, size_t dstStride) {
+		YuvRowConverter convert = SelectYuvRowConverter(level, frame.format);
+		YuvCoefficients k = MakeYuvCoefficients(frame.colorSpace);
+
+		// Luma, then U and V (I420) or interleaved UV (NV12); NV12 has no third plane
+		const uint8_t* luma = frame.data + frame.planeOffsets[0];
+		const uint8_t* u = frame.data + frame.planeOffsets[1];
+		const uint8_t* v = frame.data + frame.planeOffsets[2];
+
+		for (size_t row = firstRow; row < firstRow + rows; ++row) {
+			size_t chromaRow = row / 2;
+			convert(luma + row * frame.strides[0], u + chromaRow * frame.strides[1], v + chromaRow * frame.strides[2],
+				dst + (row - firstRow) * dstStride, frame.width, k);
+		}
+	}
+}
+
+SimdLevel DetectSimdLevel() {
+	static const SimdLevel level = QuerySimdLevel();
+	return level;
+}
+
+const char* SimdLevelName(SimdLevel level) {
+	switch (level) {
+	case SimdLevel::Scalar:
+		return "scalar";
+	case SimdLevel::Ssse3:
+		return "SSSE3";
+	case SimdLevel::Avx2:
+		return "AVX2";
+	}
+	return "unknown";
+}
+
+bool ConvertFrameToBgra(const FrameView& frame, uint8_t* dst, size_t dstStride) {
+	return ConvertFrameToBgra(DetectSimdLevel(), frame, dst, dstStride);
+}
+
+bool ConvertFrameToBgra(SimdLevel level, const FrameView& frame, uint8_t* dst, size_t dstStride) {
+	level = std::min(level, DetectSimdLevel());
+	if (IsCompressedFormat(frame.format)) {
+		return DecodeImageToBgra(frame, dst, dstStride);
+	}
+	if (IsYuvFormat(frame.format)) {
+		ConvertYuvToBgra(level, frame, 0, frame.height, dst, dstStride);
+		return true;
+	}
+	ConvertToBgra(level, frame.format, frame.data + frame.planeOffsets[0], frame.strides[0],
+		dst, dstStride, frame.width, frame.height);
+	return true;
+}
+
+bool ConvertFrameToBgra(WorkStealingPool* pool, const FrameView& frame, uint8_t* dst, size_t dstStride) {
+	if (!pool || IsCompressedFormat(frame.format)) {
+		return ConvertFrameToBgra(frame, dst, dstStride);
+	}
+	// Rows convert independently of each other, YUV rows included
+	SimdLevel level = DetectSimdLevel();
+	pool->ParallelFor(frame.height, kMinConvertStripRows, [&](size_t, size_t begin, size_t end) {
+		ConvertFrameRowsToBgra(level, frame, begin, end - begin, dst + begin * dstStride, dstStride);
+		});
+	return true;
+}
+
+bool ConvertFrameRowsToBgra(SimdLevel level, const FrameView& frame, size_t firstRow, size_t rows,
+	uint8_t* dst, size_t dstStride) {
+	level = std::min(level, DetectSimdLevel());
+	if (IsCompressedFormat(frame.format) || firstRow + rows > frame.height) {
+		return false;
+	}
+	if (IsYuvFormat(frame.format)) {
+		ConvertYuvToBgra(level, frame, firstRow, rows, dst, dstStride);
+		return true;
+	}
+	ConvertToBgra(level, frame.format, frame.data + frame.planeOffsets[0] + firstRow * frame.strides[0], frame.strides[0],
+		dst, dstStride, frame.width, rows);
+	return true;
+}
+
+void ConvertToBgra(PixelFormat format, const uint8_t* src, size_t srcStride,
+	uint8_t* dst, size_t dstStride, size_t width, size_t height) {
+	ConvertToBgra(DetectSimdLevel(), format, src, srcStride, dst, dstStride, width, height);
+}
+
+void ConvertToBgra(SimdLevel level, PixelFormat format, const uint8_t* src, size_t srcStride,
+	uint8_t* dst, size_t dstStride, size_t width, size_t height) {
+	level = std::min(level, DetectSimdLevel());
+	RowConverter convert = SelectRowConverter(level, format);
+	if (!convert) {
+		return;
+	}
+
+	for (size_t y = 0; y < height; ++y) {
+		convert(src + y * srcStride, dst + y * dstStride, width);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+
+// ѸʽתΪֶʹõ 32 λ BGRA (alpha ̶Ϊ 255RGBA/BGRA 뱣ԭ alpha)
+// YUV ʹ 6 λϵ֧ BT.601/BT.709  full/limited range
+//  CPU ֵָ֧ʱѡʵ֣ x86 ƽֻ̨бʵ
+enum class SimdLevel {
+	Scalar,
+	Ssse3,   // 24 λʽֽҪ pshufbSSE2 ûжӦָ
+	Avx2,
+};
+
+// ǰ CPU ϵͳֵ֧߼״εʱ
+SimdLevel DetectSimdLevel();
+
+const char* SimdLevelName(SimdLevel level);
+
+// תһ֡frame ƽ沼 ResolvePlaneLayout ȫdstStride ΪĿֽ
+// ѹʽֱӽ뵽 dstʱ false
+bool ConvertFrameToBgra(const FrameView& frame, uint8_t* dst, size_t dstStride);
+
+// ָʵּİ汾level  DetectSimdLevel() ʱ
+bool ConvertFrameToBgra(SimdLevel level, const FrameView& frame, uint8_t* dst, size_t dstStride);
+
+class WorkStealingPool;
+
+// תʱÿٰ
+constexpr size_t kMinConvertStripRows = 64;
+
+// ̳߳ذתδѹ֡ѹʽڵ߳Ͻ룬pool Ϊʱͬ
+bool ConvertFrameToBgra(WorkStealingPool* pool, const FrameView& frame, uint8_t* dst, size_t dstStride);
+
+// ֻתδѹ֡ firstRow ʼ rows Уdst ָеһеѹʽܰת false
+bool ConvertFrameRowsToBgra(SimdLevel level, const FrameView& frame, size_t firstRow, size_t rows,
+	uint8_t* dst, size_t dstStride);
+
+// תʽ width x height أsrcStride/dstStride Ϊֽ
+void ConvertToBgra(PixelFormat format, const uint8_t* src, size_t srcStride,
+	uint8_t* dst, size_t dstStride, size_t width, size_t height);
+
+// ָʵּİ汾level  DetectSimdLevel() ʱ
+void ConvertToBgra(SimdLevel level, PixelFormat format, const uint8_t* src, size_t srcStride,
+	uint8_t* dst, size_t dstStride, size_t width, size_t height);
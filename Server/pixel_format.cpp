@@ -0,0 +1,71 @@
+#include "pixel_format.h"
+#include "image_codec.h"
+
+namespace {
+	// Bytes of pixel data in one row of a plane, and the number of rows
+	void PlaneExtent(const FrameView& frame, size_t plane, size_t& rowBytes, size_t& rows) {
+		size_t chromaWidth = (frame.width + 1) / 2;
+		size_t chromaHeight = (frame.height + 1) / 2;
+		switch (frame.format) {
+		case PixelFormat::I420:
+			rowBytes = plane == 0 ? frame.width : chromaWidth;
+			rows = plane == 0 ? frame.height : chromaHeight;
+			break;
+		case PixelFormat::Nv12:
+			rowBytes = plane == 0 ? frame.width : chromaWidth * 2;
+			rows = plane == 0 ? frame.height : chromaHeight;
+			break;
+		default:
+			rowBytes = frame.width * BytesPerPixel(frame.format);
+			rows = frame.height;
+			break;
+		}
+	}
+}
+
+bool ResolvePlaneLayout(FrameView& frame, size_t dataSize) {
+	frame.dataSize = dataSize;
+	if (IsCompressedFormat(frame.format)) {
+		size_t width = 0;
+		size_t height = 0;
+		if (!frame.data || !ReadImageSize(frame.format, frame.data, dataSize, width, height)
+			|| (frame.width != 0 && frame.width != width) || (frame.height != 0 && frame.height != height)) {
+			return false;
+		}
+		frame.width = width;
+		frame.height = height;
+		return true;
+	}
+
+	size_t planes = PlaneCount(frame.format);
+	bool packedPlanes = true;
+	for (size_t plane = 1; plane < planes; ++plane) {
+		packedPlanes = packedPlanes && frame.planeOffsets[plane] == 0;
+	}
+
+	size_t nextOffset = frame.planeOffsets[0];
+	for (size_t plane = 0; plane < planes; ++plane) {
+		size_t rowBytes = 0;
+		size_t rows = 0;
+		PlaneExtent(frame, plane, rowBytes, rows);
+		if (frame.strides[plane] == 0) {
+			frame.strides[plane] = rowBytes;
+		}
+		if (plane > 0 && packedPlanes) {
+			frame.planeOffsets[plane] = nextOffset;
+		}
+
+		size_t offset = frame.planeOffsets[plane];
+		size_t stride = frame.strides[plane];
+		if (rowBytes == 0 || rows == 0 || stride < rowBytes
+			|| offset > dataSize || dataSize - offset < rowBytes) {
+			return false;
+		}
+		// The last row needs no padding, so decoder buffers cut right after it are accepted
+		if ((dataSize - offset - rowBytes) / stride < rows - 1) {
+			return false;
+		}
+		nextOffset = offset + stride * rows;
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ͻظʽȡֵ windowcaster.proto е PixelFormat Լԭʼ֡ͷ pixelFormat һ
+enum class PixelFormat : uint16_t {
+	Rgb24 = 0,
+	Bgr24 = 1,
+	Rgba32 = 2,
+	Bgra32 = 3,
+	I420 = 4,    // Y ƽ UV ƽ棬ɫȿ߸Ϊһ (ȡ)
+	Nv12 = 5,    // Y ƽ UV ƽ
+	Jpeg = 6,    // ѹͼƬΪһļȡļͷ
+	Png = 7,
+	Qoi = 8,
+	Screen = 9,  // Ļݱ룬 screen_codec.h
+};
+
+// ǷΪ֪ظʽ
+inline bool IsKnownPixelFormat(uint32_t value) {
+	return value <= static_cast<uint32_t>(PixelFormat::Screen);
+}
+
+inline bool IsYuvFormat(PixelFormat format) {
+	return format == PixelFormat::I420 || format == PixelFormat::Nv12;
+}
+
+inline bool IsCompressedFormat(PixelFormat format) {
+	return format == PixelFormat::Jpeg || format == PixelFormat::Png || format == PixelFormat::Qoi
+		|| format == PixelFormat::Screen;
+}
+
+// ʽÿֽYUV ƽʽѹʽ 0
+inline size_t BytesPerPixel(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Rgb24:
+	case PixelFormat::Bgr24:
+		return 3;
+	case PixelFormat::Rgba32:
+	case PixelFormat::Bgra32:
+		return 4;
+	case PixelFormat::I420:
+	case PixelFormat::Nv12:
+	case PixelFormat::Jpeg:
+	case PixelFormat::Png:
+	case PixelFormat::Qoi:
+	case PixelFormat::Screen:
+		return 0;
+	}
+	return 0;
+}
+
+// ʽƽ
+inline size_t PlaneCount(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::I420:
+		return 3;
+	case PixelFormat::Nv12:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+// YUV  RGB ת
+enum class YuvMatrix : uint8_t {
+	Bt601,
+	Bt709,
+};
+
+// YUV ɫʿռ䣬limited range  Y ȡ 16-235UV ȡ 16-240
+struct YuvColorSpace {
+	YuvMatrix matrix = YuvMatrix::Bt601;
+	bool fullRange = false;
+};
+
+constexpr size_t kMaxPlanes = 3;
+
+// һ֡صɵ÷
+// ʽֻƽ 0I420 Ϊ YUVNV12 Ϊ YUV
+struct FrameView {
+	const uint8_t* data = nullptr;
+	size_t width = 0;
+	size_t height = 0;
+	PixelFormat format = PixelFormat::Rgb24;
+	YuvColorSpace colorSpace;   //  YUV ʽ
+	// ƽ data ֽƫֽɺβ
+	size_t planeOffsets[kMaxPlanes] = {};
+	size_t strides[kMaxPlanes] = {};
+	size_t dataSize = 0;        // data ֽ ResolvePlaneLayout ¼
+};
+
+// ȫƽ沼ֽ֣Ϊ 0 ƽΪУ
+// YUV ɫƽƫƶΪ 0 ʱΪƽν
+// ֽСһػһƽ泬 dataSize ʱ false
+// ѹʽļͷȡ (width/height  0 ʱ֮һ)Ǹøʽߴ糬ʱ false
+bool ResolvePlaneLayout(FrameView& frame, size_t dataSize);
@@ -0,0 +1,80 @@
+#include "raw_frame.h"
+#include "block_free_list.h"
+
+namespace {
+	// Fields are little endian regardless of host byte order
+	uint64_t ReadLittleEndian(const unsigned char* p, size_t bytes) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) {
+			value |= static_cast<uint64_t>(p[i]) << (8 * i);
+		}
+		return value;
+	}
+
+	// Frames in flight on the raw channel of every session at once, with room to spare
+	constexpr size_t kMaxFreeRawFrames = 256;
+
+	BlockFreeList& RawFrameFreeList() {
+		// Never destroyed, as frames may still be freed during static destruction
+		static BlockFreeList* freeList = new BlockFreeList(sizeof(RawFrame), kMaxFreeRawFrames);
+		return *freeList;
+	}
+}
+
+void* RawFrame::operator new(size_t size) {
+	if (size != sizeof(RawFrame)) {
+		return ::operator new(size);
+	}
+	return RawFrameFreeList().Allocate();
+}
+
+void RawFrame::operator delete(void* frame, size_t size) {
+	if (size != sizeof(RawFrame)) {
+		::operator delete(frame);
+		return;
+	}
+	RawFrameFreeList().Deallocate(frame);
+}
+
+size_t PeekRawFrameHeaderSize(const char* prefix) {
+	return static_cast<size_t>(ReadLittleEndian(reinterpret_cast<const unsigned char*>(prefix) + 6, 2));
+}
+
+bool ParseRawFrameHeader(std::string_view data, RawFrameHeader& header) {
+	if (data.size() < kRawFrameHeaderSizeV1) {
+		return false;
+	}
+
+	// Version 1 headers end before the plane table
+	const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+	uint64_t version = ReadLittleEndian(p + 4, 2);
+	size_t expectedSize = version == 1 ? kRawFrameHeaderSizeV1 : kRawFrameHeaderSize;
+	if (ReadLittleEndian(p, 4) != kRawFrameMagic
+		|| version < 1 || version > kRawFrameVersion
+		|| ReadLittleEndian(p + 6, 2) != expectedSize
+		|| data.size() < expectedSize) {
+		return false;
+	}
+
+	header.targetWindow = ReadLittleEndian(p + 8, 8);
+	header.sequence = ReadLittleEndian(p + 16, 8);
+	header.width = static_cast<uint32_t>(ReadLittleEndian(p + 24, 4));
+	header.height = static_cast<uint32_t>(ReadLittleEndian(p + 28, 4));
+	header.strides[0] = static_cast<uint32_t>(ReadLittleEndian(p + 32, 4));
+	header.pixelFormat = static_cast<uint16_t>(ReadLittleEndian(p + 36, 2));
+	uint64_t flags = ReadLittleEndian(p + 38, 2);
+	header.isVideo = (flags & kRawFrameFlagVideo) != 0;
+	header.colorSpace.matrix = (flags & kRawFrameFlagBt709) ? YuvMatrix::Bt709 : YuvMatrix::Bt601;
+	header.colorSpace.fullRange = (flags & kRawFrameFlagFullRange) != 0;
+
+	if (version >= 2) {
+		for (size_t plane = 0; plane < kMaxPlanes; ++plane) {
+			header.planeOffsets[plane] = static_cast<uint32_t>(ReadLittleEndian(p + 40 + 4 * plane, 4));
+		}
+		header.strides[1] = static_cast<uint32_t>(ReadLittleEndian(p + 52, 4));
+		header.strides[2] = static_cast<uint32_t>(ReadLittleEndian(p + 56, 4));
+		header.compression = static_cast<TransportCompression>((flags & kRawFrameCompressionMask) >> kRawFrameCompressionShift);
+		header.rawPayloadSize = static_cast<uint32_t>(ReadLittleEndian(p + 60, 4));
+	}
+	return true;
+}
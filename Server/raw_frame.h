@@ -0,0 +1,72 @@
+#pragma once
+
+#include "frame_buffer_pool.h"
+#include "pixel_format.h"
+#include "transport_compression.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// ԭʼ֡ͨ (framing v2)ǰ׺λ 1ϢΪ֡ͷ + ظ
+// ز protobufֱӰѸؽյػ֡
+//
+// ֡ͷ (Сˣ汾 2  64 ֽڣ汾 1 ֻǰ 40 ֽ)
+//   0  uint32 magic         'WCRF'
+//   4  uint16 version       2
+//   6  uint16 headerSize    64
+//   8  uint64 targetWindow
+//  16  uint64 sequence      ͻ֡
+//  24  uint32 width
+//  28  uint32 height
+//  32  uint32 stride        ƽ 0 ֽ0 ʾ
+//  36  uint16 pixelFormat   ȡֵ pixel_format.h
+//  38  uint16 flags         bit0 = Ƶ֡bit1 = BT.709 ( BT.601)bit2 = full range
+//                          bit3-4 = صѹ㷨 (TransportCompression)
+//  40  uint32 planeOffsets[3]  ƽڸеƫƣɫƽƫƶΪ 0 ʾν
+//  52  uint32 strides[2]       ƽ 12 ֽ0 ʾ
+//  60  uint32 rawPayloadSize  ѹʱΪѹֽΪ 0
+constexpr uint32_t kRawFrameFlag = 0x80000000u;
+constexpr uint32_t kRawFrameMagic = 0x46524357u;
+constexpr uint16_t kRawFrameVersion = 2;
+constexpr size_t kRawFrameHeaderSizeV1 = 40;
+constexpr size_t kRawFrameHeaderSize = 64;
+// magicversion  headerSizeݴ˵֪֡ͷĳ
+constexpr size_t kRawFramePrefixSize = 8;
+constexpr uint16_t kRawFrameFlagVideo = 0x1;
+constexpr uint16_t kRawFrameFlagBt709 = 0x2;
+constexpr uint16_t kRawFrameFlagFullRange = 0x4;
+constexpr uint16_t kRawFrameCompressionShift = 3;
+constexpr uint16_t kRawFrameCompressionMask = 0x18;
+
+struct RawFrameHeader {
+	uint64_t targetWindow = 0;
+	uint64_t sequence = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t planeOffsets[kMaxPlanes] = {};
+	uint32_t strides[kMaxPlanes] = {};
+	uint16_t pixelFormat = 0;
+	bool isVideo = false;
+	YuvColorSpace colorSpace;
+	TransportCompression compression = TransportCompression::None;
+	uint32_t rawPayloadSize = 0;
+};
+
+// ֡ͷĳȣprefix ٺ kRawFramePrefixSize ֽ
+size_t PeekRawFrameHeaderSize(const char* prefix);
+
+// ֡ͷ (汾 1  2)magic/汾/Ȳʱ false
+bool ParseRawFrameHeader(std::string_view data, RawFrameHeader& header);
+
+// ͨԭʼ֡ͨյһ֡
+struct RawFrame {
+	RawFrameHeader header;
+	std::shared_ptr<FrameBuffer> pixels;
+	// ֡ͷ븺صֽذѹĴС (öԴΪ׼)
+	size_t messageSize = 0;
+
+	//  FrameItem һ֡ͷźڿйһ֡ʹ
+	static void* operator new(size_t size);
+	static void operator delete(void* frame, size_t size);
+};
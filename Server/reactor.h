@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// ӵ¼ص̵߳ãͬһӵĻصᲢִ
+class ConnectionHandler {
+public:
+	virtual ~ConnectionHandler() = default;
+
+	// ṩջֱдУ nullptr ʾϿ
+	virtual char* PrepareReceive(size_t& writable) = 0;
+
+	//  PrepareReceive صĻд bytes ֽڣ false ʾϿ
+	virtual bool OnReceived(size_t bytes) = 0;
+
+	// ѹرգ֮󲻻κλص
+	virtual void OnClosed() = 0;
+};
+
+// ¼ѭӿڣLinux » epollWindows »ɶ˿
+// ʹù̶̷߳
+class Reactor {
+public:
+	// ŶδޣԶ˳ʱ䲻ȡʱ֮Ͽ
+	static constexpr size_t kMaxQueuedSendBytes = 16 * 1024 * 1024;
+
+	// ӵص󣻷 nullptr ʾܾ
+	using AcceptHandler = std::function<std::shared_ptr<ConnectionHandler>(uint64_t connectionId, const std::string& peerAddress)>;
+
+	virtual ~Reactor() = default;
+
+	// ָ˿ڼ߳
+	virtual bool Start(uint16_t port, AcceptHandler acceptHandler) = 0;
+
+	// ֹ̲ͣ߳ر
+	virtual void Stop() = 0;
+
+	//  (̰߳ȫ)޷ĲڲŶ
+	// Ŷӵݽ kMaxQueuedSendBytes ʱϿӲ false
+	virtual bool Send(uint64_t connectionId, const char* data, size_t size) = 0;
+
+	// Ͽ (̰߳ȫ)OnClosed ߳ϵ
+	virtual void Close(uint64_t connectionId) = 0;
+};
+
+// ǰƽ̨ ReactorioThreads Ϊ߳
+std::unique_ptr<Reactor> CreateReactor(size_t ioThreads);
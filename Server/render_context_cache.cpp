@@ -0,0 +1,168 @@
+#include "render_context_cache.h"
+
+namespace {
+	void Accumulate(PresentCounters& total, const PresentCounters& counters) {
+		total.framesSkipped += counters.framesSkipped;
+		total.tilesPresented += counters.tilesPresented;
+		total.tilesSkipped += counters.tilesSkipped;
+	}
+}
+
+RenderContextCache::RenderContextCache(RenderTargetFactory factory)
+	: factory(std::move(factory)) {
+}
+
+std::shared_ptr<RenderContextCache::Entry> RenderContextCache::EntryFor(uint64_t targetWindow) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& entry = entries[targetWindow];
+	if (!entry) {
+		entry = std::make_shared<Entry>();
+	}
+	return entry;
+}
+
+std::shared_ptr<RenderTarget> RenderContextCache::Acquire(uint64_t targetWindow) {
+	while (true) {
+		std::shared_ptr<Entry> entry = EntryFor(targetWindow);
+		// Only callers for the same window wait here, and each window presents on one thread
+		std::lock_guard<std::mutex> lock(entry->mutex);
+		if (entry->removed) {
+			// Invalidated or pruned between the lookup and the lock
+			continue;
+		}
+
+		if (entry->target) {
+			int width = 0;
+			int height = 0;
+			if (!entry->target->IsAlive()) {
+				counters.destroyed++;
+			}
+			else if (!entry->target->GetClientSize(width, height)
+				|| width != entry->clientWidth || height != entry->clientHeight) {
+				counters.resized++;
+			}
+			else {
+				counters.hits++;
+				return entry->target;
+			}
+			RemoveLocked(targetWindow, *entry);
+			continue;
+		}
+
+		counters.misses++;
+		// Misses are rare, use them to drop contexts of windows that went away meanwhile
+		PruneDeadExcept(entry.get());
+
+		// Creating the DC and bitmap holds up no other window
+		std::shared_ptr<RenderTarget> target = factory();
+		if (!target || !target->Initialize(targetWindow)
+			|| !target->GetClientSize(entry->clientWidth, entry->clientHeight)) {
+			counters.initFailures++;
+			RemoveLocked(targetWindow, *entry);
+			return nullptr;
+		}
+		entry->target = target;
+		return target;
+	}
+}
+
+void RenderContextCache::RemoveLocked(uint64_t targetWindow, Entry& entry) {
+	entry.removed = true;
+	std::shared_ptr<RenderTarget> target = std::move(entry.target);
+	PresentCounters present;
+	if (target) {
+		present = target->GetPresentCounters();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(targetWindow);
+	if (it != entries.end() && it->second.get() == &entry) {
+		entries.erase(it);
+	}
+	Accumulate(retired, present);
+}
+
+std::vector<std::pair<uint64_t, std::shared_ptr<RenderContextCache::Entry>>> RenderContextCache::Snapshot() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::vector<std::pair<uint64_t, std::shared_ptr<Entry>>>(entries.begin(), entries.end());
+}
+
+void RenderContextCache::Invalidate(uint64_t targetWindow) {
+	std::shared_ptr<Entry> entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(targetWindow);
+		if (it == entries.end()) {
+			return;
+		}
+		entry = it->second;
+	}
+
+	std::lock_guard<std::mutex> lock(entry->mutex);
+	if (entry->removed) {
+		return;
+	}
+	if (entry->target) {
+		counters.invalidated++;
+	}
+	RemoveLocked(targetWindow, *entry);
+}
+
+void RenderContextCache::PruneDead() {
+	PruneDeadExcept(nullptr);
+}
+
+void RenderContextCache::PruneDeadExcept(const Entry* held) {
+	for (const auto& item : Snapshot()) {
+		Entry& entry = *item.second;
+		if (&entry == held) {
+			continue;
+		}
+		// An entry in use is checked by its user anyway
+		std::unique_lock<std::mutex> lock(entry.mutex, std::try_to_lock);
+		if (lock.owns_lock() && !entry.removed && entry.target && !entry.target->IsAlive()) {
+			counters.destroyed++;
+			RemoveLocked(item.first, entry);
+		}
+	}
+}
+
+void RenderContextCache::Clear() {
+	for (const auto& item : Snapshot()) {
+		std::lock_guard<std::mutex> lock(item.second->mutex);
+		if (!item.second->removed) {
+			RemoveLocked(item.first, *item.second);
+		}
+	}
+}
+
+size_t RenderContextCache::Size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+RenderContextCache::Stats RenderContextCache::GetStats() const {
+	Stats result;
+	result.hits = counters.hits.load();
+	result.misses = counters.misses.load();
+	result.initFailures = counters.initFailures.load();
+	result.destroyed = counters.destroyed.load();
+	result.resized = counters.resized.load();
+	result.invalidated = counters.invalidated.load();
+
+	std::vector<std::shared_ptr<RenderTarget>> targets;
+	for (const auto& item : Snapshot()) {
+		std::lock_guard<std::mutex> lock(item.second->mutex);
+		if (item.second->target) {
+			targets.push_back(item.second->target);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		result.present = retired;
+	}
+	for (const auto& target : targets) {
+		Accumulate(result.present, target->GetPresentCounters());
+	}
+	return result;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "render_target.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Ŀ괰ھѳʼȾĿ
+// ֻڴ١ͻߴ仯 StopRender ʱ³ʼ
+// ̰߳ȫصȾĿʧЧԿɱ߰ȫʹ
+// ÿڵĿһʼ ( DC λͼ) ÿ֡Ĵߴֻͬһڵĵû⣬
+// ڵĳ̻߳ȴűֻڲҡƳĿʱݳ
+class RenderContextCache {
+public:
+	struct Stats {
+		uint64_t hits = 0;          // ֱӸѳʼ
+		uint64_t misses = 0;        // Ҫ½ʼ
+		uint64_t initFailures = 0;  // ʼʧ
+		uint64_t destroyed = 0;     // 򴰿ٶʧЧ
+		uint64_t resized = 0;       // ͻߴ仯ʧЧ
+		uint64_t invalidated = 0;   // ʽʧЧ (StopRender)
+		PresentCounters present;    // ȾĿ (ʧЧ) ͼȽʡµĳ
+	};
+
+	explicit RenderContextCache(RenderTargetFactory factory);
+
+	// ȡڵȾĿ꣬δʱʼʧܷ nullptr
+	std::shared_ptr<RenderTarget> Acquire(uint64_t targetWindow);
+
+	// ʹڵȾĿʧЧ
+	void Invalidate(uint64_t targetWindow);
+
+	// ƳдٵĿ
+	void PruneDead();
+
+	// ջ
+	void Clear();
+
+	size_t Size() const;
+	Stats GetStats() const;
+
+private:
+	struct Entry {
+		std::mutex mutex;
+		std::shared_ptr<RenderTarget> target;
+		int clientWidth = 0;
+		int clientHeight = 0;
+		// ѴӱƳĵ÷²
+		bool removed = false;
+	};
+
+	struct Counters {
+		std::atomic<uint64_t> hits{ 0 };
+		std::atomic<uint64_t> misses{ 0 };
+		std::atomic<uint64_t> initFailures{ 0 };
+		std::atomic<uint64_t> destroyed{ 0 };
+		std::atomic<uint64_t> resized{ 0 };
+		std::atomic<uint64_t> invalidated{ 0 };
+	};
+
+	RenderTargetFactory factory;
+	//  entries  retiredĿʱȡ֮
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<Entry>> entries;
+	Counters counters;
+
+	// ƳȾĿĳͳ
+	PresentCounters retired;
+
+	// һ봰ڵĿ
+	std::shared_ptr<Entry> EntryFor(uint64_t targetWindow);
+	// ÷סĿ heldʹõĿҲ
+	void PruneDeadExcept(const Entry* held);
+	// ڳĿʱãƳ (ʱ)ۼͳƲͷȾĿ
+	void RemoveLocked(uint64_t targetWindow, Entry& entry);
+	std::vector<std::pair<uint64_t, std::shared_ptr<Entry>>> Snapshot() const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// ֲеһimage Ŀ߼С(x, y) Ϊ֡еλ
+struct DirtyRect {
+	size_t x = 0;
+	size_t y = 0;
+	FrameView image;
+};
+
+// ͼȽϺʡµĳ֣֡ͼ
+struct PresentCounters {
+	uint64_t framesSkipped = 0;    // һ֡ͬûг
+	uint64_t tilesPresented = 0;
+	uint64_t tilesSkipped = 0;     // δ仯ûгֵͼ
+};
+
+// ȾĿӿڣGDI ڴ˶ʵָýӿ
+class RenderTarget {
+public:
+	virtual ~RenderTarget() = default;
+
+	// Ŀ괰ڲԴ
+	virtual bool Initialize(uint64_t targetWindow) = 0;
+
+	// Ŀ괰ǷȻ
+	virtual bool IsAlive() const = 0;
+
+	// ѯĿ괰ڵǰĿͻߴ
+	virtual bool GetClientSize(int& width, int& height) const = 0;
+
+	// ȾͼƬ֡ƽ沼 ResolvePlaneLayout ȫ
+	virtual bool RenderImageFrame(const FrameView& image) = 0;
+
+	// ȾƵ֡
+	virtual bool RenderVideoFrame(const FrameView& frame) = 0;
+
+	// дһ֡Ļ沢ֻЩȷ֡
+	// һ֡ĳߴ粻 frameWidth x frameHeight (ûл) ʱ false
+	virtual bool RenderDirtyRects(size_t frameWidth, size_t frameHeight, const std::vector<DirtyRect>& rects) = 0;
+
+	// Ⱦ
+	virtual void Clear() = 0;
+
+	// ֵͳƣ̶߳ȡ
+	virtual PresentCounters GetPresentCounters() const = 0;
+};
+
+// ȾĿĹ
+using RenderTargetFactory = std::function<std::unique_ptr<RenderTarget>()>;
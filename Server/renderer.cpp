@@ -1,17 +1,30 @@
 #include "renderer.h"
+#include "pixel_convert.h"
 #include <stdexcept>
 #include <iostream>
 #include <iomanip>
 #include <windows.h>
 
-Renderer::Renderer()
+namespace {
+	// The target window repaints itself now and then, over what was drawn on it;
+	// the whole frame is presented again at least this often
+	constexpr auto kFullPresentInterval = std::chrono::seconds(1);
+}
+
+Renderer::Renderer(const ScaleOptions& scaleOptions, WorkStealingPool* pool)
 	: targetWindow(nullptr)
 	, windowDC(nullptr)
 	, memoryDC(nullptr)
 	, bitmap(nullptr)
-	, currentWidth(0)
-	, currentHeight(0)
-	, gdiplusToken(0) {
+	, bitmapBits(nullptr)
+	, frameWidth(0)
+	, frameHeight(0)
+	, clientWidth(0)
+	, clientHeight(0)
+	, pool(pool)
+	, scaler(scaleOptions, DetectSimdLevel(), pool)
+	, gdiplusToken(0)
+	, tiles(DetectSimdLevel(), pool) {
 
 	// Initialize GDI+
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
@@ -32,7 +45,8 @@ Renderer::~Renderer() {
 	}
 }
 
-bool Renderer::Initialize(HWND targetWindow) {
+bool Renderer::Initialize(uint64_t targetWindowHandle) {
+	HWND targetWindow = reinterpret_cast<HWND>(targetWindowHandle);
 	if (!targetWindow || !IsWindow(targetWindow)) {
 		std::cout << "Invalid window handle" << std::endl;
 		return false;
@@ -79,84 +93,131 @@ bool Renderer::Initialize(HWND targetWindow) {
 		AttachThreadInput(currentThreadID, targetThreadID, FALSE);
 	}
 
+	// The client size is cached for the lifetime of this context; a resize re-initializes it
+	if (!GetClientSize(clientWidth, clientHeight)) {
+		std::cout << "Failed to get client rect" << std::endl;
+		return false;
+	}
+
 	std::cout << "Renderer initialization completed, target window: 0x"
 		<< std::hex << reinterpret_cast<uintptr_t>(targetWindow)
 		<< std::dec << std::endl;
 	return true;
 }
 
-bool Renderer::CreateCompatibleBitmap(size_t width, size_t height) {
-	if (!windowDC || !memoryDC) {
+bool Renderer::IsAlive() const {
+	return targetWindow && IsWindow(targetWindow);
+}
+
+bool Renderer::GetClientSize(int& width, int& height) const {
+	RECT rect;
+	if (!targetWindow || !GetClientRect(targetWindow, &rect)) {
 		return false;
 	}
+	width = rect.right - rect.left;
+	height = rect.bottom - rect.top;
+	return true;
+}
 
-	// If dimensions haven't changed and bitmap already exists, just return
-	if (bitmap && width == currentWidth && height == currentHeight) {
-		return true;
+bool Renderer::CreateClientBitmap() {
+	if (!windowDC || !memoryDC) {
+		return false;
 	}
 
-	// Delete the old bitmap
+	// The client size is fixed for the lifetime of this context, and so is the bitmap
 	if (bitmap) {
-		DeleteObject(bitmap);
-		bitmap = nullptr;
+		return true;
+	}
+	if (clientWidth <= 0 || clientHeight <= 0) {
+		return false;
 	}
 
-	// Create a new bitmap
-	bitmap = ::CreateCompatibleBitmap(windowDC, static_cast<int>(width), static_cast<int>(height));
-	if (!bitmap) {
+	// A top-down 32-bit DIB section of the client's size: frames are scaled straight into its
+	// pixels, and presenting is a 1:1 BitBlt with no stretching in GDI
+	BITMAPINFO bmi = { 0 };
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = clientWidth;
+	bmi.bmiHeader.biHeight = -clientHeight; // Negative indicates top-down DIB
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	void* bits = nullptr;
+	bitmap = CreateDIBSection(memoryDC, &bmi, DIB_RGB_COLORS, &bits, nullptr, 0);
+	if (!bitmap || !bits) {
+		if (bitmap) {
+			DeleteObject(bitmap);
+			bitmap = nullptr;
+		}
 		return false;
 	}
+	bitmapBits = static_cast<uint8_t*>(bits);
 
 	// Select the bitmap into the memory DC
 	SelectObject(memoryDC, bitmap);
-	currentWidth = width;
-	currentHeight = height;
-
 	return true;
 }
 
-bool Renderer::RenderImageFrame(const void* imageData, size_t width, size_t height) {
+bool Renderer::IsDirect() const {
+	return frameWidth == static_cast<size_t>(clientWidth) && frameHeight == static_cast<size_t>(clientHeight);
+}
+
+bool Renderer::RenderImageFrame(const FrameView& image) {
 	if (!windowDC || !memoryDC || !targetWindow) {
 		std::cout << "Renderer not properly initialized" << std::endl;
 		return false;
 	}
 
-	// Create or update the compatible bitmap
-	if (!CreateCompatibleBitmap(width, height)) {
-		std::cout << "Failed to create compatible bitmap, width = " << width << " ,height = " << height << std::endl;
+	size_t width = image.width;
+	size_t height = image.height;
+
+	if (!CreateClientBitmap()) {
+		std::cout << "Failed to create frame bitmap, width = " << clientWidth << " ,height = " << clientHeight << std::endl;
 		return false;
 	}
 
-	// Copy imageData to bitmap (assuming imageData is in RGB24 format)
-	BITMAPINFO bmi = { 0 };
-	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-	bmi.bmiHeader.biWidth = static_cast<LONG>(width);
-	bmi.bmiHeader.biHeight = -static_cast<LONG>(height); // Negative indicates top-down DIB
-	bmi.bmiHeader.biPlanes = 1;
-	bmi.bmiHeader.biBitCount = 24;
-	bmi.bmiHeader.biCompression = BI_RGB;
+	bool resized = width != frameWidth || height != frameHeight;
+	frameWidth = width;
+	frameHeight = height;
 
-	if (!SetDIBits(windowDC, bitmap, 0, height, imageData, &bmi, DIB_RGB_COLORS)) {
-		std::cout << "Failed to copy image data, width = " << width << " ,height = " << height << std::endl;
+	// GDI may still be reading the previous frame from the bitmap
+	GdiFlush();
+	uint8_t* pixels = bitmapBits;
+	if (!IsDirect()) {
+		frame.resize(width * height * 4);
+		pixels = frame.data();
+	}
+	if (!ConvertFrameToBgra(pool, image, pixels, width * 4)) {
+		std::cout << "Failed to decode image" << std::endl;
+		// Neither buffer holds a whole frame any more
+		frameWidth = 0;
+		frameHeight = 0;
 		return false;
 	}
 
-	// Get the client area size of the window
-	RECT rect;
-	GetClientRect(targetWindow, &rect);
-	int windowWidth = rect.right - rect.left;
-	int windowHeight = rect.bottom - rect.top;
-
-	// Set stretch mode
-	SetStretchBltMode(windowDC, HALFTONE);
-	SetBrushOrgEx(windowDC, 0, 0, nullptr);
-
-	// Stretch-blit the image from memory DC to the window
-	bool success = StretchBlt(
-		windowDC, 0, 0, windowWidth, windowHeight,
-		memoryDC, 0, 0, static_cast<int>(width), static_cast<int>(height),
-		SRCCOPY
-	) != 0;
+	auto now = std::chrono::steady_clock::now();
+	if (resized || now - lastFullPresent >= kFullPresentInterval) {
+		tiles.Reset();
+		lastFullPresent = now;
+	}
+
+	// Only tiles that differ from the previous frame are scaled and blitted; an identical frame
+	// is not presented at all. Past half of the tiles one pass over the whole frame is cheaper.
+	changedRegions.clear();
+	size_t changedTiles = tiles.Compare(pixels, width * 4, width, height, changedRegions);
+	bool success = true;
+	if (changedTiles * 2 >= tiles.TileCount()) {
+		success = PresentFrame();
+	}
+	else {
+		for (const TileTracker::Region& region : changedRegions) {
+			success = PresentRegion(region.x, region.y, region.width, region.height) && success;
+		}
+	}
+	if (!success) {
+		// The window may not show what the tiles say it does
+		tiles.Reset();
+	}
 
 	if (success) {
 		std::cout << "Image rendered successfully" << std::endl;
@@ -167,9 +228,109 @@ bool Renderer::RenderImageFrame(const void* imageData, size_t width, size_t heig
 	return success;
 }
 
-bool Renderer::RenderVideoFrame(const void* frameData, size_t width, size_t height) {
-	// This implementation is similar to RenderImageFrame; actual implementation depends on the video frame data format
-	return RenderImageFrame(frameData, width, height);
+bool Renderer::RenderVideoFrame(const FrameView& video) {
+	// Compressed frames decode whole anyway, and frames of the client's size need no scaling
+	if (IsCompressedFormat(video.format)
+		|| (video.width == static_cast<size_t>(clientWidth) && video.height == static_cast<size_t>(clientHeight))) {
+		return RenderImageFrame(video);
+	}
+	if (!windowDC || !memoryDC || !targetWindow) {
+		std::cout << "Renderer not properly initialized" << std::endl;
+		return false;
+	}
+	if (!CreateClientBitmap()) {
+		std::cout << "Failed to create frame bitmap, width = " << clientWidth << " ,height = " << clientHeight << std::endl;
+		return false;
+	}
+
+	// Rows are converted and scaled in one pass straight into the bitmap, with no full-size BGRA
+	// frame in between. Packed RGB frames are still kept whole, since region updates patch them;
+	// YUV frames only ever come from video, which does not send regions.
+	bool retain = !IsYuvFormat(video.format);
+	if (retain) {
+		frame.resize(video.width * video.height * 4);
+	}
+	GdiFlush();
+	bool converted = scaler.ScaleFrame(video, retain ? frame.data() : nullptr, video.width * 4,
+		bitmapBits, static_cast<size_t>(clientWidth) * 4, clientWidth, clientHeight);
+	frameWidth = converted && retain ? video.width : 0;
+	frameHeight = converted && retain ? video.height : 0;
+	if (!converted) {
+		std::cout << "Failed to decode video frame" << std::endl;
+		return false;
+	}
+
+	// Video changes nearly everywhere each frame, so it is presented whole without comparing tiles;
+	// the tiles no longer describe the window after it
+	tiles.Reset();
+	lastFullPresent = std::chrono::steady_clock::now();
+	return BitBlt(windowDC, 0, 0, clientWidth, clientHeight, memoryDC, 0, 0, SRCCOPY) != 0;
+}
+
+bool Renderer::RenderDirtyRects(size_t frameWidth, size_t frameHeight, const std::vector<DirtyRect>& rects) {
+	if (!windowDC || !memoryDC || !targetWindow) {
+		std::cout << "Renderer not properly initialized" << std::endl;
+		return false;
+	}
+
+	// The regions patch the last full frame; a new context has none yet
+	if (!bitmap || this->frameWidth == 0 || frameWidth != this->frameWidth || frameHeight != this->frameHeight) {
+		std::cout << "No frame to apply the region update to" << std::endl;
+		return false;
+	}
+
+	GdiFlush();
+	uint8_t* pixels = IsDirect() ? bitmapBits : frame.data();
+	size_t stride = frameWidth * 4;
+	size_t dirtyArea = 0;
+	for (const DirtyRect& rect : rects) {
+		if (!ConvertFrameToBgra(rect.image, pixels + rect.y * stride + rect.x * 4, stride)) {
+			std::cout << "Failed to decode region" << std::endl;
+			return false;
+		}
+		dirtyArea += rect.image.width * rect.image.height;
+		tiles.Invalidate(rect.x, rect.y, rect.image.width, rect.image.height);
+	}
+
+	// Once most of the frame changed, one pass is cheaper than many small ones
+	if (dirtyArea * 2 >= frameWidth * frameHeight) {
+		return PresentFrame();
+	}
+
+	bool success = true;
+	for (const DirtyRect& rect : rects) {
+		success = PresentRegion(rect.x, rect.y, rect.image.width, rect.image.height) && success;
+	}
+	return success;
+}
+
+bool Renderer::PresentFrame() {
+	if (!IsDirect()) {
+		scaler.Scale(frame.data(), frameWidth * 4, frameWidth, frameHeight,
+			bitmapBits, static_cast<size_t>(clientWidth) * 4, clientWidth, clientHeight);
+	}
+	return BitBlt(windowDC, 0, 0, clientWidth, clientHeight, memoryDC, 0, 0, SRCCOPY) != 0;
+}
+
+bool Renderer::PresentRegion(size_t x, size_t y, size_t width, size_t height) {
+	ImageScaler::Rect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.width = width;
+	rect.height = height;
+	if (!IsDirect()) {
+		// The scaler widens the region by the filter's reach, so its edges match a whole-frame pass
+		rect = scaler.ScaleRegion(frame.data(), frameWidth * 4, frameWidth, frameHeight,
+			bitmapBits, static_cast<size_t>(clientWidth) * 4, clientWidth, clientHeight, rect);
+		if (rect.width == 0 || rect.height == 0) {
+			return true;
+		}
+	}
+	return BitBlt(
+		windowDC, static_cast<int>(rect.x), static_cast<int>(rect.y), static_cast<int>(rect.width), static_cast<int>(rect.height),
+		memoryDC, static_cast<int>(rect.x), static_cast<int>(rect.y),
+		SRCCOPY
+	) != 0;
 }
 
 void Renderer::Clear() {
@@ -178,12 +339,23 @@ void Renderer::Clear() {
 		GetClientRect(targetWindow, &rect);
 		FillRect(windowDC, &rect, (HBRUSH)GetStockObject(BLACK_BRUSH));
 	}
+	tiles.Reset();
+}
+
+PresentCounters Renderer::GetPresentCounters() const {
+	const TileTracker::Counters& tileCounters = tiles.GetCounters();
+	PresentCounters result;
+	result.framesSkipped = tileCounters.framesSkipped.load();
+	result.tilesPresented = tileCounters.tilesChanged.load();
+	result.tilesSkipped = tileCounters.tilesSkipped.load();
+	return result;
 }
 
 void Renderer::Cleanup() {
 	if (bitmap) {
 		DeleteObject(bitmap);
 		bitmap = nullptr;
+		bitmapBits = nullptr;
 	}
 
 	if (memoryDC) {
@@ -197,8 +369,12 @@ void Renderer::Cleanup() {
 	}
 
 	targetWindow = nullptr;
-	currentWidth = 0;
-	currentHeight = 0;
+	tiles.Reset();
+	frame.clear();
+	frameWidth = 0;
+	frameHeight = 0;
+	clientWidth = 0;
+	clientHeight = 0;
 }
 
 std::wstring Renderer::StringToWString(const std::string& str) {
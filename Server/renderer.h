@@ -1,6 +1,11 @@
 #pragma once
 
+#include "image_scaler.h"
+#include "render_target.h"
+#include "tile_tracker.h"
+#include <chrono>
 #include <string>
+#include <vector>
 #define GDIPVER 0x0110
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -8,34 +13,66 @@
 #include <gdiplus.h>
 #pragma comment(lib, "gdiplus.lib")
 
-class Renderer {
+//  GDI ĴȾĿ
+class Renderer : public RenderTarget {
 public:
-	Renderer();
-	~Renderer();
+	// pool Ϊʱһ֡תͼȽϲϲִ
+	explicit Renderer(const ScaleOptions& scaleOptions = ScaleOptions(), WorkStealingPool* pool = nullptr);
+	~Renderer() override;
 
 	// ʼȾ
-	bool Initialize(HWND targetWindow);
+	bool Initialize(uint64_t targetWindow) override;
 
-	// ȾͼƬͼƬΪݣҪʵ RenderImageFrame ӿڣ
-	bool RenderImageFrame(const void* imageData, size_t width, size_t height);
+	// Ŀ괰ǷȻ
+	bool IsAlive() const override;
 
-	// ȾƵ֡
-	bool RenderVideoFrame(const void* frameData, size_t width, size_t height);
+	// ѯĿ괰ڵǰĿͻߴ
+	bool GetClientSize(int& width, int& height) const override;
+
+	// ȾͼƬת (ѹʽ) Ϊ BGRAΪͻߴ 1:1 Ƶ
+	// ֻһ֡ȱ仯ͼ飬ȫͬ֡
+	bool RenderImageFrame(const FrameView& image) override;
+
+	// ȾƵ֡Ҫŵδѹ֡תŽλͼ֡ BGRAҲȽͼ
+	bool RenderVideoFrame(const FrameView& video) override;
+
+	// ֲ£дһֻ֡ŲӰĲ
+	bool RenderDirtyRects(size_t frameWidth, size_t frameHeight, const std::vector<DirtyRect>& rects) override;
 
 	// Ⱦ
-	void Clear();
+	void Clear() override;
+
+	PresentCounters GetPresentCounters() const override;
 
 private:
 	HWND targetWindow;
 	HDC windowDC;
 	HDC memoryDC;
 	HBITMAP bitmap;
-	size_t currentWidth;
-	size_t currentHeight;
+	uint8_t* bitmapBits;   // DIB section أͻߴ 32 λ BGRA ϶
+	std::vector<uint8_t> frame;   // ͻߴ粻ͬ֡תŵλͼ
+	size_t frameWidth;
+	size_t frameHeight;
+	int clientWidth;
+	int clientHeight;
+	WorkStealingPool* pool;
+	ImageScaler scaler;
 	ULONG_PTR gdiplusToken;
+	TileTracker tiles;
+	std::vector<TileTracker::Region> changedRegions;
+	std::chrono::steady_clock::time_point lastFullPresent;
+
+	//  () ͻߴ 32 λ DIB section λͼ
+	bool CreateClientBitmap();
+
+	// ֡ͻߴͬʱֱתλͼ
+	bool IsDirect() const;
+
+	// ֡ ( letterbox ĺڱ) ͻ
+	bool PresentFrame();
 
-	// ݵλͼ
-	bool CreateCompatibleBitmap(size_t width, size_t height);
+	// ֻŲ֡һӰĲ
+	bool PresentRegion(size_t x, size_t y, size_t width, size_t height);
 
 	// Դ
 	void Cleanup();
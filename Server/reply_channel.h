@@ -0,0 +1,23 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+class StreamAcknowledger;
+
+// ظͨ׶ͨӦضӦĿͻ
+class ReplyChannel {
+public:
+	virtual ~ReplyChannel() = default;
+
+	// һǰ׺Ϣ
+	virtual bool SendMessage(const std::string& message) = 0;
+
+	// ʽģʽȷ״̬δʽģʽʱΪ
+	// ֻڸûỰĽ׶Ϸʣ
+	const std::shared_ptr<StreamAcknowledger>& Stream() const { return stream; }
+	void SetStream(std::shared_ptr<StreamAcknowledger> value) { stream = std::move(value); }
+
+private:
+	std::shared_ptr<StreamAcknowledger> stream;
+};
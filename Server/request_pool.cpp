@@ -0,0 +1,180 @@
+#include "request_pool.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace {
+	using google::protobuf::internal::WireFormatLite;
+
+	// Number of the first length-delimited field at the top level of a serialized message, narrowing
+	// data and size to its bytes. 0 when there is none or the data ends early; the parse then fails
+	// or starts from a cleared message anyway.
+	int FirstEmbeddedMessage(const char*& data, size_t& size) {
+		google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(data), static_cast<int>(size));
+		while (uint32_t tag = input.ReadTag()) {
+			if (WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+				uint32_t length = 0;
+				if (!input.ReadVarint32(&length)) {
+					return 0;
+				}
+				size_t position = static_cast<size_t>(input.CurrentPosition());
+				if (length > size - position) {
+					return 0;
+				}
+				data += position;
+				size = length;
+				return WireFormatLite::GetTagFieldNumber(tag);
+			}
+			if (!WireFormatLite::SkipField(&input, tag)) {
+				return 0;
+			}
+		}
+		return 0;
+	}
+
+	// Clears a message but keeps the member set in its oneof allocated, cleared too; its strings and
+	// repeated fields keep their capacity
+	template <typename Message, typename Member>
+	void ClearKeeping(Message& message, Member* (Message::*release)(), void (Message::*setAllocated)(Member*)) {
+		Member* member = (message.*release)();
+		member->Clear();
+		message.Clear();
+		(message.*setAllocated)(member);
+	}
+}
+
+RequestPool::RequestPool(size_t maxRequests, size_t maxRetainedBytes)
+	: maxRequests(maxRequests)
+	, maxRetainedBytes(maxRetainedBytes)
+	, kept(0) {
+}
+
+std::shared_ptr<windowcaster::ClientRequest> RequestPool::Parse(const char* data, size_t size) {
+	// A pooled request would keep the memory of a large message for as long as the pool lives. Its
+	// strings never grow beyond the message, so anything below the cap keeps pooled requests below it.
+	if (size > maxRetainedBytes) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.oversized++;
+		}
+		auto request = std::make_shared<windowcaster::ClientRequest>();
+		if (!request->ParseFromArray(data, static_cast<int>(size))) {
+			return nullptr;
+		}
+		return request;
+	}
+
+	Shape shape = PeekShape(data, size);
+	std::shared_ptr<windowcaster::ClientRequest> request;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// Any idle request will do, but one that last held the same kind of message keeps its memory
+		size_t idle = requests.size();
+		for (size_t i = 0; i < requests.size(); ++i) {
+			if (requests[i].use_count() != 1) {
+				continue;
+			}
+			if (idle == requests.size()) {
+				idle = i;
+			}
+			if (ShapeOf(*requests[i]) == shape) {
+				idle = i;
+				break;
+			}
+		}
+		if (idle < requests.size()) {
+			request = requests[idle];
+			stats.reused++;
+		}
+		else {
+			request = std::make_shared<windowcaster::ClientRequest>();
+			stats.created++;
+			if (requests.size() < maxRequests) {
+				requests.push_back(request);
+			}
+		}
+	}
+	// The last frame that held the request let go with a release; see its writes before reusing it
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (Prepare(*request, shape)) {
+		kept++;
+	}
+	// Messages are capped well below INT_MAX by the assembler
+	google::protobuf::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(data), static_cast<int>(size));
+	if (!request->MergeFromCodedStream(&input) || !input.ConsumedEntireMessage()) {
+		return nullptr;
+	}
+	return request;
+}
+
+RequestPool::Stats RequestPool::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Stats result = stats;
+	result.kept = kept.load();
+	result.requests = requests.size();
+	return result;
+}
+
+RequestPool::Shape RequestPool::PeekShape(const char* data, size_t size) {
+	Shape shape;
+	shape.request = FirstEmbeddedMessage(data, size);
+	if (shape.request == windowcaster::ClientRequest::kRenderCommand) {
+		// Target window and sequence are varints; the only embedded messages are the content
+		shape.content = FirstEmbeddedMessage(data, size);
+	}
+	return shape;
+}
+
+RequestPool::Shape RequestPool::ShapeOf(const windowcaster::ClientRequest& request) {
+	Shape shape;
+	shape.request = request.request_case();
+	if (request.has_render_command()) {
+		shape.content = request.render_command().content_case();
+	}
+	return shape;
+}
+
+bool RequestPool::Prepare(windowcaster::ClientRequest& request, const Shape& shape) {
+	// Merging into a kept member equals parsing from scratch only because the data sets that member
+	if (shape.request == 0 || !(ShapeOf(request) == shape)) {
+		request.Clear();
+		return false;
+	}
+
+	using windowcaster::ClientRequest;
+	using windowcaster::RenderCommand;
+	switch (shape.request) {
+	case ClientRequest::kRenderCommand: {
+		RenderCommand* command = request.release_render_command();
+		switch (shape.content) {
+		case RenderCommand::kImage:
+			ClearKeeping(*command, &RenderCommand::release_image, &RenderCommand::set_allocated_image);
+			break;
+		case RenderCommand::kVideo:
+			ClearKeeping(*command, &RenderCommand::release_video, &RenderCommand::set_allocated_video);
+			break;
+		case RenderCommand::kEncodedVideo:
+			ClearKeeping(*command, &RenderCommand::release_encoded_video, &RenderCommand::set_allocated_encoded_video);
+			break;
+		case RenderCommand::kRegionUpdate:
+			ClearKeeping(*command, &RenderCommand::release_region_update, &RenderCommand::set_allocated_region_update);
+			break;
+		case RenderCommand::kCachedImage:
+			ClearKeeping(*command, &RenderCommand::release_cached_image, &RenderCommand::set_allocated_cached_image);
+			break;
+		default:
+			command->Clear();
+			break;
+		}
+		request.Clear();
+		request.set_allocated_render_command(command);
+		return true;
+	}
+	case ClientRequest::kMediaUpload:
+		ClearKeeping(request, &ClientRequest::release_media_upload, &ClientRequest::set_allocated_media_upload);
+		return true;
+	default:
+		request.Clear();
+		return false;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "windowcaster.pb.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ɸõ ClientRequestϢʱÿ½ص bytes ֶϴνµڴ
+// protobuf  oneof ʱͷеϢԽǰлв鿴ȾݸĸԱ
+// ϴγеͬʱֻЩϢͷţϺϲ¶ ParseFromArray ͬ
+// 󱻴֡ (Ϊصĳ) ʱᱻãȫͷźŻص
+// ÿϢڴ棬Գ maxRetainedBytes Ϣ꼴ͷŵĶУ
+// ÿռõڴ治ޣ maxRequests ʱ½Ķͬ꼴ͷ
+// maxRequests ˰ã kRequestsPerParseThread
+// ̰߳ȫ
+class RequestPool {
+public:
+	struct Stats {
+		uint64_t reused = 0;     // ȡ˳еĿж
+		uint64_t created = 0;    // ûпж½
+		uint64_t kept = 0;       // гԱϴͬϢַԱ
+		uint64_t oversized = 0;  // ϢޣصĶ
+		size_t requests = 0;     // еĶ
+	};
+
+	// 㹻һ֡ 4K BGRA ͼ
+	static constexpr size_t kDefaultRetainedBytes = 40 * 1024 * 1024;
+
+	// ÿ߳ͬʱõĶڽġеȴֵڳֵĸһ
+	static constexpr size_t kRequestsPerParseThread = 3;
+
+	explicit RequestPool(size_t maxRequests, size_t maxRetainedBytes = kDefaultRetainedBytes);
+
+	// һϢʱ nullptr
+	std::shared_ptr<windowcaster::ClientRequest> Parse(const char* data, size_t size);
+
+	Stats GetStats() const;
+
+private:
+	// Ⱦ oneof еĳԱ (ֶκ)0 ʾû
+	struct Shape {
+		int request = 0;
+		int content = 0;
+
+		bool operator==(const Shape& other) const { return request == other.request && content == other.content; }
+	};
+
+	size_t maxRequests;
+	size_t maxRetainedBytes;
+	mutable std::mutex mutex;
+	// ֻس (use_count Ϊ 1) Ķǿе
+	std::vector<std::shared_ptr<windowcaster::ClientRequest>> requests;
+	Stats stats;
+	std::atomic<uint64_t> kept;
+
+	static Shape PeekShape(const char* data, size_t size);
+	static Shape ShapeOf(const windowcaster::ClientRequest& request);
+	// shape ϴγеͬʱЩϢǷ
+	static bool Prepare(windowcaster::ClientRequest& request, const Shape& shape);
+};
@@ -0,0 +1,365 @@
+#include "screen_codec.h"
+#include "pixel_convert.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	constexpr size_t kTilePixels = kScreenTileSize * kScreenTileSize;
+	constexpr size_t kMaxPaletteColors = 256;
+	constexpr size_t kMaxLiteralRun = 128;
+	constexpr uint8_t kRunFlag = 0x80;
+	constexpr uint8_t kLongRun = 0x7F;
+
+	uint32_t ReadLittleEndian32(const uint8_t* p) {
+		return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+	}
+
+	void WriteLittleEndian32(std::vector<uint8_t>& out, uint32_t value) {
+		for (size_t i = 0; i < 4; ++i) {
+			out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	// Opaque BGRA as stored in the destination, from B, G, R bytes
+	uint32_t OpaqueColor(const uint8_t* bgr) {
+		return uint32_t(bgr[0]) | (uint32_t(bgr[1]) << 8) | (uint32_t(bgr[2]) << 16) | 0xFF000000u;
+	}
+
+	size_t IndexBits(size_t colors) {
+		return colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+	}
+
+	// Packed indices expand through a table per bit depth instead of shifting them out one by one
+	struct UnpackTables {
+		uint8_t bits1[256][8];
+		uint8_t bits2[256][4];
+		uint8_t bits4[256][2];
+
+		UnpackTables() {
+			for (size_t value = 0; value < 256; ++value) {
+				for (size_t i = 0; i < 8; ++i) {
+					bits1[value][i] = static_cast<uint8_t>((value >> (7 - i)) & 0x1);
+				}
+				for (size_t i = 0; i < 4; ++i) {
+					bits2[value][i] = static_cast<uint8_t>((value >> (6 - 2 * i)) & 0x3);
+				}
+				for (size_t i = 0; i < 2; ++i) {
+					bits4[value][i] = static_cast<uint8_t>((value >> (4 - 4 * i)) & 0xF);
+				}
+			}
+		}
+	};
+
+	const UnpackTables& Unpack() {
+		static const UnpackTables tables;
+		return tables;
+	}
+
+	template <size_t PerByte>
+	void UnpackIndices(const uint8_t (*table)[PerByte], const uint8_t* src, size_t bytes, uint8_t* dst) {
+		// dst has room for a whole byte's worth of indices past the last one
+		for (size_t i = 0; i < bytes; ++i) {
+			std::memcpy(dst + i * PerByte, table[src[i]], PerByte);
+		}
+	}
+
+	// Decodes the index stream of a palette tile; pos is left after its last operation
+	bool DecodeIndices(const uint8_t* data, size_t size, size_t& pos, size_t bits, size_t pixels, uint8_t* indices) {
+		const UnpackTables& tables = Unpack();
+		size_t filled = 0;
+		while (filled < pixels) {
+			if (pos >= size) {
+				return false;
+			}
+			uint8_t op = data[pos++];
+			if (op & kRunFlag) {
+				size_t length = (op & kLongRun) + 1;
+				if ((op & kLongRun) == kLongRun) {
+					uint8_t extra;
+					do {
+						if (pos >= size) {
+							return false;
+						}
+						extra = data[pos++];
+						length += extra;
+					} while (extra == 255);
+				}
+				if (length > pixels - filled || pos >= size) {
+					return false;
+				}
+				std::memset(indices + filled, data[pos++], length);
+				filled += length;
+				continue;
+			}
+
+			size_t count = size_t(op) + 1;
+			size_t bytes = (count * bits + 7) / 8;
+			if (count > pixels - filled || bytes > size - pos) {
+				return false;
+			}
+			switch (bits) {
+			case 1:
+				UnpackIndices<8>(tables.bits1, data + pos, bytes, indices + filled);
+				break;
+			case 2:
+				UnpackIndices<4>(tables.bits2, data + pos, bytes, indices + filled);
+				break;
+			case 4:
+				UnpackIndices<2>(tables.bits4, data + pos, bytes, indices + filled);
+				break;
+			default:
+				std::memcpy(indices + filled, data + pos, count);
+				break;
+			}
+			pos += bytes;
+			filled += count;
+		}
+		return true;
+	}
+
+	bool DecodeTile(const uint8_t* data, size_t size, size_t& pos, uint8_t* dst, size_t dstStride,
+		size_t tileWidth, size_t tileHeight) {
+		if (pos >= size) {
+			return false;
+		}
+		auto mode = static_cast<ScreenTileMode>(data[pos++]);
+		switch (mode) {
+		case ScreenTileMode::Raw: {
+			size_t bytes = tileWidth * tileHeight * 3;
+			if (bytes > size - pos) {
+				return false;
+			}
+			ConvertToBgra(PixelFormat::Bgr24, data + pos, tileWidth * 3, dst, dstStride, tileWidth, tileHeight);
+			pos += bytes;
+			return true;
+		}
+		case ScreenTileMode::Solid: {
+			if (3 > size - pos) {
+				return false;
+			}
+			uint32_t color = OpaqueColor(data + pos);
+			pos += 3;
+			for (size_t y = 0; y < tileHeight; ++y) {
+				uint8_t* row = dst + y * dstStride;
+				for (size_t x = 0; x < tileWidth; ++x) {
+					std::memcpy(row + x * 4, &color, 4);
+				}
+			}
+			return true;
+		}
+		case ScreenTileMode::Palette: {
+			if (pos >= size) {
+				return false;
+			}
+			size_t colors = size_t(data[pos++]) + 1;
+			if (colors * 3 > size - pos) {
+				return false;
+			}
+			uint32_t palette[kMaxPaletteColors];
+			for (size_t i = 0; i < kMaxPaletteColors; ++i) {
+				palette[i] = i < colors ? OpaqueColor(data + pos + i * 3) : 0xFF000000u;
+			}
+			pos += colors * 3;
+
+			uint8_t indices[kTilePixels + 8];
+			if (!DecodeIndices(data, size, pos, IndexBits(colors), tileWidth * tileHeight, indices)) {
+				return false;
+			}
+			for (size_t y = 0; y < tileHeight; ++y) {
+				const uint8_t* index = indices + y * tileWidth;
+				uint8_t* row = dst + y * dstStride;
+				for (size_t x = 0; x < tileWidth; ++x) {
+					std::memcpy(row + x * 4, &palette[index[x]], 4);
+				}
+			}
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	// Colours of one tile in order of first appearance, found through a small open-addressing table
+	class TilePalette {
+	public:
+		// Returns false once the tile has more colours than a palette holds
+		bool Build(const uint32_t* pixels, size_t count, uint8_t* indices) {
+			colors = 0;
+			std::fill(std::begin(slots), std::end(slots), kEmpty);
+			for (size_t i = 0; i < count; ++i) {
+				uint32_t color = pixels[i];
+				size_t slot = (color * 0x9E3779B1u) >> (32 - kSlotBits);
+				while (slots[slot] != kEmpty && palette[slots[slot]] != color) {
+					slot = (slot + 1) & (kSlots - 1);
+				}
+				if (slots[slot] == kEmpty) {
+					if (colors == kMaxPaletteColors) {
+						return false;
+					}
+					palette[colors] = color;
+					slots[slot] = static_cast<uint16_t>(colors++);
+				}
+				indices[i] = static_cast<uint8_t>(slots[slot]);
+			}
+			return true;
+		}
+
+		size_t Colors() const { return colors; }
+		uint32_t Color(size_t index) const { return palette[index]; }
+
+	private:
+		static constexpr size_t kSlotBits = 9;
+		static constexpr size_t kSlots = size_t(1) << kSlotBits;
+		static constexpr uint16_t kEmpty = 0xFFFF;
+		uint16_t slots[kSlots];
+		uint32_t palette[kMaxPaletteColors];
+		size_t colors = 0;
+	};
+
+	void WriteColor(std::vector<uint8_t>& out, uint32_t color) {
+		out.push_back(static_cast<uint8_t>(color));
+		out.push_back(static_cast<uint8_t>(color >> 8));
+		out.push_back(static_cast<uint8_t>(color >> 16));
+	}
+
+	void WriteLiterals(std::vector<uint8_t>& out, const uint8_t* indices, size_t count, size_t bits) {
+		while (count > 0) {
+			size_t chunk = std::min(count, kMaxLiteralRun);
+			out.push_back(static_cast<uint8_t>(chunk - 1));
+			uint32_t accumulator = 0;
+			size_t pending = 0;
+			for (size_t i = 0; i < chunk; ++i) {
+				accumulator = (accumulator << bits) | indices[i];
+				pending += bits;
+				if (pending == 8) {
+					out.push_back(static_cast<uint8_t>(accumulator));
+					accumulator = 0;
+					pending = 0;
+				}
+			}
+			if (pending > 0) {
+				out.push_back(static_cast<uint8_t>(accumulator << (8 - pending)));
+			}
+			indices += chunk;
+			count -= chunk;
+		}
+	}
+
+	void WriteRun(std::vector<uint8_t>& out, uint8_t index, size_t length) {
+		if (length <= kLongRun) {
+			out.push_back(static_cast<uint8_t>(kRunFlag | (length - 1)));
+		}
+		else {
+			out.push_back(kRunFlag | kLongRun);
+			size_t extra = length - (kLongRun + 1);
+			while (extra >= 255) {
+				out.push_back(255);
+				extra -= 255;
+			}
+			out.push_back(static_cast<uint8_t>(extra));
+		}
+		out.push_back(index);
+	}
+
+	// Runs shorter than this cost more than the packed literals they replace
+	size_t MinimumRun(size_t bits) {
+		return std::max<size_t>(3, 24 / bits);
+	}
+
+	void EncodeTile(const uint8_t* bgra, size_t stride, size_t tileWidth, size_t tileHeight,
+		TilePalette& palette, std::vector<uint8_t>& out) {
+		uint32_t pixels[kTilePixels];
+		for (size_t y = 0; y < tileHeight; ++y) {
+			const uint8_t* row = bgra + y * stride;
+			for (size_t x = 0; x < tileWidth; ++x) {
+				pixels[y * tileWidth + x] = OpaqueColor(row + x * 4);
+			}
+		}
+
+		size_t count = tileWidth * tileHeight;
+		size_t rawBytes = count * 3;
+		uint8_t indices[kTilePixels];
+		if (palette.Build(pixels, count, indices)) {
+			if (palette.Colors() == 1) {
+				out.push_back(static_cast<uint8_t>(ScreenTileMode::Solid));
+				WriteColor(out, palette.Color(0));
+				return;
+			}
+
+			size_t start = out.size();
+			out.push_back(static_cast<uint8_t>(ScreenTileMode::Palette));
+			out.push_back(static_cast<uint8_t>(palette.Colors() - 1));
+			for (size_t i = 0; i < palette.Colors(); ++i) {
+				WriteColor(out, palette.Color(i));
+			}
+
+			size_t bits = IndexBits(palette.Colors());
+			size_t minimumRun = MinimumRun(bits);
+			size_t literalStart = 0;
+			size_t i = 0;
+			while (i < count) {
+				size_t run = 1;
+				while (i + run < count && indices[i + run] == indices[i]) {
+					++run;
+				}
+				if (run >= minimumRun) {
+					WriteLiterals(out, indices + literalStart, i - literalStart, bits);
+					WriteRun(out, indices[i], run);
+					literalStart = i + run;
+				}
+				i += run;
+			}
+			WriteLiterals(out, indices + literalStart, count - literalStart, bits);
+
+			// Photographic tiles with a few hundred colours can come out larger than their pixels
+			if (out.size() - start < 1 + rawBytes) {
+				return;
+			}
+			out.resize(start);
+		}
+
+		out.push_back(static_cast<uint8_t>(ScreenTileMode::Raw));
+		for (size_t i = 0; i < count; ++i) {
+			WriteColor(out, pixels[i]);
+		}
+	}
+}
+
+bool ReadScreenImageSize(const uint8_t* data, size_t size, size_t& width, size_t& height) {
+	if (size < kScreenImageHeaderSize || ReadLittleEndian32(data) != kScreenImageMagic) {
+		return false;
+	}
+	width = ReadLittleEndian32(data + 4);
+	height = ReadLittleEndian32(data + 8);
+	return true;
+}
+
+bool DecodeScreenImage(const FrameView& image, uint8_t* dst, size_t dstStride) {
+	size_t pos = kScreenImageHeaderSize;
+	for (size_t top = 0; top < image.height; top += kScreenTileSize) {
+		size_t tileHeight = std::min(kScreenTileSize, image.height - top);
+		for (size_t left = 0; left < image.width; left += kScreenTileSize) {
+			size_t tileWidth = std::min(kScreenTileSize, image.width - left);
+			if (!DecodeTile(image.data, image.dataSize, pos, dst + top * dstStride + left * 4, dstStride,
+				tileWidth, tileHeight)) {
+				return false;
+			}
+		}
+	}
+	return pos == image.dataSize;
+}
+
+void EncodeScreenImage(const uint8_t* bgra, size_t stride, size_t width, size_t height, std::vector<uint8_t>& out) {
+	WriteLittleEndian32(out, kScreenImageMagic);
+	WriteLittleEndian32(out, static_cast<uint32_t>(width));
+	WriteLittleEndian32(out, static_cast<uint32_t>(height));
+
+	TilePalette palette;
+	for (size_t top = 0; top < height; top += kScreenTileSize) {
+		size_t tileHeight = std::min(kScreenTileSize, height - top);
+		for (size_t left = 0; left < width; left += kScreenTileSize) {
+			size_t tileWidth = std::min(kScreenTileSize, width - left);
+			EncodeTile(bgra + top * stride + left * 4, stride, tileWidth, tileHeight, palette, out);
+		}
+	}
+}
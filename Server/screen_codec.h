@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ļݱ (PixelFormat::Screen)ͼӦѡɫɫ + γ̻ԭ洢
+// ʺɫ١ɫĽ棬ֱԵƵĨ͸ (alpha Ϊ 255)
+//
+//  (С)
+//   0  uint32 magic   'WCSC'
+//   4  uint32 width
+//   8  uint32 height
+//  12  ͼ鰴˳Уͼ߳ 64һһеͼܸС
+// ÿͼ 1 ֽģʽͷ
+//   0 Raw      ͼȫذУÿ BGR 3 ֽ (Ƭ)
+//   1 Solid    һɫ BGR
+//   2 Palette  ɫ - 1 (1 ֽ)ɫ (ÿɫ BGR)֮ͼڰ˳ɫ
+//              ɲɣֱͼ飺
+//              0x00-0x7F   n + 1 λܴλǰɫ 2/4/16 ʱ
+//                         ÿֱռ 1/2/4 λռ 8 λ
+//              0x80-0xFF  ͬһظ (n & 0x7F) + 1 Σn & 0x7F Ϊ 0x7F ʱΪ 128 Ϻ
+//                         ֽ֮ (ֱΪ 255 ֽ)֮ 1 ֽڵ
+//              ɫΪɫ
+constexpr uint32_t kScreenImageMagic = 0x43534357u;
+constexpr size_t kScreenImageHeaderSize = 12;
+constexpr size_t kScreenTileSize = 64;
+
+enum class ScreenTileMode : uint8_t {
+	Raw = 0,
+	Solid = 1,
+	Palette = 2,
+};
+
+// ȡͷеĿߣݲǸøʽʱ false
+bool ReadScreenImageSize(const uint8_t* data, size_t size, size_t& width, size_t& height);
+
+// ѱֱӽ뵽 32 λ BGRA Ŀ껺壬image Ŀ ResolvePlaneLayout 
+// 𻵡ضϻжֽʱ false
+bool DecodeScreenImage(const FrameView& image, uint8_t* dst, size_t dstStride);
+
+// ο 32 λ BGRA ͼ ( alpha) ׷ӵ out
+// ͻ˵ıֽ֮һ£׼
+void EncodeScreenImage(const uint8_t* bgra, size_t stride, size_t width, size_t height, std::vector<uint8_t>& out);
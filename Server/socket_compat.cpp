@@ -0,0 +1,110 @@
+#include "socket_compat.h"
+#include <iostream>
+
+namespace socket_compat {
+
+	bool Startup() {
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			std::cerr << "WSAStartup failed" << std::endl;
+			return false;
+		}
+#endif
+		return true;
+	}
+
+	void Cleanup() {
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	void Close(SocketHandle socket) {
+		if (socket == kInvalidSocket) {
+			return;
+		}
+#ifdef _WIN32
+		closesocket(socket);
+#else
+		close(socket);
+#endif
+	}
+
+	bool SetNonBlocking(SocketHandle socket) {
+#ifdef _WIN32
+		u_long mode = 1;
+		return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+		int flags = fcntl(socket, F_GETFL, 0);
+		return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+	}
+
+	void SetNoDelay(SocketHandle socket) {
+		int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY,
+			reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	}
+
+	int LastError() {
+#ifdef _WIN32
+		return WSAGetLastError();
+#else
+		return errno;
+#endif
+	}
+
+	bool IsWouldBlock(int error) {
+#ifdef _WIN32
+		return error == WSAEWOULDBLOCK;
+#else
+		return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+	}
+
+	SocketHandle Listen(uint16_t port) {
+		// Create server socket
+		SocketHandle listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listenSocket == kInvalidSocket) {
+			std::cerr << "Failed to create socket" << std::endl;
+			return kInvalidSocket;
+		}
+
+		// Set address reuse
+		int reuseAddr = 1;
+		if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR,
+			reinterpret_cast<const char*>(&reuseAddr), sizeof(reuseAddr)) != 0) {
+			std::cerr << "Failed to set socket options" << std::endl;
+			Close(listenSocket);
+			return kInvalidSocket;
+		}
+
+		// Bind address
+		sockaddr_in serverAddr = {};
+		serverAddr.sin_family = AF_INET;
+		serverAddr.sin_addr.s_addr = INADDR_ANY;
+		serverAddr.sin_port = htons(port);
+
+		if (bind(listenSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) != 0) {
+			std::cerr << "Failed to bind address" << std::endl;
+			Close(listenSocket);
+			return kInvalidSocket;
+		}
+
+		// Start listening
+		if (listen(listenSocket, SOMAXCONN) != 0) {
+			std::cerr << "Failed to listen" << std::endl;
+			Close(listenSocket);
+			return kInvalidSocket;
+		}
+
+		return listenSocket;
+	}
+
+	std::string FormatAddress(const sockaddr_in& address) {
+		char addressText[INET_ADDRSTRLEN] = { 0 };
+		inet_ntop(AF_INET, &address.sin_addr, addressText, sizeof(addressText));
+		return std::string(addressText) + ":" + std::to_string(ntohs(address.sin_port));
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// ƽ̨ socket 壺Windows ʹ Winsockƽ̨ʹ BSD socket
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "mswsock.lib")
+
+using SocketHandle = SOCKET;
+constexpr SocketHandle kInvalidSocket = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using SocketHandle = int;
+constexpr SocketHandle kInvalidSocket = -1;
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace socket_compat {
+
+	// ʼ / ͷƽ̨ socket  (Windows Ϊ WSAStartup/WSACleanup)
+	bool Startup();
+	void Cleanup();
+
+	// ر socket
+	void Close(SocketHandle socket);
+
+	// Ϊģʽ
+	bool SetNonBlocking(SocketHandle socket);
+
+	// ر Nagle 㷨СϢ (Ӧ) ӳ
+	void SetNoDelay(SocketHandle socket);
+
+	// һ socket õĴ
+	int LastError();
+
+	// Ƿʾ"ʱ/"
+	bool IsWouldBlock(int error);
+
+	//  socketʧܷ kInvalidSocket
+	SocketHandle Listen(uint16_t port);
+
+	// ʽԶ˵ַ "ip:port"
+	std::string FormatAddress(const sockaddr_in& address);
+}
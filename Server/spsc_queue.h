@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// н/߶
+// ֻһ߳ TryPushһ߳ TryPop
+template <typename T>
+class SpscQueue {
+public:
+	// capacity ȡΪ 2 
+	explicit SpscQueue(size_t capacity)
+		: mask(RoundUpPowerOfTwo(capacity) - 1)
+		, slots(new T[mask + 1])
+		, head(0)
+		, tail(0) {
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	// ߣʱ falseitem ֲ
+	bool TryPush(T&& item) {
+		size_t currentTail = tail.load(std::memory_order_relaxed);
+		if (currentTail - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		slots[currentTail & mask] = std::move(item);
+		tail.store(currentTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// ߣпʱ false
+	bool TryPop(T& item) {
+		size_t currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = std::move(slots[currentHead & mask]);
+		slots[currentHead & mask] = T();
+		head.store(currentHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	// ǰԪظ (̵߳ʱΪֵ)
+	size_t Size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	size_t Capacity() const { return mask + 1; }
+
+private:
+	static size_t RoundUpPowerOfTwo(size_t value) {
+		size_t result = 1;
+		while (result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+	const size_t mask;
+	std::unique_ptr<T[]> slots;
+	// Producer and consumer indices live on separate cache lines to avoid false sharing
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
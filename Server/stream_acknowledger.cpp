@@ -0,0 +1,60 @@
+#include "stream_acknowledger.h"
+
+StreamAcknowledger::StreamAcknowledger(uint32_t framesPerAck, uint32_t ackIntervalMs)
+	: framesPerAck(framesPerAck ? framesPerAck : kDefaultFramesPerAck)
+	, ackInterval(ackIntervalMs ? ackIntervalMs : kDefaultAckIntervalMs)
+	, lastAckAt(std::chrono::steady_clock::now())
+	, presentedSequence(0)
+	, presentFailedSequence(0)
+	, reportedPresentFailure(0)
+	, credits(kCreditFrames, kCreditBytes) {
+}
+
+bool StreamAcknowledger::RecordFrame(uint64_t sequence, bool success, const std::string& error) {
+	pending.sequence = sequence;
+	pending.frames++;
+	if (!success) {
+		pending.failedFrames++;
+		pending.errorSequence = sequence;
+		pending.error = error;
+		// Report errors right away instead of waiting for the batch to fill
+		return true;
+	}
+
+	return pending.frames >= framesPerAck
+		|| std::chrono::steady_clock::now() - lastAckAt >= ackInterval;
+}
+
+StreamAcknowledger::Ack StreamAcknowledger::TakeAck() {
+	Ack ack = std::move(pending);
+	pending = Ack();
+	pending.sequence = ack.sequence;
+	lastAckAt = std::chrono::steady_clock::now();
+
+	ack.presentedSequence = presentedSequence.load();
+
+	// A frame accepted earlier may still fail on the present thread; surface that once
+	uint64_t presentFailure = presentFailedSequence.load();
+	if (presentFailure != reportedPresentFailure) {
+		reportedPresentFailure = presentFailure;
+		if (ack.error.empty()) {
+			ack.errorSequence = presentFailure;
+			ack.error = "Render failed";
+		}
+	}
+	return ack;
+}
+
+void StreamAcknowledger::OnFramePresented(const FrameItem& frame, bool success) {
+	std::atomic<uint64_t>& target = success ? presentedSequence : presentFailedSequence;
+	uint64_t current = target.load(std::memory_order_relaxed);
+	while (frame.clientSequence > current && !target.compare_exchange_weak(current, frame.clientSequence)) {
+	}
+	credits.Release(frame.targetWindow, frame.messageSize);
+}
+
+void StreamAcknowledger::OnFrameDropped(const FrameItem& frame, DropReason /*reason*/) {
+	// A superseded frame is only reported once the frame that replaced it is done, so its
+	// credit already comes back at the present rate rather than the parse rate
+	credits.Release(frame.targetWindow, frame.messageSize);
+}
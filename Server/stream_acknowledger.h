@@ -0,0 +1,52 @@
+#pragma once
+
+#include "credit_window.h"
+#include "frame_pipeline.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// ʽģʽһỰۼȷö
+// ֡ĴڸûỰĽ׶ϼ¼ֽڳ߳ϼ¼
+class StreamAcknowledger : public PresentObserver {
+public:
+	static constexpr uint32_t kDefaultFramesPerAck = 30;
+	static constexpr uint32_t kDefaultAckIntervalMs = 100;
+	// ÿĿ괰ڵ;ȣ㹻ֵĲУֲŶӳ
+	static constexpr uint32_t kCreditFrames = 4;
+	static constexpr uint64_t kCreditBytes = 64ull * 1024 * 1024;
+
+	struct Ack {
+		uint64_t sequence = 0;           // Ѵһ֡
+		uint64_t presentedSequence = 0;  // ѳֵһ֡
+		uint32_t frames = 0;             // ϴȷ֡
+		uint32_t failedFrames = 0;       // ʧܵ֡
+		uint64_t errorSequence = 0;      // һʧܵ֡
+		std::string error;
+	};
+
+	// Ϊ 0 ʱʹĬֵ
+	StreamAcknowledger(uint32_t framesPerAck, uint32_t ackIntervalMs);
+
+	// ¼һ֡Ĵ true ʾӦȷ
+	bool RecordFrame(uint64_t sequence, bool success, const std::string& error);
+
+	// ȡۼ״̬ʼһּ
+	Ack TakeAck();
+
+	CreditWindow& Credits() { return credits; }
+
+	void OnFramePresented(const FrameItem& frame, bool success) override;
+	void OnFrameDropped(const FrameItem& frame, DropReason reason) override;
+
+private:
+	uint32_t framesPerAck;
+	std::chrono::milliseconds ackInterval;
+	std::chrono::steady_clock::time_point lastAckAt;
+	Ack pending;
+	std::atomic<uint64_t> presentedSequence;
+	std::atomic<uint64_t> presentFailedSequence;
+	uint64_t reportedPresentFailure;
+	CreditWindow credits;
+};
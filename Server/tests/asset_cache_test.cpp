@@ -0,0 +1,187 @@
+#include "asset_cache.h"
+#include "asset_store.h"
+#include "screen_codec.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+	// Bytes (i * 31 + 7) % 251, so that every lane of every stripe differs
+	std::vector<uint8_t> Pattern(size_t size) {
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; ++i) {
+			data[i] = static_cast<uint8_t>((i * 31 + 7) % 251);
+		}
+		return data;
+	}
+
+	// A screen-encoded image of a single colour, as the client uploads it
+	std::vector<uint8_t> EncodedImage(size_t width, size_t height, uint32_t color) {
+		std::vector<uint32_t> bgra(width * height, color);
+		std::vector<uint8_t> encoded;
+		EncodeScreenImage(reinterpret_cast<const uint8_t*>(bgra.data()), width * 4, width, height, encoded);
+		return encoded;
+	}
+
+	FrameView Upload(const std::vector<uint8_t>& data) {
+		FrameView image;
+		image.data = data.data();
+		image.format = PixelFormat::Screen;
+		EXPECT_TRUE(ResolvePlaneLayout(image, data.size()));
+		return image;
+	}
+
+	uint32_t FirstPixel(const CachedAsset& asset) {
+		const uint8_t* p = asset.image.data;
+		return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+	}
+
+	// A store in a directory of its own, removed afterwards
+	class TemporaryDirectory {
+	public:
+		TemporaryDirectory() {
+			path = std::filesystem::temp_directory_path()
+				/ ("asset_cache_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+			std::filesystem::create_directories(path);
+		}
+
+		~TemporaryDirectory() {
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		std::filesystem::path path;
+	};
+}
+
+TEST(AssetCacheTest, ComputeAssetIdMatchesXxh3) {
+	// Reference digests from xxhash-rust's xxh3_128, covering each input length branch
+	struct Vector {
+		size_t size;
+		uint64_t low;
+		uint64_t high;
+	};
+	const Vector vectors[] = {
+		{ 0, 0x6001C324468D497Full, 0x99AA06D3014798D8ull },
+		{ 1, 0x4C5CCA45D0F4811Full, 0x495B62073EF70CA4ull },
+		{ 2, 0xA7E250C97710FF27ull, 0x12B2847AA0DE5AAAull },
+		{ 3, 0x15F7093B173D005Cull, 0x46F66CB935381565ull },
+		{ 4, 0xB987CA5D9241572Aull, 0x7FEFEEFFB4D0EAB3ull },
+		{ 7, 0x90D8D40E8B5CA9C4ull, 0x9194EFBDDB0D752Cull },
+		{ 8, 0x56BB836CEB6D4BAAull, 0x803C675A846CC6C2ull },
+		{ 9, 0x13AF585C9BF5827Dull, 0x365644C233FFE5C2ull },
+		{ 16, 0x0D463CB04CEFFBAFull, 0xDA917C385CC874C0ull },
+		{ 17, 0x95C34448580E19C8ull, 0xD443578F2C4E2FB4ull },
+		{ 64, 0x64524FE2047012DFull, 0x3515800F003DDBD0ull },
+		{ 65, 0x3B589AD4300EC5D5ull, 0x7FD00229A220A25Bull },
+		{ 128, 0x5B77925B2C683A12ull, 0x22C34350373A38AEull },
+		{ 129, 0xD6D9E73553568BE1ull, 0xC4A7D8F7893F2090ull },
+		{ 200, 0x4EC0706F02EF2A5Bull, 0x7D5B21C921158E64ull },
+		{ 240, 0xC6ED4333F79384F8ull, 0xE29D70B8920FD24Bull },
+		{ 241, 0x07525DBC14902C7Full, 0xF91B3CB8ED0FA91Aull },
+		{ 1000, 0x84B0C79E3E1AC40Eull, 0xE719034ED2C87A36ull },
+		{ 1024, 0xE2898655DB7BC9EEull, 0xF53A1B1E9F1EFEDFull },
+		{ 1025, 0x134C652BA3D6FB9Eull, 0xA906CCA0F6E772A7ull },
+		{ 1088, 0x33AEFFF80DE9AA91ull, 0xE3FDC658D13E0BB8ull },
+		{ 100003, 0xE449A420F68908DBull, 0xC05363F4601A015Full },
+	};
+	for (const Vector& vector : vectors) {
+		std::vector<uint8_t> data = Pattern(vector.size);
+		AssetId id = ComputeAssetId(data.data(), data.size());
+		EXPECT_EQ(id.low, vector.low) << vector.size;
+		EXPECT_EQ(id.high, vector.high) << vector.size;
+	}
+}
+
+TEST(AssetCacheTest, ParsedIdsAreLittleEndian) {
+	// The client sends the u128 digest as to_le_bytes: the low half first
+	std::vector<uint8_t> bytes(kAssetIdSize);
+	for (size_t i = 0; i < kAssetIdSize; ++i) {
+		bytes[i] = static_cast<uint8_t>(i + 1);
+	}
+	AssetId id;
+	ASSERT_TRUE(ParseAssetId(bytes.data(), bytes.size(), id));
+	EXPECT_EQ(id.low, 0x0807060504030201ull);
+	EXPECT_EQ(id.high, 0x100F0E0D0C0B0A09ull);
+	EXPECT_FALSE(ParseAssetId(bytes.data(), bytes.size() - 1, id));
+}
+
+TEST(AssetCacheTest, MatchingUploadIsCached) {
+	AssetCache cache(1 << 20);
+	std::vector<uint8_t> data = EncodedImage(8, 4, 0xFF102030u);
+	AssetId id = ComputeAssetId(data.data(), data.size());
+	std::string error;
+	std::shared_ptr<const CachedAsset> asset = cache.Insert(id, Upload(data), error);
+	ASSERT_TRUE(asset) << error;
+	EXPECT_EQ(asset->image.width, 8u);
+	EXPECT_EQ(asset->image.height, 4u);
+	EXPECT_EQ(asset->image.format, PixelFormat::Bgra32);
+	EXPECT_EQ(FirstPixel(*asset), 0xFF102030u);
+
+	std::shared_ptr<const CachedAsset> found = cache.Find(id);
+	ASSERT_TRUE(found);
+	EXPECT_EQ(found->image.data, asset->image.data);
+	EXPECT_EQ(cache.GetStats().insertions, 1u);
+}
+
+TEST(AssetCacheTest, UploadUnderAnotherImagesIdIsRejected) {
+	AssetCache cache(1 << 20);
+	std::vector<uint8_t> genuine = EncodedImage(8, 4, 0xFF00FF00u);
+	AssetId id = ComputeAssetId(genuine.data(), genuine.size());
+	std::string error;
+	ASSERT_TRUE(cache.Insert(id, Upload(genuine), error)) << error;
+
+	// Another session claims the same id for different pixels
+	std::vector<uint8_t> forged = EncodedImage(8, 4, 0xFFFF0000u);
+	EXPECT_FALSE(cache.Insert(id, Upload(forged), error));
+	EXPECT_EQ(error, "Asset id does not match the image");
+	EXPECT_EQ(cache.GetStats().idMismatches, 1u);
+
+	std::shared_ptr<const CachedAsset> found = cache.Find(id);
+	ASSERT_TRUE(found);
+	EXPECT_EQ(FirstPixel(*found), 0xFF00FF00u);
+}
+
+TEST(AssetCacheTest, PoisonedIdNeverReachesTheStore) {
+	TemporaryDirectory directory;
+	std::vector<uint8_t> genuine = EncodedImage(16, 16, 0xFF0000FFu);
+	std::vector<uint8_t> forged = EncodedImage(16, 16, 0xFFFFFFFFu);
+	AssetId id = ComputeAssetId(genuine.data(), genuine.size());
+	{
+		auto store = std::make_unique<AssetStore>();
+		std::string error;
+		ASSERT_TRUE(store->Open(directory.path.string(), error)) << error;
+		AssetCache cache(1 << 20, std::move(store));
+		EXPECT_FALSE(cache.Insert(id, Upload(forged), error));
+		EXPECT_FALSE(cache.Find(id));
+	}
+
+	// Nothing was persisted under the id, so a restarted server still misses and takes the genuine upload
+	auto store = std::make_unique<AssetStore>();
+	std::string error;
+	ASSERT_TRUE(store->Open(directory.path.string(), error)) << error;
+	AssetCache cache(1 << 20, std::move(store));
+	EXPECT_FALSE(cache.Find(id));
+	ASSERT_TRUE(cache.Insert(id, Upload(genuine), error)) << error;
+	EXPECT_EQ(FirstPixel(*cache.Find(id)), 0xFF0000FFu);
+}
+
+TEST(AssetCacheTest, RawPixelUploadsAreRejected) {
+	// Raw pixels hash the same under any width, format or stride, so they cannot carry an id
+	AssetCache cache(1 << 20);
+	std::vector<uint8_t> pixels(4 * 4 * 3, 0x80);
+	FrameView image;
+	image.data = pixels.data();
+	image.width = 4;
+	image.height = 4;
+	image.format = PixelFormat::Rgb24;
+	ASSERT_TRUE(ResolvePlaneLayout(image, pixels.size()));
+	std::string error;
+	EXPECT_FALSE(cache.Insert(ComputeAssetId(pixels.data(), pixels.size()), image, error));
+	EXPECT_EQ(error, "Asset must be an image file or screen-encoded");
+	EXPECT_EQ(cache.GetStats().assets, 0u);
+}
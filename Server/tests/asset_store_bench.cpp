@@ -0,0 +1,138 @@
+// Startup with a few thousand cached images: icons, thumbnails and a few larger pictures, uploaded
+// as screen-encoded images. "re-decode" is a server without a store, which has to hash and decode
+// every image again when the clients upload it after a restart. "cold open" opens the store left by
+// the previous run and shows every image once, which maps the data file and checks each image's
+// checksum on first use. The files are in the page cache, as they are after a quick restart.
+#include "asset_cache.h"
+#include "asset_store.h"
+#include "screen_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct Upload {
+		AssetId id;
+		std::vector<uint8_t> encoded;
+		size_t pixels;
+	};
+
+	// Flat panels with a band of text-like noise, as user interface pictures tend to be
+	Upload MakeUpload(std::mt19937& random, size_t width, size_t height) {
+		std::vector<uint32_t> bgra(width * height);
+		uint32_t panel = 0xFF000000u | (random() & 0xFFFFFFu);
+		size_t bandTop = random() % height;
+		size_t bandHeight = std::min<size_t>(height - bandTop, 12);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				bool band = y >= bandTop && y < bandTop + bandHeight;
+				bgra[y * width + x] = band && random() % 3 == 0 ? 0xFF000000u | (random() & 0xFFFFFFu) : panel + uint32_t(x / 16);
+			}
+		}
+		Upload upload;
+		EncodeScreenImage(reinterpret_cast<const uint8_t*>(bgra.data()), width * 4, width, height, upload.encoded);
+		upload.id = ComputeAssetId(upload.encoded.data(), upload.encoded.size());
+		upload.pixels = width * height;
+		return upload;
+	}
+
+	FrameView View(const Upload& upload) {
+		FrameView image;
+		image.data = upload.encoded.data();
+		image.format = PixelFormat::Screen;
+		ResolvePlaneLayout(image, upload.encoded.size());
+		return image;
+	}
+
+	double Since(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	size_t count = quick ? 100 : 3000;
+	size_t runs = quick ? 1 : 3;
+
+	std::mt19937 random(1);
+	std::vector<Upload> uploads;
+	size_t pixels = 0;
+	for (size_t i = 0; i < count; ++i) {
+		// Seven icons, two thumbnails and one larger picture in every ten
+		size_t kind = i % 10;
+		if (kind < 7) {
+			uploads.push_back(MakeUpload(random, 64, 64));
+		}
+		else if (kind < 9) {
+			uploads.push_back(MakeUpload(random, 256, 192));
+		}
+		else {
+			uploads.push_back(MakeUpload(random, 640, 360));
+		}
+		pixels += uploads.back().pixels;
+	}
+
+	std::filesystem::path directory = std::filesystem::temp_directory_path()
+		/ ("asset_store_bench_" + std::to_string(Clock::now().time_since_epoch().count()));
+	std::string error;
+	{
+		auto store = std::make_unique<AssetStore>();
+		if (!store->Open(directory.string(), error)) {
+			std::printf("%s\n", error.c_str());
+			return 1;
+		}
+		AssetCache cache(size_t(1) << 30, std::move(store));
+		for (const Upload& upload : uploads) {
+			if (!cache.Insert(upload.id, View(upload), error)) {
+				std::printf("%s\n", error.c_str());
+				return 1;
+			}
+		}
+		cache.Store()->Flush();
+	}
+
+	double redecode = 1e9;
+	double open = 1e9;
+	double firstUse = 1e9;
+	for (size_t run = 0; run < runs; ++run) {
+		AssetCache fresh(size_t(1) << 30);
+		auto start = Clock::now();
+		for (const Upload& upload : uploads) {
+			fresh.Insert(upload.id, View(upload), error);
+		}
+		redecode = std::min(redecode, Since(start));
+
+		start = Clock::now();
+		auto store = std::make_unique<AssetStore>();
+		if (!store->Open(directory.string(), error)) {
+			std::printf("%s\n", error.c_str());
+			return 1;
+		}
+		open = std::min(open, Since(start));
+		AssetCache cache(size_t(1) << 30, std::move(store));
+		for (const Upload& upload : uploads) {
+			if (!cache.Find(upload.id)) {
+				std::printf("a stored image is missing\n");
+				return 1;
+			}
+		}
+		firstUse = std::min(firstUse, Since(start));
+	}
+	std::error_code removeError;
+	std::filesystem::remove_all(directory, removeError);
+
+	std::printf("%zu images, %.1f megapixels\n", count, static_cast<double>(pixels) / 1e6);
+	std::printf("%-24s %10s %14s\n", "startup", "ms", "us/image");
+	std::printf("%-24s %10.2f %14.2f\n", "re-decode", redecode * 1e3, redecode / count * 1e6);
+	std::printf("%-24s %10.2f %14.2f\n", "cold open", open * 1e3, open / count * 1e6);
+	std::printf("%-24s %10.2f %14.2f\n", "cold open + first use", firstUse * 1e3, firstUse / count * 1e6);
+	return 0;
+}
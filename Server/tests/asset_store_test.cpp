@@ -0,0 +1,169 @@
+#include "asset_store.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	class TemporaryDirectory {
+	public:
+		TemporaryDirectory() {
+			path = std::filesystem::temp_directory_path()
+				/ ("asset_store_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+			std::filesystem::create_directories(path);
+		}
+
+		~TemporaryDirectory() {
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		std::filesystem::path path;
+	};
+
+	// Tight Bgra32 pixels that differ per image and per pixel
+	struct Picture {
+		AssetId id;
+		size_t width;
+		size_t height;
+		std::vector<uint8_t> bgra;
+
+		Picture(uint64_t number, size_t width, size_t height) : width(width), height(height), bgra(width * height * 4) {
+			id.low = number;
+			id.high = ~number;
+			for (size_t i = 0; i < bgra.size(); ++i) {
+				bgra[i] = static_cast<uint8_t>(i * 7 + number * 13);
+			}
+		}
+
+		FrameView View() const {
+			FrameView view;
+			view.data = bgra.data();
+			view.width = width;
+			view.height = height;
+			view.format = PixelFormat::Bgra32;
+			view.strides[0] = width * 4;
+			view.dataSize = bgra.size();
+			return view;
+		}
+
+		bool Matches(const CachedAsset& asset) const {
+			return asset.image.width == width && asset.image.height == height
+				&& std::equal(bgra.begin(), bgra.end(), asset.image.data);
+		}
+	};
+
+	std::unique_ptr<AssetStore> OpenStore(const TemporaryDirectory& directory) {
+		auto store = std::make_unique<AssetStore>();
+		std::string error;
+		EXPECT_TRUE(store->Open(directory.path.string(), error)) << error;
+		return store;
+	}
+}
+
+TEST(AssetStoreTest, AppendedImagesSurviveReopening) {
+	TemporaryDirectory directory;
+	Picture first(1, 33, 17);
+	Picture second(2, 64, 64);
+	{
+		auto store = OpenStore(directory);
+		store->Append(first.id, first.View());
+		store->Append(second.id, second.View());
+		// A second append of a stored image writes nothing
+		store->Append(first.id, first.View());
+		EXPECT_EQ(store->GetStats().appended, 2u);
+		auto found = store->Find(first.id);
+		ASSERT_TRUE(found);
+		EXPECT_TRUE(first.Matches(*found));
+	}
+
+	auto store = OpenStore(directory);
+	AssetStore::Stats stats = store->GetStats();
+	EXPECT_EQ(stats.assets, 2u);
+	EXPECT_EQ(stats.recoveredEntries, 0u);
+	for (const Picture* picture : { &first, &second }) {
+		auto found = store->Find(picture->id);
+		ASSERT_TRUE(found);
+		EXPECT_TRUE(picture->Matches(*found));
+	}
+}
+
+TEST(AssetStoreTest, ConcurrentAppendsAreAllStored) {
+	constexpr size_t kThreads = 8;
+	constexpr size_t kPerThread = 24;
+	TemporaryDirectory directory;
+	std::vector<Picture> pictures;
+	for (size_t i = 0; i < kThreads * kPerThread; ++i) {
+		// Sizes vary so that reserved ranges are not all aligned alike
+		pictures.emplace_back(100 + i, 16 + i % 37, 8 + i % 11);
+	}
+	{
+		auto store = OpenStore(directory);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < kThreads; ++t) {
+			threads.emplace_back([&, t] {
+				for (size_t i = t; i < pictures.size(); i += kThreads) {
+					store->Append(pictures[i].id, pictures[i].View());
+					// Another thread's images may be looked up while they are being written
+					store->Find(pictures[(i + 1) % pictures.size()].id);
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		EXPECT_EQ(store->GetStats().appended, pictures.size());
+		for (const Picture& picture : pictures) {
+			auto found = store->Find(picture.id);
+			ASSERT_TRUE(found);
+			EXPECT_TRUE(picture.Matches(*found));
+		}
+	}
+
+	auto store = OpenStore(directory);
+	EXPECT_EQ(store->GetStats().assets, pictures.size());
+	EXPECT_EQ(store->GetStats().recoveredEntries, 0u);
+	for (const Picture& picture : pictures) {
+		auto found = store->Find(picture.id);
+		ASSERT_TRUE(found);
+		EXPECT_TRUE(picture.Matches(*found));
+	}
+	EXPECT_EQ(store->GetStats().checksumFailures, 0u);
+}
+
+TEST(AssetStoreTest, UnwrittenIndexSlotDropsTheEntriesAfterIt) {
+	// What a crash leaves when a later append finished before an earlier one
+	TemporaryDirectory directory;
+	Picture pictures[] = { Picture(1, 8, 8), Picture(2, 8, 8), Picture(3, 8, 8) };
+	{
+		auto store = OpenStore(directory);
+		for (const Picture& picture : pictures) {
+			store->Append(picture.id, picture.View());
+		}
+	}
+	{
+		std::fstream index(directory.path / "assets.idx", std::ios::in | std::ios::out | std::ios::binary);
+		index.seekp(64 + 64);
+		const char zeros[64] = {};
+		index.write(zeros, sizeof(zeros));
+	}
+
+	auto store = OpenStore(directory);
+	EXPECT_EQ(store->GetStats().assets, 1u);
+	EXPECT_EQ(store->GetStats().recoveredEntries, 2u);
+	EXPECT_TRUE(store->Find(pictures[0].id));
+	EXPECT_FALSE(store->Find(pictures[1].id));
+	EXPECT_FALSE(store->Find(pictures[2].id));
+
+	// The truncated store takes new appends
+	store->Append(pictures[2].id, pictures[2].View());
+	auto found = store->Find(pictures[2].id);
+	ASSERT_TRUE(found);
+	EXPECT_TRUE(pictures[2].Matches(*found));
+}
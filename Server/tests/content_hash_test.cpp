@@ -0,0 +1,121 @@
+#include "content_hash.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+	// Bytes (i * 31 + 7) % 251, so that every lane of every stripe differs
+	std::vector<uint8_t> Pattern(size_t size) {
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; ++i) {
+			data[i] = static_cast<uint8_t>((i * 31 + 7) % 251);
+		}
+		return data;
+	}
+}
+
+TEST(ContentHashTest, Xxh64MatchesReference) {
+	// Reference digests from xxHash 0.8 (XXH64, seed 0), covering the tails after whole stripes
+	struct Vector {
+		size_t size;
+		uint64_t hash;
+	};
+	const Vector vectors[] = {
+		{ 0, 0xEF46DB3751D8E999ull },
+		{ 1, 0xA96C7F0CE858BBB7ull },
+		{ 3, 0x56E6957632A487F9ull },
+		{ 4, 0xC60D15B1E3FF8F04ull },
+		{ 7, 0xAFBEFC3D6C6F9A8Eull },
+		{ 8, 0x3DA5C7AA269683E0ull },
+		{ 11, 0xFBA00BABFA165738ull },
+		{ 31, 0x3391303D485E846Eull },
+		{ 32, 0x40B7AFF75D45BBC8ull },
+		{ 33, 0x4997CAE4951C17A5ull },
+		{ 63, 0x2944B4DAFC69B206ull },
+		{ 64, 0xBB76F6EF19BD5A1Bull },
+		{ 100, 0xF0B29A915621716Dull },
+		{ 1000, 0x9E3300C1CDE3C58Dull },
+		{ 100003, 0xBDF8339B6BEB233Aull },
+	};
+	for (const Vector& vector : vectors) {
+		std::vector<uint8_t> data = Pattern(vector.size);
+		EXPECT_EQ(ComputeXxh64(data.data(), data.size()), vector.hash) << vector.size;
+	}
+	EXPECT_EQ(ComputeXxh64("abc", 3), 0x44BC2CF5AD770999ull);
+}
+
+TEST(ContentHashTest, Xxh3MatchesReference) {
+	// Reference digests from xxHash 0.8 (XXH3_64bits, seed 0), covering each input length branch
+	struct Vector {
+		size_t size;
+		uint64_t hash;
+	};
+	const Vector vectors[] = {
+		{ 0, 0x2D06800538D394C2ull },
+		{ 1, 0x4C5CCA45D0F4811Full },
+		{ 3, 0x15F7093B173D005Cull },
+		{ 4, 0xDCA012F95811B6B9ull },
+		{ 8, 0xDEC6A9A43575982Eull },
+		{ 9, 0x15E553B97E27735Dull },
+		{ 16, 0xA7683B861E585AA6ull },
+		{ 17, 0x637C1AA907698945ull },
+		{ 64, 0xA1688EF0A48A39D4ull },
+		{ 100, 0x66AE152778CBC1C4ull },
+		{ 128, 0x6D0F64C82DDAAD27ull },
+		{ 129, 0xEAF3FC97C05F44F3ull },
+		{ 200, 0xF4B54CDC82F20685ull },
+		{ 240, 0x22F28CBBFAF0447Full },
+		{ 241, 0x07525DBC14902C7Full },
+		{ 1024, 0xE2898655DB7BC9EEull },
+		{ 1025, 0x134C652BA3D6FB9Eull },
+		{ 100003, 0xE449A420F68908DBull },
+	};
+	for (const Vector& vector : vectors) {
+		std::vector<uint8_t> data = Pattern(vector.size);
+		EXPECT_EQ(ComputeXxh3(data.data(), data.size()), vector.hash) << vector.size;
+	}
+}
+
+TEST(ContentHashTest, Xxh128MatchesReference) {
+	// Reference digests from xxHash 0.8 (XXH128, seed 0), one or two per input length branch
+	struct Vector {
+		size_t size;
+		uint64_t low;
+		uint64_t high;
+	};
+	const Vector vectors[] = {
+		{ 0, 0x6001C324468D497Full, 0x99AA06D3014798D8ull },
+		{ 3, 0x15F7093B173D005Cull, 0x46F66CB935381565ull },
+		{ 8, 0x56BB836CEB6D4BAAull, 0x803C675A846CC6C2ull },
+		{ 16, 0x0D463CB04CEFFBAFull, 0xDA917C385CC874C0ull },
+		{ 100, 0x20D4A7247EF15E39ull, 0xAACC1D3C47A46150ull },
+		{ 200, 0x4EC0706F02EF2A5Bull, 0x7D5B21C921158E64ull },
+		{ 240, 0xC6ED4333F79384F8ull, 0xE29D70B8920FD24Bull },
+		{ 241, 0x07525DBC14902C7Full, 0xF91B3CB8ED0FA91Aull },
+		{ 1024, 0xE2898655DB7BC9EEull, 0xF53A1B1E9F1EFEDFull },
+		{ 1025, 0x134C652BA3D6FB9Eull, 0xA906CCA0F6E772A7ull },
+		{ 100003, 0xE449A420F68908DBull, 0xC05363F4601A015Full },
+	};
+	for (const Vector& vector : vectors) {
+		std::vector<uint8_t> data = Pattern(vector.size);
+		Digest128 digest = ComputeXxh128(data.data(), data.size());
+		EXPECT_EQ(digest.low, vector.low) << vector.size;
+		EXPECT_EQ(digest.high, vector.high) << vector.size;
+	}
+}
+
+TEST(ContentHashTest, ReadsUnalignedInput) {
+	// Uploaded images and index entries sit at any offset in a receive buffer
+	std::vector<uint8_t> data = Pattern(1000);
+	std::vector<uint8_t> shifted(data.size() + 3);
+	for (size_t offset = 1; offset < 4; ++offset) {
+		std::memcpy(shifted.data() + offset, data.data(), data.size());
+		EXPECT_EQ(ComputeXxh64(shifted.data() + offset, data.size()), ComputeXxh64(data.data(), data.size()));
+		EXPECT_EQ(ComputeXxh3(shifted.data() + offset, data.size()), ComputeXxh3(data.data(), data.size()));
+		Digest128 expected = ComputeXxh128(data.data(), data.size());
+		Digest128 digest = ComputeXxh128(shifted.data() + offset, data.size());
+		EXPECT_EQ(digest.low, expected.low);
+		EXPECT_EQ(digest.high, expected.high);
+	}
+}
@@ -0,0 +1,342 @@
+// Heap allocations on the decode path once it has warmed up: messages go through the frame assembler
+// into pooled buffers, are parsed on the pipeline's parse threads into pooled requests and presented
+// as pooled frames, the way ClientSession and the server's HandleMessage drive them; raw frames skip
+// the parsing. Every global operator new in the test binary is counted, on all threads.
+#include "frame_assembler.h"
+#include "frame_buffer_pool.h"
+#include "frame_pipeline.h"
+#include "raw_frame.h"
+#include "request_pool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	std::atomic<bool> counting{ false };
+	std::atomic<uint64_t> allocations{ 0 };
+
+	void* Allocate(size_t size, size_t alignment) {
+		if (counting.load(std::memory_order_relaxed)) {
+			allocations.fetch_add(1, std::memory_order_relaxed);
+		}
+		void* block = nullptr;
+		if (alignment <= alignof(std::max_align_t)) {
+			block = std::malloc(size ? size : 1);
+		}
+		else if (posix_memalign(&block, alignment, size ? size : 1) != 0) {
+			block = nullptr;
+		}
+		if (!block) {
+			throw std::bad_alloc();
+		}
+		return block;
+	}
+}
+
+void* operator new(size_t size) { return Allocate(size, 0); }
+void* operator new[](size_t size) { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return Allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return Allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+void operator delete[](void* block, size_t) noexcept { std::free(block); }
+void operator delete(void* block, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { std::free(block); }
+void operator delete(void* block, size_t, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void* block, size_t, std::align_val_t) noexcept { std::free(block); }
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr uint64_t kWindow = 7;
+	constexpr size_t kParseThreads = 2;
+	constexpr size_t kWidth = 64;
+	constexpr size_t kHeight = 48;
+	// Frames a client may have in flight, as the credit window of a streaming session allows
+	constexpr uint64_t kCredit = 8;
+
+	class NullChannel : public ReplyChannel {
+	public:
+		bool SendMessage(const std::string&) override { return true; }
+	};
+
+	// Checks that each frame shows the pixels its message carried; can hold the window up
+	class CheckingPresenter : public FramePresenter {
+	public:
+		explicit CheckingPresenter(std::chrono::microseconds delay) : delay(delay) {}
+
+		bool Present(const FrameItem& frame) override {
+			while (stalled) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			if (delay.count() > 0) {
+				std::this_thread::sleep_for(delay);
+			}
+			if (frame.image.width != kWidth || frame.image.height != kHeight
+				|| frame.image.data[0] != static_cast<uint8_t>(frame.clientSequence)) {
+				wrongFrames++;
+			}
+			return true;
+		}
+
+		void Execute(const ControlItem&) override {}
+
+		std::atomic<bool> stalled{ false };
+		std::atomic<uint64_t> wrongFrames{ 0 };
+
+	private:
+		std::chrono::microseconds delay;
+	};
+
+	// Counts frames leaving the pipeline, the way a streaming session returns credit
+	class CreditObserver : public PresentObserver {
+	public:
+		void OnFramePresented(const FrameItem&, bool) override { done++; }
+		void OnFrameDropped(const FrameItem&, DropReason) override { done++; }
+
+		std::atomic<uint64_t> done{ 0 };
+	};
+
+	// Frames as protobuf image commands, or on the raw channel
+	enum class Channel {
+		Protobuf,
+		Raw,
+	};
+
+	class DecodePath {
+	public:
+		DecodePath(Channel channelType, std::chrono::microseconds presentDelay)
+			: presenter(presentDelay)
+			, pipeline(presenter, kParseThreads)
+			, channelType(channelType)
+			, requests(RequestPool::kRequestsPerParseThread * kParseThreads)
+			, channel(std::make_shared<NullChannel>())
+			, observer(std::make_shared<CreditObserver>()) {
+			pipeline.SetMessageHandler([this](const std::shared_ptr<ReplyChannel>&, const FrameBuffer& message) {
+				HandleMessage(message);
+			});
+			pipeline.SetRawFrameHandler([this](const std::shared_ptr<ReplyChannel>&, std::unique_ptr<RawFrame> raw) {
+				HandleRawFrame(std::move(raw));
+			});
+			pipeline.Start();
+		}
+
+		~DecodePath() {
+			pipeline.Stop();
+		}
+
+		// Serializes the next frames with their length prefixes, as the client would send them
+		void Prepare(uint64_t frames) {
+			wire.clear();
+			for (uint64_t i = 1; i <= frames && channelType == Channel::Protobuf; ++i) {
+				wire.push_back(Serialize(sent + i));
+			}
+			prepared = frames;
+		}
+
+		// Sends the prepared frames as a client within its credit would, and waits until the last
+		// of them has left the pipeline
+		void Stream() {
+			for (uint64_t i = 0; i < prepared; ++i) {
+				while (sent - observer->done >= kCredit) {
+					std::this_thread::yield();
+				}
+				Send(i);
+			}
+			WaitUntilDone();
+		}
+
+		// Holds up parsing and the window while the client sends a frame more than its credit, then
+		// lets them go: the most the path ever holds at once. The extra frame stands for the one
+		// whose buffer is still on its way back to the pool when its credit already is.
+		void Stall() {
+			parsingStalled = true;
+			presenter.stalled = true;
+			for (uint64_t i = 0; i < prepared; ++i) {
+				Send(i);
+			}
+			parsingStalled = false;
+			while (pipeline.GetStats().framesPosted < sent) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			presenter.stalled = false;
+			WaitUntilDone();
+		}
+
+		CheckingPresenter presenter;
+		FramePipeline pipeline;
+
+	private:
+		Channel channelType;
+		FrameBufferPool buffers;
+		RequestPool requests;
+		FrameAssembler assembler;
+		std::shared_ptr<ReplyChannel> channel;
+		std::shared_ptr<CreditObserver> observer;
+		uint64_t sent = 0;
+		uint64_t prepared = 0;
+		std::atomic<bool> parsingStalled{ false };
+		std::vector<std::string> wire;
+
+		static std::string Serialize(uint64_t sequence) {
+			windowcaster::ClientRequest request;
+			auto* command = request.mutable_render_command();
+			command->set_target_window(kWindow);
+			command->set_sequence(sequence);
+			auto* image = command->mutable_image();
+			image->set_width(kWidth);
+			image->set_height(kHeight);
+			image->set_pixel_format(windowcaster::PIXEL_FORMAT_BGRA32);
+			image->set_data(std::string(kWidth * kHeight * 4, static_cast<char>(sequence)));
+			std::string body = request.SerializeAsString();
+			uint32_t length = static_cast<uint32_t>(body.size());
+			return std::string(reinterpret_cast<const char*>(&length), sizeof(length)) + body;
+		}
+
+		void Send(uint64_t index) {
+			++sent;
+			if (channelType == Channel::Protobuf) {
+				Receive(wire[index]);
+			}
+			else {
+				ReceiveRawFrame(sent);
+			}
+		}
+
+		void WaitUntilDone() {
+			auto deadline = Clock::now() + std::chrono::seconds(30);
+			while (observer->done < sent && Clock::now() < deadline) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			ASSERT_EQ(observer->done.load(), sent);
+		}
+
+		// What ClientSession does with the bytes of protobuf messages
+		void Receive(const std::string& bytes) {
+			size_t written = 0;
+			while (written < bytes.size()) {
+				size_t writable = 0;
+				char* target = assembler.PrepareWrite(writable);
+				size_t chunk = std::min(writable, bytes.size() - written);
+				std::memcpy(target, bytes.data() + written, chunk);
+				assembler.CommitWrite(chunk);
+				written += chunk;
+
+				std::string_view message;
+				bool compressed = false;
+				while (assembler.NextMessage(message, compressed)) {
+					std::shared_ptr<FrameBuffer> buffer = buffers.Acquire(message.size());
+					std::memcpy(buffer->Data(), message.data(), message.size());
+					pipeline.SubmitMessage(channel, std::move(buffer));
+				}
+			}
+		}
+
+		// What ClientSession does once it has read a raw frame's header; the payload lands in place
+		void ReceiveRawFrame(uint64_t sequence) {
+			auto frame = std::make_unique<RawFrame>();
+			frame->header.targetWindow = kWindow;
+			frame->header.sequence = sequence;
+			frame->header.width = kWidth;
+			frame->header.height = kHeight;
+			frame->header.strides[0] = kWidth * 4;
+			frame->pixels = buffers.Acquire(kWidth * kHeight * 4);
+			std::memset(frame->pixels->Data(), static_cast<int>(sequence & 0xFF), frame->pixels->Size());
+			frame->messageSize = kRawFrameHeaderSize + frame->pixels->Size();
+			pipeline.SubmitRawFrame(channel, std::move(frame));
+		}
+
+		// What the server's HandleMessage does with an uncompressed image command, replies aside
+		void HandleMessage(const FrameBuffer& message) {
+			WaitWhileStalled();
+			std::shared_ptr<windowcaster::ClientRequest> request = requests.Parse(message.Data(), message.Size());
+			if (!request) {
+				return;
+			}
+			const windowcaster::RenderCommand& command = request->render_command();
+			const std::string& data = command.image().data();
+			auto frame = std::make_unique<FrameItem>();
+			frame->image.data = reinterpret_cast<const uint8_t*>(data.data());
+			frame->image.width = command.image().width();
+			frame->image.height = command.image().height();
+			frame->image.dataSize = data.size();
+			frame->targetWindow = command.target_window();
+			frame->clientSequence = command.sequence();
+			frame->owner = std::move(request);
+			Post(std::move(frame), message.Size());
+		}
+
+		// And with a raw frame
+		void HandleRawFrame(std::unique_ptr<RawFrame> raw) {
+			WaitWhileStalled();
+			auto frame = std::make_unique<FrameItem>();
+			frame->image.data = reinterpret_cast<const uint8_t*>(raw->pixels->Data());
+			frame->image.width = raw->header.width;
+			frame->image.height = raw->header.height;
+			frame->image.dataSize = raw->pixels->Size();
+			frame->targetWindow = raw->header.targetWindow;
+			frame->clientSequence = raw->header.sequence;
+			frame->owner = std::move(raw->pixels);
+			Post(std::move(frame), raw->messageSize);
+		}
+
+		void WaitWhileStalled() {
+			while (parsingStalled) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		void Post(std::unique_ptr<FrameItem> frame, size_t messageSize) {
+			frame->image.format = PixelFormat::Bgra32;
+			frame->image.strides[0] = frame->image.width * 4;
+			frame->receivedAt = Clock::now();
+			frame->messageSize = messageSize;
+			frame->observer = observer;
+			pipeline.PostFrame(std::move(frame));
+		}
+	};
+
+	// Warms the path up to the most it holds at once, then counts what a stream of frames allocates
+	uint64_t SteadyStateAllocations(DecodePath& path, uint64_t frames) {
+		path.Prepare(kCredit + 1);
+		path.Stall();
+		path.Prepare(frames);
+		path.Stream();
+		path.Prepare(frames);
+		allocations = 0;
+		counting = true;
+		path.Stream();
+		counting = false;
+		return allocations.load();
+	}
+}
+
+TEST(DecodePathTest, PresentedFramesDoNotAllocate) {
+	DecodePath path(Channel::Protobuf, std::chrono::microseconds(0));
+	EXPECT_EQ(SteadyStateAllocations(path, 1000), 0u);
+	EXPECT_EQ(path.presenter.wrongFrames.load(), 0u);
+}
+
+TEST(DecodePathTest, SupersededFramesDoNotAllocate) {
+	// A window slower than the stream: most frames are replaced in the mailbox, and their credit
+	// waits on the frame that replaced them
+	DecodePath path(Channel::Protobuf, std::chrono::microseconds(500));
+	EXPECT_EQ(SteadyStateAllocations(path, 500), 0u);
+	EXPECT_EQ(path.presenter.wrongFrames.load(), 0u);
+	EXPECT_GT(path.pipeline.GetStats().framesDropped, 0u);
+}
+
+TEST(DecodePathTest, RawFramesDoNotAllocate) {
+	DecodePath path(Channel::Raw, std::chrono::microseconds(0));
+	EXPECT_EQ(SteadyStateAllocations(path, 1000), 0u);
+	EXPECT_EQ(path.presenter.wrongFrames.load(), 0u);
+}
@@ -0,0 +1,130 @@
+// Throughput of FrameAssembler for a connection's byte stream, with the socket replaced by memcpy
+// from a prepared stream. Reports delivered payload rate and how many bytes the assembler moved
+// itself (compaction, growth and the part of a raw frame read past its header).
+#include "frame_assembler.h"
+#include "raw_frame.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+	void AppendLittleEndian(std::string& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	std::string Stream(size_t messageSize, size_t count, bool raw) {
+		std::string header;
+		if (raw) {
+			AppendLittleEndian(header, kRawFrameMagic, 4);
+			AppendLittleEndian(header, kRawFrameVersion, 2);
+			AppendLittleEndian(header, kRawFrameHeaderSize, 2);
+			header.resize(kRawFrameHeaderSize, '\0');
+		}
+		std::string body(messageSize, 'x');
+		std::string stream;
+		stream.reserve(count * (4 + header.size() + messageSize));
+		for (size_t i = 0; i < count; ++i) {
+			AppendLittleEndian(stream, (header.size() + messageSize) | (raw ? kRawFrameFlag : 0), 4);
+			stream += header;
+			stream += body;
+		}
+		return stream;
+	}
+
+	// Receives the whole stream in reads of at most maxRecv bytes; raw payloads go to a buffer of
+	// their own like ClientSession's pooled frame buffers. Returns payload bytes delivered.
+	size_t Receive(FrameAssembler& assembler, const std::string& stream, size_t maxRecv, std::vector<char>& payload) {
+		size_t delivered = 0;
+		size_t payloadSize = 0;
+		size_t payloadReceived = 0;
+		bool inPayload = false;
+		size_t offset = 0;
+		while (offset < stream.size()) {
+			size_t writable = 0;
+			char* target = inPayload ? payload.data() + payloadReceived : assembler.PrepareWrite(writable);
+			if (inPayload) {
+				writable = payloadSize - payloadReceived;
+			}
+			size_t bytes = std::min({ writable, maxRecv, stream.size() - offset });
+			std::memcpy(target, stream.data() + offset, bytes);
+			offset += bytes;
+			if (inPayload) {
+				payloadReceived += bytes;
+				if (payloadReceived < payloadSize) {
+					continue;
+				}
+				delivered += payloadSize;
+				inPayload = false;
+			}
+			else {
+				assembler.CommitWrite(bytes);
+			}
+
+			while (true) {
+				std::string_view message;
+				bool compressed = false;
+				if (assembler.NextMessage(message, compressed)) {
+					delivered += message.size();
+					continue;
+				}
+				std::string_view header;
+				if (!assembler.NextRawFrame(header, payloadSize)) {
+					break;
+				}
+				payload.resize(std::max(payload.size(), payloadSize));
+				payloadReceived = assembler.TakeBuffered(payload.data(), payloadSize);
+				if (payloadReceived < payloadSize) {
+					inPayload = true;
+					break;
+				}
+				delivered += payloadSize;
+			}
+		}
+		return delivered;
+	}
+
+	void Run(const char* name, size_t messageSize, size_t maxRecv, bool raw, size_t totalBytes,
+		std::chrono::milliseconds duration) {
+		size_t count = std::max<size_t>(1, totalBytes / messageSize);
+		std::string stream = Stream(messageSize, count, raw);
+		std::vector<char> payload;
+
+		// The first pass grows the assembler and faults the pages in
+		FrameAssembler assembler;
+		Receive(assembler, stream, maxRecv, payload);
+
+		FrameAssembler::Stats before = assembler.GetStats();
+		auto start = std::chrono::steady_clock::now();
+		size_t delivered = 0;
+		size_t passes = 0;
+		do {
+			delivered += Receive(assembler, stream, maxRecv, payload);
+			++passes;
+		} while (std::chrono::steady_clock::now() - start < duration);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		FrameAssembler::Stats after = assembler.GetStats();
+
+		std::printf("%-26s %9.2f GB/s %12.0f msg/s  copied %5.2f%% of payload\n", name,
+			delivered / seconds / 1e9, passes * count / seconds,
+			100.0 * (after.bytesCopied - before.bytesCopied) / delivered);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	size_t total = quick ? 16 * 1024 * 1024 : 256 * 1024 * 1024;
+	std::chrono::milliseconds duration(quick ? 10 : 500);
+
+	Run("100 B messages, 64 KB recv", 100, 64 * 1024, false, total / 16, duration);
+	Run("4 KB messages, 64 KB recv", 4 * 1024, 64 * 1024, false, total, duration);
+	Run("64 KB messages, 64 KB recv", 64 * 1024, 64 * 1024, false, total, duration);
+	Run("1 MB messages, 256 KB recv", 1024 * 1024, 256 * 1024, false, total, duration);
+	Run("8 MB messages, 1 MB recv", 8 * 1024 * 1024, 1024 * 1024, false, total, duration);
+	Run("8 MB raw frames, 1 MB recv", 8 * 1024 * 1024, 1024 * 1024, true, total, duration);
+	return 0;
+}
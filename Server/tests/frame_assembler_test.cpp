@@ -0,0 +1,491 @@
+#include "frame_assembler.h"
+#include "raw_frame.h"
+#include "transport_compression.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	void AppendLittleEndian(std::string& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	std::string Framed(const std::string& body, uint32_t flags = 0) {
+		std::string out;
+		AppendLittleEndian(out, static_cast<uint32_t>(body.size()) | flags, 4);
+		return out + body;
+	}
+
+	std::string RawHeader(uint64_t targetWindow, uint64_t sequence, uint32_t width, uint32_t height,
+		uint16_t version = kRawFrameVersion) {
+		size_t headerSize = version == 1 ? kRawFrameHeaderSizeV1 : kRawFrameHeaderSize;
+		std::string header;
+		AppendLittleEndian(header, kRawFrameMagic, 4);
+		AppendLittleEndian(header, version, 2);
+		AppendLittleEndian(header, headerSize, 2);
+		AppendLittleEndian(header, targetWindow, 8);
+		AppendLittleEndian(header, sequence, 8);
+		AppendLittleEndian(header, width, 4);
+		AppendLittleEndian(header, height, 4);
+		AppendLittleEndian(header, 0, 4);   // stride
+		AppendLittleEndian(header, static_cast<uint16_t>(PixelFormat::Bgra32), 2);
+		AppendLittleEndian(header, kRawFrameFlagVideo, 2);
+		header.resize(headerSize, '\0');
+		return header;
+	}
+
+	std::string RawFrameMessage(const std::string& header, const std::string& payload) {
+		std::string out;
+		AppendLittleEndian(out, static_cast<uint32_t>(header.size() + payload.size()) | kRawFrameFlag, 4);
+		return out + header + payload;
+	}
+
+	std::string Pattern(size_t size, uint32_t seed) {
+		std::string data(size, '\0');
+		for (size_t i = 0; i < size; ++i) {
+			data[i] = static_cast<char>((i * 131 + seed * 7919) >> 3);
+		}
+		return data;
+	}
+
+	// One received item: a message, or a raw frame with its payload
+	struct Item {
+		bool raw = false;
+		bool compressed = false;
+		std::string body;
+		RawFrameHeader header;
+
+		bool operator==(const Item& other) const {
+			return raw == other.raw && compressed == other.compressed && body == other.body
+				&& (!raw || (header.targetWindow == other.header.targetWindow && header.sequence == other.header.sequence));
+		}
+	};
+
+	// Drives an assembler the way ClientSession does, with a recv that returns at most maxRecv bytes
+	class Connection {
+	public:
+		explicit Connection(FrameAssembler& assembler) : assembler(assembler) {}
+
+		// False once the assembler considers the stream corrupt
+		bool Receive(const std::string& data, size_t maxRecv) {
+			size_t offset = 0;
+			while (offset < data.size()) {
+				size_t writable = 0;
+				char* target = nullptr;
+				if (inPayload) {
+					target = &payload[payloadReceived];
+					writable = payload.size() - payloadReceived;
+				}
+				else if (!(target = assembler.PrepareWrite(writable))) {
+					return false;
+				}
+
+				size_t bytes = std::min({ writable, maxRecv, data.size() - offset });
+				std::memcpy(target, data.data() + offset, bytes);
+				offset += bytes;
+				if (inPayload) {
+					payloadReceived += bytes;
+					if (payloadReceived < payload.size()) {
+						continue;
+					}
+					DeliverRaw();
+				}
+				else {
+					assembler.CommitWrite(bytes);
+				}
+				if (!Drain()) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		std::vector<Item> items;
+
+	private:
+		FrameAssembler& assembler;
+		bool inPayload = false;
+		RawFrameHeader header;
+		std::string payload;
+		size_t payloadReceived = 0;
+
+		bool Drain() {
+			while (true) {
+				std::string_view message;
+				Item item;
+				if (assembler.NextMessage(message, item.compressed)) {
+					item.body.assign(message.data(), message.size());
+					items.push_back(std::move(item));
+					continue;
+				}
+
+				std::string_view rawHeader;
+				size_t payloadSize = 0;
+				if (!assembler.NextRawFrame(rawHeader, payloadSize)) {
+					break;
+				}
+				header = RawFrameHeader();
+				if (!ParseRawFrameHeader(rawHeader, header)) {
+					return false;
+				}
+				payload.assign(payloadSize, '\0');
+				payloadReceived = assembler.TakeBuffered(&payload[0], payloadSize);
+				inPayload = true;
+				if (payloadReceived < payloadSize) {
+					break;
+				}
+				DeliverRaw();
+			}
+			return !assembler.IsCorrupted();
+		}
+
+		void DeliverRaw() {
+			Item item;
+			item.raw = true;
+			item.header = header;
+			item.body = std::move(payload);
+			items.push_back(std::move(item));
+			payload.clear();
+			payloadReceived = 0;
+			inPayload = false;
+		}
+	};
+
+	Item Message(const std::string& body, bool compressed = false) {
+		Item item;
+		item.compressed = compressed;
+		item.body = body;
+		return item;
+	}
+
+	Item Raw(uint64_t targetWindow, uint64_t sequence, const std::string& payload) {
+		Item item;
+		item.raw = true;
+		item.header.targetWindow = targetWindow;
+		item.header.sequence = sequence;
+		item.body = payload;
+		return item;
+	}
+}
+
+TEST(FrameAssemblerTest, DeliversMessagesReceivedOneByteAtATime) {
+	std::vector<Item> expected;
+	std::string stream;
+	for (size_t size : { 0, 1, 3, 4, 5, 100, 5000 }) {
+		std::string body = Pattern(size, static_cast<uint32_t>(size));
+		expected.push_back(Message(body));
+		stream += Framed(body);
+	}
+
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(stream, 1));
+	EXPECT_EQ(connection.items, expected);
+	EXPECT_EQ(assembler.BufferedSize(), 0u);
+	EXPECT_EQ(assembler.GetStats().messages, expected.size());
+}
+
+TEST(FrameAssemblerTest, LengthPrefixSplitAtEveryPoint) {
+	std::string first = Pattern(10, 1);
+	std::string second = Pattern(300, 2);
+	std::string stream = Framed(first) + Framed(second);
+
+	for (size_t split = 0; split <= stream.size(); ++split) {
+		FrameAssembler assembler;
+		Connection connection(assembler);
+		ASSERT_TRUE(connection.Receive(stream.substr(0, split), 1 << 20));
+		ASSERT_TRUE(connection.Receive(stream.substr(split), 1 << 20));
+		ASSERT_EQ(connection.items, (std::vector<Item>{ Message(first), Message(second) })) << "split at " << split;
+	}
+}
+
+TEST(FrameAssemblerTest, ManyMessagesInOneReceive) {
+	std::vector<Item> expected;
+	std::string stream;
+	for (uint32_t i = 0; i < 1000; ++i) {
+		std::string body = Pattern(i % 97, i);
+		expected.push_back(Message(body));
+		stream += Framed(body);
+	}
+
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(stream, stream.size()));
+	EXPECT_EQ(connection.items, expected);
+}
+
+TEST(FrameAssemblerTest, CompressedFlagIsReportedAndMasked) {
+	std::string compressed = Pattern(200, 3);
+	std::string plain = Pattern(50, 4);
+
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(Framed(compressed, kCompressedMessageFlag) + Framed(plain), 7));
+	EXPECT_EQ(connection.items, (std::vector<Item>{ Message(compressed, true), Message(plain) }));
+}
+
+TEST(FrameAssemblerTest, RawFrameHeaderThenPayload) {
+	std::string payload = Pattern(64 * 48 * 4, 5);
+	std::string after = Pattern(33, 6);
+	std::string stream = RawFrameMessage(RawHeader(0x1234, 77, 64, 48), payload) + Framed(after);
+
+	for (size_t maxRecv : { size_t(1), size_t(7), size_t(64), size_t(4096), stream.size() }) {
+		FrameAssembler assembler;
+		Connection connection(assembler);
+		ASSERT_TRUE(connection.Receive(stream, maxRecv)) << "recv size " << maxRecv;
+		ASSERT_EQ(connection.items, (std::vector<Item>{ Raw(0x1234, 77, payload), Message(after) }));
+		const RawFrameHeader& header = connection.items[0].header;
+		EXPECT_EQ(header.width, 64u);
+		EXPECT_EQ(header.height, 48u);
+		EXPECT_EQ(header.pixelFormat, static_cast<uint16_t>(PixelFormat::Bgra32));
+		EXPECT_TRUE(header.isVideo);
+	}
+}
+
+TEST(FrameAssemblerTest, VersionOneRawFrameHeader) {
+	std::string payload = Pattern(100, 7);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(RawFrameMessage(RawHeader(9, 1, 5, 5, 1), payload), 3));
+	EXPECT_EQ(connection.items, (std::vector<Item>{ Raw(9, 1, payload) }));
+}
+
+TEST(FrameAssemblerTest, EmptyRawFramePayload) {
+	std::string after = Pattern(20, 8);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(RawFrameMessage(RawHeader(1, 2, 0, 0), "") + Framed(after), 1 << 20));
+	EXPECT_EQ(connection.items, (std::vector<Item>{ Raw(1, 2, ""), Message(after) }));
+}
+
+TEST(FrameAssemblerTest, RawFramePayloadIsNotBuffered) {
+	// Only what the first read of a frame brings in past its header is handed over; the assembler
+	// never grows for a payload
+	std::string payload = Pattern(4 * 1024 * 1024, 9);
+	std::string frame = RawFrameMessage(RawHeader(1, 1, 1024, 1024), payload);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(frame + frame + frame, 256 * 1024));
+	ASSERT_EQ(connection.items.size(), 3u);
+	EXPECT_EQ(connection.items[2].body, payload);
+	EXPECT_LE(assembler.GetStats().bytesCopied, 3u * assembler.Capacity());
+	EXPECT_EQ(assembler.GetStats().growths, 0u);
+	EXPECT_EQ(assembler.Capacity(), 64u * 1024);
+}
+
+TEST(FrameAssemblerTest, MessageBodyIsLeftToTheCaller) {
+	// The session takes a message's prefix and what was read past it, then receives the rest itself
+	std::string body = Pattern(100000, 19);
+	std::string compressed = Pattern(30, 20);
+	std::string stream = Framed(body);
+	std::string head = stream.substr(0, 1000);
+
+	FrameAssembler assembler;
+	size_t writable = 0;
+	char* target = assembler.PrepareWrite(writable);
+	ASSERT_NE(target, nullptr);
+	ASSERT_GE(writable, head.size());
+	std::memcpy(target, head.data(), head.size());
+	assembler.CommitWrite(head.size());
+
+	size_t size = 0;
+	ASSERT_TRUE(assembler.NextMessageBody(size));
+	ASSERT_EQ(size, body.size());
+	std::string received(size, '\0');
+	EXPECT_EQ(assembler.TakeBuffered(&received[0], size), head.size() - 4);
+	EXPECT_EQ(assembler.BufferedSize(), 0u);
+	EXPECT_FALSE(assembler.NextMessageBody(size));
+	std::memcpy(&received[head.size() - 4], stream.data() + head.size(), stream.size() - head.size());
+	EXPECT_EQ(received, body);
+
+	// Compressed messages and raw frames are not bodies the caller can take as they are
+	std::string rest = Framed(compressed, kCompressedMessageFlag) + RawFrameMessage(RawHeader(1, 2, 0, 0), "");
+	target = assembler.PrepareWrite(writable);
+	ASSERT_NE(target, nullptr);
+	ASSERT_GE(writable, rest.size());
+	std::memcpy(target, rest.data(), rest.size());
+	assembler.CommitWrite(rest.size());
+	EXPECT_FALSE(assembler.NextMessageBody(size));
+	std::string_view message;
+	bool isCompressed = false;
+	ASSERT_TRUE(assembler.NextMessage(message, isCompressed));
+	EXPECT_TRUE(isCompressed);
+	EXPECT_FALSE(assembler.NextMessageBody(size));
+	std::string_view header;
+	ASSERT_TRUE(assembler.NextRawFrame(header, size));
+	EXPECT_EQ(size, 0u);
+	EXPECT_EQ(assembler.GetStats().messages, 3u);
+	EXPECT_EQ(assembler.GetStats().bytesDelivered, body.size() + compressed.size());
+}
+
+TEST(FrameAssemblerTest, LargeMessageIsReceivedInPlace) {
+	std::string small = Pattern(100, 10);
+	std::string large = Pattern(8 * 1024 * 1024 + 3, 11);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(Framed(small) + Framed(large) + Framed(small), 1024 * 1024));
+	EXPECT_EQ(connection.items, (std::vector<Item>{ Message(small), Message(large), Message(small) }));
+
+	// Growing moves only what had arrived of the large message when its length became known
+	const FrameAssembler::Stats& stats = assembler.GetStats();
+	EXPECT_EQ(stats.growths, 1u);
+	EXPECT_LT(stats.bytesCopied, 1024u * 1024);
+}
+
+TEST(FrameAssemblerTest, LargeMessageTailDoesNotMoveTheMessage) {
+	// Reads that leave only a few bytes of a message missing must not compact or grow the buffer
+	// around the nearly complete message to make room for a full-sized read
+	std::string large = Pattern(8 * 1024 * 1024, 18);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(Framed(large) + Framed(large) + Framed(large), 1024 * 1024));
+	ASSERT_EQ(connection.items.size(), 3u);
+	EXPECT_EQ(connection.items[2].body, large);
+	EXPECT_EQ(assembler.GetStats().growths, 1u);
+	EXPECT_EQ(assembler.GetStats().compactions, 0u);
+	EXPECT_LE(assembler.GetStats().bytesCopied, 64u * 1024);
+}
+
+TEST(FrameAssemblerTest, MessageAtTheSizeLimitIsAccepted) {
+	std::string body = Pattern(1024, 12);
+	FrameAssembler assembler(4096, 1024);
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(Framed(body), 100));
+	EXPECT_EQ(connection.items, (std::vector<Item>{ Message(body) }));
+}
+
+TEST(FrameAssemblerTest, RejectsOversizeMessage) {
+	FrameAssembler assembler(4096, 1024);
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(Framed(Pattern(1025, 13)), 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+	EXPECT_TRUE(connection.items.empty());
+
+	size_t writable = 1;
+	EXPECT_EQ(assembler.PrepareWrite(writable), nullptr);
+	EXPECT_EQ(writable, 0u);
+}
+
+TEST(FrameAssemblerTest, RejectsOversizeLengthBeforeThePayloadArrives) {
+	// A prefix alone is enough to drop the connection; nothing is allocated for the claimed size
+	std::string prefix;
+	AppendLittleEndian(prefix, 0x3FFFFFFF, 4);
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(prefix + "x", 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+	EXPECT_EQ(assembler.Capacity(), 64u * 1024);
+}
+
+TEST(FrameAssemblerTest, RejectsOversizeCompressedMessage) {
+	FrameAssembler assembler(4096, 1024);
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(Framed(Pattern(2000, 14), kCompressedMessageFlag), 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+}
+
+TEST(FrameAssemblerTest, RejectsOversizeRawFrame) {
+	FrameAssembler assembler(4096, 1024);
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(RawFrameMessage(RawHeader(1, 1, 32, 32), Pattern(32 * 32 * 4, 15)), 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+}
+
+TEST(FrameAssemblerTest, RejectsRawAndCompressedFlagsTogether) {
+	std::string header = RawHeader(1, 1, 1, 1);
+	std::string stream;
+	AppendLittleEndian(stream, static_cast<uint32_t>(header.size() + 4) | kRawFrameFlag | kCompressedMessageFlag, 4);
+	stream += header + "abcd";
+
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(stream, 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+	EXPECT_TRUE(connection.items.empty());
+}
+
+TEST(FrameAssemblerTest, RejectsRawFrameWithInvalidHeaderSize) {
+	for (size_t headerSize : { size_t(0), size_t(8), kRawFrameHeaderSizeV1 - 1, kRawFrameHeaderSize + 1 }) {
+		std::string header = RawHeader(1, 1, 1, 1);
+		header[6] = static_cast<char>(headerSize & 0xFF);
+		header[7] = static_cast<char>(headerSize >> 8);
+		FrameAssembler assembler;
+		Connection connection(assembler);
+		EXPECT_FALSE(connection.Receive(RawFrameMessage(header, "pixels"), 5)) << "header size " << headerSize;
+		EXPECT_TRUE(assembler.IsCorrupted());
+	}
+}
+
+TEST(FrameAssemblerTest, RejectsRawFrameShorterThanItsHeader) {
+	std::string header = RawHeader(1, 1, 1, 1);
+	std::string stream;
+	AppendLittleEndian(stream, static_cast<uint32_t>(header.size() - 1) | kRawFrameFlag, 4);
+	stream += header;
+
+	FrameAssembler assembler;
+	Connection connection(assembler);
+	EXPECT_FALSE(connection.Receive(stream, 1 << 20));
+	EXPECT_TRUE(assembler.IsCorrupted());
+}
+
+TEST(FrameAssemblerTest, ResetClearsCorruptionAndReleasesGrownBuffer) {
+	FrameAssembler assembler(4096, 64 * 1024 * 1024);
+	Connection connection(assembler);
+	ASSERT_TRUE(connection.Receive(Framed(Pattern(1024 * 1024, 16)), 1 << 20));
+	EXPECT_GT(assembler.Capacity(), 4096u);
+	std::string prefix;
+	AppendLittleEndian(prefix, 0x3FFFFFFF, 4);
+	EXPECT_FALSE(connection.Receive(prefix, 4));
+
+	assembler.Reset();
+	EXPECT_FALSE(assembler.IsCorrupted());
+	EXPECT_EQ(assembler.Capacity(), 4096u);
+	EXPECT_EQ(assembler.BufferedSize(), 0u);
+
+	Connection fresh(assembler);
+	std::string body = Pattern(10, 17);
+	ASSERT_TRUE(fresh.Receive(Framed(body), 3));
+	EXPECT_EQ(fresh.items, (std::vector<Item>{ Message(body) }));
+}
+
+TEST(FrameAssemblerTest, RandomStreamsMatchWhatWasSent) {
+	std::mt19937 random(20240601);
+	for (int round = 0; round < 20; ++round) {
+		std::vector<Item> expected;
+		std::string stream;
+		for (uint32_t i = 0; i < 200; ++i) {
+			// Mostly small messages, some large enough to be read straight to their end
+			size_t size = random() % 8 == 0 ? random() % (300 * 1024) : random() % 2000;
+			std::string body = Pattern(size, static_cast<uint32_t>(random()));
+			switch (random() % 3) {
+			case 0:
+				expected.push_back(Raw(i, i, body));
+				stream += RawFrameMessage(RawHeader(i, i, 1, 1), body);
+				break;
+			case 1:
+				expected.push_back(Message(body, true));
+				stream += Framed(body, kCompressedMessageFlag);
+				break;
+			default:
+				expected.push_back(Message(body));
+				stream += Framed(body);
+				break;
+			}
+		}
+
+		FrameAssembler assembler(4096);
+		Connection connection(assembler);
+		size_t offset = 0;
+		while (offset < stream.size()) {
+			size_t chunk = std::min<size_t>(stream.size() - offset, 1 + random() % 100000);
+			ASSERT_TRUE(connection.Receive(stream.substr(offset, chunk), 1 + random() % 70000));
+			offset += chunk;
+		}
+		ASSERT_EQ(connection.items, expected) << "round " << round;
+	}
+}
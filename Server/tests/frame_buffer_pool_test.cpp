@@ -0,0 +1,299 @@
+#include "block_free_list.h"
+#include "frame_buffer_pool.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+	// Pages are a multiple of this on every platform the server runs on
+	constexpr size_t kMinPageSize = 4096;
+
+	bool AlignedTo(const char* data, size_t alignment) {
+		return reinterpret_cast<uintptr_t>(data) % alignment == 0;
+	}
+
+	FrameBufferPool::Options Budget(size_t maxFreeBytes) {
+		FrameBufferPool::Options options;
+		options.maxFreeBytes = maxFreeBytes;
+		return options;
+	}
+}
+
+TEST(FrameBufferPoolTest, SizeClassesStartAt256Bytes) {
+	EXPECT_EQ(FrameBufferPool::SizeClassOf(0), 0u);
+	EXPECT_EQ(FrameBufferPool::SizeClassOf(1), 0u);
+	EXPECT_EQ(FrameBufferPool::SizeClassOf(256), 0u);
+	EXPECT_EQ(FrameBufferPool::SizeClassCapacity(0), 256u);
+	EXPECT_EQ(FrameBufferPool::SizeClassOf(257), 1u);
+}
+
+TEST(FrameBufferPoolTest, EachDoublingSplitsIntoFourClasses) {
+	const size_t capacities[] = { 320, 384, 448, 512, 640, 768, 896, 1024 };
+	for (size_t i = 0; i < 8; ++i) {
+		EXPECT_EQ(FrameBufferPool::SizeClassCapacity(i + 1), capacities[i]);
+	}
+	// One class per quarter of every power of two
+	for (size_t shift = 8; shift < 40; ++shift) {
+		size_t base = static_cast<size_t>(1) << shift;
+		EXPECT_EQ(FrameBufferPool::SizeClassOf(base * 2) - FrameBufferPool::SizeClassOf(base), 4u) << base;
+	}
+}
+
+TEST(FrameBufferPoolTest, ClassBoundariesFollowCapacities) {
+	size_t last = FrameBufferPool::SizeClassOf(SIZE_MAX);
+	for (size_t sizeClass = 1; sizeClass < last; ++sizeClass) {
+		size_t capacity = FrameBufferPool::SizeClassCapacity(sizeClass);
+		size_t previous = FrameBufferPool::SizeClassCapacity(sizeClass - 1);
+		ASSERT_GT(capacity, previous) << sizeClass;
+		// The class takes everything above the previous capacity up to its own, wasting under 25%
+		EXPECT_EQ(FrameBufferPool::SizeClassOf(previous + 1), sizeClass);
+		EXPECT_EQ(FrameBufferPool::SizeClassOf(capacity), sizeClass);
+		EXPECT_EQ(FrameBufferPool::SizeClassOf(capacity + 1), sizeClass + 1);
+		EXPECT_LE(capacity - previous, previous / 4) << sizeClass;
+	}
+}
+
+TEST(FrameBufferPoolTest, SizesPastTheLastClassAreOversize) {
+	size_t last = FrameBufferPool::SizeClassOf(SIZE_MAX);
+	size_t largest = FrameBufferPool::SizeClassCapacity(last - 1);
+	EXPECT_EQ(FrameBufferPool::SizeClassOf(largest + 1), last);
+	EXPECT_EQ(FrameBufferPool::SizeClassCapacity(last), SIZE_MAX);
+
+	FrameBufferPool pool;
+	EXPECT_THROW(pool.Acquire(SIZE_MAX), std::bad_alloc);
+	FrameBufferPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.outstandingBuffers, 0u);
+	EXPECT_EQ(stats.residentBytes, 0u);
+}
+
+TEST(FrameBufferPoolTest, BuffersAreCacheLineAligned) {
+	FrameBufferPool pool;
+	for (size_t size : { 1, 100, 257, 4000, 60000 }) {
+		std::shared_ptr<FrameBuffer> buffer = pool.Acquire(size);
+		EXPECT_TRUE(AlignedTo(buffer->Data(), FrameBufferPool::kCacheLineSize)) << size;
+		EXPECT_EQ(buffer->Size(), size);
+		EXPECT_EQ(buffer->Capacity(), FrameBufferPool::SizeClassCapacity(FrameBufferPool::SizeClassOf(size)));
+		EXPECT_EQ(buffer->Reserved(), buffer->Capacity());
+		std::memset(buffer->Data(), 0xAB, buffer->Capacity());
+	}
+}
+
+TEST(FrameBufferPoolTest, LargeBuffersArePageAligned) {
+	FrameBufferPool pool;
+	for (size_t size : { FrameBufferPool::kPageBackedBytes, FrameBufferPool::kPageBackedBytes + 1,
+		static_cast<size_t>(1920 * 1080 * 4) }) {
+		std::shared_ptr<FrameBuffer> buffer = pool.Acquire(size);
+		EXPECT_TRUE(AlignedTo(buffer->Data(), kMinPageSize)) << size;
+		EXPECT_EQ(buffer->Reserved() % kMinPageSize, 0u);
+		EXPECT_GE(buffer->Reserved(), buffer->Capacity());
+		EXPECT_FALSE(buffer->HugePages());
+		std::memset(buffer->Data(), 0xAB, buffer->Capacity());
+	}
+}
+
+TEST(FrameBufferPoolTest, ReusesReturnedBuffersOfTheSameClass) {
+	FrameBufferPool pool;
+	const char* data = nullptr;
+	{
+		std::shared_ptr<FrameBuffer> buffer = pool.Acquire(1000);
+		data = buffer->Data();
+		FrameBufferPool::Stats stats = pool.GetStats();
+		EXPECT_EQ(stats.outstandingBuffers, 1u);
+		EXPECT_EQ(stats.outstandingBytes, 1024u);
+	}
+	FrameBufferPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.freeBuffers, 1u);
+	EXPECT_EQ(stats.freeBytes, 1024u);
+	EXPECT_EQ(stats.outstandingBuffers, 0u);
+
+	// 900 bytes falls in the same 1 KB class and gets the same memory
+	std::shared_ptr<FrameBuffer> again = pool.Acquire(900);
+	EXPECT_EQ(again->Data(), data);
+	EXPECT_EQ(again->Size(), 900u);
+	std::shared_ptr<FrameBuffer> second = pool.Acquire(1000);
+	EXPECT_NE(second->Data(), data);
+
+	stats = pool.GetStats();
+	EXPECT_EQ(stats.hits, 1u);
+	EXPECT_EQ(stats.misses, 2u);
+	EXPECT_DOUBLE_EQ(stats.HitRate(), 1.0 / 3.0);
+	EXPECT_EQ(stats.freeBuffers, 0u);
+	EXPECT_EQ(stats.residentBytes, 2048u);
+	EXPECT_EQ(stats.peakResidentBytes, 2048u);
+}
+
+TEST(FrameBufferPoolTest, HandlesShareOneBuffer) {
+	FrameBufferPool pool;
+	std::shared_ptr<FrameBuffer> buffer = pool.Acquire(500);
+	std::shared_ptr<FrameBuffer> copy = buffer;
+	buffer.reset();
+	EXPECT_EQ(pool.GetStats().outstandingBuffers, 1u);
+	copy.reset();
+	EXPECT_EQ(pool.GetStats().freeBuffers, 1u);
+}
+
+TEST(FrameBufferPoolTest, RecycleEvictsTheStalestClassOverBudget) {
+	FrameBufferPool pool(Budget(2048));
+	std::shared_ptr<FrameBuffer> older = pool.Acquire(1024);
+	std::shared_ptr<FrameBuffer> newer = pool.Acquire(2048);
+	older.reset();
+	EXPECT_EQ(pool.GetStats().freeBytes, 1024u);
+
+	// The 2 KB buffer only fits once the idle 1 KB buffer, asked for earlier, is released
+	newer.reset();
+	FrameBufferPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.evictions, 1u);
+	EXPECT_EQ(stats.freeBuffers, 1u);
+	EXPECT_EQ(stats.freeBytes, 2048u);
+	EXPECT_EQ(stats.residentBytes, 2048u);
+	EXPECT_EQ(stats.budgetBytes, 2048u);
+}
+
+TEST(FrameBufferPoolTest, RecycleKeepsBuffersOfFresherClasses) {
+	FrameBufferPool pool(Budget(2048));
+	std::shared_ptr<FrameBuffer> stale = pool.Acquire(2048);
+	std::shared_ptr<FrameBuffer> fresh = pool.Acquire(1024);
+	fresh.reset();
+
+	// Its class was asked for before the idle buffer's, so the returned buffer is released instead
+	stale.reset();
+	FrameBufferPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.evictions, 1u);
+	EXPECT_EQ(stats.freeBuffers, 1u);
+	EXPECT_EQ(stats.freeBytes, 1024u);
+	EXPECT_EQ(stats.residentBytes, 1024u);
+	EXPECT_EQ(pool.Acquire(1024)->Capacity(), 1024u);
+	EXPECT_EQ(pool.GetStats().hits, 1u);
+}
+
+TEST(FrameBufferPoolTest, BuffersLargerThanTheBudgetAreNotKept) {
+	FrameBufferPool pool(Budget(4096));
+	pool.Acquire(FrameBufferPool::kPageBackedBytes).reset();
+	FrameBufferPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.evictions, 1u);
+	EXPECT_EQ(stats.freeBuffers, 0u);
+	EXPECT_EQ(stats.residentBytes, 0u);
+	EXPECT_EQ(stats.peakResidentBytes, FrameBufferPool::kPageBackedBytes);
+}
+
+TEST(FrameBufferPoolTest, BuffersOutliveThePool) {
+	auto pool = std::make_unique<FrameBufferPool>();
+	std::shared_ptr<FrameBuffer> small = pool->Acquire(300);
+	std::shared_ptr<FrameBuffer> large = pool->Acquire(FrameBufferPool::kPageBackedBytes * 4);
+	pool.reset();
+
+	std::memset(small->Data(), 1, small->Capacity());
+	std::memset(large->Data(), 2, large->Capacity());
+	EXPECT_EQ(small->Data()[small->Capacity() - 1], 1);
+	EXPECT_EQ(large->Data()[large->Capacity() - 1], 2);
+	small.reset();
+	large.reset();
+}
+
+TEST(FrameBufferPoolTest, OrdinaryPagesWithoutHugePages) {
+	FrameBufferPool pool;
+	EXPECT_FALSE(pool.HugePagesEnabled());
+	std::shared_ptr<FrameBuffer> buffer = pool.Acquire(FrameBufferPool::kHugePageBytes * 2);
+	EXPECT_FALSE(buffer->HugePages());
+	EXPECT_EQ(pool.GetStats().hugePageBytes, 0u);
+}
+
+TEST(FrameBufferPoolTest, HugePagesBackOnlyLargeBuffers) {
+	FrameBufferPool::Options options;
+	options.hugePages = true;
+	FrameBufferPool pool(options);
+	std::shared_ptr<FrameBuffer> small = pool.Acquire(FrameBufferPool::kPageBackedBytes);
+	EXPECT_FALSE(small->HugePages());
+
+	// Where huge pages are unavailable the buffer falls back to ordinary pages
+	std::shared_ptr<FrameBuffer> large = pool.Acquire(FrameBufferPool::kHugePageBytes * 2);
+	EXPECT_EQ(large->HugePages(), pool.HugePagesEnabled());
+	EXPECT_TRUE(AlignedTo(large->Data(), large->HugePages() ? FrameBufferPool::kHugePageBytes : kMinPageSize));
+	std::memset(large->Data(), 0xAB, large->Capacity());
+	size_t hugePageBytes = large->HugePages() ? large->Reserved() : 0;
+	EXPECT_EQ(pool.GetStats().hugePageBytes, hugePageBytes);
+
+	// Kept for reuse as it is, huge pages included
+	const char* data = large->Data();
+	large.reset();
+	EXPECT_EQ(pool.GetStats().hugePageBytes, hugePageBytes);
+	large = pool.Acquire(FrameBufferPool::kHugePageBytes * 2);
+	EXPECT_EQ(large->Data(), data);
+}
+
+TEST(FrameBufferPoolTest, ParsesBudgetAndHugePages) {
+	FrameBufferPool::Options options;
+	ASSERT_TRUE(ParseBufferPoolOptions("512", options));
+	EXPECT_EQ(options.maxFreeBytes, 512u * 1024 * 1024);
+	EXPECT_FALSE(options.hugePages);
+
+	ASSERT_TRUE(ParseBufferPoolOptions("64,huge", options));
+	EXPECT_EQ(options.maxFreeBytes, 64u * 1024 * 1024);
+	EXPECT_TRUE(options.hugePages);
+
+	options = FrameBufferPool::Options();
+	ASSERT_TRUE(ParseBufferPoolOptions("HUGE,0", options));
+	EXPECT_EQ(options.maxFreeBytes, 0u);
+	EXPECT_TRUE(options.hugePages);
+
+	// Words not given keep their values
+	options = FrameBufferPool::Options();
+	ASSERT_TRUE(ParseBufferPoolOptions("huge", options));
+	EXPECT_EQ(options.maxFreeBytes, FrameBufferPool::Options().maxFreeBytes);
+	EXPECT_TRUE(options.hugePages);
+}
+
+TEST(FrameBufferPoolTest, RejectsMalformedOptions) {
+	for (const char* text : { "", "abc", "512,", ",huge", "-1", "1234567", "12MB", " 512", "512,huge,x", "huge,,1" }) {
+		FrameBufferPool::Options options;
+		options.maxFreeBytes = 123;
+		EXPECT_FALSE(ParseBufferPoolOptions(text, options)) << text;
+		// Nothing is applied from a string that is rejected as a whole
+		EXPECT_EQ(options.maxFreeBytes, 123u) << text;
+		EXPECT_FALSE(options.hugePages) << text;
+	}
+}
+
+TEST(BlockFreeListTest, ReusesReturnedBlocks) {
+	BlockFreeList list(48, 4);
+	EXPECT_EQ(list.BlockSize(), 48u);
+	void* block = list.Allocate();
+	std::memset(block, 0xAB, list.BlockSize());
+	list.Deallocate(block);
+	EXPECT_EQ(list.FreeBlocks(), 1u);
+	EXPECT_EQ(list.Allocate(), block);
+	EXPECT_EQ(list.FreeBlocks(), 0u);
+	list.Deallocate(block);
+}
+
+TEST(BlockFreeListTest, KeepsAtMostMaxBlocks) {
+	BlockFreeList list(32, 2);
+	std::vector<void*> blocks;
+	for (int i = 0; i < 5; ++i) {
+		blocks.push_back(list.Allocate());
+	}
+	for (void* block : blocks) {
+		list.Deallocate(block);
+	}
+	EXPECT_EQ(list.FreeBlocks(), 2u);
+	// The last returned block comes out first, then the heap takes over
+	EXPECT_EQ(list.Allocate(), blocks[1]);
+	EXPECT_EQ(list.Allocate(), blocks[0]);
+	void* fresh = list.Allocate();
+	EXPECT_NE(fresh, nullptr);
+	for (void* block : { blocks[0], blocks[1], fresh }) {
+		list.Deallocate(block);
+	}
+	EXPECT_EQ(list.FreeBlocks(), 2u);
+}
+
+TEST(BlockFreeListTest, BlocksHoldAtLeastAPointer) {
+	BlockFreeList list(1, 4);
+	EXPECT_EQ(list.BlockSize(), sizeof(void*));
+	list.Deallocate(nullptr);
+	EXPECT_EQ(list.FreeBlocks(), 0u);
+}
@@ -0,0 +1,290 @@
+#include "frame_pipeline.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	using std::chrono::milliseconds;
+
+	// Presents by sleeping; windows can be made slow or reported gone
+	class FakePresenter : public FramePresenter {
+	public:
+		bool Present(const FrameItem& frame) override {
+			std::this_thread::sleep_for(DelayFor(frame.targetWindow));
+			std::lock_guard<std::mutex> lock(mutex);
+			presented[frame.targetWindow].push_back(frame.clientSequence);
+			return true;
+		}
+
+		void Execute(const ControlItem& control) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			executed[control.targetWindow]++;
+		}
+
+		bool IsTargetAlive(uint64_t targetWindow) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			return !dead.count(targetWindow);
+		}
+
+		void SetDelay(uint64_t targetWindow, milliseconds delay) {
+			std::lock_guard<std::mutex> lock(mutex);
+			delays[targetWindow] = delay;
+		}
+
+		void SetDead(uint64_t targetWindow) {
+			std::lock_guard<std::mutex> lock(mutex);
+			dead.insert(targetWindow);
+		}
+
+		size_t PresentedCount(uint64_t targetWindow) {
+			std::lock_guard<std::mutex> lock(mutex);
+			return presented[targetWindow].size();
+		}
+
+		uint64_t LastPresented(uint64_t targetWindow) {
+			std::lock_guard<std::mutex> lock(mutex);
+			return presented[targetWindow].empty() ? 0 : presented[targetWindow].back();
+		}
+
+		int ExecutedCount(uint64_t targetWindow) {
+			std::lock_guard<std::mutex> lock(mutex);
+			return executed[targetWindow];
+		}
+
+	private:
+		std::mutex mutex;
+		std::unordered_map<uint64_t, milliseconds> delays;
+		std::unordered_map<uint64_t, std::vector<uint64_t>> presented;
+		std::unordered_map<uint64_t, int> executed;
+		std::unordered_set<uint64_t> dead;
+
+		milliseconds DelayFor(uint64_t targetWindow) {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = delays.find(targetWindow);
+			return it == delays.end() ? milliseconds(0) : it->second;
+		}
+	};
+
+	// Counts every frame that leaves the pipeline
+	class CountingObserver : public PresentObserver {
+	public:
+		std::atomic<uint64_t> presented{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+
+		void OnFramePresented(const FrameItem&, bool) override { presented++; }
+		void OnFrameDropped(const FrameItem&, DropReason) override { dropped++; }
+	};
+
+	std::unique_ptr<FrameItem> MakeFrame(uint64_t targetWindow, uint64_t clientSequence,
+		std::shared_ptr<PresentObserver> observer = nullptr) {
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = targetWindow;
+		frame->isVideo = true;
+		frame->image.width = 64;
+		frame->image.height = 48;
+		frame->receivedAt = Clock::now();
+		frame->clientSequence = clientSequence;
+		frame->observer = std::move(observer);
+		return frame;
+	}
+
+	bool WaitUntil(const std::function<bool()>& done, milliseconds timeout = milliseconds(5000)) {
+		auto deadline = Clock::now() + timeout;
+		while (!done()) {
+			if (Clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+
+	ControlItem StopRender(uint64_t targetWindow) {
+		ControlItem control;
+		control.targetWindow = targetWindow;
+		control.type = ControlItem::Type::StopRender;
+		return control;
+	}
+
+	constexpr milliseconds kNeverIdle{ 3600 * 1000 };
+}
+
+TEST(FramePipelineTest, SlowPresenterKeepsLatencyBounded) {
+	constexpr auto kPresentTime = milliseconds(20);
+	constexpr uint64_t kFrames = 200;
+	FakePresenter presenter;
+	presenter.SetDelay(1, kPresentTime);
+	FramePipeline pipeline(presenter, 1, 64, 64, kNeverIdle);
+
+	// Frames arrive ten times faster than the window presents them
+	for (uint64_t i = 1; i <= kFrames; ++i) {
+		pipeline.PostFrame(MakeFrame(1, i));
+		std::this_thread::sleep_for(milliseconds(2));
+	}
+	ASSERT_TRUE(WaitUntil([&] { return presenter.LastPresented(1) == kFrames; }));
+
+	FramePipeline::Stats stats = pipeline.GetStats();
+	EXPECT_EQ(stats.framesPosted, kFrames);
+	EXPECT_EQ(stats.framesPresented + stats.framesDropped, kFrames);
+	EXPECT_LT(stats.framesPresented, kFrames / 2);
+	// A queue would have grown to ~kFrames * 2 ms behind; the mailbox holds at most one frame
+	// waiting behind the one being presented
+	EXPECT_LT(stats.maxLatencyUs, static_cast<uint64_t>(std::chrono::microseconds(kPresentTime * 5).count()));
+}
+
+TEST(FramePipelineTest, SlowWindowDoesNotDelayOthers) {
+	FakePresenter presenter;
+	presenter.SetDelay(1, milliseconds(1000));
+	FramePipeline pipeline(presenter, 1, 64, 64, kNeverIdle);
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	auto start = Clock::now();
+	for (uint64_t i = 1; i <= 10; ++i) {
+		pipeline.PostFrame(MakeFrame(2, i));
+		ASSERT_TRUE(WaitUntil([&] { return presenter.LastPresented(2) == i; }, milliseconds(500)));
+	}
+	EXPECT_LT(Clock::now() - start, milliseconds(500));
+	EXPECT_EQ(presenter.PresentedCount(1), 0u);
+}
+
+TEST(FramePipelineTest, IdleStageIsRetiredAndRecreated) {
+	FakePresenter presenter;
+	FramePipeline pipeline(presenter, 1, 64, 64, milliseconds(50));
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	ASSERT_TRUE(WaitUntil([&] { return presenter.PresentedCount(1) == 1; }));
+	pipeline.RetireIdleStages();
+	EXPECT_EQ(pipeline.GetStats().presentStages, 1u);
+
+	std::this_thread::sleep_for(milliseconds(100));
+	pipeline.RetireIdleStages();
+	FramePipeline::Stats stats = pipeline.GetStats();
+	EXPECT_EQ(stats.presentStages, 0u);
+	EXPECT_EQ(stats.presentStagesRetired, 1u);
+	EXPECT_EQ(stats.framesPresented, 1u);
+
+	pipeline.PostFrame(MakeFrame(1, 2));
+	ASSERT_TRUE(WaitUntil([&] { return presenter.LastPresented(1) == 2; }));
+	EXPECT_EQ(pipeline.GetStats().framesPresented, 2u);
+}
+
+TEST(FramePipelineTest, StopRenderRetiresUnlessFramesFollow) {
+	FakePresenter presenter;
+	FramePipeline pipeline(presenter, 1, 64, 64, kNeverIdle);
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	ASSERT_TRUE(pipeline.PostControl(StopRender(1)));
+	pipeline.PostFrame(MakeFrame(2, 1));
+	ASSERT_TRUE(pipeline.PostControl(StopRender(2)));
+	pipeline.PostFrame(MakeFrame(2, 2));
+	ASSERT_TRUE(WaitUntil([&] { return presenter.ExecutedCount(1) == 1 && presenter.LastPresented(2) == 2; }));
+
+	// Window 2 started rendering again after its StopRender
+	ASSERT_TRUE(WaitUntil([&] {
+		pipeline.RetireIdleStages();
+		return pipeline.GetStats().presentStagesRetired == 1;
+		}));
+	std::this_thread::sleep_for(milliseconds(20));
+	pipeline.RetireIdleStages();
+	FramePipeline::Stats stats = pipeline.GetStats();
+	EXPECT_EQ(stats.presentStages, 1u);
+	EXPECT_EQ(stats.presentStagesRetired, 1u);
+}
+
+TEST(FramePipelineTest, DeadWindowIsRetired) {
+	FakePresenter presenter;
+	FramePipeline pipeline(presenter, 1, 64, 64, kNeverIdle);
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	pipeline.PostFrame(MakeFrame(2, 1));
+	ASSERT_TRUE(WaitUntil([&] { return presenter.PresentedCount(1) == 1 && presenter.PresentedCount(2) == 1; }));
+	presenter.SetDead(1);
+	ASSERT_TRUE(WaitUntil([&] {
+		pipeline.RetireIdleStages();
+		return pipeline.GetStats().presentStagesRetired == 1;
+		}));
+	std::this_thread::sleep_for(milliseconds(20));
+	pipeline.RetireIdleStages();
+	EXPECT_EQ(pipeline.GetStats().presentStages, 1u);
+	EXPECT_EQ(pipeline.GetStats().presentStagesRetired, 1u);
+}
+
+TEST(FramePipelineTest, BusyStageIsNotRetired) {
+	FakePresenter presenter;
+	presenter.SetDelay(1, milliseconds(200));
+	FramePipeline pipeline(presenter, 1, 64, 64, milliseconds(0));
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	std::this_thread::sleep_for(milliseconds(50));
+	pipeline.RetireIdleStages();
+	EXPECT_EQ(pipeline.GetStats().presentStages, 1u);
+
+	ASSERT_TRUE(WaitUntil([&] { return presenter.PresentedCount(1) == 1; }));
+	ASSERT_TRUE(WaitUntil([&] {
+		pipeline.RetireIdleStages();
+		return pipeline.GetStats().presentStages == 0;
+		}));
+}
+
+TEST(FramePipelineTest, ParseThreadsRetireIdleStages) {
+	FakePresenter presenter;
+	FramePipeline pipeline(presenter, 1, 64, 64, milliseconds(20));
+	pipeline.Start();
+
+	pipeline.PostFrame(MakeFrame(1, 1));
+	ASSERT_TRUE(WaitUntil([&] { return pipeline.GetStats().presentStagesRetired == 1; }));
+	EXPECT_EQ(pipeline.GetStats().presentStages, 0u);
+	pipeline.Stop();
+}
+
+TEST(FramePipelineTest, NoFrameIsLostWhileStagesRetire) {
+	constexpr uint64_t kWindows = 4;
+	constexpr uint64_t kFramesPerProducer = 2000;
+	FakePresenter presenter;
+	// Retire whenever a stage is momentarily idle
+	FramePipeline pipeline(presenter, 1, 64, 4, milliseconds(0));
+	auto observer = std::make_shared<CountingObserver>();
+
+	std::atomic<bool> producing{ true };
+	std::thread reaper([&] {
+		while (producing) {
+			pipeline.RetireIdleStages();
+		}
+	});
+	std::vector<std::thread> producers;
+	for (uint64_t window = 1; window <= kWindows; ++window) {
+		producers.emplace_back([&, window] {
+			for (uint64_t i = 1; i <= kFramesPerProducer; ++i) {
+				if (i % 100 == 0) {
+					ASSERT_TRUE(pipeline.PostControl(StopRender(window)));
+					std::this_thread::yield();
+				}
+				pipeline.PostFrame(MakeFrame(window, i, observer));
+			}
+		});
+	}
+	for (auto& producer : producers) {
+		producer.join();
+	}
+	producing = false;
+	reaper.join();
+
+	// Every frame is presented or dropped, and the last one of each window is presented
+	constexpr uint64_t kTotal = kWindows * kFramesPerProducer;
+	ASSERT_TRUE(WaitUntil([&] { return observer->presented + observer->dropped == kTotal; }));
+	for (uint64_t window = 1; window <= kWindows; ++window) {
+		EXPECT_EQ(presenter.LastPresented(window), kFramesPerProducer);
+		EXPECT_EQ(presenter.ExecutedCount(window), static_cast<int>(kFramesPerProducer / 100));
+	}
+	FramePipeline::Stats stats = pipeline.GetStats();
+	EXPECT_EQ(stats.framesPosted, kTotal);
+	EXPECT_EQ(stats.framesPresented, observer->presented.load());
+	EXPECT_EQ(stats.framesDropped, observer->dropped.load());
+}
@@ -0,0 +1,138 @@
+// Sending a still image compressed and decoding it on the server, against sending it as the RGB24
+// pixels the client used to upload. For a desktop screenshot and a photo-like picture at 1080p and
+// 4K: the size on the wire, the server's decode time on one core into a BGRA buffer, and transfer
+// plus decode time over a 100 Mbit and a 1 Gbit link. Transfer time is size / rate, with no
+// protocol overhead.
+//
+// QOI and the screen codec are decoded in-tree on every platform. JPEG and PNG go through WIC and
+// are only measured on Windows; this benchmark covers what builds here.
+#include "image_codec.h"
+#include "pixel_format.h"
+#include "qoi_writer.h"
+#include "screen_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Calls run until the time is used up; returns seconds per call
+	template <typename Body>
+	double Measure(double seconds, Body body) {
+		size_t calls = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++calls;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return elapsed.count() / static_cast<double>(calls);
+	}
+
+	// Flat panels with lines of text-like noise
+	std::vector<uint8_t> Desktop(std::mt19937& random, size_t width, size_t height) {
+		std::vector<uint8_t> image(width * height * 4);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				uint8_t* pixel = &image[(y * width + x) * 4];
+				bool text = (y / 16) % 3 == 1 && (x / 300) % 2 == 0 && random() % 4 == 0;
+				uint8_t shade = static_cast<uint8_t>(((x / 240) + (y / 135)) % 2 ? 0xF0 : 0x30);
+				pixel[0] = pixel[1] = pixel[2] = text ? static_cast<uint8_t>(random() % 64) : shade;
+				pixel[3] = 255;
+			}
+		}
+		return image;
+	}
+
+	// Smooth gradients with a little sensor noise
+	std::vector<uint8_t> Photo(std::mt19937& random, size_t width, size_t height) {
+		std::vector<uint8_t> image(width * height * 4);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				uint8_t* pixel = &image[(y * width + x) * 4];
+				pixel[0] = static_cast<uint8_t>(x * 255 / width + random() % 4);
+				pixel[1] = static_cast<uint8_t>(y * 255 / height + random() % 4);
+				pixel[2] = static_cast<uint8_t>((x + y) / 8 + random() % 4);
+				pixel[3] = 255;
+			}
+		}
+		return image;
+	}
+
+	double TransferMs(size_t bytes, double bitsPerSecond) {
+		return static_cast<double>(bytes) * 8 / bitsPerSecond * 1e3;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 0.5;
+	// Quick runs use quarter-size images under the same names
+	size_t scale = quick ? 4 : 1;
+	const struct {
+		const char* name;
+		size_t width;
+		size_t height;
+	} resolutions[] = { { "1080p", 1920 / scale, 1080 / scale }, { "4K", 3840 / scale, 2160 / scale } };
+
+	std::mt19937 random(1);
+	std::printf("%-8s %-6s %-7s %8s %10s %14s %12s\n", "content", "size", "codec", "MB", "decode ms",
+		"100 Mbit ms", "1 Gbit ms");
+	for (const auto& resolution : resolutions) {
+		size_t width = resolution.width;
+		size_t height = resolution.height;
+		const struct {
+			const char* name;
+			std::vector<uint8_t> bgra;
+		} contents[] = {
+			{ "desktop", Desktop(random, width, height) },
+			{ "photo", Photo(random, width, height) },
+		};
+		for (const auto& content : contents) {
+			// What the client sent before: every file expanded to RGB24
+			size_t rawSize = width * height * 3;
+			std::printf("%-8s %-6s %-7s %8.2f %10s %14.1f %12.1f\n", content.name, resolution.name, "rgb24",
+				rawSize / 1e6, "-", TransferMs(rawSize, 100e6), TransferMs(rawSize, 1e9));
+
+			std::vector<uint8_t> screen;
+			EncodeScreenImage(content.bgra.data(), width * 4, width, height, screen);
+			const struct {
+				const char* name;
+				PixelFormat format;
+				std::vector<uint8_t> data;
+			} encoded[] = {
+				{ "qoi", PixelFormat::Qoi, qoi_writer::Encode(content.bgra, width, height) },
+				{ "screen", PixelFormat::Screen, std::move(screen) },
+			};
+			for (const auto& image : encoded) {
+				FrameView view;
+				view.data = image.data.data();
+				view.format = image.format;
+				if (!ResolvePlaneLayout(view, image.data.size())) {
+					std::printf("%s header not accepted\n", image.name);
+					return 1;
+				}
+				std::vector<uint8_t> decoded(width * height * 4);
+				bool ok = true;
+				double perImage = Measure(seconds, [&] {
+					ok &= DecodeImageToBgra(view, decoded.data(), width * 4);
+				});
+				// Both codecs are lossless; the screen codec makes every pixel opaque, as is the source
+				if (!ok || decoded != content.bgra) {
+					std::printf("%s did not decode to the original image\n", image.name);
+					return 1;
+				}
+				double decodeMs = perImage * 1e3;
+				std::printf("%-8s %-6s %-7s %8.2f %10.2f %14.1f %12.1f\n", content.name, resolution.name, image.name,
+					image.data.size() / 1e6, decodeMs, TransferMs(image.data.size(), 100e6) + decodeMs,
+					TransferMs(image.data.size(), 1e9) + decodeMs);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,408 @@
+#include "image_codec.h"
+#include "pixel_format.h"
+#include "qoi_writer.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+	constexpr uint8_t kCanary = 0xCD;
+	constexpr size_t kRowPadding = 16;
+	constexpr size_t kTailCanary = 64;
+
+	void PutBigEndian16(std::vector<uint8_t>& out, size_t value) {
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	void PutBigEndian32(std::vector<uint8_t>& out, size_t value) {
+		PutBigEndian16(out, value >> 16);
+		PutBigEndian16(out, value & 0xFFFF);
+	}
+
+	// A segment with a length but no meaningful payload
+	void PutSegment(std::vector<uint8_t>& out, uint8_t marker, size_t payload) {
+		out.push_back(0xFF);
+		out.push_back(marker);
+		PutBigEndian16(out, payload + 2);
+		out.insert(out.end(), payload, 0);
+	}
+
+	void PutFrameHeader(std::vector<uint8_t>& out, uint8_t marker, size_t width, size_t height) {
+		out.insert(out.end(), { 0xFF, marker });
+		PutBigEndian16(out, 17);
+		out.push_back(8);
+		PutBigEndian16(out, height);
+		PutBigEndian16(out, width);
+		out.insert(out.end(), { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 });
+	}
+
+	// Start of image, an APP0 segment, quantization and Huffman tables, then the frame header
+	std::vector<uint8_t> Jpeg(size_t width, size_t height, uint8_t sof = 0xC0) {
+		std::vector<uint8_t> out = { 0xFF, 0xD8 };
+		PutSegment(out, 0xE0, 14);
+		PutSegment(out, 0xDB, 65);
+		PutSegment(out, 0xC4, 29);
+		PutFrameHeader(out, sof, width, height);
+		PutSegment(out, 0xDA, 10);
+		out.insert(out.end(), { 0xFF, 0xD9 });
+		return out;
+	}
+
+	std::vector<uint8_t> PngChunk(const char* type, size_t length) {
+		std::vector<uint8_t> out;
+		PutBigEndian32(out, length);
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), length + 4, 0);
+		return out;
+	}
+
+	std::vector<uint8_t> Png(size_t width, size_t height) {
+		std::vector<uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R' };
+		PutBigEndian32(out, width);
+		PutBigEndian32(out, height);
+		out.insert(out.end(), { 8, 6, 0, 0, 0, 0, 0, 0, 0 });
+		return out;
+	}
+
+	// Header and end marker around the given chunks
+	std::vector<uint8_t> QoiStream(size_t width, size_t height, const std::vector<uint8_t>& chunks) {
+		std::vector<uint8_t> out = { 'q', 'o', 'i', 'f' };
+		PutBigEndian32(out, width);
+		PutBigEndian32(out, height);
+		out.insert(out.end(), { 4, 0 });
+		out.insert(out.end(), chunks.begin(), chunks.end());
+		out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		return out;
+	}
+
+	std::vector<uint8_t> RandomImage(size_t width, size_t height, uint32_t seed) {
+		std::mt19937 random(seed);
+		std::vector<uint8_t> bgra(width * height * 4);
+		for (size_t i = 0; i < bgra.size(); ++i) {
+			// Runs, repeats and small steps as well as literal pixels, so that every op kind appears
+			bgra[i] = i % 64 < 16 ? 0x40 : static_cast<uint8_t>(i % 4 == 3 ? 255 - random() % 2 : random() % 8 + i / 512);
+		}
+		return bgra;
+	}
+
+	// Decodes a QOI stream into a buffer with padded rows and a tail, all filled with canaries
+	struct Decoded {
+		bool ok = false;
+		size_t width = 0;
+		size_t height = 0;
+		size_t stride = 0;
+		std::vector<uint8_t> buffer;
+
+		// The rows' padding and the tail were left alone
+		bool CanariesIntact() const {
+			for (size_t y = 0; y < height; ++y) {
+				for (size_t x = width * 4; x < stride; ++x) {
+					if (buffer[y * stride + x] != kCanary) {
+						return false;
+					}
+				}
+			}
+			for (size_t i = stride * height; i < buffer.size(); ++i) {
+				if (buffer[i] != kCanary) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		std::vector<uint8_t> Pixels() const {
+			std::vector<uint8_t> pixels;
+			for (size_t y = 0; y < height; ++y) {
+				pixels.insert(pixels.end(), buffer.begin() + y * stride, buffer.begin() + y * stride + width * 4);
+			}
+			return pixels;
+		}
+	};
+
+	Decoded DecodeQoi(const std::vector<uint8_t>& stream) {
+		Decoded decoded;
+		FrameView view;
+		view.data = stream.data();
+		view.format = PixelFormat::Qoi;
+		if (!ResolvePlaneLayout(view, stream.size())) {
+			return decoded;
+		}
+		decoded.width = view.width;
+		decoded.height = view.height;
+		decoded.stride = view.width * 4 + kRowPadding;
+		decoded.buffer.assign(decoded.stride * view.height + kTailCanary, kCanary);
+		decoded.ok = DecodeImageToBgra(view, decoded.buffer.data(), decoded.stride);
+		return decoded;
+	}
+
+	bool SizeOf(PixelFormat format, const std::vector<uint8_t>& data, size_t& width, size_t& height) {
+		return ReadImageSize(format, data.data(), data.size(), width, height);
+	}
+}
+
+TEST(ImageCodecTest, ReadsJpegSize) {
+	size_t width = 0;
+	size_t height = 0;
+	ASSERT_TRUE(SizeOf(PixelFormat::Jpeg, Jpeg(640, 480), width, height));
+	EXPECT_EQ(width, 640u);
+	EXPECT_EQ(height, 480u);
+
+	// Progressive frame headers count as well
+	ASSERT_TRUE(SizeOf(PixelFormat::Jpeg, Jpeg(33, 17, 0xC2), width, height));
+	EXPECT_EQ(width, 33u);
+	EXPECT_EQ(height, 17u);
+}
+
+TEST(ImageCodecTest, JpegFillBytesAndStandaloneMarkersAreSkipped) {
+	std::vector<uint8_t> data = { 0xFF, 0xD8, 0xFF, 0xFF, 0xFF };
+	PutSegment(data, 0xE1, 40);
+	data.insert(data.end(), { 0xFF, 0xD0, 0xFF, 0x01, 0xFF, 0xFF });
+	// DHT, JPG and DAC sit in the SOF range but are not frame headers
+	PutSegment(data, 0xC4, 3);
+	PutSegment(data, 0xC8, 3);
+	PutSegment(data, 0xCC, 3);
+	PutFrameHeader(data, 0xC1, 1920, 1080);
+
+	size_t width = 0;
+	size_t height = 0;
+	ASSERT_TRUE(SizeOf(PixelFormat::Jpeg, data, width, height));
+	EXPECT_EQ(width, 1920u);
+	EXPECT_EQ(height, 1080u);
+}
+
+TEST(ImageCodecTest, RejectsJpegWithoutFrameHeader) {
+	size_t width = 0;
+	size_t height = 0;
+	std::vector<uint8_t> data = { 0xFF, 0xD8 };
+	PutSegment(data, 0xE0, 14);
+	EXPECT_FALSE(SizeOf(PixelFormat::Jpeg, data, width, height));
+
+	// Scan data or the end of the image before any frame header
+	std::vector<uint8_t> scan = data;
+	PutSegment(scan, 0xDA, 10);
+	PutFrameHeader(scan, 0xC0, 64, 64);
+	EXPECT_FALSE(SizeOf(PixelFormat::Jpeg, scan, width, height));
+	std::vector<uint8_t> end = data;
+	end.insert(end.end(), { 0xFF, 0xD9 });
+	PutFrameHeader(end, 0xC0, 64, 64);
+	EXPECT_FALSE(SizeOf(PixelFormat::Jpeg, end, width, height));
+
+	// Bytes between segments that are not a marker
+	std::vector<uint8_t> garbage = data;
+	garbage.push_back(0x00);
+	PutFrameHeader(garbage, 0xC0, 64, 64);
+	EXPECT_FALSE(SizeOf(PixelFormat::Jpeg, garbage, width, height));
+
+	EXPECT_FALSE(SizeOf(PixelFormat::Jpeg, Png(64, 64), width, height));
+}
+
+TEST(ImageCodecTest, ReadsPngSize) {
+	size_t width = 0;
+	size_t height = 0;
+	ASSERT_TRUE(SizeOf(PixelFormat::Png, Png(800, 600), width, height));
+	EXPECT_EQ(width, 800u);
+	EXPECT_EQ(height, 600u);
+}
+
+TEST(ImageCodecTest, RejectsPngWithoutLeadingIhdr) {
+	std::vector<uint8_t> data = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<uint8_t> text = PngChunk("tEXt", 12);
+	data.insert(data.end(), text.begin(), text.end());
+	std::vector<uint8_t> header = Png(64, 64);
+	data.insert(data.end(), header.begin() + 8, header.end());
+
+	size_t width = 0;
+	size_t height = 0;
+	EXPECT_FALSE(SizeOf(PixelFormat::Png, data, width, height));
+
+	std::vector<uint8_t> badSignature = Png(64, 64);
+	badSignature[1] = 'J';
+	EXPECT_FALSE(SizeOf(PixelFormat::Png, badSignature, width, height));
+}
+
+TEST(ImageCodecTest, ReadsQoiSize) {
+	size_t width = 0;
+	size_t height = 0;
+	std::vector<uint8_t> stream = qoi_writer::Encode(RandomImage(5, 3, 1), 5, 3);
+	ASSERT_TRUE(SizeOf(PixelFormat::Qoi, stream, width, height));
+	EXPECT_EQ(width, 5u);
+	EXPECT_EQ(height, 3u);
+
+	// Three channels and linear color space are valid too
+	stream[12] = 3;
+	stream[13] = 1;
+	EXPECT_TRUE(SizeOf(PixelFormat::Qoi, stream, width, height));
+
+	std::vector<uint8_t> channels = stream;
+	channels[12] = 5;
+	EXPECT_FALSE(SizeOf(PixelFormat::Qoi, channels, width, height));
+	std::vector<uint8_t> colorSpace = stream;
+	colorSpace[13] = 2;
+	EXPECT_FALSE(SizeOf(PixelFormat::Qoi, colorSpace, width, height));
+	std::vector<uint8_t> magic = stream;
+	magic[3] = 'g';
+	EXPECT_FALSE(SizeOf(PixelFormat::Qoi, magic, width, height));
+}
+
+TEST(ImageCodecTest, RejectsTruncatedHeaders) {
+	const struct {
+		PixelFormat format;
+		std::vector<uint8_t> data;
+		size_t headerSize;   // The bytes the size is read from
+	} images[] = {
+		{ PixelFormat::Jpeg, Jpeg(64, 48), 2 + 18 + 69 + 33 + 9 },
+		{ PixelFormat::Png, Png(64, 48), 24 },
+		// Header and end marker
+		{ PixelFormat::Qoi, QoiStream(64, 48, {}), 22 },
+	};
+	for (const auto& image : images) {
+		size_t width = 0;
+		size_t height = 0;
+		ASSERT_TRUE(ReadImageSize(image.format, image.data.data(), image.headerSize, width, height));
+		for (size_t size = 0; size < image.headerSize; ++size) {
+			EXPECT_FALSE(ReadImageSize(image.format, image.data.data(), size, width, height))
+				<< static_cast<int>(image.format) << " " << size;
+		}
+	}
+}
+
+TEST(ImageCodecTest, RejectsZeroAndOversizeDimensions) {
+	const struct {
+		size_t width;
+		size_t height;
+		bool accepted;
+	} sizes[] = {
+		{ 0, 100, false },
+		{ 100, 0, false },
+		{ 1, 1, true },
+		{ kMaxImageDimension, kMaxImagePixels / kMaxImageDimension, true },
+		{ kMaxImagePixels / kMaxImageDimension, kMaxImageDimension, true },
+		{ kMaxImageDimension + 1, 1, false },
+		{ 1, kMaxImageDimension + 1, false },
+		{ kMaxImageDimension, kMaxImagePixels / kMaxImageDimension + 1, false },
+		// Both sides within the limit, too many pixels together
+		{ 8193, 8193, false },
+		{ 65535, 65535, false },
+	};
+	for (const auto& size : sizes) {
+		const struct {
+			PixelFormat format;
+			std::vector<uint8_t> data;
+		} images[] = {
+			{ PixelFormat::Jpeg, Jpeg(size.width, size.height) },
+			{ PixelFormat::Png, Png(size.width, size.height) },
+			{ PixelFormat::Qoi, QoiStream(size.width, size.height, {}) },
+		};
+		for (const auto& image : images) {
+			size_t width = 7;
+			size_t height = 7;
+			EXPECT_EQ(SizeOf(image.format, image.data, width, height), size.accepted)
+				<< static_cast<int>(image.format) << " " << size.width << "x" << size.height;
+			if (!size.accepted) {
+				// Outputs are left alone on failure
+				EXPECT_EQ(width, 7u);
+				EXPECT_EQ(height, 7u);
+			}
+		}
+	}
+	// PNG stores 32-bit sizes
+	size_t width = 0;
+	size_t height = 0;
+	EXPECT_FALSE(SizeOf(PixelFormat::Png, Png(0xFFFFFFFF, 1), width, height));
+}
+
+TEST(ImageCodecTest, DecodesQoiIntoPaddedRows) {
+	for (const auto& size : { std::make_pair(1, 1), std::make_pair(7, 5), std::make_pair(64, 33) }) {
+		size_t width = static_cast<size_t>(size.first);
+		size_t height = static_cast<size_t>(size.second);
+		std::vector<uint8_t> bgra = RandomImage(width, height, 3);
+		Decoded decoded = DecodeQoi(qoi_writer::Encode(bgra, width, height));
+		ASSERT_TRUE(decoded.ok) << width << "x" << height;
+		EXPECT_EQ(decoded.Pixels(), bgra);
+		EXPECT_TRUE(decoded.CanariesIntact());
+	}
+}
+
+TEST(ImageCodecTest, RejectsQoiWithTruncatedChunks) {
+	std::vector<uint8_t> bgra = RandomImage(16, 16, 5);
+	std::vector<uint8_t> stream = qoi_writer::Encode(bgra, 16, 16);
+	std::vector<uint8_t> chunks(stream.begin() + 14, stream.end() - 8);
+	ASSERT_GT(chunks.size(), 4u);
+
+	// Every shorter prefix of the chunks, properly terminated
+	for (size_t size = 0; size < chunks.size(); ++size) {
+		Decoded decoded = DecodeQoi(QoiStream(16, 16, std::vector<uint8_t>(chunks.begin(), chunks.begin() + size)));
+		EXPECT_FALSE(decoded.ok) << size;
+		EXPECT_TRUE(decoded.CanariesIntact()) << size;
+	}
+}
+
+TEST(ImageCodecTest, RejectsQoiWithoutEndMarker) {
+	std::vector<uint8_t> stream = qoi_writer::Encode(RandomImage(16, 16, 7), 16, 16);
+
+	std::vector<uint8_t> cleared = stream;
+	cleared.back() = 0;
+	Decoded decoded = DecodeQoi(cleared);
+	EXPECT_FALSE(decoded.ok);
+	EXPECT_TRUE(decoded.CanariesIntact());
+
+	// Cut off anywhere inside the marker or the chunks before it
+	for (size_t cut = 1; cut <= 16; ++cut) {
+		std::vector<uint8_t> truncated(stream.begin(), stream.end() - cut);
+		decoded = DecodeQoi(truncated);
+		EXPECT_FALSE(decoded.ok) << cut;
+		EXPECT_TRUE(decoded.CanariesIntact()) << cut;
+	}
+}
+
+TEST(ImageCodecTest, RejectsQoiWithCorruptChunks) {
+	const struct {
+		const char* name;
+		std::vector<uint8_t> chunks;
+	} streams[] = {
+		// RGB and RGBA ops whose operands run into the end marker
+		{ "rgb operands", { 0xFE, 1, 2, 3, 0xFE, 1 } },
+		{ "rgba operands", { 0xFE, 1, 2, 3, 0xFF, 1, 2 } },
+		{ "luma operand", { 0xFE, 1, 2, 3, 0x80 } },
+		// A run of 62 pixels in a 2x2 image
+		{ "run past the image", { 0xFD } },
+		{ "chunks left over", { 0xFE, 1, 2, 3, 0xC2, 0xFE, 4, 5, 6 } },
+	};
+	for (const auto& stream : streams) {
+		Decoded decoded = DecodeQoi(QoiStream(2, 2, stream.chunks));
+		EXPECT_FALSE(decoded.ok) << stream.name;
+		EXPECT_TRUE(decoded.CanariesIntact()) << stream.name;
+	}
+
+	// Garbage chunks, with the header and marker intact, never write outside the image
+	std::mt19937 random(11);
+	for (int trial = 0; trial < 200; ++trial) {
+		std::vector<uint8_t> chunks(random() % 64);
+		for (auto& byte : chunks) {
+			byte = static_cast<uint8_t>(random());
+		}
+		Decoded decoded = DecodeQoi(QoiStream(3 + random() % 8, 1 + random() % 8, chunks));
+		EXPECT_TRUE(decoded.CanariesIntact()) << trial;
+	}
+}
+
+TEST(ImageCodecTest, ResolvesCompressedLayoutFromHeader) {
+	std::vector<uint8_t> stream = qoi_writer::Encode(RandomImage(9, 4, 13), 9, 4);
+	FrameView view;
+	view.data = stream.data();
+	view.format = PixelFormat::Qoi;
+	ASSERT_TRUE(ResolvePlaneLayout(view, stream.size()));
+	EXPECT_EQ(view.width, 9u);
+	EXPECT_EQ(view.height, 4u);
+	EXPECT_EQ(view.dataSize, stream.size());
+
+	// A declared size must match the header's
+	FrameView declared;
+	declared.data = stream.data();
+	declared.format = PixelFormat::Qoi;
+	declared.width = 8;
+	EXPECT_FALSE(ResolvePlaneLayout(declared, stream.size()));
+}
@@ -0,0 +1,170 @@
+// Throughput of the image scaler for a 1920x1080 BGRA source, per filter and target size, at the
+// scalar level, at the best SIMD level this CPU runs and at that level on a pool of worker threads.
+// Rates are target megapixels per second. The last table compares redrawing a 64x64 dirty region
+// with ScaleRegion against scaling the whole frame again, and the one after it the fused ScaleFrame
+// against converting the whole frame to BGRA first and scaling that, for 4K and 1080p sources.
+#include "image_scaler.h"
+#include "pixel_convert.h"
+#include "work_stealing_pool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kSrcWidth = 1920;
+	constexpr size_t kSrcHeight = 1080;
+
+	struct Target {
+		const char* name;
+		size_t width;
+		size_t height;
+		ScaleFit fit;
+	};
+
+	// Calls run until the time is used up; returns seconds per call
+	template <typename Body>
+	double Measure(double seconds, Body body) {
+		size_t calls = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++calls;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return elapsed.count() / static_cast<double>(calls);
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 1.0;
+
+	std::vector<uint8_t> src(kSrcWidth * kSrcHeight * 4);
+	std::mt19937 random(1);
+	for (auto& byte : src) {
+		byte = static_cast<uint8_t>(random());
+	}
+
+	const Target targets[] = {
+		{ "2560x1440 up", 2560, 1440, ScaleFit::Stretch },
+		{ "1280x720 down", 1280, 720, ScaleFit::Stretch },
+		{ "960x540 half", 960, 540, ScaleFit::Stretch },
+		{ "1024 letterbox", 1024, 1024, ScaleFit::Letterbox },
+	};
+	const ScaleFilter filters[] = { ScaleFilter::Nearest, ScaleFilter::Bilinear, ScaleFilter::Box, ScaleFilter::Lanczos3 };
+
+	WorkStealingPool::Options poolOptions;
+	WorkStealingPool pool(poolOptions);
+	SimdLevel best = DetectSimdLevel();
+	std::printf("1920x1080 source, best level on this CPU: %s, %zu threads\n", SimdLevelName(best), pool.Concurrency());
+	std::printf("%-15s %-9s %10s %10s %10s\n", "target", "filter", "scalar", SimdLevelName(best), "threads");
+
+	std::vector<uint8_t> dst;
+	for (const Target& target : targets) {
+		dst.resize(target.width * target.height * 4);
+		double megapixels = target.width * target.height / 1e6;
+		for (ScaleFilter filter : filters) {
+			ScaleOptions options;
+			options.filter = filter;
+			options.fit = target.fit;
+			std::printf("%-15s %-9s", target.name, ScaleFilterName(filter));
+			ImageScaler scalers[] = { ImageScaler(options, SimdLevel::Scalar), ImageScaler(options, best),
+				ImageScaler(options, best, &pool) };
+			for (ImageScaler& scaler : scalers) {
+				double perCall = Measure(seconds, [&] {
+					scaler.Scale(src.data(), kSrcWidth * 4, kSrcWidth, kSrcHeight, dst.data(), target.width * 4,
+						target.width, target.height);
+				});
+				std::printf(" %5.0f MP/s", megapixels / perCall);
+			}
+			std::printf("\n");
+		}
+	}
+
+	// A cursor-sized change in the middle of the frame, redrawn into a target scaled before
+	std::printf("\n%-15s %-9s %12s %12s\n", "64x64 region", "filter", "full Scale", "ScaleRegion");
+	const Target& target = targets[0];
+	dst.resize(target.width * target.height * 4);
+	ImageScaler::Rect region;
+	region.x = 900;
+	region.y = 500;
+	region.width = 64;
+	region.height = 64;
+	for (ScaleFilter filter : filters) {
+		ScaleOptions options;
+		options.filter = filter;
+		ImageScaler scaler(options, best);
+		double full = Measure(seconds, [&] {
+			scaler.Scale(src.data(), kSrcWidth * 4, kSrcWidth, kSrcHeight, dst.data(), target.width * 4,
+				target.width, target.height);
+		});
+		double partial = Measure(seconds, [&] {
+			scaler.ScaleRegion(src.data(), kSrcWidth * 4, kSrcWidth, kSrcHeight, dst.data(), target.width * 4,
+				target.width, target.height, region);
+		});
+		std::printf("%-15s %-9s %9.2f ms %9.3f ms\n", target.name, ScaleFilterName(filter), full * 1e3, partial * 1e3);
+	}
+
+	// Convert-then-scale touches every source pixel, then writes and reads back a whole BGRA frame;
+	// the fused kernel converts each source row once, into a ring of rows that stays in the cache
+	struct Case {
+		const char* name;
+		size_t srcWidth;
+		size_t srcHeight;
+		size_t dstWidth;
+		size_t dstHeight;
+	};
+	const Case cases[] = {
+		{ "4K->1080p", 3840, 2160, 1920, 1080 },
+		{ "1080p->720p", 1920, 1080, 1280, 720 },
+	};
+	struct Format {
+		const char* name;
+		PixelFormat format;
+	};
+	const Format formats[] = { { "RGB24", PixelFormat::Rgb24 }, { "BGRA", PixelFormat::Bgra32 }, { "NV12", PixelFormat::Nv12 } };
+	std::printf("\n%-12s %-7s %14s %12s %8s\n", "bilinear", "format", "convert+scale", "ScaleFrame", "speedup");
+	std::vector<uint8_t> input;
+	std::vector<uint8_t> converted;
+	for (const Case& scaleCase : cases) {
+		dst.resize(scaleCase.dstWidth * scaleCase.dstHeight * 4);
+		converted.resize(scaleCase.srcWidth * scaleCase.srcHeight * 4);
+		for (const Format& source : formats) {
+			PixelFormat format = source.format;
+			FrameView frame;
+			frame.width = scaleCase.srcWidth;
+			frame.height = scaleCase.srcHeight;
+			frame.format = format;
+			frame.colorSpace = { YuvMatrix::Bt709, false };
+			input.resize(IsYuvFormat(format)
+				? frame.width * frame.height * 3 / 2
+				: frame.width * frame.height * BytesPerPixel(format));
+			for (auto& byte : input) {
+				byte = static_cast<uint8_t>(random());
+			}
+			frame.data = input.data();
+			ResolvePlaneLayout(frame, input.size());
+
+			ScaleOptions options;
+			options.filter = ScaleFilter::Bilinear;
+			ImageScaler scaler(options, best);
+			double separate = Measure(seconds, [&] {
+				ConvertFrameToBgra(best, frame, converted.data(), frame.width * 4);
+				scaler.Scale(converted.data(), frame.width * 4, frame.width, frame.height, dst.data(),
+					scaleCase.dstWidth * 4, scaleCase.dstWidth, scaleCase.dstHeight);
+			});
+			double fused = Measure(seconds, [&] {
+				scaler.ScaleFrame(frame, nullptr, 0, dst.data(), scaleCase.dstWidth * 4,
+					scaleCase.dstWidth, scaleCase.dstHeight);
+			});
+			std::printf("%-12s %-7s %11.2f ms %9.2f ms %7.2fx\n", scaleCase.name, source.name,
+				separate * 1e3, fused * 1e3, separate / fused);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,421 @@
+#include "image_scaler.h"
+#include "work_stealing_pool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	constexpr uint8_t kUntouched = 0xCD;
+	constexpr ScaleFilter kFilters[] = { ScaleFilter::Nearest, ScaleFilter::Bilinear, ScaleFilter::Box, ScaleFilter::Lanczos3 };
+
+	std::vector<SimdLevel> AvailableLevels() {
+		std::vector<SimdLevel> levels{ SimdLevel::Scalar };
+		if (DetectSimdLevel() >= SimdLevel::Ssse3) {
+			levels.push_back(SimdLevel::Ssse3);
+		}
+		if (DetectSimdLevel() >= SimdLevel::Avx2) {
+			levels.push_back(SimdLevel::Avx2);
+		}
+		return levels;
+	}
+
+	struct Image {
+		size_t width = 0;
+		size_t height = 0;
+		size_t stride = 0;
+		std::vector<uint8_t> bgra;
+
+		Image(size_t width, size_t height, size_t padding = 0)
+			: width(width), height(height), stride(width * 4 + padding), bgra(stride * height, kUntouched) {}
+
+		uint8_t* At(size_t x, size_t y) { return bgra.data() + y * stride + x * 4; }
+		const uint8_t* At(size_t x, size_t y) const { return bgra.data() + y * stride + x * 4; }
+	};
+
+	// Every channel different and every byte random, the worst case for rounding differences
+	Image Noise(size_t width, size_t height, uint32_t seed, size_t padding = 8) {
+		std::mt19937 random(seed);
+		Image image(width, height, padding);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width * 4; ++x) {
+				image.bgra[y * image.stride + x] = static_cast<uint8_t>(random());
+			}
+		}
+		return image;
+	}
+
+	// Smooth waves with no overshoot under any filter, so results compare to the exact resampling
+	Image Waves(size_t width, size_t height) {
+		Image image(width, height);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				uint8_t* pixel = image.At(x, y);
+				for (size_t c = 0; c < 4; ++c) {
+					double wave = std::sin(x * (0.03 + 0.01 * c) + c) * std::cos(y * (0.05 - 0.008 * c));
+					pixel[c] = static_cast<uint8_t>(std::lround(128.0 + 100.0 * wave));
+				}
+			}
+		}
+		return image;
+	}
+
+	Image Scale(const ScaleOptions& options, const Image& src, size_t width, size_t height,
+		SimdLevel level = DetectSimdLevel(), WorkStealingPool* pool = nullptr, size_t padding = 12) {
+		ImageScaler scaler(options, level, pool);
+		Image dst(width, height, padding);
+		scaler.Scale(src.bgra.data(), src.stride, src.width, src.height, dst.bgra.data(), dst.stride, width, height);
+		return dst;
+	}
+
+	ScaleOptions Options(ScaleFilter filter, ScaleFit fit = ScaleFit::Stretch) {
+		ScaleOptions options;
+		options.filter = filter;
+		options.fit = fit;
+		return options;
+	}
+
+	std::string Describe(ScaleFilter filter, const Image& src, size_t width, size_t height) {
+		return std::string(ScaleFilterName(filter)) + " " + std::to_string(src.width) + "x" + std::to_string(src.height)
+			+ " -> " + std::to_string(width) + "x" + std::to_string(height);
+	}
+
+	void ExpectPaddingUntouched(const Image& image) {
+		for (size_t y = 0; y < image.height; ++y) {
+			for (size_t x = image.width * 4; x < image.stride; ++x) {
+				ASSERT_EQ(image.bgra[y * image.stride + x], kUntouched) << "row " << y;
+			}
+		}
+	}
+
+	// The resampling the scaler approximates, in double precision: kernels widened by the shrink
+	// factor, pixel centres at i + 0.5, weights clipped to the image and normalized
+	double Kernel(ScaleFilter filter, double x) {
+		switch (filter) {
+		case ScaleFilter::Box:
+			return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+		case ScaleFilter::Lanczos3: {
+			auto sinc = [](double v) { return v == 0.0 ? 1.0 : std::sin(v * 3.14159265358979323846) / (v * 3.14159265358979323846); };
+			return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+		}
+		default:
+			x = std::fabs(x);
+			return x < 1.0 ? 1.0 - x : 0.0;
+		}
+	}
+
+	std::vector<std::vector<double>> Weights(ScaleFilter filter, size_t in, size_t out) {
+		double scale = static_cast<double>(in) / out;
+		double widen = std::max(scale, 1.0);
+		std::vector<std::vector<double>> weights(out, std::vector<double>(in));
+		for (size_t i = 0; i < out; ++i) {
+			double center = (i + 0.5) * scale;
+			double total = 0.0;
+			for (size_t j = 0; j < in; ++j) {
+				weights[i][j] = Kernel(filter, (j + 0.5 - center) / widen);
+				total += weights[i][j];
+			}
+			for (double& weight : weights[i]) {
+				weight /= total;
+			}
+		}
+		return weights;
+	}
+
+	// Horizontal pass first, clamped like the scaler's 8-bit intermediate rows but not rounded
+	std::vector<double> ReferenceScale(ScaleFilter filter, const Image& src, size_t width, size_t height) {
+		auto horizontal = Weights(filter, src.width, width);
+		auto vertical = Weights(filter, src.height, height);
+		std::vector<double> rows(src.height * width * 4);
+		for (size_t y = 0; y < src.height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				for (size_t c = 0; c < 4; ++c) {
+					double sum = 0.0;
+					for (size_t j = 0; j < src.width; ++j) {
+						sum += horizontal[x][j] * src.At(j, y)[c];
+					}
+					rows[(y * width + x) * 4 + c] = std::min(std::max(sum, 0.0), 255.0);
+				}
+			}
+		}
+		std::vector<double> out(width * height * 4);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t i = 0; i < width * 4; ++i) {
+				double sum = 0.0;
+				for (size_t j = 0; j < src.height; ++j) {
+					sum += vertical[y][j] * rows[j * width * 4 + i];
+				}
+				out[y * width * 4 + i] = sum;
+			}
+		}
+		return out;
+	}
+
+	// Size pairs: up and down by whole and odd factors, one axis only, and tiny images
+	struct SizePair {
+		size_t srcWidth;
+		size_t srcHeight;
+		size_t dstWidth;
+		size_t dstHeight;
+	};
+	const SizePair kSizes[] = {
+		{ 64, 48, 128, 96 }, { 64, 48, 32, 24 }, { 333, 201, 500, 120 }, { 120, 90, 37, 211 },
+		{ 300, 200, 300, 150 }, { 300, 200, 111, 200 }, { 1, 1, 17, 9 }, { 97, 3, 5, 64 },
+	};
+}
+
+TEST(ImageScalerTest, PlacementCentresTheImageAtItsAspectRatio) {
+	// Wider than the target: full width, rounded height, centred vertically
+	ImageScaler::Rect wide = ImageScaler::Placement(ScaleFit::Letterbox, 1920, 1080, 1000, 1000);
+	EXPECT_EQ(wide.x, 0u);
+	EXPECT_EQ(wide.width, 1000u);
+	EXPECT_EQ(wide.height, 563u);
+	EXPECT_EQ(wide.y, 218u);
+
+	ImageScaler::Rect tall = ImageScaler::Placement(ScaleFit::Letterbox, 100, 400, 400, 400);
+	EXPECT_EQ(tall.y, 0u);
+	EXPECT_EQ(tall.height, 400u);
+	EXPECT_EQ(tall.width, 100u);
+	EXPECT_EQ(tall.x, 150u);
+
+	// The same aspect ratio, a stretch, and a sliver that would round to nothing
+	ImageScaler::Rect same = ImageScaler::Placement(ScaleFit::Letterbox, 640, 480, 1280, 960);
+	EXPECT_EQ(same.x, 0u);
+	EXPECT_EQ(same.y, 0u);
+	EXPECT_EQ(same.width, 1280u);
+	EXPECT_EQ(same.height, 960u);
+	ImageScaler::Rect stretch = ImageScaler::Placement(ScaleFit::Stretch, 1920, 1080, 1000, 1000);
+	EXPECT_EQ(stretch.width, 1000u);
+	EXPECT_EQ(stretch.height, 1000u);
+	ImageScaler::Rect sliver = ImageScaler::Placement(ScaleFit::Letterbox, 1, 1000, 100, 100);
+	EXPECT_EQ(sliver.width, 1u);
+	EXPECT_EQ(sliver.x, 49u);
+}
+
+TEST(ImageScalerTest, LetterboxFillsTheBarsBlack) {
+	Image white(160, 90);
+	std::fill(white.bgra.begin(), white.bgra.end(), 0xFF);
+	for (ScaleFilter filter : kFilters) {
+		Image dst = Scale(Options(filter, ScaleFit::Letterbox), white, 200, 200);
+		ImageScaler::Rect place = ImageScaler::Placement(ScaleFit::Letterbox, 160, 90, 200, 200);
+		for (size_t y = 0; y < dst.height; ++y) {
+			for (size_t x = 0; x < dst.width; ++x) {
+				bool inside = x >= place.x && x < place.x + place.width && y >= place.y && y < place.y + place.height;
+				uint32_t expected = inside ? 0xFFFFFFFFu : 0xFF000000u;
+				const uint8_t* p = dst.At(x, y);
+				uint32_t actual = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+				ASSERT_EQ(actual, expected) << ScaleFilterName(filter) << " at " << x << "," << y;
+			}
+		}
+		ExpectPaddingUntouched(dst);
+	}
+}
+
+TEST(ImageScalerTest, FlatColourStaysExact) {
+	// Quantized weights add up to exactly 1.0, so no filter shifts the level of a flat area
+	for (const SizePair& size : kSizes) {
+		Image flat(size.srcWidth, size.srcHeight);
+		for (size_t y = 0; y < flat.height; ++y) {
+			for (size_t x = 0; x < flat.width; ++x) {
+				const uint8_t color[4] = { 17, 130, 251, 200 };
+				std::copy(color, color + 4, flat.At(x, y));
+			}
+		}
+		for (ScaleFilter filter : kFilters) {
+			Image dst = Scale(Options(filter), flat, size.dstWidth, size.dstHeight);
+			for (size_t y = 0; y < dst.height; ++y) {
+				for (size_t x = 0; x < dst.width; ++x) {
+					const uint8_t* p = dst.At(x, y);
+					ASSERT_TRUE(p[0] == 17 && p[1] == 130 && p[2] == 251 && p[3] == 200)
+						<< Describe(filter, flat, size.dstWidth, size.dstHeight) << " at " << x << "," << y;
+				}
+			}
+		}
+	}
+}
+
+TEST(ImageScalerTest, SameSizeIsACopy) {
+	Image src = Noise(77, 31, 1);
+	for (ScaleFilter filter : kFilters) {
+		Image dst = Scale(Options(filter), src, 77, 31);
+		for (size_t y = 0; y < 31; ++y) {
+			ASSERT_TRUE(std::equal(src.At(0, y), src.At(0, y) + 77 * 4, dst.At(0, y))) << ScaleFilterName(filter);
+		}
+	}
+}
+
+TEST(ImageScalerTest, KnownValues) {
+	// Bilinear doubling of a black and a white pixel: the outer pixels clip to their source pixel,
+	// the inner ones are 1/4 and 3/4 of the way
+	Image pair(2, 1);
+	std::fill(pair.At(0, 0), pair.At(0, 0) + 4, 0);
+	std::fill(pair.At(1, 0), pair.At(1, 0) + 4, 255);
+	Image doubled = Scale(Options(ScaleFilter::Bilinear), pair, 4, 1);
+	const uint8_t ramp[] = { 0, 64, 191, 255 };
+	for (size_t x = 0; x < 4; ++x) {
+		EXPECT_EQ(doubled.At(x, 0)[0], ramp[x]) << x;
+	}
+
+	// Box halving averages each 2x2 block; the two passes each round, so within one of the exact mean
+	Image src = Noise(64, 40, 2);
+	Image half = Scale(Options(ScaleFilter::Box), src, 32, 20);
+	for (size_t y = 0; y < 20; ++y) {
+		for (size_t x = 0; x < 32; ++x) {
+			for (size_t c = 0; c < 4; ++c) {
+				double mean = (src.At(2 * x, 2 * y)[c] + src.At(2 * x + 1, 2 * y)[c]
+					+ src.At(2 * x, 2 * y + 1)[c] + src.At(2 * x + 1, 2 * y + 1)[c]) / 4.0;
+				ASSERT_LE(std::fabs(half.At(x, y)[c] - mean), 1.0) << x << "," << y;
+			}
+		}
+	}
+	// Auto picks the box filter for whole-factor shrinking
+	EXPECT_EQ(Scale(Options(ScaleFilter::Auto), src, 32, 20).bgra, half.bgra);
+
+	// Nearest tripling repeats every pixel in a 3x3 block
+	Image small = Noise(5, 4, 3, 0);
+	Image tripled = Scale(Options(ScaleFilter::Nearest), small, 15, 12);
+	for (size_t y = 0; y < 12; ++y) {
+		for (size_t x = 0; x < 15; ++x) {
+			ASSERT_TRUE(std::equal(small.At(x / 3, y / 3), small.At(x / 3, y / 3) + 4, tripled.At(x, y))) << x << "," << y;
+		}
+	}
+}
+
+TEST(ImageScalerTest, MatchesDoublePrecisionResampling) {
+	// Q14 weights and two 8-bit roundings stay within 1.5 levels of the exact result
+	for (const SizePair& size : { SizePair{ 120, 80, 300, 170 }, SizePair{ 300, 170, 120, 80 }, SizePair{ 200, 150, 67, 150 } }) {
+		Image src = Waves(size.srcWidth, size.srcHeight);
+		for (ScaleFilter filter : { ScaleFilter::Bilinear, ScaleFilter::Box, ScaleFilter::Lanczos3 }) {
+			std::vector<double> expected = ReferenceScale(filter, src, size.dstWidth, size.dstHeight);
+			Image dst = Scale(Options(filter), src, size.dstWidth, size.dstHeight);
+			double worst = 0.0;
+			for (size_t y = 0; y < dst.height; ++y) {
+				for (size_t i = 0; i < dst.width * 4; ++i) {
+					worst = std::max(worst, std::fabs(dst.At(0, y)[i] - expected[y * dst.width * 4 + i]));
+				}
+			}
+			EXPECT_LE(worst, 1.5) << Describe(filter, src, size.dstWidth, size.dstHeight);
+		}
+	}
+}
+
+TEST(ImageScalerTest, SimdLevelsAndThreadsMatchScalar) {
+	WorkStealingPool::Options poolOptions;
+	poolOptions.threads = 4;
+	WorkStealingPool pool(poolOptions);
+	for (const SizePair& size : kSizes) {
+		Image src = Noise(size.srcWidth, size.srcHeight, static_cast<uint32_t>(size.srcWidth * 7 + size.dstHeight));
+		for (ScaleFilter filter : kFilters) {
+			for (ScaleFit fit : { ScaleFit::Stretch, ScaleFit::Letterbox }) {
+				Image expected = Scale(Options(filter, fit), src, size.dstWidth, size.dstHeight, SimdLevel::Scalar);
+				ExpectPaddingUntouched(expected);
+				for (SimdLevel level : AvailableLevels()) {
+					EXPECT_EQ(Scale(Options(filter, fit), src, size.dstWidth, size.dstHeight, level).bgra, expected.bgra)
+						<< SimdLevelName(level) << " " << Describe(filter, src, size.dstWidth, size.dstHeight);
+					EXPECT_EQ(Scale(Options(filter, fit), src, size.dstWidth, size.dstHeight, level, &pool).bgra, expected.bgra)
+						<< SimdLevelName(level) << " pooled " << Describe(filter, src, size.dstWidth, size.dstHeight);
+				}
+			}
+		}
+	}
+}
+
+TEST(ImageScalerTest, ScaleRegionMatchesAFullScale) {
+	WorkStealingPool::Options poolOptions;
+	poolOptions.threads = 4;
+	WorkStealingPool pool(poolOptions);
+	std::mt19937 random(4);
+	for (const SizePair& size : kSizes) {
+		Image before = Noise(size.srcWidth, size.srcHeight, static_cast<uint32_t>(size.srcHeight * 3 + size.dstWidth));
+		for (ScaleFilter filter : kFilters) {
+			for (ScaleFit fit : { ScaleFit::Stretch, ScaleFit::Letterbox }) {
+				for (WorkStealingPool* threads : { static_cast<WorkStealingPool*>(nullptr), &pool }) {
+					// Regions at the edges, in the middle, a single pixel and the whole image
+					for (int attempt = 0; attempt < 6; ++attempt) {
+						ImageScaler::Rect region;
+						if (attempt == 5) {
+							region.width = size.srcWidth;
+							region.height = size.srcHeight;
+						}
+						else {
+							region.x = random() % size.srcWidth;
+							region.y = random() % size.srcHeight;
+							region.width = attempt == 0 ? 1 : 1 + random() % (size.srcWidth - region.x);
+							region.height = attempt == 0 ? 1 : 1 + random() % (size.srcHeight - region.y);
+						}
+						Image after = before;
+						for (size_t y = region.y; y < region.y + region.height; ++y) {
+							for (size_t x = region.x * 4; x < (region.x + region.width) * 4; ++x) {
+								after.bgra[y * after.stride + x] = static_cast<uint8_t>(random());
+							}
+						}
+
+						ImageScaler scaler(Options(filter, fit), DetectSimdLevel(), threads);
+						Image updated(size.dstWidth, size.dstHeight, 12);
+						scaler.Scale(before.bgra.data(), before.stride, before.width, before.height,
+							updated.bgra.data(), updated.stride, updated.width, updated.height);
+						Image previous = updated;
+						ImageScaler::Rect changed = scaler.ScaleRegion(after.bgra.data(), after.stride, after.width, after.height,
+							updated.bgra.data(), updated.stride, updated.width, updated.height, region);
+						Image expected = Scale(Options(filter, fit), after, size.dstWidth, size.dstHeight);
+
+						std::string what = Describe(filter, before, size.dstWidth, size.dstHeight) + " " + ScaleFitName(fit)
+							+ " region " + std::to_string(region.x) + "," + std::to_string(region.y) + " "
+							+ std::to_string(region.width) + "x" + std::to_string(region.height);
+						ASSERT_EQ(updated.bgra, expected.bgra) << what;
+						// Everything that differs from the previous result lies in the reported rectangle
+						for (size_t y = 0; y < expected.height; ++y) {
+							for (size_t x = 0; x < expected.width; ++x) {
+								bool inside = x >= changed.x && x < changed.x + changed.width
+									&& y >= changed.y && y < changed.y + changed.height;
+								if (!inside) {
+									ASSERT_TRUE(std::equal(previous.At(x, y), previous.At(x, y) + 4, expected.At(x, y)))
+										<< what << " changed outside at " << x << "," << y;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(ImageScalerTest, ScaleFrameMatchesConvertThenScale) {
+	WorkStealingPool::Options poolOptions;
+	poolOptions.threads = 4;
+	WorkStealingPool pool(poolOptions);
+	std::mt19937 random(5);
+	for (const SizePair& size : kSizes) {
+		size_t chroma = ((size.srcWidth + 1) / 2) * ((size.srcHeight + 1) / 2);
+		std::vector<uint8_t> data(size.srcWidth * size.srcHeight + 2 * chroma);
+		for (auto& byte : data) {
+			byte = static_cast<uint8_t>(random());
+		}
+		FrameView frame;
+		frame.data = data.data();
+		frame.width = size.srcWidth;
+		frame.height = size.srcHeight;
+		frame.format = PixelFormat::I420;
+		ASSERT_TRUE(ResolvePlaneLayout(frame, data.size()));
+
+		Image converted(size.srcWidth, size.srcHeight);
+		ASSERT_TRUE(ConvertFrameToBgra(frame, converted.bgra.data(), converted.stride));
+		for (ScaleFilter filter : kFilters) {
+			for (WorkStealingPool* threads : { static_cast<WorkStealingPool*>(nullptr), &pool }) {
+				Image expected = Scale(Options(filter, ScaleFit::Letterbox), converted, size.dstWidth, size.dstHeight,
+					DetectSimdLevel(), threads);
+				ImageScaler scaler(Options(filter, ScaleFit::Letterbox), DetectSimdLevel(), threads);
+				Image dst(size.dstWidth, size.dstHeight, 12);
+				Image retained(size.srcWidth, size.srcHeight);
+				ASSERT_TRUE(scaler.ScaleFrame(frame, retained.bgra.data(), retained.stride,
+					dst.bgra.data(), dst.stride, dst.width, dst.height));
+				EXPECT_EQ(dst.bgra, expected.bgra) << Describe(filter, converted, size.dstWidth, size.dstHeight);
+				EXPECT_EQ(retained.bgra, converted.bgra) << Describe(filter, converted, size.dstWidth, size.dstHeight);
+			}
+		}
+	}
+}
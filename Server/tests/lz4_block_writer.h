@@ -0,0 +1,83 @@
+#pragma once
+
+// An LZ4 block compressor for the tests and benchmarks, which have no liblz4 to produce input for
+// the server's decoder. Greedy with one hash table of 4-byte sequences, like LZ4_compress_fast at
+// its default level: ratios are a little worse than liblz4's, the format is the same, including
+// its end-of-block rules (the last 5 bytes are literals, no match starts in the last 12).
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace lz4_block_writer {
+	constexpr size_t kMinMatch = 4;
+	constexpr size_t kLastLiterals = 5;
+	constexpr size_t kMatchStartLimit = 12;
+	constexpr size_t kMaxOffset = 65535;
+
+	inline void AppendLength(std::vector<uint8_t>& out, size_t length) {
+		for (; length >= 255; length -= 255) {
+			out.push_back(255);
+		}
+		out.push_back(static_cast<uint8_t>(length));
+	}
+
+	// One sequence: literals, then a match of matchLength bytes at offset back (none when 0)
+	inline void AppendSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount,
+		size_t offset, size_t matchLength) {
+		size_t matchCode = offset ? matchLength - kMinMatch : 0;
+		out.push_back(static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4
+			| (matchCode < 15 ? matchCode : 15)));
+		if (literalCount >= 15) {
+			AppendLength(out, literalCount - 15);
+		}
+		out.insert(out.end(), literals, literals + literalCount);
+		if (offset) {
+			out.push_back(static_cast<uint8_t>(offset));
+			out.push_back(static_cast<uint8_t>(offset >> 8));
+			if (matchCode >= 15) {
+				AppendLength(out, matchCode - 15);
+			}
+		}
+	}
+
+	inline uint32_t Read32(const uint8_t* p) {
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+}
+
+inline std::vector<uint8_t> CompressLz4Block(const uint8_t* src, size_t size) {
+	using namespace lz4_block_writer;
+	constexpr size_t kNone = ~size_t(0);
+	std::vector<size_t> table(size_t(1) << 16, kNone);
+	std::vector<uint8_t> out;
+	out.reserve(size + size / 255 + 16);
+
+	size_t anchor = 0;
+	size_t i = 0;
+	while (size > kMatchStartLimit && i < size - kMatchStartLimit) {
+		uint32_t sequence = Read32(src + i);
+		size_t& slot = table[(sequence * 2654435761u) >> 16];
+		size_t candidate = slot;
+		slot = i;
+		if (candidate == kNone || i - candidate > kMaxOffset || Read32(src + candidate) != sequence) {
+			++i;
+			continue;
+		}
+		size_t length = kMinMatch;
+		while (i + length < size - kLastLiterals && src[candidate + length] == src[i + length]) {
+			++length;
+		}
+		AppendSequence(out, src + anchor, i - anchor, i - candidate, length);
+		i += length;
+		anchor = i;
+	}
+	AppendSequence(out, src + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+inline std::vector<uint8_t> CompressLz4Block(const std::vector<uint8_t>& data) {
+	return CompressLz4Block(data.data(), data.size());
+}
@@ -0,0 +1,135 @@
+#include "media_library.h"
+#include "content_hash.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<uint8_t> File(size_t size, uint8_t seed) {
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; ++i) {
+			data[i] = static_cast<uint8_t>(i * 13 + seed);
+		}
+		return data;
+	}
+
+	uint64_t MediaId(const std::vector<uint8_t>& file) {
+		return ComputeXxh3(file.data(), file.size());
+	}
+
+	// Sends the file in chunks as the client does, stopping at the first one refused
+	bool UploadAll(MediaLibrary& library, uint64_t mediaId, const std::vector<uint8_t>& file, size_t chunk,
+		std::string& error) {
+		for (size_t offset = 0; offset < file.size(); offset += chunk) {
+			size_t size = std::min(chunk, file.size() - offset);
+			if (!library.Upload(mediaId, file.size(), offset, file.data() + offset, size, error)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<uint8_t> ReadAll(MediaInput& input) {
+		std::vector<uint8_t> data(static_cast<size_t>(input.Size()));
+		EXPECT_EQ(input.ReadAt(0, data.data(), data.size()), data.size());
+		return data;
+	}
+}
+
+TEST(MediaLibraryTest, UploadWithItsDigestCanBePlayed) {
+	MediaLibrary library(1 << 20, "");
+	std::vector<uint8_t> file = File(10000, 1);
+	std::string error;
+	ASSERT_TRUE(UploadAll(library, MediaId(file), file, 4096, error)) << error;
+
+	auto input = library.OpenUpload(MediaId(file), error);
+	ASSERT_TRUE(input) << error;
+	EXPECT_EQ(ReadAll(*input), file);
+	EXPECT_EQ(library.GetStats().idMismatches, 0u);
+}
+
+TEST(MediaLibraryTest, UploadNotMatchingItsIdIsDiscarded) {
+	MediaLibrary library(1 << 20, "");
+	std::vector<uint8_t> file = File(10000, 1);
+	uint64_t wrongId = MediaId(file) + 1;
+	std::string error;
+	// Only the last chunk can tell
+	EXPECT_TRUE(library.Upload(wrongId, file.size(), 0, file.data(), 6000, error));
+	EXPECT_FALSE(library.Upload(wrongId, file.size(), 6000, file.data() + 6000, 4000, error));
+	EXPECT_EQ(error, "Media id does not match the file");
+
+	EXPECT_FALSE(library.OpenUpload(wrongId, error));
+	MediaLibrary::Stats stats = library.GetStats();
+	EXPECT_EQ(stats.idMismatches, 1u);
+	EXPECT_EQ(stats.uploads, 0u);
+	EXPECT_EQ(stats.bytes, 0u);
+}
+
+TEST(MediaLibraryTest, VerifiedFileIsNotReplaced) {
+	MediaLibrary library(1 << 20, "");
+	std::vector<uint8_t> file = File(10000, 1);
+	uint64_t mediaId = MediaId(file);
+	std::string error;
+	ASSERT_TRUE(UploadAll(library, mediaId, file, 4096, error)) << error;
+
+	// Other content of the same size under the stored id is accepted and dropped
+	std::vector<uint8_t> other = File(file.size(), 2);
+	EXPECT_TRUE(UploadAll(library, mediaId, other, 4096, error));
+	// A different size cannot be the stored file
+	std::vector<uint8_t> shorter = File(500, 1);
+	EXPECT_FALSE(library.Upload(mediaId, shorter.size(), 0, shorter.data(), shorter.size(), error));
+	EXPECT_EQ(library.GetStats().idMismatches, 1u);
+
+	auto input = library.OpenUpload(mediaId, error);
+	ASSERT_TRUE(input) << error;
+	EXPECT_EQ(ReadAll(*input), file);
+}
+
+TEST(MediaLibraryTest, UnfinishedUploadRestartsAtOffsetZero) {
+	MediaLibrary library(1 << 20, "");
+	std::vector<uint8_t> file = File(10000, 1);
+	uint64_t mediaId = MediaId(file);
+	std::string error;
+	std::vector<uint8_t> garbage = File(3000, 9);
+	ASSERT_TRUE(library.Upload(mediaId, file.size(), 0, garbage.data(), garbage.size(), error));
+	EXPECT_FALSE(library.OpenUpload(mediaId, error));
+	EXPECT_EQ(error, "Media upload incomplete");
+
+	ASSERT_TRUE(UploadAll(library, mediaId, file, 4096, error)) << error;
+	auto input = library.OpenUpload(mediaId, error);
+	ASSERT_TRUE(input) << error;
+	EXPECT_EQ(ReadAll(*input), file);
+	EXPECT_EQ(library.GetStats().bytes, file.size());
+}
+
+TEST(MediaLibraryTest, OutOfOrderChunkDiscardsTheUpload) {
+	MediaLibrary library(1 << 20, "");
+	std::vector<uint8_t> file = File(10000, 1);
+	uint64_t mediaId = MediaId(file);
+	std::string error;
+	ASSERT_TRUE(library.Upload(mediaId, file.size(), 0, file.data(), 4096, error));
+	EXPECT_FALSE(library.Upload(mediaId, file.size(), 8192, file.data() + 8192, 1808, error));
+	EXPECT_EQ(error, "Media upload out of order");
+	EXPECT_FALSE(library.Upload(mediaId, file.size(), 4096, file.data() + 4096, 4096, error));
+	EXPECT_EQ(error, "Media not uploaded");
+}
+
+TEST(MediaLibraryTest, OldestUploadIsEvictedOverBudget) {
+	MediaLibrary library(25000, "");
+	std::vector<uint8_t> first = File(10000, 1);
+	std::vector<uint8_t> second = File(10000, 2);
+	std::vector<uint8_t> third = File(10000, 3);
+	std::string error;
+	ASSERT_TRUE(UploadAll(library, MediaId(first), first, 4096, error));
+	ASSERT_TRUE(UploadAll(library, MediaId(second), second, 4096, error));
+	// Opening marks the first as recently used
+	ASSERT_TRUE(library.OpenUpload(MediaId(first), error));
+	ASSERT_TRUE(UploadAll(library, MediaId(third), third, 4096, error));
+
+	EXPECT_TRUE(library.OpenUpload(MediaId(first), error));
+	EXPECT_FALSE(library.OpenUpload(MediaId(second), error));
+	EXPECT_TRUE(library.OpenUpload(MediaId(third), error));
+	EXPECT_EQ(library.GetStats().evictions, 1u);
+}
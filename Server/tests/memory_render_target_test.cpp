@@ -0,0 +1,156 @@
+#include "memory_render_target.h"
+#include "pixel_convert.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+		std::vector<uint8_t> bytes(size);
+		for (auto& byte : bytes) {
+			byte = static_cast<uint8_t>(random());
+		}
+		return bytes;
+	}
+
+	FrameView Bgra(const std::vector<uint8_t>& pixels, size_t width, size_t height) {
+		FrameView view;
+		view.data = pixels.data();
+		view.width = width;
+		view.height = height;
+		view.format = PixelFormat::Bgra32;
+		ResolvePlaneLayout(view, pixels.size());
+		return view;
+	}
+
+	// A rect of random pixels in one of the formats a region update can carry
+	struct TestRect {
+		std::vector<uint8_t> bytes;
+		DirtyRect rect;
+	};
+
+	TestRect MakeRect(std::mt19937& random, size_t frameWidth, size_t frameHeight, PixelFormat format) {
+		std::uniform_int_distribution<size_t> widths(1, frameWidth / 3);
+		std::uniform_int_distribution<size_t> heights(1, frameHeight / 3);
+		TestRect test;
+		size_t width = widths(random);
+		size_t height = heights(random);
+		test.rect.x = std::uniform_int_distribution<size_t>(0, frameWidth - width)(random);
+		test.rect.y = std::uniform_int_distribution<size_t>(0, frameHeight - height)(random);
+		test.bytes = RandomBytes(random, IsYuvFormat(format)
+			? width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2)
+			: width * height * BytesPerPixel(format));
+		test.rect.image.data = test.bytes.data();
+		test.rect.image.width = width;
+		test.rect.image.height = height;
+		test.rect.image.format = format;
+		test.rect.image.colorSpace = { YuvMatrix::Bt709, false };
+		EXPECT_TRUE(ResolvePlaneLayout(test.rect.image, test.bytes.size()));
+		return test;
+	}
+
+	std::string Describe(size_t frameWidth, size_t frameHeight, int clientWidth, int clientHeight, ScaleFilter filter) {
+		return std::to_string(frameWidth) + "x" + std::to_string(frameHeight) + " in " + std::to_string(clientWidth)
+			+ "x" + std::to_string(clientHeight) + " " + ScaleFilterName(filter);
+	}
+}
+
+TEST(MemoryRenderTargetTest, DirtyRectsMatchPresentingTheWholeFrame) {
+	struct Size {
+		size_t frameWidth;
+		size_t frameHeight;
+		int clientWidth;
+		int clientHeight;
+	};
+	// Unscaled, enlarged, reduced and reduced to a non-integer ratio
+	const Size sizes[] = { { 300, 200, 300, 200 }, { 300, 200, 451, 317 }, { 320, 240, 160, 120 }, { 301, 199, 200, 133 } };
+	const ScaleFilter filters[] = { ScaleFilter::Nearest, ScaleFilter::Bilinear, ScaleFilter::Lanczos3 };
+	const PixelFormat formats[] = { PixelFormat::Bgra32, PixelFormat::Rgb24, PixelFormat::Bgr24, PixelFormat::Rgba32,
+		PixelFormat::I420, PixelFormat::Nv12 };
+
+	std::mt19937 random(1);
+	for (const Size& size : sizes) {
+		for (ScaleFilter filter : filters) {
+			ScaleOptions options;
+			options.filter = filter;
+			MemoryRenderTarget patched(size.clientWidth, size.clientHeight, options);
+			MemoryRenderTarget whole(size.clientWidth, size.clientHeight, options);
+			ASSERT_TRUE(patched.Initialize(1));
+			ASSERT_TRUE(whole.Initialize(1));
+
+			size_t stride = size.frameWidth * 4;
+			std::vector<uint8_t> expected = RandomBytes(random, stride * size.frameHeight);
+			ASSERT_TRUE(patched.RenderImageFrame(Bgra(expected, size.frameWidth, size.frameHeight)));
+
+			for (size_t update = 0; update < 6; ++update) {
+				// Several rects per update, overlapping at times; later ones win
+				std::vector<TestRect> rects;
+				std::vector<DirtyRect> dirty;
+				for (size_t i = 0; i < 1 + update % 3; ++i) {
+					rects.push_back(MakeRect(random, size.frameWidth, size.frameHeight, formats[(update + i) % 6]));
+				}
+				for (const TestRect& test : rects) {
+					dirty.push_back(test.rect);
+					ASSERT_TRUE(ConvertFrameToBgra(test.rect.image, expected.data() + test.rect.y * stride + test.rect.x * 4, stride));
+				}
+
+				ASSERT_TRUE(patched.RenderDirtyRects(size.frameWidth, size.frameHeight, dirty));
+				ASSERT_TRUE(whole.RenderImageFrame(Bgra(expected, size.frameWidth, size.frameHeight)));
+				ASSERT_EQ(patched.FrameData(), expected)
+					<< Describe(size.frameWidth, size.frameHeight, size.clientWidth, size.clientHeight, filter);
+				ASSERT_EQ(patched.ClientData(), whole.ClientData())
+					<< Describe(size.frameWidth, size.frameHeight, size.clientWidth, size.clientHeight, filter)
+					<< " update " << update;
+			}
+
+			// A full frame after the updates presents the same picture
+			ASSERT_TRUE(patched.RenderImageFrame(Bgra(expected, size.frameWidth, size.frameHeight)));
+			ASSERT_EQ(patched.ClientData(), whole.ClientData());
+		}
+	}
+}
+
+TEST(MemoryRenderTargetTest, DirtyRectsWriteOnlyTheirPixels) {
+	std::mt19937 random(2);
+	MemoryRenderTarget target(1280, 720);
+	ASSERT_TRUE(target.Initialize(1));
+	std::vector<uint8_t> frame = RandomBytes(random, 640 * 360 * 4);
+	ASSERT_TRUE(target.RenderImageFrame(Bgra(frame, 640, 360)));
+	uint64_t written = target.GetCounters().pixelsWritten;
+	uint64_t scaled = target.GetCounters().pixelsScaled;
+
+	TestRect cursor = MakeRect(random, 640, 360, PixelFormat::Bgra32);
+	cursor.rect.image.width = 16;
+	cursor.rect.image.height = 16;
+	ResolvePlaneLayout(cursor.rect.image, cursor.bytes.size());
+	ASSERT_TRUE(target.RenderDirtyRects(640, 360, { cursor.rect }));
+
+	const MemoryRenderTarget::Counters& counters = target.GetCounters();
+	EXPECT_EQ(counters.regionUpdates, 1u);
+	EXPECT_EQ(counters.pixelsWritten - written, 16u * 16u);
+	// The rect doubled plus the filter's reach, far from the whole client area
+	EXPECT_GE(counters.pixelsScaled - scaled, 32u * 32u);
+	EXPECT_LT(counters.pixelsScaled - scaled, 64u * 64u);
+	ASSERT_EQ(target.PresentedRegions().size(), 1u);
+	EXPECT_EQ(target.PresentedRegions()[0].width, 16u);
+}
+
+TEST(MemoryRenderTargetTest, DirtyRectsNeedAFrameOfTheSameSize) {
+	std::mt19937 random(3);
+	MemoryRenderTarget target(64, 48);
+	ASSERT_TRUE(target.Initialize(1));
+	TestRect test = MakeRect(random, 64, 48, PixelFormat::Bgra32);
+
+	// Nothing to patch yet
+	EXPECT_FALSE(target.RenderDirtyRects(64, 48, { test.rect }));
+
+	std::vector<uint8_t> frame = RandomBytes(random, 64 * 48 * 4);
+	ASSERT_TRUE(target.RenderImageFrame(Bgra(frame, 64, 48)));
+	EXPECT_FALSE(target.RenderDirtyRects(65, 48, { test.rect }));
+	EXPECT_FALSE(target.RenderDirtyRects(64, 47, { test.rect }));
+	EXPECT_EQ(target.FrameData(), frame);
+	EXPECT_TRUE(target.RenderDirtyRects(64, 48, { test.rect }));
+	EXPECT_EQ(target.GetCounters().regionUpdates, 1u);
+}
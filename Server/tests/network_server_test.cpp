@@ -0,0 +1,384 @@
+#include "network_server.h"
+#include "socket_compat.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	using std::chrono::milliseconds;
+
+	bool WaitUntil(const std::function<bool()>& done, milliseconds timeout = milliseconds(10000)) {
+		auto deadline = Clock::now() + timeout;
+		while (!done()) {
+			if (Clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+
+	// Server that echoes every message back to its session
+	class EchoServer {
+	public:
+		explicit EchoServer(size_t maxSessions, size_t ioThreads = 4) {
+			// Ports are shared with whatever else runs on the machine; take the first free one
+			std::mt19937 random(static_cast<uint32_t>(Clock::now().time_since_epoch().count()));
+			for (int attempt = 0; attempt < 50 && !server; ++attempt) {
+				port = static_cast<uint16_t>(20000 + random() % 30000);
+				auto candidate = std::make_unique<NetworkServer>(port, maxSessions, ioThreads);
+				candidate->SetMessageHandler([this](const std::shared_ptr<ClientSession>& session,
+					std::shared_ptr<FrameBuffer> message) {
+					messages++;
+					if (!session->SendMessage(std::string(message->Data(), message->Size()))) {
+						sendFailures++;
+					}
+					});
+				candidate->SetSessionClosedHandler([this](const std::shared_ptr<ClientSession>&) {
+					closed++;
+					});
+				if (candidate->Start()) {
+					server = std::move(candidate);
+				}
+			}
+		}
+
+		~EchoServer() {
+			if (server) {
+				server->Stop();
+			}
+		}
+
+		NetworkServer* operator->() { return server.get(); }
+		explicit operator bool() const { return server != nullptr; }
+
+		uint16_t port = 0;
+		std::atomic<uint64_t> messages{ 0 };
+		std::atomic<uint64_t> sendFailures{ 0 };
+		std::atomic<uint64_t> closed{ 0 };
+
+	private:
+		std::unique_ptr<NetworkServer> server;
+	};
+
+	// Blocking loopback client speaking the length-prefixed protocol
+	class Client {
+	public:
+		explicit Client(uint16_t port) {
+			socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(port);
+			if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+				Close();
+			}
+		}
+
+		~Client() { Close(); }
+
+		bool Connected() const { return socket != kInvalidSocket; }
+
+		void Close() {
+			socket_compat::Close(socket);
+			socket = kInvalidSocket;
+		}
+
+		bool SendAll(const std::string& data) {
+			size_t sent = 0;
+			while (sent < data.size()) {
+				ssize_t n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) {
+					return false;
+				}
+				sent += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		bool SendMessage(const std::string& body) {
+			return SendAll(Framed(body));
+		}
+
+		// Next message, or false once the server closed the connection
+		bool ReceiveMessage(std::string& body) {
+			std::string prefix;
+			if (!ReceiveExact(prefix, 4)) {
+				return false;
+			}
+			const auto* p = reinterpret_cast<const unsigned char*>(prefix.data());
+			size_t length = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<size_t>(p[3]) << 24);
+			return ReceiveExact(body, length);
+		}
+
+		static std::string Framed(const std::string& body) {
+			std::string out(4, '\0');
+			uint32_t length = static_cast<uint32_t>(body.size());
+			for (int i = 0; i < 4; ++i) {
+				out[i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+			}
+			return out + body;
+		}
+
+	private:
+		SocketHandle socket;
+
+		bool ReceiveExact(std::string& out, size_t size) {
+			out.resize(size);
+			size_t received = 0;
+			while (received < size) {
+				ssize_t n = recv(socket, &out[received], size - received, 0);
+				if (n <= 0) {
+					return false;
+				}
+				received += static_cast<size_t>(n);
+			}
+			return true;
+		}
+	};
+
+	std::string Payload(std::mt19937& random, size_t size) {
+		std::string body(size, '\0');
+		for (char& c : body) {
+			c = static_cast<char>(random());
+		}
+		return body;
+	}
+}
+
+TEST(NetworkServerTest, ManyConcurrentClientsEcho) {
+	constexpr size_t kThreads = 8;
+	constexpr size_t kClientsPerThread = 32;
+	constexpr size_t kRounds = 40;
+	constexpr size_t kClients = kThreads * kClientsPerThread;
+	EchoServer server(kClients, 4);
+	ASSERT_TRUE(server);
+
+	std::atomic<size_t> connected{ 0 };
+	std::atomic<size_t> echoed{ 0 };
+	std::atomic<size_t> mismatches{ 0 };
+	std::atomic<bool> allConnected{ false };
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&, t] {
+			std::mt19937 random(static_cast<uint32_t>(t + 1));
+			std::vector<std::unique_ptr<Client>> clients;
+			for (size_t i = 0; i < kClientsPerThread; ++i) {
+				clients.push_back(std::make_unique<Client>(server.port));
+				if (clients.back()->Connected()) {
+					connected++;
+				}
+			}
+			while (!allConnected) {
+				std::this_thread::yield();
+			}
+
+			// Every client has a message in flight at once; some are large enough to span many reads
+			// and to back up the server's send path
+			for (size_t round = 0; round < kRounds; ++round) {
+				std::vector<std::string> sent;
+				for (auto& client : clients) {
+					size_t size = random() % 16 == 0 ? 256 * 1024 + random() % (768 * 1024) : 1 + random() % 4096;
+					sent.push_back(Payload(random, size));
+					if (!client->SendMessage(sent.back())) {
+						mismatches++;
+					}
+				}
+				for (size_t i = 0; i < clients.size(); ++i) {
+					std::string reply;
+					if (clients[i]->ReceiveMessage(reply) && reply == sent[i]) {
+						echoed++;
+					}
+					else {
+						mismatches++;
+					}
+				}
+			}
+		});
+	}
+
+	ASSERT_TRUE(WaitUntil([&] { return connected == kClients && server->SessionCount() == kClients; }));
+	allConnected = true;
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(mismatches, 0u);
+	EXPECT_EQ(echoed, kClients * kRounds);
+	EXPECT_EQ(server.messages, kClients * kRounds);
+	// Clients closed when their threads ended
+	ASSERT_TRUE(WaitUntil([&] { return server.closed == kClients; }));
+	EXPECT_EQ(server->SessionCount(), 0u);
+}
+
+TEST(NetworkServerTest, StatsCountEachSession) {
+	EchoServer server(8, 2);
+	ASSERT_TRUE(server);
+	Client client(server.port);
+	ASSERT_TRUE(client.Connected());
+
+	std::string reply;
+	for (int i = 0; i < 10; ++i) {
+		ASSERT_TRUE(client.SendMessage(std::string(100, 'x')));
+		ASSERT_TRUE(client.ReceiveMessage(reply));
+	}
+	// The reply can arrive before the sender has counted it
+	std::vector<ClientSession::Stats> stats;
+	ASSERT_TRUE(WaitUntil([&] {
+		stats = server->GetSessionStats();
+		return stats.size() == 1 && stats[0].messagesSent == 10;
+		}));
+	EXPECT_EQ(stats[0].messagesReceived, 10u);
+	EXPECT_EQ(stats[0].bytesReceived, 10u * 104);
+	EXPECT_EQ(stats[0].messagesSent, 10u);
+	EXPECT_EQ(stats[0].bytesSent, 10u * 104);
+	// Small bodies come in with their prefix and are copied out of the assembler at most once
+	EXPECT_LE(stats[0].bytesCopied, 10u * 100);
+}
+
+TEST(NetworkServerTest, BodiesReceivedStraightIntoPooledBuffers) {
+	// Empty, small and large bodies back to back in one send: each body is received into its own
+	// buffer from whatever the previous read brought in past its prefix
+	EchoServer server(4, 2);
+	ASSERT_TRUE(server);
+	Client client(server.port);
+	ASSERT_TRUE(client.Connected());
+
+	std::mt19937 random(7);
+	std::vector<std::string> bodies = { "", Payload(random, 3), Payload(random, 3 * 1024 * 1024 + 5), "",
+		Payload(random, 70000), Payload(random, 1) };
+	std::string stream;
+	for (const std::string& body : bodies) {
+		stream += Client::Framed(body);
+	}
+	ASSERT_TRUE(client.SendAll(stream));
+	for (const std::string& body : bodies) {
+		std::string reply;
+		ASSERT_TRUE(client.ReceiveMessage(reply));
+		EXPECT_EQ(reply, body);
+	}
+	EXPECT_EQ(server.messages, bodies.size());
+}
+
+TEST(NetworkServerTest, SessionLimitRejectsExtraClients) {
+	EchoServer server(2, 2);
+	ASSERT_TRUE(server);
+	Client first(server.port);
+	Client second(server.port);
+	ASSERT_TRUE(WaitUntil([&] { return server->SessionCount() == 2; }));
+
+	// The extra connection is accepted by the kernel and closed by the server right away
+	Client third(server.port);
+	ASSERT_TRUE(third.Connected());
+	std::string reply;
+	third.SendMessage("hello");
+	EXPECT_FALSE(third.ReceiveMessage(reply));
+
+	ASSERT_TRUE(first.SendMessage("hello"));
+	ASSERT_TRUE(first.ReceiveMessage(reply));
+	EXPECT_EQ(reply, "hello");
+	EXPECT_EQ(server->SessionCount(), 2u);
+}
+
+TEST(NetworkServerTest, AbruptDisconnectsLeaveOtherClientsAlone) {
+	constexpr size_t kQuitters = 64;
+	EchoServer server(kQuitters + 1, 4);
+	ASSERT_TRUE(server);
+	Client survivor(server.port);
+	ASSERT_TRUE(survivor.Connected());
+
+	// Each of these hangs up halfway through a message
+	std::vector<std::unique_ptr<Client>> quitters;
+	for (size_t i = 0; i < kQuitters; ++i) {
+		quitters.push_back(std::make_unique<Client>(server.port));
+		std::string partial = Client::Framed(std::string(10000, 'q')).substr(0, 4 + 5000);
+		ASSERT_TRUE(quitters.back()->SendAll(partial));
+	}
+	ASSERT_TRUE(WaitUntil([&] { return server->SessionCount() == kQuitters + 1; }));
+	quitters.clear();
+
+	ASSERT_TRUE(WaitUntil([&] { return server.closed == kQuitters; }));
+	EXPECT_EQ(server.messages, 0u);
+	std::string reply;
+	ASSERT_TRUE(survivor.SendMessage("still here"));
+	ASSERT_TRUE(survivor.ReceiveMessage(reply));
+	EXPECT_EQ(reply, "still here");
+	EXPECT_EQ(server->SessionCount(), 1u);
+}
+
+TEST(NetworkServerTest, InvalidLengthDropsOnlyThatClient) {
+	EchoServer server(4, 2);
+	ASSERT_TRUE(server);
+	Client good(server.port);
+	Client bad(server.port);
+	ASSERT_TRUE(WaitUntil([&] { return server->SessionCount() == 2; }));
+
+	// Longer than any message the server accepts
+	ASSERT_TRUE(bad.SendAll(std::string("\xff\xff\xff\x7f", 4)));
+	std::string reply;
+	EXPECT_FALSE(bad.ReceiveMessage(reply));
+	ASSERT_TRUE(WaitUntil([&] { return server.closed == 1; }));
+
+	ASSERT_TRUE(good.SendMessage("ok"));
+	ASSERT_TRUE(good.ReceiveMessage(reply));
+	EXPECT_EQ(reply, "ok");
+}
+
+TEST(NetworkServerTest, PeerThatStopsReadingIsDropped) {
+	EchoServer server(4, 2);
+	ASSERT_TRUE(server);
+	Client reader(server.port);
+	Client stalled(server.port);
+	ASSERT_TRUE(WaitUntil([&] { return server->SessionCount() == 2; }));
+
+	// Echoes pile up on the server until the queue cap is reached; socket buffers take a few MB more
+	const std::string body(256 * 1024, 's');
+	size_t sent = 0;
+	while (sent < 4 * Reactor::kMaxQueuedSendBytes && stalled.SendMessage(body)) {
+		sent += body.size();
+	}
+	ASSERT_TRUE(WaitUntil([&] { return server.closed == 1; }));
+	EXPECT_GE(server.sendFailures, 1u);
+	EXPECT_LT(sent, 4 * Reactor::kMaxQueuedSendBytes);
+
+	std::string reply;
+	ASSERT_TRUE(reader.SendMessage("ok"));
+	ASSERT_TRUE(reader.ReceiveMessage(reply));
+	EXPECT_EQ(reply, "ok");
+}
+
+TEST(NetworkServerTest, SlowReaderWithinTheCapGetsEverything) {
+	EchoServer server(4, 2);
+	ASSERT_TRUE(server);
+	Client client(server.port);
+	ASSERT_TRUE(client.Connected());
+
+	// Keeps the queue partly drained but never empty, so sent bytes must not accumulate in it
+	constexpr size_t kMessages = 400;
+	const std::string body(64 * 1024, 'r');
+	std::thread writer([&] {
+		for (size_t i = 0; i < kMessages; ++i) {
+			client.SendMessage(body);
+		}
+	});
+	size_t received = 0;
+	std::string reply;
+	while (received < kMessages && client.ReceiveMessage(reply)) {
+		EXPECT_EQ(reply.size(), body.size());
+		++received;
+		if (received % 16 == 0) {
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+	}
+	writer.join();
+	EXPECT_EQ(received, kMessages);
+	EXPECT_EQ(server.sendFailures, 0u);
+	EXPECT_EQ(server.closed, 0u);
+}
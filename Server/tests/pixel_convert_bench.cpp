@@ -0,0 +1,84 @@
+// Throughput of the pixel format conversions at each SIMD level this CPU runs, single threaded,
+// for a 1920x1080 frame. Rates are source bytes read plus BGRA bytes written per second.
+#include "pixel_convert.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct Source {
+		const char* name;
+		FrameView view;
+		size_t bytes;
+	};
+
+	Source Prepare(const char* name, PixelFormat format, size_t width, size_t height, std::vector<uint8_t>& storage) {
+		FrameView view;
+		view.width = width;
+		view.height = height;
+		view.format = format;
+		view.colorSpace = { YuvMatrix::Bt709, false };
+		size_t bytes = IsYuvFormat(format)
+			? width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2)
+			: width * height * BytesPerPixel(format);
+		storage.resize(bytes);
+		std::mt19937 random(1);
+		for (auto& byte : storage) {
+			byte = static_cast<uint8_t>(random());
+		}
+		view.data = storage.data();
+		ResolvePlaneLayout(view, bytes);
+		return { name, view, bytes };
+	}
+
+	double Measure(SimdLevel level, const Source& source, std::vector<uint8_t>& dst, double seconds) {
+		size_t stride = source.view.width * 4;
+		size_t frames = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			ConvertFrameToBgra(level, source.view, dst.data(), stride);
+			++frames;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		double bytes = static_cast<double>(frames) * (source.bytes + dst.size());
+		return bytes / elapsed.count() / 1e9;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 1.0;
+	constexpr size_t kWidth = 1920;
+	constexpr size_t kHeight = 1080;
+
+	std::vector<uint8_t> storage[6];
+	Source sources[] = {
+		Prepare("RGB24", PixelFormat::Rgb24, kWidth, kHeight, storage[0]),
+		Prepare("BGR24", PixelFormat::Bgr24, kWidth, kHeight, storage[1]),
+		Prepare("RGBA32", PixelFormat::Rgba32, kWidth, kHeight, storage[2]),
+		Prepare("BGRA32", PixelFormat::Bgra32, kWidth, kHeight, storage[3]),
+		Prepare("I420", PixelFormat::I420, kWidth, kHeight, storage[4]),
+		Prepare("NV12", PixelFormat::Nv12, kWidth, kHeight, storage[5]),
+	};
+	std::vector<uint8_t> dst(kWidth * kHeight * 4);
+
+	std::printf("%zux%zu, best level on this CPU: %s\n", kWidth, kHeight, SimdLevelName(DetectSimdLevel()));
+	std::printf("%-8s %11s %11s %11s\n", "format", "scalar", "SSSE3", "AVX2");
+	for (const Source& source : sources) {
+		std::printf("%-8s", source.name);
+		for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Ssse3, SimdLevel::Avx2 }) {
+			if (level > DetectSimdLevel()) {
+				std::printf(" %11s", "-");
+				continue;
+			}
+			std::printf(" %6.2f GB/s", Measure(level, source, dst, seconds));
+		}
+		std::printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,463 @@
+#include "pixel_convert.h"
+#include "work_stealing_pool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+	constexpr uint8_t kUntouched = 0xCD;
+
+	// Every level this CPU runs, scalar first; higher levels are compared against it
+	std::vector<SimdLevel> AvailableLevels() {
+		std::vector<SimdLevel> levels{ SimdLevel::Scalar };
+		if (DetectSimdLevel() >= SimdLevel::Ssse3) {
+			levels.push_back(SimdLevel::Ssse3);
+		}
+		if (DetectSimdLevel() >= SimdLevel::Avx2) {
+			levels.push_back(SimdLevel::Avx2);
+		}
+		return levels;
+	}
+
+	// Widths around the 16 and 32 pixel SIMD blocks plus random odd ones
+	std::vector<size_t> TestWidths(std::mt19937& random) {
+		std::vector<size_t> widths{ 1, 2, 3, 5, 7, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 95, 127, 129 };
+		std::uniform_int_distribution<size_t> odd(0, 400);
+		for (int i = 0; i < 16; ++i) {
+			widths.push_back(odd(random) * 2 + 1);
+		}
+		return widths;
+	}
+
+	std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+		std::vector<uint8_t> bytes(size);
+		for (auto& byte : bytes) {
+			byte = static_cast<uint8_t>(random());
+		}
+		return bytes;
+	}
+
+	// Size of a plane whose last row is not padded, like a decoder buffer cut right after it
+	size_t PlaneBytes(size_t rowBytes, size_t stride, size_t rows) {
+		return stride * (rows - 1) + rowBytes;
+	}
+
+	// A random frame with padded strides; YUV planes are placed with gaps between them.
+	// The buffer is exactly as large as the layout needs so overreads show up under ASan.
+	struct TestFrame {
+		std::vector<uint8_t> bytes;
+		FrameView view;
+	};
+
+	TestFrame MakeFrame(std::mt19937& random, PixelFormat format, size_t width, size_t height,
+		YuvColorSpace colorSpace = {}) {
+		std::uniform_int_distribution<size_t> padding(0, 37);
+		TestFrame frame;
+		frame.view.width = width;
+		frame.view.height = height;
+		frame.view.format = format;
+		frame.view.colorSpace = colorSpace;
+
+		size_t chromaWidth = (width + 1) / 2;
+		size_t chromaHeight = (height + 1) / 2;
+		size_t rowBytes[kMaxPlanes] = { width * BytesPerPixel(format) };
+		size_t rows[kMaxPlanes] = { height };
+		if (IsYuvFormat(format)) {
+			rowBytes[0] = width;
+			rowBytes[1] = format == PixelFormat::Nv12 ? chromaWidth * 2 : chromaWidth;
+			rowBytes[2] = chromaWidth;
+			rows[1] = rows[2] = chromaHeight;
+		}
+
+		size_t size = 0;
+		for (size_t plane = 0; plane < PlaneCount(format); ++plane) {
+			size += plane == 0 ? 0 : padding(random);
+			frame.view.planeOffsets[plane] = size;
+			frame.view.strides[plane] = rowBytes[plane] + padding(random);
+			size += PlaneBytes(rowBytes[plane], frame.view.strides[plane], rows[plane]);
+		}
+		frame.bytes = RandomBytes(random, size);
+		frame.view.data = frame.bytes.data();
+		return frame;
+	}
+
+	struct Output {
+		std::vector<uint8_t> pixels;
+		size_t stride = 0;
+	};
+
+	Output Convert(SimdLevel level, const FrameView& frame, size_t padding) {
+		Output out;
+		out.stride = frame.width * 4 + padding;
+		out.pixels.assign(out.stride * frame.height, kUntouched);
+		EXPECT_TRUE(ConvertFrameToBgra(level, frame, out.pixels.data(), out.stride));
+		return out;
+	}
+
+	// Row padding of the output must be left alone
+	void ExpectPaddingUntouched(const Output& out, size_t width) {
+		for (size_t offset = 0; offset < out.pixels.size(); offset += out.stride) {
+			for (size_t x = width * 4; x < out.stride; ++x) {
+				ASSERT_EQ(out.pixels[offset + x], kUntouched) << "row " << offset / out.stride << " byte " << x;
+			}
+		}
+	}
+
+	std::string Describe(SimdLevel level, PixelFormat format, size_t width, size_t height) {
+		return std::string(SimdLevelName(level)) + " format " + std::to_string(static_cast<int>(format))
+			+ " " + std::to_string(width) + "x" + std::to_string(height);
+	}
+
+	// Reference YUV math in double precision, with the matrices and ranges of pixel_format.h
+	struct Rgb {
+		double r;
+		double g;
+		double b;
+	};
+
+	struct Yuv {
+		uint8_t y;
+		uint8_t u;
+		uint8_t v;
+	};
+
+	void MatrixWeights(const YuvColorSpace& colorSpace, double& kr, double& kb) {
+		kr = colorSpace.matrix == YuvMatrix::Bt709 ? 0.2126 : 0.299;
+		kb = colorSpace.matrix == YuvMatrix::Bt709 ? 0.0722 : 0.114;
+	}
+
+	uint8_t RoundToByte(double value) {
+		return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0), 255.0)));
+	}
+
+	Yuv EncodeYuv(const Rgb& rgb, const YuvColorSpace& colorSpace) {
+		double kr, kb;
+		MatrixWeights(colorSpace, kr, kb);
+		double luma = (kr * rgb.r + (1.0 - kr - kb) * rgb.g + kb * rgb.b) / 255.0;
+		double cb = (rgb.b / 255.0 - luma) / (2.0 * (1.0 - kb));
+		double cr = (rgb.r / 255.0 - luma) / (2.0 * (1.0 - kr));
+		if (colorSpace.fullRange) {
+			return { RoundToByte(luma * 255.0), RoundToByte(128.0 + cb * 255.0), RoundToByte(128.0 + cr * 255.0) };
+		}
+		return { RoundToByte(16.0 + luma * 219.0), RoundToByte(128.0 + cb * 224.0), RoundToByte(128.0 + cr * 224.0) };
+	}
+
+	Rgb DecodeYuv(const Yuv& yuv, const YuvColorSpace& colorSpace) {
+		double kr, kb;
+		MatrixWeights(colorSpace, kr, kb);
+		double kg = 1.0 - kr - kb;
+		double luma = colorSpace.fullRange ? yuv.y : (yuv.y - 16.0) * 255.0 / 219.0;
+		double chromaScale = colorSpace.fullRange ? 1.0 : 255.0 / 224.0;
+		double cb = (yuv.u - 128.0) * chromaScale;
+		double cr = (yuv.v - 128.0) * chromaScale;
+		auto clamp = [](double value) { return std::min(std::max(value, 0.0), 255.0); };
+		return {
+			clamp(luma + 2.0 * (1.0 - kr) * cr),
+			clamp(luma - 2.0 * (1.0 - kb) * kb / kg * cb - 2.0 * (1.0 - kr) * kr / kg * cr),
+			clamp(luma + 2.0 * (1.0 - kb) * cb) };
+	}
+
+	// A tightly packed YUV frame; pixelAt gives each pixel's luma, and the chroma of a 2x2 block
+	// comes from its top-left pixel
+	template <typename PixelAt>
+	TestFrame MakeYuvFrame(PixelFormat format, const YuvColorSpace& colorSpace, size_t width, size_t height,
+		PixelAt pixelAt) {
+		size_t chromaWidth = (width + 1) / 2;
+		size_t chromaHeight = (height + 1) / 2;
+		TestFrame frame;
+		frame.bytes.resize(width * height + 2 * chromaWidth * chromaHeight);
+		uint8_t* luma = frame.bytes.data();
+		uint8_t* chroma = luma + width * height;
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				Yuv yuv = pixelAt(x, y);
+				luma[y * width + x] = yuv.y;
+				if (x % 2 == 0 && y % 2 == 0) {
+					size_t c = (y / 2) * chromaWidth + x / 2;
+					if (format == PixelFormat::Nv12) {
+						chroma[2 * c] = yuv.u;
+						chroma[2 * c + 1] = yuv.v;
+					}
+					else {
+						chroma[c] = yuv.u;
+						chroma[chromaWidth * chromaHeight + c] = yuv.v;
+					}
+				}
+			}
+		}
+		frame.view.data = frame.bytes.data();
+		frame.view.width = width;
+		frame.view.height = height;
+		frame.view.format = format;
+		frame.view.colorSpace = colorSpace;
+		EXPECT_TRUE(ResolvePlaneLayout(frame.view, frame.bytes.size()));
+		return frame;
+	}
+
+	// Largest difference from the reference over the color channels; alpha must be opaque
+	double PixelError(const uint8_t* bgra, const Rgb& expected) {
+		EXPECT_EQ(bgra[3], 0xFF);
+		return std::max({ std::abs(bgra[2] - expected.r), std::abs(bgra[1] - expected.g), std::abs(bgra[0] - expected.b) });
+	}
+
+	std::string Describe(const YuvColorSpace& colorSpace) {
+		return std::string(colorSpace.matrix == YuvMatrix::Bt709 ? " BT.709" : " BT.601")
+			+ (colorSpace.fullRange ? " full" : " limited");
+	}
+
+	// The 6-bit luma scale of limited range is 0.6% high and each chroma coefficient is up to
+	// half a step off; together they reach 2.9 levels at the extremes of the legal range
+	constexpr double kYuvTolerance = 3.0;
+
+	const YuvColorSpace kColorSpaces[] = {
+		{ YuvMatrix::Bt601, false }, { YuvMatrix::Bt601, true }, { YuvMatrix::Bt709, false }, { YuvMatrix::Bt709, true } };
+
+	const PixelFormat kPackedFormats[] = { PixelFormat::Rgb24, PixelFormat::Bgr24, PixelFormat::Rgba32, PixelFormat::Bgra32 };
+	const PixelFormat kYuvFormats[] = { PixelFormat::I420, PixelFormat::Nv12 };
+}
+
+TEST(PixelConvertTest, ScalarPackedFormatsSwapChannels) {
+	std::mt19937 random(1);
+	for (PixelFormat format : kPackedFormats) {
+		TestFrame frame = MakeFrame(random, format, 37, 3);
+		Output out = Convert(SimdLevel::Scalar, frame.view, 12);
+		size_t bpp = BytesPerPixel(format);
+		bool swap = format == PixelFormat::Rgb24 || format == PixelFormat::Rgba32;
+		for (size_t y = 0; y < frame.view.height; ++y) {
+			for (size_t x = 0; x < frame.view.width; ++x) {
+				const uint8_t* src = frame.view.data + y * frame.view.strides[0] + x * bpp;
+				const uint8_t* dst = out.pixels.data() + y * out.stride + x * 4;
+				ASSERT_EQ(dst[0], src[swap ? 2 : 0]);
+				ASSERT_EQ(dst[1], src[1]);
+				ASSERT_EQ(dst[2], src[swap ? 0 : 2]);
+				ASSERT_EQ(dst[3], bpp == 4 ? src[3] : 0xFF);
+			}
+		}
+		ExpectPaddingUntouched(out, frame.view.width);
+	}
+}
+
+TEST(PixelConvertTest, SimdPackedFormatsMatchScalar) {
+	std::mt19937 random(2);
+	std::uniform_int_distribution<size_t> heights(1, 6);
+	std::uniform_int_distribution<size_t> padding(0, 29);
+	for (PixelFormat format : kPackedFormats) {
+		for (size_t width : TestWidths(random)) {
+			TestFrame frame = MakeFrame(random, format, width, heights(random));
+			size_t dstPadding = padding(random);
+			Output expected = Convert(SimdLevel::Scalar, frame.view, dstPadding);
+			for (SimdLevel level : AvailableLevels()) {
+				Output actual = Convert(level, frame.view, dstPadding);
+				ASSERT_EQ(actual.pixels, expected.pixels) << Describe(level, format, width, frame.view.height);
+				ExpectPaddingUntouched(actual, width);
+			}
+		}
+	}
+}
+
+TEST(PixelConvertTest, SimdYuvFormatsMatchScalar) {
+	std::mt19937 random(3);
+	std::uniform_int_distribution<size_t> heights(1, 7);
+	std::uniform_int_distribution<size_t> padding(0, 29);
+	for (PixelFormat format : kYuvFormats) {
+		for (const YuvColorSpace& colorSpace : kColorSpaces) {
+			for (size_t width : TestWidths(random)) {
+				// Random bytes include out-of-range YUV, which drives the saturating paths
+				TestFrame frame = MakeFrame(random, format, width, heights(random), colorSpace);
+				size_t dstPadding = padding(random);
+				Output expected = Convert(SimdLevel::Scalar, frame.view, dstPadding);
+				for (SimdLevel level : AvailableLevels()) {
+					Output actual = Convert(level, frame.view, dstPadding);
+					ASSERT_EQ(actual.pixels, expected.pixels) << Describe(level, format, width, frame.view.height)
+						<< Describe(colorSpace);
+					ExpectPaddingUntouched(actual, width);
+				}
+			}
+		}
+	}
+}
+
+TEST(PixelConvertTest, PaddedFramesConvertLikeTightOnes) {
+	std::mt19937 random(8);
+	std::uniform_int_distribution<size_t> sizes(1, 40);
+	for (PixelFormat format : { PixelFormat::Rgb24, PixelFormat::Bgr24, PixelFormat::Rgba32, PixelFormat::Bgra32,
+		PixelFormat::I420, PixelFormat::Nv12 }) {
+		for (int i = 0; i < 20; ++i) {
+			size_t width = sizes(random) * 2 + 1;
+			size_t height = sizes(random) | 1;
+			TestFrame padded = MakeFrame(random, format, width, height);
+			if (format == PixelFormat::I420 && i % 2) {
+				// V before U
+				std::swap(padded.view.planeOffsets[1], padded.view.planeOffsets[2]);
+				std::swap(padded.view.strides[1], padded.view.strides[2]);
+			}
+			ASSERT_TRUE(ResolvePlaneLayout(padded.view, padded.bytes.size()));
+
+			// The same pixels repacked without padding, the layout producers had to send before strides
+			TestFrame tight;
+			tight.view.width = width;
+			tight.view.height = height;
+			tight.view.format = format;
+			for (size_t plane = 0; plane < PlaneCount(format); ++plane) {
+				FrameView probe = tight.view;
+				ASSERT_TRUE(ResolvePlaneLayout(probe, SIZE_MAX));
+				size_t rows = plane == 0 ? height : (height + 1) / 2;
+				size_t rowBytes = probe.strides[plane];
+				for (size_t row = 0; row < rows; ++row) {
+					const uint8_t* src = padded.view.data + padded.view.planeOffsets[plane] + row * padded.view.strides[plane];
+					tight.bytes.insert(tight.bytes.end(), src, src + rowBytes);
+				}
+			}
+			tight.view.data = tight.bytes.data();
+			ASSERT_TRUE(ResolvePlaneLayout(tight.view, tight.bytes.size()));
+
+			for (SimdLevel level : AvailableLevels()) {
+				EXPECT_EQ(Convert(level, padded.view, 0).pixels, Convert(level, tight.view, 0).pixels)
+					<< Describe(level, format, width, height);
+			}
+		}
+	}
+}
+
+TEST(PixelConvertTest, RowStripsMatchWholeFrame) {
+	std::mt19937 random(4);
+	for (PixelFormat format : { PixelFormat::Rgb24, PixelFormat::Rgba32, PixelFormat::I420, PixelFormat::Nv12 }) {
+		TestFrame frame = MakeFrame(random, format, 77, 13);
+		for (SimdLevel level : AvailableLevels()) {
+			Output whole = Convert(level, frame.view, 8);
+
+			// Strips starting on odd rows share a chroma row with the strip before them
+			Output strips;
+			strips.stride = whole.stride;
+			strips.pixels.assign(whole.pixels.size(), kUntouched);
+			for (size_t first = 0, rows = 1; first < frame.view.height; first += rows, rows = rows % 4 + 1) {
+				rows = std::min(rows, frame.view.height - first);
+				ASSERT_TRUE(ConvertFrameRowsToBgra(level, frame.view, first, rows,
+					strips.pixels.data() + first * strips.stride, strips.stride));
+			}
+			EXPECT_EQ(strips.pixels, whole.pixels) << Describe(level, format, 77, 13);
+		}
+		EXPECT_FALSE(ConvertFrameRowsToBgra(SimdLevel::Scalar, frame.view, 10, 4, nullptr, 0));
+	}
+}
+
+TEST(PixelConvertTest, ParallelConversionMatchesSerial) {
+	std::mt19937 random(5);
+	WorkStealingPool::Options options;
+	options.threads = 4;
+	WorkStealingPool pool(options);
+	for (PixelFormat format : { PixelFormat::Bgr24, PixelFormat::I420, PixelFormat::Nv12 }) {
+		TestFrame frame = MakeFrame(random, format, 333, 301);
+		Output serial = Convert(DetectSimdLevel(), frame.view, 4);
+		std::vector<uint8_t> parallel(serial.pixels.size(), kUntouched);
+		ASSERT_TRUE(ConvertFrameToBgra(&pool, frame.view, parallel.data(), serial.stride));
+		EXPECT_EQ(parallel, serial.pixels);
+	}
+}
+
+TEST(PixelConvertTest, RequestedLevelIsClampedToTheCpu) {
+	std::mt19937 random(6);
+	TestFrame frame = MakeFrame(random, PixelFormat::Rgb24, 65, 2);
+	// Asking for AVX2 on a CPU without it must fall back rather than fault
+	Output expected = Convert(SimdLevel::Scalar, frame.view, 0);
+	EXPECT_EQ(Convert(SimdLevel::Avx2, frame.view, 0).pixels, expected.pixels);
+}
+
+TEST(PixelConvertTest, YuvColorBarsDecodeToTheirColors) {
+	// 75% color bars, six pixels each, and a last column that has a chroma sample of its own
+	const Rgb bars[] = { { 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+		{ 191, 0, 191 }, { 191, 0, 0 }, { 0, 0, 191 }, { 0, 0, 0 } };
+	constexpr size_t kBarWidth = 6;
+	constexpr size_t kWidth = 8 * kBarWidth + 1;
+	constexpr size_t kHeight = 5;
+	auto barAt = [&](size_t x) { return bars[std::min<size_t>(x / kBarWidth, 7)]; };
+
+	for (PixelFormat format : kYuvFormats) {
+		for (const YuvColorSpace& colorSpace : kColorSpaces) {
+			TestFrame frame = MakeYuvFrame(format, colorSpace, kWidth, kHeight,
+				[&](size_t x, size_t) { return EncodeYuv(barAt(x), colorSpace); });
+			for (SimdLevel level : AvailableLevels()) {
+				Output out = Convert(level, frame.view, 0);
+				for (size_t y = 0; y < kHeight; ++y) {
+					for (size_t x = 0; x < kWidth; ++x) {
+						// Encoding rounds to whole code values, which adds to the decoder's own error
+						ASSERT_LE(PixelError(out.pixels.data() + y * out.stride + x * 4, barAt(x)), kYuvTolerance + 1.0)
+							<< Describe(level, format, x, y) << Describe(colorSpace);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(PixelConvertTest, YuvMatchesFloatingPointReference) {
+	std::mt19937 random(7);
+	constexpr size_t kWidth = 131;
+	constexpr size_t kHeight = 67;
+	for (PixelFormat format : kYuvFormats) {
+		for (const YuvColorSpace& colorSpace : kColorSpaces) {
+			// Code values within the legal range of the color space, so the reference needs no clamping
+			int lumaMin = colorSpace.fullRange ? 0 : 16;
+			int lumaMax = colorSpace.fullRange ? 255 : 235;
+			int chromaMin = colorSpace.fullRange ? 0 : 16;
+			int chromaMax = colorSpace.fullRange ? 255 : 240;
+			std::uniform_int_distribution<int> luma(lumaMin, lumaMax);
+			std::uniform_int_distribution<int> chroma(chromaMin, chromaMax);
+			std::vector<Yuv> pixels(kWidth * kHeight);
+			for (auto& pixel : pixels) {
+				pixel = { static_cast<uint8_t>(luma(random)), static_cast<uint8_t>(chroma(random)), static_cast<uint8_t>(chroma(random)) };
+			}
+			// Each pixel is decoded with the chroma of its 2x2 block
+			auto sampled = [&](size_t x, size_t y) {
+				Yuv yuv = pixels[y * kWidth + x];
+				const Yuv& block = pixels[(y & ~size_t(1)) * kWidth + (x & ~size_t(1))];
+				return Yuv{ yuv.y, block.u, block.v };
+			};
+			TestFrame frame = MakeYuvFrame(format, colorSpace, kWidth, kHeight, sampled);
+
+			for (SimdLevel level : AvailableLevels()) {
+				Output out = Convert(level, frame.view, 0);
+				double maxError = 0.0;
+				for (size_t y = 0; y < kHeight; ++y) {
+					for (size_t x = 0; x < kWidth; ++x) {
+						Rgb expected = DecodeYuv(sampled(x, y), colorSpace);
+						maxError = std::max(maxError, PixelError(out.pixels.data() + y * out.stride + x * 4, expected));
+					}
+				}
+				EXPECT_LE(maxError, kYuvTolerance) << Describe(level, format, kWidth, kHeight) << Describe(colorSpace);
+			}
+		}
+	}
+}
+
+TEST(PixelConvertTest, YuvRangeAndMatrixAreHonoured) {
+	auto decode = [](const Yuv& yuv, const YuvColorSpace& colorSpace) {
+		TestFrame frame = MakeYuvFrame(PixelFormat::I420, colorSpace, 2, 2, [&](size_t, size_t) { return yuv; });
+		Output out = Convert(SimdLevel::Scalar, frame.view, 0);
+		return std::vector<int>{ out.pixels[2], out.pixels[1], out.pixels[0] };
+	};
+	const YuvColorSpace limited601{ YuvMatrix::Bt601, false };
+	const YuvColorSpace full601{ YuvMatrix::Bt601, true };
+	const YuvColorSpace limited709{ YuvMatrix::Bt709, false };
+
+	// Limited range stretches 16-235 to the full scale; full range takes code values as they are
+	EXPECT_EQ(decode({ 16, 128, 128 }, limited601), (std::vector<int>{ 0, 0, 0 }));
+	EXPECT_EQ(decode({ 235, 128, 128 }, limited601), (std::vector<int>{ 255, 255, 255 }));
+	EXPECT_EQ(decode({ 16, 128, 128 }, full601), (std::vector<int>{ 16, 16, 16 }));
+	EXPECT_EQ(decode({ 255, 128, 128 }, full601), (std::vector<int>{ 255, 255, 255 }));
+	// Below-black and above-white code values clamp
+	EXPECT_EQ(decode({ 0, 128, 128 }, limited601), (std::vector<int>{ 0, 0, 0 }));
+	EXPECT_EQ(decode({ 255, 128, 128 }, limited601), (std::vector<int>{ 255, 255, 255 }));
+
+	// A BT.709 green read with the BT.601 matrix comes out visibly wrong
+	Yuv green = EncodeYuv({ 60, 200, 40 }, limited709);
+	std::vector<int> right = decode(green, limited709);
+	std::vector<int> wrong = decode(green, limited601);
+	EXPECT_LE(std::abs(right[0] - 60) + std::abs(right[1] - 200) + std::abs(right[2] - 40), 6);
+	EXPECT_GT(std::abs(wrong[0] - right[0]) + std::abs(wrong[1] - right[1]) + std::abs(wrong[2] - right[2]), 20);
+}
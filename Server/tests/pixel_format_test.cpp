@@ -0,0 +1,181 @@
+#include "pixel_format.h"
+#include "raw_frame.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace {
+	FrameView Frame(PixelFormat format, size_t width, size_t height) {
+		static const uint8_t bytes[1] = {};
+		FrameView frame;
+		frame.data = bytes;
+		frame.width = width;
+		frame.height = height;
+		frame.format = format;
+		return frame;
+	}
+
+	void AppendLittleEndian(std::string& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	std::string HeaderV1(uint32_t width, uint32_t height, uint32_t stride, PixelFormat format) {
+		std::string header;
+		AppendLittleEndian(header, kRawFrameMagic, 4);
+		AppendLittleEndian(header, 1, 2);
+		AppendLittleEndian(header, kRawFrameHeaderSizeV1, 2);
+		AppendLittleEndian(header, 7, 8);
+		AppendLittleEndian(header, 42, 8);
+		AppendLittleEndian(header, width, 4);
+		AppendLittleEndian(header, height, 4);
+		AppendLittleEndian(header, stride, 4);
+		AppendLittleEndian(header, static_cast<uint16_t>(format), 2);
+		AppendLittleEndian(header, kRawFrameFlagVideo, 2);
+		return header;
+	}
+
+	std::string HeaderV2(uint32_t width, uint32_t height, PixelFormat format,
+		const uint32_t (&offsets)[kMaxPlanes], const uint32_t (&strides)[kMaxPlanes]) {
+		std::string header = HeaderV1(width, height, strides[0], format);
+		header[4] = 2;
+		header[6] = static_cast<char>(kRawFrameHeaderSize);
+		for (uint32_t offset : offsets) {
+			AppendLittleEndian(header, offset, 4);
+		}
+		AppendLittleEndian(header, strides[1], 4);
+		AppendLittleEndian(header, strides[2], 4);
+		AppendLittleEndian(header, 0, 4);
+		return header;
+	}
+}
+
+TEST(PixelFormatTest, ZeroStrideMeansTightlyPacked) {
+	FrameView rgb = Frame(PixelFormat::Rgb24, 5, 3);
+	ASSERT_TRUE(ResolvePlaneLayout(rgb, 45));
+	EXPECT_EQ(rgb.strides[0], 15u);
+	EXPECT_EQ(rgb.dataSize, 45u);
+
+	FrameView truncated = Frame(PixelFormat::Rgb24, 5, 3);
+	EXPECT_FALSE(ResolvePlaneLayout(truncated, 44));
+}
+
+TEST(PixelFormatTest, TightYuvPlanesFollowEachOther) {
+	// Chroma planes of odd sizes round up
+	FrameView i420 = Frame(PixelFormat::I420, 5, 3);
+	ASSERT_TRUE(ResolvePlaneLayout(i420, 15 + 2 * 3 * 2));
+	EXPECT_EQ(i420.strides[0], 5u);
+	EXPECT_EQ(i420.strides[1], 3u);
+	EXPECT_EQ(i420.strides[2], 3u);
+	EXPECT_EQ(i420.planeOffsets[1], 15u);
+	EXPECT_EQ(i420.planeOffsets[2], 21u);
+
+	FrameView nv12 = Frame(PixelFormat::Nv12, 5, 3);
+	ASSERT_TRUE(ResolvePlaneLayout(nv12, 15 + 6 * 2));
+	EXPECT_EQ(nv12.strides[1], 6u);
+	EXPECT_EQ(nv12.planeOffsets[1], 15u);
+
+	FrameView truncated = Frame(PixelFormat::Nv12, 5, 3);
+	EXPECT_FALSE(ResolvePlaneLayout(truncated, 15 + 6 * 2 - 1));
+}
+
+TEST(PixelFormatTest, PaddedStridesFollowThePadding) {
+	// Tight plane placement uses the padded strides, and the last row of the last plane may be short
+	FrameView i420 = Frame(PixelFormat::I420, 5, 3);
+	i420.strides[0] = 8;
+	i420.strides[1] = 4;
+	i420.strides[2] = 6;
+	ASSERT_TRUE(ResolvePlaneLayout(i420, 24 + 8 + 6 + 3));
+	EXPECT_EQ(i420.planeOffsets[1], 24u);
+	EXPECT_EQ(i420.planeOffsets[2], 32u);
+	EXPECT_EQ(i420.strides[2], 6u);
+
+	FrameView shortData = Frame(PixelFormat::I420, 5, 3);
+	shortData.strides[0] = 8;
+	shortData.strides[1] = 4;
+	shortData.strides[2] = 6;
+	EXPECT_FALSE(ResolvePlaneLayout(shortData, 24 + 8 + 6 + 2));
+}
+
+TEST(PixelFormatTest, StrideShorterThanARowIsRejected) {
+	FrameView rgba = Frame(PixelFormat::Rgba32, 5, 3);
+	rgba.strides[0] = 19;
+	EXPECT_FALSE(ResolvePlaneLayout(rgba, 1000));
+	rgba.strides[0] = 20;
+	EXPECT_TRUE(ResolvePlaneLayout(rgba, 1000));
+
+	// An odd width's chroma row is rounded up, so a stride of width / 2 is one short
+	FrameView i420 = Frame(PixelFormat::I420, 5, 4);
+	i420.strides[1] = 2;
+	EXPECT_FALSE(ResolvePlaneLayout(i420, 1000));
+
+	FrameView nv12 = Frame(PixelFormat::Nv12, 5, 4);
+	nv12.strides[1] = 5;
+	EXPECT_FALSE(ResolvePlaneLayout(nv12, 1000));
+
+	FrameView luma = Frame(PixelFormat::Nv12, 5, 4);
+	luma.strides[0] = 4;
+	EXPECT_FALSE(ResolvePlaneLayout(luma, 1000));
+}
+
+TEST(PixelFormatTest, ExplicitPlaneOffsetsAreKeptAndChecked) {
+	// Planes may come in any order, with gaps between them
+	FrameView i420 = Frame(PixelFormat::I420, 4, 4);
+	i420.planeOffsets[0] = 100;
+	i420.planeOffsets[1] = 10;
+	i420.planeOffsets[2] = 50;
+	ASSERT_TRUE(ResolvePlaneLayout(i420, 116));
+	EXPECT_EQ(i420.planeOffsets[0], 100u);
+	EXPECT_EQ(i420.planeOffsets[1], 10u);
+	EXPECT_EQ(i420.planeOffsets[2], 50u);
+
+	FrameView pastEnd = Frame(PixelFormat::I420, 4, 4);
+	pastEnd.planeOffsets[0] = 100;
+	pastEnd.planeOffsets[1] = 10;
+	pastEnd.planeOffsets[2] = 113;
+	EXPECT_FALSE(ResolvePlaneLayout(pastEnd, 116));
+
+	FrameView farOffset = Frame(PixelFormat::Rgb24, 1, 1);
+	farOffset.planeOffsets[0] = SIZE_MAX - 1;
+	EXPECT_FALSE(ResolvePlaneLayout(farOffset, 16));
+}
+
+TEST(PixelFormatTest, EmptyFramesAreRejected) {
+	FrameView noWidth = Frame(PixelFormat::Rgb24, 0, 4);
+	EXPECT_FALSE(ResolvePlaneLayout(noWidth, 100));
+	FrameView noHeight = Frame(PixelFormat::I420, 4, 0);
+	EXPECT_FALSE(ResolvePlaneLayout(noHeight, 100));
+}
+
+TEST(PixelFormatTest, RawHeaderV1IsTightExceptPlaneZero) {
+	RawFrameHeader header;
+	ASSERT_TRUE(ParseRawFrameHeader(HeaderV1(5, 3, 16, PixelFormat::Rgb24), header));
+	EXPECT_EQ(header.width, 5u);
+	EXPECT_EQ(header.height, 3u);
+	EXPECT_EQ(header.strides[0], 16u);
+	EXPECT_EQ(header.strides[1], 0u);
+	EXPECT_EQ(header.planeOffsets[1], 0u);
+	EXPECT_TRUE(header.isVideo);
+	EXPECT_EQ(PeekRawFrameHeaderSize(HeaderV1(5, 3, 16, PixelFormat::Rgb24).data()), kRawFrameHeaderSizeV1);
+}
+
+TEST(PixelFormatTest, RawHeaderV2CarriesThePlaneTable) {
+	const uint32_t offsets[kMaxPlanes] = { 64, 0, 32 };
+	const uint32_t strides[kMaxPlanes] = { 8, 4, 6 };
+	std::string data = HeaderV2(5, 3, PixelFormat::I420, offsets, strides);
+	ASSERT_EQ(data.size(), kRawFrameHeaderSize);
+	RawFrameHeader header;
+	ASSERT_TRUE(ParseRawFrameHeader(data, header));
+	for (size_t plane = 0; plane < kMaxPlanes; ++plane) {
+		EXPECT_EQ(header.planeOffsets[plane], offsets[plane]);
+		EXPECT_EQ(header.strides[plane], strides[plane]);
+	}
+
+	// A version 2 header that claims the version 1 size, or is cut short, is rejected
+	std::string wrongSize = data;
+	wrongSize[6] = static_cast<char>(kRawFrameHeaderSizeV1);
+	EXPECT_FALSE(ParseRawFrameHeader(wrongSize, header));
+	EXPECT_FALSE(ParseRawFrameHeader(std::string_view(data).substr(0, kRawFrameHeaderSize - 1), header));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// A QOI encoder for the tests and benchmarks, following the specification as the image crates on
+// the client do: every op kind, runs of up to 62 pixels, and the 8-byte end marker.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace qoi_writer {
+	inline void PutBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			out.push_back(static_cast<uint8_t>(value >> shift));
+		}
+	}
+
+	// BGRA pixels, tightly packed, to a QOI stream with four channels
+	inline std::vector<uint8_t> Encode(const std::vector<uint8_t>& bgra, size_t width, size_t height) {
+		struct Pixel {
+			uint8_t r, g, b, a;
+			bool operator==(const Pixel& other) const {
+				return r == other.r && g == other.g && b == other.b && a == other.a;
+			}
+		};
+		std::vector<uint8_t> out = { 'q', 'o', 'i', 'f' };
+		PutBigEndian32(out, static_cast<uint32_t>(width));
+		PutBigEndian32(out, static_cast<uint32_t>(height));
+		out.push_back(4);
+		out.push_back(0);
+
+		Pixel index[64] = {};
+		Pixel previous = { 0, 0, 0, 255 };
+		size_t run = 0;
+		size_t pixels = width * height;
+		for (size_t i = 0; i < pixels; ++i) {
+			const uint8_t* p = &bgra[i * 4];
+			Pixel pixel = { p[2], p[1], p[0], p[3] };
+			if (pixel == previous) {
+				if (++run == 62 || i + 1 == pixels) {
+					out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0) {
+				out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+				run = 0;
+			}
+			size_t hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+			if (index[hash] == pixel) {
+				out.push_back(static_cast<uint8_t>(hash));
+			}
+			else {
+				index[hash] = pixel;
+				int dr = static_cast<int8_t>(pixel.r - previous.r);
+				int dg = static_cast<int8_t>(pixel.g - previous.g);
+				int db = static_cast<int8_t>(pixel.b - previous.b);
+				if (pixel.a != previous.a) {
+					out.insert(out.end(), { 0xFF, pixel.r, pixel.g, pixel.b, pixel.a });
+				}
+				else if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+				}
+				else if (dg >= -32 && dg <= 31 && dr - dg >= -8 && dr - dg <= 7 && db - dg >= -8 && db - dg <= 7) {
+					out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+					out.push_back(static_cast<uint8_t>((dr - dg + 8) << 4 | (db - dg + 8)));
+				}
+				else {
+					out.insert(out.end(), { 0xFE, pixel.r, pixel.g, pixel.b });
+				}
+			}
+			previous = pixel;
+		}
+		out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		return out;
+	}
+}
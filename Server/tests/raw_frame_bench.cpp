@@ -0,0 +1,201 @@
+// Video frames from a loopback client to a NetworkServer, as a RenderCommand with the pixels in
+// Video.frame_data and over the raw frame channel, at 1080p and 4K BGRA. The client sends frames
+// back to back; the server takes each one as Server.cpp does up to the renderer: protobuf frames
+// are parsed through a RequestPool, raw frames are handed over as received.
+//
+// "copies" is the bytes the server copied per frame, in frames: what the session's assembler moved
+// (ClientSession::Stats::bytesCopied) plus, for protobuf, the frame_data that parsing copies out of
+// the received message. Everything else was received in place.
+#include "network_server.h"
+#include "raw_frame.h"
+#include "request_pool.h"
+#include "socket_compat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Server that takes every frame up to where the renderer would see its pixels
+	class FrameServer {
+	public:
+		FrameServer() : requests(RequestPool::kRequestsPerParseThread) {
+			std::mt19937 random(static_cast<uint32_t>(Clock::now().time_since_epoch().count()));
+			for (int attempt = 0; attempt < 50 && !server; ++attempt) {
+				port = static_cast<uint16_t>(20000 + random() % 30000);
+				auto candidate = std::make_unique<NetworkServer>(port, 4, 1);
+				candidate->SetMessageHandler([this](const std::shared_ptr<ClientSession>&, std::shared_ptr<FrameBuffer> message) {
+					auto request = requests.Parse(message->Data(), message->Size());
+					if (request && request->has_render_command() && request->render_command().has_video()) {
+						parsedBytes += request->render_command().video().frame_data().size();
+						frames++;
+					}
+					});
+				candidate->SetRawFrameHandler([this](const std::shared_ptr<ClientSession>&, std::unique_ptr<RawFrame>) {
+					frames++;
+					});
+				if (candidate->Start()) {
+					server = std::move(candidate);
+				}
+			}
+		}
+
+		~FrameServer() {
+			if (server) {
+				server->Stop();
+			}
+		}
+
+		explicit operator bool() const { return server != nullptr; }
+
+		// Bytes the session's assembler copied, summed over sessions
+		uint64_t AssemblerCopies() const {
+			uint64_t copied = 0;
+			for (const ClientSession::Stats& stats : server->GetSessionStats()) {
+				copied += stats.bytesCopied;
+			}
+			return copied;
+		}
+
+		uint16_t port = 0;
+		std::atomic<uint64_t> frames{ 0 };
+		std::atomic<uint64_t> parsedBytes{ 0 };
+
+	private:
+		RequestPool requests;
+		std::unique_ptr<NetworkServer> server;
+	};
+
+	SocketHandle Connect(uint16_t port) {
+		SocketHandle socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			socket_compat::Close(socket);
+			return kInvalidSocket;
+		}
+		return socket;
+	}
+
+	bool SendAll(SocketHandle socket, const std::string& data) {
+		for (size_t sent = 0; sent < data.size(); ) {
+			ssize_t n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if (n <= 0) {
+				return false;
+			}
+			sent += static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	void Put(std::string& out, size_t offset, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	std::string Pixels(size_t width, size_t height) {
+		std::string pixels(width * height * 4, '\0');
+		for (size_t i = 0; i < pixels.size(); ++i) {
+			pixels[i] = static_cast<char>(i * 7 + i / 4096);
+		}
+		return pixels;
+	}
+
+	std::string ProtobufFrame(size_t width, size_t height, const std::string& pixels) {
+		windowcaster::ClientRequest request;
+		auto* command = request.mutable_render_command();
+		command->set_target_window(1);
+		command->set_sequence(1);
+		auto* video = command->mutable_video();
+		video->set_width(static_cast<uint32_t>(width));
+		video->set_height(static_cast<uint32_t>(height));
+		video->set_pixel_format(windowcaster::PIXEL_FORMAT_BGRA32);
+		video->set_frame_data(pixels);
+		std::string body = request.SerializeAsString();
+		std::string message(4, '\0');
+		Put(message, 0, body.size(), 4);
+		return message + body;
+	}
+
+	std::string RawFrameMessage(size_t width, size_t height, const std::string& pixels) {
+		std::string message(4 + kRawFrameHeaderSize, '\0');
+		Put(message, 0, (kRawFrameHeaderSize + pixels.size()) | kRawFrameFlag, 4);
+		Put(message, 4, kRawFrameMagic, 4);
+		Put(message, 8, kRawFrameVersion, 2);
+		Put(message, 10, kRawFrameHeaderSize, 2);
+		Put(message, 12, 1, 8);
+		Put(message, 20, 1, 8);
+		Put(message, 28, width, 4);
+		Put(message, 32, height, 4);
+		Put(message, 40, static_cast<uint16_t>(PixelFormat::Bgra32), 2);
+		Put(message, 42, kRawFrameFlagVideo, 2);
+		return message + pixels;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 2.0;
+	// Quick runs send quarter-size frames under the same names
+	size_t scale = quick ? 4 : 1;
+	const struct {
+		const char* name;
+		size_t width;
+		size_t height;
+	} resolutions[] = { { "1080p", 1920 / scale, 1080 / scale }, { "4K", 3840 / scale, 2160 / scale } };
+
+	socket_compat::Startup();
+	std::printf("BGRA video frames over loopback, server side up to the renderer\n");
+	std::printf("%-6s %-9s %10s %10s %8s\n", "frame", "channel", "frames/s", "GB/s", "copies");
+	for (const auto& resolution : resolutions) {
+		std::string pixels = Pixels(resolution.width, resolution.height);
+		for (bool raw : { false, true }) {
+			std::string message = raw ? RawFrameMessage(resolution.width, resolution.height, pixels)
+				: ProtobufFrame(resolution.width, resolution.height, pixels);
+
+			FrameServer server;
+			SocketHandle socket = server ? Connect(server.port) : kInvalidSocket;
+			if (socket == kInvalidSocket) {
+				std::printf("cannot connect to the loopback server\n");
+				return 1;
+			}
+			auto start = Clock::now();
+			uint64_t count = 0;
+			while (count < 3 || std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+				if (!SendAll(socket, message)) {
+					std::printf("send failed\n");
+					return 1;
+				}
+				++count;
+			}
+			auto deadline = Clock::now() + std::chrono::seconds(30);
+			while (server.frames < count) {
+				if (Clock::now() > deadline) {
+					std::printf("the server did not take every frame\n");
+					return 1;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			uint64_t copied = server.AssemblerCopies() + server.parsedBytes;
+			socket_compat::Close(socket);
+
+			std::printf("%-6s %-9s %10.1f %10.2f %8.3f\n", resolution.name, raw ? "raw" : "protobuf",
+				static_cast<double>(count) / elapsed, static_cast<double>(count * pixels.size()) / elapsed / 1e9,
+				static_cast<double>(copied) / static_cast<double>(count * pixels.size()));
+		}
+	}
+	socket_compat::Cleanup();
+	return 0;
+}
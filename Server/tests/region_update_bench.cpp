@@ -0,0 +1,146 @@
+// A mostly static 1920x1080 screen where each frame moves a 32x32 cursor, rewrites a 600x16 line
+// of text and ticks an 80x16 clock, shown in a 1920x1080 and a 2560x1440 client area by a
+// MemoryRenderTarget. "full frame" sends the whole screen every frame, and the target compares
+// tiles and presents the changed ones. "region update" sends only the three rects, which are
+// patched into the window's last frame. The table shows payload bytes, pixels written and scaled,
+// and milliseconds per frame. The patched picture is checked against the full frame's at the end.
+#include "memory_render_target.h"
+#include "pixel_convert.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kWidth = 1920;
+	constexpr size_t kHeight = 1080;
+
+	struct Rect {
+		size_t x;
+		size_t y;
+		size_t width;
+		size_t height;
+	};
+
+	struct Result {
+		double seconds = 0;
+		double payloadBytes = 0;
+		double pixelsWritten = 0;
+		double pixelsScaled = 0;
+	};
+
+	// Draws frame n into screen and returns the rects that changed since frame n - 1
+	std::vector<Rect> Animate(std::vector<uint8_t>& screen, size_t n) {
+		std::vector<Rect> rects = {
+			{ 200 + (n * 7) % 1500, 300 + (n * 3) % 600, 32, 32 },
+			{ 100, 900, 600, 16 },
+			{ 1800, 8, 80, 16 },
+		};
+		for (size_t i = 0; i < rects.size(); ++i) {
+			const Rect& rect = rects[i];
+			for (size_t y = rect.y; y < rect.y + rect.height; ++y) {
+				for (size_t x = rect.x; x < rect.x + rect.width; ++x) {
+					uint8_t* pixel = &screen[(y * kWidth + x) * 4];
+					pixel[0] = static_cast<uint8_t>(n * 31 + x);
+					pixel[1] = static_cast<uint8_t>(n * 17 + y + i);
+					pixel[2] = static_cast<uint8_t>(x ^ y);
+					pixel[3] = 255;
+				}
+			}
+		}
+		return rects;
+	}
+
+	FrameView Bgra(const uint8_t* data, size_t width, size_t height, size_t stride) {
+		FrameView view;
+		view.data = data;
+		view.width = width;
+		view.height = height;
+		view.format = PixelFormat::Bgra32;
+		view.strides[0] = stride;
+		ResolvePlaneLayout(view, stride * (height - 1) + width * 4);
+		return view;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	size_t frames = quick ? 10 : 300;
+
+	// A desktop-like background of flat panels with some noise
+	std::vector<uint8_t> background(kWidth * kHeight * 4);
+	std::mt19937 random(1);
+	for (size_t y = 0; y < kHeight; ++y) {
+		for (size_t x = 0; x < kWidth; ++x) {
+			uint8_t* pixel = &background[(y * kWidth + x) * 4];
+			uint8_t shade = static_cast<uint8_t>(((x / 240) + (y / 135)) % 2 ? 0xF0 : 0x30);
+			pixel[0] = pixel[1] = pixel[2] = (random() % 50 == 0) ? static_cast<uint8_t>(random()) : shade;
+			pixel[3] = 255;
+		}
+	}
+
+	const int clients[][2] = { { 1920, 1080 }, { 2560, 1440 } };
+	std::printf("%-10s %-14s %12s %12s %12s %10s\n", "client", "update", "bytes/frame", "written", "scaled", "ms/frame");
+	for (const auto& client : clients) {
+		MemoryRenderTarget full(client[0], client[1]);
+		MemoryRenderTarget patched(client[0], client[1]);
+		full.Initialize(1);
+		patched.Initialize(1);
+		std::vector<uint8_t> screen = background;
+		full.RenderImageFrame(Bgra(screen.data(), kWidth, kHeight, kWidth * 4));
+		patched.RenderImageFrame(Bgra(screen.data(), kWidth, kHeight, kWidth * 4));
+
+		Result fullResult;
+		Result patchedResult;
+		uint64_t fullWritten = full.GetCounters().pixelsWritten;
+		uint64_t fullScaled = full.GetCounters().pixelsScaled;
+		uint64_t patchedWritten = patched.GetCounters().pixelsWritten;
+		uint64_t patchedScaled = patched.GetCounters().pixelsScaled;
+		std::vector<DirtyRect> dirty;
+		for (size_t n = 1; n <= frames; ++n) {
+			std::vector<Rect> rects = Animate(screen, n);
+
+			auto start = Clock::now();
+			full.RenderImageFrame(Bgra(screen.data(), kWidth, kHeight, kWidth * 4));
+			fullResult.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+			fullResult.payloadBytes += static_cast<double>(screen.size());
+
+			// The rects point into the screen as a client's would point into its message
+			dirty.clear();
+			for (const Rect& rect : rects) {
+				DirtyRect region;
+				region.x = rect.x;
+				region.y = rect.y;
+				region.image = Bgra(&screen[(rect.y * kWidth + rect.x) * 4], rect.width, rect.height, kWidth * 4);
+				dirty.push_back(region);
+				patchedResult.payloadBytes += static_cast<double>(rect.width * rect.height * 4);
+			}
+			start = Clock::now();
+			patched.RenderDirtyRects(kWidth, kHeight, dirty);
+			patchedResult.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		fullResult.pixelsWritten = static_cast<double>(full.GetCounters().pixelsWritten - fullWritten);
+		fullResult.pixelsScaled = static_cast<double>(full.GetCounters().pixelsScaled - fullScaled);
+		patchedResult.pixelsWritten = static_cast<double>(patched.GetCounters().pixelsWritten - patchedWritten);
+		patchedResult.pixelsScaled = static_cast<double>(patched.GetCounters().pixelsScaled - patchedScaled);
+
+		const struct {
+			const char* name;
+			const Result& result;
+		} rows[] = { { "full frame", fullResult }, { "region update", patchedResult } };
+		for (const auto& row : rows) {
+			std::printf("%4dx%-5d %-14s %12.0f %12.0f %12.0f %10.3f\n", client[0], client[1], row.name,
+				row.result.payloadBytes / frames, row.result.pixelsWritten / frames, row.result.pixelsScaled / frames,
+				row.result.seconds / frames * 1e3);
+		}
+
+		if (full.FrameData() != patched.FrameData() || full.ClientData() != patched.ClientData()) {
+			std::printf("region updates presented a different picture\n");
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+// Presenting a stream of frames to one window through a RenderContextCache, against initializing
+// a render target for every frame, on MemoryRenderTarget with a 1080p and a 4K client area.
+// "cached" acquires the window's context from the cache, which after the first frame is a hit:
+// the entry lock plus the liveness and client size checks. "per frame" creates a target from the
+// factory, initializes it for the window, reads its client size and releases it afterwards, as the
+// renderer did before the cache. "context us" is the context alone; "frame ms" adds rendering a
+// client-size BGRA frame, the two frames alternating so that every tile changes.
+//
+// The memory target's context is its tile tracker and scaler, and its frame and client buffers
+// allocated by the first render, so nearly all of its cost shows in "frame ms". The window backend
+// also creates a DC and a bitmap per context, so the difference on Windows is larger than shown.
+#include "memory_render_target.h"
+#include "render_context_cache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr uint64_t kWindow = 1;
+
+	// Calls run until the time is used up; returns seconds per call
+	template <typename Body>
+	double Measure(double seconds, Body body) {
+		size_t calls = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++calls;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return elapsed.count() / static_cast<double>(calls);
+	}
+
+	std::vector<uint8_t> Frame(size_t width, size_t height, uint8_t seed) {
+		std::vector<uint8_t> frame(width * height * 4);
+		for (size_t i = 0; i < frame.size(); ++i) {
+			frame[i] = (i & 3) == 3 ? 255 : static_cast<uint8_t>(i * 13 + seed);
+		}
+		return frame;
+	}
+
+	FrameView Bgra(const std::vector<uint8_t>& frame, size_t width, size_t height) {
+		FrameView view;
+		view.data = frame.data();
+		view.width = width;
+		view.height = height;
+		view.format = PixelFormat::Bgra32;
+		view.strides[0] = width * 4;
+		view.dataSize = frame.size();
+		return view;
+	}
+
+	// What the renderer did per frame before the cache; the target is released when it goes out of scope
+	std::unique_ptr<RenderTarget> InitializeContext(const RenderTargetFactory& factory) {
+		std::unique_ptr<RenderTarget> target = factory();
+		int width = 0;
+		int height = 0;
+		if (!target || !target->Initialize(kWindow) || !target->GetClientSize(width, height)) {
+			return nullptr;
+		}
+		return target;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 0.5;
+	// Quick runs use quarter-size client areas under the same names
+	int scale = quick ? 4 : 1;
+	const struct {
+		const char* name;
+		int width;
+		int height;
+	} clients[] = { { "1080p", 1920 / scale, 1080 / scale }, { "4K", 3840 / scale, 2160 / scale } };
+
+	std::printf("%-6s %-10s %12s %10s %10s\n", "client", "path", "context us", "frame ms", "vs cached");
+	for (const auto& client : clients) {
+		size_t width = static_cast<size_t>(client.width);
+		size_t height = static_cast<size_t>(client.height);
+		const std::vector<uint8_t> frames[] = { Frame(width, height, 0), Frame(width, height, 1) };
+		const FrameView views[] = { Bgra(frames[0], width, height), Bgra(frames[1], width, height) };
+		RenderTargetFactory factory = [&] {
+			return std::make_unique<MemoryRenderTarget>(client.width, client.height);
+		};
+
+		RenderContextCache cache(factory);
+		bool ok = cache.Acquire(kWindow) != nullptr;
+		double cachedContext = Measure(seconds, [&] {
+			ok &= cache.Acquire(kWindow) != nullptr;
+		});
+		size_t n = 0;
+		double cachedFrame = Measure(seconds, [&] {
+			std::shared_ptr<RenderTarget> target = cache.Acquire(kWindow);
+			ok &= target && target->RenderImageFrame(views[n++ % 2]);
+		});
+		// Every call after the first must have been a hit
+		RenderContextCache::Stats stats = cache.GetStats();
+		ok &= stats.misses == 1 && stats.resized == 0 && stats.destroyed == 0;
+
+		double freshContext = Measure(seconds, [&] {
+			ok &= InitializeContext(factory) != nullptr;
+		});
+		double freshFrame = Measure(seconds, [&] {
+			std::unique_ptr<RenderTarget> target = InitializeContext(factory);
+			ok &= target && target->RenderImageFrame(views[n++ % 2]);
+		});
+		if (!ok) {
+			std::printf("rendering failed\n");
+			return 1;
+		}
+
+		std::printf("%-6s %-10s %12.2f %10.3f %10s\n", client.name, "cached", cachedContext * 1e6, cachedFrame * 1e3, "-");
+		std::printf("%-6s %-10s %12.2f %10.3f %9.2fx\n", client.name, "per frame", freshContext * 1e6, freshFrame * 1e3,
+			freshFrame / cachedFrame);
+	}
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include "memory_render_target.h"
+#include "render_context_cache.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace {
+	// Memory target whose initialization can be held up or made to fail
+	class FakeTarget : public MemoryRenderTarget {
+	public:
+		FakeTarget(std::atomic<int>& started, std::shared_future<void> gate, bool fail)
+			: MemoryRenderTarget(64, 48), started(started), gate(std::move(gate)), fail(fail) {}
+
+		bool Initialize(uint64_t targetWindow) override {
+			started++;
+			if (gate.valid()) {
+				gate.wait();
+			}
+			return !fail && MemoryRenderTarget::Initialize(targetWindow);
+		}
+
+	private:
+		std::atomic<int>& started;
+		std::shared_future<void> gate;
+		bool fail;
+	};
+
+	struct Factory {
+		std::atomic<int> created{ 0 };
+		std::atomic<int> started{ 0 };
+		// Targets created from now on wait for the gate to open, or fail to initialize
+		std::shared_future<void> gate;
+		bool fail = false;
+
+		RenderTargetFactory Make() {
+			return [this] {
+				created++;
+				return std::make_unique<FakeTarget>(started, gate, fail);
+			};
+		}
+	};
+
+	FakeTarget& AsFake(const std::shared_ptr<RenderTarget>& target) {
+		return static_cast<FakeTarget&>(*target);
+	}
+}
+
+TEST(RenderContextCacheTest, ReusesInitializedContext) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	std::shared_ptr<RenderTarget> first = cache.Acquire(1);
+	ASSERT_TRUE(first);
+	EXPECT_EQ(cache.Acquire(1), first);
+	EXPECT_EQ(AsFake(first).TargetWindow(), 1u);
+
+	RenderContextCache::Stats stats = cache.GetStats();
+	EXPECT_EQ(stats.misses, 1u);
+	EXPECT_EQ(stats.hits, 1u);
+	EXPECT_EQ(factory.created, 1);
+}
+
+TEST(RenderContextCacheTest, ResizeStartsAFreshContext) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	std::shared_ptr<RenderTarget> first = cache.Acquire(1);
+	AsFake(first).SetClientSize(100, 100);
+	std::shared_ptr<RenderTarget> second = cache.Acquire(1);
+	ASSERT_TRUE(second);
+	EXPECT_NE(second, first);
+	EXPECT_EQ(cache.GetStats().resized, 1u);
+	EXPECT_EQ(cache.Size(), 1u);
+}
+
+TEST(RenderContextCacheTest, DestroyedWindowStartsAFreshContext) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	std::shared_ptr<RenderTarget> first = cache.Acquire(1);
+	AsFake(first).Destroy();
+	std::shared_ptr<RenderTarget> second = cache.Acquire(1);
+	ASSERT_TRUE(second);
+	EXPECT_NE(second, first);
+	EXPECT_EQ(cache.GetStats().destroyed, 1u);
+}
+
+TEST(RenderContextCacheTest, InvalidateDropsTheContext) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	std::shared_ptr<RenderTarget> first = cache.Acquire(1);
+	cache.Invalidate(1);
+	cache.Invalidate(1);
+	EXPECT_EQ(cache.Size(), 0u);
+	EXPECT_EQ(cache.GetStats().invalidated, 1u);
+	EXPECT_NE(cache.Acquire(1), first);
+}
+
+TEST(RenderContextCacheTest, MissesPruneDestroyedWindows) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	AsFake(cache.Acquire(1)).Destroy();
+	cache.Acquire(2);
+	EXPECT_EQ(cache.Size(), 1u);
+	EXPECT_EQ(cache.GetStats().destroyed, 1u);
+
+	AsFake(cache.Acquire(2)).Destroy();
+	cache.PruneDead();
+	EXPECT_EQ(cache.Size(), 0u);
+}
+
+TEST(RenderContextCacheTest, FailedInitializationIsNotCached) {
+	Factory factory;
+	factory.fail = true;
+	RenderContextCache cache(factory.Make());
+	EXPECT_FALSE(cache.Acquire(1));
+	EXPECT_FALSE(cache.Acquire(1));
+	EXPECT_EQ(cache.Size(), 0u);
+	EXPECT_EQ(cache.GetStats().initFailures, 2u);
+}
+
+TEST(RenderContextCacheTest, SlowInitializationDoesNotBlockOtherWindows) {
+	Factory factory;
+	RenderContextCache cache(factory.Make());
+	std::shared_ptr<RenderTarget> ready = cache.Acquire(1);
+
+	// Window 2's context takes until the gate opens to create
+	std::promise<void> open;
+	factory.gate = open.get_future().share();
+	std::thread slow([&] { cache.Acquire(2); });
+	while (factory.started < 2) {
+		std::this_thread::yield();
+	}
+
+	// Window 1 keeps presenting meanwhile
+	auto other = std::async(std::launch::async, [&] {
+		for (int i = 0; i < 1000; ++i) {
+			if (cache.Acquire(1) != ready) {
+				return false;
+			}
+		}
+		return true;
+	});
+	bool finished = other.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+	open.set_value();
+	slow.join();
+	ASSERT_TRUE(finished);
+	EXPECT_TRUE(other.get());
+}
+
+TEST(RenderContextCacheTest, ConcurrentCallersInitializeOnce) {
+	Factory factory;
+	std::promise<void> open;
+	factory.gate = open.get_future().share();
+	RenderContextCache cache(factory.Make());
+
+	std::vector<std::shared_ptr<RenderTarget>> results(8);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < results.size(); ++i) {
+		threads.emplace_back([&, i] { results[i] = cache.Acquire(7); });
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	open.set_value();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(factory.created, 1);
+	for (const auto& result : results) {
+		EXPECT_EQ(result, results[0]);
+	}
+}
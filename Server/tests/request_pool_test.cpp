@@ -0,0 +1,184 @@
+#include "request_pool.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::string ImageCommand(uint64_t sequence, size_t bytes) {
+		windowcaster::ClientRequest request;
+		auto* command = request.mutable_render_command();
+		command->set_target_window(7);
+		command->set_sequence(sequence);
+		auto* image = command->mutable_image();
+		image->set_width(static_cast<uint32_t>(bytes / 4));
+		image->set_height(1);
+		image->set_pixel_format(windowcaster::PIXEL_FORMAT_BGRA32);
+		image->set_data(std::string(bytes, static_cast<char>(sequence)));
+		return request.SerializeAsString();
+	}
+
+	std::string StopRender(uint64_t window) {
+		windowcaster::ClientRequest request;
+		request.mutable_stop_render()->set_target_window(window);
+		return request.SerializeAsString();
+	}
+
+	std::shared_ptr<windowcaster::ClientRequest> Parse(RequestPool& pool, const std::string& message) {
+		return pool.Parse(message.data(), message.size());
+	}
+
+	// What a fresh ParseFromArray makes of the message, serialized again for comparison
+	std::string Fresh(const std::string& message) {
+		windowcaster::ClientRequest request;
+		EXPECT_TRUE(request.ParseFromArray(message.data(), static_cast<int>(message.size())));
+		return request.SerializeAsString();
+	}
+}
+
+TEST(RequestPoolTest, IdleRequestKeepsItsPixelBuffer) {
+	RequestPool pool(4);
+	const char* pixels = nullptr;
+	{
+		auto request = Parse(pool, ImageCommand(1, 4096));
+		ASSERT_TRUE(request);
+		pixels = request->render_command().image().data().data();
+	}
+	auto request = Parse(pool, ImageCommand(2, 1024));
+	ASSERT_TRUE(request);
+	EXPECT_EQ(request->render_command().sequence(), 2u);
+	EXPECT_EQ(request->render_command().image().data(), std::string(1024, 2));
+	EXPECT_EQ(request->render_command().image().data().data(), pixels);
+
+	RequestPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.created, 1u);
+	EXPECT_EQ(stats.reused, 1u);
+	EXPECT_EQ(stats.kept, 1u);
+}
+
+TEST(RequestPoolTest, HeldRequestsAreNotReused) {
+	RequestPool pool(2);
+	std::vector<std::shared_ptr<windowcaster::ClientRequest>> held;
+	for (uint64_t i = 1; i <= 3; ++i) {
+		held.push_back(Parse(pool, ImageCommand(i, 64)));
+		ASSERT_TRUE(held.back());
+	}
+	for (uint64_t i = 1; i <= 3; ++i) {
+		EXPECT_EQ(held[i - 1]->render_command().sequence(), i);
+	}
+	// The third did not fit and goes away with its last holder
+	RequestPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.created, 3u);
+	EXPECT_EQ(stats.requests, 2u);
+}
+
+TEST(RequestPoolTest, OversizedMessagesAreNotPooled) {
+	RequestPool pool(4, 64 * 1024);
+	std::string large = ImageCommand(1, 256 * 1024);
+	std::weak_ptr<windowcaster::ClientRequest> parsed;
+	{
+		auto request = Parse(pool, large);
+		ASSERT_TRUE(request);
+		EXPECT_EQ(request->SerializeAsString(), Fresh(large));
+		parsed = request;
+	}
+	// Freed with its last holder instead of pinning a quarter of a megabyte in the pool
+	EXPECT_TRUE(parsed.expired());
+
+	RequestPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.oversized, 1u);
+	EXPECT_EQ(stats.requests, 0u);
+
+	// Messages under the cap are pooled as before
+	ASSERT_TRUE(Parse(pool, ImageCommand(2, 1024)));
+	EXPECT_EQ(pool.GetStats().requests, 1u);
+}
+
+TEST(RequestPoolTest, RetentionCapBoundsPooledRequests) {
+	// A message exactly at the cap is pooled, one byte over is not
+	std::string atCap = ImageCommand(1, 64 * 1024);
+	RequestPool pool(4, atCap.size());
+	ASSERT_TRUE(Parse(pool, atCap));
+	EXPECT_EQ(pool.GetStats().oversized, 0u);
+	EXPECT_EQ(pool.GetStats().requests, 1u);
+	std::string overCap = ImageCommand(2, 64 * 1024 + 4);
+	ASSERT_TRUE(Parse(pool, overCap));
+	EXPECT_EQ(pool.GetStats().oversized, 1u);
+	EXPECT_EQ(pool.GetStats().requests, 1u);
+
+	// Whatever mix of sizes under the cap goes through, what a pooled request keeps stays under it too
+	std::mt19937 random(2);
+	for (uint64_t i = 0; i < 200; ++i) {
+		std::string message = ImageCommand(i, 4 * (random() % (16 * 1024)));
+		auto request = Parse(pool, message);
+		ASSERT_TRUE(request);
+		EXPECT_LE(request->render_command().image().data().capacity(), atCap.size()) << i;
+	}
+	EXPECT_EQ(pool.GetStats().oversized, 1u);
+}
+
+TEST(RequestPoolTest, PoolSizedToParseThreadsStopsCreatingAfterWarmUp) {
+	// Each parse thread holds the request it parses, one waiting in the mailbox and one being presented
+	constexpr size_t kParseThreads = 4;
+	RequestPool pool(RequestPool::kRequestsPerParseThread * kParseThreads);
+	std::vector<std::vector<std::shared_ptr<windowcaster::ClientRequest>>> held(kParseThreads);
+	uint64_t sequence = 0;
+	for (int frame = 0; frame < 50; ++frame) {
+		for (auto& thread : held) {
+			if (thread.size() == RequestPool::kRequestsPerParseThread) {
+				thread.erase(thread.begin());
+			}
+			thread.push_back(Parse(pool, ImageCommand(++sequence, 4096)));
+			ASSERT_TRUE(thread.back());
+		}
+	}
+	RequestPool::Stats stats = pool.GetStats();
+	EXPECT_EQ(stats.created, RequestPool::kRequestsPerParseThread * kParseThreads);
+	EXPECT_EQ(stats.reused, sequence - stats.created);
+	EXPECT_EQ(stats.requests, RequestPool::kRequestsPerParseThread * kParseThreads);
+
+	// A pool sized for fewer threads than parse keeps creating requests it cannot keep
+	RequestPool small(RequestPool::kRequestsPerParseThread * (kParseThreads - 1));
+	for (auto& thread : held) {
+		thread.clear();
+	}
+	for (int frame = 0; frame < 50; ++frame) {
+		for (auto& thread : held) {
+			if (thread.size() == RequestPool::kRequestsPerParseThread) {
+				thread.erase(thread.begin());
+			}
+			thread.push_back(Parse(small, ImageCommand(++sequence, 4096)));
+		}
+	}
+	stats = small.GetStats();
+	EXPECT_GT(stats.created, 2 * stats.requests);
+	EXPECT_EQ(stats.requests, RequestPool::kRequestsPerParseThread * (kParseThreads - 1));
+}
+
+TEST(RequestPoolTest, ReusedRequestsParseLikeFreshOnes) {
+	RequestPool pool(2);
+	std::mt19937 random(1);
+	for (int i = 0; i < 500; ++i) {
+		std::string message = random() % 3 == 0 ? StopRender(random()) : ImageCommand(i, 4 * (random() % 300));
+		// Some are cut short or followed by junk
+		switch (random() % 8) {
+		case 0:
+			message.resize(random() % (message.size() + 1));
+			break;
+		case 1:
+			message.push_back(static_cast<char>(random()));
+			break;
+		default:
+			break;
+		}
+		windowcaster::ClientRequest fresh;
+		bool valid = fresh.ParseFromArray(message.data(), static_cast<int>(message.size()));
+		auto request = Parse(pool, message);
+		ASSERT_EQ(static_cast<bool>(request), valid) << i;
+		if (request) {
+			EXPECT_EQ(request->SerializeAsString(), fresh.SerializeAsString()) << i;
+		}
+	}
+}
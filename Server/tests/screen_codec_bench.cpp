@@ -0,0 +1,157 @@
+// Screen codec on a synthetic UI corpus at 1920x1080: encoded size against 24-bit pixels, and
+// encode and decode rates in megapixels per second, single threaded.
+#include "pixel_convert.h"
+#include "screen_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kWidth = 1920;
+	constexpr size_t kHeight = 1080;
+
+	struct Canvas {
+		std::vector<uint8_t> bgra = std::vector<uint8_t>(kWidth * kHeight * 4);
+
+		void Fill(size_t left, size_t top, size_t w, size_t h, uint32_t color) {
+			for (size_t y = top; y < std::min(top + h, kHeight); ++y) {
+				for (size_t x = left; x < std::min(left + w, kWidth); ++x) {
+					std::memcpy(bgra.data() + (y * kWidth + x) * 4, &color, 4);
+				}
+			}
+		}
+
+		// Lines of random 5x12 one-bit glyphs in a text area; colors picks each glyph's color
+		template <typename PickColor>
+		void Text(std::mt19937& random, size_t left, size_t top, size_t w, size_t h, size_t lineHeight, PickColor colors) {
+			for (size_t line = top; line + lineHeight <= top + h; line += lineHeight) {
+				size_t length = w / 7 * (random() % 100) / 100;
+				for (size_t x = left; x < left + length * 7; x += 7) {
+					uint32_t glyph = random();
+					uint32_t color = colors();
+					for (size_t bit = 0; bit < 30; ++bit) {
+						if (glyph >> bit & 1) {
+							Fill(x + bit % 5, line + bit / 5 * 2, 1, 2, color);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	// A desktop with overlapping windows, title bars, text and a few anti-aliased controls
+	Canvas Desktop() {
+		std::mt19937 random(1);
+		Canvas canvas;
+		canvas.Fill(0, 0, kWidth, kHeight, 0xFF3A6EA5u);
+		canvas.Fill(0, kHeight - 40, kWidth, 40, 0xFF1F1F1Fu);
+		for (int window = 0; window < 5; ++window) {
+			size_t left = random() % (kWidth / 2);
+			size_t top = random() % (kHeight / 2);
+			size_t w = 400 + random() % 800;
+			size_t h = 300 + random() % 400;
+			canvas.Fill(left, top, w, h, 0xFF202020u);
+			canvas.Fill(left + 1, top + 1, w - 2, 30, 0xFF0063B1u);
+			canvas.Fill(left + 1, top + 31, w - 2, h - 32, 0xFFF3F3F3u);
+			canvas.Text(random, left + 12, top + 44, w - 24, h - 100, 16, [] { return 0xFF000000u; });
+			for (size_t i = 0; i < 4; ++i) {
+				uint32_t gray = 0x40 + 0x30 * static_cast<uint32_t>(i);
+				canvas.Fill(left + w - 110 + i, top + h - 40 + i, 90 - 2 * i, 28 - 2 * i, 0xFF000000u | gray * 0x010101u);
+			}
+		}
+		return canvas;
+	}
+
+	// A dark terminal with text in a handful of colors
+	Canvas Terminal() {
+		std::mt19937 random(2);
+		const uint32_t palette[] = { 0xFFCCCCCCu, 0xFF3BB54Au, 0xFFE5C07Bu, 0xFF61AFEFu, 0xFFE06C75u };
+		Canvas canvas;
+		canvas.Fill(0, 0, kWidth, kHeight, 0xFF1E1E1Eu);
+		canvas.Text(random, 8, 8, kWidth - 16, kHeight - 16, 14, [&] { return palette[random() % 5]; });
+		return canvas;
+	}
+
+	// A document: white page, black text, a smooth gradient banner
+	Canvas Document() {
+		std::mt19937 random(3);
+		Canvas canvas;
+		canvas.Fill(0, 0, kWidth, kHeight, 0xFFE0E0E0u);
+		canvas.Fill(360, 0, 1200, kHeight, 0xFFFFFFFFu);
+		for (size_t y = 0; y < 120; ++y) {
+			for (size_t x = 360; x < 1560; ++x) {
+				uint32_t color = 0xFF000000u | static_cast<uint32_t>((x - 360) * 255 / 1200) << 16 | static_cast<uint32_t>(y * 2);
+				std::memcpy(canvas.bgra.data() + (y * kWidth + x) * 4, &color, 4);
+			}
+		}
+		canvas.Text(random, 420, 160, 1080, kHeight - 200, 18, [] { return 0xFF000000u; });
+		return canvas;
+	}
+
+	// Photographic content: noise, the worst case
+	Canvas Photo() {
+		std::mt19937 random(4);
+		Canvas canvas;
+		for (size_t i = 0; i < kWidth * kHeight; ++i) {
+			uint32_t color = 0xFF000000u | (random() & 0xFFFFFFu);
+			std::memcpy(canvas.bgra.data() + i * 4, &color, 4);
+		}
+		return canvas;
+	}
+
+	template <typename Body>
+	double MegapixelsPerSecond(double seconds, Body body) {
+		size_t runs = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++runs;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return static_cast<double>(runs) * kWidth * kHeight / elapsed.count() / 1e6;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 1.0;
+	struct Sample {
+		const char* name;
+		Canvas canvas;
+	} corpus[] = { { "desktop", Desktop() }, { "terminal", Terminal() }, { "document", Document() }, { "photo", Photo() } };
+
+	std::vector<uint8_t> encoded;
+	std::vector<uint8_t> decoded(kWidth * kHeight * 4);
+	std::printf("%zux%zu\n%-10s %12s %8s %14s %14s\n", kWidth, kHeight, "image", "bytes", "of RGB", "encode MP/s", "decode MP/s");
+	for (const Sample& sample : corpus) {
+		double encodeRate = MegapixelsPerSecond(seconds, [&] {
+			encoded.clear();
+			EncodeScreenImage(sample.canvas.bgra.data(), kWidth * 4, kWidth, kHeight, encoded);
+			});
+
+		FrameView frame;
+		frame.data = encoded.data();
+		frame.format = PixelFormat::Screen;
+		if (!ResolvePlaneLayout(frame, encoded.size())) {
+			std::fprintf(stderr, "%s: bad encoding\n", sample.name);
+			return 1;
+		}
+		bool ok = true;
+		double decodeRate = MegapixelsPerSecond(seconds, [&] {
+			ok = ok && ConvertFrameToBgra(frame, decoded.data(), kWidth * 4);
+			});
+		if (!ok) {
+			std::fprintf(stderr, "%s: decode failed\n", sample.name);
+			return 1;
+		}
+		std::printf("%-10s %12zu %7.2f%% %14.1f %14.1f\n", sample.name, encoded.size(),
+			100.0 * encoded.size() / (kWidth * kHeight * 3), encodeRate, decodeRate);
+	}
+	return 0;
+}
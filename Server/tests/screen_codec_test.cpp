@@ -0,0 +1,245 @@
+#include "pixel_convert.h"
+#include "screen_codec.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Image {
+		size_t width = 0;
+		size_t height = 0;
+		size_t stride = 0;
+		std::vector<uint8_t> bgra;
+
+		Image(size_t width, size_t height, size_t padding = 0)
+			: width(width), height(height), stride(width * 4 + padding), bgra(stride * height, 0xCD) {}
+
+		void Set(size_t x, size_t y, uint32_t color) {
+			uint8_t* pixel = bgra.data() + y * stride + x * 4;
+			pixel[0] = static_cast<uint8_t>(color);
+			pixel[1] = static_cast<uint8_t>(color >> 8);
+			pixel[2] = static_cast<uint8_t>(color >> 16);
+			pixel[3] = static_cast<uint8_t>(color >> 24);
+		}
+
+		void Fill(size_t left, size_t top, size_t w, size_t h, uint32_t color) {
+			for (size_t y = top; y < std::min(top + h, height); ++y) {
+				for (size_t x = left; x < std::min(left + w, width); ++x) {
+					Set(x, y, color);
+				}
+			}
+		}
+	};
+
+	// A desktop-like image: flat background, windows with title bars and borders, lines of
+	// one-bit "text", an anti-aliased button and a noisy photo area
+	Image SyntheticUi(size_t width, size_t height, uint32_t seed) {
+		std::mt19937 random(seed);
+		Image image(width, height);
+		image.Fill(0, 0, width, height, 0xFF3A6EA5u);
+		for (int window = 0; window < 3; ++window) {
+			size_t left = random() % (width / 2 + 1);
+			size_t top = random() % (height / 2 + 1);
+			size_t w = width / 3 + random() % (width / 3 + 1);
+			size_t h = height / 3 + random() % (height / 3 + 1);
+			image.Fill(left, top, w, h, 0xFF202020u);
+			image.Fill(left + 1, top + 1, w - 2, 20, 0xFF0063B1u);
+			image.Fill(left + 1, top + 21, w - 2, h - 22, 0xFFFFFFFFu);
+			for (size_t line = top + 28; line + 10 < top + h; line += 14) {
+				for (size_t x = left + 8; x + 6 < left + w - 8; x += 6) {
+					uint32_t glyph = random();
+					for (size_t bit = 0; bit < 30; ++bit) {
+						if (glyph >> bit & 1) {
+							image.Fill(x + bit % 5, line + bit / 5 * 2, 1, 2, 0xFF000000u);
+						}
+					}
+				}
+			}
+			// Button edges blend through a few grays
+			for (size_t i = 0; i < 4; ++i) {
+				uint32_t gray = 0x40 + 0x30 * static_cast<uint32_t>(i);
+				image.Fill(left + 10 + i, top + h - 30 + i, 80 - 2 * i, 20 - 2 * i, 0xFF000000u | gray * 0x010101u);
+			}
+		}
+		size_t photoLeft = width * 2 / 3;
+		size_t photoTop = height * 2 / 3;
+		for (size_t y = photoTop; y < height; ++y) {
+			for (size_t x = photoLeft; x < width; ++x) {
+				image.Set(x, y, 0xFF000000u | (random() & 0xFFFFFFu));
+			}
+		}
+		return image;
+	}
+
+	std::vector<uint8_t> Encode(const Image& image) {
+		std::vector<uint8_t> encoded;
+		EncodeScreenImage(image.bgra.data(), image.stride, image.width, image.height, encoded);
+		return encoded;
+	}
+
+	// Decodes through the same path as a received frame
+	bool Decode(const std::vector<uint8_t>& encoded, Image& out) {
+		FrameView frame;
+		frame.data = encoded.data();
+		frame.format = PixelFormat::Screen;
+		if (!ResolvePlaneLayout(frame, encoded.size())) {
+			return false;
+		}
+		out = Image(frame.width, frame.height, 12);
+		return ConvertFrameToBgra(frame, out.bgra.data(), out.stride);
+	}
+
+	// Pixels match with alpha forced opaque, and the destination's row padding is untouched
+	void ExpectSamePixels(const Image& expected, const Image& actual) {
+		ASSERT_EQ(actual.width, expected.width);
+		ASSERT_EQ(actual.height, expected.height);
+		for (size_t y = 0; y < expected.height; ++y) {
+			for (size_t x = 0; x < expected.width; ++x) {
+				const uint8_t* e = expected.bgra.data() + y * expected.stride + x * 4;
+				const uint8_t* a = actual.bgra.data() + y * actual.stride + x * 4;
+				ASSERT_TRUE(a[0] == e[0] && a[1] == e[1] && a[2] == e[2] && a[3] == 0xFF) << "pixel " << x << "," << y;
+			}
+			for (size_t x = actual.width * 4; x < actual.stride; ++x) {
+				ASSERT_EQ(actual.bgra[y * actual.stride + x], 0xCD);
+			}
+		}
+	}
+
+	void ExpectRoundTrip(const Image& image) {
+		std::vector<uint8_t> encoded = Encode(image);
+		Image decoded(0, 0);
+		ASSERT_TRUE(Decode(encoded, decoded)) << image.width << "x" << image.height;
+		ExpectSamePixels(image, decoded);
+	}
+
+	// The mode byte of the first tile
+	ScreenTileMode FirstTileMode(const std::vector<uint8_t>& encoded) {
+		return static_cast<ScreenTileMode>(encoded[kScreenImageHeaderSize]);
+	}
+
+	// A tile of the given number of colours, each pixel picked at random
+	Image RandomColors(size_t width, size_t height, size_t colors, uint32_t seed) {
+		std::mt19937 random(seed);
+		Image image(width, height);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				size_t index = (y * width + x) < colors ? y * width + x : random() % colors;
+				image.Set(x, y, 0xFF000000u | static_cast<uint32_t>(index * 0x010203u));
+			}
+		}
+		return image;
+	}
+}
+
+TEST(ScreenCodecTest, SyntheticUiRoundTrips) {
+	for (uint32_t seed = 1; seed <= 4; ++seed) {
+		ExpectRoundTrip(SyntheticUi(640, 480, seed));
+	}
+	// Edge tiles narrower and shorter than a full tile
+	ExpectRoundTrip(SyntheticUi(333, 201, 5));
+	ExpectRoundTrip(SyntheticUi(65, 129, 6));
+}
+
+TEST(ScreenCodecTest, OddSizesAndPaddedStridesRoundTrip) {
+	std::mt19937 random(7);
+	for (size_t width : { 1, 2, 63, 64, 65, 127, 129 }) {
+		for (size_t height : { 1, 3, 64, 65 }) {
+			Image image(width, height, 20);
+			for (size_t y = 0; y < height; ++y) {
+				for (size_t x = 0; x < width; ++x) {
+					image.Set(x, y, 0xFF000000u | (random() % 3) * 0x7F7F7Fu);
+				}
+			}
+			ExpectRoundTrip(image);
+		}
+	}
+}
+
+TEST(ScreenCodecTest, TilesPickTheirMode) {
+	Image solid(64, 64);
+	solid.Fill(0, 0, 64, 64, 0xFF123456u);
+	std::vector<uint8_t> encoded = Encode(solid);
+	EXPECT_EQ(FirstTileMode(encoded), ScreenTileMode::Solid);
+	EXPECT_EQ(encoded.size(), kScreenImageHeaderSize + 4);
+
+	EXPECT_EQ(FirstTileMode(Encode(RandomColors(64, 64, 2, 1))), ScreenTileMode::Palette);
+
+	// Random 24-bit noise does not fit a palette
+	std::vector<uint8_t> noise = Encode(RandomColors(64, 64, 4096, 2));
+	EXPECT_EQ(FirstTileMode(noise), ScreenTileMode::Raw);
+	EXPECT_EQ(noise.size(), kScreenImageHeaderSize + 1 + 64 * 64 * 3);
+}
+
+TEST(ScreenCodecTest, EveryIndexWidthRoundTrips) {
+	// Palette sizes at the edges of 1, 2, 4 and 8 bit indices, and just past the palette limit
+	for (size_t colors : { 2, 3, 4, 5, 16, 17, 200, 256, 257 }) {
+		Image image = RandomColors(64, 64, colors, static_cast<uint32_t>(colors));
+		ExpectRoundTrip(image);
+		EXPECT_EQ(FirstTileMode(Encode(image)), colors <= 256 ? ScreenTileMode::Palette : ScreenTileMode::Raw) << colors;
+	}
+}
+
+TEST(ScreenCodecTest, LongRunsRoundTrip) {
+	// Runs past 128 pixels need extension bytes, some of them 255
+	Image image(64, 64);
+	image.Fill(0, 0, 64, 64, 0xFFFFFFFFu);
+	image.Fill(0, 0, 64, 6, 0xFF000000u);
+	image.Set(5, 20, 0xFF000000u);
+	image.Fill(0, 30, 64, 34, 0xFF808080u);
+	ExpectRoundTrip(image);
+	EXPECT_LT(Encode(image).size(), 64u);
+}
+
+TEST(ScreenCodecTest, DamagedDataIsRejected) {
+	std::vector<uint8_t> encoded = Encode(SyntheticUi(200, 130, 8));
+	Image decoded(0, 0);
+	ASSERT_TRUE(Decode(encoded, decoded));
+
+	for (size_t cut : { size_t(0), size_t(5), kScreenImageHeaderSize, encoded.size() / 2, encoded.size() - 1 }) {
+		std::vector<uint8_t> truncated(encoded.begin(), encoded.begin() + cut);
+		EXPECT_FALSE(Decode(truncated, decoded)) << cut;
+	}
+
+	std::vector<uint8_t> trailing = encoded;
+	trailing.push_back(0);
+	EXPECT_FALSE(Decode(trailing, decoded));
+
+	std::vector<uint8_t> badMode = encoded;
+	badMode[kScreenImageHeaderSize] = 3;
+	EXPECT_FALSE(Decode(badMode, decoded));
+
+	std::vector<uint8_t> badMagic = encoded;
+	badMagic[0] ^= 1;
+	EXPECT_FALSE(Decode(badMagic, decoded));
+
+	// Random damage must never read out of bounds (run under ASan); the result may go either way
+	std::mt19937 random(9);
+	for (int i = 0; i < 2000; ++i) {
+		std::vector<uint8_t> damaged = encoded;
+		size_t offset = kScreenImageHeaderSize + random() % (damaged.size() - kScreenImageHeaderSize);
+		damaged[offset] = static_cast<uint8_t>(random());
+		Decode(damaged, decoded);
+	}
+}
+
+TEST(ScreenCodecTest, IndexPastThePaletteDecodesBlack) {
+	// A 2x1 image whose palette tile has two colours and a run of index 5
+	std::vector<uint8_t> encoded;
+	for (uint32_t value : { kScreenImageMagic, 2u, 1u }) {
+		for (size_t i = 0; i < 4; ++i) {
+			encoded.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+	const uint8_t tile[] = { static_cast<uint8_t>(ScreenTileMode::Palette), 1, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60,
+		0x80 | 1, 5 };
+	encoded.insert(encoded.end(), std::begin(tile), std::end(tile));
+	Image decoded(0, 0);
+	ASSERT_TRUE(Decode(encoded, decoded));
+	for (size_t x = 0; x < 2; ++x) {
+		const uint8_t* pixel = decoded.bgra.data() + x * 4;
+		EXPECT_EQ(std::string(pixel, pixel + 4), std::string("\0\0\0\xFF", 4));
+	}
+}
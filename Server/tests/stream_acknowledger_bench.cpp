@@ -0,0 +1,446 @@
+// Frames per second from a loopback client to a NetworkServer and FramePipeline, over a link with
+// the given round trip time, with a reply per frame and in streaming mode. The server handles raw
+// frames as Server.cpp does (credits, cumulative acks, grants) and presents each frame by sleeping
+// for a fixed render time. The round trip is added on the client: every message from the server is
+// held back for that long before the client sees it.
+//
+// With a reply per frame the client sends one frame per round trip. Streaming keeps the credit
+// window in flight and is bounded by the render time and window / RTT, whichever is lower.
+// "presented/s" counts the frames that reached the window; the rest were superseded in the mailbox.
+#include "frame_pipeline.h"
+#include "network_server.h"
+#include "raw_frame.h"
+#include "socket_compat.h"
+#include "stream_acknowledger.h"
+#include "windowcaster.pb.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	constexpr uint64_t kTargetWindow = 1;
+
+	// Presents by sleeping for the render time
+	class SleepingPresenter : public FramePresenter {
+	public:
+		explicit SleepingPresenter(std::chrono::microseconds renderTime) : renderTime(renderTime) {}
+
+		bool Present(const FrameItem&) override {
+			std::this_thread::sleep_for(renderTime);
+			presented++;
+			return true;
+		}
+
+		void Execute(const ControlItem&) override {}
+
+		std::atomic<uint64_t> presented{ 0 };
+
+	private:
+		std::chrono::microseconds renderTime;
+	};
+
+	void SendResponse(ReplyChannel& reply, const windowcaster::ServerResponse& response) {
+		reply.SendMessage(response.SerializeAsString());
+	}
+
+	void FillStreamAck(StreamAcknowledger& stream, windowcaster::ServerResponse& response) {
+		StreamAcknowledger::Ack ack = stream.TakeAck();
+		auto* streamAck = response.mutable_stream_ack();
+		streamAck->set_sequence(ack.sequence);
+		streamAck->set_presented_sequence(ack.presentedSequence);
+		streamAck->set_frames(ack.frames);
+		streamAck->set_failed_frames(ack.failedFrames);
+	}
+
+	// The parts of the server that raw frames and stream configuration go through
+	class StreamingServer {
+	public:
+		explicit StreamingServer(std::chrono::microseconds renderTime)
+			: presenter(renderTime)
+			, pipeline(presenter, 1) {
+			pipeline.SetMessageHandler([](const std::shared_ptr<ReplyChannel>& reply, const FrameBuffer& message) {
+				HandleMessage(reply, message);
+				});
+			pipeline.SetRawFrameHandler([this](const std::shared_ptr<ReplyChannel>& reply, std::unique_ptr<RawFrame> raw) {
+				HandleRawFrame(*reply, std::move(raw));
+				});
+			pipeline.Start();
+
+			std::mt19937 random(static_cast<uint32_t>(Clock::now().time_since_epoch().count()));
+			for (int attempt = 0; attempt < 50 && !server; ++attempt) {
+				port = static_cast<uint16_t>(20000 + random() % 30000);
+				auto candidate = std::make_unique<NetworkServer>(port, 4, 1);
+				candidate->SetMessageHandler([this](const std::shared_ptr<ClientSession>& session,
+					std::shared_ptr<FrameBuffer> message) {
+					pipeline.SubmitMessage(session, std::move(message));
+					});
+				candidate->SetRawFrameHandler([this](const std::shared_ptr<ClientSession>& session,
+					std::unique_ptr<RawFrame> frame) {
+					pipeline.SubmitRawFrame(session, std::move(frame));
+					});
+				candidate->SetSessionClosedHandler([this](const std::shared_ptr<ClientSession>& session) {
+					pipeline.CloseSource(session.get());
+					});
+				if (candidate->Start()) {
+					server = std::move(candidate);
+				}
+			}
+		}
+
+		~StreamingServer() {
+			if (server) {
+				server->Stop();
+			}
+			pipeline.Stop();
+		}
+
+		explicit operator bool() const { return server != nullptr; }
+
+		uint64_t Presented() const { return presenter.presented; }
+
+		uint16_t port = 0;
+
+	private:
+		SleepingPresenter presenter;
+		FramePipeline pipeline;
+		std::unique_ptr<NetworkServer> server;
+
+		static void HandleMessage(const std::shared_ptr<ReplyChannel>& channel, const FrameBuffer& message) {
+			windowcaster::ClientRequest request;
+			windowcaster::ServerResponse response;
+			if (!request.ParseFromArray(message.Data(), static_cast<int>(message.Size())) || !request.has_stream_config()) {
+				response.mutable_status()->set_success(false);
+				SendResponse(*channel, response);
+				return;
+			}
+
+			if (channel->Stream()) {
+				FillStreamAck(*channel->Stream(), response);
+			}
+			response.mutable_status()->set_success(true);
+			const auto& config = request.stream_config();
+			if (!config.enabled()) {
+				channel->SetStream(nullptr);
+				SendResponse(*channel, response);
+				return;
+			}
+
+			auto stream = std::make_shared<StreamAcknowledger>(config.ack_every_frames(), config.ack_interval_ms());
+			std::weak_ptr<ReplyChannel> weakChannel = channel;
+			stream->Credits().SetGrantHandler([weakChannel](uint64_t targetWindow, uint64_t frames, uint64_t bytes) {
+				if (std::shared_ptr<ReplyChannel> target = weakChannel.lock()) {
+					windowcaster::ServerResponse grantResponse;
+					auto* grant = grantResponse.add_credits();
+					grant->set_target_window(targetWindow);
+					grant->set_frames(frames);
+					grant->set_bytes(bytes);
+					SendResponse(*target, grantResponse);
+				}
+				});
+			response.set_raw_frame_version(kRawFrameVersion);
+			response.mutable_credit_window()->set_frames(stream->Credits().Frames());
+			response.mutable_credit_window()->set_bytes(stream->Credits().Bytes());
+			channel->SetStream(std::move(stream));
+			SendResponse(*channel, response);
+		}
+
+		void HandleRawFrame(ReplyChannel& reply, std::unique_ptr<RawFrame> raw) {
+			windowcaster::ServerResponse response;
+			auto* status = response.mutable_status();
+			uint64_t sequence = raw->header.sequence;
+			size_t messageSize = raw->messageSize;
+
+			auto frame = std::make_unique<FrameItem>();
+			frame->targetWindow = raw->header.targetWindow;
+			frame->isVideo = true;
+			frame->receivedAt = Clock::now();
+			frame->image.data = reinterpret_cast<const uint8_t*>(raw->pixels->Data());
+			frame->image.width = raw->header.width;
+			frame->image.height = raw->header.height;
+			frame->owner = std::move(raw->pixels);
+
+			if (const auto& stream = reply.Stream()) {
+				CreditWindow& credits = stream->Credits();
+				if (!credits.Acquire(frame->targetWindow, messageSize)) {
+					status->set_success(false);
+					status->set_message("Credit exceeded");
+					credits.Release(frame->targetWindow, messageSize);
+					frame.reset();
+				}
+				else {
+					frame->clientSequence = sequence;
+					frame->messageSize = messageSize;
+					frame->observer = stream;
+				}
+			}
+			if (frame) {
+				pipeline.PostFrame(std::move(frame));
+				status->set_success(true);
+			}
+
+			if (const auto& stream = reply.Stream()) {
+				if (!stream->RecordFrame(sequence, status->success(), status->message())) {
+					return;
+				}
+				response.Clear();
+				FillStreamAck(*stream, response);
+			}
+			SendResponse(reply, response);
+		}
+	};
+
+	// Loopback client whose view of the server lags by the round trip time
+	class DelayedClient {
+	public:
+		DelayedClient(uint16_t port, std::chrono::microseconds roundTrip) : roundTrip(roundTrip) {
+			socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(port);
+			if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+				socket_compat::Close(socket);
+				socket = kInvalidSocket;
+				return;
+			}
+			reader = std::thread([this] { Read(); });
+		}
+
+		~DelayedClient() {
+			if (socket != kInvalidSocket) {
+				shutdown(socket, SHUT_RDWR);
+			}
+			if (reader.joinable()) {
+				reader.join();
+			}
+			socket_compat::Close(socket);
+		}
+
+		bool Connected() const { return socket != kInvalidSocket; }
+
+		bool SendAll(const std::string& data) {
+			for (size_t sent = 0; sent < data.size(); ) {
+				ssize_t n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) {
+					return false;
+				}
+				sent += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		// Next message from the server once the round trip has passed, false after 10 s without one
+		bool Next(windowcaster::ServerResponse& response) {
+			std::unique_lock<std::mutex> lock(mutex);
+			auto deadline = Clock::now() + std::chrono::seconds(10);
+			while (true) {
+				if (!arrived.empty() && arrived.front().first <= Clock::now()) {
+					bool ok = response.ParseFromString(arrived.front().second);
+					arrived.pop_front();
+					return ok;
+				}
+				if (Clock::now() > deadline || (closed && arrived.empty())) {
+					return false;
+				}
+				if (arrived.empty()) {
+					changed.wait_until(lock, deadline);
+				}
+				else {
+					changed.wait_until(lock, std::min(deadline, arrived.front().first));
+				}
+			}
+		}
+
+	private:
+		SocketHandle socket;
+		std::chrono::microseconds roundTrip;
+		std::thread reader;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<std::pair<Clock::time_point, std::string>> arrived;
+		bool closed = false;
+
+		bool ReceiveExact(char* out, size_t size) {
+			for (size_t received = 0; received < size; ) {
+				ssize_t n = recv(socket, out + received, size - received, 0);
+				if (n <= 0) {
+					return false;
+				}
+				received += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+		void Read() {
+			while (true) {
+				unsigned char prefix[4];
+				std::string body;
+				bool ok = ReceiveExact(reinterpret_cast<char*>(prefix), 4);
+				if (ok) {
+					body.resize(prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) | (static_cast<size_t>(prefix[3]) << 24));
+					ok = ReceiveExact(&body[0], body.size());
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!ok) {
+					closed = true;
+					changed.notify_all();
+					return;
+				}
+				arrived.emplace_back(Clock::now() + roundTrip, std::move(body));
+				changed.notify_all();
+			}
+		}
+	};
+
+	void Put(std::string& out, size_t offset, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	// Length prefix, raw frame header and BGRA pixels of one video frame
+	std::string RawFrameMessage(size_t width, size_t height, uint64_t sequence) {
+		std::string message(4 + kRawFrameHeaderSize + width * height * 4, '\x40');
+		Put(message, 0, (kRawFrameHeaderSize + width * height * 4) | kRawFrameFlag, 4);
+		std::memset(&message[4], 0, kRawFrameHeaderSize);
+		Put(message, 4, kRawFrameMagic, 4);
+		Put(message, 8, kRawFrameVersion, 2);
+		Put(message, 10, kRawFrameHeaderSize, 2);
+		Put(message, 12, kTargetWindow, 8);
+		Put(message, 20, sequence, 8);
+		Put(message, 28, width, 4);
+		Put(message, 32, height, 4);
+		Put(message, 40, static_cast<uint16_t>(PixelFormat::Bgra32), 2);
+		Put(message, 42, kRawFrameFlagVideo, 2);
+		return message;
+	}
+
+	std::string Framed(const google::protobuf::Message& request) {
+		std::string body = request.SerializeAsString();
+		std::string message(4, '\0');
+		Put(message, 0, body.size(), 4);
+		return message + body;
+	}
+
+	std::string StreamConfig(bool enabled) {
+		windowcaster::ClientRequest request;
+		request.mutable_stream_config()->set_enabled(enabled);
+		return Framed(request);
+	}
+
+	// Sends a frame and waits for its reply until the time is up, counting frames
+	bool RunPerMessage(DelayedClient& client, const std::string& frame, double seconds, uint64_t& frames) {
+		auto start = Clock::now();
+		windowcaster::ServerResponse response;
+		while (frames < 3 || std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+			std::string message = frame;
+			Put(message, 20, ++frames, 8);
+			if (!client.SendAll(message) || !client.Next(response) || !response.status().success()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Sends frames while the credit window has room, then ends the stream and waits for its last ack
+	bool RunStreaming(DelayedClient& client, const std::string& frame, double seconds, uint64_t& frames) {
+		auto start = Clock::now();
+		windowcaster::ServerResponse response;
+		if (!client.SendAll(StreamConfig(true)) || !client.Next(response) || !response.status().success()) {
+			return false;
+		}
+		uint64_t window = response.credit_window().frames();
+		uint64_t released = 0;
+		uint64_t acknowledged = 0;
+		auto take = [&](const windowcaster::ServerResponse& message) {
+			for (const auto& grant : message.credits()) {
+				released = std::max(released, grant.frames());
+			}
+			if (message.has_stream_ack()) {
+				acknowledged = std::max(acknowledged, message.stream_ack().sequence());
+				if (message.stream_ack().failed_frames()) {
+					return false;
+				}
+			}
+			return true;
+		};
+
+		while (frames < 3 || std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+			while (frames - released >= window) {
+				if (!client.Next(response) || !take(response)) {
+					return false;
+				}
+			}
+			std::string message = frame;
+			Put(message, 20, ++frames, 8);
+			if (!client.SendAll(message)) {
+				return false;
+			}
+		}
+
+		if (!client.SendAll(StreamConfig(false))) {
+			return false;
+		}
+		do {
+			if (!client.Next(response) || !take(response)) {
+				return false;
+			}
+		} while (!response.has_status());
+		return acknowledged == frames;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 2.0;
+	size_t width = quick ? 64 : 1280;
+	size_t height = quick ? 36 : 720;
+	auto renderTime = std::chrono::microseconds(quick ? 100 : 2000);
+	std::vector<int> roundTripsMs = quick ? std::vector<int>{ 0, 5 } : std::vector<int>{ 0, 1, 5, 20, 50 };
+
+	socket_compat::Startup();
+	std::string frame = RawFrameMessage(width, height, 0);
+	std::printf("%zux%zu BGRA raw frames over loopback, %.1f ms render, credit window %u frames\n", width, height,
+		renderTime.count() / 1e3, StreamAcknowledger::kCreditFrames);
+	std::printf("%-8s %-12s %10s %12s\n", "RTT ms", "replies", "frames/s", "presented/s");
+	for (int roundTripMs : roundTripsMs) {
+		for (bool streaming : { false, true }) {
+			StreamingServer server(renderTime);
+			if (!server) {
+				std::printf("cannot start the loopback server\n");
+				return 1;
+			}
+			DelayedClient client(server.port, std::chrono::milliseconds(roundTripMs));
+			if (!client.Connected()) {
+				std::printf("cannot connect to the loopback server\n");
+				return 1;
+			}
+
+			auto start = Clock::now();
+			uint64_t frames = 0;
+			bool ok = streaming ? RunStreaming(client, frame, seconds, frames)
+				: RunPerMessage(client, frame, seconds, frames);
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			if (!ok) {
+				std::printf("%s run failed after %llu frames\n", streaming ? "streaming" : "per-frame",
+					static_cast<unsigned long long>(frames));
+				return 1;
+			}
+			std::printf("%-8d %-12s %10.1f %12.1f\n", roundTripMs, streaming ? "cumulative" : "per frame",
+				static_cast<double>(frames) / elapsed, static_cast<double>(server.Presented()) / elapsed);
+		}
+	}
+	socket_compat::Cleanup();
+	return 0;
+}
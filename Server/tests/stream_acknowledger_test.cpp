@@ -0,0 +1,243 @@
+#include "frame_pipeline.h"
+#include "stream_acknowledger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	using std::chrono::milliseconds;
+
+	bool WaitUntil(const std::function<bool()>& done, milliseconds timeout = milliseconds(10000)) {
+		auto deadline = Clock::now() + timeout;
+		while (!done()) {
+			if (Clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+
+	// Presents slowly, and can be held inside Present until the test opens the gate
+	class ThrottledPresenter : public FramePresenter {
+	public:
+		explicit ThrottledPresenter(milliseconds presentTime = milliseconds(0)) : presentTime(presentTime) {}
+
+		bool Present(const FrameItem& frame) override {
+			entered++;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return open; });
+			}
+			std::this_thread::sleep_for(presentTime);
+			presented++;
+			lastSequence = frame.sequence;
+			return true;
+		}
+
+		void Execute(const ControlItem&) override {}
+
+		void Close() {
+			std::lock_guard<std::mutex> lock(mutex);
+			open = false;
+		}
+
+		void Open() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				open = true;
+			}
+			condition.notify_all();
+		}
+
+		std::atomic<uint64_t> entered{ 0 };
+		std::atomic<uint64_t> presented{ 0 };
+		std::atomic<uint64_t> lastSequence{ 0 };
+
+	private:
+		milliseconds presentTime;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool open = true;
+	};
+
+	// A streaming session as the server sees it, driven like the client: a frame is only sent
+	// while the window has credit left
+	class StreamingSource {
+	public:
+		StreamingSource() : stream(std::make_shared<StreamAcknowledger>(0, 0)) {
+			stream->Credits().SetGrantHandler([this](uint64_t, uint64_t frames, uint64_t bytes) {
+				// Cumulative totals may arrive out of order
+				UpdateMax(framesReleased, frames);
+				UpdateMax(bytesReleased, bytes);
+			});
+		}
+
+		bool CanSend() const {
+			return sent - framesReleased < StreamAcknowledger::kCreditFrames;
+		}
+
+		// Queues a frame the way Server::QueueFrame does
+		void Send(FramePipeline& pipeline, uint64_t targetWindow, size_t messageSize = 1000) {
+			ASSERT_TRUE(stream->Credits().Acquire(targetWindow, messageSize));
+			auto frame = std::make_unique<FrameItem>();
+			frame->targetWindow = targetWindow;
+			frame->isVideo = true;
+			frame->receivedAt = Clock::now();
+			frame->clientSequence = ++sent;
+			frame->messageSize = messageSize;
+			frame->observer = stream;
+			bytesSent += messageSize;
+			pipeline.PostFrame(std::move(frame));
+		}
+
+		std::shared_ptr<StreamAcknowledger> stream;
+		std::atomic<uint64_t> sent{ 0 };
+		std::atomic<uint64_t> bytesSent{ 0 };
+		std::atomic<uint64_t> framesReleased{ 0 };
+		std::atomic<uint64_t> bytesReleased{ 0 };
+
+	private:
+		static void UpdateMax(std::atomic<uint64_t>& target, uint64_t value) {
+			uint64_t current = target.load();
+			while (value > current && !target.compare_exchange_weak(current, value)) {
+			}
+		}
+	};
+
+	// A frame from server-side playback: no observer, holds no credit
+	void PostPlayback(FramePipeline& pipeline, uint64_t targetWindow) {
+		auto frame = std::make_unique<FrameItem>();
+		frame->targetWindow = targetWindow;
+		frame->isVideo = true;
+		frame->receivedAt = Clock::now();
+		pipeline.PostFrame(std::move(frame));
+	}
+
+	constexpr uint64_t kWindow = 7;
+}
+
+TEST(StreamAcknowledgerTest, SupersededCreditComesBackWhenTheReplacementIsPresented) {
+	ThrottledPresenter presenter;
+	FramePipeline pipeline(presenter, 1);
+	StreamingSource client;
+
+	presenter.Close();
+	client.Send(pipeline, kWindow);
+	ASSERT_TRUE(WaitUntil([&] { return presenter.entered == 1; }));
+	client.Send(pipeline, kWindow);
+	client.Send(pipeline, kWindow);
+
+	// Frame 2 was replaced by frame 3, which is not presented yet
+	std::this_thread::sleep_for(milliseconds(20));
+	EXPECT_EQ(client.framesReleased, 0u);
+
+	presenter.Open();
+	ASSERT_TRUE(WaitUntil([&] { return client.framesReleased == 3; }));
+	EXPECT_EQ(client.bytesReleased, client.bytesSent);
+	EXPECT_EQ(presenter.presented, 2u);
+}
+
+TEST(StreamAcknowledgerTest, FrameSupersededByAnotherSessionReturnsItsCredit) {
+	ThrottledPresenter presenter;
+	FramePipeline pipeline(presenter, 1);
+	StreamingSource first;
+	StreamingSource second;
+
+	// The other session's frames are the ones being presented around the first session's last frame
+	presenter.Close();
+	second.Send(pipeline, kWindow);
+	ASSERT_TRUE(WaitUntil([&] { return presenter.entered == 1; }));
+	first.Send(pipeline, kWindow);
+	second.Send(pipeline, kWindow);
+	presenter.Open();
+
+	// The first session sends nothing more, so no frame of its own would carry the credit back
+	ASSERT_TRUE(WaitUntil([&] { return second.framesReleased == 2; }));
+	ASSERT_TRUE(WaitUntil([&] { return first.framesReleased == 1; }, milliseconds(1000)));
+	EXPECT_EQ(first.bytesReleased, first.bytesSent);
+}
+
+TEST(StreamAcknowledgerTest, FrameSupersededByPlaybackReturnsItsCredit) {
+	ThrottledPresenter presenter;
+	FramePipeline pipeline(presenter, 1);
+	StreamingSource client;
+
+	presenter.Close();
+	PostPlayback(pipeline, kWindow);
+	ASSERT_TRUE(WaitUntil([&] { return presenter.entered == 1; }));
+	client.Send(pipeline, kWindow);
+	PostPlayback(pipeline, kWindow);
+	presenter.Open();
+
+	ASSERT_TRUE(WaitUntil([&] { return presenter.presented == 2; }));
+	ASSERT_TRUE(WaitUntil([&] { return client.framesReleased == 1; }, milliseconds(1000)));
+	EXPECT_EQ(client.bytesReleased, client.bytesSent);
+}
+
+TEST(StreamAcknowledgerTest, CancelledReplacementReturnsSupersededCredit) {
+	ThrottledPresenter presenter;
+	FramePipeline pipeline(presenter, 1);
+	StreamingSource first;
+	StreamingSource second;
+
+	presenter.Close();
+	PostPlayback(pipeline, kWindow);
+	ASSERT_TRUE(WaitUntil([&] { return presenter.entered == 1; }));
+	first.Send(pipeline, kWindow);
+	second.Send(pipeline, kWindow);
+	ControlItem stop;
+	stop.targetWindow = kWindow;
+	ASSERT_TRUE(pipeline.PostControl(stop));
+	presenter.Open();
+
+	ASSERT_TRUE(WaitUntil([&] { return second.framesReleased == 1; }));
+	ASSERT_TRUE(WaitUntil([&] { return first.framesReleased == 1; }, milliseconds(1000)));
+	EXPECT_EQ(presenter.presented, 1u);
+}
+
+TEST(StreamAcknowledgerTest, ThrottledSourcesSharingAWindowNeverStall) {
+	constexpr uint64_t kFrames = 300;
+	ThrottledPresenter presenter(milliseconds(2));
+	FramePipeline pipeline(presenter, 1);
+	StreamingSource first;
+	StreamingSource second;
+
+	// Two sessions and a server-side player all target one window and keep replacing each other's frames
+	std::atomic<bool> streaming{ true };
+	std::thread player([&] {
+		while (streaming) {
+			PostPlayback(pipeline, kWindow);
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+	});
+	auto stream = [&](StreamingSource& source) {
+		while (source.sent < kFrames) {
+			if (!WaitUntil([&] { return source.CanSend(); }, milliseconds(5000))) {
+				return;
+			}
+			source.Send(pipeline, kWindow, 1000 + source.sent);
+		}
+	};
+	std::thread firstThread(stream, std::ref(first));
+	std::thread secondThread(stream, std::ref(second));
+	firstThread.join();
+	secondThread.join();
+	streaming = false;
+	player.join();
+
+	EXPECT_EQ(first.sent, kFrames);
+	EXPECT_EQ(second.sent, kFrames);
+	// Once the window is done every frame's credit is back, superseded ones included
+	ASSERT_TRUE(WaitUntil([&] { return first.framesReleased == kFrames && second.framesReleased == kFrames; }));
+	EXPECT_EQ(first.bytesReleased, first.bytesSent);
+	EXPECT_EQ(second.bytesReleased, second.bytesSent);
+	EXPECT_GT(pipeline.GetStats().framesDropped, 0u);
+}
@@ -0,0 +1,124 @@
+// What change detection costs against the presenting it saves, for 1920x1080 BGRA frames shown in
+// a 2560x1440 client area. Consecutive frames differ by the given amount. "diff" is hashing and
+// comparing the tiles alone, "full present" converting and scaling the whole frame as a target
+// without change detection does, and "tiled present" MemoryRenderTarget::RenderImageFrame, which
+// compares tiles and rescales only the changed ones. Times are milliseconds per frame.
+#include "memory_render_target.h"
+#include "pixel_convert.h"
+#include "tile_tracker.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kWidth = 1920;
+	constexpr size_t kHeight = 1080;
+	constexpr int kClientWidth = 2560;
+	constexpr int kClientHeight = 1440;
+
+	struct Change {
+		const char* name;
+		size_t x;
+		size_t y;
+		size_t width;
+		size_t height;
+	};
+
+	// Calls run until the time is used up; returns seconds per call
+	template <typename Body>
+	double Measure(double seconds, Body body) {
+		size_t calls = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++calls;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return elapsed.count() / static_cast<double>(calls);
+	}
+
+	FrameView View(const std::vector<uint8_t>& pixels) {
+		FrameView view;
+		view.data = pixels.data();
+		view.width = kWidth;
+		view.height = kHeight;
+		view.format = PixelFormat::Bgra32;
+		ResolvePlaneLayout(view, pixels.size());
+		return view;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 1.0;
+
+	std::mt19937 random(1);
+	std::vector<uint8_t> base(kWidth * kHeight * 4);
+	for (auto& byte : base) {
+		byte = static_cast<uint8_t>(random());
+	}
+
+	const Change changes[] = {
+		{ "identical", 0, 0, 0, 0 },
+		{ "cursor 32x32", 900, 500, 32, 32 },
+		{ "text line", 0, 600, kWidth, 20 },
+		{ "quarter", 0, 0, kWidth / 2, kHeight / 2 },
+		{ "everything", 0, 0, kWidth, kHeight },
+	};
+
+	SimdLevel best = DetectSimdLevel();
+	std::printf("1920x1080 BGRA frames in a 2560x1440 client, %s\n", SimdLevelName(best));
+	std::printf("%-13s %10s %14s %15s %14s\n", "change", "diff", "full present", "tiled present", "scaled pixels");
+
+	std::vector<uint8_t> converted(base.size());
+	std::vector<uint8_t> client(static_cast<size_t>(kClientWidth) * kClientHeight * 4);
+	for (const Change& change : changes) {
+		// Two frames that differ only inside the change, shown in turn
+		std::vector<uint8_t> other = base;
+		for (size_t y = change.y; y < change.y + change.height; ++y) {
+			for (size_t x = change.x; x < change.x + change.width; ++x) {
+				other[(y * kWidth + x) * 4] ^= 0xFF;
+			}
+		}
+		const FrameView frames[] = { View(base), View(other) };
+		size_t next = 0;
+
+		TileTracker tracker(best);
+		std::vector<TileTracker::Region> regions;
+		double diff = Measure(seconds, [&] {
+			regions.clear();
+			tracker.Compare(frames[next].data, kWidth * 4, kWidth, kHeight, regions);
+			next ^= 1;
+		});
+
+		ImageScaler scaler(ScaleOptions(), best);
+		double full = Measure(seconds, [&] {
+			ConvertFrameToBgra(best, frames[next], converted.data(), kWidth * 4);
+			scaler.Scale(converted.data(), kWidth * 4, kWidth, kHeight, client.data(), kClientWidth * 4,
+				kClientWidth, kClientHeight);
+			next ^= 1;
+		});
+
+		MemoryRenderTarget target(kClientWidth, kClientHeight);
+		target.Initialize(1);
+		target.RenderImageFrame(frames[0]);
+		next = 1;
+		uint64_t scaledBefore = target.GetCounters().pixelsScaled;
+		uint64_t framesBefore = target.GetCounters().frames;
+		double tiled = Measure(seconds, [&] {
+			target.RenderImageFrame(frames[next]);
+			next ^= 1;
+		});
+		double scaledPerFrame = static_cast<double>(target.GetCounters().pixelsScaled - scaledBefore)
+			/ static_cast<double>(target.GetCounters().frames - framesBefore);
+
+		std::printf("%-13s %7.3f ms %11.2f ms %12.2f ms %13.0f\n", change.name, diff * 1e3, full * 1e3, tiled * 1e3,
+			scaledPerFrame);
+	}
+	return 0;
+}
@@ -0,0 +1,303 @@
+#include "tile_tracker.h"
+#include "work_stealing_pool.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	constexpr size_t kTile = TileTracker::kTileSize;
+
+	// Every level this CPU runs, scalar first; higher levels are compared against it
+	std::vector<SimdLevel> AvailableLevels() {
+		std::vector<SimdLevel> levels{ SimdLevel::Scalar };
+		if (DetectSimdLevel() >= SimdLevel::Ssse3) {
+			levels.push_back(SimdLevel::Ssse3);
+		}
+		if (DetectSimdLevel() >= SimdLevel::Avx2) {
+			levels.push_back(SimdLevel::Avx2);
+		}
+		return levels;
+	}
+
+	std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+		std::vector<uint8_t> bytes(size);
+		for (auto& byte : bytes) {
+			byte = static_cast<uint8_t>(random());
+		}
+		return bytes;
+	}
+
+	// A tightly packed BGRA frame
+	struct Frame {
+		size_t width;
+		size_t height;
+		std::vector<uint8_t> pixels;
+
+		Frame(std::mt19937& random, size_t width, size_t height)
+			: width(width), height(height), pixels(RandomBytes(random, width * height * 4)) {
+		}
+
+		size_t Stride() const { return width * 4; }
+
+		void Touch(size_t x, size_t y) {
+			pixels[y * Stride() + x * 4] ^= 0x5A;
+		}
+	};
+
+	std::vector<TileTracker::Region> Compare(TileTracker& tracker, const Frame& frame, size_t* changedTiles = nullptr) {
+		std::vector<TileTracker::Region> regions;
+		size_t changed = tracker.Compare(frame.pixels.data(), frame.Stride(), frame.width, frame.height, regions);
+		if (changedTiles) {
+			*changedTiles = changed;
+		}
+		return regions;
+	}
+
+	std::string Describe(const std::vector<TileTracker::Region>& regions) {
+		std::string text;
+		for (const TileTracker::Region& region : regions) {
+			text += "{" + std::to_string(region.x) + "," + std::to_string(region.y) + " "
+				+ std::to_string(region.width) + "x" + std::to_string(region.height) + "} ";
+		}
+		return text;
+	}
+
+	std::string Describe(size_t x, size_t y, size_t width, size_t height) {
+		TileTracker::Region region;
+		region.x = x;
+		region.y = y;
+		region.width = width;
+		region.height = height;
+		return Describe({ region });
+	}
+}
+
+TEST(TileTrackerTest, HashIsTheSameAtEveryLevel) {
+	std::mt19937 random(1);
+	std::uniform_int_distribution<size_t> rowBytes(1, 700);
+	std::uniform_int_distribution<size_t> rows(1, 70);
+	std::uniform_int_distribution<size_t> padding(0, 40);
+	for (int i = 0; i < 300; ++i) {
+		size_t width = rowBytes(random);
+		size_t height = rows(random);
+		size_t stride = width + padding(random);
+		std::vector<uint8_t> data = RandomBytes(random, stride * (height - 1) + width);
+		uint64_t expected = HashPixels(SimdLevel::Scalar, data.data(), stride, width, height);
+		for (SimdLevel level : AvailableLevels()) {
+			ASSERT_EQ(HashPixels(level, data.data(), stride, width, height), expected)
+				<< SimdLevelName(level) << " " << width << "x" << height << " stride " << stride;
+		}
+	}
+}
+
+TEST(TileTrackerTest, HashIgnoresRowPadding) {
+	std::mt19937 random(2);
+	const size_t width = 4 * 37;
+	const size_t height = 9;
+	const size_t stride = width + 20;
+	std::vector<uint8_t> data = RandomBytes(random, stride * height);
+	for (SimdLevel level : AvailableLevels()) {
+		uint64_t before = HashPixels(level, data.data(), stride, width, height);
+		std::vector<uint8_t> repadded = data;
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = width; x < stride; ++x) {
+				repadded[y * stride + x] ^= 0xFF;
+			}
+		}
+		EXPECT_EQ(HashPixels(level, repadded.data(), stride, width, height), before) << SimdLevelName(level);
+	}
+}
+
+TEST(TileTrackerTest, HashChangesWithAnyByteOrArrangement) {
+	std::mt19937 random(3);
+	const size_t width = 256 + 12;
+	const size_t height = 16;
+	std::vector<uint8_t> data = RandomBytes(random, width * height);
+	for (SimdLevel level : AvailableLevels()) {
+		uint64_t original = HashPixels(level, data.data(), width, width, height);
+		// Every byte position, including those in the zero-padded remainder of the rows
+		for (size_t offset = 0; offset < data.size(); offset += 7) {
+			std::vector<uint8_t> changed = data;
+			changed[offset] ^= 0x01;
+			ASSERT_NE(HashPixels(level, changed.data(), width, width, height), original)
+				<< SimdLevelName(level) << " offset " << offset;
+		}
+
+		// The same stripes in another order
+		std::vector<uint8_t> swapped = data;
+		for (size_t i = 0; i < 32; ++i) {
+			std::swap(swapped[i], swapped[32 + i]);
+		}
+		EXPECT_NE(HashPixels(level, swapped.data(), width, width, height), original) << SimdLevelName(level);
+
+		// The same bytes seen as a different shape
+		EXPECT_NE(HashPixels(level, data.data(), width / 2, width / 2, height * 2), original) << SimdLevelName(level);
+	}
+}
+
+TEST(TileTrackerTest, FirstFrameChangesEveryTile) {
+	std::mt19937 random(4);
+	Frame frame(random, 3 * kTile, 2 * kTile);
+	TileTracker tracker;
+	size_t changed = 0;
+	std::vector<TileTracker::Region> regions = Compare(tracker, frame, &changed);
+
+	EXPECT_EQ(changed, 6u);
+	EXPECT_EQ(tracker.TileCount(), 6u);
+	ASSERT_EQ(regions.size(), 2u) << Describe(regions);
+	EXPECT_EQ(Describe(regions), Describe(0, 0, 3 * kTile, kTile) + Describe(0, kTile, 3 * kTile, kTile));
+}
+
+TEST(TileTrackerTest, IdenticalFrameChangesNothing) {
+	std::mt19937 random(5);
+	Frame frame(random, 200, 150);
+	TileTracker tracker;
+	Compare(tracker, frame);
+	size_t changed = 1;
+	EXPECT_TRUE(Compare(tracker, frame, &changed).empty());
+	EXPECT_EQ(changed, 0u);
+
+	const TileTracker::Counters& counters = tracker.GetCounters();
+	EXPECT_EQ(counters.framesCompared.load(), 2u);
+	EXPECT_EQ(counters.framesSkipped.load(), 1u);
+	EXPECT_EQ(counters.tilesChanged.load(), tracker.TileCount());
+	EXPECT_EQ(counters.tilesSkipped.load(), tracker.TileCount());
+}
+
+TEST(TileTrackerTest, RunsOfChangedTilesMergeAlongARow) {
+	std::mt19937 random(6);
+	Frame frame(random, 5 * kTile, 3 * kTile);
+	TileTracker tracker;
+	Compare(tracker, frame);
+
+	// Tiles 1 and 2 of the first row form one run, tile 4 another; a whole row is one region,
+	// and a tile in the row below is not merged with the run above it
+	frame.Touch(kTile + 3, 5);
+	frame.Touch(2 * kTile + 63, 63);
+	frame.Touch(4 * kTile, 0);
+	frame.Touch(kTile + 10, kTile);
+	for (size_t x = 0; x < 5; ++x) {
+		frame.Touch(x * kTile + 20, 2 * kTile + 20);
+	}
+	size_t changed = 0;
+	std::vector<TileTracker::Region> regions = Compare(tracker, frame, &changed);
+
+	EXPECT_EQ(changed, 9u);
+	EXPECT_EQ(Describe(regions), Describe(kTile, 0, 2 * kTile, kTile) + Describe(4 * kTile, 0, kTile, kTile)
+		+ Describe(kTile, kTile, kTile, kTile) + Describe(0, 2 * kTile, 5 * kTile, kTile));
+}
+
+TEST(TileTrackerTest, EdgeTilesAreClippedToTheFrame) {
+	std::mt19937 random(7);
+	// 22 columns in the last tile across, 36 rows in the last one down
+	Frame frame(random, 2 * kTile + 22, kTile + 36);
+	TileTracker tracker;
+	Compare(tracker, frame);
+	EXPECT_EQ(tracker.TileCount(), 6u);
+
+	frame.Touch(frame.width - 1, frame.height - 1);
+	EXPECT_EQ(Describe(Compare(tracker, frame)), Describe(2 * kTile, kTile, 22, 36));
+
+	// A run reaching the right edge ends there
+	frame.Touch(kTile, 0);
+	frame.Touch(2 * kTile, 0);
+	EXPECT_EQ(Describe(Compare(tracker, frame)), Describe(kTile, 0, kTile + 22, kTile));
+
+	// Frames narrower and shorter than a tile
+	Frame small(random, 5, 3);
+	TileTracker smallTracker;
+	EXPECT_EQ(Describe(Compare(smallTracker, small)), Describe(0, 0, 5, 3));
+	small.Touch(4, 2);
+	EXPECT_EQ(Describe(Compare(smallTracker, small)), Describe(0, 0, 5, 3));
+	EXPECT_TRUE(Compare(smallTracker, small).empty());
+}
+
+TEST(TileTrackerTest, IgnoresBytesOutsideTheFrameWidth) {
+	std::mt19937 random(8);
+	const size_t width = kTile + 10;
+	const size_t height = 20;
+	const size_t stride = (width + 30) * 4;
+	std::vector<uint8_t> pixels = RandomBytes(random, stride * height);
+	TileTracker tracker;
+	std::vector<TileTracker::Region> regions;
+	tracker.Compare(pixels.data(), stride, width, height, regions);
+
+	for (size_t y = 0; y < height; ++y) {
+		pixels[y * stride + width * 4] ^= 0xFF;
+	}
+	regions.clear();
+	EXPECT_EQ(tracker.Compare(pixels.data(), stride, width, height, regions), 0u) << Describe(regions);
+}
+
+TEST(TileTrackerTest, SizeChangeChangesEveryTile) {
+	std::mt19937 random(9);
+	Frame frame(random, 3 * kTile, kTile);
+	TileTracker tracker;
+	Compare(tracker, frame);
+
+	// The same bytes seen as a frame of another shape
+	Frame reshaped = frame;
+	reshaped.width = kTile;
+	reshaped.height = 3 * kTile;
+	size_t changed = 0;
+	std::vector<TileTracker::Region> regions = Compare(tracker, reshaped, &changed);
+	EXPECT_EQ(changed, 3u);
+	EXPECT_EQ(regions.size(), 3u);
+}
+
+TEST(TileTrackerTest, InvalidatedTilesChangeEvenWithTheSameContent) {
+	std::mt19937 random(10);
+	Frame frame(random, 4 * kTile + 8, 2 * kTile);
+	TileTracker tracker;
+	Compare(tracker, frame);
+
+	// Straddles the corner of four tiles
+	tracker.Invalidate(kTile - 1, kTile - 1, 2, 2);
+	EXPECT_EQ(Describe(Compare(tracker, frame)), Describe(0, 0, 2 * kTile, kTile) + Describe(0, kTile, 2 * kTile, kTile));
+	EXPECT_TRUE(Compare(tracker, frame).empty());
+
+	// Clipped to the frame; empty and outside areas are ignored
+	tracker.Invalidate(4 * kTile, kTile, 1000, 1000);
+	tracker.Invalidate(0, 0, 0, 10);
+	tracker.Invalidate(frame.width, 0, 10, 10);
+	tracker.Invalidate(0, frame.height, 10, 10);
+	EXPECT_EQ(Describe(Compare(tracker, frame)), Describe(4 * kTile, kTile, 8, kTile));
+
+	// Before any frame there is nothing to invalidate
+	TileTracker fresh;
+	fresh.Invalidate(0, 0, 10, 10);
+	EXPECT_EQ(Compare(fresh, frame).size(), 2u);
+}
+
+TEST(TileTrackerTest, ResetChangesEveryTileOnce) {
+	std::mt19937 random(11);
+	Frame frame(random, 2 * kTile, 2 * kTile);
+	TileTracker tracker;
+	Compare(tracker, frame);
+	tracker.Reset();
+	size_t changed = 0;
+	Compare(tracker, frame, &changed);
+	EXPECT_EQ(changed, 4u);
+	Compare(tracker, frame, &changed);
+	EXPECT_EQ(changed, 0u);
+}
+
+TEST(TileTrackerTest, PoolFindsTheSameRegions) {
+	WorkStealingPool::Options options;
+	options.threads = 4;
+	WorkStealingPool pool(options);
+	std::mt19937 random(12);
+	std::uniform_int_distribution<size_t> coordinate(0, 1 << 20);
+	Frame frame(random, 1000, 700);
+	TileTracker serial;
+	TileTracker parallel(DetectSimdLevel(), &pool);
+	for (int i = 0; i < 20; ++i) {
+		for (int touch = 0; touch < i; ++touch) {
+			frame.Touch(coordinate(random) % frame.width, coordinate(random) % frame.height);
+		}
+		std::vector<TileTracker::Region> expected = Compare(serial, frame);
+		ASSERT_EQ(Describe(Compare(parallel, frame)), Describe(expected)) << "frame " << i;
+	}
+}
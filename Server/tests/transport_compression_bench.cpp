@@ -0,0 +1,294 @@
+// Transport compression of raw frames. The first table is decompression speed on one core, in
+// GB/s of output, for BGRA frames of a desktop (flat panels and text-like noise), of a photo-like
+// gradient with sensor noise, and of random bytes. The second sends desktop frames from a loopback
+// client to a NetworkServer through a link throttled to the given rate, and shows the frames per
+// second the server delivers, each decompressed into its pooled buffer. Compression on the client
+// is done ahead of time and not counted.
+#include "lz4_block_writer.h"
+#include "network_server.h"
+#include "raw_frame.h"
+#include "socket_compat.h"
+#include "transport_compression.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WINDOWCASTER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Calls run until the time is used up; returns seconds per call
+	template <typename Body>
+	double Measure(double seconds, Body body) {
+		size_t calls = 0;
+		auto start = Clock::now();
+		std::chrono::duration<double> elapsed{};
+		do {
+			body();
+			++calls;
+			elapsed = Clock::now() - start;
+		} while (elapsed.count() < seconds);
+		return elapsed.count() / static_cast<double>(calls);
+	}
+
+	std::vector<uint8_t> Desktop(std::mt19937& random, size_t width, size_t height) {
+		std::vector<uint8_t> frame(width * height * 4);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				uint8_t* pixel = &frame[(y * width + x) * 4];
+				bool text = (y / 16) % 3 == 1 && (x / 300) % 2 == 0 && random() % 4 == 0;
+				uint8_t shade = static_cast<uint8_t>(((x / 240) + (y / 135)) % 2 ? 0xF0 : 0x30);
+				pixel[0] = pixel[1] = pixel[2] = text ? static_cast<uint8_t>(random() % 64) : shade;
+				pixel[3] = 255;
+			}
+		}
+		return frame;
+	}
+
+	std::vector<uint8_t> Photo(std::mt19937& random, size_t width, size_t height) {
+		std::vector<uint8_t> frame(width * height * 4);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				uint8_t* pixel = &frame[(y * width + x) * 4];
+				pixel[0] = static_cast<uint8_t>(x * 255 / width + random() % 4);
+				pixel[1] = static_cast<uint8_t>(y * 255 / height + random() % 4);
+				pixel[2] = static_cast<uint8_t>((x + y) / 8 + random() % 4);
+				pixel[3] = 255;
+			}
+		}
+		return frame;
+	}
+
+	std::vector<uint8_t> Compress(TransportCompression compression, const std::vector<uint8_t>& data) {
+		if (compression == TransportCompression::Lz4) {
+			return CompressLz4Block(data);
+		}
+#ifdef WINDOWCASTER_WITH_ZSTD
+		if (compression == TransportCompression::Zstd) {
+			std::vector<uint8_t> frame(ZSTD_compressBound(data.size()));
+			frame.resize(ZSTD_compress(frame.data(), frame.size(), data.data(), data.size(), 1));
+			return frame;
+		}
+#endif
+		return data;
+	}
+
+	const char* CompressionName(TransportCompression compression) {
+		switch (compression) {
+		case TransportCompression::Lz4: return "lz4";
+		case TransportCompression::Zstd: return "zstd";
+		default: return "none";
+		}
+	}
+
+	void Put(std::string& out, size_t offset, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) {
+			out[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	// Length prefix, raw frame header and payload of one BGRA frame
+	std::string RawFrameMessage(size_t width, size_t height, uint64_t sequence, TransportCompression compression,
+		const std::vector<uint8_t>& payload, size_t rawSize) {
+		std::string message(4 + kRawFrameHeaderSize, '\0');
+		Put(message, 0, (kRawFrameHeaderSize + payload.size()) | kRawFrameFlag, 4);
+		Put(message, 4, kRawFrameMagic, 4);
+		Put(message, 8, kRawFrameVersion, 2);
+		Put(message, 10, kRawFrameHeaderSize, 2);
+		Put(message, 12, 1, 8);
+		Put(message, 20, sequence, 8);
+		Put(message, 28, width, 4);
+		Put(message, 32, height, 4);
+		Put(message, 40, static_cast<uint16_t>(PixelFormat::Bgra32), 2);
+		Put(message, 42, static_cast<uint16_t>(compression) << kRawFrameCompressionShift, 2);
+		if (compression != TransportCompression::None) {
+			Put(message, 64, rawSize, 4);
+		}
+		message.append(reinterpret_cast<const char*>(payload.data()), payload.size());
+		return message;
+	}
+
+	// Server that counts the raw frames it delivers
+	class CountingServer {
+	public:
+		CountingServer() {
+			std::mt19937 random(static_cast<uint32_t>(Clock::now().time_since_epoch().count()));
+			for (int attempt = 0; attempt < 50 && !server; ++attempt) {
+				port = static_cast<uint16_t>(20000 + random() % 30000);
+				auto candidate = std::make_unique<NetworkServer>(port, 4, 1);
+				candidate->SetRawFrameHandler([this](const std::shared_ptr<ClientSession>&, std::unique_ptr<RawFrame>) {
+					frames++;
+					});
+				if (candidate->Start()) {
+					server = std::move(candidate);
+				}
+			}
+		}
+
+		~CountingServer() {
+			if (server) {
+				server->Stop();
+			}
+		}
+
+		explicit operator bool() const { return server != nullptr; }
+
+		uint16_t port = 0;
+		std::atomic<uint64_t> frames{ 0 };
+
+	private:
+		std::unique_ptr<NetworkServer> server;
+	};
+
+	SocketHandle Connect(uint16_t port) {
+		SocketHandle socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+			socket_compat::Close(socket);
+			return kInvalidSocket;
+		}
+		return socket;
+	}
+
+	// Sends in slices no faster than bitsPerSecond (0 for no limit); returns false on error
+	bool SendThrottled(SocketHandle socket, const std::string& data, double bitsPerSecond, Clock::time_point start,
+		uint64_t& bytesSent) {
+		constexpr size_t kSlice = 64 * 1024;
+		for (size_t sent = 0; sent < data.size(); ) {
+			size_t slice = std::min(kSlice, data.size() - sent);
+			if (bitsPerSecond > 0) {
+				std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double>(static_cast<double>(bytesSent) * 8 / bitsPerSecond)));
+			}
+			ssize_t n = send(socket, data.data() + sent, slice, MSG_NOSIGNAL);
+			if (n <= 0) {
+				return false;
+			}
+			sent += static_cast<size_t>(n);
+			bytesSent += static_cast<size_t>(n);
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	double seconds = quick ? 0.02 : 1.0;
+	size_t width = quick ? 480 : 1920;
+	size_t height = quick ? 270 : 1080;
+
+	std::vector<TransportCompression> compressions = { TransportCompression::Lz4 };
+	if (IsCompressionSupported(TransportCompression::Zstd)) {
+		compressions.push_back(TransportCompression::Zstd);
+	}
+
+	std::mt19937 random(1);
+	struct Content {
+		const char* name;
+		std::vector<uint8_t> frame;
+	};
+	std::vector<uint8_t> noise(width * height * 4);
+	for (auto& byte : noise) {
+		byte = static_cast<uint8_t>(random());
+	}
+	const Content contents[] = {
+		{ "desktop", Desktop(random, width, height) },
+		{ "photo", Photo(random, width, height) },
+		{ "random", std::move(noise) },
+	};
+
+	std::printf("%zux%zu BGRA frames, decompression on one core\n", width, height);
+	std::printf("%-9s %-6s %8s %10s %10s\n", "content", "codec", "ratio", "ms/frame", "GB/s");
+	for (const Content& content : contents) {
+		for (TransportCompression compression : compressions) {
+			std::vector<uint8_t> compressed = Compress(compression, content.frame);
+			std::vector<char> out(content.frame.size());
+			Decompressor decompressor;
+			bool ok = true;
+			double perFrame = Measure(seconds, [&] {
+				ok &= decompressor.Decompress(compression, reinterpret_cast<const char*>(compressed.data()),
+					compressed.size(), out.data(), out.size());
+			});
+			if (!ok || std::memcmp(out.data(), content.frame.data(), out.size()) != 0) {
+				std::printf("%s did not decompress to the original frame\n", CompressionName(compression));
+				return 1;
+			}
+			std::printf("%-9s %-6s %7.2fx %10.3f %10.2f\n", content.name, CompressionName(compression),
+				static_cast<double>(content.frame.size()) / static_cast<double>(compressed.size()), perFrame * 1e3,
+				static_cast<double>(content.frame.size()) / perFrame / 1e9);
+		}
+	}
+
+	// Desktop frames that each differ, compressed ahead of time
+	std::vector<std::vector<uint8_t>> frames;
+	for (int i = 0; i < 4; ++i) {
+		frames.push_back(Desktop(random, width, height));
+	}
+	std::vector<TransportCompression> sent = { TransportCompression::None };
+	sent.insert(sent.end(), compressions.begin(), compressions.end());
+
+	socket_compat::Startup();
+	std::printf("\n%zux%zu desktop frames over loopback\n", width, height);
+	std::printf("%-10s %-6s %12s %10s\n", "link", "codec", "MB/frame", "frames/s");
+	const struct {
+		const char* name;
+		double bitsPerSecond;
+	} links[] = { { "100 Mbit", 100e6 }, { "1 Gbit", 1e9 }, { "unlimited", 0 } };
+	for (const auto& link : links) {
+		for (TransportCompression compression : sent) {
+			std::vector<std::string> messages;
+			size_t wireBytes = 0;
+			for (size_t i = 0; i < frames.size(); ++i) {
+				std::vector<uint8_t> payload = Compress(compression, frames[i]);
+				messages.push_back(RawFrameMessage(width, height, i, compression, payload, frames[i].size()));
+				wireBytes += messages.back().size();
+			}
+
+			CountingServer server;
+			SocketHandle socket = server ? Connect(server.port) : kInvalidSocket;
+			if (socket == kInvalidSocket) {
+				std::printf("cannot connect to the loopback server\n");
+				return 1;
+			}
+			// At least a few frames, however slow the link
+			auto start = Clock::now();
+			uint64_t bytesSent = 0;
+			size_t count = 0;
+			while (count < 3 || std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+				if (!SendThrottled(socket, messages[count % messages.size()], link.bitsPerSecond, start, bytesSent)) {
+					std::printf("send failed\n");
+					return 1;
+				}
+				++count;
+			}
+			auto deadline = Clock::now() + std::chrono::seconds(30);
+			while (server.frames < count) {
+				if (Clock::now() > deadline) {
+					std::printf("the server did not deliver every frame\n");
+					return 1;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			socket_compat::Close(socket);
+
+			std::printf("%-10s %-6s %12.3f %10.1f\n", link.name, CompressionName(compression),
+				static_cast<double>(wireBytes) / frames.size() / 1e6, static_cast<double>(count) / elapsed);
+		}
+	}
+	socket_compat::Cleanup();
+	return 0;
+}
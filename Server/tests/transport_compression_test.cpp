@@ -0,0 +1,222 @@
+#include "transport_compression.h"
+#include "lz4_block_writer.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef WINDOWCASTER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+	constexpr uint8_t kCanary = 0xA5;
+	constexpr size_t kCanaryBytes = 64;
+
+	// BGRA rows of flat runs with some noise, the kind of frame LZ4 is used for
+	std::vector<uint8_t> ScreenLike(std::mt19937& random, size_t size) {
+		std::vector<uint8_t> data(size);
+		uint8_t pixel[4] = { 0x20, 0x40, 0x60, 0xFF };
+		for (size_t i = 0; i < size; ++i) {
+			if (i % 4 == 0 && random() % 97 == 0) {
+				for (size_t c = 0; c < 3; ++c) {
+					pixel[c] = static_cast<uint8_t>(random());
+				}
+			}
+			data[i] = pixel[i % 4];
+		}
+		return data;
+	}
+
+	std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+		std::vector<uint8_t> data(size);
+		for (auto& byte : data) {
+			byte = static_cast<uint8_t>(random());
+		}
+		return data;
+	}
+
+	// Decompresses into a buffer with a canary after dstSize; a write past the end fails the test
+	bool Decompress(TransportCompression compression, const std::vector<uint8_t>& src, size_t dstSize,
+		std::vector<uint8_t>& out) {
+		out.assign(dstSize + kCanaryBytes, kCanary);
+		Decompressor decompressor;
+		bool ok = decompressor.Decompress(compression, reinterpret_cast<const char*>(src.data()), src.size(),
+			reinterpret_cast<char*>(out.data()), dstSize);
+		for (size_t i = dstSize; i < out.size(); ++i) {
+			EXPECT_EQ(out[i], kCanary) << "wrote past the end at " << i - dstSize;
+		}
+		out.resize(dstSize);
+		return ok;
+	}
+}
+
+TEST(TransportCompressionTest, Lz4DecodesReferenceBlocks) {
+	// Compressed by liblz4 (LZ4_compress_default)
+	std::vector<uint8_t> text(reinterpret_cast<const uint8_t*>("abcabcabcabcabcabcabcabc hello hello hello hello!"),
+		reinterpret_cast<const uint8_t*>("abcabcabcabcabcabcabcabc hello hello hello hello!") + 49);
+	const std::vector<uint8_t> textBlock = {
+		0x3f, 0x61, 0x62, 0x63, 0x03, 0x00, 0x02, 0x6a, 0x20, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x06, 0x00,
+		0x50, 0x65, 0x6c, 0x6c, 0x6f, 0x21,
+	};
+	// 500 pixels of one colour and 20 literals: a match length that continues over several bytes
+	std::vector<uint8_t> pixels;
+	for (size_t i = 0; i < 500; ++i) {
+		pixels.insert(pixels.end(), { 0x20, 0x40, 0x60, 0xFF });
+	}
+	for (const char* p = "0123456789abcdefghij"; *p; ++p) {
+		pixels.push_back(static_cast<uint8_t>(*p));
+	}
+	const std::vector<uint8_t> pixelBlock = {
+		0x4f, 0x20, 0x40, 0x60, 0xff, 0x04, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xc0, 0xf0,
+		0x05, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x61, 0x62, 0x63, 0x64, 0x65,
+		0x66, 0x67, 0x68, 0x69, 0x6a,
+	};
+
+	std::vector<uint8_t> out;
+	ASSERT_TRUE(Decompress(TransportCompression::Lz4, textBlock, text.size(), out));
+	EXPECT_EQ(out, text);
+	ASSERT_TRUE(Decompress(TransportCompression::Lz4, pixelBlock, pixels.size(), out));
+	EXPECT_EQ(out, pixels);
+}
+
+TEST(TransportCompressionTest, Lz4RoundTrips) {
+	std::mt19937 random(1);
+	const size_t sizes[] = { 0, 1, 4, 12, 13, 15, 16, 17, 31, 32, 33, 100, 4096, 65536 + 77, 1920 * 4 * 64 };
+	for (size_t size : sizes) {
+		for (int kind = 0; kind < 2; ++kind) {
+			std::vector<uint8_t> data = kind == 0 ? ScreenLike(random, size) : RandomBytes(random, size);
+			std::vector<uint8_t> block = CompressLz4Block(data);
+			std::vector<uint8_t> out;
+			ASSERT_TRUE(Decompress(TransportCompression::Lz4, block, data.size(), out)) << size << " kind " << kind;
+			EXPECT_EQ(out, data) << size << " kind " << kind;
+		}
+	}
+}
+
+TEST(TransportCompressionTest, Lz4RepeatsShortPeriods) {
+	// A match closer than its own length repeats the bytes before it; every period up to past the
+	// 16-byte copy width, at lengths ending inside, at and past the copy margin of the block
+	std::mt19937 random(2);
+	for (size_t period = 1; period <= 40; ++period) {
+		for (size_t length : { size_t(4), size_t(15), size_t(19), size_t(33), size_t(64), size_t(1000) }) {
+			std::vector<uint8_t> seed = RandomBytes(random, period);
+			std::vector<uint8_t> tail = RandomBytes(random, 5);
+			std::vector<uint8_t> expected = seed;
+			for (size_t i = 0; i < length; ++i) {
+				expected.push_back(expected[expected.size() - period]);
+			}
+			expected.insert(expected.end(), tail.begin(), tail.end());
+
+			std::vector<uint8_t> block;
+			lz4_block_writer::AppendSequence(block, seed.data(), seed.size(), period, length);
+			lz4_block_writer::AppendSequence(block, tail.data(), tail.size(), 0, 0);
+			std::vector<uint8_t> out;
+			ASSERT_TRUE(Decompress(TransportCompression::Lz4, block, expected.size(), out))
+				<< "period " << period << " length " << length;
+			EXPECT_EQ(out, expected) << "period " << period << " length " << length;
+		}
+	}
+}
+
+TEST(TransportCompressionTest, Lz4RejectsTruncatedInput) {
+	std::mt19937 random(3);
+	for (int kind = 0; kind < 2; ++kind) {
+		std::vector<uint8_t> data = kind == 0 ? ScreenLike(random, 5000) : RandomBytes(random, 5000);
+		std::vector<uint8_t> block = CompressLz4Block(data);
+		for (size_t cut = 0; cut < block.size(); ++cut) {
+			std::vector<uint8_t> truncated(block.begin(), block.begin() + cut);
+			std::vector<uint8_t> out;
+			EXPECT_FALSE(Decompress(TransportCompression::Lz4, truncated, data.size(), out)) << "cut at " << cut;
+		}
+	}
+}
+
+TEST(TransportCompressionTest, Lz4RejectsBadOffsets) {
+	const uint8_t literals[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	const size_t offsets[] = { 0, 9, 100, 65535 };
+	for (size_t offset : offsets) {
+		std::vector<uint8_t> block;
+		lz4_block_writer::AppendSequence(block, literals, sizeof(literals), 1, 8);
+		// Patched afterwards: offset 0 would otherwise read as "no match"
+		block[1 + sizeof(literals)] = static_cast<uint8_t>(offset);
+		block[2 + sizeof(literals)] = static_cast<uint8_t>(offset >> 8);
+		lz4_block_writer::AppendSequence(block, literals, 5, 0, 0);
+		std::vector<uint8_t> out;
+		EXPECT_FALSE(Decompress(TransportCompression::Lz4, block, sizeof(literals) + 8 + 5, out)) << offset;
+	}
+}
+
+TEST(TransportCompressionTest, Lz4NeedsTheExactOutputSize) {
+	std::mt19937 random(4);
+	std::vector<uint8_t> data = ScreenLike(random, 3000);
+	std::vector<uint8_t> block = CompressLz4Block(data);
+	std::vector<uint8_t> out;
+	EXPECT_FALSE(Decompress(TransportCompression::Lz4, block, data.size() - 1, out));
+	EXPECT_FALSE(Decompress(TransportCompression::Lz4, block, data.size() + 1, out));
+	EXPECT_FALSE(Decompress(TransportCompression::Lz4, block, 0, out));
+	EXPECT_TRUE(Decompress(TransportCompression::Lz4, block, data.size(), out));
+
+	// Lengths that run past the end of the output
+	std::vector<uint8_t> longLiterals;
+	lz4_block_writer::AppendSequence(longLiterals, data.data(), 400, 0, 0);
+	EXPECT_FALSE(Decompress(TransportCompression::Lz4, longLiterals, 399, out));
+	std::vector<uint8_t> longMatch;
+	lz4_block_writer::AppendSequence(longMatch, data.data(), 4, 4, 1000);
+	lz4_block_writer::AppendSequence(longMatch, data.data(), 5, 0, 0);
+	EXPECT_FALSE(Decompress(TransportCompression::Lz4, longMatch, 4 + 999 + 5, out));
+}
+
+TEST(TransportCompressionTest, Lz4SurvivesCorruptInput) {
+	// Whatever the bytes, the decoder fails or fills the output, and never writes past it
+	std::mt19937 random(5);
+	std::vector<uint8_t> data = ScreenLike(random, 20000);
+	std::vector<uint8_t> block = CompressLz4Block(data);
+	for (int trial = 0; trial < 2000; ++trial) {
+		std::vector<uint8_t> corrupt = block;
+		for (int flips = 1 + trial % 4; flips > 0; --flips) {
+			corrupt[random() % corrupt.size()] = static_cast<uint8_t>(random());
+		}
+		std::vector<uint8_t> out;
+		Decompress(TransportCompression::Lz4, corrupt, data.size(), out);
+	}
+	for (int trial = 0; trial < 200; ++trial) {
+		std::vector<uint8_t> garbage = RandomBytes(random, 1 + random() % 300);
+		std::vector<uint8_t> out;
+		Decompress(TransportCompression::Lz4, garbage, 1 + random() % 4000, out);
+	}
+}
+
+TEST(TransportCompressionTest, UncompressedNeedsMatchingSizes) {
+	std::vector<uint8_t> data = { 1, 2, 3, 4 };
+	std::vector<uint8_t> out;
+	EXPECT_TRUE(Decompress(TransportCompression::None, data, 4, out));
+	EXPECT_EQ(out, data);
+	EXPECT_FALSE(Decompress(TransportCompression::None, data, 3, out));
+	EXPECT_FALSE(Decompress(static_cast<TransportCompression>(3), data, 4, out));
+	EXPECT_FALSE(IsCompressionSupported(static_cast<TransportCompression>(3)));
+}
+
+#ifdef WINDOWCASTER_WITH_ZSTD
+TEST(TransportCompressionTest, ZstdRoundTripsAndRejectsCorruptInput) {
+	std::mt19937 random(6);
+	std::vector<uint8_t> data = ScreenLike(random, 100000);
+	std::vector<uint8_t> frame(ZSTD_compressBound(data.size()));
+	frame.resize(ZSTD_compress(frame.data(), frame.size(), data.data(), data.size(), 1));
+
+	std::vector<uint8_t> out;
+	ASSERT_TRUE(Decompress(TransportCompression::Zstd, frame, data.size(), out));
+	EXPECT_EQ(out, data);
+	EXPECT_FALSE(Decompress(TransportCompression::Zstd, frame, data.size() - 1, out));
+	std::vector<uint8_t> truncated(frame.begin(), frame.end() - 1);
+	EXPECT_FALSE(Decompress(TransportCompression::Zstd, truncated, data.size(), out));
+}
+#else
+TEST(TransportCompressionTest, ZstdIsUnsupportedWithoutLibzstd) {
+	std::vector<uint8_t> data = { 1, 2, 3, 4 };
+	std::vector<uint8_t> out;
+	EXPECT_FALSE(IsCompressionSupported(TransportCompression::Zstd));
+	EXPECT_FALSE(Decompress(TransportCompression::Zstd, data, 4, out));
+}
+#endif
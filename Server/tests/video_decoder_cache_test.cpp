@@ -0,0 +1,280 @@
+#include "video_decoder_cache.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+	constexpr uint64_t kWindow = 7;
+
+	// NAL unit headers: H.264 IDR and non-IDR slices, HEVC IDR_W_RADL and TRAIL_R slices
+	constexpr uint8_t kH264Key = 0x65;
+	constexpr uint8_t kH264Delta = 0x41;
+	constexpr uint8_t kHevcKey = 19 << 1;
+	constexpr uint8_t kHevcDelta = 1 << 1;
+
+	// Marks a packet the fake decoder reports as corrupt
+	constexpr uint8_t kCorrupt = 0xEE;
+
+	// An Annex-B access unit of one NAL unit carrying the picture size, as parameter sets would
+	std::vector<uint8_t> Packet(uint8_t nalHeader, uint8_t width = 64, uint8_t height = 48, uint8_t pictures = 1) {
+		return { 0, 0, 0, 1, nalHeader, width, height, pictures };
+	}
+
+	struct DecoderLog {
+		int created = 0;
+		int resets = 0;
+		std::vector<VideoCodec> codecs;
+	};
+
+	// Decodes a keyframe into pictures of the size it carries; a delta needs a keyframe of the
+	// same size before it, as a real decoder needs its references
+	class FakeDecoder : public VideoDecoder {
+	public:
+		FakeDecoder(VideoCodec codec, DecoderLog& log) : codec(codec), log(log) {}
+
+		Status Decode(const uint8_t* data, size_t size, std::vector<DecodedFrame>& frames) override {
+			if (size < 8 || data[5] == kCorrupt) {
+				return Status::Corrupt;
+			}
+			size_t packetWidth = data[5];
+			size_t packetHeight = data[6];
+			if (ContainsKeyframe(codec, data, size)) {
+				width = packetWidth;
+				height = packetHeight;
+			}
+			else if (width != packetWidth || height != packetHeight) {
+				return Status::Corrupt;
+			}
+			for (uint8_t i = 0; i < data[7]; ++i) {
+				DecodedFrame frame;
+				frame.image.width = width;
+				frame.image.height = height;
+				frame.image.format = PixelFormat::I420;
+				frame.owner = std::make_shared<int>(++pictures);
+				frames.push_back(std::move(frame));
+			}
+			return Status::Ok;
+		}
+
+		void Reset() override {
+			log.resets++;
+			width = 0;
+			height = 0;
+		}
+
+	private:
+		VideoCodec codec;
+		DecoderLog& log;
+		size_t width = 0;
+		size_t height = 0;
+		int pictures = 0;
+	};
+
+	struct Harness {
+		DecoderLog log;
+		bool hevcSupported = true;
+		VideoDecoderCache cache;
+
+		Harness()
+			: cache([this](VideoCodec codec) -> std::unique_ptr<VideoDecoder> {
+				if (codec == VideoCodec::Hevc && !hevcSupported) {
+					return nullptr;
+				}
+				log.created++;
+				log.codecs.push_back(codec);
+				return std::make_unique<FakeDecoder>(codec, log);
+			}) {
+		}
+
+		VideoDecoderCache::Result Decode(uint64_t sequence, const std::vector<uint8_t>& packet,
+			VideoCodec codec = VideoCodec::H264, uint64_t window = kWindow) {
+			return cache.Decode(window, codec, sequence, packet.data(), packet.size());
+		}
+	};
+
+	size_t Width(const VideoDecoderCache::Result& result) {
+		return result.frame.owner ? result.frame.image.width : 0;
+	}
+}
+
+TEST(VideoDecoderCacheTest, DecoderPersistsAcrossPackets) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key)).success);
+	for (uint64_t sequence = 2; sequence <= 10; ++sequence) {
+		VideoDecoderCache::Result result = harness.Decode(sequence, Packet(kH264Delta));
+		ASSERT_TRUE(result.success) << result.error;
+		EXPECT_FALSE(result.requestKeyframe);
+		EXPECT_EQ(Width(result), 64u);
+	}
+
+	EXPECT_EQ(harness.log.created, 1);
+	EXPECT_EQ(harness.log.resets, 0);
+	VideoDecoderCache::Stats stats = harness.cache.GetStats();
+	EXPECT_EQ(stats.decoders, 1u);
+	EXPECT_EQ(stats.packets, 10u);
+	EXPECT_EQ(stats.frames, 10u);
+	EXPECT_EQ(stats.skipped, 0u);
+}
+
+TEST(VideoDecoderCacheTest, OnlyTheNewestPictureIsReturned) {
+	Harness harness;
+	VideoDecoderCache::Result result = harness.Decode(1, Packet(kH264Key, 64, 48, 3));
+	ASSERT_TRUE(result.success);
+	EXPECT_EQ(*std::static_pointer_cast<const int>(result.frame.owner), 3);
+	EXPECT_EQ(harness.cache.GetStats().frames, 3u);
+
+	// A decoder still filling its pipeline outputs nothing, which is not a failure
+	result = harness.Decode(2, Packet(kH264Delta, 64, 48, 0));
+	EXPECT_TRUE(result.success);
+	EXPECT_FALSE(result.frame.owner);
+}
+
+TEST(VideoDecoderCacheTest, DeltasWaitForAKeyframe) {
+	Harness harness;
+	VideoDecoderCache::Result result = harness.Decode(1, Packet(kH264Delta));
+	EXPECT_FALSE(result.success);
+	EXPECT_EQ(std::string(result.error), "Waiting for keyframe");
+	EXPECT_TRUE(result.requestKeyframe);
+
+	// Asked for already; not again straight away
+	result = harness.Decode(2, Packet(kH264Delta));
+	EXPECT_FALSE(result.success);
+	EXPECT_FALSE(result.requestKeyframe);
+
+	result = harness.Decode(3, Packet(kH264Key));
+	EXPECT_TRUE(result.success);
+	EXPECT_EQ(Width(result), 64u);
+	EXPECT_TRUE(harness.Decode(4, Packet(kH264Delta)).success);
+
+	VideoDecoderCache::Stats stats = harness.cache.GetStats();
+	EXPECT_EQ(stats.skipped, 2u);
+	EXPECT_EQ(stats.keyframeRequests, 1u);
+	EXPECT_EQ(stats.packets, 2u);
+}
+
+TEST(VideoDecoderCacheTest, SequenceGapResetsToTheNextKeyframe) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key)).success);
+	ASSERT_TRUE(harness.Decode(2, Packet(kH264Delta)).success);
+
+	// Packet 3 never arrived
+	VideoDecoderCache::Result result = harness.Decode(4, Packet(kH264Delta));
+	EXPECT_FALSE(result.success);
+	EXPECT_TRUE(result.requestKeyframe);
+	EXPECT_EQ(harness.log.resets, 1);
+	EXPECT_FALSE(harness.Decode(5, Packet(kH264Delta)).success);
+
+	EXPECT_TRUE(harness.Decode(6, Packet(kH264Key)).success);
+	EXPECT_TRUE(harness.Decode(7, Packet(kH264Delta)).success);
+	// The same decoder throughout
+	EXPECT_EQ(harness.log.created, 1);
+}
+
+TEST(VideoDecoderCacheTest, SequenceZeroIsNotChecked) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(0, Packet(kH264Key)).success);
+	EXPECT_TRUE(harness.Decode(0, Packet(kH264Delta)).success);
+	EXPECT_TRUE(harness.Decode(0, Packet(kH264Delta)).success);
+	EXPECT_EQ(harness.log.resets, 0);
+}
+
+TEST(VideoDecoderCacheTest, CorruptDataResetsTheDecoder) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key)).success);
+	VideoDecoderCache::Result result = harness.Decode(2, Packet(kH264Delta, kCorrupt));
+	EXPECT_FALSE(result.success);
+	EXPECT_EQ(std::string(result.error), "Corrupt video data");
+	EXPECT_TRUE(result.requestKeyframe);
+	EXPECT_EQ(harness.log.resets, 1);
+
+	// In sequence, but the references are gone
+	EXPECT_FALSE(harness.Decode(3, Packet(kH264Delta)).success);
+	EXPECT_TRUE(harness.Decode(4, Packet(kH264Key)).success);
+	EXPECT_EQ(harness.cache.GetStats().errors, 1u);
+}
+
+TEST(VideoDecoderCacheTest, SizeChangeTakesEffectAtItsKeyframe) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key, 64, 48)).success);
+	ASSERT_TRUE(harness.Decode(2, Packet(kH264Delta, 64, 48)).success);
+
+	// The client's window was resized: a keyframe of the new size starts the new stream
+	VideoDecoderCache::Result result = harness.Decode(3, Packet(kH264Key, 128, 96));
+	ASSERT_TRUE(result.success);
+	EXPECT_EQ(Width(result), 128u);
+	EXPECT_EQ(Width(harness.Decode(4, Packet(kH264Delta, 128, 96))), 128u);
+
+	// Pictures of the new size without its keyframe cannot be decoded; the decoder is reset and
+	// the next keyframe restores the picture
+	result = harness.Decode(5, Packet(kH264Delta, 200, 100));
+	EXPECT_FALSE(result.success);
+	EXPECT_EQ(harness.log.resets, 1);
+	EXPECT_FALSE(harness.Decode(6, Packet(kH264Delta, 200, 100)).success);
+	EXPECT_EQ(Width(harness.Decode(7, Packet(kH264Key, 200, 100))), 200u);
+	EXPECT_EQ(harness.log.created, 1);
+}
+
+TEST(VideoDecoderCacheTest, CodecChangeReplacesTheDecoder) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key)).success);
+	ASSERT_TRUE(harness.Decode(2, Packet(kH264Delta)).success);
+
+	// A fresh HEVC decoder needs its own keyframe, even in sequence
+	EXPECT_FALSE(harness.Decode(3, Packet(kHevcDelta), VideoCodec::Hevc).success);
+	EXPECT_TRUE(harness.Decode(4, Packet(kHevcKey), VideoCodec::Hevc).success);
+	EXPECT_TRUE(harness.Decode(5, Packet(kHevcDelta), VideoCodec::Hevc).success);
+
+	// And back
+	EXPECT_FALSE(harness.Decode(6, Packet(kH264Delta)).success);
+	EXPECT_TRUE(harness.Decode(7, Packet(kH264Key)).success);
+
+	ASSERT_EQ(harness.log.codecs.size(), 3u);
+	EXPECT_EQ(harness.log.codecs[1], VideoCodec::Hevc);
+	EXPECT_EQ(harness.log.codecs[2], VideoCodec::H264);
+	EXPECT_EQ(harness.cache.GetStats().decoders, 3u);
+}
+
+TEST(VideoDecoderCacheTest, UnsupportedCodecFails) {
+	Harness harness;
+	harness.hevcSupported = false;
+	VideoDecoderCache::Result result = harness.Decode(1, Packet(kHevcKey), VideoCodec::Hevc);
+	EXPECT_FALSE(result.success);
+	EXPECT_EQ(std::string(result.error), "Unsupported video codec");
+	EXPECT_EQ(harness.cache.GetStats().decoders, 0u);
+}
+
+TEST(VideoDecoderCacheTest, WindowsHaveTheirOwnDecoders) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key, 64, 48), VideoCodec::H264, 1).success);
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key, 32, 16), VideoCodec::H264, 2).success);
+	EXPECT_EQ(Width(harness.Decode(2, Packet(kH264Delta, 64, 48), VideoCodec::H264, 1)), 64u);
+	EXPECT_EQ(Width(harness.Decode(2, Packet(kH264Delta, 32, 16), VideoCodec::H264, 2)), 32u);
+	EXPECT_EQ(harness.cache.Size(), 2u);
+	EXPECT_EQ(harness.log.created, 2);
+}
+
+TEST(VideoDecoderCacheTest, InvalidateEvictsOneWindow) {
+	Harness harness;
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key), VideoCodec::H264, 1).success);
+	ASSERT_TRUE(harness.Decode(1, Packet(kH264Key), VideoCodec::H264, 2).success);
+
+	harness.cache.Invalidate(1);
+	EXPECT_EQ(harness.cache.Size(), 1u);
+	// Window 1 starts over with a new decoder and waits for a keyframe; window 2 keeps going
+	VideoDecoderCache::Result result = harness.Decode(2, Packet(kH264Delta), VideoCodec::H264, 1);
+	EXPECT_FALSE(result.success);
+	EXPECT_TRUE(result.requestKeyframe);
+	EXPECT_EQ(harness.log.created, 3);
+	EXPECT_TRUE(harness.Decode(2, Packet(kH264Delta), VideoCodec::H264, 2).success);
+
+	// Invalidating a window without a decoder does nothing
+	harness.cache.Invalidate(99);
+	EXPECT_EQ(harness.cache.Size(), 2u);
+
+	harness.cache.Clear();
+	EXPECT_EQ(harness.cache.Size(), 0u);
+	EXPECT_FALSE(harness.Decode(3, Packet(kH264Delta), VideoCodec::H264, 2).success);
+	EXPECT_EQ(harness.log.created, 4);
+}
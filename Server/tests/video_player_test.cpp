@@ -0,0 +1,150 @@
+#include "video_player.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	using std::chrono::milliseconds;
+
+	constexpr uint64_t kWindow = 7;
+
+	bool WaitUntil(const std::function<bool()>& done, milliseconds timeout = milliseconds(10000)) {
+		auto deadline = Clock::now() + timeout;
+		while (!done()) {
+			if (Clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+
+	// Frames a millisecond apart; reports when it is closed
+	class FakeSource : public VideoSource {
+	public:
+		FakeSource(int frames, std::shared_ptr<std::atomic<bool>> closed, Status after = Status::End)
+			: frames(frames), closed(std::move(closed)), after(after) {}
+
+		~FakeSource() override {
+			*closed = true;
+		}
+
+		int64_t DurationUs() const override { return frames * 1000; }
+
+		Status Read(Frame& frame) override {
+			if (next >= frames) {
+				return after;
+			}
+			frame.timestampUs = next++ * 1000;
+			return Status::Ok;
+		}
+
+		bool Seek(int64_t timestampUs) override {
+			next = static_cast<int>(timestampUs / 1000);
+			return true;
+		}
+
+	private:
+		int frames;
+		int next = 0;
+		std::shared_ptr<std::atomic<bool>> closed;
+		Status after;
+	};
+
+	struct Playback {
+		std::atomic<uint64_t> presented{ 0 };
+		std::atomic<bool> windowOpen{ true };
+		PlaybackController controller{ [this](uint64_t, DecodedFrame) {
+			presented++;
+			return windowOpen.load();
+		} };
+
+		std::shared_ptr<std::atomic<bool>> Play(int frames, bool loop = false,
+			VideoSource::Status after = VideoSource::Status::End) {
+			auto closed = std::make_shared<std::atomic<bool>>(false);
+			VideoPlayer::Options options;
+			options.loop = loop;
+			controller.Play(kWindow, std::make_unique<FakeSource>(frames, closed, after), options);
+			return closed;
+		}
+	};
+}
+
+TEST(VideoPlayerTest, FinishedPlaybackClosesItsSourceAndIsReaped) {
+	Playback playback;
+	auto closed = playback.Play(5);
+	ASSERT_TRUE(WaitUntil([&] { return closed->load(); }));
+
+	EXPECT_EQ(playback.controller.Size(), 0u);
+	// The final state can still be asked for, but there is nothing left to control
+	VideoPlayer::State state;
+	ASSERT_TRUE(playback.controller.GetState(kWindow, state));
+	EXPECT_TRUE(state.finished);
+	EXPECT_TRUE(state.error.empty());
+	EXPECT_EQ(state.framesPresented, 5u);
+	EXPECT_FALSE(playback.controller.Seek(kWindow, 0));
+	EXPECT_FALSE(playback.controller.Pause(kWindow));
+
+	// Stopping drops the final state
+	EXPECT_TRUE(playback.controller.Stop(kWindow));
+	EXPECT_FALSE(playback.controller.GetState(kWindow, state));
+	EXPECT_FALSE(playback.controller.Stop(kWindow));
+}
+
+TEST(VideoPlayerTest, CorruptDataEndsPlayback) {
+	Playback playback;
+	auto closed = playback.Play(2, false, VideoSource::Status::Corrupt);
+	ASSERT_TRUE(WaitUntil([&] { return closed->load(); }));
+
+	VideoPlayer::State state;
+	ASSERT_TRUE(playback.controller.GetState(kWindow, state));
+	EXPECT_TRUE(state.finished);
+	EXPECT_EQ(state.error, "Corrupt video data");
+	EXPECT_EQ(state.framesCorrupt, VideoPlayer::kMaxConsecutiveErrors);
+	EXPECT_EQ(playback.controller.Size(), 0u);
+}
+
+TEST(VideoPlayerTest, ClosedWindowLeavesNothingBehind) {
+	Playback playback;
+	playback.windowOpen = false;
+	auto closed = playback.Play(1000, true);
+	ASSERT_TRUE(WaitUntil([&] { return closed->load(); }));
+
+	EXPECT_EQ(playback.presented, 1u);
+	EXPECT_EQ(playback.controller.Size(), 0u);
+	VideoPlayer::State state;
+	EXPECT_FALSE(playback.controller.GetState(kWindow, state));
+}
+
+TEST(VideoPlayerTest, LoopingPlaybackRunsUntilStopped) {
+	Playback playback;
+	auto closed = playback.Play(3, true);
+	ASSERT_TRUE(WaitUntil([&] { return playback.presented > 10; }));
+	EXPECT_EQ(playback.controller.Size(), 1u);
+	EXPECT_FALSE(*closed);
+
+	EXPECT_TRUE(playback.controller.Stop(kWindow));
+	EXPECT_TRUE(*closed);
+	EXPECT_EQ(playback.controller.Size(), 0u);
+}
+
+TEST(VideoPlayerTest, PlayingAgainReplacesTheFinalState) {
+	Playback playback;
+	auto first = playback.Play(2);
+	ASSERT_TRUE(WaitUntil([&] { return first->load(); }));
+
+	auto second = playback.Play(1000);
+	VideoPlayer::State state;
+	ASSERT_TRUE(playback.controller.GetState(kWindow, state));
+	EXPECT_FALSE(state.finished);
+	EXPECT_TRUE(playback.controller.Pause(kWindow));
+	EXPECT_EQ(playback.controller.Size(), 1u);
+
+	playback.controller.StopAll();
+	EXPECT_TRUE(*second);
+	EXPECT_FALSE(playback.controller.GetState(kWindow, state));
+}
@@ -0,0 +1,243 @@
+#include "tile_tracker.h"
+#include "content_hash.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TILE_TRACKER_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC accepts any intrinsic without /arch; GCC and Clang need the target enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PIXEL_TARGET(isa)
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+	// The hash works on 32-byte stripes split into four 64-bit lanes, in the manner of XXH3:
+	// each lane adds the product of the two halves of (data ^ key) plus the neighbouring lane.
+	// The key advances with every stripe so that moving pixels around changes the hash.
+	// Only 32x32->64 multiplies are used, which SSE2 and AVX2 have, so all levels agree.
+	// The whole stripes of all rows come first, then the zero-padded remainders of the rows.
+	constexpr size_t kStripeBytes = 32;
+	// Starts from the first 32 bytes of the XXH3 secret and steps by the golden ratio and XXH64 primes
+	constexpr uint64_t kKeySteps[4] = { 0x9e3779b97f4a7c15ull, kXxhPrime64_2, kXxhPrime64_3, kXxhPrime64_5 };
+
+	using Accumulator = void (*)(uint64_t* acc, uint64_t* key, const uint8_t* data, size_t stride,
+		size_t stripes, size_t rows);
+
+	void AccumulateScalar(uint64_t* acc, uint64_t* key, const uint8_t* data, size_t stride,
+		size_t stripes, size_t rows) {
+		for (size_t y = 0; y < rows; ++y) {
+			const uint8_t* row = data + y * stride;
+			for (size_t stripe = 0; stripe < stripes; ++stripe) {
+				uint64_t lanes[4];
+				std::memcpy(lanes, row + stripe * kStripeBytes, sizeof(lanes));
+				for (size_t i = 0; i < 4; ++i) {
+					uint64_t mixed = lanes[i] ^ key[i];
+					acc[i] += lanes[i ^ 1] + (mixed & 0xffffffffull) * (mixed >> 32);
+					key[i] += kKeySteps[i];
+				}
+			}
+		}
+	}
+
+#ifdef TILE_TRACKER_X86
+	PIXEL_TARGET("sse2")
+	void AccumulateSse2(uint64_t* acc, uint64_t* key, const uint8_t* data, size_t stride,
+		size_t stripes, size_t rows) {
+		__m128i acc0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc));
+		__m128i acc1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2));
+		__m128i key0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+		__m128i key1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 2));
+		const __m128i step0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kKeySteps));
+		const __m128i step1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kKeySteps + 2));
+
+		for (size_t y = 0; y < rows; ++y) {
+			const uint8_t* row = data + y * stride;
+			for (size_t stripe = 0; stripe < stripes; ++stripe) {
+				const uint8_t* src = row + stripe * kStripeBytes;
+				__m128i lanes0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+				__m128i lanes1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+				__m128i mixed0 = _mm_xor_si128(lanes0, key0);
+				__m128i mixed1 = _mm_xor_si128(lanes1, key1);
+				__m128i product0 = _mm_mul_epu32(mixed0, _mm_srli_epi64(mixed0, 32));
+				__m128i product1 = _mm_mul_epu32(mixed1, _mm_srli_epi64(mixed1, 32));
+				acc0 = _mm_add_epi64(acc0, _mm_add_epi64(product0, _mm_shuffle_epi32(lanes0, _MM_SHUFFLE(1, 0, 3, 2))));
+				acc1 = _mm_add_epi64(acc1, _mm_add_epi64(product1, _mm_shuffle_epi32(lanes1, _MM_SHUFFLE(1, 0, 3, 2))));
+				key0 = _mm_add_epi64(key0, step0);
+				key1 = _mm_add_epi64(key1, step1);
+			}
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(acc), acc0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2), acc1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(key), key0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(key + 2), key1);
+	}
+
+	PIXEL_TARGET("avx2")
+	void AccumulateAvx2(uint64_t* acc, uint64_t* key, const uint8_t* data, size_t stride,
+		size_t stripes, size_t rows) {
+		__m256i accs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+		__m256i keys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key));
+		const __m256i steps = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kKeySteps));
+
+		for (size_t y = 0; y < rows; ++y) {
+			const uint8_t* row = data + y * stride;
+			for (size_t stripe = 0; stripe < stripes; ++stripe) {
+				__m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + stripe * kStripeBytes));
+				__m256i mixed = _mm256_xor_si256(lanes, keys);
+				__m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+				accs = _mm256_add_epi64(accs, _mm256_add_epi64(product, _mm256_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2))));
+				keys = _mm256_add_epi64(keys, steps);
+			}
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), accs);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(key), keys);
+	}
+#endif
+
+	Accumulator SelectAccumulator(SimdLevel level) {
+		level = std::min(level, DetectSimdLevel());
+#ifdef TILE_TRACKER_X86
+		if (level == SimdLevel::Avx2) return AccumulateAvx2;
+		if (level == SimdLevel::Ssse3) return AccumulateSse2;
+#endif
+		return AccumulateScalar;
+	}
+
+	uint64_t Hash(Accumulator accumulate, const uint8_t* data, size_t stride, size_t rowBytes, size_t rows) {
+		uint64_t acc[4] = { kKeySteps[1], kKeySteps[2], kKeySteps[3], kKeySteps[0] };
+		uint64_t key[4];
+		std::memcpy(key, kXxh3Secret, sizeof(key));
+		size_t stripes = rowBytes / kStripeBytes;
+		size_t tail = rowBytes % kStripeBytes;
+
+		accumulate(acc, key, data, stride, stripes, rows);
+		if (tail > 0) {
+			for (size_t y = 0; y < rows; ++y) {
+				uint8_t last[kStripeBytes] = {};
+				std::memcpy(last, data + y * stride + stripes * kStripeBytes, tail);
+				accumulate(acc, key, last, kStripeBytes, 1, 1);
+			}
+		}
+
+		uint64_t hash = Xxh64Avalanche(rows) ^ rowBytes;
+		for (size_t i = 0; i < 4; ++i) {
+			hash = (hash ^ Xxh64Avalanche(acc[i])) * kKeySteps[0];
+		}
+		return Xxh64Avalanche(hash);
+	}
+}
+
+uint64_t HashPixels(SimdLevel level, const uint8_t* data, size_t stride, size_t rowBytes, size_t rows) {
+	return Hash(SelectAccumulator(level), data, stride, rowBytes, rows);
+}
+
+TileTracker::TileTracker(SimdLevel level, WorkStealingPool* pool)
+	: level(level)
+	, pool(pool)
+	, width(0)
+	, height(0)
+	, tilesAcross(0) {
+}
+
+size_t TileTracker::Compare(const uint8_t* pixels, size_t stride, size_t width, size_t height,
+	std::vector<Region>& changed) {
+	if (width != this->width || height != this->height) {
+		this->width = width;
+		this->height = height;
+		tilesAcross = (width + kTileSize - 1) / kTileSize;
+		size_t tilesDown = (height + kTileSize - 1) / kTileSize;
+		hashes.assign(tilesAcross * tilesDown, 0);
+		known.assign(tilesAcross * tilesDown, 0);
+	}
+
+	// Hashing is the expensive part and each tile is independent; rows of tiles are hashed in
+	// parallel and the runs gathered afterwards in order
+	Accumulator accumulate = SelectAccumulator(level);
+	size_t tilesDown = tilesAcross > 0 ? hashes.size() / tilesAcross : 0;
+	fresh.resize(hashes.size());
+	auto hashRows = [&](size_t, size_t begin, size_t end) {
+		for (size_t tileY = begin; tileY < end; ++tileY) {
+			size_t top = tileY * kTileSize;
+			size_t rows = std::min(kTileSize, height - top);
+			for (size_t tileX = 0; tileX < tilesAcross; ++tileX) {
+				size_t left = tileX * kTileSize;
+				size_t columns = std::min(kTileSize, width - left);
+				fresh[tileY * tilesAcross + tileX] = Hash(accumulate, pixels + top * stride + left * 4, stride, columns * 4, rows);
+			}
+		}
+	};
+	if (pool) {
+		pool->ParallelFor(tilesDown, 1, hashRows);
+	}
+	else {
+		hashRows(0, 0, tilesDown);
+	}
+
+	size_t changedTiles = 0;
+	for (size_t top = 0, tileY = 0; top < height; top += kTileSize, ++tileY) {
+		size_t rows = std::min(kTileSize, height - top);
+		// Runs of changed tiles along a row of tiles become one region
+		size_t runStart = 0;
+		bool inRun = false;
+		for (size_t tileX = 0; tileX <= tilesAcross; ++tileX) {
+			bool tileChanged = false;
+			if (tileX < tilesAcross) {
+				size_t index = tileY * tilesAcross + tileX;
+				uint64_t hash = fresh[index];
+				tileChanged = !known[index] || hashes[index] != hash;
+				hashes[index] = hash;
+				known[index] = 1;
+			}
+
+			if (tileChanged) {
+				++changedTiles;
+				if (!inRun) {
+					runStart = tileX;
+					inRun = true;
+				}
+			}
+			else if (inRun) {
+				Region region;
+				region.x = runStart * kTileSize;
+				region.y = top;
+				region.width = std::min(tileX * kTileSize, width) - region.x;
+				region.height = rows;
+				changed.push_back(region);
+				inRun = false;
+			}
+		}
+	}
+
+	counters.framesCompared++;
+	if (changedTiles == 0) {
+		counters.framesSkipped++;
+	}
+	counters.tilesChanged += changedTiles;
+	counters.tilesSkipped += hashes.size() - changedTiles;
+	return changedTiles;
+}
+
+void TileTracker::Invalidate(size_t x, size_t y, size_t width, size_t height) {
+	if (width == 0 || height == 0 || x >= this->width || y >= this->height) {
+		return;
+	}
+	size_t lastX = std::min(x + width, this->width) - 1;
+	size_t lastY = std::min(y + height, this->height) - 1;
+	for (size_t tileY = y / kTileSize; tileY <= lastY / kTileSize; ++tileY) {
+		for (size_t tileX = x / kTileSize; tileX <= lastX / kTileSize; ++tileX) {
+			known[tileY * tilesAcross + tileX] = 0;
+		}
+	}
+}
+
+void TileTracker::Reset() {
+	std::fill(known.begin(), known.end(), static_cast<uint8_t>(0));
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pixel_convert.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//  rows Сÿ rowBytes ֽڵص 64 λϣ֮ stride ֽ
+// ͬϣָͬʵֵĽһ
+uint64_t HashPixels(SimdLevel level, const uint8_t* data, size_t stride, size_t rowBytes, size_t rows);
+
+class WorkStealingPool;
+
+// ͼҳһ֡ 32 λ BGRA ͼһ֡仯Ĳֻ֣ÿͼĹϣ
+// ̳߳ʱͼвмϣ
+// ͬһʵͬһʱֻһ߳ʹã̶߳ȡ
+class TileTracker {
+public:
+	static constexpr size_t kTileSize = 64;
+
+	struct Region {
+		size_t x = 0;
+		size_t y = 0;
+		size_t width = 0;
+		size_t height = 0;
+	};
+
+	struct Counters {
+		std::atomic<uint64_t> framesCompared{ 0 };
+		std::atomic<uint64_t> framesSkipped{ 0 };   // ûκͼ仯
+		std::atomic<uint64_t> tilesChanged{ 0 };
+		std::atomic<uint64_t> tilesSkipped{ 0 };
+	};
+
+	explicit TileTracker(SimdLevel level = DetectSimdLevel(), WorkStealingPool* pool = nullptr);
+
+	// һ֡Ƚϣ仯ͼ鰴кϲΪ׷ӵ changedر仯ͼ
+	// һ֡ߴ仯 Reset ֮ͼ鶼仯
+	size_t Compare(const uint8_t* pixels, size_t stride, size_t width, size_t height, std::vector<Region>& changed);
+
+	// ڵرд (ֲ)һαȽʱཻ֮ͼһ仯
+	void Invalidate(size_t x, size_t y, size_t width, size_t height);
+
+	// һ֡һ֡֡仯
+	void Reset();
+
+	size_t TileCount() const { return hashes.size(); }
+	const Counters& GetCounters() const { return counters; }
+
+private:
+	SimdLevel level;
+	WorkStealingPool* pool;
+	size_t width;
+	size_t height;
+	size_t tilesAcross;
+	std::vector<uint64_t> hashes;
+	std::vector<uint8_t> known;   // ӦͼĹϣǷӳϵ
+	std::vector<uint64_t> fresh;  // ֡ͼĹϣ
+	Counters counters;
+};
@@ -0,0 +1,176 @@
+#include "transport_compression.h"
+#include <cstring>
+
+#ifdef WINDOWCASTER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+	// Copies go in whole 16-byte chunks, two at a time, and may write past the end of a sequence;
+	// they stop this far short of the end of the buffer, where the rest is copied exactly
+	constexpr size_t kChunkBytes = 16;
+	constexpr size_t kCopyMargin = 2 * kChunkBytes;
+
+	// LZ4 length fields continue in extra bytes for as long as they read 255
+	bool ReadLz4Length(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+		uint8_t byte;
+		do {
+			if (ip >= end) {
+				return false;
+			}
+			byte = *ip++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	// Decodes an LZ4 block (the format of LZ4_compress_default), checking every read and write
+	bool DecompressLz4(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+		const uint8_t* ip = src;
+		const uint8_t* const inputEnd = src + srcSize;
+		uint8_t* op = dst;
+		uint8_t* const outputEnd = dst + dstSize;
+		uint8_t* const chunkLimit = dstSize > kCopyMargin ? outputEnd - kCopyMargin : dst;
+
+		while (ip < inputEnd) {
+			unsigned token = *ip++;
+
+			size_t literals = token >> 4;
+			if (literals == 15 && !ReadLz4Length(ip, inputEnd, literals)) {
+				return false;
+			}
+			if (literals > static_cast<size_t>(inputEnd - ip) || literals > static_cast<size_t>(outputEnd - op)) {
+				return false;
+			}
+			if (literals <= kChunkBytes && static_cast<size_t>(inputEnd - ip) >= kChunkBytes
+				&& static_cast<size_t>(outputEnd - op) >= kChunkBytes) {
+				std::memcpy(op, ip, kChunkBytes);
+			}
+			else {
+				std::memcpy(op, ip, literals);
+			}
+			ip += literals;
+			op += literals;
+
+			// The last sequence is literals only
+			if (ip == inputEnd) {
+				break;
+			}
+
+			if (inputEnd - ip < 2) {
+				return false;
+			}
+			size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+			ip += 2;
+			if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+				return false;
+			}
+
+			size_t match = token & 15;
+			if (match == 15 && !ReadLz4Length(ip, inputEnd, match)) {
+				return false;
+			}
+			match += 4;
+			if (match > static_cast<size_t>(outputEnd - op)) {
+				return false;
+			}
+
+			const uint8_t* from = op - offset;
+			uint8_t* const matchEnd = op + match;
+			uint8_t* const chunkEnd = matchEnd < chunkLimit ? matchEnd : chunkLimit;
+			if (offset < kChunkBytes) {
+				// A short period repeats, the way solid areas of a screen do (offset 3 or 4).
+				// Spell out the first bytes one at a time until a whole chunk of the pattern exists,
+				// then keep storing that chunk, advancing by a multiple of the period each time
+				size_t distance = (kChunkBytes + offset - 1) / offset * offset;
+				uint8_t* const spelled = op + (distance - offset);
+				if (spelled < chunkEnd) {
+					while (op < spelled) {
+						*op++ = *from++;
+					}
+					uint8_t pattern[kChunkBytes];
+					std::memcpy(pattern, op - distance, kChunkBytes);
+					size_t step = kChunkBytes / offset * offset;
+					while (op < chunkEnd) {
+						std::memcpy(op, pattern, kChunkBytes);
+						std::memcpy(op + step, pattern, kChunkBytes);
+						op += 2 * step;
+					}
+				}
+			}
+			else {
+				while (op < chunkEnd) {
+					std::memcpy(op, from, kChunkBytes);
+					std::memcpy(op + kChunkBytes, from + kChunkBytes, kChunkBytes);
+					op += 2 * kChunkBytes;
+					from += 2 * kChunkBytes;
+				}
+			}
+
+			// Byte by byte for whatever is left, because source and destination may overlap
+			if (op > matchEnd) {
+				op = matchEnd;
+			}
+			for (from = op - offset; op < matchEnd; ) {
+				*op++ = *from++;
+			}
+		}
+
+		return op == outputEnd;
+	}
+}
+
+bool IsCompressionSupported(TransportCompression compression) {
+	switch (compression) {
+	case TransportCompression::None:
+	case TransportCompression::Lz4:
+		return true;
+	case TransportCompression::Zstd:
+#ifdef WINDOWCASTER_WITH_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
+
+Decompressor::Decompressor()
+	: zstdContext(nullptr) {
+}
+
+Decompressor::~Decompressor() {
+#ifdef WINDOWCASTER_WITH_ZSTD
+	ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(zstdContext));
+#endif
+}
+
+bool Decompressor::Decompress(TransportCompression compression, const char* src, size_t srcSize,
+	char* dst, size_t dstSize) {
+	switch (compression) {
+	case TransportCompression::None:
+		if (srcSize != dstSize) {
+			return false;
+		}
+		std::memcpy(dst, src, srcSize);
+		return true;
+	case TransportCompression::Lz4:
+		return DecompressLz4(reinterpret_cast<const uint8_t*>(src), srcSize, reinterpret_cast<uint8_t*>(dst), dstSize);
+#ifdef WINDOWCASTER_WITH_ZSTD
+	case TransportCompression::Zstd: {
+		// One context per connection keeps its tables warm between messages
+		if (!zstdContext) {
+			zstdContext = ZSTD_createDCtx();
+			if (!zstdContext) {
+				return false;
+			}
+		}
+		size_t result = ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(zstdContext), dst, dstSize, src, srcSize);
+		return !ZSTD_isError(result) && result == dstSize;
+	}
+#endif
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ѹڿʽģʽʱЭ̣֮ɿͻϢǷѹ
+// (ѾѹƵJPEG/PNG ѹһ)
+//
+// protobuf Ϣǰ׺θλ 1ϢΪѹ֡ͷ + ѹ
+//   0  uint8  compression   ȡֵ TransportCompression
+//   1  uint32 rawSize       ѹֽ (С)
+// ԭʼ֡֡ͷ flags  bit3-4 Ϊѹ㷨reserved ֶΪѹĸֻֽѹ
+constexpr uint32_t kCompressedMessageFlag = 0x40000000u;
+constexpr size_t kCompressedMessageHeaderSize = 5;
+
+enum class TransportCompression : uint8_t {
+	None = 0,
+	Lz4 = 1,   // LZ4 ʽѹͣʺϾ
+	Zstd = 2,  // zstd ֡ʽ (ѹȼ)ʺϴ޵·
+};
+
+// ܷѹ㷨LZ4 ʼտãzstd Ҫʱṩ libzstd
+bool IsCompressionSupported(TransportCompression compression);
+
+// һӵĽѹ״̬ͬһʱֻһ߳ʹ
+class Decompressor {
+public:
+	Decompressor();
+	~Decompressor();
+
+	Decompressor(const Decompressor&) = delete;
+	Decompressor& operator=(const Decompressor&) = delete;
+
+	//  src ѹ dstѹǡ dstSize ֽڣʱ false
+	bool Decompress(TransportCompression compression, const char* src, size_t srcSize, char* dst, size_t dstSize);
+
+private:
+	// zstd Ľѹģյһ zstd ϢʱŴ
+	void* zstdContext;
+};
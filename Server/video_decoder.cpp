@@ -0,0 +1,203 @@
+#include "video_decoder.h"
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+#include "frame_buffer_pool.h"
+#include <climits>
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+#endif
+
+namespace {
+	// Calls visit with the first header byte of every NAL unit until it returns true
+	template <typename Visitor>
+	bool AnyNalUnit(const uint8_t* data, size_t size, Visitor visit) {
+		// A start code is 00 00 01, optionally preceded by another zero byte
+		for (size_t i = 0; i + 3 < size; ++i) {
+			if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+				if (visit(data[i + 3])) {
+					return true;
+				}
+				i += 2;
+			}
+		}
+		return false;
+	}
+}
+
+bool ContainsKeyframe(VideoCodec codec, const uint8_t* data, size_t size) {
+	switch (codec) {
+	case VideoCodec::H264:
+		// nal_unit_type 5: coded slice of an IDR picture
+		return AnyNalUnit(data, size, [](uint8_t header) { return (header & 0x1f) == 5; });
+	case VideoCodec::Hevc:
+		// nal_unit_type 16-21: BLA, IDR and CRA pictures (IRAP)
+		return AnyNalUnit(data, size, [](uint8_t header) {
+			uint8_t type = (header >> 1) & 0x3f;
+			return type >= 16 && type <= 21;
+			});
+	}
+	return false;
+}
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+
+VideoDecoder::Status CopyDecodedPicture(const AVFrame& source, FrameBufferPool& buffers, DecodedFrame& frame) {
+	using Status = VideoDecoder::Status;
+	// Error concealment still outputs a picture; showing it would smear the damage
+	if (source.decode_error_flags != 0 || (source.flags & AV_FRAME_FLAG_CORRUPT) != 0) {
+		return Status::Corrupt;
+	}
+
+	FrameView& view = frame.image;
+	view = FrameView();
+	switch (source.format) {
+	case AV_PIX_FMT_YUVJ420P:
+		view.colorSpace.fullRange = true;
+		view.format = PixelFormat::I420;
+		break;
+	case AV_PIX_FMT_YUV420P:
+		view.format = PixelFormat::I420;
+		break;
+	case AV_PIX_FMT_NV12:
+		view.format = PixelFormat::Nv12;
+		break;
+	default:
+		return Status::UnsupportedFormat;
+	}
+	view.width = static_cast<size_t>(source.width);
+	view.height = static_cast<size_t>(source.height);
+	view.colorSpace.matrix = source.colorspace == AVCOL_SPC_BT709 ? YuvMatrix::Bt709 : YuvMatrix::Bt601;
+	view.colorSpace.fullRange = view.colorSpace.fullRange || source.color_range == AVCOL_RANGE_JPEG;
+
+	// One pooled buffer keeping the decoder's strides
+	size_t planes = PlaneCount(view.format);
+	size_t planeSizes[kMaxPlanes] = {};
+	size_t total = 0;
+	for (size_t plane = 0; plane < planes; ++plane) {
+		if (source.linesize[plane] <= 0) {
+			return Status::UnsupportedFormat;
+		}
+		size_t rows = plane == 0 ? view.height : (view.height + 1) / 2;
+		view.planeOffsets[plane] = total;
+		view.strides[plane] = static_cast<size_t>(source.linesize[plane]);
+		planeSizes[plane] = view.strides[plane] * rows;
+		total += planeSizes[plane];
+	}
+
+	std::shared_ptr<FrameBuffer> buffer = buffers.Acquire(total);
+	for (size_t plane = 0; plane < planes; ++plane) {
+		std::memcpy(buffer->Data() + view.planeOffsets[plane], source.data[plane], planeSizes[plane]);
+	}
+	view.data = reinterpret_cast<const uint8_t*>(buffer->Data());
+	if (!ResolvePlaneLayout(view, total)) {
+		return Status::UnsupportedFormat;
+	}
+	frame.owner = std::move(buffer);
+	return Status::Ok;
+}
+
+namespace {
+	struct CodecContextDeleter {
+		void operator()(AVCodecContext* context) const { avcodec_free_context(&context); }
+	};
+	struct PacketDeleter {
+		void operator()(AVPacket* packet) const { av_packet_free(&packet); }
+	};
+	struct PictureDeleter {
+		void operator()(AVFrame* picture) const { av_frame_free(&picture); }
+	};
+
+	class LibavcodecDecoder : public VideoDecoder {
+	public:
+		// Decoded pictures wait in the window's mailbox at most one or two at a time
+		LibavcodecDecoder() : buffers(FrameBufferPool::Options{ kVideoFramePoolBytes }) {}
+
+		bool Open(VideoCodec codec) {
+			const AVCodec* decoder = avcodec_find_decoder(codec == VideoCodec::Hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+			if (!decoder) {
+				return false;
+			}
+			context.reset(avcodec_alloc_context3(decoder));
+			packet.reset(av_packet_alloc());
+			picture.reset(av_frame_alloc());
+			if (!context || !packet || !picture) {
+				return false;
+			}
+			// Output each picture as soon as it is decoded; frame threading would add a frame
+			// of latency per thread, slice threading does not
+			context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+			context->thread_type = FF_THREAD_SLICE;
+			context->thread_count = 0;
+			return avcodec_open2(context.get(), decoder, nullptr) == 0;
+		}
+
+		Status Decode(const uint8_t* data, size_t size, std::vector<DecodedFrame>& frames) override {
+			if (size > INT_MAX) {
+				return Status::Corrupt;
+			}
+			// The bitstream reader may look past the end; av_new_packet adds zeroed padding
+			if (av_new_packet(packet.get(), static_cast<int>(size)) < 0) {
+				return Status::Corrupt;
+			}
+			std::memcpy(packet->data, data, size);
+			int result = avcodec_send_packet(context.get(), packet.get());
+			av_packet_unref(packet.get());
+			if (result < 0 && result != AVERROR(EAGAIN)) {
+				return Status::Corrupt;
+			}
+
+			Status status = Status::Ok;
+			while ((result = avcodec_receive_frame(context.get(), picture.get())) == 0) {
+				if (status == Status::Ok) {
+					status = Wrap(*picture, frames);
+				}
+				av_frame_unref(picture.get());
+			}
+			if (result != AVERROR(EAGAIN) && result != AVERROR_EOF) {
+				return Status::Corrupt;
+			}
+			return status;
+		}
+
+		void Reset() override {
+			avcodec_flush_buffers(context.get());
+		}
+
+	private:
+		std::unique_ptr<AVCodecContext, CodecContextDeleter> context;
+		std::unique_ptr<AVPacket, PacketDeleter> packet;
+		std::unique_ptr<AVFrame, PictureDeleter> picture;
+		FrameBufferPool buffers;
+
+		// The copy lets the decoder reuse its picture while the frame waits to be presented
+		Status Wrap(const AVFrame& source, std::vector<DecodedFrame>& frames) {
+			DecodedFrame frame;
+			Status status = CopyDecodedPicture(source, buffers, frame);
+			if (status == Status::Ok) {
+				frames.push_back(std::move(frame));
+			}
+			return status;
+		}
+	};
+}
+
+std::unique_ptr<VideoDecoder> CreateSoftwareVideoDecoder(VideoCodec codec) {
+	auto decoder = std::make_unique<LibavcodecDecoder>();
+	if (!decoder->Open(codec)) {
+		return nullptr;
+	}
+	return decoder;
+}
+
+#else
+
+std::unique_ptr<VideoDecoder> CreateSoftwareVideoDecoder(VideoCodec) {
+	return nullptr;
+}
+
+#endif
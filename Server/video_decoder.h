@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pixel_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// ѹƵıʽȡֵ windowcaster.proto е VideoCodec һ
+enum class VideoCodec : uint8_t {
+	H264 = 0,
+	Hevc = 1,
+};
+
+inline bool IsKnownVideoCodec(uint32_t value) {
+	return value <= static_cast<uint32_t>(VideoCodec::Hevc);
+}
+
+// ʵԪǷԶĹؼ֡ (H.264 IDRHEVC IRAP)data Ϊ Annex-B ʽ
+bool ContainsKeyframe(VideoCodec codec, const uint8_t* data, size_t size);
+
+// һ֡ owner Уƽ沼Ѳȫ
+struct DecodedFrame {
+	FrameView image;
+	std::shared_ptr<const void> owner;
+};
+
+// ƵӿڣΪ Annex-B ʽ (ʼָ NAL Ԫ) ķʵԪ
+// ͬһʵͬһʱֻһ߳ʹ
+class VideoDecoder {
+public:
+	enum class Status {
+		Ok,
+		Corrupt,             // 𻵻ȱٲο֡ӹؼ֡¿ʼ
+		UnsupportedFormat,   // ظʽ޷
+	};
+
+	virtual ~VideoDecoder() = default;
+
+	// һʵԪ֡׷ӵ frames (нӳʱû)
+	virtual Status Decode(const uint8_t* data, size_t size, std::vector<DecodedFrame>& frames) = 0;
+
+	// ο֡δ֡
+	virtual void Reset() = 0;
+};
+
+// ÿ벥ԴԼĻرĿлޣڴڵȴһ֡
+// ֡ 4K Ŀлý벻ٷڴ
+constexpr size_t kVideoFramePoolBytes = 64 * 1024 * 1024;
+
+// Ĺֵ֧ıʽ nullptr
+using VideoDecoderFactory = std::function<std::unique_ptr<VideoDecoder>(VideoCodec codec)>;
+
+//  libavcodec ʱδ WINDOWCASTER_WITH_LIBAVCODEC Ƿ nullptr
+std::unique_ptr<VideoDecoder> CreateSoftwareVideoDecoder(VideoCodec codec);
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+struct AVFrame;
+class FrameBufferPool;
+
+//  libavcodec ͼƵصһ黺У漴Ըͼ
+// ͬʹ libavcodec ģ ( video_source.h) 
+VideoDecoder::Status CopyDecodedPicture(const AVFrame& source, FrameBufferPool& buffers, DecodedFrame& frame);
+#endif
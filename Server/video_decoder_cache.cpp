@@ -0,0 +1,122 @@
+#include "video_decoder_cache.h"
+
+namespace {
+	// Ask again while still waiting, in case the client missed or ignored the first request
+	constexpr auto kKeyframeRequestInterval = std::chrono::milliseconds(500);
+}
+
+VideoDecoderCache::VideoDecoderCache(VideoDecoderFactory factory)
+	: factory(std::move(factory)) {
+}
+
+std::shared_ptr<VideoDecoderCache::Entry> VideoDecoderCache::EntryFor(uint64_t targetWindow) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& entry = entries[targetWindow];
+	if (!entry) {
+		entry = std::make_shared<Entry>();
+	}
+	return entry;
+}
+
+VideoDecoderCache::Result VideoDecoderCache::Decode(uint64_t targetWindow, VideoCodec codec, uint64_t sequence,
+	const uint8_t* data, size_t size) {
+	Result result;
+	std::shared_ptr<Entry> entry = EntryFor(targetWindow);
+	std::lock_guard<std::mutex> lock(entry->mutex);
+
+	if (!entry->decoder || entry->codec != codec) {
+		entry->decoder = factory(codec);
+		if (!entry->decoder) {
+			result.error = "Unsupported video codec";
+			return result;
+		}
+		counters.decoders++;
+		entry->codec = codec;
+		entry->waitingForKeyframe = true;
+	}
+
+	// A gap means a packet never reached the decoder (rejected, or sent before a reconnect);
+	// the pictures after it reference data the decoder does not have
+	if (sequence != 0) {
+		if (entry->lastSequence != 0 && sequence != entry->lastSequence + 1 && !entry->waitingForKeyframe) {
+			entry->decoder->Reset();
+			entry->waitingForKeyframe = true;
+		}
+		entry->lastSequence = sequence;
+	}
+
+	if (entry->waitingForKeyframe) {
+		if (!ContainsKeyframe(codec, data, size)) {
+			counters.skipped++;
+			result.error = "Waiting for keyframe";
+			result.requestKeyframe = KeyframeRequestDue(*entry);
+			return result;
+		}
+		entry->waitingForKeyframe = false;
+		entry->keyframeRequested = false;
+	}
+
+	counters.packets++;
+	switch (entry->decoder->Decode(data, size, entry->output)) {
+	case VideoDecoder::Status::Ok:
+		break;
+	case VideoDecoder::Status::Corrupt:
+		counters.errors++;
+		entry->output.clear();
+		entry->decoder->Reset();
+		entry->waitingForKeyframe = true;
+		result.error = "Corrupt video data";
+		result.requestKeyframe = KeyframeRequestDue(*entry);
+		return result;
+	case VideoDecoder::Status::UnsupportedFormat:
+		entry->output.clear();
+		result.error = "Unsupported decoded pixel format";
+		return result;
+	}
+
+	result.success = true;
+	if (!entry->output.empty()) {
+		// Only the newest picture matters, the window presents latest-wins anyway
+		counters.frames += entry->output.size();
+		result.frame = std::move(entry->output.back());
+		entry->output.clear();
+	}
+	return result;
+}
+
+bool VideoDecoderCache::KeyframeRequestDue(Entry& entry) {
+	auto now = std::chrono::steady_clock::now();
+	if (entry.keyframeRequested && now - entry.keyframeRequestedAt < kKeyframeRequestInterval) {
+		return false;
+	}
+	entry.keyframeRequested = true;
+	entry.keyframeRequestedAt = now;
+	counters.keyframeRequests++;
+	return true;
+}
+
+void VideoDecoderCache::Invalidate(uint64_t targetWindow) {
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.erase(targetWindow);
+}
+
+void VideoDecoderCache::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+}
+
+size_t VideoDecoderCache::Size() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+VideoDecoderCache::Stats VideoDecoderCache::GetStats() const {
+	Stats stats;
+	stats.packets = counters.packets.load();
+	stats.frames = counters.frames.load();
+	stats.skipped = counters.skipped.load();
+	stats.errors = counters.errors.load();
+	stats.keyframeRequests = counters.keyframeRequests.load();
+	stats.decoders = counters.decoders.load();
+	return stats;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "video_decoder.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Ŀ괰ڱƵϢ֮
+// ½лʽ𻵻֡Ų (ͻ) ӹؼ֡¿ʼ
+// ڼķǹؼ֡ʾ÷ͻؼ֡
+// ̰߳ȫͬڿԲн룬ͬһڵĽ봮ִ
+class VideoDecoderCache {
+public:
+	struct Stats {
+		uint64_t packets = 0;            // ķʵԪ
+		uint64_t frames = 0;             // ֡
+		uint64_t skipped = 0;            // ȴؼ֡ڼ䶪ķʵԪ
+		uint64_t errors = 0;             // 
+		uint64_t keyframeRequests = 0;   // ʾؼ֡Ĵ
+		uint64_t decoders = 0;           // Ľ
+	};
+
+	struct Result {
+		bool success = false;
+		const char* error = "";          // ʧԭ
+		bool requestKeyframe = false;    // Ҫͻؼ֡
+		DecodedFrame frame;              // ½һ֡ӳʱ owner Ϊ
+	};
+
+	explicit VideoDecoderCache(VideoDecoderFactory factory);
+
+	// 봰ڵһʵԪsequence Ϊͻ֡ (0 ʾ)
+	Result Decode(uint64_t targetWindow, VideoCodec codec, uint64_t sequence, const uint8_t* data, size_t size);
+
+	// ڵĽ֮ӹؼ֡¿ʼ
+	void Invalidate(uint64_t targetWindow);
+
+	void Clear();
+
+	size_t Size() const;
+	Stats GetStats() const;
+
+private:
+	struct Entry {
+		std::mutex mutex;
+		VideoCodec codec = VideoCodec::H264;
+		std::unique_ptr<VideoDecoder> decoder;
+		uint64_t lastSequence = 0;
+		bool waitingForKeyframe = true;
+		bool keyframeRequested = false;
+		std::chrono::steady_clock::time_point keyframeRequestedAt;
+		std::vector<DecodedFrame> output;
+	};
+
+	VideoDecoderFactory factory;
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<Entry>> entries;
+
+	// ʱ mutexԭӱ
+	struct Counters {
+		std::atomic<uint64_t> packets{ 0 };
+		std::atomic<uint64_t> frames{ 0 };
+		std::atomic<uint64_t> skipped{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::atomic<uint64_t> keyframeRequests{ 0 };
+		std::atomic<uint64_t> decoders{ 0 };
+	};
+	Counters counters;
+
+	std::shared_ptr<Entry> EntryFor(uint64_t targetWindow);
+	bool KeyframeRequestDue(Entry& entry);
+};
@@ -0,0 +1,365 @@
+#include "video_player.h"
+#include <utility>
+#include <vector>
+
+VideoPlayer::VideoPlayer(std::unique_ptr<VideoSource> source, FrameSink sink, const Options& options)
+	: source(std::move(source))
+	, sink(std::move(sink))
+	, loop(options.loop)
+	, stopping(false) {
+	state.durationUs = this->source->DurationUs();
+	if (options.startUs > 0) {
+		seekPending = true;
+		seekTarget = options.startUs;
+	}
+	thread = std::thread(&VideoPlayer::Run, this);
+}
+
+VideoPlayer::~VideoPlayer() {
+	Stop();
+}
+
+void VideoPlayer::Pause() {
+	std::lock_guard<std::mutex> lock(mutex);
+	state.paused = true;
+}
+
+void VideoPlayer::Resume() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!state.paused) {
+			return;
+		}
+		state.paused = false;
+		// Restart the clock at the next frame instead of catching up on the pause
+		anchored = false;
+	}
+	wake.notify_all();
+}
+
+void VideoPlayer::Seek(int64_t positionUs) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		seekPending = true;
+		seekTarget = positionUs > 0 ? positionUs : 0;
+	}
+	wake.notify_all();
+}
+
+VideoPlayer::State VideoPlayer::GetState() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return state;
+}
+
+void VideoPlayer::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	std::lock_guard<std::mutex> lock(joinMutex);
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void VideoPlayer::Run() {
+	// The next frame, decoded ahead and waiting for its time
+	VideoSource::Frame pending;
+	bool hasPending = false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping && !state.finished) {
+		if (seekPending) {
+			SeekLocked(lock, pending, hasPending);
+			continue;
+		}
+		if (state.paused) {
+			wake.wait(lock);
+			continue;
+		}
+		if (!hasPending) {
+			hasPending = ReadLocked(lock, pending);
+			continue;
+		}
+
+		Clock::time_point now = Clock::now();
+		// Timestamps running backwards (a rewind, a broken file) restart the clock
+		if (!anchored || pending.timestampUs < anchorMediaUs) {
+			anchored = true;
+			anchorTime = now;
+			anchorMediaUs = pending.timestampUs;
+		}
+		Clock::time_point due = anchorTime + std::chrono::microseconds(pending.timestampUs - anchorMediaUs);
+		if (now < due) {
+			// Woken early by a control, which is handled first
+			wake.wait_until(lock, due);
+			continue;
+		}
+		// Late frames go out at once; the window's mailbox drops those its present thread cannot keep up with
+		if (now - due > kLateThreshold) {
+			state.framesLate++;
+			if (now - due > kMaxLag) {
+				anchorTime = now;
+				anchorMediaUs = pending.timestampUs;
+			}
+		}
+		hasPending = false;
+		PresentLocked(lock, pending);
+	}
+	lock.unlock();
+
+	// A finished player keeps only its state: the file and the decoder go now rather than when the
+	// controller gets round to dropping the player
+	pending = {};
+	source.reset();
+}
+
+void VideoPlayer::SeekLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& pending, bool& hasPending) {
+	int64_t target = seekTarget;
+	seekPending = false;
+	hasPending = false;
+	state.finished = false;
+	state.error.clear();
+	lock.unlock();
+
+	// Decode from the keyframe before the target; the last frame not after it is shown and the
+	// one following it becomes the pending frame
+	VideoSource::Frame shown;
+	VideoSource::Frame next;
+	bool hasShown = false;
+	bool hasNext = false;
+	bool seeked = source->Seek(target);
+	uint32_t errors = 0;
+	while (seeked && !stopping) {
+		VideoSource::Status status = source->Read(next);
+		if (status == VideoSource::Status::Corrupt && ++errors < kMaxConsecutiveErrors) {
+			continue;
+		}
+		if (status != VideoSource::Status::Ok) {
+			break;
+		}
+		errors = 0;
+		if (hasShown && next.timestampUs > target) {
+			hasNext = true;
+			break;
+		}
+		shown = std::move(next);
+		hasShown = true;
+	}
+
+	lock.lock();
+	if (!hasShown) {
+		state.finished = true;
+		if (!seeked) {
+			state.error = "Seek failed";
+		}
+		return;
+	}
+	if (hasNext) {
+		pending = std::move(next);
+		hasPending = true;
+	}
+	anchored = true;
+	anchorTime = Clock::now();
+	anchorMediaUs = shown.timestampUs;
+	// A seek is a jump, not a step: the previous position says nothing about the frame rate
+	frameIntervalUs = 0;
+	state.positionUs = shown.timestampUs;
+	PresentLocked(lock, shown);
+}
+
+bool VideoPlayer::ReadLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& frame) {
+	lock.unlock();
+	VideoSource::Status status = source->Read(frame);
+	bool rewound = false;
+	if (status == VideoSource::Status::End && loop) {
+		rewound = source->Seek(0);
+		if (rewound) {
+			status = source->Read(frame);
+		}
+	}
+	lock.lock();
+
+	switch (status) {
+	case VideoSource::Status::Ok:
+		consecutiveErrors = 0;
+		if (rewound && anchored) {
+			// The first frame follows the last one after the usual frame interval
+			anchorTime += std::chrono::microseconds(state.positionUs + frameIntervalUs - anchorMediaUs);
+			anchorMediaUs = frame.timestampUs;
+		}
+		return true;
+	case VideoSource::Status::Corrupt:
+		state.framesCorrupt++;
+		if (++consecutiveErrors >= kMaxConsecutiveErrors) {
+			state.finished = true;
+			state.error = "Corrupt video data";
+		}
+		return false;
+	case VideoSource::Status::UnsupportedFormat:
+		state.finished = true;
+		state.error = "Unsupported pixel format";
+		return false;
+	case VideoSource::Status::End:
+		break;
+	}
+	state.finished = true;
+	return false;
+}
+
+void VideoPlayer::PresentLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& frame) {
+	int64_t timestampUs = frame.timestampUs;
+	lock.unlock();
+	bool accepted = sink(std::move(frame.picture));
+	lock.lock();
+
+	if (state.framesPresented > 0 && timestampUs > state.positionUs) {
+		frameIntervalUs = timestampUs - state.positionUs;
+	}
+	state.positionUs = timestampUs;
+	state.framesPresented++;
+	if (!accepted) {
+		state.finished = true;
+		state.error = kWindowGoneError;
+	}
+}
+
+PlaybackController::PlaybackController(FrameSink sink)
+	: sink(std::move(sink)) {
+}
+
+PlaybackController::~PlaybackController() {
+	StopAll();
+}
+
+void PlaybackController::Play(uint64_t targetWindow, std::unique_ptr<VideoSource> source,
+	const VideoPlayer::Options& options) {
+	// The old player is gone before the new one presents its first frame
+	Stop(targetWindow);
+	auto player = std::make_shared<VideoPlayer>(std::move(source),
+		[sink = sink, targetWindow](DecodedFrame frame) { return sink(targetWindow, std::move(frame)); },
+		options);
+
+	std::shared_ptr<VideoPlayer> previous;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::shared_ptr<VideoPlayer>& slot = players[targetWindow];
+		previous = std::move(slot);
+		slot = std::move(player);
+		finished.erase(targetWindow);
+	}
+	// Another session started playing on the same window meanwhile
+	if (previous) {
+		previous->Stop();
+	}
+}
+
+bool PlaybackController::Pause(uint64_t targetWindow) {
+	std::shared_ptr<VideoPlayer> player = Find(targetWindow);
+	if (!player) {
+		return false;
+	}
+	player->Pause();
+	return true;
+}
+
+bool PlaybackController::Resume(uint64_t targetWindow) {
+	std::shared_ptr<VideoPlayer> player = Find(targetWindow);
+	if (!player) {
+		return false;
+	}
+	player->Resume();
+	return true;
+}
+
+bool PlaybackController::Seek(uint64_t targetWindow, int64_t positionUs) {
+	std::shared_ptr<VideoPlayer> player = Find(targetWindow);
+	if (!player) {
+		return false;
+	}
+	player->Seek(positionUs);
+	return true;
+}
+
+bool PlaybackController::GetState(uint64_t targetWindow, VideoPlayer::State& state) {
+	std::shared_ptr<VideoPlayer> player = Find(targetWindow);
+	if (player) {
+		state = player->GetState();
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = finished.find(targetWindow);
+	if (it == finished.end()) {
+		return false;
+	}
+	state = it->second;
+	return true;
+}
+
+bool PlaybackController::Stop(uint64_t targetWindow) {
+	Reap();
+	std::shared_ptr<VideoPlayer> player;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bool ended = finished.erase(targetWindow) > 0;
+		auto it = players.find(targetWindow);
+		if (it == players.end()) {
+			return ended;
+		}
+		player = std::move(it->second);
+		players.erase(it);
+	}
+	// Joined outside the lock: the player may be in the middle of presenting a frame
+	player->Stop();
+	return true;
+}
+
+void PlaybackController::StopAll() {
+	std::unordered_map<uint64_t, std::shared_ptr<VideoPlayer>> stopped;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped.swap(players);
+		finished.clear();
+	}
+	for (auto& entry : stopped) {
+		entry.second->Stop();
+	}
+}
+
+size_t PlaybackController::Size() {
+	Reap();
+	std::lock_guard<std::mutex> lock(mutex);
+	return players.size();
+}
+
+std::shared_ptr<VideoPlayer> PlaybackController::Find(uint64_t targetWindow) {
+	Reap();
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = players.find(targetWindow);
+	return it != players.end() ? it->second : nullptr;
+}
+
+// A finished player's thread has closed its source and is exiting; joining it takes no time
+void PlaybackController::Reap() {
+	std::vector<std::shared_ptr<VideoPlayer>> ended;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = players.begin(); it != players.end();) {
+			VideoPlayer::State state = it->second->GetState();
+			if (!state.finished) {
+				++it;
+				continue;
+			}
+			// Nobody can ask about a window that is gone
+			if (state.error != VideoPlayer::kWindowGoneError) {
+				finished[it->first] = std::move(state);
+			}
+			ended.push_back(std::move(it->second));
+			it = players.erase(it);
+		}
+	}
+	for (auto& player : ended) {
+		player->Stop();
+	}
+}
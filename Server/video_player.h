@@ -0,0 +1,133 @@
+#pragma once
+
+#include "video_source.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// һƵԼ߳϶ȡ룬ʾʱʱַ֡
+// ֡Ľֻȡڷ˵ʱӣͻ˼ʱӰ
+// ٵ֡׷ʱ (ָʱڵֻһ֡)̫ʱ׷ϣӵǰ֡¼ʱ
+//  (ѭʱ) ֹͣ󲥷߳˳رƵԴֻ״̬
+class VideoPlayer {
+public:
+	// ڲ߳ϵã false ʱֹͣ (Ŀ괰ѹر)
+	using FrameSink = std::function<bool(DecodedFrame frame)>;
+
+	struct Options {
+		int64_t startUs = 0;
+		bool loop = false;
+	};
+
+	struct State {
+		int64_t positionUs = 0;        // ֵ֡ʱ
+		int64_t durationUs = 0;        // δ֪ʱΪ 0
+		bool paused = false;
+		bool finished = false;         // Ѳŵĩβ (ѭʱ) ֹͣ
+		uint64_t framesPresented = 0;
+		uint64_t framesLate = 0;       // ʾʱ䳬 kLateThreshold Ž֡
+		uint64_t framesCorrupt = 0;
+		std::string error;             // ֹͣʱԭ
+	};
+
+	static constexpr std::chrono::milliseconds kLateThreshold{ 40 };
+	// 󳬹ʱʱ¼ʱǿ׷
+	static constexpr std::chrono::milliseconds kMaxLag{ 500 };
+	// 𻵵ݴﵽôʱֹͣ
+	static constexpr uint32_t kMaxConsecutiveErrors = 100;
+	// sink ܾ֡ (Ŀ괰Ѳ) ֹͣʱ State::error
+	static constexpr const char* kWindowGoneError = "Invalid window handle";
+
+	VideoPlayer(std::unique_ptr<VideoSource> source, FrameSink sink, const Options& options);
+	~VideoPlayer();
+
+	VideoPlayer(const VideoPlayer&) = delete;
+	VideoPlayer& operator=(const VideoPlayer&) = delete;
+
+	void Pause();
+	void Resume();
+
+	// ת positionUs Ļ (ͣʱҲ)ѽĲŲӦ
+	void Seek(int64_t positionUs);
+
+	State GetState() const;
+
+	// ֹͣȴ֮߳̽ٵ sinkظ
+	void Stop();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	std::unique_ptr<VideoSource> source;
+	FrameSink sink;
+	bool loop;
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<bool> stopping;
+	std::mutex joinMutex;
+	bool seekPending = false;
+	int64_t seekTarget = 0;
+	// ʱ anchorMediaUs ֡Ӧ anchorTime ֣֮֡ʱƺ
+	bool anchored = false;
+	Clock::time_point anchorTime;
+	int64_t anchorMediaUs = 0;
+	State state;
+	int64_t frameIntervalUs = 0;      // ֡ʱѭʱνβ
+	uint32_t consecutiveErrors = 0;   // ֻڲ߳ʹ
+	std::thread thread;
+
+	void Run();
+	// ڲ߳ϵãʱ lockȡڼͷ
+	void SeekLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& pending, bool& hasPending);
+	bool ReadLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& frame);
+	void PresentLocked(std::unique_lock<std::mutex>& lock, VideoSource::Frame& frame);
+};
+
+// Ŀ괰ڵķ˲ţÿͬһʱһ
+// ѽĲһεÿʱ (߳ƵԴڽʱͷ)ֻ֮ܲѯ״̬
+// ֱôٴοʼŻֹͣĿ괰ڹرնĲ״̬
+// ̰߳ȫڶ߳ͬʱ
+class PlaybackController {
+public:
+	using FrameSink = std::function<bool(uint64_t targetWindow, DecodedFrame frame)>;
+
+	explicit PlaybackController(FrameSink sink);
+	~PlaybackController();
+
+	// ʼţ滻֮ǰĲ
+	void Play(uint64_t targetWindow, std::unique_ptr<VideoSource> source, const VideoPlayer::Options& options);
+
+	// ²ڴûڽеĲʱ false
+	bool Pause(uint64_t targetWindow);
+	bool Resume(uint64_t targetWindow);
+	bool Seek(uint64_t targetWindow, int64_t positionUs);
+
+	// ڽеĲŵ״̬ѽĲŵ״̬
+	bool GetState(uint64_t targetWindow, VideoPlayer::State& state);
+
+	// ֹͣŲȴ֮߳̽󲻻иôڵ֡ѽĲֻ״̬
+	bool Stop(uint64_t targetWindow);
+
+	void StopAll();
+
+	// ڽеĲ
+	size_t Size();
+
+private:
+	FrameSink sink;
+	std::mutex mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<VideoPlayer>> players;
+	std::unordered_map<uint64_t, VideoPlayer::State> finished;
+
+	std::shared_ptr<VideoPlayer> Find(uint64_t targetWindow);
+	// ѽĲƳ players ȴ߳˳
+	void Reap();
+};
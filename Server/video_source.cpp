@@ -0,0 +1,488 @@
+#include "video_source.h"
+#include "frame_buffer_pool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+}
+#endif
+
+namespace {
+	class MemoryInput : public MediaInput {
+	public:
+		explicit MemoryInput(std::shared_ptr<const std::vector<uint8_t>> data) : data(std::move(data)) {}
+
+		uint64_t Size() const override { return data->size(); }
+
+		size_t ReadAt(uint64_t offset, void* buffer, size_t size) override {
+			if (offset >= data->size()) {
+				return 0;
+			}
+			size_t available = static_cast<size_t>(data->size() - offset);
+			size_t count = size < available ? size : available;
+			std::memcpy(buffer, data->data() + offset, count);
+			return count;
+		}
+
+		const uint8_t* Data() const override { return data->data(); }
+
+	private:
+		std::shared_ptr<const std::vector<uint8_t>> data;
+	};
+
+	class FileInput : public MediaInput {
+	public:
+		FileInput(std::ifstream stream, uint64_t size) : stream(std::move(stream)), size(size) {}
+
+		uint64_t Size() const override { return size; }
+
+		size_t ReadAt(uint64_t offset, void* buffer, size_t count) override {
+			if (offset >= size) {
+				return 0;
+			}
+			// A previous read that hit the end leaves the stream failed
+			stream.clear();
+			stream.seekg(static_cast<std::streamoff>(offset));
+			stream.read(static_cast<char*>(buffer), static_cast<std::streamsize>(count));
+			return static_cast<size_t>(stream.gcount());
+		}
+
+	private:
+		std::ifstream stream;
+		uint64_t size;
+	};
+
+	// YUV4MPEG2: a text header line, then per frame a "FRAME" line and the raw planes
+	constexpr char kY4mSignature[] = "YUV4MPEG2 ";
+	constexpr size_t kY4mSignatureSize = sizeof(kY4mSignature) - 1;
+	constexpr size_t kMaxY4mLine = 1024;
+	constexpr size_t kMaxY4mDimension = 16384;
+
+	class Y4mSource : public VideoSource {
+	public:
+		// Frames are presented one at a time, a few may wait in the window's mailbox
+		explicit Y4mSource(std::shared_ptr<MediaInput> input) : input(std::move(input)), buffers(FrameBufferPool::Options{ kVideoFramePoolBytes }) {}
+
+		bool Open(std::string& error) {
+			std::string header;
+			if (!ReadLine(0, header)) {
+				error = "Invalid Y4M header";
+				return false;
+			}
+
+			bool fullRange = false;
+			std::string chroma = "420jpeg";
+			size_t position = kY4mSignatureSize;
+			while (position < header.size()) {
+				size_t end = header.find(' ', position);
+				if (end == std::string::npos) {
+					end = header.size();
+				}
+				std::string token = header.substr(position, end - position);
+				position = end + 1;
+				if (token.empty()) {
+					continue;
+				}
+				const char* value = token.c_str() + 1;
+				switch (token[0]) {
+				case 'W':
+					width = std::strtoul(value, nullptr, 10);
+					break;
+				case 'H':
+					height = std::strtoul(value, nullptr, 10);
+					break;
+				case 'F': {
+					char* separator = nullptr;
+					rateNumerator = std::strtoul(value, &separator, 10);
+					rateDenominator = *separator == ':' ? std::strtoul(separator + 1, nullptr, 10) : 0;
+					break;
+				}
+				case 'C':
+					chroma = value;
+					break;
+				case 'X':
+					fullRange = fullRange || token == "XCOLORRANGE=FULL";
+					break;
+				default:
+					// Interlacing and aspect ratio do not change how the frame is shown
+					break;
+				}
+			}
+
+			if (width == 0 || height == 0 || width > kMaxY4mDimension || height > kMaxY4mDimension
+				|| rateNumerator == 0 || rateDenominator == 0) {
+				error = "Invalid Y4M header";
+				return false;
+			}
+			// The 4:2:0 variants differ only in chroma siting, which the converter ignores
+			if (chroma != "420jpeg" && chroma != "420paldv" && chroma != "420mpeg2" && chroma != "420") {
+				error = "Unsupported Y4M colour space C" + chroma;
+				return false;
+			}
+			colorSpace.fullRange = fullRange;
+			// The format has no matrix tag; HD material is BT.709 by convention
+			colorSpace.matrix = height > 576 ? YuvMatrix::Bt709 : YuvMatrix::Bt601;
+			frameSize = width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2);
+			streamStart = header.size() + 1;
+			return true;
+		}
+
+		int64_t DurationUs() const override {
+			// Exact as long as the frame lines carry no parameters, which is how encoders write them
+			uint64_t frames = (input->Size() - streamStart) / (frameSize + sizeof("FRAME"));
+			return TimestampOf(frames);
+		}
+
+		Status Read(Frame& frame) override {
+			uint64_t dataOffset = 0;
+			if (!LocateFrame(next, dataOffset)) {
+				return Status::End;
+			}
+
+			frame.picture = DecodedFrame();
+			FrameView& view = frame.picture.image;
+			view.width = width;
+			view.height = height;
+			view.format = PixelFormat::I420;
+			view.colorSpace = colorSpace;
+			if (const uint8_t* data = input->Data()) {
+				// Uploaded files are presented straight from memory
+				view.data = data + dataOffset;
+				frame.picture.owner = input;
+			}
+			else {
+				std::shared_ptr<FrameBuffer> buffer = buffers.Acquire(frameSize);
+				if (input->ReadAt(dataOffset, buffer->Data(), frameSize) != frameSize) {
+					return Status::End;
+				}
+				view.data = reinterpret_cast<const uint8_t*>(buffer->Data());
+				frame.picture.owner = std::move(buffer);
+			}
+			if (!ResolvePlaneLayout(view, frameSize)) {
+				return Status::UnsupportedFormat;
+			}
+			frame.timestampUs = TimestampOf(next);
+			next++;
+			return Status::Ok;
+		}
+
+		// Every frame stands on its own, so seeking is exact
+		bool Seek(int64_t timestampUs) override {
+			double frames = timestampUs > 0
+				? static_cast<double>(timestampUs) * rateNumerator / (rateDenominator * 1000000.0) : 0.0;
+			size_t index = static_cast<size_t>(frames);
+			uint64_t dataOffset = 0;
+			if (!LocateFrame(index, dataOffset)) {
+				// Past the end: the scan stopped at the last complete frame
+				index = frameOffsets.empty() ? 0 : frameOffsets.size() - 1;
+			}
+			next = index;
+			return true;
+		}
+
+	private:
+		std::shared_ptr<MediaInput> input;
+		FrameBufferPool buffers;
+		size_t width = 0;
+		size_t height = 0;
+		unsigned long rateNumerator = 0;
+		unsigned long rateDenominator = 0;
+		YuvColorSpace colorSpace;
+		size_t frameSize = 0;
+		uint64_t streamStart = 0;
+		// Pixel offsets of the frames found so far; each frame line follows the previous pixels
+		std::vector<uint64_t> frameOffsets;
+		size_t next = 0;
+
+		int64_t TimestampOf(uint64_t index) const {
+			return static_cast<int64_t>(static_cast<double>(index) * rateDenominator * 1000000.0 / rateNumerator);
+		}
+
+		// A line without its '\n'; false if there is none within kMaxY4mLine bytes
+		bool ReadLine(uint64_t offset, std::string& line) {
+			char buffer[kMaxY4mLine];
+			size_t count = input->ReadAt(offset, buffer, sizeof(buffer));
+			const void* end = std::memchr(buffer, '\n', count);
+			if (!end) {
+				return false;
+			}
+			line.assign(buffer, static_cast<size_t>(static_cast<const char*>(end) - buffer));
+			return true;
+		}
+
+		bool LocateFrame(size_t index, uint64_t& dataOffset) {
+			std::string line;
+			while (index >= frameOffsets.size()) {
+				uint64_t lineOffset = frameOffsets.empty() ? streamStart : frameOffsets.back() + frameSize;
+				if (!ReadLine(lineOffset, line) || line.compare(0, 5, "FRAME") != 0) {
+					return false;
+				}
+				uint64_t pixels = lineOffset + line.size() + 1;
+				// A frame cut short by an unfinished upload or copy ends the video
+				if (pixels + frameSize > input->Size()) {
+					return false;
+				}
+				frameOffsets.push_back(pixels);
+			}
+			dataOffset = frameOffsets[index];
+			return true;
+		}
+	};
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+	struct FormatContextDeleter {
+		void operator()(AVFormatContext* format) const { avformat_close_input(&format); }
+	};
+	struct IoContextDeleter {
+		void operator()(AVIOContext* io) const {
+			// The demuxer may have replaced the buffer it was given
+			av_freep(&io->buffer);
+			avio_context_free(&io);
+		}
+	};
+	struct CodecContextDeleter {
+		void operator()(AVCodecContext* context) const { avcodec_free_context(&context); }
+	};
+	struct PacketDeleter {
+		void operator()(AVPacket* packet) const { av_packet_free(&packet); }
+	};
+	struct PictureDeleter {
+		void operator()(AVFrame* picture) const { av_frame_free(&picture); }
+	};
+
+	// Any container and codec libavformat/libavcodec know, read through MediaInput so that
+	// uploaded files need no temporary copy on disk
+	class LibavformatSource : public VideoSource {
+	public:
+		explicit LibavformatSource(std::shared_ptr<MediaInput> input) : input(std::move(input)), buffers(FrameBufferPool::Options{ kVideoFramePoolBytes }) {}
+
+		bool Open(std::string& error) {
+			constexpr int kIoBufferSize = 64 * 1024;
+			auto* ioBuffer = static_cast<unsigned char*>(av_malloc(kIoBufferSize));
+			if (!ioBuffer) {
+				error = "Out of memory";
+				return false;
+			}
+			io.reset(avio_alloc_context(ioBuffer, kIoBufferSize, 0, this, &LibavformatSource::ReadInput,
+				nullptr, &LibavformatSource::SeekInput));
+			if (!io) {
+				av_free(ioBuffer);
+				error = "Out of memory";
+				return false;
+			}
+
+			AVFormatContext* opened = avformat_alloc_context();
+			if (!opened) {
+				error = "Out of memory";
+				return false;
+			}
+			opened->pb = io.get();
+			opened->flags |= AVFMT_FLAG_CUSTOM_IO;
+			// Frees the context itself on failure
+			if (avformat_open_input(&opened, nullptr, nullptr, nullptr) < 0) {
+				error = "Unsupported media format";
+				return false;
+			}
+			format.reset(opened);
+			if (avformat_find_stream_info(format.get(), nullptr) < 0) {
+				error = "Unsupported media format";
+				return false;
+			}
+
+			const AVCodec* decoder = nullptr;
+			streamIndex = av_find_best_stream(format.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+			if (streamIndex < 0 || !decoder) {
+				error = "No decodable video stream";
+				return false;
+			}
+			for (unsigned int i = 0; i < format->nb_streams; ++i) {
+				if (static_cast<int>(i) != streamIndex) {
+					format->streams[i]->discard = AVDISCARD_ALL;
+				}
+			}
+			const AVStream* stream = format->streams[streamIndex];
+			timeBase = stream->time_base;
+			startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+			context.reset(avcodec_alloc_context3(decoder));
+			packet.reset(av_packet_alloc());
+			picture.reset(av_frame_alloc());
+			if (!context || !packet || !picture
+				|| avcodec_parameters_to_context(context.get(), stream->codecpar) < 0) {
+				error = "Out of memory";
+				return false;
+			}
+			// Playback decodes ahead of the clock, so frame threading's extra latency costs nothing
+			context->thread_count = 0;
+			if (avcodec_open2(context.get(), decoder, nullptr) < 0) {
+				error = "Unsupported video codec";
+				return false;
+			}
+			return true;
+		}
+
+		int64_t DurationUs() const override {
+			return format->duration != AV_NOPTS_VALUE ? format->duration : 0;
+		}
+
+		Status Read(Frame& frame) override {
+			while (true) {
+				int result = avcodec_receive_frame(context.get(), picture.get());
+				if (result == 0) {
+					int64_t timestamp = picture->best_effort_timestamp;
+					VideoDecoder::Status status = CopyDecodedPicture(*picture, buffers, frame.picture);
+					av_frame_unref(picture.get());
+					if (status == VideoDecoder::Status::Corrupt) {
+						return Status::Corrupt;
+					}
+					if (status == VideoDecoder::Status::UnsupportedFormat) {
+						return Status::UnsupportedFormat;
+					}
+					if (timestamp != AV_NOPTS_VALUE) {
+						lastTimestampUs = av_rescale_q(timestamp - startTime, timeBase, AV_TIME_BASE_Q);
+					}
+					frame.timestampUs = lastTimestampUs;
+					return Status::Ok;
+				}
+				if (result == AVERROR_EOF) {
+					return Status::End;
+				}
+				if (result != AVERROR(EAGAIN)) {
+					return Status::Corrupt;
+				}
+
+				if (av_read_frame(format.get(), packet.get()) < 0) {
+					// End of the file (or an unreadable tail): drain the pictures held for reordering
+					result = avcodec_send_packet(context.get(), nullptr);
+					if (result < 0) {
+						return Status::End;
+					}
+					continue;
+				}
+				result = 0;
+				if (packet->stream_index == streamIndex) {
+					result = avcodec_send_packet(context.get(), packet.get());
+				}
+				av_packet_unref(packet.get());
+				if (result < 0) {
+					return Status::Corrupt;
+				}
+			}
+		}
+
+		bool Seek(int64_t timestampUs) override {
+			int64_t target = av_rescale_q(timestampUs, AV_TIME_BASE_Q, timeBase) + startTime;
+			if (av_seek_frame(format.get(), streamIndex, target, AVSEEK_FLAG_BACKWARD) < 0) {
+				return false;
+			}
+			// Also leaves the draining state after the end was reached
+			avcodec_flush_buffers(context.get());
+			return true;
+		}
+
+	private:
+		std::shared_ptr<MediaInput> input;
+		uint64_t position = 0;
+		FrameBufferPool buffers;
+		// Declared before the format context, which still uses it while closing
+		std::unique_ptr<AVIOContext, IoContextDeleter> io;
+		std::unique_ptr<AVFormatContext, FormatContextDeleter> format;
+		std::unique_ptr<AVCodecContext, CodecContextDeleter> context;
+		std::unique_ptr<AVPacket, PacketDeleter> packet;
+		std::unique_ptr<AVFrame, PictureDeleter> picture;
+		int streamIndex = -1;
+		AVRational timeBase{ 1, AV_TIME_BASE };
+		int64_t startTime = 0;
+		int64_t lastTimestampUs = 0;
+
+		static int ReadInput(void* opaque, uint8_t* buffer, int size) {
+			auto* source = static_cast<LibavformatSource*>(opaque);
+			size_t count = source->input->ReadAt(source->position, buffer, static_cast<size_t>(size));
+			if (count == 0) {
+				return AVERROR_EOF;
+			}
+			source->position += count;
+			return static_cast<int>(count);
+		}
+
+		static int64_t SeekInput(void* opaque, int64_t offset, int whence) {
+			auto* source = static_cast<LibavformatSource*>(opaque);
+			int64_t size = static_cast<int64_t>(source->input->Size());
+			int64_t target = 0;
+			switch (whence & ~AVSEEK_FORCE) {
+			case AVSEEK_SIZE:
+				return size;
+			case SEEK_SET:
+				target = offset;
+				break;
+			case SEEK_CUR:
+				target = static_cast<int64_t>(source->position) + offset;
+				break;
+			case SEEK_END:
+				target = size + offset;
+				break;
+			default:
+				return AVERROR(EINVAL);
+			}
+			if (target < 0) {
+				return AVERROR(EINVAL);
+			}
+			source->position = static_cast<uint64_t>(target);
+			return target;
+		}
+	};
+#endif
+}
+
+std::shared_ptr<MediaInput> CreateMemoryInput(std::shared_ptr<const std::vector<uint8_t>> data) {
+	return std::make_shared<MemoryInput>(std::move(data));
+}
+
+std::shared_ptr<MediaInput> OpenFileInput(const std::string& path, std::string& error) {
+	std::filesystem::path file = std::filesystem::u8path(path);
+	std::error_code code;
+	uint64_t size = std::filesystem::file_size(file, code);
+	if (code) {
+		error = "Cannot open media file: " + code.message();
+		return nullptr;
+	}
+	std::ifstream stream(file, std::ios::binary);
+	if (!stream) {
+		error = "Cannot open media file";
+		return nullptr;
+	}
+	return std::make_shared<FileInput>(std::move(stream), size);
+}
+
+std::unique_ptr<VideoSource> OpenVideoSource(std::shared_ptr<MediaInput> input, std::string& error) {
+	char signature[kY4mSignatureSize];
+	if (input->ReadAt(0, signature, sizeof(signature)) == sizeof(signature)
+		&& std::memcmp(signature, kY4mSignature, sizeof(signature)) == 0) {
+		auto source = std::make_unique<Y4mSource>(std::move(input));
+		if (!source->Open(error)) {
+			return nullptr;
+		}
+		return source;
+	}
+
+#ifdef WINDOWCASTER_WITH_LIBAVCODEC
+	auto source = std::make_unique<LibavformatSource>(std::move(input));
+	if (!source->Open(error)) {
+		return nullptr;
+	}
+	return source;
+#else
+	error = "Unsupported media format";
+	return nullptr;
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "video_decoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ýļֽԴϴڴеļ˿ԶȡĴļ
+// ͬһʵͬһʱֻһ߳϶ȡڴԴֻɱŹ
+class MediaInput {
+public:
+	virtual ~MediaInput() = default;
+
+	virtual uint64_t Size() const = 0;
+
+	// ȡ offset ʼ size ֽڣضֽ (ԽĩβĲֲ)
+	virtual size_t ReadAt(uint64_t offset, void* buffer, size_t size) = 0;
+
+	// ļڴʱʼַΪ nullptr
+	virtual const uint8_t* Data() const { return nullptr; }
+};
+
+// ڴеļ֡ݿֱö
+std::shared_ptr<MediaInput> CreateMemoryInput(std::shared_ptr<const std::vector<uint8_t>> data);
+
+// ϵļ·Ϊ UTF-8򲻿ʱ nullptr ԭ
+std::shared_ptr<MediaInput> OpenFileInput(const std::string& path, std::string& error);
+
+// ɲŵƵʾ˳֡ʾʱ
+// ͬһʵͬһʱֻһ߳ʹ
+class VideoSource {
+public:
+	enum class Status {
+		Ok,
+		End,                 // Ѷ
+		Corrupt,             // 𻵣Լ֮֡
+		UnsupportedFormat,   // ظʽ޷
+	};
+
+	struct Frame {
+		DecodedFrame picture;
+		int64_t timestampUs = 0;   // ļͷʾʱ
+	};
+
+	virtual ~VideoSource() = default;
+
+	// ʱδ֪ʱΪ 0
+	virtual int64_t DurationUs() const = 0;
+
+	// һ֡
+	virtual Status Read(Frame& frame) = 0;
+
+	// ת֮֡Ӳ timestampUs һؼ֡ʼԽĩβʱͣ
+	virtual bool Seek(int64_t timestampUs) = 0;
+};
+
+// ʶYUV4MPEG2 (.y4mδѹ I420) ֧֣
+// ʽ (MP4/MKV е H.264HEVC ) Ҫʱ WINDOWCASTER_WITH_LIBAVCODEC
+std::unique_ptr<VideoSource> OpenVideoSource(std::shared_ptr<MediaInput> input, std::string& error);
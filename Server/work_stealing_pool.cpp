@@ -0,0 +1,225 @@
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cctype>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	size_t LogicalCores() {
+		unsigned int cores = std::thread::hardware_concurrency();
+		return cores > 0 ? cores : 1;
+	}
+
+	void PinCurrentThread(size_t core) {
+#ifdef _WIN32
+		if (core < sizeof(DWORD_PTR) * 8) {
+			SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+		}
+#else
+		if (core < CPU_SETSIZE) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+#endif
+	}
+}
+
+WorkStealingPool::WorkStealingPool(const Options& options)
+	: queued(0)
+	, nextQueue(0)
+	, stopping(false)
+	, jobs(0)
+	, inlineJobs(0)
+	, tasks(0)
+	, stolen(0) {
+	size_t cores = LogicalCores();
+	size_t count = (options.threads > 0 ? options.threads : cores) - 1;
+	for (size_t i = 0; i < count; ++i) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+	// Every queue exists before the first worker starts stealing from them
+	for (size_t i = 0; i < count; ++i) {
+		workers.emplace_back(&WorkStealingPool::Worker, this, i, (options.firstCore + i) % cores, options.pinWorkers);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	sleepCondition.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+size_t WorkStealingPool::TaskCount(size_t count, size_t minGrain) const {
+	if (count == 0) {
+		return 0;
+	}
+	size_t bySize = count / std::max<size_t>(minGrain, 1);
+	return std::max<size_t>(1, std::min(bySize, Concurrency() * kTasksPerThread));
+}
+
+void WorkStealingPool::ParallelFor(size_t count, size_t minGrain, const RangeTask& body) {
+	size_t taskCount = TaskCount(count, minGrain);
+	if (taskCount == 0) {
+		return;
+	}
+	if (taskCount == 1 || workers.empty()) {
+		inlineJobs++;
+		body(0, 0, count);
+		return;
+	}
+
+	Job job;
+	job.body = &body;
+	job.count = count;
+	job.tasks = taskCount;
+	job.remaining = taskCount;
+
+	// Each queue gets a contiguous run of strips, so a worker that keeps to its own queue walks
+	// down the frame; successive jobs start at different queues to spread several windows out
+	size_t queueCount = queues.size();
+	size_t first = nextQueue.fetch_add(1, std::memory_order_relaxed);
+	for (size_t q = 0; q < queueCount; ++q) {
+		size_t begin = q * taskCount / queueCount;
+		size_t end = (q + 1) * taskCount / queueCount;
+		Queue& queue = *queues[(first + q) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (size_t index = begin; index < end; ++index) {
+			queue.tasks.push_back(Task{ &job, index });
+		}
+		// Counted under the queue's lock, before anyone can take them
+		queued.fetch_add(end - begin, std::memory_order_acq_rel);
+	}
+	jobs++;
+	{
+		// Pairs with the check under the lock in Worker, so no worker misses the tasks and sleeps
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	sleepCondition.notify_all();
+
+	// The caller works too, on whatever is queued, until its own strips are done
+	Task task;
+	while (job.remaining.load(std::memory_order_acquire) > 0) {
+		if (TakeTask(queueCount, first, task)) {
+			RunTask(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(job.mutex);
+		job.done.wait(lock, [&job] { return job.remaining.load(std::memory_order_acquire) == 0; });
+	}
+	// The last task may still be notifying; the job lives on this stack until it has let go
+	std::lock_guard<std::mutex> lock(job.mutex);
+}
+
+WorkStealingPool::Stats WorkStealingPool::GetStats() const {
+	Stats stats;
+	stats.workers = workers.size();
+	stats.jobs = jobs.load();
+	stats.inlineJobs = inlineJobs.load();
+	stats.tasks = tasks.load();
+	stats.stolen = stolen.load();
+	return stats;
+}
+
+bool WorkStealingPool::TakeTask(size_t home, size_t start, Task& task) {
+	size_t queueCount = queues.size();
+	if (queued.load(std::memory_order_acquire) == 0) {
+		return false;
+	}
+	for (size_t i = 0; i < queueCount; ++i) {
+		size_t index = (start + i) % queueCount;
+		Queue& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) {
+			continue;
+		}
+		if (index == home) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		else {
+			// Thieves take from the far end, away from where the owner is working
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			stolen++;
+		}
+		queued.fetch_sub(1, std::memory_order_acq_rel);
+		return true;
+	}
+	return false;
+}
+
+void WorkStealingPool::RunTask(const Task& task) {
+	Job& job = *task.job;
+	size_t begin = task.index * job.count / job.tasks;
+	size_t end = (task.index + 1) * job.count / job.tasks;
+	(*job.body)(task.index, begin, end);
+	tasks++;
+	// Counted down under the lock, so the submitter cannot see the job finish and free it
+	// while the last task is still notifying
+	std::lock_guard<std::mutex> lock(job.mutex);
+	if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		job.done.notify_all();
+	}
+}
+
+void WorkStealingPool::Worker(size_t index, size_t core, bool pin) {
+	if (pin) {
+		PinCurrentThread(core);
+	}
+	Task task;
+	while (true) {
+		if (TakeTask(index, index, task)) {
+			RunTask(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+bool ParsePoolOptions(const std::string& text, WorkStealingPool::Options& options) {
+	WorkStealingPool::Options parsed = options;
+	size_t begin = 0;
+	while (begin <= text.size()) {
+		size_t end = text.find(',', begin);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string word = text.substr(begin, end - begin);
+		std::transform(word.begin(), word.end(), word.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		if (word == "auto") {
+			parsed.threads = 0;
+		}
+		else if (word == "pin") {
+			parsed.pinWorkers = true;
+		}
+		else if (!word.empty() && word.size() <= 4
+			&& std::all_of(word.begin(), word.end(), [](unsigned char c) { return std::isdigit(c) != 0; })) {
+			parsed.threads = static_cast<size_t>(std::stoul(word));
+		}
+		else {
+			return false;
+		}
+		begin = end + 1;
+	}
+	options = parsed;
+	return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// дڹõĹ̳߳أһ֡תͼȽϲִ
+// ÿ߳ԼУӶװ˳ȡԼ񣬿ʱеĶβȡ
+// ύ߳ (ڵĳ߳) ڵȴڼҲִжеͬʱ߳
+// ߳ύĳ߳ٶҲ߳
+// ̰߳ȫڶ߳ͬʱύ
+class WorkStealingPool {
+public:
+	// ÿ߳ƽֵԶ 1 Աȡʱƽĺʱ
+	static constexpr size_t kTasksPerThread = 4;
+
+	struct Options {
+		size_t threads = 0;       // ߳ύ̣߳0 ʾ CPU ߼
+		bool pinWorkers = false;  // ѵ i ̶̹߳ڵ (firstCore + i) ߼
+		size_t firstCore = 0;
+	};
+
+	struct Stats {
+		size_t workers = 0;
+		uint64_t jobs = 0;          // ֲִеĵ
+		uint64_t inlineJobs = 0;    // ̫Сֱڵִ߳еĵ
+		uint64_t tasks = 0;
+		uint64_t stolen = 0;        // ڶеִ߳е
+	};
+
+	// һ [begin, end)task Ϊ (0  TaskCount() - 1)ѡԼʱ
+	// ׳쳣
+	using RangeTask = std::function<void(size_t task, size_t begin, size_t end)>;
+
+	explicit WorkStealingPool(const Options& options);
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// ߳ (̼߳ϵ߳)
+	size_t Concurrency() const { return workers.size() + 1; }
+
+	// [0, count) ɵĶÿ minGrain  Concurrency() * kTasksPerThread 
+	size_t TaskCount(size_t count, size_t minGrain) const;
+
+	//  [0, count)  TaskCount() Ķβִ bodyȫɺ󷵻
+	// ֻһλûй߳ʱֱڵִ߳Уbody пٴε
+	void ParallelFor(size_t count, size_t minGrain, const RangeTask& body);
+
+	Stats GetStats() const;
+
+private:
+	struct Job {
+		const RangeTask* body = nullptr;
+		size_t count = 0;
+		size_t tasks = 0;
+		std::atomic<size_t> remaining{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+
+	struct Task {
+		Job* job = nullptr;
+		size_t index = 0;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;   // ÿ߳һ
+	std::vector<std::thread> workers;
+	std::atomic<size_t> queued;                    // δȡߵ
+	std::atomic<size_t> nextQueue;                 // ύӲͬĶпʼ
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	bool stopping;
+
+	std::atomic<uint64_t> jobs;
+	std::atomic<uint64_t> inlineJobs;
+	std::atomic<uint64_t> tasks;
+	std::atomic<uint64_t> stolen;
+
+	// ȡһ񣺴 start ʼβ鿴Уhome дӶȡдӶβȡ
+	// ̲߳ǹ߳ʱ home Ϊ queues.size()
+	bool TakeTask(size_t home, size_t start, Task& task);
+	void RunTask(const Task& task);
+	void Worker(size_t index, size_t core, bool pin);
+};
+
+//  "8"  "8,pin" ߳ (߳"auto" ʾ"1" ʾʹù߳)
+bool ParsePoolOptions(const std::string& text, WorkStealingPool::Options& options);
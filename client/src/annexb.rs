@@ -0,0 +1,107 @@
+use anyhow::{Context, Result};
+use std::borrow::Cow;
+
+const START_CODE: [u8; 4] = [0, 0, 0, 1];
+
+/// Rewrites H.264/HEVC packets as the Annex-B byte stream the server decodes.
+/// MP4 and MKV store NAL units behind a length prefix and keep the parameter sets in the
+/// stream's extradata (avcC/hvcC); raw .h264 files and MPEG-TS already use start codes.
+pub struct AnnexBWriter {
+    /// Bytes of the NAL unit length prefix, 0 when packets already use start codes.
+    length_size: usize,
+    /// Parameter sets in Annex-B form, sent ahead of every keyframe so decoding can start there.
+    parameter_sets: Vec<u8>,
+}
+
+impl AnnexBWriter {
+    pub fn new(hevc: bool, extradata: &[u8]) -> Result<Self> {
+        // avcC and hvcC both start with configurationVersion 1; anything else is Annex-B already
+        if extradata.first() != Some(&1) {
+            return Ok(Self { length_size: 0, parameter_sets: extradata.to_vec() });
+        }
+
+        let mut reader = Reader { data: extradata, pos: 0 };
+        let mut parameter_sets = Vec::new();
+        let length_size;
+        if hevc {
+            reader.skip(21)?;
+            length_size = (reader.u8()? & 3) as usize + 1;
+            let arrays = reader.u8()?;
+            for _ in 0..arrays {
+                reader.skip(1)?;
+                let units = reader.u16()?;
+                for _ in 0..units {
+                    let size = reader.u16()? as usize;
+                    Self::push_unit(&mut parameter_sets, reader.bytes(size)?);
+                }
+            }
+        } else {
+            reader.skip(4)?;
+            length_size = (reader.u8()? & 3) as usize + 1;
+            // Sequence parameter sets, then picture parameter sets
+            for mask in [0x1f, 0xff] {
+                let units = reader.u8()? & mask;
+                for _ in 0..units {
+                    let size = reader.u16()? as usize;
+                    Self::push_unit(&mut parameter_sets, reader.bytes(size)?);
+                }
+            }
+        }
+        Ok(Self { length_size, parameter_sets })
+    }
+
+    pub fn convert<'a>(&self, packet: &'a [u8], keyframe: bool) -> Result<Cow<'a, [u8]>> {
+        if self.length_size == 0 && (!keyframe || self.parameter_sets.is_empty()) {
+            return Ok(Cow::Borrowed(packet));
+        }
+
+        let mut stream = Vec::with_capacity(packet.len() + self.parameter_sets.len() + 16);
+        if keyframe {
+            stream.extend_from_slice(&self.parameter_sets);
+        }
+        if self.length_size == 0 {
+            stream.extend_from_slice(packet);
+            return Ok(Cow::Owned(stream));
+        }
+
+        let mut reader = Reader { data: packet, pos: 0 };
+        while reader.pos < packet.len() {
+            let size = reader.bytes(self.length_size)?
+                .iter()
+                .fold(0usize, |size, byte| (size << 8) | *byte as usize);
+            Self::push_unit(&mut stream, reader.bytes(size)?);
+        }
+        Ok(Cow::Owned(stream))
+    }
+
+    fn push_unit(stream: &mut Vec<u8>, unit: &[u8]) {
+        stream.extend_from_slice(&START_CODE);
+        stream.extend_from_slice(unit);
+    }
+}
+
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, size: usize) -> Result<&'a [u8]> {
+        let bytes = self.data.get(self.pos..self.pos + size).context("Truncated NAL unit")?;
+        self.pos += size;
+        Ok(bytes)
+    }
+
+    fn skip(&mut self, size: usize) -> Result<()> {
+        self.bytes(size).map(|_| ())
+    }
+
+    fn u8(&mut self) -> Result<u8> {
+        Ok(self.bytes(1)?[0])
+    }
+
+    fn u16(&mut self) -> Result<u16> {
+        let bytes = self.bytes(2)?;
+        Ok(u16::from_be_bytes([bytes[0], bytes[1]]))
+    }
+}
@@ -1,5 +1,6 @@
 use clap::{Parser, Subcommand};
 use std::path::PathBuf;
+use crate::compression::Compression;
 
 #[derive(Parser)]
 #[command(
@@ -91,5 +92,89 @@ pub enum Commands {
             help = "The file path of the video to render. Supported formats include MP4, AVI, etc."
         )]
         file: PathBuf,
+
+        /// Wait for a reply to every frame instead of streaming.
+        #[arg(
+            long,
+            help = "Disable streaming mode and wait for the server to reply to every frame before sending the next one."
+        )]
+        no_stream: bool,
+
+        /// Send RGB24 frames instead of I420.
+        #[arg(
+            long,
+            help = "Send frames as RGB24 instead of I420 (twice the bandwidth, for servers without YUV support)."
+        )]
+        rgb: bool,
+
+        /// Send H.264/HEVC packets undecoded and let the server decode them.
+        #[arg(
+            long,
+            help = "Send H.264 or HEVC video without decoding it; the server decodes it (a fraction of the bandwidth of raw frames)."
+        )]
+        encoded: bool,
+
+        /// Send only the parts of each frame that changed.
+        #[arg(
+            long,
+            help = "Send only the tiles that changed since the previous frame, as RGB24 (for screen recordings and other mostly static content)."
+        )]
+        dirty_rects: bool,
+
+        /// Send frames losslessly screen-encoded.
+        #[arg(
+            long,
+            help = "Send frames (and with --dirty-rects, the changed tiles) in the lossless screen-content format: palette and run-length coded, many times smaller than RGB24 for UI and text. Needs a server that supports it."
+        )]
+        screen_codec: bool,
+
+        /// Compress frames on the way to the server.
+        #[arg(
+            long,
+            value_enum,
+            help = "Compress raw frames in streaming mode: lz4 for fast links, zstd for constrained ones. H.264/HEVC packets are never compressed again."
+        )]
+        compress: Option<Compression>,
+    },
+    /// Let the server play a video file on its own.
+    #[command(about = "Has the server play a video onto a specified window by itself: the file is uploaded once (or read from the server's media directory) and the server decodes it and paces it by its timestamps, with no per-frame network traffic. Playback is then controlled from standard input.")]
+    Play {
+        /// Target window handle (in hexadecimal format).
+        #[arg(
+            short = 'w',
+            long,
+            help = "The window handle where the video will be played. Use hexadecimal format (e.g., 0x12345678)."
+        )]
+        hwnd: String,
+
+        /// Video file path.
+        #[arg(
+            short,
+            long,
+            help = "The video file to play. The server reads Y4M by itself and MP4, MKV, etc. when built with FFmpeg."
+        )]
+        file: PathBuf,
+
+        /// The file is a path on the server.
+        #[arg(
+            long,
+            help = "Treat the file as a path relative to the server's media directory instead of uploading a local file."
+        )]
+        on_server: bool,
+
+        /// Start over at the end.
+        #[arg(
+            long = "loop",
+            help = "Start over from the beginning when the video ends."
+        )]
+        looped: bool,
+
+        /// Start position in seconds.
+        #[arg(
+            long,
+            default_value = "0",
+            help = "Position to start playing at, in seconds."
+        )]
+        start: f64,
     },
 }
@@ -0,0 +1,43 @@
+use crate::proto::windowcaster;
+
+/// zstd level for frames: fast enough to keep up with video, and low levels already get
+/// most of the gain on screen content.
+const ZSTD_LEVEL: i32 = 1;
+
+/// Transport compression for frame data (see Server/transport_compression.h). It is agreed on
+/// when the stream opens; after that every message is compressed only if that makes it smaller.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, clap::ValueEnum)]
+pub enum Compression {
+    /// LZ4: cheapest to decompress, for fast links.
+    Lz4,
+    /// zstd at a low level: smaller messages for constrained links.
+    Zstd,
+}
+
+impl Compression {
+    /// Value of the compression field in the message and raw frame headers.
+    pub fn wire_id(self) -> u8 {
+        match self {
+            Compression::Lz4 => 1,
+            Compression::Zstd => 2,
+        }
+    }
+
+    pub fn to_proto(self) -> windowcaster::Compression {
+        match self {
+            Compression::Lz4 => windowcaster::Compression::COMPRESSION_LZ4,
+            Compression::Zstd => windowcaster::Compression::COMPRESSION_ZSTD,
+        }
+    }
+
+    /// The compressed data, or None when compressing does not make it smaller.
+    pub fn compress(self, data: &[u8]) -> Option<Vec<u8>> {
+        // The header records the decompressed size in 32 bits
+        u32::try_from(data.len()).ok()?;
+        let compressed = match self {
+            Compression::Lz4 => lz4_flex::block::compress(data),
+            Compression::Zstd => zstd::bulk::compress(data, ZSTD_LEVEL).ok()?,
+        };
+        (compressed.len() < data.len()).then_some(compressed)
+    }
+}
@@ -0,0 +1,116 @@
+/// Edge of the square tiles frames are compared in.
+const TILE_SIZE: usize = 64;
+/// Frames between full frames. The server drops its copy of the picture when the window is
+/// resized, and a full frame now and then brings it back.
+const REFRESH_INTERVAL: u32 = 60;
+
+/// A changed part of a frame as tightly packed RGB24.
+pub struct Region {
+    pub x: u32,
+    pub y: u32,
+    pub width: u32,
+    pub height: u32,
+    pub data: Vec<u8>,
+}
+
+/// Finds the tiles of RGB24 frames that changed since the previous frame, so that only those
+/// are sent as a region update. Mostly static content (screen recordings, UI) shrinks to a
+/// few kilobytes per frame.
+pub struct DirtyTracker {
+    width: usize,
+    height: usize,
+    /// The picture the server has, tightly packed; empty until the first full frame.
+    previous: Vec<u8>,
+    frames_since_full: u32,
+}
+
+impl DirtyTracker {
+    pub fn new(width: u32, height: u32) -> Self {
+        Self {
+            width: width as usize,
+            height: height as usize,
+            previous: Vec::new(),
+            frames_since_full: 0,
+        }
+    }
+
+    /// The regions that changed, or None when the whole frame should be sent instead:
+    /// the first frame, a periodic refresh, or when most of the frame changed.
+    pub fn update(&mut self, data: &[u8], stride: usize) -> Option<Vec<Region>> {
+        let row_bytes = self.width * 3;
+        let tiles_across = (self.width + TILE_SIZE - 1) / TILE_SIZE;
+        let tiles_down = (self.height + TILE_SIZE - 1) / TILE_SIZE;
+
+        self.frames_since_full += 1;
+        if self.previous.is_empty() || self.frames_since_full >= REFRESH_INTERVAL {
+            self.store_full(data, stride);
+            return None;
+        }
+
+        let mut dirty = vec![false; tiles_across * tiles_down];
+        let mut dirty_area = 0;
+        for tile_y in 0..tiles_down {
+            let top = tile_y * TILE_SIZE;
+            let bottom = (top + TILE_SIZE).min(self.height);
+            for tile_x in 0..tiles_across {
+                let left = tile_x * TILE_SIZE * 3;
+                let right = ((tile_x + 1) * TILE_SIZE * 3).min(row_bytes);
+                let changed = (top..bottom).any(|y| {
+                    data[y * stride + left..y * stride + right] != self.previous[y * row_bytes + left..y * row_bytes + right]
+                });
+                if changed {
+                    dirty[tile_y * tiles_across + tile_x] = true;
+                    dirty_area += (right - left) / 3 * (bottom - top);
+                }
+            }
+        }
+
+        if dirty_area * 2 >= self.width * self.height {
+            self.store_full(data, stride);
+            return None;
+        }
+
+        // Runs of changed tiles in a row of tiles become one region
+        let mut regions = Vec::new();
+        for tile_y in 0..tiles_down {
+            let top = tile_y * TILE_SIZE;
+            let bottom = (top + TILE_SIZE).min(self.height);
+            let mut tile_x = 0;
+            while tile_x < tiles_across {
+                if !dirty[tile_y * tiles_across + tile_x] {
+                    tile_x += 1;
+                    continue;
+                }
+                let first = tile_x;
+                while tile_x < tiles_across && dirty[tile_y * tiles_across + tile_x] {
+                    tile_x += 1;
+                }
+                let left = first * TILE_SIZE * 3;
+                let right = (tile_x * TILE_SIZE * 3).min(row_bytes);
+                let mut pixels = Vec::with_capacity((right - left) * (bottom - top));
+                for y in top..bottom {
+                    let row = &data[y * stride + left..y * stride + right];
+                    pixels.extend_from_slice(row);
+                    self.previous[y * row_bytes + left..y * row_bytes + right].copy_from_slice(row);
+                }
+                regions.push(Region {
+                    x: (left / 3) as u32,
+                    y: top as u32,
+                    width: ((right - left) / 3) as u32,
+                    height: (bottom - top) as u32,
+                    data: pixels,
+                });
+            }
+        }
+        Some(regions)
+    }
+
+    fn store_full(&mut self, data: &[u8], stride: usize) {
+        let row_bytes = self.width * 3;
+        self.previous.resize(row_bytes * self.height, 0);
+        for y in 0..self.height {
+            self.previous[y * row_bytes..(y + 1) * row_bytes].copy_from_slice(&data[y * stride..y * stride + row_bytes]);
+        }
+        self.frames_since_full = 0;
+    }
+}
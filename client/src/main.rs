@@ -1,15 +1,21 @@
-use anyhow::Result;
+use anyhow::{Context, Result};
 use clap::Parser;
 use tracing::{info, error};
 
+mod annexb;
 mod cli;
+mod compression;
+mod dirty;
 mod network;
+mod playback;
 mod window;
 mod proto;
+mod screen;
 mod video;
 
 use cli::{Cli, Commands};
 use network::NetworkClient;
+use playback::PlaybackClient;
 use window::WindowManager;
 use proto::Protocol;
 use video::VideoRenderer;
@@ -64,11 +70,38 @@ async fn main() -> Result<()> {
             let hwnd = u64::from_str_radix(hwnd_str, 16)?;
             
             info!("Rendering image {} to window 0x{:X}", file.display(), hwnd);
-            let request = Protocol::create_image_render_request(hwnd, &file)?;
-            client.send_message(&request).await?;
+            let file = std::fs::read(&file).context("Failed to open image")?;
+            let image = Protocol::create_image(&file, false)?;
+            let asset_id = Protocol::asset_id(&image);
 
+            // An image shown before is still in the server's cache and needs no upload
+            let request = Protocol::create_cached_image_request(hwnd, asset_id)?;
+            client.send_message(&request).await?;
             let response = client.receive_message().await?;
-            let server_response = Protocol::parse_server_response(&response)?;
+            let mut server_response = Protocol::parse_server_response(&response)?;
+
+            // Older servers do not know cached images at all
+            if server_response.status.as_ref().map_or(false, |status| {
+                !status.success && (status.message == b"Asset not cached" || status.message == b"Unknown render content type")
+            }) {
+                let request = Protocol::create_image_render_request(hwnd, image)?;
+                client.send_message(&request).await?;
+                let response = client.receive_message().await?;
+                server_response = Protocol::parse_server_response(&response)?;
+            } else if server_response.status.as_ref().map_or(false, |status| status.success) {
+                info!("Image shown from the server's cache");
+            }
+
+            // Older servers only take raw pixels
+            if server_response.status.as_ref().map_or(false, |status| {
+                !status.success && status.message == b"Unsupported pixel format"
+            }) {
+                info!("Server cannot decode the image, sending its pixels instead");
+                let request = Protocol::create_image_render_request(hwnd, Protocol::create_image(&file, true)?)?;
+                client.send_message(&request).await?;
+                let response = client.receive_message().await?;
+                server_response = Protocol::parse_server_response(&response)?;
+            }
 
             if let Some(status) = server_response.status.as_ref() {
                 if status.success {
@@ -81,13 +114,14 @@ async fn main() -> Result<()> {
             }
         }
 
-        Commands::Video { hwnd, file } => {
+        Commands::Video { hwnd, file, no_stream, rgb, encoded, dirty_rects, screen_codec, compress } => {
             let hwnd_str = hwnd.trim_start_matches("0x");
             let hwnd = u64::from_str_radix(hwnd_str, 16)?;
             info!("Rendering video {} to window 0x{:X}", file.display(), hwnd);
             
             // Create video renderer
-            let mut renderer = VideoRenderer::new(client, hwnd);
+            let mut renderer = VideoRenderer::new(
+                client, hwnd, !no_stream, rgb, encoded, dirty_rects, screen_codec, compress);
             
             // Start video rendering
             if let Err(e) = renderer.render_video(&file).await {
@@ -97,6 +131,19 @@ async fn main() -> Result<()> {
             
             info!("Video rendering completed");
         }
+
+        Commands::Play { hwnd, file, on_server, looped, start } => {
+            let hwnd_str = hwnd.trim_start_matches("0x");
+            let hwnd = u64::from_str_radix(hwnd_str, 16)?;
+            info!("Playing video {} on window 0x{:X} on the server", file.display(), hwnd);
+
+            let mut playback = PlaybackClient::new(client, hwnd);
+            if let Err(e) = playback.play(&file, on_server, looped, (start.max(0.0) * 1000.0) as u64).await {
+                error!("Playback failed: {}", e);
+                return Err(e);
+            }
+            playback.control().await?;
+        }
     }
 
     Ok(())
@@ -1,8 +1,10 @@
 use anyhow::{Context, Result};
 use std::net::SocketAddr;
 use tokio::net::TcpStream;
-use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::tcp::{OwnedReadHalf, OwnedWriteHalf};
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt};
 use tracing::{debug, error, info};
+use crate::compression::Compression;
 use tokio::time::{timeout, Duration};
 pub struct NetworkClient {
     stream: Option<TcpStream>,
@@ -37,14 +39,7 @@ impl NetworkClient {
 
     pub async fn send_message(&mut self, message: &[u8]) -> Result<()> {
         if let Some(stream) = &mut self.stream {
-            // Send message length
-            let len = message.len() as u32;
-            stream.write_all(&len.to_le_bytes()).await?;
-            
-            // Send message content
-            stream.write_all(message).await?;
-            info!("Sent {} bytes", len);
-            Ok(())
+            write_message(stream, message).await
         } else {
             error!("Not connected to server");
             anyhow::bail!("Not connected to server")
@@ -53,18 +48,103 @@ impl NetworkClient {
 
     pub async fn receive_message(&mut self) -> Result<Vec<u8>> {
         if let Some(stream) = &mut self.stream {
-            // Read message length
-            let mut len_bytes = [0u8; 4];
-            stream.read_exact(&mut len_bytes).await?;
-            let len = u32::from_le_bytes(len_bytes) as usize;      
-            // Read message content
-            let mut buffer = vec![0u8; len];
-            stream.read_exact(&mut buffer).await?;
-            debug!("Received {} bytes", len);
-            Ok(buffer)
+            read_message(stream).await
         } else {
             error!("Not connected to server");
             anyhow::bail!("Not connected to server")
         }
     }
+
+    /// Splits the connection so that replies can be read while requests keep being sent.
+    /// The client is no longer usable afterwards.
+    pub fn split(&mut self) -> Result<(MessageReader, MessageWriter)> {
+        let stream = self.stream.take().context("Not connected to server")?;
+        let (reader, writer) = stream.into_split();
+        Ok((MessageReader { stream: reader }, MessageWriter { stream: writer }))
+    }
+}
+
+/// Receiving half of a split connection.
+pub struct MessageReader {
+    stream: OwnedReadHalf,
+}
+
+impl MessageReader {
+    pub async fn receive_message(&mut self) -> Result<Vec<u8>> {
+        read_message(&mut self.stream).await
+    }
+}
+
+/// Sending half of a split connection.
+pub struct MessageWriter {
+    stream: OwnedWriteHalf,
+}
+
+impl MessageWriter {
+    pub async fn send_message(&mut self, message: &[u8]) -> Result<()> {
+        write_message(&mut self.stream, message).await
+    }
+
+    /// Sends a compressed protobuf message: the compression and the decompressed size,
+    /// followed by the compressed bytes. Only for compressions the server accepted.
+    pub async fn send_compressed_message(&mut self, compression: Compression, raw_size: u32, data: &[u8]) -> Result<()> {
+        let size = COMPRESSED_MESSAGE_HEADER_SIZE + data.len();
+        let len = u32::try_from(size).ok()
+            .filter(|len| len & (RAW_FRAME_FLAG | COMPRESSED_MESSAGE_FLAG) == 0)
+            .with_context(|| format!("Compressed message too large: {} bytes", size))?;
+        let mut header = [0u8; 4 + COMPRESSED_MESSAGE_HEADER_SIZE];
+        header[0..4].copy_from_slice(&(len | COMPRESSED_MESSAGE_FLAG).to_le_bytes());
+        header[4] = compression.wire_id();
+        header[5..9].copy_from_slice(&raw_size.to_le_bytes());
+        self.stream.write_all(&header).await?;
+        self.stream.write_all(data).await?;
+        debug!("Sent {} bytes compressed from {}", len, raw_size);
+        Ok(())
+    }
+
+    /// Sends a frame over the raw frame channel: a fixed header followed by the pixels,
+    /// without wrapping them in a protobuf message. The planes are written back to back.
+    pub async fn send_raw_frame(&mut self, header: &[u8], planes: &[&[u8]]) -> Result<()> {
+        let size = header.len() + planes.iter().map(|plane| plane.len()).sum::<usize>();
+        let len = u32::try_from(size).ok()
+            .filter(|len| len & RAW_FRAME_FLAG == 0)
+            .with_context(|| format!("Raw frame too large: {} bytes", size))?;
+        self.stream.write_all(&(len | RAW_FRAME_FLAG).to_le_bytes()).await?;
+        self.stream.write_all(header).await?;
+        for plane in planes {
+            self.stream.write_all(plane).await?;
+        }
+        debug!("Sent raw frame of {} bytes", len);
+        Ok(())
+    }
+}
+
+/// Set in the length prefix to mark a raw frame instead of a protobuf message.
+const RAW_FRAME_FLAG: u32 = 0x8000_0000;
+/// Set in the length prefix of a compressed protobuf message.
+const COMPRESSED_MESSAGE_FLAG: u32 = 0x4000_0000;
+/// Compression (1 byte) and decompressed size (4 bytes) in front of a compressed message.
+const COMPRESSED_MESSAGE_HEADER_SIZE: usize = 5;
+
+async fn write_message<W: AsyncWrite + Unpin>(stream: &mut W, message: &[u8]) -> Result<()> {
+    // Send message length
+    let len = message.len() as u32;
+    stream.write_all(&len.to_le_bytes()).await?;
+
+    // Send message content
+    stream.write_all(message).await?;
+    info!("Sent {} bytes", len);
+    Ok(())
+}
+
+async fn read_message<R: AsyncRead + Unpin>(stream: &mut R) -> Result<Vec<u8>> {
+    // Read message length
+    let mut len_bytes = [0u8; 4];
+    stream.read_exact(&mut len_bytes).await?;
+    let len = u32::from_le_bytes(len_bytes) as usize;
+    // Read message content
+    let mut buffer = vec![0u8; len];
+    stream.read_exact(&mut buffer).await?;
+    debug!("Received {} bytes", len);
+    Ok(buffer)
 }
@@ -0,0 +1,156 @@
+use anyhow::{bail, Context, Result};
+use indicatif::{ProgressBar, ProgressStyle};
+use std::path::Path;
+use tokio::io::{AsyncBufReadExt, BufReader};
+use tracing::{error, info, warn};
+use crate::network::NetworkClient;
+use crate::proto::{windowcaster, Protocol};
+use windowcaster::PlaybackAction;
+
+/// Media files are uploaded in chunks of this size, far below the server's message limit.
+const UPLOAD_CHUNK_SIZE: usize = 4 * 1024 * 1024;
+
+/// Server-side playback: the server reads, decodes and paces the video by itself, so nothing
+/// crosses the network per frame. The client uploads the file once (or names a file in the
+/// server's media directory) and afterwards only sends controls.
+pub struct PlaybackClient {
+    client: NetworkClient,
+    hwnd: u64,
+}
+
+impl PlaybackClient {
+    pub fn new(client: NetworkClient, hwnd: u64) -> Self {
+        Self { client, hwnd }
+    }
+
+    /// Starts playing a local file, uploading it unless the server still holds it from an
+    /// earlier run. With `on_server`, `file` is a path in the server's media directory instead.
+    pub async fn play(&mut self, file: &Path, on_server: bool, looped: bool, start_ms: u64) -> Result<()> {
+        let response = if on_server {
+            let path = file.to_str().context("Media path is not valid UTF-8")?;
+            self.send(PlaybackAction::PLAYBACK_PLAY, 0, path, looped, start_ms).await?
+        } else {
+            let data = std::fs::read(file).context("Failed to open video")?;
+            if data.is_empty() {
+                bail!("Video file is empty");
+            }
+            let media_id = Protocol::media_id(&data);
+            let mut response = self.send(PlaybackAction::PLAYBACK_PLAY, media_id, "", looped, start_ms).await?;
+            if response.status.as_ref().map_or(false, |status| {
+                !status.success && (status.message == b"Media not uploaded" || status.message == b"Media upload incomplete")
+            }) {
+                self.upload(media_id, &data).await?;
+                response = self.send(PlaybackAction::PLAYBACK_PLAY, media_id, "", looped, start_ms).await?;
+            } else {
+                info!("Video is still on the server, no upload needed");
+            }
+            response
+        };
+        Self::check(&response)?;
+        Self::log_state(&response);
+        Ok(())
+    }
+
+    /// Reads controls from standard input until `q` or the end of the input. Playback goes on
+    /// without the client once the input ends.
+    pub async fn control(&mut self) -> Result<()> {
+        println!("Controls: p = pause, r = resume, s <seconds> = seek, i = status, q = stop");
+        let mut lines = BufReader::new(tokio::io::stdin()).lines();
+        while let Some(line) = lines.next_line().await? {
+            let mut words = line.split_whitespace();
+            let (action, position_ms) = match words.next() {
+                Some("p") | Some("pause") => (PlaybackAction::PLAYBACK_PAUSE, 0),
+                Some("r") | Some("resume") => (PlaybackAction::PLAYBACK_RESUME, 0),
+                Some("s") | Some("seek") => match words.next().and_then(|word| word.parse::<f64>().ok()).filter(|seconds| *seconds >= 0.0) {
+                    Some(seconds) => (PlaybackAction::PLAYBACK_SEEK, (seconds * 1000.0) as u64),
+                    None => {
+                        warn!("Usage: s <seconds>");
+                        continue;
+                    }
+                },
+                Some("q") | Some("stop") => (PlaybackAction::PLAYBACK_STOP, 0),
+                None | Some("i") | Some("status") => (PlaybackAction::PLAYBACK_STATUS, 0),
+                Some(other) => {
+                    warn!("Unknown control: {}", other);
+                    continue;
+                }
+            };
+
+            let response = self.send(action, 0, "", false, position_ms).await?;
+            match Self::check(&response) {
+                Ok(()) => Self::log_state(&response),
+                Err(e) => error!("{}", e),
+            }
+            if action == PlaybackAction::PLAYBACK_STOP {
+                return Ok(());
+            }
+        }
+        info!("Playback continues on the server");
+        Ok(())
+    }
+
+    /// Chunks go one at a time; the server answers each, so a rejected upload stops early.
+    async fn upload(&mut self, media_id: u64, data: &[u8]) -> Result<()> {
+        info!("Uploading {} bytes to the server", data.len());
+        let pb = ProgressBar::new(data.len() as u64);
+        pb.set_style(ProgressStyle::default_bar()
+            .template("{spinner:.green} [{elapsed_precise}] [{bar:40.cyan/blue}] {bytes}/{total_bytes} ({eta})")
+            .unwrap()
+            .progress_chars("#>-"));
+
+        for (index, chunk) in data.chunks(UPLOAD_CHUNK_SIZE).enumerate() {
+            let offset = (index * UPLOAD_CHUNK_SIZE) as u64;
+            let request = Protocol::create_media_upload_request(media_id, data.len() as u64, offset, chunk)?;
+            self.client.send_message(&request).await?;
+            let response = Protocol::parse_server_response(&self.client.receive_message().await?)?;
+            if let Err(e) = Self::check(&response) {
+                bail!("Upload failed: {}", e);
+            }
+            pb.inc(chunk.len() as u64);
+        }
+        pb.finish_and_clear();
+        Ok(())
+    }
+
+    async fn send(
+        &mut self,
+        action: PlaybackAction,
+        media_id: u64,
+        path: &str,
+        looped: bool,
+        position_ms: u64,
+    ) -> Result<windowcaster::ServerResponse> {
+        let request = Protocol::create_playback_request(self.hwnd, action, media_id, path, looped, position_ms)?;
+        self.client.send_message(&request).await?;
+        let response = self.client.receive_message().await?;
+        Protocol::parse_server_response(&response)
+    }
+
+    fn check(response: &windowcaster::ServerResponse) -> Result<()> {
+        match response.status.as_ref() {
+            Some(status) if status.success => Ok(()),
+            // Older servers do not know the request at all
+            Some(status) if status.message == b"Unknown request type" => bail!("The server does not support server-side playback"),
+            Some(status) => bail!("{}", String::from_utf8_lossy(&status.message)),
+            None => bail!("Received an unexpected server response (no status)"),
+        }
+    }
+
+    fn log_state(response: &windowcaster::ServerResponse) {
+        let Some(state) = response.playback_state.as_ref() else {
+            return;
+        };
+        let status = if !state.error.is_empty() {
+            format!("Stopped ({})", String::from_utf8_lossy(&state.error))
+        } else if state.finished {
+            "Finished".to_string()
+        } else if state.paused {
+            "Paused".to_string()
+        } else {
+            "Playing".to_string()
+        };
+        info!("{} at {:.1}s of {:.1}s, {} frames presented, {} late",
+            status, state.position_ms as f64 / 1000.0, state.duration_ms as f64 / 1000.0,
+            state.frames_presented, state.frames_late);
+    }
+}
@@ -1,9 +1,38 @@
 use anyhow::{Result, Context};
-use std::path::Path;
-use protobuf::Message;
+use protobuf::{EnumOrUnknown, Message};
+use crate::compression::Compression;
+use crate::dirty::Region;
+use crate::screen;
 
 include!(concat!(env!("OUT_DIR"), "/protos/mod.rs"));
 
+/// Raw frame channel version this client speaks (see Server/raw_frame.h for the layout).
+pub const RAW_FRAME_VERSION: u32 = 2;
+pub const RAW_FRAME_HEADER_SIZE: usize = 64;
+const RAW_FRAME_MAGIC: u32 = 0x4652_4357;
+const RAW_FRAME_FLAG_VIDEO: u16 = 1;
+const RAW_FRAME_FLAG_BT709: u16 = 2;
+const RAW_FRAME_FLAG_FULL_RANGE: u16 = 4;
+/// Bits 3-4 of the flags hold the compression of the payload.
+const RAW_FRAME_COMPRESSION_SHIFT: u16 = 3;
+
+/// Pixel layout and colour space of the video frames sent to the server.
+/// The colour space only matters for YUV formats.
+#[derive(Clone, Copy)]
+pub struct FrameFormat {
+    pub pixel_format: windowcaster::PixelFormat,
+    pub bt709: bool,
+    pub full_range: bool,
+}
+
+/// Where one plane starts in the frame data and the bytes between its rows,
+/// padding included.
+#[derive(Clone, Copy)]
+pub struct Plane {
+    pub offset: u32,
+    pub stride: u32,
+}
+
 pub struct Protocol;
 
 impl Protocol {
@@ -15,19 +44,43 @@ impl Protocol {
         Ok(request.write_to_bytes()?)
     }
 
-    pub fn create_image_render_request(hwnd: u64, file_path: &Path) -> Result<Vec<u8>> {
-        let img = image::open(file_path)
-            .context("Failed to open image")?
-            .to_rgb8();
-    
-        let (width, height) = img.dimensions();
-        let rgb_data = img.into_raw();
-    
+    /// The picture in an image file as it is uploaded. JPEG, PNG and QOI files are sent as they
+    /// are for the server to decode, a fraction of the size of their pixels; other formats are
+    /// decoded here and sent screen-encoded. Both carry an asset id (see `asset_id`) and the server
+    /// keeps the converted picture under it. With `decode_locally` (for servers that only take raw
+    /// pixels) everything goes as RGB24 without an id: raw pixels do not describe their own size
+    /// and format, so the server cannot check an id against them.
+    pub fn create_image(file: &[u8], decode_locally: bool) -> Result<windowcaster::Image> {
         let mut image = windowcaster::Image::new();
-        image.data = rgb_data;
-        image.width = width;
-        image.height = height;
-    
+        match Self::compressed_image_format(file).filter(|_| !decode_locally) {
+            Some(pixel_format) => {
+                // The server reads the size from the file header
+                image.data = file.to_vec();
+                image.pixel_format = EnumOrUnknown::new(pixel_format);
+            }
+            None => {
+                let img = image::load_from_memory(file)
+                    .context("Failed to decode image")?
+                    .to_rgb8();
+
+                let (width, height) = img.dimensions();
+                if decode_locally {
+                    image.data = img.into_raw();
+                } else {
+                    image.data = screen::encode_rgb24(img.as_raw(), width as usize * 3, width as usize, height as usize);
+                    image.pixel_format = EnumOrUnknown::new(windowcaster::PixelFormat::PIXEL_FORMAT_SCREEN);
+                }
+                image.width = width;
+                image.height = height;
+            }
+        }
+        if !decode_locally {
+            image.asset_id = Self::asset_id(&image).to_le_bytes().to_vec();
+        }
+        Ok(image)
+    }
+
+    pub fn create_image_render_request(hwnd: u64, image: windowcaster::Image) -> Result<Vec<u8>> {
         let mut render_command = windowcaster::RenderCommand::new();
         render_command.target_window = hwnd;
         render_command.set_image(image);
@@ -38,20 +91,71 @@ impl Protocol {
         Ok(request.write_to_bytes()?)
     }
 
+    /// Shows an image the server already holds in its asset cache. The server answers
+    /// "Asset not cached" when it does not have it, and the image has to be uploaded.
+    pub fn create_cached_image_request(hwnd: u64, asset_id: u128) -> Result<Vec<u8>> {
+        let mut cached_image = windowcaster::CachedImage::new();
+        cached_image.asset_id = asset_id.to_le_bytes().to_vec();
+
+        let mut render_command = windowcaster::RenderCommand::new();
+        render_command.target_window = hwnd;
+        render_command.set_cached_image(cached_image);
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_render_command(render_command);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// Id an image is cached under on the server: XXH3-128 of the uploaded data, which the
+    /// server recomputes before it keeps the picture.
+    pub fn asset_id(image: &windowcaster::Image) -> u128 {
+        xxhash_rust::xxh3::xxh3_128(&image.data)
+    }
+
+    fn compressed_image_format(file: &[u8]) -> Option<windowcaster::PixelFormat> {
+        if file.starts_with(&[0xFF, 0xD8, 0xFF]) {
+            Some(windowcaster::PixelFormat::PIXEL_FORMAT_JPEG)
+        } else if file.starts_with(b"\x89PNG\r\n\x1a\n") {
+            Some(windowcaster::PixelFormat::PIXEL_FORMAT_PNG)
+        } else if file.starts_with(b"qoif") {
+            Some(windowcaster::PixelFormat::PIXEL_FORMAT_QOI)
+        } else {
+            None
+        }
+    }
+
     pub fn create_video_frame_request(
         hwnd: u64, 
         frame_data: Vec<u8>, 
         width: u32, 
-        height: u32
+        height: u32,
+        sequence: u64,
+        format: &FrameFormat,
+        planes: &[Plane],
     ) -> Result<Vec<u8>> {
 
         let mut video = windowcaster::Video::new();
         video.frame_data = frame_data;
         video.width = width;
         video.height = height;
+        video.pixel_format = EnumOrUnknown::new(format.pixel_format);
+        video.color_matrix = EnumOrUnknown::new(if format.bt709 {
+            windowcaster::ColorMatrix::COLOR_MATRIX_BT709
+        } else {
+            windowcaster::ColorMatrix::COLOR_MATRIX_BT601
+        });
+        video.full_range = format.full_range;
+        video.planes = planes.iter().map(|plane| {
+            let mut layout = windowcaster::PlaneLayout::new();
+            layout.offset = plane.offset;
+            layout.stride = plane.stride;
+            layout
+        }).collect();
 
         let mut render_command = windowcaster::RenderCommand::new();
         render_command.target_window = hwnd;
+        render_command.sequence = sequence;
         render_command.set_video(video);
 
         let mut request = windowcaster::ClientRequest::new();
@@ -60,6 +164,180 @@ impl Protocol {
         Ok(request.write_to_bytes()?)
     }
 
+    /// The parts of a frame that changed, applied by the server onto the picture the window
+    /// already shows. An empty list changes nothing. Region data is RGB24 or, with
+    /// PIXEL_FORMAT_SCREEN, screen-encoded.
+    pub fn create_region_update_request(
+        hwnd: u64,
+        width: u32,
+        height: u32,
+        sequence: u64,
+        regions: Vec<Region>,
+        pixel_format: windowcaster::PixelFormat,
+    ) -> Result<Vec<u8>> {
+        let mut update = windowcaster::RegionUpdate::new();
+        update.width = width;
+        update.height = height;
+        update.rects = regions.into_iter().map(|region| {
+            let mut rect = windowcaster::DirtyRect::new();
+            rect.x = region.x;
+            rect.y = region.y;
+            rect.width = region.width;
+            rect.height = region.height;
+            rect.data = region.data;
+            rect.pixel_format = EnumOrUnknown::new(pixel_format);
+            rect
+        }).collect();
+
+        let mut render_command = windowcaster::RenderCommand::new();
+        render_command.target_window = hwnd;
+        render_command.sequence = sequence;
+        render_command.set_region_update(update);
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_render_command(render_command);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// A compressed video packet (Annex-B access unit) for the server to decode.
+    pub fn create_encoded_video_request(
+        hwnd: u64,
+        codec: windowcaster::VideoCodec,
+        data: Vec<u8>,
+        sequence: u64,
+    ) -> Result<Vec<u8>> {
+        let mut video = windowcaster::EncodedVideo::new();
+        video.codec = EnumOrUnknown::new(codec);
+        video.data = data;
+
+        let mut render_command = windowcaster::RenderCommand::new();
+        render_command.target_window = hwnd;
+        render_command.sequence = sequence;
+        render_command.set_encoded_video(video);
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_render_command(render_command);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// Enables or disables streaming mode. Zero intervals leave the choice to the server.
+    /// Compressions the client would like to use are offered to the server, which answers
+    /// with the ones it accepts.
+    pub fn create_stream_config_request(
+        enabled: bool,
+        ack_every_frames: u32,
+        ack_interval_ms: u32,
+        compression: &[Compression],
+    ) -> Result<Vec<u8>> {
+        let mut config = windowcaster::StreamConfig::new();
+        config.enabled = enabled;
+        config.ack_every_frames = ack_every_frames;
+        config.ack_interval_ms = ack_interval_ms;
+        config.compression = compression.iter().map(|compression| EnumOrUnknown::new(compression.to_proto())).collect();
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_stream_config(config);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// One chunk of a media file uploaded for server-side playback. Chunks go in order;
+    /// the one at offset 0 starts the upload over.
+    pub fn create_media_upload_request(media_id: u64, total_size: u64, offset: u64, data: &[u8]) -> Result<Vec<u8>> {
+        let mut upload = windowcaster::MediaUpload::new();
+        upload.media_id = media_id;
+        upload.total_size = total_size;
+        upload.offset = offset;
+        upload.data = data.to_vec();
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_media_upload(upload);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// Controls server-side playback on a window. PLAY plays the upload `media_id`, or the file
+    /// at `path` in the server's media directory when a path is given; `position_ms` is where
+    /// PLAY starts and where SEEK goes.
+    pub fn create_playback_request(
+        hwnd: u64,
+        action: windowcaster::PlaybackAction,
+        media_id: u64,
+        path: &str,
+        looped: bool,
+        position_ms: u64,
+    ) -> Result<Vec<u8>> {
+        let mut playback = windowcaster::Playback::new();
+        playback.target_window = hwnd;
+        playback.action = EnumOrUnknown::new(action);
+        playback.media_id = media_id;
+        playback.path = path.to_string();
+        playback.loop_ = looped;
+        playback.position_ms = position_ms;
+
+        let mut request = windowcaster::ClientRequest::new();
+        request.set_playback(playback);
+
+        Ok(request.write_to_bytes()?)
+    }
+
+    /// Id a media file is uploaded under: XXH3-64 of its content, so that playing the same
+    /// file again finds it on the server.
+    pub fn media_id(file: &[u8]) -> u64 {
+        xxhash_rust::xxh3::xxh3_64(file)
+    }
+
+    /// Header of a video frame sent over the raw frame channel. Planes left out
+    /// are laid out tightly after the previous one.
+    pub fn create_raw_frame_header(
+        hwnd: u64,
+        width: u32,
+        height: u32,
+        sequence: u64,
+        format: &FrameFormat,
+        planes: &[Plane],
+    ) -> [u8; RAW_FRAME_HEADER_SIZE] {
+        let mut header = [0u8; RAW_FRAME_HEADER_SIZE];
+        header[0..4].copy_from_slice(&RAW_FRAME_MAGIC.to_le_bytes());
+        header[4..6].copy_from_slice(&(RAW_FRAME_VERSION as u16).to_le_bytes());
+        header[6..8].copy_from_slice(&(RAW_FRAME_HEADER_SIZE as u16).to_le_bytes());
+        header[8..16].copy_from_slice(&hwnd.to_le_bytes());
+        header[16..24].copy_from_slice(&sequence.to_le_bytes());
+        header[24..28].copy_from_slice(&width.to_le_bytes());
+        header[28..32].copy_from_slice(&height.to_le_bytes());
+        // Plane 0's stride sits where version 1 kept the single stride
+        if let Some(plane) = planes.first() {
+            header[32..36].copy_from_slice(&plane.stride.to_le_bytes());
+        }
+        header[36..38].copy_from_slice(&(format.pixel_format as u16).to_le_bytes());
+        let mut flags = RAW_FRAME_FLAG_VIDEO;
+        if format.bt709 {
+            flags |= RAW_FRAME_FLAG_BT709;
+        }
+        if format.full_range {
+            flags |= RAW_FRAME_FLAG_FULL_RANGE;
+        }
+        header[38..40].copy_from_slice(&flags.to_le_bytes());
+        for (index, plane) in planes.iter().take(3).enumerate() {
+            let offset = 40 + index * 4;
+            header[offset..offset + 4].copy_from_slice(&plane.offset.to_le_bytes());
+            if index > 0 {
+                let stride = 52 + (index - 1) * 4;
+                header[stride..stride + 4].copy_from_slice(&plane.stride.to_le_bytes());
+            }
+        }
+        header
+    }
+
+    /// Marks a raw frame header as carrying a compressed payload of `raw_size` bytes once decompressed.
+    pub fn set_raw_frame_compression(header: &mut [u8; RAW_FRAME_HEADER_SIZE], compression: Compression, raw_size: u32) {
+        let flags = u16::from_le_bytes([header[38], header[39]]) | ((compression.wire_id() as u16) << RAW_FRAME_COMPRESSION_SHIFT);
+        header[38..40].copy_from_slice(&flags.to_le_bytes());
+        header[60..64].copy_from_slice(&raw_size.to_le_bytes());
+    }
+
     pub fn parse_server_response(data: &[u8]) -> Result<windowcaster::ServerResponse> {
         Ok(windowcaster::ServerResponse::parse_from_bytes(data)
             .context("Failed to parse server response")?)
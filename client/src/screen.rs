@@ -0,0 +1,183 @@
+const MAGIC: u32 = 0x4353_4357;
+const TILE_SIZE: usize = 64;
+const MAX_PALETTE_COLORS: usize = 256;
+const MAX_LITERAL_RUN: usize = 128;
+const RUN_FLAG: u8 = 0x80;
+const LONG_RUN: usize = 0x7F;
+
+const MODE_RAW: u8 = 0;
+const MODE_SOLID: u8 = 1;
+const MODE_PALETTE: u8 = 2;
+
+const SLOT_BITS: u32 = 9;
+const SLOTS: usize = 1 << SLOT_BITS;
+const EMPTY_SLOT: u16 = u16::MAX;
+
+/// Encodes an RGB24 picture whose rows are `stride` bytes apart as PIXEL_FORMAT_SCREEN
+/// (lossless screen content, see Server/screen_codec.h). Every 64x64 tile is stored as one
+/// colour, as a palette with run-length coded indices, or as plain pixels, whichever is
+/// smallest, so UI and text come out many times smaller than RGB24 without the smearing of
+/// a lossy video codec. The output matches the server's reference encoder byte for byte.
+pub fn encode_rgb24(rgb: &[u8], stride: usize, width: usize, height: usize) -> Vec<u8> {
+    let mut out = Vec::with_capacity(width * height / 4 + 12);
+    out.extend_from_slice(&MAGIC.to_le_bytes());
+    out.extend_from_slice(&(width as u32).to_le_bytes());
+    out.extend_from_slice(&(height as u32).to_le_bytes());
+
+    let mut tile = TileEncoder::new();
+    for top in (0..height).step_by(TILE_SIZE) {
+        let tile_height = TILE_SIZE.min(height - top);
+        for left in (0..width).step_by(TILE_SIZE) {
+            let tile_width = TILE_SIZE.min(width - left);
+            tile.encode(&rgb[top * stride + left * 3..], stride, tile_width, tile_height, &mut out);
+        }
+    }
+    out
+}
+
+/// Scratch space reused from tile to tile.
+struct TileEncoder {
+    /// Pixels as 0xFFRRGGBB, the way the server keys its palette.
+    pixels: Vec<u32>,
+    indices: Vec<u8>,
+    palette: Vec<u32>,
+    slots: Vec<u16>,
+}
+
+impl TileEncoder {
+    fn new() -> Self {
+        Self {
+            pixels: Vec::with_capacity(TILE_SIZE * TILE_SIZE),
+            indices: Vec::with_capacity(TILE_SIZE * TILE_SIZE),
+            palette: Vec::with_capacity(MAX_PALETTE_COLORS),
+            slots: vec![EMPTY_SLOT; SLOTS],
+        }
+    }
+
+    fn encode(&mut self, rgb: &[u8], stride: usize, width: usize, height: usize, out: &mut Vec<u8>) {
+        self.pixels.clear();
+        for y in 0..height {
+            let row = &rgb[y * stride..y * stride + width * 3];
+            self.pixels.extend(row.chunks_exact(3).map(|px| {
+                0xFF00_0000 | (u32::from(px[0]) << 16) | (u32::from(px[1]) << 8) | u32::from(px[2])
+            }));
+        }
+
+        if self.build_palette() {
+            if self.palette.len() == 1 {
+                out.push(MODE_SOLID);
+                write_color(out, self.palette[0]);
+                return;
+            }
+
+            let start = out.len();
+            out.push(MODE_PALETTE);
+            out.push((self.palette.len() - 1) as u8);
+            for &color in &self.palette {
+                write_color(out, color);
+            }
+            self.write_indices(out);
+
+            // Photographic tiles with a few hundred colours can come out larger than their pixels
+            if out.len() - start < 1 + self.pixels.len() * 3 {
+                return;
+            }
+            out.truncate(start);
+        }
+
+        out.push(MODE_RAW);
+        for &color in &self.pixels {
+            write_color(out, color);
+        }
+    }
+
+    /// Colours in order of first appearance; false once there are more than a palette holds.
+    fn build_palette(&mut self) -> bool {
+        self.palette.clear();
+        self.indices.clear();
+        self.slots.fill(EMPTY_SLOT);
+        for &color in &self.pixels {
+            let mut slot = (color.wrapping_mul(0x9E37_79B1) >> (32 - SLOT_BITS)) as usize;
+            while self.slots[slot] != EMPTY_SLOT && self.palette[self.slots[slot] as usize] != color {
+                slot = (slot + 1) & (SLOTS - 1);
+            }
+            if self.slots[slot] == EMPTY_SLOT {
+                if self.palette.len() == MAX_PALETTE_COLORS {
+                    return false;
+                }
+                self.slots[slot] = self.palette.len() as u16;
+                self.palette.push(color);
+            }
+            self.indices.push(self.slots[slot] as u8);
+        }
+        true
+    }
+
+    fn write_indices(&self, out: &mut Vec<u8>) {
+        let bits = index_bits(self.palette.len());
+        // Runs shorter than this cost more than the packed literals they replace
+        let minimum_run = (24 / bits).max(3);
+        let indices = &self.indices;
+        let mut literal_start = 0;
+        let mut i = 0;
+        while i < indices.len() {
+            let run = indices[i..].iter().take_while(|&&index| index == indices[i]).count();
+            if run >= minimum_run {
+                write_literals(out, &indices[literal_start..i], bits);
+                write_run(out, indices[i], run);
+                literal_start = i + run;
+            }
+            i += run;
+        }
+        write_literals(out, &indices[literal_start..], bits);
+    }
+}
+
+fn index_bits(colors: usize) -> usize {
+    match colors {
+        0..=2 => 1,
+        3..=4 => 2,
+        5..=16 => 4,
+        _ => 8,
+    }
+}
+
+/// Writes a colour as B, G, R.
+fn write_color(out: &mut Vec<u8>, color: u32) {
+    out.extend_from_slice(&color.to_le_bytes()[..3]);
+}
+
+fn write_literals(out: &mut Vec<u8>, indices: &[u8], bits: usize) {
+    for chunk in indices.chunks(MAX_LITERAL_RUN) {
+        out.push((chunk.len() - 1) as u8);
+        let mut accumulator = 0u32;
+        let mut pending = 0;
+        for &index in chunk {
+            accumulator = (accumulator << bits) | u32::from(index);
+            pending += bits;
+            if pending == 8 {
+                out.push(accumulator as u8);
+                accumulator = 0;
+                pending = 0;
+            }
+        }
+        if pending > 0 {
+            out.push((accumulator << (8 - pending)) as u8);
+        }
+    }
+}
+
+fn write_run(out: &mut Vec<u8>, index: u8, length: usize) {
+    if length <= LONG_RUN {
+        out.push(RUN_FLAG | (length - 1) as u8);
+    } else {
+        out.push(RUN_FLAG | LONG_RUN as u8);
+        let mut extra = length - (LONG_RUN + 1);
+        while extra >= 255 {
+            out.push(255);
+            extra -= 255;
+        }
+        out.push(extra as u8);
+    }
+    out.push(index);
+}
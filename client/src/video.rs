@@ -1,22 +1,230 @@
 use anyhow::{Result, Context};
 use ffmpeg_next as ffmpeg;
 use std::path::Path;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
 use std::time::Duration;
 use indicatif::{ProgressBar, ProgressStyle};
-use tracing::{info, warn};
-use crate::network::NetworkClient;
-use crate::proto::Protocol;
+use tokio::sync::watch;
+use tokio::task::JoinHandle;
+use tracing::{debug, info, warn};
+use crate::annexb::AnnexBWriter;
+use crate::compression::Compression;
+use crate::dirty::DirtyTracker;
+use crate::network::{MessageReader, MessageWriter, NetworkClient};
+use crate::proto::{windowcaster, FrameFormat, Plane, Protocol, RAW_FRAME_HEADER_SIZE, RAW_FRAME_VERSION};
+use crate::screen;
+
+/// Credit the server advertised for each target window. Frames in flight (sent but
+/// not yet released by the server) must stay within it.
+#[derive(Clone, Copy)]
+struct CreditLimit {
+    frames: u64,
+    bytes: u64,
+}
+
+/// Sending side of a streaming session; acknowledgements are consumed by a background task.
+struct FrameStream {
+    writer: MessageWriter,
+    acks: JoinHandle<Result<()>>,
+    /// None when the server does not do flow control.
+    limit: Option<CreditLimit>,
+    /// Frames and bytes the server has released so far, as (frames, bytes).
+    released: watch::Receiver<(u64, u64)>,
+    sent_frames: u64,
+    sent_bytes: u64,
+    /// Whether the server accepts pixels over the raw frame channel.
+    raw_frames: bool,
+    /// Set when the server asks for a keyframe for the target window.
+    keyframe_wanted: Arc<AtomicBool>,
+    /// Compression the server accepted for frame data.
+    compression: Option<Compression>,
+}
+
+impl FrameStream {
+    /// Sends a frame once the credit window has room for it. Frames that are already
+    /// compressed (H.264/HEVC packets) are not worth compressing again.
+    async fn send_frame(&mut self, request: &[u8], compressible: bool) -> Result<()> {
+        // Credit is charged for the decompressed size, which is what the server holds on to
+        self.wait_for_credit(request.len() as u64).await?;
+        let compressed = self.compression.filter(|_| compressible)
+            .and_then(|compression| Some((compression, compression.compress(request)?)));
+        match compressed {
+            Some((compression, data)) => self.writer.send_compressed_message(compression, request.len() as u32, &data).await?,
+            None => self.writer.send_message(request).await?,
+        }
+        self.record_sent(request.len() as u64);
+        Ok(())
+    }
+
+    /// Sends a frame over the raw frame channel once the credit window has room for it.
+    async fn send_raw_frame(&mut self, mut header: [u8; RAW_FRAME_HEADER_SIZE], planes: &[&[u8]]) -> Result<()> {
+        // The server charges the header and the pixels, like the whole message on the protobuf path
+        let payload_size = planes.iter().map(|plane| plane.len()).sum::<usize>();
+        let size = (header.len() + payload_size) as u64;
+        self.wait_for_credit(size).await?;
+        let compressed = self.compression
+            .and_then(|compression| Some((compression, compression.compress(&planes.concat())?)));
+        match compressed {
+            Some((compression, data)) => {
+                Protocol::set_raw_frame_compression(&mut header, compression, payload_size as u32);
+                self.writer.send_raw_frame(&header, &[&data]).await?;
+            }
+            None => self.writer.send_raw_frame(&header, planes).await?,
+        }
+        self.record_sent(size);
+        Ok(())
+    }
+
+    async fn wait_for_credit(&mut self, size: u64) -> Result<()> {
+        if let Some(limit) = self.limit {
+            loop {
+                let (released_frames, released_bytes) = *self.released.borrow_and_update();
+                let frames_in_flight = self.sent_frames - released_frames;
+                let bytes_in_flight = self.sent_bytes - released_bytes;
+                // Same rule as the server: one oversized frame may go when nothing is in flight
+                if frames_in_flight < limit.frames
+                    && (bytes_in_flight == 0 || bytes_in_flight + size <= limit.bytes) {
+                    break;
+                }
+                self.released.changed().await.context("Acknowledgement reader stopped")?;
+            }
+        }
+        Ok(())
+    }
+
+    fn record_sent(&mut self, size: u64) {
+        self.sent_frames += 1;
+        self.sent_bytes += size;
+    }
+}
 
 pub struct VideoRenderer {
     client: NetworkClient,
     target_window: u64,
+    streaming: bool,
+    /// Send RGB24 instead of I420.
+    rgb: bool,
+    /// Send H.264/HEVC packets for the server to decode.
+    encoded: bool,
+    /// Send only the parts of each frame that changed (RGB24).
+    dirty_rects: bool,
+    /// Send frames and changed regions screen-encoded (lossless, for UI and text).
+    screen_codec: bool,
+    /// Compression to ask the server for when streaming.
+    compression: Option<Compression>,
 }
 
 impl VideoRenderer {
-    pub fn new(client: NetworkClient, target_window: u64) -> Self {
+    pub fn new(
+        client: NetworkClient,
+        target_window: u64,
+        streaming: bool,
+        rgb: bool,
+        encoded: bool,
+        dirty_rects: bool,
+        screen_codec: bool,
+        compression: Option<Compression>,
+    ) -> Self {
         Self {
             client,
             target_window,
+            streaming,
+            rgb,
+            encoded,
+            dirty_rects,
+            screen_codec,
+            compression,
+        }
+    }
+
+    /// Asks the server to acknowledge frames cumulatively. Returns None when the
+    /// server does not support streaming, in which case every frame is answered.
+    async fn open_stream(&mut self) -> Result<Option<FrameStream>> {
+        let offered: Vec<Compression> = self.compression.into_iter().collect();
+        let request = Protocol::create_stream_config_request(true, 0, 0, &offered)?;
+        self.client.send_message(&request).await?;
+
+        let response = self.client.receive_message().await?;
+        let server_response = Protocol::parse_server_response(&response)?;
+        if !server_response.status.as_ref().map_or(false, |status| status.success) {
+            info!("Server does not support streaming, waiting for a reply to every frame");
+            return Ok(None);
+        }
+
+        let limit = server_response.credit_window.as_ref()
+            .filter(|window| window.frames > 0)
+            .map(|window| CreditLimit { frames: window.frames as u64, bytes: window.bytes });
+        let raw_frames = server_response.raw_frame_version == RAW_FRAME_VERSION;
+        if raw_frames {
+            info!("Sending pixels over the raw frame channel");
+        }
+        // Servers without transport compression leave the list empty
+        let compression = self.compression.filter(|compression| {
+            server_response.compression.iter().any(|accepted| accepted.enum_value() == Ok(compression.to_proto()))
+        });
+        match (self.compression, compression) {
+            (Some(requested), None) => warn!("Server does not accept {:?} compression, sending frames uncompressed", requested),
+            (_, Some(compression)) => info!("Compressing frames with {:?}", compression),
+            _ => {}
+        }
+
+        let (reader, writer) = self.client.split()?;
+        let (released_tx, released) = watch::channel((0u64, 0u64));
+        let keyframe_wanted = Arc::new(AtomicBool::new(false));
+        let acks = tokio::spawn(Self::receive_acks(reader, self.target_window, released_tx, keyframe_wanted.clone()));
+        Ok(Some(FrameStream {
+            writer,
+            acks,
+            limit,
+            released,
+            sent_frames: 0,
+            sent_bytes: 0,
+            raw_frames,
+            keyframe_wanted,
+            compression,
+        }))
+    }
+
+    /// Reports acknowledged failures and credit grants until the reply that closes the stream arrives.
+    async fn receive_acks(
+        mut reader: MessageReader,
+        target_window: u64,
+        released: watch::Sender<(u64, u64)>,
+        keyframe_wanted: Arc<AtomicBool>,
+    ) -> Result<()> {
+        loop {
+            let response = reader.receive_message().await?;
+            let server_response = Protocol::parse_server_response(&response)?;
+
+            // Grant totals are cumulative and may arrive out of order
+            for grant in server_response.credits.iter().filter(|grant| grant.target_window == target_window) {
+                released.send_if_modified(|totals| {
+                    let updated = (totals.0.max(grant.frames), totals.1.max(grant.bytes));
+                    let changed = updated != *totals;
+                    *totals = updated;
+                    changed
+                });
+            }
+
+            if server_response.keyframe_requests.iter().any(|request| request.target_window == target_window) {
+                keyframe_wanted.store(true, Ordering::Relaxed);
+            }
+
+            if let Some(ack) = server_response.stream_ack.as_ref() {
+                if ack.failed_frames > 0 {
+                    warn!("Failed to render {} frame(s), last {}: {}",
+                        ack.failed_frames, ack.error_sequence, String::from_utf8_lossy(&ack.error));
+                } else if !ack.error.is_empty() {
+                    warn!("Failed to render frame {}: {}", ack.error_sequence, String::from_utf8_lossy(&ack.error));
+                }
+                debug!("Server acknowledged frame {} (presented {})", ack.sequence, ack.presented_sequence);
+            }
+
+            // Periodic acks carry no status; only the reply to closing the stream does
+            if server_response.status.is_some() {
+                return Ok(());
+            }
         }
     }
 
@@ -35,6 +243,23 @@ impl VideoRenderer {
             .context("No video stream found in the file")?;
         let video_stream_index = video_stream.index();
 
+        // Create progress bar
+        let total_frames = video_stream.frames() as u64;
+        let pb = ProgressBar::new(total_frames);
+        pb.set_style(ProgressStyle::default_bar()
+            .template("{spinner:.green} [{elapsed_precise}] [{bar:40.cyan/blue}] {pos}/{len} ({eta})")
+            .unwrap()
+            .progress_chars("#>-"));
+
+        if self.encoded {
+            if let Some((codec, writer)) = Self::encoded_stream(&video_stream)? {
+                self.send_encoded(&mut input, video_stream_index, codec, &writer, &pb).await?;
+                pb.finish_with_message("Video rendering completed");
+                return Ok(());
+            }
+            warn!("The server only decodes H.264 and HEVC, decoding the video locally");
+        }
+
         // Create the decoder
         let context_decoder = ffmpeg::codec::context::Context::from_parameters(video_stream.parameters())?;
         let mut decoder = context_decoder.decoder().video()?;
@@ -44,66 +269,126 @@ impl VideoRenderer {
         let height = decoder.height();
         info!("Video dimensions: {}x{}", width, height);
 
-        // Create progress bar
-        let total_frames = video_stream.frames() as u64;
-        let pb = ProgressBar::new(total_frames);
-        pb.set_style(ProgressStyle::default_bar()
-            .template("{spinner:.green} [{elapsed_precise}] [{bar:40.cyan/blue}] {pos}/{len} ({eta})")
-            .unwrap()
-            .progress_chars("#>-"));
+        // I420 is half the size of RGB24 and is what most decoders produce already;
+        // the server converts it to RGB
+        // Changed tiles are compared, and screen encoding done, on RGB24
+        let (output_format, pixel_format) = if self.rgb || self.dirty_rects || self.screen_codec {
+            (ffmpeg::format::Pixel::RGB24, windowcaster::PixelFormat::PIXEL_FORMAT_RGB24)
+        } else {
+            (ffmpeg::format::Pixel::YUV420P, windowcaster::PixelFormat::PIXEL_FORMAT_I420)
+        };
+        let format = FrameFormat {
+            pixel_format,
+            bt709: decoder.color_space() == ffmpeg::color::Space::BT709,
+            full_range: decoder.color_range() == ffmpeg::color::Range::JPEG,
+        };
+        let screen_format = FrameFormat {
+            pixel_format: windowcaster::PixelFormat::PIXEL_FORMAT_SCREEN,
+            ..format
+        };
+        let region_format = if self.screen_codec {
+            windowcaster::PixelFormat::PIXEL_FORMAT_SCREEN
+        } else {
+            windowcaster::PixelFormat::PIXEL_FORMAT_RGB24
+        };
 
-        // Create the scaler to convert frames to RGB format
-        let mut scaler = ffmpeg::software::scaling::context::Context::get(
-            decoder.format(),
-            width,
-            height,
-            ffmpeg::format::Pixel::RGB24,
-            width,
-            height,
-            ffmpeg::software::scaling::flag::Flags::BILINEAR,
-        )?;
+        // Only convert when the decoder output is not already in the format we send
+        let mut scaler = if decoder.format() != output_format {
+            Some(ffmpeg::software::scaling::context::Context::get(
+                decoder.format(),
+                width,
+                height,
+                output_format,
+                width,
+                height,
+                ffmpeg::software::scaling::flag::Flags::BILINEAR,
+            )?)
+        } else {
+            None
+        };
+
+        // Send frames back to back if the server acknowledges them cumulatively
+        let mut frame_stream = if self.streaming { self.open_stream().await? } else { None };
 
         // Read and process each frame
         let mut frame_index = 0u32;
         let mut receive_frame = ffmpeg::frame::Video::empty();
-        let mut rgb_frame = ffmpeg::frame::Video::new(
-            ffmpeg::format::Pixel::RGB24,
-            width,
-            height,
-        );
+        let mut converted_frame = ffmpeg::frame::Video::new(output_format, width, height);
+        let mut dirty_tracker = self.dirty_rects.then(|| DirtyTracker::new(width, height));
 
         for (stream, packet) in input.packets() {
             if stream.index() == video_stream_index {
                 decoder.send_packet(&packet)?;
                 
                 while decoder.receive_frame(&mut receive_frame).is_ok() {
-                    // Convert to RGB format
-                    scaler.run(&receive_frame, &mut rgb_frame)?;
-                    
-                    // Get frame data
-                    let frame_data = rgb_frame.data(0).to_vec();
-                    
-                    // Send frame data to the server using actual width and height
-                    let request = Protocol::create_video_frame_request(
-                        self.target_window,
-                        frame_data,
-                        width,  // pass video frame width
-                        height, // pass video frame height
-                    )?;
-                    
-                    self.client.send_message(&request).await?;
-                    
-                    // Wait for the server response
-                    let response = self.client.receive_message().await?;
-                    let server_response = Protocol::parse_server_response(&response)?;
-                    if let Some(status) = server_response.status.as_ref() {
-                        if !status.success {
-                            warn!("Failed to render frame {}: {}", frame_index,  String::from_utf8_lossy(&status.message));
+                    let frame = match scaler.as_mut() {
+                        Some(scaler) => {
+                            scaler.run(&receive_frame, &mut converted_frame)?;
+                            &converted_frame
+                        }
+                        None => &receive_frame,
+                    };
+                    // Decoder buffers go out as they are; the plane table tells the server about row padding
+                    let (data, planes) = Self::frame_planes(frame);
+
+                    let sequence = frame_index as u64 + 1;
+                    let regions = dirty_tracker.as_mut().and_then(|tracker| tracker.update(data[0], planes[0].stride as usize));
+                    if let Some(mut regions) = regions {
+                        if self.screen_codec {
+                            for region in &mut regions {
+                                let (region_width, region_height) = (region.width as usize, region.height as usize);
+                                region.data = screen::encode_rgb24(&region.data, region_width * 3, region_width, region_height);
+                            }
+                        }
+                        let request = Protocol::create_region_update_request(
+                            self.target_window, width, height, sequence, regions, region_format)?;
+                        match frame_stream.as_mut() {
+                            Some(frame_stream) => frame_stream.send_frame(&request, true).await?,
+                            None => self.send_and_wait(&request, frame_index).await?,
                         }
                     } else {
-                        warn!("Server response has no status field");
+                        // A screen-encoded frame is a single buffer that carries its own size
+                        let encoded_frame;
+                        let (data, planes, format) = if self.screen_codec {
+                            encoded_frame = screen::encode_rgb24(data[0], planes[0].stride as usize, width as usize, height as usize);
+                            (vec![&encoded_frame[..]], Vec::new(), &screen_format)
+                        } else {
+                            (data, planes, &format)
+                        };
+                        match frame_stream.as_mut() {
+                            Some(frame_stream) if frame_stream.raw_frames => {
+                                let header = Protocol::create_raw_frame_header(
+                                    self.target_window, width, height, sequence, format, &planes);
+                                frame_stream.send_raw_frame(header, &data).await?;
+                            }
+                            Some(frame_stream) => {
+                                let request = Protocol::create_video_frame_request(
+                                    self.target_window,
+                                    data.concat(),
+                                    width,
+                                    height,
+                                    sequence,
+                                    format,
+                                    &planes,
+                                )?;
+                                frame_stream.send_frame(&request, true).await?;
+                            }
+                            None => {
+                                // Send frame data to the server using actual width and height
+                                let request = Protocol::create_video_frame_request(
+                                    self.target_window,
+                                    data.concat(),
+                                    width,  // pass video frame width
+                                    height, // pass video frame height
+                                    sequence,
+                                    format,
+                                    &planes,
+                                )?;
+                                self.send_and_wait(&request, frame_index).await?;
+                            }
+                        }
                     }
-                    
+
                     frame_index += 1;
                     pb.inc(1);
                     
@@ -113,16 +398,143 @@ impl VideoRenderer {
             }
         }
 
-        // Send the final frame (an empty frame) to signal the end of video
-        let request = Protocol::create_video_frame_request(
-            self.target_window,
-            Vec::new(),
-            width,
-            height,
-        )?;
-        self.client.send_message(&request).await?;
+        if let Some(frame_stream) = frame_stream {
+            Self::close_stream(frame_stream).await?;
+        } else {
+            // Send the final frame (an empty frame) to signal the end of video
+            let request = Protocol::create_video_frame_request(
+                self.target_window,
+                Vec::new(),
+                width,
+                height,
+                frame_index as u64 + 1,
+                &format,
+                &[],
+            )?;
+            self.client.send_message(&request).await?;
+        }
 
         pb.finish_with_message("Video rendering completed");
         Ok(())
     }
+
+    /// Sends a frame and waits for the server to answer it.
+    async fn send_and_wait(&mut self, request: &[u8], frame_index: u32) -> Result<()> {
+        self.client.send_message(request).await?;
+
+        // Wait for the server response
+        let response = self.client.receive_message().await?;
+        let server_response = Protocol::parse_server_response(&response)?;
+        if let Some(status) = server_response.status.as_ref() {
+            if !status.success {
+                warn!("Failed to render frame {}: {}", frame_index,  String::from_utf8_lossy(&status.message));
+            }
+        } else {
+            warn!("Server response has no status field");
+        }
+        Ok(())
+    }
+
+    /// Closing the stream flushes a final acknowledgement.
+    async fn close_stream(mut frame_stream: FrameStream) -> Result<()> {
+        let request = Protocol::create_stream_config_request(false, 0, 0, &[])?;
+        frame_stream.writer.send_message(&request).await?;
+        frame_stream.acks.await.context("Acknowledgement reader failed")??;
+        Ok(())
+    }
+
+    /// The codec to announce and the Annex-B rewriter for a stream the server can decode.
+    fn encoded_stream(stream: &ffmpeg::Stream) -> Result<Option<(windowcaster::VideoCodec, AnnexBWriter)>> {
+        let parameters = stream.parameters();
+        let (codec, hevc) = match parameters.id() {
+            ffmpeg::codec::Id::H264 => (windowcaster::VideoCodec::VIDEO_CODEC_H264, false),
+            ffmpeg::codec::Id::HEVC => (windowcaster::VideoCodec::VIDEO_CODEC_HEVC, true),
+            _ => return Ok(None),
+        };
+        let extradata = unsafe {
+            let raw = parameters.as_ptr();
+            if (*raw).extradata.is_null() || (*raw).extradata_size <= 0 {
+                &[][..]
+            } else {
+                std::slice::from_raw_parts((*raw).extradata, (*raw).extradata_size as usize)
+            }
+        };
+        Ok(Some((codec, AnnexBWriter::new(hevc, extradata)?)))
+    }
+
+    /// Sends the stream's packets undecoded. A file cannot produce a keyframe on demand, so
+    /// when the server asks for one the packets up to the next keyframe are skipped.
+    async fn send_encoded(
+        &mut self,
+        input: &mut ffmpeg::format::context::Input,
+        stream_index: usize,
+        codec: windowcaster::VideoCodec,
+        writer: &AnnexBWriter,
+        pb: &ProgressBar,
+    ) -> Result<()> {
+        info!("Sending {:?} packets for the server to decode", codec);
+        let mut frame_stream = if self.streaming { self.open_stream().await? } else { None };
+        let mut skip_to_keyframe = false;
+        let mut sequence = 0u64;
+
+        for (stream, packet) in input.packets() {
+            if stream.index() != stream_index {
+                continue;
+            }
+            let Some(data) = packet.data() else {
+                continue;
+            };
+            pb.inc(1);
+
+            if frame_stream.as_ref().map_or(false, |frame_stream| frame_stream.keyframe_wanted.swap(false, Ordering::Relaxed)) {
+                skip_to_keyframe = true;
+            }
+            if skip_to_keyframe && !packet.is_key() {
+                continue;
+            }
+            skip_to_keyframe = false;
+
+            sequence += 1;
+            let data = writer.convert(data, packet.is_key())?;
+            let request = Protocol::create_encoded_video_request(self.target_window, codec, data.into_owned(), sequence)?;
+            match frame_stream.as_mut() {
+                Some(frame_stream) => frame_stream.send_frame(&request, false).await?,
+                None => {
+                    self.client.send_message(&request).await?;
+                    let response = self.client.receive_message().await?;
+                    let server_response = Protocol::parse_server_response(&response)?;
+                    if let Some(status) = server_response.status.as_ref() {
+                        if !status.success {
+                            warn!("Failed to render frame {}: {}", sequence, String::from_utf8_lossy(&status.message));
+                        }
+                    }
+                    skip_to_keyframe = !server_response.keyframe_requests.is_empty();
+                }
+            }
+            if skip_to_keyframe {
+                debug!("Server asked for a keyframe, skipping to the next one");
+            }
+
+            // Add a small delay to control the frame rate (approximately 30fps)
+            tokio::time::sleep(Duration::from_millis(33)).await;
+        }
+
+        if let Some(frame_stream) = frame_stream {
+            Self::close_stream(frame_stream).await?;
+        }
+        Ok(())
+    }
+
+    /// The planes of a frame with their rows as the decoder laid them out, and where
+    /// each one lands when they are sent back to back.
+    fn frame_planes(frame: &ffmpeg::frame::Video) -> (Vec<&[u8]>, Vec<Plane>) {
+        let data: Vec<&[u8]> = (0..frame.planes()).map(|index| frame.data(index)).collect();
+        let mut offset = 0;
+        let planes = data.iter().enumerate().map(|(index, plane)| {
+            let layout = Plane { offset: offset as u32, stride: frame.stride(index) as u32 };
+            offset += plane.len();
+            layout
+        }).collect();
+        (data, planes)
+    }
 }